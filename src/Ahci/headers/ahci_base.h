@@ -0,0 +1,7 @@
+#pragma once
+
+#include "common_lib.h"
+#include "log.h"
+#include "io.h"
+#include "ahci_registers.h"
+#include "ahci_structures.h"
@@ -0,0 +1,31 @@
+#pragma once
+
+// ATA commands issued through the AHCI command tables
+
+#define AHCI_ATA_CMD_READ_DMA_EXT               0x25
+#define AHCI_ATA_CMD_WRITE_DMA_EXT              0x35
+
+// Native Command Queuing: the sector count is placed in the features
+// register and the tag in bits 7:3 of the count register
+#define AHCI_ATA_CMD_READ_FPDMA_QUEUED          0x60
+#define AHCI_ATA_CMD_WRITE_FPDMA_QUEUED         0x61
+
+#define AHCI_ATA_CMD_IDENTIFY                   0xEC
+
+#define AHCI_ATA_NCQ_TAG_SHIFT                  3
+
+// bit 6 of the device register selects LBA addressing
+#define AHCI_ATA_DEVICE_LBA                     (1<<6)
+
+// a sector count of 0 written to the device means 65536 sectors
+#define AHCI_MAX_SECTORS_PER_COMMAND            0x10000
+
+// IDENTIFY DEVICE response words we are interested in
+#define AHCI_IDENTIFY_WORD_QUEUE_DEPTH          75
+#define AHCI_IDENTIFY_WORD_SATA_CAPABILITIES    76
+#define AHCI_IDENTIFY_WORD_COMMAND_SET_2        83
+#define AHCI_IDENTIFY_WORD_MAX_LBA48            100
+
+#define AHCI_IDENTIFY_QUEUE_DEPTH_MASK          0x1F
+#define AHCI_IDENTIFY_SATA_CAP_NCQ              (1<<8)
+#define AHCI_IDENTIFY_COMMAND_SET_2_LBA48       (1<<10)
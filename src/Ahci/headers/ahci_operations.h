@@ -0,0 +1,81 @@
+#pragma once
+
+//******************************************************************************
+// Function:     AhciInitializeController
+// Description:  Maps the HBA registers, enables AHCI mode and reads the
+//               capabilities of the controller. The interrupts of the HBA
+//               remain disabled until AhciStartController is called.
+// Returns:      STATUS
+// Parameter:    IN PPCI_DEVICE_DESCRIPTION PciDevice
+// Parameter:    OUT PAHCI_CONTROLLER Controller
+//******************************************************************************
+STATUS
+AhciInitializeController(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT         PAHCI_CONTROLLER            Controller
+    );
+
+//******************************************************************************
+// Function:     AhciInitializePort
+// Description:  Allocates the command list, received FIS area and command
+//               tables of the port, starts its command engine and identifies
+//               the attached device.
+// Returns:      STATUS - STATUS_DEVICE_DOES_NOT_EXIST if no SATA disk is
+//               attached to the port.
+// Parameter:    INOUT PAHCI_CONTROLLER Controller
+// Parameter:    IN DWORD PortIndex
+// Parameter:    IN PDEVICE_OBJECT Device - its extension is an AHCI_PORT
+//******************************************************************************
+STATUS
+AhciInitializePort(
+    INOUT       PAHCI_CONTROLLER            Controller,
+    IN          DWORD                       PortIndex,
+    IN          PDEVICE_OBJECT              Device
+    );
+
+void
+AhciUninitializePort(
+    INOUT       PAHCI_PORT                  Port
+    );
+
+//******************************************************************************
+// Function:     AhciStartController
+// Description:  Registers the completion interrupt (MSI if the controller is
+//               capable) and enables the interrupts of the initialized ports.
+// Returns:      STATUS
+// Parameter:    INOUT PAHCI_CONTROLLER Controller
+//******************************************************************************
+STATUS
+AhciStartController(
+    INOUT       PAHCI_CONTROLLER            Controller
+    );
+
+//******************************************************************************
+// Function:     AhciPortTransfer
+// Description:  Transfers SectorCount sectors starting at SectorIndex. The
+//               buffer is described by PRD entries built directly from its
+//               physical pages, the transfer is split over as many command
+//               slots as needed and all of them are issued without waiting
+//               for the previous ones to complete.
+// Returns:      STATUS
+// Parameter:    INOUT PAHCI_PORT Port
+// Parameter:    IN QWORD SectorIndex
+// Parameter:    IN DWORD SectorCount
+// Parameter:    INOUT PVOID Buffer
+// Parameter:    IN BOOLEAN WriteOperation
+// Parameter:    IN_OPT PIRP Irp - if non-NULL it is completed by the interrupt
+//               handler. For asynchronous IRPs the function returns as soon
+//               as all the commands are issued with STATUS_PENDING, else it
+//               returns after the IRP was completed.
+//******************************************************************************
+STATUS
+AhciPortTransfer(
+    INOUT       PAHCI_PORT                  Port,
+    IN          QWORD                       SectorIndex,
+    IN          DWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                PVOID                       Buffer,
+    IN          BOOLEAN                     WriteOperation,
+    IN_OPT      PIRP                        Irp
+    );
@@ -0,0 +1,282 @@
+#pragma once
+
+// Serial ATA AHCI 1.3.1 Specification
+
+// the HBA registers are described by BAR 5 (ABAR)
+#define AHCI_ABAR_INDEX                         5
+
+#define AHCI_MAX_PORTS                          32
+#define AHCI_MAX_SLOTS                          32
+
+#define AHCI_PORT_REGISTERS_OFFSET              0x100
+#define AHCI_PORT_REGISTERS_SIZE                0x80
+#define AHCI_HBA_REGISTERS_SIZE                 (AHCI_PORT_REGISTERS_OFFSET + AHCI_MAX_PORTS * AHCI_PORT_REGISTERS_SIZE)
+
+// CAP - HBA capabilities
+#define AHCI_CAP_NP_MASK                        0x1F
+#define AHCI_CAP_NCS_SHIFT                      8
+#define AHCI_CAP_NCS_MASK                       0x1F
+#define AHCI_CAP_SSS                            (1UL<<27)
+#define AHCI_CAP_SNCQ                           (1UL<<30)
+#define AHCI_CAP_S64A                           (1UL<<31)
+
+// GHC - global HBA control
+#define AHCI_GHC_HR                             (1UL<<0)
+#define AHCI_GHC_IE                             (1UL<<1)
+#define AHCI_GHC_AE                             (1UL<<31)
+
+// PxIS/PxIE - port interrupt status/enable
+#define AHCI_PORT_INT_DHRS                      (1UL<<0)
+#define AHCI_PORT_INT_PSS                       (1UL<<1)
+#define AHCI_PORT_INT_DSS                       (1UL<<2)
+#define AHCI_PORT_INT_SDBS                      (1UL<<3)
+#define AHCI_PORT_INT_UFS                       (1UL<<4)
+#define AHCI_PORT_INT_DPS                       (1UL<<5)
+#define AHCI_PORT_INT_PCS                       (1UL<<6)
+#define AHCI_PORT_INT_OFS                       (1UL<<24)
+#define AHCI_PORT_INT_INFS                      (1UL<<26)
+#define AHCI_PORT_INT_IFS                       (1UL<<27)
+#define AHCI_PORT_INT_HBDS                      (1UL<<28)
+#define AHCI_PORT_INT_HBFS                      (1UL<<29)
+#define AHCI_PORT_INT_TFES                      (1UL<<30)
+
+// if any of these are set all the commands in flight are lost
+#define AHCI_PORT_INT_ERROR_MASK                (AHCI_PORT_INT_OFS | AHCI_PORT_INT_INFS | AHCI_PORT_INT_IFS | \
+                                                 AHCI_PORT_INT_HBDS | AHCI_PORT_INT_HBFS | AHCI_PORT_INT_TFES)
+
+// the interrupts we care about: command completion (D2H register FIS for
+// regular commands, set device bits FIS for NCQ commands) and errors
+#define AHCI_PORT_INT_ENABLE_MASK               (AHCI_PORT_INT_DHRS | AHCI_PORT_INT_SDBS | AHCI_PORT_INT_ERROR_MASK)
+
+// PxCMD - port command and status
+#define AHCI_PORT_CMD_ST                        (1UL<<0)
+#define AHCI_PORT_CMD_SUD                       (1UL<<1)
+#define AHCI_PORT_CMD_POD                       (1UL<<2)
+#define AHCI_PORT_CMD_CLO                       (1UL<<3)
+#define AHCI_PORT_CMD_FRE                       (1UL<<4)
+#define AHCI_PORT_CMD_FR                        (1UL<<14)
+#define AHCI_PORT_CMD_CR                        (1UL<<15)
+
+// PxTFD - task file data, the low byte mirrors the ATA status register
+#define AHCI_PORT_TFD_STS_ERR                   (1UL<<0)
+#define AHCI_PORT_TFD_STS_DRQ                   (1UL<<3)
+#define AHCI_PORT_TFD_STS_BSY                   (1UL<<7)
+
+// PxSSTS - SATA status
+#define AHCI_PORT_SSTS_DET_MASK                 0xF
+#define AHCI_PORT_SSTS_DET_PRESENT              0x3
+#define AHCI_PORT_SSTS_IPM_SHIFT                8
+#define AHCI_PORT_SSTS_IPM_MASK                 0xF
+#define AHCI_PORT_SSTS_IPM_ACTIVE               0x1
+
+// PxSIG - signature of the attached device
+#define AHCI_PORT_SIG_ATA                       0x00000101
+
+#pragma warning(push)
+
+// warning C4201: nonstandard extension used: nameless struct/union
+#pragma warning(disable:4201)
+
+// warning C4214: nonstandard extension used: bit field types other than int
+#pragma warning(disable:4214)
+
+typedef volatile struct _AHCI_PORT_REGISTERS
+{
+    // 0x00
+    DWORD                       CommandListBase;
+    DWORD                       CommandListBaseUpper;
+
+    // 0x08
+    DWORD                       FisBase;
+    DWORD                       FisBaseUpper;
+
+    // 0x10
+    DWORD                       InterruptStatus;
+    DWORD                       InterruptEnable;
+
+    // 0x18
+    DWORD                       Command;
+    DWORD                       __Reserved0;
+
+    // 0x20
+    DWORD                       TaskFileData;
+    DWORD                       Signature;
+
+    // 0x28
+    DWORD                       SataStatus;
+    DWORD                       SataControl;
+
+    // 0x30
+    DWORD                       SataError;
+    DWORD                       SataActive;
+
+    // 0x38
+    DWORD                       CommandIssue;
+    DWORD                       SataNotification;
+
+    // 0x40
+    DWORD                       FisSwitchingControl;
+    DWORD                       __Reserved1[11];
+
+    // 0x70
+    DWORD                       VendorSpecific[4];
+} AHCI_PORT_REGISTERS, *PAHCI_PORT_REGISTERS;
+STATIC_ASSERT(sizeof(AHCI_PORT_REGISTERS) == AHCI_PORT_REGISTERS_SIZE);
+
+typedef volatile struct _AHCI_HBA_REGISTERS
+{
+    // 0x00
+    DWORD                       Capabilities;
+    DWORD                       GlobalHbaControl;
+
+    // 0x08
+    DWORD                       InterruptStatus;
+    DWORD                       PortsImplemented;
+
+    // 0x10
+    DWORD                       Version;
+    DWORD                       CommandCompletionCoalescingControl;
+
+    // 0x18
+    DWORD                       CommandCompletionCoalescingPorts;
+    DWORD                       EnclosureManagementLocation;
+
+    // 0x20
+    DWORD                       EnclosureManagementControl;
+    DWORD                       Capabilities2;
+
+    // 0x28
+    DWORD                       BiosHandoffControl;
+    BYTE                        __Reserved0[0xA0 - 0x2C];
+
+    // 0xA0
+    BYTE                        VendorSpecific[AHCI_PORT_REGISTERS_OFFSET - 0xA0];
+
+    // 0x100
+    AHCI_PORT_REGISTERS         Ports[AHCI_MAX_PORTS];
+} AHCI_HBA_REGISTERS, *PAHCI_HBA_REGISTERS;
+STATIC_ASSERT(sizeof(AHCI_HBA_REGISTERS) == AHCI_HBA_REGISTERS_SIZE);
+
+#pragma pack(push,1)
+
+#define AHCI_FIS_TYPE_REG_H2D                   0x27
+
+// Register - Host to Device FIS
+typedef struct _AHCI_FIS_REG_H2D
+{
+    BYTE                        FisType;
+
+    BYTE                        PortMultiplier  :   4;
+    BYTE                        __Reserved0     :   3;
+
+    // 1 => the FIS carries a command, 0 => it updates the device control register
+    BYTE                        CommandBit      :   1;
+
+    BYTE                        Command;
+    BYTE                        FeatureLow;
+
+    BYTE                        Lba0;
+    BYTE                        Lba1;
+    BYTE                        Lba2;
+    BYTE                        Device;
+
+    BYTE                        Lba3;
+    BYTE                        Lba4;
+    BYTE                        Lba5;
+    BYTE                        FeatureHigh;
+
+    BYTE                        CountLow;
+    BYTE                        CountHigh;
+    BYTE                        Icc;
+    BYTE                        Control;
+
+    BYTE                        __Reserved1[4];
+} AHCI_FIS_REG_H2D, *PAHCI_FIS_REG_H2D;
+STATIC_ASSERT(sizeof(AHCI_FIS_REG_H2D) == 20);
+
+// the FIS the HBA copies from the device, one area per port
+typedef struct _AHCI_RECEIVED_FIS
+{
+    BYTE                        DmaSetupFis[0x20];
+    BYTE                        PioSetupFis[0x20];
+    BYTE                        D2HRegisterFis[0x18];
+    BYTE                        SetDeviceBitsFis[0x08];
+    BYTE                        UnknownFis[0x40];
+    BYTE                        __Reserved[0x60];
+} AHCI_RECEIVED_FIS, *PAHCI_RECEIVED_FIS;
+STATIC_ASSERT(sizeof(AHCI_RECEIVED_FIS) == 0x100);
+
+#define AHCI_RECEIVED_FIS_ALIGNMENT             0x100
+
+// the FIS length is specified in DWORDs
+#define AHCI_CMD_HEADER_CFL                     (sizeof(AHCI_FIS_REG_H2D) / sizeof(DWORD))
+
+typedef struct _AHCI_COMMAND_HEADER
+{
+    WORD                        CommandFisLength    :   5;
+    WORD                        Atapi               :   1;
+    WORD                        Write               :   1;
+    WORD                        Prefetchable        :   1;
+    WORD                        Reset               :   1;
+    WORD                        Bist                :   1;
+    WORD                        ClearBusyUponOk     :   1;
+    WORD                        __Reserved0         :   1;
+    WORD                        PortMultiplier      :   4;
+
+    // number of entries in the PRD table
+    WORD                        PrdtLength;
+
+    // number of bytes transferred, updated by the HBA
+    volatile DWORD              PrdByteCount;
+
+    // must be 128 byte aligned
+    DWORD                       CommandTableBase;
+    DWORD                       CommandTableBaseUpper;
+
+    DWORD                       __Reserved1[4];
+} AHCI_COMMAND_HEADER, *PAHCI_COMMAND_HEADER;
+STATIC_ASSERT(sizeof(AHCI_COMMAND_HEADER) == 0x20);
+
+#define AHCI_COMMAND_LIST_ALIGNMENT             0x400
+#define AHCI_COMMAND_LIST_SIZE                  (AHCI_MAX_SLOTS * sizeof(AHCI_COMMAND_HEADER))
+
+// the byte count of a PRD entry is a 22 bit value
+#define AHCI_PRD_MAX_BYTE_COUNT                 (4 * MB_SIZE)
+
+typedef struct _AHCI_PRD_ENTRY
+{
+    // must be WORD aligned
+    DWORD                       DataBaseAddress;
+    DWORD                       DataBaseAddressUpper;
+    DWORD                       __Reserved0;
+
+    // byte count - 1, bit 0 must always be set (the count must be even)
+    DWORD                       ByteCount           :  22;
+    DWORD                       __Reserved1         :   9;
+    DWORD                       InterruptOnCompletion : 1;
+} AHCI_PRD_ENTRY, *PAHCI_PRD_ENTRY;
+STATIC_ASSERT(sizeof(AHCI_PRD_ENTRY) == 0x10);
+
+#define AHCI_COMMAND_TABLE_ALIGNMENT            0x80
+#define AHCI_COMMAND_TABLE_HEADER_SIZE          0x80
+
+// we give each command table a page => the number of PRD entries follows
+#define AHCI_PRD_ENTRIES_PER_TABLE              ((PAGE_SIZE - AHCI_COMMAND_TABLE_HEADER_SIZE) / sizeof(AHCI_PRD_ENTRY))
+
+typedef struct _AHCI_COMMAND_TABLE
+{
+    union
+    {
+        AHCI_FIS_REG_H2D        RegisterFis;
+        BYTE                    CommandFis[0x40];
+    };
+    BYTE                        AtapiCommand[0x10];
+    BYTE                        __Reserved[0x30];
+
+    AHCI_PRD_ENTRY              Prdt[AHCI_PRD_ENTRIES_PER_TABLE];
+} AHCI_COMMAND_TABLE, *PAHCI_COMMAND_TABLE;
+STATIC_ASSERT(FIELD_OFFSET(AHCI_COMMAND_TABLE, Prdt) == AHCI_COMMAND_TABLE_HEADER_SIZE);
+STATIC_ASSERT(sizeof(AHCI_COMMAND_TABLE) == PAGE_SIZE);
+
+#pragma pack(pop)
+#pragma warning(pop)
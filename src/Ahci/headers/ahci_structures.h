@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ex_event.h"
+
+typedef struct _AHCI_REQUEST
+{
+    PIRP                        Irp;
+    DWORD                       Length;
+
+    // number of commands issued for this request which did not yet complete,
+    // large or fragmented transfers are split over multiple command slots
+    volatile DWORD              PendingCommands;
+
+    // the status of the first command which failed
+    STATUS                      Status;
+
+    PMDL                        Mdl;
+
+    // the MDL was pinned by the issuer of the IRP, it must not be freed
+    BOOLEAN                     CallerMdl;
+
+    // the request serves an asynchronous IRP and nobody waits for it, the
+    // last command to complete releases its resources and frees it
+    BOOLEAN                     Detached;
+
+    EX_EVENT                    Completed;
+} AHCI_REQUEST, *PAHCI_REQUEST;
+
+typedef struct _AHCI_SLOT
+{
+    // the request served by the command occupying the slot
+    PAHCI_REQUEST               Request;
+
+    PAHCI_COMMAND_TABLE         CommandTable;
+} AHCI_SLOT, *PAHCI_SLOT;
+
+typedef struct _AHCI_PORT_STATISTICS
+{
+    QWORD                       CommandsIssued;
+    QWORD                       CommandErrors;
+} AHCI_PORT_STATISTICS, *PAHCI_PORT_STATISTICS;
+
+typedef struct _AHCI_PORT
+{
+    struct _AHCI_CONTROLLER*    Controller;
+    PAHCI_PORT_REGISTERS        Registers;
+    DWORD                       PortIndex;
+
+    QWORD                       TotalSectors;
+
+    // if set the commands are issued as READ/WRITE FPDMA QUEUED
+    BOOLEAN                     NcqEnabled;
+
+    // minimum between the slots of the HBA and the queue depth of the device
+    DWORD                       NumberOfSlots;
+    DWORD                       SlotMask;
+
+    PAHCI_COMMAND_HEADER        CommandList;
+    PAHCI_RECEIVED_FIS          ReceivedFis;
+
+    // NumberOfSlots consecutive pages, one command table per slot
+    PAHCI_COMMAND_TABLE         CommandTables;
+
+    LOCK                        SlotLock;
+
+    // slots reserved by a submitter, some of them may not be issued yet
+    _Guarded_by_(SlotLock)
+    DWORD                       AllocatedSlots;
+
+    // slots for which the command was issued to the HBA
+    _Guarded_by_(SlotLock)
+    DWORD                       ActiveSlots;
+
+    _Guarded_by_(SlotLock)
+    AHCI_SLOT                   Slots[AHCI_MAX_SLOTS];
+
+    // signaled each time a command completes and frees its slot
+    EX_EVENT                    SlotFreed;
+
+    _Guarded_by_(SlotLock)
+    AHCI_PORT_STATISTICS        Statistics;
+
+    BOOLEAN                     Initialized;
+} AHCI_PORT, *PAHCI_PORT;
+
+typedef struct _AHCI_CONTROLLER
+{
+    PPCI_DEVICE_DESCRIPTION     PciDevice;
+    PAHCI_HBA_REGISTERS         Registers;
+
+    DWORD                       NumberOfSlots;
+    BOOLEAN                     Supports64BitAddressing;
+    BOOLEAN                     SupportsNcq;
+
+    // the device objects of the ports which have a disk attached
+    PDEVICE_OBJECT              Ports[AHCI_MAX_PORTS];
+    DWORD                       NumberOfPorts;
+} AHCI_CONTROLLER, *PAHCI_CONTROLLER;
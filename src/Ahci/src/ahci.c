@@ -0,0 +1,183 @@
+#include "ahci_base.h"
+#include "ahci.h"
+#include "ahci_dispatch.h"
+#include "ahci_operations.h"
+
+// programming interface of SATA controllers operating in AHCI mode
+#define PCI_SATA_PROG_IF_AHCI           0x01
+
+static
+BOOLEAN
+_AhciInitializeController(
+    INOUT       PDRIVER_OBJECT              Driver,
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice
+    );
+
+STATUS
+(__cdecl AhciDriverEntry)(
+    INOUT       PDRIVER_OBJECT      Driver
+    )
+{
+    STATUS status;
+    PPCI_DEVICE_DESCRIPTION* pPciDevices;
+    DWORD noOfDevices;
+    BOOLEAN foundDevice;
+    PCI_SPEC pciSpec;
+    DWORD i;
+
+    ASSERT(NULL != Driver);
+
+    LOG_FUNC_START;
+
+    pPciDevices = NULL;
+    noOfDevices = 0;
+    foundDevice = FALSE;
+    memzero(&pciSpec, sizeof(PCI_SPEC));
+
+    pciSpec.MatchClass = TRUE;
+    pciSpec.MatchSubclass = TRUE;
+
+    pciSpec.Description.ClassCode = PciDeviceClassMassStorageController;
+    pciSpec.Description.Subclass = PciMassStorageSATA;
+
+    status = IoGetPciDevicesMatchingSpecification(pciSpec, &pPciDevices, &noOfDevices);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
+        return status;
+    }
+    ASSERT(noOfDevices == 0 || pPciDevices != NULL);
+    LOGL("Found %d SATA controllers\n", noOfDevices);
+
+    Driver->DispatchFunctions[IRP_MJ_READ] = AhciDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_WRITE] = AhciDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_DEVICE_CONTROL] = AhciDispatchDeviceControl;
+
+    for (i = 0; i < noOfDevices; ++i)
+    {
+        ASSERT(pPciDevices[i] != NULL);
+
+        if (PCI_SATA_PROG_IF_AHCI != pPciDevices[i]->DeviceData->Header.ProgIF)
+        {
+            LOG("SATA controller with programming interface 0x%x is not in AHCI mode\n",
+                pPciDevices[i]->DeviceData->Header.ProgIF);
+            continue;
+        }
+
+        if (_AhciInitializeController(Driver, pPciDevices[i]))
+        {
+            foundDevice = TRUE;
+        }
+    }
+
+    if (NULL != pPciDevices)
+    {
+        IoFreeTemporaryData(pPciDevices);
+        pPciDevices = NULL;
+    }
+
+    if (!foundDevice && 0 != noOfDevices)
+    {
+        // there are AHCI controllers, but none of them could be used
+        status = STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+BOOLEAN
+_AhciInitializeController(
+    INOUT       PDRIVER_OBJECT              Driver,
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice
+    )
+{
+    STATUS status;
+    PAHCI_CONTROLLER pController;
+    PDEVICE_OBJECT pPortDevice;
+    DWORD portsImplemented;
+    DWORD i;
+
+    ASSERT(NULL != Driver);
+    ASSERT(NULL != PciDevice);
+
+    pController = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(AHCI_CONTROLLER), HEAP_AHCI_TAG, 0);
+    if (NULL == pController)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(AHCI_CONTROLLER));
+        return FALSE;
+    }
+
+    status = AhciInitializeController(PciDevice, pController);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("AhciInitializeController", status);
+        ExFreePoolWithTag(pController, HEAP_AHCI_TAG);
+        return FALSE;
+    }
+
+    portsImplemented = pController->Registers->PortsImplemented;
+
+    for (i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        if (!IsBooleanFlagOn(portsImplemented, 1UL << i))
+        {
+            continue;
+        }
+
+        pPortDevice = IoCreateDevice(Driver, sizeof(AHCI_PORT), DeviceTypeHarddiskController);
+        if (NULL == pPortDevice)
+        {
+            LOG_FUNC_ERROR_ALLOC("IoCreateDevice", sizeof(AHCI_PORT));
+            break;
+        }
+        pPortDevice->DeviceAlignment = SECTOR_SIZE;
+
+        status = AhciInitializePort(pController, i, pPortDevice);
+        if (!SUCCEEDED(status))
+        {
+            if (STATUS_DEVICE_DOES_NOT_EXIST != status)
+            {
+                LOG_WARNING("AhciInitializePort failed for port %u with status: 0x%x\n", i, status);
+            }
+            IoDeleteDevice(pPortDevice);
+            continue;
+        }
+
+        // the command slots of the port are managed by the driver, there is
+        // no need for the I/O manager to serialize the requests
+        pPortDevice->ConcurrentDispatch = TRUE;
+
+        pController->Ports[i] = pPortDevice;
+        pController->NumberOfPorts++;
+    }
+
+    if (0 != pController->NumberOfPorts)
+    {
+        status = AhciStartController(pController);
+        if (SUCCEEDED(status))
+        {
+            LOG("AHCI controller initialized with %u disks\n", pController->NumberOfPorts);
+            return TRUE;
+        }
+
+        LOG_FUNC_ERROR("AhciStartController", status);
+
+        for (i = 0; i < AHCI_MAX_PORTS; ++i)
+        {
+            if (NULL != pController->Ports[i])
+            {
+                AhciUninitializePort(IoGetDeviceExtension(pController->Ports[i]));
+                IoDeleteDevice(pController->Ports[i]);
+                pController->Ports[i] = NULL;
+            }
+        }
+    }
+
+    IoUnmapMemory((PVOID)pController->Registers, AHCI_HBA_REGISTERS_SIZE);
+    ExFreePoolWithTag(pController, HEAP_AHCI_TAG);
+
+    return FALSE;
+}
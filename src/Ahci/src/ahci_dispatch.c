@@ -0,0 +1,173 @@
+#include "ahci_base.h"
+#include "ahci_dispatch.h"
+#include "ahci_operations.h"
+
+#define LBA48_MAX_VALUE                 0x0000'FFFF'FFFF'FFFFULL
+
+__forceinline
+static
+STATUS
+_AhciCheckAlignment(
+    IN                                          QWORD           Size,
+    IN                                          QWORD           Offset
+    )
+{
+    if (!IsAddressAligned(Size, SECTOR_SIZE))
+    {
+        return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+    }
+
+    if (!IsAddressAligned(Offset, SECTOR_SIZE))
+    {
+        return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__forceinline
+static
+STATUS
+_AhciCheckIOParameters(
+    IN                                          PAHCI_PORT      Port,
+    IN                                          QWORD           SectorIndex,
+    IN                                          QWORD           SectorCount
+    )
+{
+    ASSERT(NULL != Port);
+
+    if (!Port->Initialized)
+    {
+        return STATUS_DEVICE_NOT_INITIALIZED;
+    }
+
+    if (SectorIndex >= Port->TotalSectors || SectorIndex >= LBA48_MAX_VALUE)
+    {
+        return STATUS_DEVICE_SECTOR_OFFSET_EXCEEDED;
+    }
+
+    if (Port->TotalSectors - SectorIndex < SectorCount)
+    {
+        return STATUS_DEVICE_SECTOR_COUNT_EXCEEDED;
+    }
+
+    // the byte count of the transfer is kept in a DWORD
+    if (SectorCount * SECTOR_SIZE > MAX_DWORD)
+    {
+        return STATUS_DEVICE_SECTOR_COUNT_EXCEEDED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+(__cdecl AhciDispatchReadWrite)(
+    INOUT       PDEVICE_OBJECT      DeviceObject,
+    INOUT       PIRP                Irp
+    )
+{
+    PAHCI_PORT pPort;
+    QWORD sectorIndex;
+    QWORD sectorCount;
+    PIO_STACK_LOCATION pStackLocation;
+    STATUS status;
+    QWORD sizeInBytes;
+    QWORD offset;
+    BOOLEAN writeOperation;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Irp);
+
+    pPort = IoGetDeviceExtension(DeviceObject);
+    ASSERT(NULL != pPort);
+
+    pStackLocation = IoGetCurrentIrpStackLocation(Irp);
+
+    ASSERT(IRP_MJ_READ == pStackLocation->MajorFunction || IRP_MJ_WRITE == pStackLocation->MajorFunction);
+    writeOperation = IRP_MJ_WRITE == pStackLocation->MajorFunction;
+
+    sizeInBytes = pStackLocation->Parameters.ReadWrite.Length;
+    offset = pStackLocation->Parameters.ReadWrite.Offset;
+
+    LOG_TRACE_STORAGE("Offset: 0x%X\n", offset);
+    LOG_TRACE_STORAGE("Size in bytes: 0x%x\n", sizeInBytes);
+
+    sectorIndex = offset / SECTOR_SIZE;
+    sectorCount = sizeInBytes / SECTOR_SIZE;
+
+    status = _AhciCheckAlignment(sizeInBytes, offset);
+    if (SUCCEEDED(status))
+    {
+        status = _AhciCheckIOParameters(pPort, sectorIndex, sectorCount);
+    }
+
+    if (!SUCCEEDED(status))
+    {
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+
+        IoCompleteIrp(Irp);
+        return STATUS_SUCCESS;
+    }
+
+    LOG_TRACE_STORAGE("Sector index, Sector count: 0x%X, 0x%X\n", sectorIndex, sectorCount);
+
+    // the IRP is completed by the interrupt handler once the last
+    // command serving it finishes
+    status = AhciPortTransfer(pPort, sectorIndex, (DWORD)sectorCount, Irp->Buffer, writeOperation, Irp);
+
+    return (STATUS_PENDING == status) ? STATUS_PENDING : STATUS_SUCCESS;
+}
+
+STATUS
+(__cdecl AhciDispatchDeviceControl)(
+    INOUT       PDEVICE_OBJECT      DeviceObject,
+    INOUT       PIRP                Irp
+    )
+{
+    STATUS status;
+    PIO_STACK_LOCATION pStackLocation;
+    DWORD information;
+    PAHCI_PORT pPort;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Irp);
+
+    status = STATUS_SUCCESS;
+    pStackLocation = IoGetCurrentIrpStackLocation(Irp);
+    information = 0;
+    pPort = IoGetDeviceExtension(DeviceObject);
+    ASSERT(NULL != pPort);
+
+    ASSERT(IRP_MJ_DEVICE_CONTROL == pStackLocation->MajorFunction);
+
+    switch (pStackLocation->Parameters.DeviceControl.IoControlCode)
+    {
+    case IOCTL_DISK_GET_LENGTH_INFO:
+        {
+            GET_LENGTH_INFORMATION result;
+
+            information = sizeof(GET_LENGTH_INFORMATION);
+            memzero(&result, information);
+
+            if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            result.Length = pPort->TotalSectors * SECTOR_SIZE;
+
+            memcpy(pStackLocation->Parameters.DeviceControl.OutputBuffer, &result, information);
+        }
+        break;
+    default:
+        status = STATUS_UNSUPPORTED;
+    }
+
+    Irp->IoStatus.Status = status;
+    Irp->IoStatus.Information = information;
+    IoCompleteIrp(Irp);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,1300 @@
+#include "ahci_base.h"
+#include "ahci_operations.h"
+#include "ahci_commands.h"
+
+#define AHCI_PORT_STOP_TIMEOUT_US           (500 * MS_IN_US)
+#define AHCI_LINK_TIMEOUT_US                (100 * MS_IN_US)
+#define AHCI_DEVICE_READY_TIMEOUT_US        (1 * SEC_IN_US)
+#define AHCI_IDENTIFY_TIMEOUT_US            (1 * SEC_IN_US)
+
+// the interrupt handler cannot rely on the system time advancing
+#define AHCI_RECOVERY_MAX_POLLS             0x100000
+
+#define AHCI_MAX_BYTES_PER_COMMAND          (AHCI_MAX_SECTORS_PER_COMMAND * SECTOR_SIZE)
+
+#define AHCI_SLOT_BIT(Slot)                 (1UL << (Slot))
+
+STATIC_ASSERT(AHCI_COMMAND_LIST_SIZE + sizeof(AHCI_RECEIVED_FIS) <= PAGE_SIZE);
+STATIC_ASSERT(IsAddressAligned(AHCI_COMMAND_LIST_SIZE, AHCI_RECEIVED_FIS_ALIGNMENT));
+
+static FUNC_InterruptFunction       _AhciInterrupt;
+
+static
+void
+_AhciEnableBusMastering(
+    IN      PPCI_DEVICE_DESCRIPTION     PciDevice
+    );
+
+static
+STATUS
+_AhciWaitForRegister(
+    IN      volatile DWORD*             Register,
+    IN      DWORD                       Mask,
+    IN      DWORD                       Value,
+    IN      QWORD                       TimeoutUs
+    );
+
+static
+STATUS
+_AhciStopPort(
+    INOUT   PAHCI_PORT_REGISTERS        Registers
+    );
+
+static
+STATUS
+_AhciAllocatePortMemory(
+    INOUT   PAHCI_PORT                  Port
+    );
+
+static
+STATUS
+_AhciPortIdentify(
+    INOUT   PAHCI_PORT                  Port
+    );
+
+static
+void
+_AhciPortHandleInterrupt(
+    INOUT   PAHCI_PORT                  Port
+    );
+
+static
+void
+_AhciPortRecover(
+    INOUT   PAHCI_PORT                  Port
+    );
+
+static
+STATUS
+_AhciValidateBuffer(
+    IN      PAHCI_PORT                  Port,
+    IN      PVOID                       Buffer,
+    IN      PMDL                        Mdl
+    );
+
+static
+DWORD
+_AhciAcquireSlot(
+    INOUT   PAHCI_PORT                  Port,
+    IN      PAHCI_REQUEST               Request
+    );
+
+static
+DWORD
+_AhciFillPrdt(
+    INOUT   PAHCI_COMMAND_TABLE         CommandTable,
+    IN      PMDL                        Mdl,
+    INOUT   DWORD*                      PairIndex,
+    INOUT   DWORD*                      PairOffset,
+    OUT     DWORD*                      NumberOfEntries
+    );
+
+static
+void
+_AhciBuildRegisterFis(
+    IN      PAHCI_PORT                  Port,
+    OUT     PAHCI_FIS_REG_H2D           Fis,
+    IN      DWORD                       Slot,
+    IN      QWORD                       SectorIndex,
+    IN      DWORD                       SectorCount,
+    IN      BOOLEAN                     WriteOperation
+    );
+
+static
+void
+_AhciPrepareCommandHeader(
+    INOUT   PAHCI_PORT                  Port,
+    IN      DWORD                       Slot,
+    IN      DWORD                       NumberOfEntries,
+    IN      BOOLEAN                     WriteOperation
+    );
+
+static
+void
+_AhciIssueCommand(
+    INOUT   PAHCI_PORT                  Port,
+    IN      DWORD                       Slot,
+    IN      QWORD                       SectorIndex,
+    IN      DWORD                       SectorCount,
+    IN      DWORD                       NumberOfEntries,
+    IN      BOOLEAN                     WriteOperation
+    );
+
+static
+void
+_AhciReleaseRequest(
+    INOUT   PAHCI_REQUEST               Request
+    );
+
+STATUS
+AhciInitializeController(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT         PAHCI_CONTROLLER            Controller
+    )
+{
+    PPCI_BAR pBar;
+    PHYSICAL_ADDRESS abarPa;
+    DWORD capabilities;
+
+    if (NULL == PciDevice)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Controller)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    memzero(Controller, sizeof(AHCI_CONTROLLER));
+
+    Controller->PciDevice = PciDevice;
+
+    pBar = &PciDevice->DeviceData->Header.Device.Bar[AHCI_ABAR_INDEX];
+    if (0 != pBar->MemorySpace.Zero)
+    {
+        LOG_ERROR("ABAR is not memory mapped: 0x%x\n", pBar->Raw);
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    abarPa = PCI_GET_PA_FROM_MEM_ADDR(pBar);
+    if (NULL == abarPa)
+    {
+        LOG_ERROR("ABAR was not assigned\n");
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    LOG_TRACE_STORAGE("ABAR PA at 0x%X\n", abarPa);
+
+    Controller->Registers = IoMapMemory(abarPa, AHCI_HBA_REGISTERS_SIZE, PAGE_RIGHTS_READWRITE);
+    if (NULL == Controller->Registers)
+    {
+        LOG_ERROR("IoMapMemory could not map PA 0x%X\n", abarPa);
+        return STATUS_MEMORY_CANNOT_BE_MAPPED;
+    }
+
+    // the HBA fetches the command lists and transfers the data by itself
+    _AhciEnableBusMastering(PciDevice);
+
+    // we do not want interrupts until all the ports are initialized
+    Controller->Registers->GlobalHbaControl = AHCI_GHC_AE;
+
+    capabilities = Controller->Registers->Capabilities;
+
+    Controller->NumberOfSlots = ((capabilities >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1;
+    Controller->Supports64BitAddressing = IsBooleanFlagOn(capabilities, AHCI_CAP_S64A);
+    Controller->SupportsNcq = IsBooleanFlagOn(capabilities, AHCI_CAP_SNCQ);
+
+    LOG_TRACE_STORAGE("AHCI version 0x%x, capabilities 0x%x, ports implemented 0x%x\n",
+                      Controller->Registers->Version, capabilities, Controller->Registers->PortsImplemented);
+    LOG_TRACE_STORAGE("Command slots: %u, NCQ: %u, 64 bit addressing: %u\n",
+                      Controller->NumberOfSlots, Controller->SupportsNcq, Controller->Supports64BitAddressing);
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+AhciInitializePort(
+    INOUT       PAHCI_CONTROLLER            Controller,
+    IN          DWORD                       PortIndex,
+    IN          PDEVICE_OBJECT              Device
+    )
+{
+    STATUS status;
+    PAHCI_PORT pPort;
+    PAHCI_PORT_REGISTERS pRegisters;
+    QWORD commandListPa;
+    QWORD receivedFisPa;
+
+    if (NULL == Controller)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (PortIndex >= AHCI_MAX_PORTS)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pPort = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPort);
+
+    pRegisters = &Controller->Registers->Ports[PortIndex];
+
+    pPort->Controller = Controller;
+    pPort->Registers = pRegisters;
+    pPort->PortIndex = PortIndex;
+    pPort->NumberOfSlots = Controller->NumberOfSlots;
+
+    LockInit(&pPort->SlotLock);
+
+    status = ExEventInit(&pPort->SlotFreed, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    __try
+    {
+        // the command list and FIS base addresses may only be changed while the port is idle
+        status = _AhciStopPort(pRegisters);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciStopPort", status);
+            __leave;
+        }
+
+        pRegisters->Command = pRegisters->Command | AHCI_PORT_CMD_SUD | AHCI_PORT_CMD_POD;
+
+        status = _AhciWaitForRegister(&pRegisters->SataStatus, AHCI_PORT_SSTS_DET_MASK, AHCI_PORT_SSTS_DET_PRESENT, AHCI_LINK_TIMEOUT_US);
+        if (!SUCCEEDED(status))
+        {
+            LOG_TRACE_STORAGE("No device attached to port %u, SSTS: 0x%x\n", PortIndex, pRegisters->SataStatus);
+            status = STATUS_DEVICE_DOES_NOT_EXIST;
+            __leave;
+        }
+
+        status = _AhciAllocatePortMemory(pPort);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciAllocatePortMemory", status);
+            __leave;
+        }
+
+        commandListPa = (QWORD) IoGetPhysicalAddress(pPort->CommandList);
+        receivedFisPa = (QWORD) IoGetPhysicalAddress(pPort->ReceivedFis);
+
+        pRegisters->CommandListBase = (DWORD) QWORD_LOW(commandListPa);
+        pRegisters->CommandListBaseUpper = (DWORD) QWORD_HIGH(commandListPa);
+        pRegisters->FisBase = (DWORD) QWORD_LOW(receivedFisPa);
+        pRegisters->FisBaseUpper = (DWORD) QWORD_HIGH(receivedFisPa);
+
+        // all these registers are write 1 to clear
+        pRegisters->SataError = MAX_DWORD;
+        pRegisters->InterruptStatus = MAX_DWORD;
+        pRegisters->InterruptEnable = 0;
+
+        pRegisters->Command = pRegisters->Command | AHCI_PORT_CMD_FRE;
+
+        status = _AhciWaitForRegister(&pRegisters->TaskFileData, AHCI_PORT_TFD_STS_BSY | AHCI_PORT_TFD_STS_DRQ, 0, AHCI_DEVICE_READY_TIMEOUT_US);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Device on port %u did not become ready, TFD: 0x%x\n", PortIndex, pRegisters->TaskFileData);
+            __leave;
+        }
+
+        if (AHCI_PORT_SIG_ATA != pRegisters->Signature)
+        {
+            LOG("Device on port %u has signature 0x%x, only SATA disks are supported\n", PortIndex, pRegisters->Signature);
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        pRegisters->Command = pRegisters->Command | AHCI_PORT_CMD_ST;
+
+        status = _AhciPortIdentify(pPort);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciPortIdentify", status);
+            __leave;
+        }
+
+        pPort->SlotMask = (AHCI_MAX_SLOTS == pPort->NumberOfSlots) ? MAX_DWORD : (AHCI_SLOT_BIT(pPort->NumberOfSlots) - 1);
+
+        LOG("Port %u: 0x%X sectors, %u command slots, NCQ %s\n",
+            PortIndex, pPort->TotalSectors, pPort->NumberOfSlots, pPort->NcqEnabled ? "enabled" : "disabled");
+
+        pPort->Initialized = TRUE;
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            AhciUninitializePort(pPort);
+        }
+    }
+
+    return status;
+}
+
+void
+AhciUninitializePort(
+    INOUT       PAHCI_PORT                  Port
+    )
+{
+    ASSERT(NULL != Port);
+    ASSERT(0 == Port->AllocatedSlots);
+
+    Port->Initialized = FALSE;
+
+    if (NULL != Port->Registers)
+    {
+        Port->Registers->InterruptEnable = 0;
+        _AhciStopPort(Port->Registers);
+    }
+
+    if (NULL != Port->CommandTables)
+    {
+        IoFreeContinuousMemory(Port->CommandTables);
+        Port->CommandTables = NULL;
+    }
+
+    if (NULL != Port->CommandList)
+    {
+        IoFreeContinuousMemory(Port->CommandList);
+        Port->CommandList = NULL;
+        Port->ReceivedFis = NULL;
+    }
+}
+
+STATUS
+AhciStartController(
+    INOUT       PAHCI_CONTROLLER            Controller
+    )
+{
+    STATUS status;
+    IO_INTERRUPT ioInterrupt;
+    PDEVICE_OBJECT pFirstPort;
+    DWORD i;
+
+    if (NULL == Controller)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    pFirstPort = NULL;
+    memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+
+    for (i = 0; i < AHCI_MAX_PORTS && NULL == pFirstPort; ++i)
+    {
+        pFirstPort = Controller->Ports[i];
+    }
+    ASSERT(NULL != pFirstPort);
+
+    // all the ports share the interrupt of the HBA, the ICH9 is MSI
+    // capable => the I/O manager will program a message instead of an
+    // IO APIC redirection entry
+    ioInterrupt.Type = IoInterruptTypePci;
+    ioInterrupt.Irql = IrqlStorageLevel;
+    ioInterrupt.ServiceRoutine = _AhciInterrupt;
+    ioInterrupt.Exclusive = FALSE;
+    ioInterrupt.Pci.PciDevice = Controller->PciDevice;
+
+    status = IoRegisterInterrupt(&ioInterrupt, pFirstPort);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+        return status;
+    }
+
+    for (i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        PAHCI_PORT pPort;
+
+        if (NULL == Controller->Ports[i])
+        {
+            continue;
+        }
+
+        pPort = IoGetDeviceExtension(Controller->Ports[i]);
+        ASSERT(NULL != pPort);
+
+        pPort->Registers->InterruptStatus = MAX_DWORD;
+        pPort->Registers->InterruptEnable = AHCI_PORT_INT_ENABLE_MASK;
+    }
+
+    Controller->Registers->InterruptStatus = MAX_DWORD;
+    Controller->Registers->GlobalHbaControl = AHCI_GHC_AE | AHCI_GHC_IE;
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+AhciPortTransfer(
+    INOUT       PAHCI_PORT                  Port,
+    IN          QWORD                       SectorIndex,
+    IN          DWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                PVOID                       Buffer,
+    IN          BOOLEAN                     WriteOperation,
+    IN_OPT      PIRP                        Irp
+    )
+{
+    STATUS status;
+    AHCI_REQUEST request;
+    PAHCI_REQUEST pRequest;
+    PMDL pMdl;
+    DWORD noOfPairs;
+    DWORD pairIndex;
+    DWORD pairOffset;
+    QWORD currentSector;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Port);
+    ASSERT(0 != SectorCount);
+    ASSERT(NULL != Buffer);
+
+    status = STATUS_SUCCESS;
+    pMdl = NULL;
+    noOfPairs = 0;
+    pairIndex = 0;
+    pairOffset = 0;
+    currentSector = SectorIndex;
+    pRequest = &request;
+
+    if (NULL != Irp && Irp->Flags.Asynchronous)
+    {
+        // nobody waits for an asynchronous IRP => the request may outlive us
+        pRequest = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(AHCI_REQUEST), HEAP_AHCI_TAG, 0);
+        if (NULL == pRequest)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(AHCI_REQUEST));
+
+            Irp->IoStatus.Status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            Irp->IoStatus.Information = 0;
+            IoCompleteIrp(Irp);
+
+            return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+        }
+
+        pRequest->Detached = TRUE;
+        IoMarkIrpPending(Irp);
+    }
+    else
+    {
+        memzero(pRequest, sizeof(AHCI_REQUEST));
+
+        status = ExEventInit(&pRequest->Completed, ExEventTypeNotification, FALSE);
+        ASSERT(SUCCEEDED(status));
+    }
+
+    pRequest->Irp = Irp;
+    pRequest->Length = SectorCount * SECTOR_SIZE;
+    pRequest->Status = STATUS_SUCCESS;
+
+    // the submitter holds a reference until all the commands are issued
+    pRequest->PendingCommands = 1;
+
+    __try
+    {
+        // the pages of a caller supplied MDL are already pinned
+        pMdl = (NULL != Irp) ? IoGetCallerMdl(Irp, Buffer, pRequest->Length) : NULL;
+        pRequest->CallerMdl = (NULL != pMdl);
+
+        if (!pRequest->CallerMdl)
+        {
+            status = IoAllocateMdl(Buffer, pRequest->Length, NULL, &pMdl);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("IoAllocateMdl", status);
+                __leave;
+            }
+        }
+
+        // the MDL must live until the last command completes
+        pRequest->Mdl = pMdl;
+
+        status = _AhciValidateBuffer(Port, Buffer, pMdl);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciValidateBuffer", status);
+            __leave;
+        }
+
+        noOfPairs = IoMdlGetNumberOfPairs(pMdl);
+
+        // issue as many commands as needed without waiting for the previous ones,
+        // the device is free to serve them in any order
+        while (pairIndex < noOfPairs)
+        {
+            DWORD slot;
+            DWORD sectorCount;
+            DWORD noOfEntries;
+
+            slot = _AhciAcquireSlot(Port, pRequest);
+
+            sectorCount = _AhciFillPrdt(Port->Slots[slot].CommandTable, pMdl, &pairIndex, &pairOffset, &noOfEntries);
+            ASSERT(0 != sectorCount);
+
+            _InterlockedIncrement(&pRequest->PendingCommands);
+
+            _AhciIssueCommand(Port, slot, currentSector, sectorCount, noOfEntries, WriteOperation);
+
+            currentSector = currentSector + sectorCount;
+        }
+        ASSERT(currentSector == SectorIndex + SectorCount);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            // nothing was issued yet => we are the only ones touching the request
+            pRequest->Status = status;
+        }
+
+        if (pRequest->Detached)
+        {
+            // after this the request may be freed at any moment
+            _AhciReleaseRequest(pRequest);
+            pRequest = NULL;
+
+            status = STATUS_PENDING;
+        }
+        else
+        {
+            _AhciReleaseRequest(pRequest);
+
+            ExEventWaitForSignal(&pRequest->Completed);
+
+            // the interrupt handler may still hold the event lock after the signal was
+            // seen, make sure it is done with the event before the request goes away
+            LockAcquire(&pRequest->Completed.EventLock, &intrState);
+            LockRelease(&pRequest->Completed.EventLock, intrState);
+
+            if (NULL != pMdl && !pRequest->CallerMdl)
+            {
+                IoFreeMdl(pMdl);
+            }
+            pMdl = NULL;
+
+            status = pRequest->Status;
+        }
+    }
+
+    return status;
+}
+
+static
+void
+_AhciEnableBusMastering(
+    IN      PPCI_DEVICE_DESCRIPTION     PciDevice
+    )
+{
+    ASSERT(NULL != PciDevice);
+
+    PciDevice->DeviceData->Header.Command.MemorySpaceEnabled = TRUE;
+    PciDevice->DeviceData->Header.Command.BusMaster = TRUE;
+
+    if (!PciDevice->PciExpressDevice)
+    {
+        PciWriteConfigurationSpace(PciDevice->DeviceLocation,
+                                   FIELD_OFFSET(PCI_COMMON_HEADER, Command),
+                                   *(DWORD*)&PciDevice->DeviceData->Header.Command
+                                   );
+    }
+}
+
+static
+STATUS
+_AhciWaitForRegister(
+    IN      volatile DWORD*             Register,
+    IN      DWORD                       Mask,
+    IN      DWORD                       Value,
+    IN      QWORD                       TimeoutUs
+    )
+{
+    QWORD deadline;
+
+    ASSERT(NULL != Register);
+
+    deadline = IoGetSystemTimeUs() + TimeoutUs;
+
+    while ((*Register & Mask) != Value)
+    {
+        if (IoGetSystemTimeUs() >= deadline)
+        {
+            return STATUS_DEVICE_NOT_READY;
+        }
+
+        _mm_pause();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AhciStopPort(
+    INOUT   PAHCI_PORT_REGISTERS        Registers
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Registers);
+
+    Registers->Command = Registers->Command & ~AHCI_PORT_CMD_ST;
+
+    status = _AhciWaitForRegister(&Registers->Command, AHCI_PORT_CMD_CR, 0, AHCI_PORT_STOP_TIMEOUT_US);
+    if (!SUCCEEDED(status))
+    {
+        LOG_ERROR("Command list engine did not stop, CMD: 0x%x\n", Registers->Command);
+        return status;
+    }
+
+    Registers->Command = Registers->Command & ~AHCI_PORT_CMD_FRE;
+
+    status = _AhciWaitForRegister(&Registers->Command, AHCI_PORT_CMD_FR, 0, AHCI_PORT_STOP_TIMEOUT_US);
+    if (!SUCCEEDED(status))
+    {
+        LOG_ERROR("FIS receive engine did not stop, CMD: 0x%x\n", Registers->Command);
+        return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AhciAllocatePortMemory(
+    INOUT   PAHCI_PORT                  Port
+    )
+{
+    PVOID pPage;
+    DWORD tablesSize;
+    QWORD highestPa;
+    DWORD i;
+
+    ASSERT(NULL != Port);
+    ASSERT(0 != Port->NumberOfSlots && Port->NumberOfSlots <= AHCI_MAX_SLOTS);
+
+    tablesSize = Port->NumberOfSlots * sizeof(AHCI_COMMAND_TABLE);
+
+    // the command list (1KB aligned) and the received FIS area (256 bytes
+    // aligned) share a page
+    pPage = IoAllocateContinuousMemoryEx(PAGE_SIZE, TRUE);
+    if (NULL == pPage)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", PAGE_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memzero(pPage, PAGE_SIZE);
+
+    Port->CommandList = pPage;
+    Port->ReceivedFis = (PAHCI_RECEIVED_FIS) PtrOffset(pPage, AHCI_COMMAND_LIST_SIZE);
+
+    // each command table occupies a page => they are properly aligned
+    Port->CommandTables = IoAllocateContinuousMemoryEx(tablesSize, TRUE);
+    if (NULL == Port->CommandTables)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", tablesSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memzero(Port->CommandTables, tablesSize);
+
+    highestPa = (QWORD) IoGetPhysicalAddress(Port->CommandTables) + tablesSize - 1;
+    if (!Port->Controller->Supports64BitAddressing &&
+        (highestPa > MAX_DWORD || (QWORD) IoGetPhysicalAddress(pPage) > MAX_DWORD))
+    {
+        return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+    }
+
+    for (i = 0; i < Port->NumberOfSlots; ++i)
+    {
+        QWORD tablePa = (QWORD) IoGetPhysicalAddress(&Port->CommandTables[i]);
+
+        ASSERT(IsAddressAligned(tablePa, AHCI_COMMAND_TABLE_ALIGNMENT));
+
+        Port->Slots[i].CommandTable = &Port->CommandTables[i];
+        Port->Slots[i].Request = NULL;
+
+        Port->CommandList[i].CommandTableBase = (DWORD) QWORD_LOW(tablePa);
+        Port->CommandList[i].CommandTableBaseUpper = (DWORD) QWORD_HIGH(tablePa);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AhciPortIdentify(
+    INOUT   PAHCI_PORT                  Port
+    )
+{
+    STATUS status;
+    PWORD pIdentify;
+    PAHCI_COMMAND_TABLE pTable;
+    PAHCI_PORT_REGISTERS pRegisters;
+    QWORD identifyPa;
+    QWORD deadline;
+    DWORD queueDepth;
+
+    ASSERT(NULL != Port);
+
+    status = STATUS_SUCCESS;
+    pTable = Port->Slots[0].CommandTable;
+    pRegisters = Port->Registers;
+
+    pIdentify = IoAllocateContinuousMemory(SECTOR_SIZE);
+    if (NULL == pIdentify)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", SECTOR_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    __try
+    {
+        identifyPa = (QWORD) IoGetPhysicalAddress(pIdentify);
+        if (!Port->Controller->Supports64BitAddressing && identifyPa > MAX_DWORD)
+        {
+            status = STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+            __leave;
+        }
+
+        memzero(pTable, AHCI_COMMAND_TABLE_HEADER_SIZE);
+
+        pTable->RegisterFis.FisType = AHCI_FIS_TYPE_REG_H2D;
+        pTable->RegisterFis.CommandBit = 1;
+        pTable->RegisterFis.Command = AHCI_ATA_CMD_IDENTIFY;
+
+        pTable->Prdt[0].DataBaseAddress = (DWORD) QWORD_LOW(identifyPa);
+        pTable->Prdt[0].DataBaseAddressUpper = (DWORD) QWORD_HIGH(identifyPa);
+        pTable->Prdt[0].ByteCount = SECTOR_SIZE - 1;
+
+        _AhciPrepareCommandHeader(Port, 0, 1, FALSE);
+
+        // interrupts are not yet enabled, we poll for completion
+        pRegisters->CommandIssue = AHCI_SLOT_BIT(0);
+
+        deadline = IoGetSystemTimeUs() + AHCI_IDENTIFY_TIMEOUT_US;
+        while (IsBooleanFlagOn(pRegisters->CommandIssue, AHCI_SLOT_BIT(0)))
+        {
+            if (0 != (pRegisters->InterruptStatus & AHCI_PORT_INT_ERROR_MASK))
+            {
+                LOG_ERROR("IDENTIFY failed, IS: 0x%x, TFD: 0x%x\n", pRegisters->InterruptStatus, pRegisters->TaskFileData);
+                status = STATUS_DEVICE_TRANSFER_ERROR;
+                __leave;
+            }
+
+            if (IoGetSystemTimeUs() >= deadline)
+            {
+                LOG_ERROR("IDENTIFY timed out, TFD: 0x%x\n", pRegisters->TaskFileData);
+                status = STATUS_DEVICE_NOT_READY;
+                __leave;
+            }
+
+            _mm_pause();
+        }
+
+        if (!IsBooleanFlagOn(pIdentify[AHCI_IDENTIFY_WORD_COMMAND_SET_2], AHCI_IDENTIFY_COMMAND_SET_2_LBA48))
+        {
+            LOG_ERROR("Device does not support LBA48\n");
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        Port->TotalSectors = *((QWORD*) &pIdentify[AHCI_IDENTIFY_WORD_MAX_LBA48]);
+
+        Port->NcqEnabled = Port->Controller->SupportsNcq &&
+                           IsBooleanFlagOn(pIdentify[AHCI_IDENTIFY_WORD_SATA_CAPABILITIES], AHCI_IDENTIFY_SATA_CAP_NCQ);
+        if (Port->NcqEnabled)
+        {
+            // the device cannot use more tags than its queue depth
+            queueDepth = (pIdentify[AHCI_IDENTIFY_WORD_QUEUE_DEPTH] & AHCI_IDENTIFY_QUEUE_DEPTH_MASK) + 1;
+            Port->NumberOfSlots = min(Port->NumberOfSlots, queueDepth);
+        }
+    }
+    __finally
+    {
+        pRegisters->InterruptStatus = MAX_DWORD;
+
+        IoFreeContinuousMemory(pIdentify);
+        pIdentify = NULL;
+    }
+
+    return status;
+}
+
+static
+BOOLEAN
+(__cdecl _AhciInterrupt)(
+    IN      PDEVICE_OBJECT              Device
+    )
+{
+    PAHCI_PORT pPort;
+    PAHCI_CONTROLLER pController;
+    DWORD pendingPorts;
+    DWORD i;
+
+    ASSERT(NULL != Device);
+
+    pPort = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPort);
+
+    pController = pPort->Controller;
+    ASSERT(NULL != pController);
+
+    pendingPorts = pController->Registers->InterruptStatus;
+    if (0 == pendingPorts)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        if (!IsBooleanFlagOn(pendingPorts, AHCI_SLOT_BIT(i)) || NULL == pController->Ports[i])
+        {
+            continue;
+        }
+
+        _AhciPortHandleInterrupt(IoGetDeviceExtension(pController->Ports[i]));
+    }
+
+    // the port interrupt status must be cleared before the HBA one
+    pController->Registers->InterruptStatus = pendingPorts;
+
+    return TRUE;
+}
+
+static
+void
+_AhciPortHandleInterrupt(
+    INOUT   PAHCI_PORT                  Port
+    )
+{
+    PAHCI_PORT_REGISTERS pRegisters;
+    DWORD interruptStatus;
+    DWORD completedSlots;
+    STATUS status;
+    INTR_STATE intrState;
+    DWORD i;
+    PAHCI_REQUEST completedRequests[AHCI_MAX_SLOTS];
+    DWORD noOfCompletedRequests;
+
+    ASSERT(NULL != Port);
+
+    pRegisters = Port->Registers;
+    status = STATUS_SUCCESS;
+    noOfCompletedRequests = 0;
+
+    LockAcquire(&Port->SlotLock, &intrState);
+
+    interruptStatus = pRegisters->InterruptStatus;
+    pRegisters->InterruptStatus = interruptStatus;
+
+    if (0 != (interruptStatus & AHCI_PORT_INT_ERROR_MASK))
+    {
+        LOG_ERROR("Port %u error, IS: 0x%x, TFD: 0x%x, SERR: 0x%x\n",
+                  Port->PortIndex, interruptStatus, pRegisters->TaskFileData, pRegisters->SataError);
+
+        // the HBA stops processing the command list, all the commands in flight are lost
+        completedSlots = Port->ActiveSlots;
+        status = STATUS_DEVICE_TRANSFER_ERROR;
+        Port->Statistics.CommandErrors = Port->Statistics.CommandErrors + 1;
+
+        _AhciPortRecover(Port);
+    }
+    else
+    {
+        // a slot is done once the HBA cleared both its issue and its active bit
+        completedSlots = Port->ActiveSlots & ~(pRegisters->SataActive | pRegisters->CommandIssue);
+    }
+
+    for (i = 0; i < Port->NumberOfSlots; ++i)
+    {
+        PAHCI_REQUEST pRequest;
+
+        if (!IsBooleanFlagOn(completedSlots, AHCI_SLOT_BIT(i)))
+        {
+            continue;
+        }
+
+        pRequest = Port->Slots[i].Request;
+        ASSERT(NULL != pRequest);
+
+        Port->Slots[i].Request = NULL;
+
+        if (!SUCCEEDED(status) && SUCCEEDED(pRequest->Status))
+        {
+            pRequest->Status = status;
+        }
+
+        completedRequests[noOfCompletedRequests] = pRequest;
+        noOfCompletedRequests = noOfCompletedRequests + 1;
+    }
+
+    Port->ActiveSlots = Port->ActiveSlots & ~completedSlots;
+    Port->AllocatedSlots = Port->AllocatedSlots & ~completedSlots;
+
+    LockRelease(&Port->SlotLock, intrState);
+
+    // the IRPs are completed without holding the slot lock, a completion
+    // routine may issue a new command on this same port
+    for (i = 0; i < noOfCompletedRequests; ++i)
+    {
+        _AhciReleaseRequest(completedRequests[i]);
+    }
+
+    if (0 != completedSlots)
+    {
+        ExEventSignal(&Port->SlotFreed);
+    }
+}
+
+static
+void
+_AhciPortRecover(
+    INOUT   PAHCI_PORT                  Port
+    )
+{
+    PAHCI_PORT_REGISTERS pRegisters;
+    DWORD i;
+
+    ASSERT(NULL != Port);
+    ASSERT(LockIsOwner(&Port->SlotLock));
+
+    pRegisters = Port->Registers;
+
+    // clearing ST resets PxCI and PxSACT
+    pRegisters->Command = pRegisters->Command & ~AHCI_PORT_CMD_ST;
+    for (i = 0; i < AHCI_RECOVERY_MAX_POLLS && IsBooleanFlagOn(pRegisters->Command, AHCI_PORT_CMD_CR); ++i)
+    {
+        _mm_pause();
+    }
+
+    pRegisters->SataError = MAX_DWORD;
+
+    if (0 != (pRegisters->TaskFileData & (AHCI_PORT_TFD_STS_BSY | AHCI_PORT_TFD_STS_DRQ)))
+    {
+        // the device is stuck, override its busy state so the port can be restarted
+        pRegisters->Command = pRegisters->Command | AHCI_PORT_CMD_CLO;
+        for (i = 0; i < AHCI_RECOVERY_MAX_POLLS && IsBooleanFlagOn(pRegisters->Command, AHCI_PORT_CMD_CLO); ++i)
+        {
+            _mm_pause();
+        }
+    }
+
+    pRegisters->Command = pRegisters->Command | AHCI_PORT_CMD_ST;
+}
+
+static
+STATUS
+_AhciValidateBuffer(
+    IN      PAHCI_PORT                  Port,
+    IN      PVOID                       Buffer,
+    IN      PMDL                        Mdl
+    )
+{
+    DWORD noOfPairs;
+    DWORD i;
+
+    ASSERT(NULL != Port);
+    ASSERT(NULL != Mdl);
+
+    // the data base address of each PRD entry must be WORD aligned
+    if (!IsAddressAligned(Buffer, sizeof(WORD)))
+    {
+        return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+    }
+
+    if (Port->Controller->Supports64BitAddressing)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    noOfPairs = IoMdlGetNumberOfPairs(Mdl);
+    for (i = 0; i < noOfPairs; ++i)
+    {
+        PMDL_TRANSLATION_PAIR pPair = IoMdlGetTranslationPair(Mdl, i);
+
+        if ((QWORD) pPair->Address + pPair->NumberOfBytes - 1 > MAX_DWORD)
+        {
+            return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+DWORD
+_AhciAcquireSlot(
+    INOUT   PAHCI_PORT                  Port,
+    IN      PAHCI_REQUEST               Request
+    )
+{
+    INTR_STATE intrState;
+    DWORD freeSlots;
+    DWORD slot;
+
+    ASSERT(NULL != Port);
+    ASSERT(NULL != Request);
+
+    for (;;)
+    {
+        LockAcquire(&Port->SlotLock, &intrState);
+
+        freeSlots = Port->SlotMask & ~Port->AllocatedSlots;
+        if (0 != freeSlots)
+        {
+            for (slot = 0; !IsBooleanFlagOn(freeSlots, AHCI_SLOT_BIT(slot)); ++slot);
+
+            Port->AllocatedSlots = Port->AllocatedSlots | AHCI_SLOT_BIT(slot);
+            Port->Slots[slot].Request = Request;
+
+            LockRelease(&Port->SlotLock, intrState);
+
+            if (0 != (freeSlots & ~AHCI_SLOT_BIT(slot)))
+            {
+                // there are still free slots, pass the wake up on to another submitter
+                ExEventSignal(&Port->SlotFreed);
+            }
+
+            return slot;
+        }
+
+        LockRelease(&Port->SlotLock, intrState);
+
+        ExEventWaitForSignal(&Port->SlotFreed);
+    }
+}
+
+static
+DWORD
+_AhciFillPrdt(
+    INOUT   PAHCI_COMMAND_TABLE         CommandTable,
+    IN      PMDL                        Mdl,
+    INOUT   DWORD*                      PairIndex,
+    INOUT   DWORD*                      PairOffset,
+    OUT     DWORD*                      NumberOfEntries
+    )
+{
+    DWORD noOfPairs;
+    DWORD noOfEntries;
+    DWORD byteCount;
+    DWORD lastPairIndex;
+    DWORD lastPairOffset;
+    DWORD excess;
+
+    ASSERT(NULL != CommandTable);
+    ASSERT(NULL != Mdl);
+    ASSERT(NULL != PairIndex);
+    ASSERT(NULL != PairOffset);
+    ASSERT(NULL != NumberOfEntries);
+
+    noOfPairs = IoMdlGetNumberOfPairs(Mdl);
+    noOfEntries = 0;
+    byteCount = 0;
+    lastPairIndex = *PairIndex;
+    lastPairOffset = *PairOffset;
+
+    while (*PairIndex < noOfPairs &&
+           noOfEntries < AHCI_PRD_ENTRIES_PER_TABLE &&
+           byteCount < AHCI_MAX_BYTES_PER_COMMAND)
+    {
+        PMDL_TRANSLATION_PAIR pPair;
+        QWORD entryPa;
+        DWORD entrySize;
+
+        pPair = IoMdlGetTranslationPair(Mdl, *PairIndex);
+        ASSERT(NULL != pPair);
+
+        entryPa = (QWORD) pPair->Address + *PairOffset;
+        entrySize = pPair->NumberOfBytes - *PairOffset;
+        entrySize = min(entrySize, AHCI_PRD_MAX_BYTE_COUNT);
+        entrySize = min(entrySize, AHCI_MAX_BYTES_PER_COMMAND - byteCount);
+
+        CommandTable->Prdt[noOfEntries].DataBaseAddress = (DWORD) QWORD_LOW(entryPa);
+        CommandTable->Prdt[noOfEntries].DataBaseAddressUpper = (DWORD) QWORD_HIGH(entryPa);
+        CommandTable->Prdt[noOfEntries].ByteCount = entrySize - 1;
+        CommandTable->Prdt[noOfEntries].InterruptOnCompletion = 0;
+
+        lastPairIndex = *PairIndex;
+        lastPairOffset = *PairOffset;
+
+        noOfEntries = noOfEntries + 1;
+        byteCount = byteCount + entrySize;
+        *PairOffset = *PairOffset + entrySize;
+
+        if (*PairOffset == pPair->NumberOfBytes)
+        {
+            *PairIndex = *PairIndex + 1;
+            *PairOffset = 0;
+        }
+    }
+
+    // if the PRD table filled up the command may end in the middle of a sector,
+    // the buffer is not sector aligned => give the partial sector back to the
+    // next command. The last entry describes at least a whole page, the buffer
+    // pieces smaller than a page can only be at its ends.
+    excess = byteCount % SECTOR_SIZE;
+    if (0 != excess)
+    {
+        DWORD lastEntrySize = CommandTable->Prdt[noOfEntries - 1].ByteCount + 1;
+
+        ASSERT(lastEntrySize > excess);
+
+        CommandTable->Prdt[noOfEntries - 1].ByteCount = lastEntrySize - excess - 1;
+        byteCount = byteCount - excess;
+
+        *PairIndex = lastPairIndex;
+        *PairOffset = lastPairOffset + lastEntrySize - excess;
+    }
+
+    *NumberOfEntries = noOfEntries;
+
+    return byteCount / SECTOR_SIZE;
+}
+
+static
+void
+_AhciBuildRegisterFis(
+    IN      PAHCI_PORT                  Port,
+    OUT     PAHCI_FIS_REG_H2D           Fis,
+    IN      DWORD                       Slot,
+    IN      QWORD                       SectorIndex,
+    IN      DWORD                       SectorCount,
+    IN      BOOLEAN                     WriteOperation
+    )
+{
+    WORD sectorCount;
+
+    ASSERT(NULL != Port);
+    ASSERT(NULL != Fis);
+    ASSERT(0 != SectorCount && SectorCount <= AHCI_MAX_SECTORS_PER_COMMAND);
+
+    // 65536 sectors are encoded as 0
+    sectorCount = (WORD) SectorCount;
+
+    memzero(Fis, sizeof(AHCI_FIS_REG_H2D));
+
+    Fis->FisType = AHCI_FIS_TYPE_REG_H2D;
+    Fis->CommandBit = 1;
+    Fis->Device = AHCI_ATA_DEVICE_LBA;
+
+    Fis->Lba0 = (BYTE) (SectorIndex & MAX_BYTE);
+    Fis->Lba1 = (BYTE) ((SectorIndex >> 8) & MAX_BYTE);
+    Fis->Lba2 = (BYTE) ((SectorIndex >> 16) & MAX_BYTE);
+    Fis->Lba3 = (BYTE) ((SectorIndex >> 24) & MAX_BYTE);
+    Fis->Lba4 = (BYTE) ((SectorIndex >> 32) & MAX_BYTE);
+    Fis->Lba5 = (BYTE) ((SectorIndex >> 40) & MAX_BYTE);
+
+    if (Port->NcqEnabled)
+    {
+        Fis->Command = WriteOperation ? AHCI_ATA_CMD_WRITE_FPDMA_QUEUED : AHCI_ATA_CMD_READ_FPDMA_QUEUED;
+
+        Fis->FeatureLow = (BYTE) WORD_LOW(sectorCount);
+        Fis->FeatureHigh = (BYTE) WORD_HIGH(sectorCount);
+
+        // the tag identifies the command when the device reports its completion
+        Fis->CountLow = (BYTE) (Slot << AHCI_ATA_NCQ_TAG_SHIFT);
+    }
+    else
+    {
+        Fis->Command = WriteOperation ? AHCI_ATA_CMD_WRITE_DMA_EXT : AHCI_ATA_CMD_READ_DMA_EXT;
+
+        Fis->CountLow = (BYTE) WORD_LOW(sectorCount);
+        Fis->CountHigh = (BYTE) WORD_HIGH(sectorCount);
+    }
+}
+
+static
+void
+_AhciPrepareCommandHeader(
+    INOUT   PAHCI_PORT                  Port,
+    IN      DWORD                       Slot,
+    IN      DWORD                       NumberOfEntries,
+    IN      BOOLEAN                     WriteOperation
+    )
+{
+    PAHCI_COMMAND_HEADER pHeader;
+
+    ASSERT(NULL != Port);
+    ASSERT(Slot < Port->NumberOfSlots);
+    ASSERT(NumberOfEntries <= AHCI_PRD_ENTRIES_PER_TABLE);
+
+    pHeader = &Port->CommandList[Slot];
+
+    pHeader->CommandFisLength = AHCI_CMD_HEADER_CFL;
+    pHeader->Atapi = 0;
+    pHeader->Write = BooleanToInteger(WriteOperation);
+    pHeader->Prefetchable = 0;
+    pHeader->Reset = 0;
+    pHeader->Bist = 0;
+    pHeader->ClearBusyUponOk = 0;
+    pHeader->PortMultiplier = 0;
+    pHeader->PrdtLength = (WORD) NumberOfEntries;
+    pHeader->PrdByteCount = 0;
+}
+
+static
+void
+_AhciIssueCommand(
+    INOUT   PAHCI_PORT                  Port,
+    IN      DWORD                       Slot,
+    IN      QWORD                       SectorIndex,
+    IN      DWORD                       SectorCount,
+    IN      DWORD                       NumberOfEntries,
+    IN      BOOLEAN                     WriteOperation
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Port);
+
+    _AhciBuildRegisterFis(Port, &Port->Slots[Slot].CommandTable->RegisterFis, Slot, SectorIndex, SectorCount, WriteOperation);
+    _AhciPrepareCommandHeader(Port, Slot, NumberOfEntries, WriteOperation);
+
+    LOG_TRACE_STORAGE("Issuing command in slot %u for 0x%x sectors starting at 0x%X\n", Slot, SectorCount, SectorIndex);
+
+    LockAcquire(&Port->SlotLock, &intrState);
+
+    ASSERT(IsBooleanFlagOn(Port->AllocatedSlots, AHCI_SLOT_BIT(Slot)));
+    ASSERT(!IsBooleanFlagOn(Port->ActiveSlots, AHCI_SLOT_BIT(Slot)));
+
+    Port->ActiveSlots = Port->ActiveSlots | AHCI_SLOT_BIT(Slot);
+    Port->Statistics.CommandsIssued = Port->Statistics.CommandsIssued + 1;
+
+    // writing 0 bits has no effect on these registers, for queued commands
+    // PxSACT must be set before PxCI
+    if (Port->NcqEnabled)
+    {
+        Port->Registers->SataActive = AHCI_SLOT_BIT(Slot);
+    }
+    Port->Registers->CommandIssue = AHCI_SLOT_BIT(Slot);
+
+    LockRelease(&Port->SlotLock, intrState);
+}
+
+static
+void
+_AhciReleaseRequest(
+    INOUT   PAHCI_REQUEST               Request
+    )
+{
+    ASSERT(NULL != Request);
+
+    if (0 != _InterlockedDecrement(&Request->PendingCommands))
+    {
+        return;
+    }
+
+    // this was the last command of the request
+    if (NULL != Request->Irp)
+    {
+        Request->Irp->IoStatus.Status = Request->Status;
+        Request->Irp->IoStatus.Information = SUCCEEDED(Request->Status) ? Request->Length : 0;
+
+        IoCompleteIrp(Request->Irp);
+    }
+
+    if (Request->Detached)
+    {
+        if (NULL != Request->Mdl && !Request->CallerMdl)
+        {
+            IoFreeMdl(Request->Mdl);
+        }
+        Request->Mdl = NULL;
+
+        ExFreePoolWithTag(Request, HEAP_AHCI_TAG);
+        return;
+    }
+
+    ExEventSignal(&Request->Completed);
+}
@@ -7,18 +7,70 @@ AtaInitialize(
     IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
     IN                              BOOLEAN                     SecondaryChannel,
     IN                              BOOLEAN                     Slave,
+    IN                              PATA_CHANNEL                Channel,
     IN                              PDEVICE_OBJECT              Device
     );
 
-STATUS
-AtaReadWriteSectors(
+//******************************************************************************
+// Function:     AtaIssueCommand
+// Description:  Programs the device with a LBA48 read or write command. If Dma
+//               is TRUE the bus master is started using the PRD table found at
+//               PrdtPhysicalAddress and the function returns immediately, the
+//               completion being signaled through the channel interrupt. Else
+//               the data must be transferred using AtaTransferPio.
+// Returns:      void
+// Parameter:    IN PATA_DEVICE Device
+// Parameter:    IN QWORD SectorIndex
+// Parameter:    IN DWORD SectorCount - at most ATA_MAX_SECTORS_PER_COMMAND
+// Parameter:    IN BOOLEAN WriteOperation
+// Parameter:    IN BOOLEAN Dma
+// Parameter:    IN DWORD PrdtPhysicalAddress - ignored if Dma is FALSE
+//******************************************************************************
+void
+AtaIssueCommand(
     IN                              PATA_DEVICE                 Device,
     IN                              QWORD                       SectorIndex,
+    IN                              DWORD                       SectorCount,
+    IN                              BOOLEAN                     WriteOperation,
+    IN                              BOOLEAN                     Dma,
+    IN                              DWORD                       PrdtPhysicalAddress
+    );
+
+void
+AtaTransferPio(
+    IN                              PATA_DEVICE                 Device,
     IN                              WORD                        SectorCount,
-    _When_(WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
-    _When_(!WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
                                     PVOID                       Buffer,
-    OUT                             WORD*                       SectorsReadWriten,
-    IN                              BOOLEAN                     Asynchronous,
     IN                              BOOLEAN                     WriteOperation
-    );
\ No newline at end of file
+    );
+
+//******************************************************************************
+// Function:     AtaBuildPrdEntries
+// Description:  Describes the physical pages of Mdl, starting at Position, as
+//               PRD entries. The translations are split at each 64KB boundary
+//               and no bounce buffer is ever used. The description stops when
+//               MaxBytes were described or when the table is full, in the
+//               latter case it is shortened to a whole number of sectors.
+// Returns:      STATUS
+// Parameter:    IN PMDL Mdl
+// Parameter:    INOUT PATA_MDL_POSITION Position - updated to the first byte
+//               which was not described
+// Parameter:    IN DWORD MaxBytes - multiple of SECTOR_SIZE
+// Parameter:    OUT PPRD_ENTRY PrdTable
+// Parameter:    IN DWORD MaxEntries
+// Parameter:    OUT DWORD* NumberOfEntries
+// Parameter:    OUT DWORD* BytesDescribed - always a multiple of SECTOR_SIZE
+// NOTE:         The last entry written is marked as the end of the table.
+//******************************************************************************
+STATUS
+AtaBuildPrdEntries(
+    IN                              PMDL                        Mdl,
+    INOUT                           PATA_MDL_POSITION           Position,
+    IN                              DWORD                       MaxBytes,
+    OUT_WRITES(MaxEntries)          union _PRD_ENTRY*           PrdTable,
+    IN                              DWORD                       MaxEntries,
+    OUT                             DWORD*                      NumberOfEntries,
+    OUT                             DWORD*                      BytesDescribed
+    );
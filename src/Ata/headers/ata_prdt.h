@@ -0,0 +1,38 @@
+#pragma once
+
+//******************************************************************************
+// Function:     AtaPrdtPoolInit
+// Description:  Allocates the PRD tables of a device. All the tables are
+//               allocated once, in physically contiguous non-cached memory
+//               below 4GB, and are reused by all the DMA requests of the
+//               device.
+// Returns:      STATUS
+// Parameter:    OUT PATA_PRDT_POOL Pool
+//******************************************************************************
+STATUS
+AtaPrdtPoolInit(
+    OUT     PATA_PRDT_POOL      Pool
+    );
+
+void
+AtaPrdtPoolUninit(
+    INOUT   PATA_PRDT_POOL      Pool
+    );
+
+//******************************************************************************
+// Function:     AtaPrdtPoolAcquire
+// Description:  Takes a PRD table out of the pool, waits for one to be
+//               released if all of them are in use.
+// Returns:      PATA_PRDT - never NULL
+// Parameter:    INOUT PATA_PRDT_POOL Pool
+//******************************************************************************
+PATA_PRDT
+AtaPrdtPoolAcquire(
+    INOUT   PATA_PRDT_POOL      Pool
+    );
+
+void
+AtaPrdtPoolRelease(
+    INOUT   PATA_PRDT_POOL      Pool,
+    IN      PATA_PRDT           Prdt
+    );
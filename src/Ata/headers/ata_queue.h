@@ -0,0 +1,67 @@
+#pragma once
+
+// read requests are more latency sensitive than writes
+#define ATA_QUEUE_READ_DEADLINE_US          (50 * MS_IN_US)
+#define ATA_QUEUE_WRITE_DEADLINE_US         (500 * MS_IN_US)
+
+//******************************************************************************
+// Function:     AtaQueueInitChannel
+// Description:  Initializes the request queue of an IDE channel and allocates
+//               the PRD table used for the merged DMA commands issued on it.
+// Returns:      STATUS
+// Parameter:    OUT PATA_CHANNEL Channel
+//******************************************************************************
+STATUS
+AtaQueueInitChannel(
+    OUT     PATA_CHANNEL        Channel
+    );
+
+void
+AtaQueueUninitChannel(
+    INOUT   PATA_CHANNEL        Channel
+    );
+
+//******************************************************************************
+// Function:     AtaQueueSubmitRequest
+// Description:  Places the request in the channel queue and waits for it to be
+//               served. While waiting the request may be merged with adjacent
+//               requests from other threads into a single DMA command. The
+//               requests are served in LBA order (C-LOOK), except for the ones
+//               whose deadline expired which are served in arrival order.
+// Returns:      STATUS - the status of the transfer
+// Parameter:    INOUT PATA_REQUEST Request - SectorIndex, SectorCount, Buffer,
+//               WriteOperation, Dma and Irp must be set by the caller.
+// NOTE:         If Request->Irp is non-NULL the IRP is completed by the
+//               completion path before the submitter is woken up. On return
+//               Request->Irp is NULL if this happened, else the caller is
+//               still responsible for completing it.
+//               A DMA request whose buffer is too fragmented to be described
+//               by a single PRD table is served in multiple steps.
+//               A Detached request served in a single step is not waited for:
+//               STATUS_PENDING is returned and the request is freed by the
+//               completion path, the caller must not touch it anymore.
+//******************************************************************************
+STATUS
+AtaQueueSubmitRequest(
+    IN      PATA_DEVICE         Device,
+    INOUT   PATA_REQUEST        Request
+    );
+
+//******************************************************************************
+// Function:     AtaQueueCompleteCommand
+// Description:  Completes all the requests served by the active command of the
+//               channel and issues the next command. Called from the DMA
+//               interrupt handler or by the thread which performed a PIO
+//               transfer. The requests are completed after the next command
+//               is issued and without holding the queue lock, so completion
+//               routines may submit new requests to the same channel.
+// Returns:      void
+// Parameter:    INOUT PATA_CHANNEL Channel
+// Parameter:    IN STATUS Status - the status of the command, given to every
+//               request it served
+//******************************************************************************
+void
+AtaQueueCompleteCommand(
+    INOUT   PATA_CHANNEL        Channel,
+    IN      STATUS              Status
+    );
@@ -118,5 +118,8 @@ typedef union _PRD_ENTRY
 } PRD_ENTRY, *PPRD_ENTRY;
 STATIC_ASSERT(ATA_PRD_ENTRY_PREDEFINED_SIZE == sizeof(PRD_ENTRY));
 
+// a PRD table must not cross a 64KB boundary => we never use more than a page
+#define ATA_PRD_ENTRIES_PER_TABLE               (PAGE_SIZE / sizeof(PRD_ENTRY))
+
 #pragma warning(pop)
 #pragma pack(pop)
@@ -2,6 +2,51 @@
 
 #include "ex_event.h"
 
+// LBA48 commands can transfer at most 65536 sectors, a sector
+// count of 0 written to the device means 65536 sectors
+#define ATA_MAX_SECTORS_PER_COMMAND     0x10000
+
+// number of PRD tables pre-allocated for each device, this is also
+// the maximum number of DMA requests a device may have queued
+#define ATA_PRDT_POOL_SIZE              16
+
+typedef struct _ATA_PRDT
+{
+    LIST_ENTRY                  ListEntry;
+
+    union _PRD_ENTRY*           Entries;
+    DWORD                       PhysicalAddress;
+    DWORD                       Capacity;
+} ATA_PRDT, *PATA_PRDT;
+
+typedef struct _ATA_PRDT_POOL
+{
+    LOCK                        Lock;
+
+    _Guarded_by_(Lock)
+    LIST_ENTRY                  FreeList;
+
+    _Guarded_by_(Lock)
+    DWORD                       TablesInUse;
+
+    // number of times a submitter had to wait for a table
+    _Guarded_by_(Lock)
+    QWORD                       Waits;
+
+    EX_EVENT                    TableReleased;
+
+    // ATA_PRDT_POOL_SIZE consecutive pages, one table per page
+    PVOID                       Tables;
+    ATA_PRDT                    Prdts[ATA_PRDT_POOL_SIZE];
+} ATA_PRDT_POOL, *PATA_PRDT_POOL;
+
+// position in the translation pairs of a MDL
+typedef struct _ATA_MDL_POSITION
+{
+    DWORD                       PairIndex;
+    DWORD                       PairOffset;
+} ATA_MDL_POSITION, *PATA_MDL_POSITION;
+
 typedef enum _ATA_TRANSFER_STATE
 {
     AtaTransferStateFree,
@@ -9,13 +54,122 @@ typedef enum _ATA_TRANSFER_STATE
     AtaTransferStateFinished
 } ATA_TRANSFER_STATE;
 
-typedef struct _ATA_CURRENT_TRANSFER
+typedef enum _ATA_REQUEST_STATE
+{
+    AtaRequestStateQueued,
+
+    // the request was chosen by the elevator, but it is a PIO
+    // request => the submitting thread must perform the transfer
+    AtaRequestStatePioReady,
+
+    // the request is part of the command currently executing
+    AtaRequestStateIssued,
+    AtaRequestStateCompleted
+} ATA_REQUEST_STATE;
+
+typedef struct _ATA_REQUEST
+{
+    // element in the LBA sorted list of the channel
+    LIST_ENTRY                  SortedListEntry;
+
+    // element in the arrival ordered list of the channel
+    LIST_ENTRY                  FifoListEntry;
+
+    // element in the request list of the command which serves it
+    LIST_ENTRY                  CommandListEntry;
+
+    struct _ATA_DEVICE*         Device;
+    QWORD                       SectorIndex;
+    DWORD                       SectorCount;
+    PVOID                       Buffer;
+    BOOLEAN                     WriteOperation;
+    BOOLEAN                     Dma;
+
+    // the request will be served before any other request as
+    // soon as the system time exceeds this value
+    QWORD                       DeadlineUs;
+
+    // valid only for DMA requests, the PRD table is taken from the pool of
+    // the device and describes the sectors of the request directly from
+    // the physical pages of the MDL
+    struct _MDL*                Mdl;
+    PATA_PRDT                   Prdt;
+
+    // the MDL was pinned by the issuer of the IRP, it must not be freed
+    BOOLEAN                     CallerMdl;
+    DWORD                       NumberOfPrdEntries;
+
+    // a request whose buffer cannot be described by a single PRD table is
+    // served in multiple steps, these are the sectors already transferred
+    DWORD                       SectorsTransferred;
+
+    PIRP                        Irp;
+
+    // the request was allocated for an asynchronous IRP and nobody waits for
+    // it, the completion path releases its resources and frees it
+    BOOLEAN                     Detached;
+
+    volatile ATA_REQUEST_STATE  State;
+    STATUS                      Status;
+    EX_EVENT                    StateChanged;
+} ATA_REQUEST, *PATA_REQUEST;
+
+typedef struct _ATA_COMMAND
+{
+    LIST_ENTRY                  RequestList;
+    DWORD                       NumberOfRequests;
+
+    struct _ATA_DEVICE*         Device;
+    QWORD                       SectorIndex;
+    DWORD                       SectorCount;
+    BOOLEAN                     WriteOperation;
+    BOOLEAN                     Dma;
+} ATA_COMMAND, *PATA_COMMAND;
+
+typedef struct _ATA_CHANNEL_STATISTICS
 {
+    QWORD                       RequestsSubmitted;
+    QWORD                       CommandsIssued;
+    QWORD                       RequestsMerged;
+    QWORD                       DeadlinesExpired;
+    DWORD                       MaximumQueueDepth;
+} ATA_CHANNEL_STATISTICS, *PATA_CHANNEL_STATISTICS;
+
+typedef struct _ATA_CHANNEL
+{
+    LOCK                        QueueLock;
+
+    _Guarded_by_(QueueLock)
+    LIST_ENTRY                  SortedList;
+
+    _Guarded_by_(QueueLock)
+    LIST_ENTRY                  FifoList;
+
+    _Guarded_by_(QueueLock)
+    DWORD                       QueueDepth;
+
+    // sort key of the sector following the last command issued,
+    // the elevator continues its sweep from this position
+    _Guarded_by_(QueueLock)
+    QWORD                       HeadPosition;
+
     volatile DWORD              State;
-    EX_EVENT                    TransferReady;
 
+    _Guarded_by_(QueueLock)
+    ATA_COMMAND                 ActiveCommand;
+
+    // PRD table used by the DMA commands which serve multiple requests, the
+    // tables of the merged requests are concatenated in it. It occupies a
+    // single page => it will never cross a 64KB boundary
     union _PRD_ENTRY*           Prdt;
-} ATA_CURRENT_TRANSFER, *PATA_CURRENT_TRANSPER;
+    DWORD                       PrdtPhysicalAddress;
+    DWORD                       PrdtCapacity;
+
+    BOOLEAN                     InterruptRegistered;
+
+    _Guarded_by_(QueueLock)
+    ATA_CHANNEL_STATISTICS      Statistics;
+} ATA_CHANNEL, *PATA_CHANNEL;
 
 typedef struct _ATA_DEVICE_REGISTERS
 {
@@ -33,5 +187,8 @@ typedef struct _ATA_DEVICE
     BOOLEAN                     Slave;
     BOOLEAN                     Initialized;
 
-    ATA_CURRENT_TRANSFER        CurrentTransfer;
-} ATA_DEVICE, *PATA_DEVICE;
\ No newline at end of file
+    // the master and slave devices share the channel and its request queue
+    PATA_CHANNEL                Channel;
+
+    ATA_PRDT_POOL               PrdtPool;
+} ATA_DEVICE, *PATA_DEVICE;
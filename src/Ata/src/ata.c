@@ -2,6 +2,8 @@
 #include "ata.h"
 #include "ata_dispatch.h"
 #include "ata_operations.h"
+#include "ata_queue.h"
+#include "ata_prdt.h"
 
 STATUS
 (__cdecl AtaDriverEntry)(
@@ -17,6 +19,9 @@ STATUS
     BOOLEAN foundDevice;
     DWORD noOfDevices;
     PCI_SPEC pciSpec;
+    PATA_CHANNEL pChannel;
+    DWORD devicesOnChannel;
+    PATA_DEVICE pDeviceExtension;
 
     ASSERT(NULL != Driver);
 
@@ -30,6 +35,9 @@ STATUS
     i = 0;
     j = 0;
     k = 0;
+    pChannel = NULL;
+    devicesOnChannel = 0;
+    pDeviceExtension = NULL;
     memzero(&pciSpec, sizeof(PCI_SPEC));
 
     pciSpec.MatchClass = TRUE;
@@ -58,6 +66,25 @@ STATUS
 
         for (j = 0; j < 2; ++j)
         {
+            // the master and the slave device share the request queue of the channel
+            pChannel = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(ATA_CHANNEL), HEAP_ATA_TAG, 0);
+            if (NULL == pChannel)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(ATA_CHANNEL));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            status = AtaQueueInitChannel(pChannel);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("AtaQueueInitChannel", status);
+                ExFreePoolWithTag(pChannel, HEAP_ATA_TAG);
+                pChannel = NULL;
+                continue;
+            }
+            devicesOnChannel = 0;
+
             for (k = 0; k < 2; ++k)
             {
                 if (NULL != pAtaDevice)
@@ -75,18 +102,42 @@ STATUS
                 }
                 pAtaDevice->DeviceAlignment = SECTOR_SIZE;
 
+                pDeviceExtension = IoGetDeviceExtension(pAtaDevice);
+                ASSERT(NULL != pDeviceExtension);
+
+                // the PRD tables are allocated once, not for each transfer
+                status = AtaPrdtPoolInit(&pDeviceExtension->PrdtPool);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("AtaPrdtPoolInit", status);
+                    continue;
+                }
+
                 // initialize ATA device
-                status = AtaInitialize(pPciDevices[i], (BOOLEAN)j, (BOOLEAN)k, pAtaDevice);
+                status = AtaInitialize(pPciDevices[i], (BOOLEAN)j, (BOOLEAN)k, pChannel, pAtaDevice);
                 if (!SUCCEEDED(status))
                 {
                     LOG_WARNING("AtaInitialize failed with status: 0x%x\n", status);
+                    AtaPrdtPoolUninit(&pDeviceExtension->PrdtPool);
                     continue;
                 }
                 LOG("AtaInitialize succeded\n");
 
+                // the ATA queue serializes the requests, there is no need for
+                // the I/O manager to do it
+                pAtaDevice->ConcurrentDispatch = TRUE;
+
                 foundDevice = TRUE;
+                devicesOnChannel++;
                 pAtaDevice = NULL;
             }
+
+            if (0 == devicesOnChannel)
+            {
+                AtaQueueUninitChannel(pChannel);
+                ExFreePoolWithTag(pChannel, HEAP_ATA_TAG);
+            }
+            pChannel = NULL;
         }
     }
 
@@ -1,6 +1,7 @@
 #include "ata_base.h"
 #include "ata_dispatch.h"
 #include "ata_operations.h"
+#include "ata_queue.h"
 
 #define LBA48_MAX_VALUE                 0x0000'FFFF'FFFF'FFFFULL
 
@@ -31,7 +32,7 @@ STATUS
 _AtaCheckIOParameters(
     IN                                          PATA_DEVICE     Device,
     IN                                          QWORD           SectorIndex,
-    IN                                          WORD            SectorCount
+    IN                                          DWORD           SectorCount
     )
 {
     ASSERT(NULL != Device);
@@ -75,8 +76,9 @@ STATUS
     STATUS status;
     QWORD sizeInBytes;
     QWORD offset;
-    WORD sectorsRead;
     BOOLEAN writeOperation;
+    ATA_REQUEST request;
+    PATA_REQUEST pRequest;
 
     ASSERT(NULL != DeviceObject);
     ASSERT(NULL != Irp);
@@ -88,8 +90,8 @@ STATUS
     status = STATUS_SUCCESS;
     sizeInBytes = 0;
     offset = 0;
-    sectorsRead = 0;
     writeOperation = FALSE;
+    pRequest = &request;
 
     pAtaDevice = IoGetDeviceExtension(DeviceObject);
     ASSERT(NULL != pAtaDevice);
@@ -126,7 +128,7 @@ STATUS
             __leave;
         }
 
-        status = _AtaCheckIOParameters(pAtaDevice, sectorIndex, (WORD)sectorCount);
+        status = _AtaCheckIOParameters(pAtaDevice, sectorIndex, (DWORD)sectorCount);
         if (!SUCCEEDED(status))
         {
             __leave;
@@ -136,23 +138,69 @@ STATUS
         LOG_TRACE_STORAGE("Sector index: 0x%X\n", sectorIndex);
         LOG_TRACE_STORAGE("Sector count: 0x%X\n", sectorCount);
 
-        ASSERT(AtaTransferStateFree == _InterlockedCompareExchange(&pAtaDevice->CurrentTransfer.State, AtaTransferStateInProgress, AtaTransferStateFree));
+        if (Irp->Flags.Asynchronous)
+        {
+            // nobody waits for an asynchronous IRP => its request may outlive us
+            pRequest = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(ATA_REQUEST), HEAP_ATA_TAG, 0);
+            if (NULL == pRequest)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(ATA_REQUEST));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
 
-        status = AtaReadWriteSectors(pAtaDevice, sectorIndex, (WORD)sectorCount, Irp->Buffer, &sectorsRead, (BOOLEAN)Irp->Flags.Asynchronous, writeOperation);
+            pRequest->Detached = TRUE;
+        }
+        else
+        {
+            memzero(pRequest, sizeof(ATA_REQUEST));
+        }
+
+        pRequest->SectorIndex = sectorIndex;
+        pRequest->SectorCount = (DWORD)sectorCount;
+        pRequest->Buffer = Irp->Buffer;
+        pRequest->WriteOperation = writeOperation;
+        // the pages of a caller supplied MDL are already pinned, DMA
+        // transfers them without any copy
+        pRequest->Dma = (BOOLEAN)(Irp->Flags.Asynchronous || Irp->Flags.CallerMdl);
+        pRequest->Irp = Irp;
+
+        // the IRP is completed by the queue when the command serving
+        // the last sectors of the request finishes
+        status = AtaQueueSubmitRequest(pAtaDevice, pRequest);
+        if (STATUS_PENDING == status)
+        {
+            // the request and the IRP now belong to the completion path
+            pRequest = NULL;
+            Irp = NULL;
+            __leave;
+        }
 
-        _InterlockedExchange(&pAtaDevice->CurrentTransfer.State, AtaTransferStateFree);
+        if (NULL == pRequest->Irp)
+        {
+            Irp = NULL;
+        }
     }
     __finally
     {
-        Irp->IoStatus.Status = status;
-        Irp->IoStatus.Information = sectorsRead * SECTOR_SIZE;
+        if (NULL != pRequest && &request != pRequest)
+        {
+            ExFreePoolWithTag(pRequest, HEAP_ATA_TAG);
+            pRequest = NULL;
+        }
 
-        // complete IRP
-        IoCompleteIrp(Irp);
-        Irp = NULL;
+        if (NULL != Irp)
+        {
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = 0;
+
+            // complete IRP
+            IoCompleteIrp(Irp);
+            Irp = NULL;
+        }
     }
 
-    return STATUS_SUCCESS;
+    return (STATUS_PENDING == status) ? STATUS_PENDING : STATUS_SUCCESS;
 }
 
 STATUS
@@ -204,6 +252,7 @@ STATUS
 
     Irp->IoStatus.Status = status;
     Irp->IoStatus.Information = information;
+    IoCompleteIrp(Irp);
 
     return STATUS_SUCCESS;
 }
\ No newline at end of file
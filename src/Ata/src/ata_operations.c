@@ -2,6 +2,7 @@
 #include "ata_operations.h"
 #include "ata_commands.h"
 #include "ata_registers.h"
+#include "ata_queue.h"
 
 /// to remove
 #include "../../HAL9000/headers/dmp_ata.h"
@@ -44,16 +45,6 @@ _AtaWriteBuffer(
     IN                          DWORD                       WordsToRead
     );
 
-static
-STATUS
-_AtaPrepareDmaTransfer(
-    IN          PATA_DEVICE_REGISTERS                       AtaDevice,
-    INOUT       PATA_CURRENT_TRANSPER                       CurrentTransfer,
-    IN          PVOID                                       Buffer,
-    IN          WORD                                        SectorCount,
-    IN          BOOLEAN                                     WriteOperation
-    );
-
 static
 STATUS
 _AtaValidateTranslationPair(
@@ -308,164 +299,112 @@ _AtaWriteBuffer(
     }
 }
 
-static
 STATUS
-_AtaPrepareDmaTransfer(
-    IN          PATA_DEVICE_REGISTERS                       AtaDevice,
-    INOUT       PATA_CURRENT_TRANSPER                       CurrentTransfer,
-    IN          PVOID                                       Buffer,
-    IN          WORD                                        SectorCount,
-    IN          BOOLEAN                                     WriteOperation
+AtaBuildPrdEntries(
+    IN                              PMDL                        Mdl,
+    INOUT                           PATA_MDL_POSITION           Position,
+    IN                              DWORD                       MaxBytes,
+    OUT_WRITES(MaxEntries)          PPRD_ENTRY                  PrdTable,
+    IN                              DWORD                       MaxEntries,
+    OUT                             DWORD*                      NumberOfEntries,
+    OUT                             DWORD*                      BytesDescribed
     )
 {
-    PMDL pMdl;
     STATUS status;
-    DWORD byteCount;
     DWORD noOfMdlTranslationEntries;
     DWORD indexInPrdEntries;
-    PPRD_ENTRY prdTable;
-    DWORD i;
-    PHYSICAL_ADDRESS prdtPa;
-    DWORD bytesRemaining;
-    DWORD allocationSize;
-
-    LOG_FUNC_START;
-
-    ASSERT( NULL != AtaDevice );
-    ASSERT( NULL != CurrentTransfer );
-    ASSERT( NULL != Buffer );
-    ASSERT( 0 != SectorCount );
-
-    pMdl = NULL;
-    status = STATUS_SUCCESS;
-    byteCount = SectorCount * SECTOR_SIZE;
-    noOfMdlTranslationEntries = 0;
-    prdTable = NULL;
-    prdtPa = NULL;
-    bytesRemaining = SectorCount * SECTOR_SIZE;
+    DWORD byteCount;
+    ATA_MDL_POSITION lastEntryPosition;
+    DWORD excess;
+
+    ASSERT( NULL != Mdl );
+    ASSERT( NULL != Position );
+    ASSERT( 0 != MaxBytes && IsAddressAligned(MaxBytes, SECTOR_SIZE) );
+    ASSERT( NULL != PrdTable );
+    ASSERT( 0 != MaxEntries );
+    ASSERT( NULL != NumberOfEntries );
+    ASSERT( NULL != BytesDescribed );
+
+    noOfMdlTranslationEntries = IoMdlGetNumberOfPairs(Mdl);
     indexInPrdEntries = 0;
-    allocationSize = 0;
+    byteCount = 0;
+    lastEntryPosition = *Position;
 
-    status = IoAllocateMdl(Buffer,byteCount,NULL,&pMdl);
-    if (!SUCCEEDED(status))
-    {
-        LOG_FUNC_ERROR("IoAllocateMdl", status);
-        return status;
-    }
+    ASSERT( Position->PairIndex < noOfMdlTranslationEntries );
 
-    noOfMdlTranslationEntries = IoMdlGetNumberOfPairs(pMdl);
-    ASSERT( 0 != noOfMdlTranslationEntries );
+    while (Position->PairIndex < noOfMdlTranslationEntries &&
+           indexInPrdEntries < MaxEntries &&
+           byteCount < MaxBytes)
+    {
+        QWORD entryAddress;
+        DWORD entrySize;
 
-    // we allocate twice as many entries because we may have translations which cross
-    // the 64KB boundary => we will split such translations into 2 distinct PRD entries
-    allocationSize = sizeof(PRD_ENTRY) * noOfMdlTranslationEntries * 2;
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, Position->PairIndex);
+        ASSERT(NULL != pCurPair);
 
-    __try
-    {
-        // also we align at allocationSize so that we can make sure we do not cross page boundaries
-        prdTable = IoAllocateContinuousMemoryEx(allocationSize, TRUE);
-        if (NULL == prdTable)
+        status = _AtaValidateTranslationPair(pCurPair);
+        if (!SUCCEEDED(status))
         {
-            LOG_FUNC_ERROR("HeapAllocatePoolWithTag", allocationSize);
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
+            return status;
         }
-        ASSERT(IsInSameBoundary(prdTable, allocationSize, PAGE_SIZE));
-
-        for (i = 0; i < noOfMdlTranslationEntries; ++i)
-        {
-            WORD byteCountForPrd;
-            WORD byteCountForAlignment;
-
-            MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(pMdl, i);
-            ASSERT(NULL != pCurPair);
-
-            status = _AtaValidateTranslationPair(pCurPair);
-            if (!SUCCEEDED(status))
-            {
-                __leave;
-            }
-
-            byteCountForPrd = (WORD)min(pCurPair->NumberOfBytes, bytesRemaining);
-            byteCountForAlignment = 0;
-
-            if (!IsInSameBoundary(pCurPair->Address, byteCountForPrd, ATA_DMA_PHYSICAL_BOUNDARY))
-            {
-                byteCountForAlignment = (WORD)(ATA_DMA_PHYSICAL_BOUNDARY - AddressOffset(pCurPair->Address, ATA_DMA_PHYSICAL_BOUNDARY));
 
-                // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-                prdTable[indexInPrdEntries].PhysicalAddress = (DWORD)pCurPair->Address;
-                prdTable[indexInPrdEntries].ByteCount = byteCountForAlignment;
-                prdTable[indexInPrdEntries].LastEntry = 0;
+        entryAddress = (QWORD)pCurPair->Address + Position->PairOffset;
+        entrySize = min(pCurPair->NumberOfBytes - Position->PairOffset, MaxBytes - byteCount);
 
-                indexInPrdEntries++;
-            }
+        // an entry cannot cross a 64KB boundary, which also limits its size to 64KB
+        entrySize = (DWORD) min(entrySize, ATA_DMA_PHYSICAL_BOUNDARY - AddressOffset(entryAddress, ATA_DMA_PHYSICAL_BOUNDARY));
 
-            // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-            prdTable[indexInPrdEntries].PhysicalAddress = (DWORD)pCurPair->Address + byteCountForAlignment;
-            prdTable[indexInPrdEntries].ByteCount = byteCountForPrd - byteCountForAlignment;
-            prdTable[indexInPrdEntries].LastEntry = 0;
+        PrdTable[indexInPrdEntries].PhysicalAddress = (DWORD)entryAddress;
 
-            // increment lbaOffset
-            bytesRemaining = bytesRemaining - byteCountForPrd;
+        // a byte count of 0 means 64KB
+        PrdTable[indexInPrdEntries].ByteCount = (WORD)entrySize;
+        PrdTable[indexInPrdEntries].LastEntry = 0;
 
-            indexInPrdEntries++;
-        }
+        LOG_TRACE_STORAGE("PrdTable[0x%x].PhysicalAddress: 0x%x\n", indexInPrdEntries, PrdTable[indexInPrdEntries].PhysicalAddress);
+        LOG_TRACE_STORAGE("PrdTable[0x%x].ByteCount: 0x%x\n", indexInPrdEntries, entrySize);
 
-        ASSERT(0 == bytesRemaining);
+        lastEntryPosition = *Position;
 
-        // mark last entry
-        prdTable[indexInPrdEntries - 1].LastEntry = 1;
+        indexInPrdEntries++;
+        byteCount = byteCount + entrySize;
+        Position->PairOffset = Position->PairOffset + entrySize;
 
-        LOG_TRACE_STORAGE("Number of entries: 0x%x\n", indexInPrdEntries);
-        for (i = 0; i < indexInPrdEntries; ++i)
+        if (Position->PairOffset == pCurPair->NumberOfBytes)
         {
-            LOG_TRACE_STORAGE("prdTable[i].PhysicalAddress: 0x%x\n", prdTable[i].PhysicalAddress);
-            LOG_TRACE_STORAGE("prdTable[i].ByteCount: 0x%x\n", prdTable[i].ByteCount);
-            LOG_TRACE_STORAGE("prdTable[i].LastEntry: 0x%x\n", prdTable[i].LastEntry);
-            LOG_TRACE_STORAGE("prdTable[i].Raw: 0x%X\n", prdTable[i].Raw);
+            Position->PairIndex = Position->PairIndex + 1;
+            Position->PairOffset = 0;
         }
+    }
+
+    // if the table filled up before MaxBytes were described we may have stopped
+    // in the middle of a sector => leave the partial sector for the next table
+    excess = byteCount % SECTOR_SIZE;
+    if (0 != excess)
+    {
+        PPRD_ENTRY pLastEntry = &PrdTable[indexInPrdEntries - 1];
+        DWORD lastEntrySize = (0 == pLastEntry->ByteCount) ? ATA_DMA_PHYSICAL_BOUNDARY : pLastEntry->ByteCount;
 
-        prdtPa = IoGetPhysicalAddress(prdTable);
-        ASSERT(NULL != prdtPa);
-        if ((QWORD)prdtPa > MAX_DWORD)
+        if (lastEntrySize <= excess)
         {
-            status = STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
-            __leave;
+            // the buffer is so fragmented that a table cannot hold a single
+            // sector, this cannot happen with page sized translations
+            return STATUS_BUFFER_TOO_SMALL;
         }
 
-        LOG_TRACE_STORAGE("About to set up DMA registers!\n");
+        pLastEntry->ByteCount = (WORD)(lastEntrySize - excess);
+        byteCount = byteCount - excess;
 
-        // setup DMA registers
-
-    // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-        _AtaWriteDmaRegisters(AtaDevice, (DWORD)prdtPa, WriteOperation);
-
-        CurrentTransfer->Prdt = prdTable;
+        Position->PairIndex = lastEntryPosition.PairIndex;
+        Position->PairOffset = lastEntryPosition.PairOffset + lastEntrySize - excess;
     }
-    __finally
-    {
-        if (!SUCCEEDED(status))
-        {
-            if (NULL != prdTable)
-            {
-                IoFreeContinuousMemory(prdTable);
-                prdTable = NULL;
-            }
-        }
-        if (NULL != pMdl)
-        {
-            IoFreeMdl(pMdl);
-            pMdl = NULL;
-        }
 
-        LOG_FUNC_END;
-    }
+    ASSERT(0 != indexInPrdEntries);
+    PrdTable[indexInPrdEntries - 1].LastEntry = 1;
 
-    return status;
+    *NumberOfEntries = indexInPrdEntries;
+    *BytesDescribed = byteCount;
+
+    return STATUS_SUCCESS;
 }
 
 static
@@ -476,7 +415,7 @@ _AtaValidateTranslationPair(
 {
     ASSERT( NULL != TranslationPair );
 
-    if ((QWORD)TranslationPair->Address > ATA_DMA_MAX_PHYSICAL_ADDRESS)
+    if ((QWORD)TranslationPair->Address + TranslationPair->NumberOfBytes - 1 > ATA_DMA_MAX_PHYSICAL_ADDRESS)
     {
         return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
     }
@@ -486,11 +425,6 @@ _AtaValidateTranslationPair(
         return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
     }
 
-    if (TranslationPair->NumberOfBytes > ATA_DMA_MAX_PHYSICAL_LEN)
-    {
-        return STATUS_DEVICE_DMA_PHYSICAL_SPAN_TOO_LARGE;
-    }
-
     if (!IsAddressAligned(TranslationPair->NumberOfBytes, ATA_DMA_ALIGNMENT))
     {
         return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
@@ -526,6 +460,7 @@ AtaInitialize(
     IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
     IN                              BOOLEAN                     SecondaryChannel,
     IN                              BOOLEAN                     Slave,
+    IN                              PATA_CHANNEL                Channel,
     IN                              PDEVICE_OBJECT              Device
     )
 {
@@ -547,11 +482,16 @@ AtaInitialize(
         return STATUS_INVALID_PARAMETER1;
     }
 
-    if (NULL == Device)
+    if (NULL == Channel)
     {
         return STATUS_INVALID_PARAMETER4;
     }
 
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
     status = STATUS_SUCCESS;
     data = 0;
     pDeviceExtension = NULL;
@@ -663,12 +603,17 @@ AtaInitialize(
 
     pDeviceExtension->TotalSectors = identify.Address48Bit;
 
-    // initialize current transfer structure
-    _InterlockedExchange(&pDeviceExtension->CurrentTransfer.State, AtaTransferStateFree);
-    status = ExEventInit(&pDeviceExtension->CurrentTransfer.TransferReady, ExEventTypeSynchronization, FALSE );
-    if (!SUCCEEDED(status))
+    // the request queue is shared with the other device on the channel
+    pDeviceExtension->Channel = Channel;
+
+    if (Channel->InterruptRegistered)
     {
-        LOG_FUNC_ERROR("ExEventInit", status );
+        // the other device on this channel already registered the interrupt
+        // handler, it will serve the commands of both devices
+        _AtaWriteRegister(&pDeviceExtension->DeviceRegisters, AtaRegisterBusCommand, 0 );
+
+        pDeviceExtension->Initialized = TRUE;
+
         return status;
     }
 
@@ -692,6 +637,7 @@ AtaInitialize(
         LOG_FUNC_ERROR("IoRegisterInterrupt", status);
         return status;
     }
+    Channel->InterruptRegistered = TRUE;
 
     // make sure DMA transfer is stopped
     _AtaWriteRegister(&pDeviceExtension->DeviceRegisters, AtaRegisterBusCommand, 0 );
@@ -701,44 +647,23 @@ AtaInitialize(
     return status;
 }
 
-STATUS
-AtaReadWriteSectors(
-    IN                                          PATA_DEVICE     Device,
-    IN                                          QWORD           SectorIndex,
-    IN                                          WORD            SectorCount,
-    _When_(WriteOperation,OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
-    _When_(!WriteOperation,IN_READS_BYTES(SectorCount*SECTOR_SIZE))
-                                                PVOID           Buffer,
-    OUT                                         WORD*           SectorsReadWriten,
-    IN                                          BOOLEAN         Asynchronous,
-    IN                                          BOOLEAN         WriteOperation
+void
+AtaIssueCommand(
+    IN                              PATA_DEVICE                 Device,
+    IN                              QWORD                       SectorIndex,
+    IN                              DWORD                       SectorCount,
+    IN                              BOOLEAN                     WriteOperation,
+    IN                              BOOLEAN                     Dma,
+    IN                              DWORD                       PrdtPhysicalAddress
     )
 {
-    STATUS status;
     PATA_DEVICE_REGISTERS pDevRegisters;
     BYTE ataCmd;
 
-    if (NULL == Device)
-    {
-        return STATUS_INVALID_PARAMETER1;
-    }
-
-    if (0 == SectorCount)
-    {
-        return STATUS_INVALID_PARAMETER3;
-    }
-
-    if (NULL == Buffer)
-    {
-        return STATUS_INVALID_PARAMETER4;
-    }
-
-    if (NULL == SectorsReadWriten)
-    {
-        return STATUS_INVALID_PARAMETER5;
-    }
+    ASSERT(NULL != Device);
+    ASSERT(0 != SectorCount && SectorCount <= ATA_MAX_SECTORS_PER_COMMAND);
+    ASSERT(!Dma || 0 != PrdtPhysicalAddress);
 
-    status = STATUS_SUCCESS;
     pDevRegisters = &Device->DeviceRegisters;
 
     // 1. wait for device to become idle
@@ -760,38 +685,24 @@ AtaReadWriteSectors(
     _AtaWaitDeviceReady(pDevRegisters);
 
     LOG_TRACE_STORAGE("Device is ready\n");
-    LOG_TRACE_STORAGE("Asynchronous: 0x%x\n", Asynchronous );
+    LOG_TRACE_STORAGE("DMA: 0x%x\n", Dma );
 
-    // we don't want interrupts if we're performing a synchronous transfer
-    pDevRegisters->NoInterrupt = Asynchronous ? 0 : ATA_DCTRL_REG_NIEN;
+    // we don't want interrupts if we're performing a PIO transfer
+    pDevRegisters->NoInterrupt = Dma ? 0 : ATA_DCTRL_REG_NIEN;
 
     // specify if we want interrupts or not
     _AtaWriteRegister(pDevRegisters, AtaRegisterDeviceControl, pDevRegisters->NoInterrupt);
 
-    if (pDevRegisters->NoInterrupt)
-    {
-        LOG_TRACE_STORAGE("We don't want interrupts\n");
-    }
-    else
-    {
-        LOG_TRACE_STORAGE("We'll use interrupts\n");
-    }
-
     // 4. write command parameters
-    _AtaWriteIOParameters(pDevRegisters, SectorIndex, SectorCount);
+    // a sector count of ATA_MAX_SECTORS_PER_COMMAND is truncated to 0 which
+    // is exactly how LBA48 commands encode it
+    _AtaWriteIOParameters(pDevRegisters, SectorIndex, (WORD) SectorCount);
     LOG_TRACE_STORAGE("IO parameters written\n");
 
-    if (Asynchronous)
+    if (Dma)
     {
         // 4.5 write DMA parameters
-
-        // configure bus master register for DMA transfer
-        status = _AtaPrepareDmaTransfer(pDevRegisters, &Device->CurrentTransfer, Buffer, SectorCount, WriteOperation );
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("_AtaPrepareDmaTransfer", status);
-            return status;
-        }
+        _AtaWriteDmaRegisters(pDevRegisters, PrdtPhysicalAddress, WriteOperation);
 
         LOG_TRACE_STORAGE("DMA parameters written\n");
     }
@@ -799,57 +710,52 @@ AtaReadWriteSectors(
     // set command type
     if (WriteOperation)
     {
-        ataCmd = Asynchronous ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_SECTORS_EXT;
+        ataCmd = Dma ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_SECTORS_EXT;
     }
     else
     {
-        ataCmd = Asynchronous ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_SECTORS_EXT;
+        ataCmd = Dma ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_SECTORS_EXT;
     }
 
     // 5. write command
     _AtaWriteRegister(pDevRegisters, AtaRegisterCommand, ataCmd);
 
-    if (Asynchronous)
+    if (Dma)
     {
         // set direction, it's weird this must be set after the command is written
         // yeah Read => bit set, Write => bit cleared
         _AtaWriteRegister(pDevRegisters, AtaRegisterBusCommand, (!WriteOperation * ATA_BUS_CMD_READ_BIT) | ATA_BUS_CMD_START_BIT);
 
-        // wait for DMA transfer to complete
-        ExEventWaitForSignal(&Device->CurrentTransfer.TransferReady);
+        // the completion will be signaled by the interrupt
+    }
+}
 
-        // check if transfer actually finished
-        ASSERT( AtaTransferStateFinished == _InterlockedAnd( &Device->CurrentTransfer.State, MAX_DWORD ) );
-        ASSERT( NULL != Device->CurrentTransfer.Prdt );
+void
+AtaTransferPio(
+    IN                              PATA_DEVICE                 Device,
+    IN                              WORD                        SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                                    PVOID                       Buffer,
+    IN                              BOOLEAN                     WriteOperation
+    )
+{
+    ASSERT(NULL != Device);
+    ASSERT(0 != SectorCount);
+    ASSERT(NULL != Buffer);
 
-        LOG_TRACE_STORAGE("About to free PRDT\n");
-        IoFreeContinuousMemory(Device->CurrentTransfer.Prdt );
-        Device->CurrentTransfer.Prdt = NULL;
+    if (WriteOperation)
+    {
+        _AtaWriteBuffer(&Device->DeviceRegisters, Buffer, SectorCount * (SECTOR_SIZE / sizeof(WORD)));
 
-        LOG_TRACE_STORAGE("DMA transfer complete\n");
+        LOG_TRACE_STORAGE("Buffer written\n");
     }
     else
     {
-        // read buffer synchronously
-        if (WriteOperation)
-        {
-            _AtaWriteBuffer(pDevRegisters, Buffer, SectorCount * (SECTOR_SIZE / sizeof(WORD)));
-
-            LOG_TRACE_STORAGE("Buffer written\n");
-        }
-        else
-        {
-            _AtaReadBuffer(pDevRegisters, Buffer, SectorCount * (SECTOR_SIZE / sizeof(WORD)));
+        _AtaReadBuffer(&Device->DeviceRegisters, Buffer, SectorCount * (SECTOR_SIZE / sizeof(WORD)));
 
-            LOG_TRACE_STORAGE("Buffer read\n");
-        }
+        LOG_TRACE_STORAGE("Buffer read\n");
     }
-
-    *SectorsReadWriten = SectorCount;
-
-    status = STATUS_SUCCESS;
-
-    return status;
 }
 
 BOOLEAN
@@ -858,17 +764,34 @@ BOOLEAN
     )
 {
     PATA_DEVICE pAtaDev;
+    PATA_CHANNEL pChannel;
     PATA_DEVICE_REGISTERS pDevRegisters;
     BYTE busStatus;
     BYTE devStatus;
+    STATUS status;
 
     LOG_FUNC_START;
 
     ASSERT( NULL != Device );
 
+    status = STATUS_SUCCESS;
+
     pAtaDev = IoGetDeviceExtension(Device);
     ASSERT( NULL != pAtaDev );
 
+    pChannel = pAtaDev->Channel;
+    ASSERT( NULL != pChannel );
+
+    if (AtaTransferStateInProgress != pChannel->State || !pChannel->ActiveCommand.Dma)
+    {
+        // we have no DMA transfer in flight on this channel
+        return FALSE;
+    }
+
+    // the command may belong to the other device on the channel
+    pAtaDev = pChannel->ActiveCommand.Device;
+    ASSERT( NULL != pAtaDev );
+
     pDevRegisters = &pAtaDev->DeviceRegisters;
 
     _AtaSelectDevice(pDevRegisters, pAtaDev->Slave);
@@ -882,27 +805,28 @@ BOOLEAN
     }
 
     devStatus = _AtaReadRegister(pDevRegisters, AtaRegisterStatus);
-    ASSERT(!IsBooleanFlagOn(devStatus, ATA_SREG_DF));
-
-    if (IsBooleanFlagOn(devStatus, ATA_SREG_ERR))
+    if (IsBooleanFlagOn(devStatus, ATA_SREG_ERR) || IsBooleanFlagOn(devStatus, ATA_SREG_DF))
     {
-        LOG_ERROR("DMA command failed, error register: 0x%x\n", _AtaReadRegister(pDevRegisters, AtaRegisterError ));
-        NOT_REACHED;
+        // the command may serve several merged requests, all of them fail
+        // but the channel keeps serving the requests queued after them
+        LOG_ERROR("DMA command for sector 0x%X failed, status register: 0x%x, error register: 0x%x\n",
+                  pChannel->ActiveCommand.SectorIndex, devStatus, _AtaReadRegister(pDevRegisters, AtaRegisterError ));
+        status = STATUS_DEVICE_TRANSFER_ERROR;
     }
 
     // must set Stop bit in command register
     _AtaWriteRegister(pDevRegisters, AtaRegisterBusCommand, 0 );
 
-    ASSERT( AtaTransferStateInProgress == _InterlockedCompareExchange( &pAtaDev->CurrentTransfer.State, AtaTransferStateFinished, AtaTransferStateInProgress ) );
-
-    ExEventSignal(&pAtaDev->CurrentTransfer.TransferReady);
-
     // clear IRQ bit
     // apparently this status register is R/W
-    _AtaWriteRegister(&pAtaDev->DeviceRegisters, AtaRegisterBusStatus, ATA_BUS_DMA_IRQ );
+    // this must be done before the next command is issued
+    _AtaWriteRegister(pDevRegisters, AtaRegisterBusStatus, ATA_BUS_DMA_IRQ );
+
+    // complete the requests served by this command and issue the next one
+    AtaQueueCompleteCommand(pChannel, status);
 
     LOG_FUNC_END;
 
     // we solved the interrupt
     return TRUE;
-}
\ No newline at end of file
+}
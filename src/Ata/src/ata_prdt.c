@@ -0,0 +1,142 @@
+#include "ata_base.h"
+#include "ata_prdt.h"
+#include "ata_registers.h"
+
+STATUS
+AtaPrdtPoolInit(
+    OUT     PATA_PRDT_POOL      Pool
+    )
+{
+    STATUS status;
+    QWORD tablesPa;
+    DWORD i;
+
+    ASSERT(NULL != Pool);
+
+    memzero(Pool, sizeof(ATA_PRDT_POOL));
+
+    LockInit(&Pool->Lock);
+    InitializeListHead(&Pool->FreeList);
+
+    status = ExEventInit(&Pool->TableReleased, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    // each table occupies a page => none of them crosses a 64KB boundary
+    Pool->Tables = IoAllocateContinuousMemoryEx(ATA_PRDT_POOL_SIZE * PAGE_SIZE, TRUE);
+    if (NULL == Pool->Tables)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", ATA_PRDT_POOL_SIZE * PAGE_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    tablesPa = (QWORD) IoGetPhysicalAddress(Pool->Tables);
+    ASSERT(0 != tablesPa);
+
+    if (tablesPa + ATA_PRDT_POOL_SIZE * PAGE_SIZE - 1 > ATA_DMA_MAX_PHYSICAL_ADDRESS)
+    {
+        IoFreeContinuousMemory(Pool->Tables);
+        Pool->Tables = NULL;
+
+        return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+    }
+
+    for (i = 0; i < ATA_PRDT_POOL_SIZE; ++i)
+    {
+        PATA_PRDT pPrdt = &Pool->Prdts[i];
+
+        pPrdt->Entries = (PPRD_ENTRY) PtrOffset(Pool->Tables, i * PAGE_SIZE);
+        pPrdt->PhysicalAddress = (DWORD) (tablesPa + i * PAGE_SIZE);
+        pPrdt->Capacity = ATA_PRD_ENTRIES_PER_TABLE;
+
+        InsertTailList(&Pool->FreeList, &pPrdt->ListEntry);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+AtaPrdtPoolUninit(
+    INOUT   PATA_PRDT_POOL      Pool
+    )
+{
+    ASSERT(NULL != Pool);
+
+    if (NULL != Pool->Tables)
+    {
+        IoFreeContinuousMemory(Pool->Tables);
+        Pool->Tables = NULL;
+    }
+
+    InitializeListHead(&Pool->FreeList);
+}
+
+PATA_PRDT
+AtaPrdtPoolAcquire(
+    INOUT   PATA_PRDT_POOL      Pool
+    )
+{
+    INTR_STATE intrState;
+    PLIST_ENTRY pEntry;
+    BOOLEAN moreAvailable;
+
+    ASSERT(NULL != Pool);
+
+    for (;;)
+    {
+        LockAcquire(&Pool->Lock, &intrState);
+
+        pEntry = RemoveHeadList(&Pool->FreeList);
+        moreAvailable = !IsListEmpty(&Pool->FreeList);
+
+        if (pEntry != &Pool->FreeList)
+        {
+            Pool->TablesInUse = Pool->TablesInUse + 1;
+        }
+        else
+        {
+            Pool->Waits = Pool->Waits + 1;
+        }
+
+        LockRelease(&Pool->Lock, intrState);
+
+        if (pEntry != &Pool->FreeList)
+        {
+            if (moreAvailable)
+            {
+                // pass the wake up on in case more threads are waiting
+                ExEventSignal(&Pool->TableReleased);
+            }
+
+            return CONTAINING_RECORD(pEntry, ATA_PRDT, ListEntry);
+        }
+
+        ExEventWaitForSignal(&Pool->TableReleased);
+    }
+}
+
+void
+AtaPrdtPoolRelease(
+    INOUT   PATA_PRDT_POOL      Pool,
+    IN      PATA_PRDT           Prdt
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Pool);
+    ASSERT(NULL != Prdt);
+
+    LockAcquire(&Pool->Lock, &intrState);
+
+    ASSERT(Pool->TablesInUse > 0);
+    Pool->TablesInUse = Pool->TablesInUse - 1;
+
+    InsertHeadList(&Pool->FreeList, &Prdt->ListEntry);
+
+    LockRelease(&Pool->Lock, intrState);
+
+    ExEventSignal(&Pool->TableReleased);
+}
@@ -0,0 +1,779 @@
+#include "ata_base.h"
+#include "ata_queue.h"
+#include "ata_operations.h"
+#include "ata_registers.h"
+#include "ata_prdt.h"
+
+// the master and the slave device share the same channel => we prefix the LBA
+// (a 48 bit value) with the device so the requests of each device are grouped
+#define ATA_SORT_KEY(Device,Sector)         ((((QWORD)(Device)->Slave) << 48) | (Sector))
+#define ATA_REQUEST_SORT_KEY(Request)       ATA_SORT_KEY((Request)->Device,(Request)->SectorIndex)
+
+static FUNC_CompareFunction                 _AtaQueueCompareRequests;
+
+static
+STATUS
+_AtaQueuePrepareDmaStep(
+    INOUT   PATA_REQUEST        Request,
+    INOUT   PATA_MDL_POSITION   Position,
+    IN      DWORD               SectorsRemaining
+    );
+
+static
+void
+_AtaQueueQueueRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    );
+
+static
+STATUS
+_AtaQueueExecuteRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    );
+
+static
+void
+_AtaQueueFreeDetachedRequest(
+    INOUT   PATA_REQUEST        Request
+    );
+
+static
+void
+_AtaQueueInsertRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    );
+
+static
+void
+_AtaQueueRemoveRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    );
+
+static
+PATA_REQUEST
+_AtaQueueSelectNextRequest(
+    INOUT   PATA_CHANNEL        Channel
+    );
+
+static
+BOOLEAN
+_AtaQueueCanMerge(
+    IN      PATA_CHANNEL        Channel,
+    IN      PATA_COMMAND        Command,
+    IN      PATA_REQUEST        Request,
+    IN      DWORD               PrdEntriesUsed,
+    IN      BOOLEAN             FrontMerge
+    );
+
+static
+void
+_AtaQueueStartNextCommand(
+    INOUT   PATA_CHANNEL        Channel
+    );
+
+static
+DWORD
+_AtaQueueFillPrdt(
+    INOUT   PATA_CHANNEL        Channel,
+    IN      PATA_COMMAND        Command
+    );
+
+STATUS
+AtaQueueInitChannel(
+    OUT     PATA_CHANNEL        Channel
+    )
+{
+    PHYSICAL_ADDRESS prdtPa;
+
+    ASSERT(NULL != Channel);
+
+    memzero(Channel, sizeof(ATA_CHANNEL));
+
+    LockInit(&Channel->QueueLock);
+    InitializeListHead(&Channel->SortedList);
+    InitializeListHead(&Channel->FifoList);
+    InitializeListHead(&Channel->ActiveCommand.RequestList);
+    _InterlockedExchange(&Channel->State, AtaTransferStateFree);
+
+    // a single page can never cross a 64KB boundary
+    Channel->Prdt = IoAllocateContinuousMemoryEx(PAGE_SIZE, TRUE);
+    if (NULL == Channel->Prdt)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", PAGE_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    prdtPa = IoGetPhysicalAddress(Channel->Prdt);
+    ASSERT(NULL != prdtPa);
+    if ((QWORD)prdtPa > ATA_DMA_MAX_PHYSICAL_ADDRESS)
+    {
+        IoFreeContinuousMemory(Channel->Prdt);
+        Channel->Prdt = NULL;
+
+        return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+    }
+
+    // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
+#pragma warning(suppress:4311)
+    Channel->PrdtPhysicalAddress = (DWORD)prdtPa;
+    Channel->PrdtCapacity = PAGE_SIZE / sizeof(PRD_ENTRY);
+
+    return STATUS_SUCCESS;
+}
+
+void
+AtaQueueUninitChannel(
+    INOUT   PATA_CHANNEL        Channel
+    )
+{
+    ASSERT(NULL != Channel);
+    ASSERT(IsListEmpty(&Channel->SortedList));
+
+    if (NULL != Channel->Prdt)
+    {
+        IoFreeContinuousMemory(Channel->Prdt);
+        Channel->Prdt = NULL;
+    }
+}
+
+STATUS
+AtaQueueSubmitRequest(
+    IN      PATA_DEVICE         Device,
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    STATUS status;
+    PATA_CHANNEL pChannel;
+    PIRP pIrp;
+    ATA_MDL_POSITION position;
+    DWORD sectorsRemaining;
+    BOOLEAN irpHandedOff;
+    BOOLEAN bPending;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Request);
+    ASSERT(0 != Request->SectorCount && Request->SectorCount <= MAX_WORD);
+    ASSERT(NULL != Request->Buffer);
+
+    pChannel = Device->Channel;
+    ASSERT(NULL != pChannel);
+
+    status = STATUS_SUCCESS;
+    pIrp = Request->Irp;
+    memzero(&position, sizeof(ATA_MDL_POSITION));
+    sectorsRemaining = Request->SectorCount;
+    irpHandedOff = FALSE;
+    bPending = FALSE;
+
+    Request->Device = Device;
+    Request->Mdl = NULL;
+    Request->CallerMdl = FALSE;
+    Request->Prdt = NULL;
+    Request->NumberOfPrdEntries = 0;
+    Request->SectorsTransferred = 0;
+
+    status = ExEventInit(&Request->StateChanged, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    __try
+    {
+        if (Request->Dma)
+        {
+            Request->Mdl = (NULL != pIrp)
+                ? IoGetCallerMdl(pIrp, Request->Buffer, Request->SectorCount * SECTOR_SIZE)
+                : NULL;
+            Request->CallerMdl = (NULL != Request->Mdl);
+
+            if (!Request->CallerMdl)
+            {
+                status = IoAllocateMdl(Request->Buffer, Request->SectorCount * SECTOR_SIZE, NULL, &Request->Mdl);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("IoAllocateMdl", status);
+                    __leave;
+                }
+            }
+
+            // the table is reused by all the steps of the request
+            Request->Prdt = AtaPrdtPoolAcquire(&Device->PrdtPool);
+        }
+
+        do
+        {
+            if (Request->Dma)
+            {
+                // the PRD entries are built here, in the context of the submitter,
+                // the command may be issued later from the interrupt handler
+                status = _AtaQueuePrepareDmaStep(Request, &position, sectorsRemaining);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_AtaQueuePrepareDmaStep", status);
+                    __leave;
+                }
+            }
+
+            sectorsRemaining = sectorsRemaining - Request->SectorCount;
+
+            // only the last step completes the IRP
+            irpHandedOff = (0 == sectorsRemaining);
+            Request->Irp = irpHandedOff ? pIrp : NULL;
+
+            if (Request->Detached && irpHandedOff)
+            {
+                // a single step is enough => there is nothing left for us to
+                // do after the command is issued, from now on the request
+                // belongs to the completion path
+                ASSERT(NULL != pIrp);
+
+                IoMarkIrpPending(pIrp);
+                bPending = TRUE;
+
+                _AtaQueueQueueRequest(pChannel, Request);
+
+                status = STATUS_PENDING;
+                __leave;
+            }
+
+            // the request will be waited for => it is handled as a regular one
+            Request->Detached = FALSE;
+
+            status = _AtaQueueExecuteRequest(pChannel, Request);
+            if (!SUCCEEDED(status))
+            {
+                __leave;
+            }
+
+            Request->SectorIndex = Request->SectorIndex + Request->SectorCount;
+            Request->SectorsTransferred = Request->SectorsTransferred + Request->SectorCount;
+        } while (0 != sectorsRemaining);
+    }
+    __finally
+    {
+        // a pending request may already be completed and freed
+        if (!bPending)
+        {
+            if (NULL != Request->Prdt)
+            {
+                AtaPrdtPoolRelease(&Device->PrdtPool, Request->Prdt);
+                Request->Prdt = NULL;
+            }
+
+            if (NULL != Request->Mdl && !Request->CallerMdl)
+            {
+                IoFreeMdl(Request->Mdl);
+            }
+            Request->Mdl = NULL;
+
+            // let the caller know if it is still responsible for the IRP
+            Request->Irp = irpHandedOff ? NULL : pIrp;
+        }
+    }
+
+    return status;
+}
+
+void
+AtaQueueCompleteCommand(
+    INOUT   PATA_CHANNEL        Channel,
+    IN      STATUS              Status
+    )
+{
+    INTR_STATE intrState;
+    PATA_COMMAND pCommand;
+    PLIST_ENTRY pEntry;
+    LIST_ENTRY finishedRequests;
+
+    ASSERT(NULL != Channel);
+
+    InitializeListHead(&finishedRequests);
+
+    LockAcquire(&Channel->QueueLock, &intrState);
+
+    ASSERT(AtaTransferStateInProgress == Channel->State);
+
+    pCommand = &Channel->ActiveCommand;
+
+    // the requests are completed only after the lock is released, a completion
+    // routine may issue a new request to this same channel
+    for (pEntry = RemoveHeadList(&pCommand->RequestList);
+         pEntry != &pCommand->RequestList;
+         pEntry = RemoveHeadList(&pCommand->RequestList))
+    {
+        InsertTailList(&finishedRequests, pEntry);
+    }
+    pCommand->NumberOfRequests = 0;
+
+    _InterlockedExchange(&Channel->State, AtaTransferStateFree);
+
+    // keep the channel busy
+    _AtaQueueStartNextCommand(Channel);
+
+    LockRelease(&Channel->QueueLock, intrState);
+
+    for (pEntry = RemoveHeadList(&finishedRequests);
+         pEntry != &finishedRequests;
+         pEntry = RemoveHeadList(&finishedRequests))
+    {
+        PATA_REQUEST pRequest = CONTAINING_RECORD(pEntry, ATA_REQUEST, CommandListEntry);
+
+        pRequest->Status = Status;
+
+        if (NULL != pRequest->Irp)
+        {
+            // hand back the IRP directly from the completion path
+            pRequest->Irp->IoStatus.Status = Status;
+            pRequest->Irp->IoStatus.Information = SUCCEEDED(Status) ? (QWORD) (pRequest->SectorsTransferred + pRequest->SectorCount) * SECTOR_SIZE : 0;
+
+            IoCompleteIrp(pRequest->Irp);
+        }
+
+        if (pRequest->Detached)
+        {
+            _AtaQueueFreeDetachedRequest(pRequest);
+            continue;
+        }
+
+        pRequest->State = AtaRequestStateCompleted;
+        ExEventSignal(&pRequest->StateChanged);
+    }
+}
+
+static
+STATUS
+_AtaQueuePrepareDmaStep(
+    INOUT   PATA_REQUEST        Request,
+    INOUT   PATA_MDL_POSITION   Position,
+    IN      DWORD               SectorsRemaining
+    )
+{
+    STATUS status;
+    DWORD noOfEntries;
+    DWORD byteCount;
+
+    ASSERT(NULL != Request);
+    ASSERT(NULL != Request->Mdl);
+    ASSERT(NULL != Request->Prdt);
+    ASSERT(NULL != Position);
+    ASSERT(0 != SectorsRemaining);
+
+    noOfEntries = 0;
+    byteCount = 0;
+
+    // if the buffer is too fragmented to fit in a single table only the sectors
+    // which fit are described, the rest are served by the next steps
+    status = AtaBuildPrdEntries(Request->Mdl,
+                                Position,
+                                SectorsRemaining * SECTOR_SIZE,
+                                Request->Prdt->Entries,
+                                Request->Prdt->Capacity,
+                                &noOfEntries,
+                                &byteCount);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("AtaBuildPrdEntries", status);
+        return status;
+    }
+    ASSERT(0 != byteCount);
+
+    Request->NumberOfPrdEntries = noOfEntries;
+    Request->SectorCount = byteCount / SECTOR_SIZE;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_AtaQueueQueueRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Request);
+
+    Request->State = AtaRequestStateQueued;
+    Request->Status = STATUS_SUCCESS;
+    Request->DeadlineUs = IoGetSystemTimeUs() + (Request->WriteOperation ? ATA_QUEUE_WRITE_DEADLINE_US : ATA_QUEUE_READ_DEADLINE_US);
+
+    LockAcquire(&Channel->QueueLock, &intrState);
+    _AtaQueueInsertRequest(Channel, Request);
+    _AtaQueueStartNextCommand(Channel);
+    LockRelease(&Channel->QueueLock, intrState);
+}
+
+static
+STATUS
+_AtaQueueExecuteRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Request);
+
+    _AtaQueueQueueRequest(Channel, Request);
+
+    // we are signaled when the request becomes PioReady and when it completes
+    do
+    {
+        ExEventWaitForSignal(&Request->StateChanged);
+
+        if (AtaRequestStatePioReady == Request->State)
+        {
+            // the elevator chose our request, but PIO transfers cannot be
+            // performed from the interrupt handler => we do it ourselves
+            // while the channel is reserved for us
+            AtaIssueCommand(Request->Device, Request->SectorIndex, Request->SectorCount, Request->WriteOperation, FALSE, 0);
+            AtaTransferPio(Request->Device, (WORD) Request->SectorCount, Request->Buffer, Request->WriteOperation);
+
+            AtaQueueCompleteCommand(Channel, STATUS_SUCCESS);
+        }
+    } while (AtaRequestStateCompleted != Request->State);
+
+    // the completion path may still hold the event lock after the signal was
+    // seen, make sure it is done with the event before the request goes away
+    LockAcquire(&Request->StateChanged.EventLock, &intrState);
+    LockRelease(&Request->StateChanged.EventLock, intrState);
+
+    return Request->Status;
+}
+
+static
+void
+_AtaQueueInsertRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Request);
+    ASSERT(LockIsOwner(&Channel->QueueLock));
+
+    InsertOrderedList(&Channel->SortedList, &Request->SortedListEntry, _AtaQueueCompareRequests, NULL);
+    InsertTailList(&Channel->FifoList, &Request->FifoListEntry);
+
+    Channel->QueueDepth = Channel->QueueDepth + 1;
+
+    Channel->Statistics.RequestsSubmitted = Channel->Statistics.RequestsSubmitted + 1;
+    Channel->Statistics.MaximumQueueDepth = max(Channel->Statistics.MaximumQueueDepth, Channel->QueueDepth);
+}
+
+static
+void
+_AtaQueueRemoveRequest(
+    INOUT   PATA_CHANNEL        Channel,
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Request);
+    ASSERT(LockIsOwner(&Channel->QueueLock));
+    ASSERT(Channel->QueueDepth > 0);
+
+    RemoveEntryList(&Request->SortedListEntry);
+    RemoveEntryList(&Request->FifoListEntry);
+
+    Channel->QueueDepth = Channel->QueueDepth - 1;
+}
+
+static
+PATA_REQUEST
+_AtaQueueSelectNextRequest(
+    INOUT   PATA_CHANNEL        Channel
+    )
+{
+    PATA_REQUEST pOldest;
+    PLIST_ENTRY pEntry;
+
+    ASSERT(NULL != Channel);
+    ASSERT(!IsListEmpty(&Channel->FifoList));
+
+    // deadline fairness: a request which waited for too long is served first,
+    // regardless of the position of the head
+    pOldest = CONTAINING_RECORD(Channel->FifoList.Flink, ATA_REQUEST, FifoListEntry);
+    if (IoGetSystemTimeUs() >= pOldest->DeadlineUs)
+    {
+        Channel->Statistics.DeadlinesExpired = Channel->Statistics.DeadlinesExpired + 1;
+        return pOldest;
+    }
+
+    // C-LOOK: continue the sweep in increasing LBA order from the last position
+    for (pEntry = Channel->SortedList.Flink;
+         pEntry != &Channel->SortedList;
+         pEntry = pEntry->Flink)
+    {
+        PATA_REQUEST pRequest = CONTAINING_RECORD(pEntry, ATA_REQUEST, SortedListEntry);
+
+        if (ATA_REQUEST_SORT_KEY(pRequest) >= Channel->HeadPosition)
+        {
+            return pRequest;
+        }
+    }
+
+    // nothing after the head, start a new sweep from the lowest LBA
+    return CONTAINING_RECORD(Channel->SortedList.Flink, ATA_REQUEST, SortedListEntry);
+}
+
+static
+BOOLEAN
+_AtaQueueCanMerge(
+    IN      PATA_CHANNEL        Channel,
+    IN      PATA_COMMAND        Command,
+    IN      PATA_REQUEST        Request,
+    IN      DWORD               PrdEntriesUsed,
+    IN      BOOLEAN             FrontMerge
+    )
+{
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Command);
+    ASSERT(NULL != Request);
+
+    if (Request->Device != Command->Device ||
+        !Request->Dma ||
+        Request->WriteOperation != Command->WriteOperation)
+    {
+        return FALSE;
+    }
+
+    if (FrontMerge)
+    {
+        if (Request->SectorIndex + Request->SectorCount != Command->SectorIndex)
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        if (Command->SectorIndex + Command->SectorCount != Request->SectorIndex)
+        {
+            return FALSE;
+        }
+    }
+
+    if (Command->SectorCount + Request->SectorCount > ATA_MAX_SECTORS_PER_COMMAND)
+    {
+        return FALSE;
+    }
+
+    return PrdEntriesUsed + Request->NumberOfPrdEntries <= Channel->PrdtCapacity;
+}
+
+static
+void
+_AtaQueueStartNextCommand(
+    INOUT   PATA_CHANNEL        Channel
+    )
+{
+    PATA_COMMAND pCommand;
+    PATA_REQUEST pRequest;
+    PLIST_ENTRY pPrevEntry;
+    PLIST_ENTRY pNextEntry;
+    DWORD prdEntries;
+    DWORD prdtPa;
+
+    ASSERT(NULL != Channel);
+    ASSERT(LockIsOwner(&Channel->QueueLock));
+
+    if (AtaTransferStateFree != Channel->State || IsListEmpty(&Channel->SortedList))
+    {
+        return;
+    }
+
+    pCommand = &Channel->ActiveCommand;
+    ASSERT(IsListEmpty(&pCommand->RequestList));
+
+    pRequest = _AtaQueueSelectNextRequest(Channel);
+    ASSERT(NULL != pRequest);
+
+    // remember the neighbors before removing the request from the queue
+    pPrevEntry = pRequest->SortedListEntry.Blink;
+    pNextEntry = pRequest->SortedListEntry.Flink;
+
+    _AtaQueueRemoveRequest(Channel, pRequest);
+
+    InsertTailList(&pCommand->RequestList, &pRequest->CommandListEntry);
+    pCommand->NumberOfRequests = 1;
+    pCommand->Device = pRequest->Device;
+    pCommand->SectorIndex = pRequest->SectorIndex;
+    pCommand->SectorCount = pRequest->SectorCount;
+    pCommand->WriteOperation = pRequest->WriteOperation;
+    pCommand->Dma = pRequest->Dma;
+
+    prdEntries = pRequest->NumberOfPrdEntries;
+
+    if (pCommand->Dma)
+    {
+        // back merge: requests continuing the command
+        while (pNextEntry != &Channel->SortedList)
+        {
+            PATA_REQUEST pCandidate = CONTAINING_RECORD(pNextEntry, ATA_REQUEST, SortedListEntry);
+
+            if (!_AtaQueueCanMerge(Channel, pCommand, pCandidate, prdEntries, FALSE))
+            {
+                break;
+            }
+
+            pNextEntry = pNextEntry->Flink;
+            _AtaQueueRemoveRequest(Channel, pCandidate);
+
+            InsertTailList(&pCommand->RequestList, &pCandidate->CommandListEntry);
+            pCommand->NumberOfRequests = pCommand->NumberOfRequests + 1;
+            pCommand->SectorCount = pCommand->SectorCount + pCandidate->SectorCount;
+            prdEntries = prdEntries + pCandidate->NumberOfPrdEntries;
+        }
+
+        // front merge: requests ending where the command starts
+        while (pPrevEntry != &Channel->SortedList)
+        {
+            PATA_REQUEST pCandidate = CONTAINING_RECORD(pPrevEntry, ATA_REQUEST, SortedListEntry);
+
+            if (!_AtaQueueCanMerge(Channel, pCommand, pCandidate, prdEntries, TRUE))
+            {
+                break;
+            }
+
+            pPrevEntry = pPrevEntry->Blink;
+            _AtaQueueRemoveRequest(Channel, pCandidate);
+
+            InsertHeadList(&pCommand->RequestList, &pCandidate->CommandListEntry);
+            pCommand->NumberOfRequests = pCommand->NumberOfRequests + 1;
+            pCommand->SectorIndex = pCandidate->SectorIndex;
+            pCommand->SectorCount = pCommand->SectorCount + pCandidate->SectorCount;
+            prdEntries = prdEntries + pCandidate->NumberOfPrdEntries;
+        }
+
+        Channel->Statistics.RequestsMerged = Channel->Statistics.RequestsMerged + pCommand->NumberOfRequests - 1;
+    }
+
+    Channel->HeadPosition = ATA_SORT_KEY(pCommand->Device, pCommand->SectorIndex + pCommand->SectorCount);
+    Channel->Statistics.CommandsIssued = Channel->Statistics.CommandsIssued + 1;
+
+    _InterlockedExchange(&Channel->State, AtaTransferStateInProgress);
+
+    if (!pCommand->Dma)
+    {
+        // the submitter will do the transfer
+        pRequest->State = AtaRequestStatePioReady;
+        ExEventSignal(&pRequest->StateChanged);
+
+        return;
+    }
+
+    if (1 == pCommand->NumberOfRequests)
+    {
+        // the table of the request was built when it was submitted
+        prdtPa = pRequest->Prdt->PhysicalAddress;
+    }
+    else
+    {
+        DWORD entriesWritten = _AtaQueueFillPrdt(Channel, pCommand);
+        ASSERT(entriesWritten == prdEntries);
+
+        prdtPa = Channel->PrdtPhysicalAddress;
+    }
+
+    LOG_TRACE_STORAGE("Issuing DMA command for 0x%x sectors starting at 0x%X built from %u requests\n",
+                      pCommand->SectorCount, pCommand->SectorIndex, pCommand->NumberOfRequests);
+
+    AtaIssueCommand(pCommand->Device, pCommand->SectorIndex, pCommand->SectorCount, pCommand->WriteOperation, TRUE, prdtPa);
+
+    for (pNextEntry = pCommand->RequestList.Flink;
+         pNextEntry != &pCommand->RequestList;
+         pNextEntry = pNextEntry->Flink)
+    {
+        CONTAINING_RECORD(pNextEntry, ATA_REQUEST, CommandListEntry)->State = AtaRequestStateIssued;
+    }
+}
+
+static
+DWORD
+_AtaQueueFillPrdt(
+    INOUT   PATA_CHANNEL        Channel,
+    IN      PATA_COMMAND        Command
+    )
+{
+    PLIST_ENTRY pEntry;
+    DWORD index;
+
+    ASSERT(NULL != Channel);
+    ASSERT(NULL != Command);
+
+    index = 0;
+
+    // the requests are kept in LBA order => their buffers are described in the
+    // same order in which the device transfers the sectors
+    for (pEntry = Command->RequestList.Flink;
+         pEntry != &Command->RequestList;
+         pEntry = pEntry->Flink)
+    {
+        PATA_REQUEST pRequest = CONTAINING_RECORD(pEntry, ATA_REQUEST, CommandListEntry);
+
+        ASSERT(index + pRequest->NumberOfPrdEntries <= Channel->PrdtCapacity);
+
+        // the entries were built from the MDL when the request was submitted,
+        // we only need to concatenate them
+        memcpy(&Channel->Prdt[index], pRequest->Prdt->Entries, pRequest->NumberOfPrdEntries * sizeof(PRD_ENTRY));
+
+        index = index + pRequest->NumberOfPrdEntries;
+        Channel->Prdt[index - 1].LastEntry = 0;
+    }
+
+    ASSERT(0 != index);
+    Channel->Prdt[index - 1].LastEntry = 1;
+
+    return index;
+}
+
+INT64
+(__cdecl _AtaQueueCompareRequests)(
+    IN      PLIST_ENTRY     FirstElem,
+    IN      PLIST_ENTRY     SecondElem,
+    IN_OPT  PVOID           Context
+    )
+{
+    QWORD firstKey;
+    QWORD secondKey;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    firstKey = ATA_REQUEST_SORT_KEY(CONTAINING_RECORD(FirstElem, ATA_REQUEST, SortedListEntry));
+    secondKey = ATA_REQUEST_SORT_KEY(CONTAINING_RECORD(SecondElem, ATA_REQUEST, SortedListEntry));
+
+    return (firstKey < secondKey) ? -1 : ((firstKey > secondKey) ? 1 : 0);
+}
+
+static
+void
+_AtaQueueFreeDetachedRequest(
+    INOUT   PATA_REQUEST        Request
+    )
+{
+    ASSERT(NULL != Request);
+    ASSERT(Request->Detached);
+
+    if (NULL != Request->Prdt)
+    {
+        AtaPrdtPoolRelease(&Request->Device->PrdtPool, Request->Prdt);
+        Request->Prdt = NULL;
+    }
+
+    if (NULL != Request->Mdl && !Request->CallerMdl)
+    {
+        IoFreeMdl(Request->Mdl);
+    }
+    Request->Mdl = NULL;
+
+    ExFreePoolWithTag(Request, HEAP_ATA_TAG);
+}
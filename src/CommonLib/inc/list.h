@@ -195,6 +195,20 @@ InsertHeadList(
     INOUT   PLIST_ENTRY Entry
     );
 
+//******************************************************************************
+// Function:     AppendTailList
+// Description:  Moves all the elements of ListToAppend to the tail of
+//               ListHead, keeping their order. ListToAppend remains empty.
+// Returns:      void
+// Parameter:    INOUT PLIST_ENTRY ListHead
+// Parameter:    INOUT PLIST_ENTRY ListToAppend
+//******************************************************************************
+void
+AppendTailList(
+    INOUT   PLIST_ENTRY ListHead,
+    INOUT   PLIST_ENTRY ListToAppend
+    );
+
 //******************************************************************************
 // Function:     InsertOrderedList
 // Description:  Inserts an element into the list following the ordering given
@@ -74,6 +74,10 @@ C_HEADER_START
 #define CL_STATUS_SIZE_INVALID                             (ERROR_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0033UL)
 #define CL_STATUS_VALUE_MISMATCH                           (ERROR_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0034UL)
 #define CL_STATUS_OPERATION_REQUIRES_HIGHER_CPL            (ERROR_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0035UL)
+#define CL_STATUS_PENDING                                  (INFO_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0036UL)
+#define CL_STATUS_MORE_PROCESSING_REQUIRED                 (INFO_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0037UL)
+#define CL_STATUS_TIMEOUT                                  (ERROR_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0038UL)
+#define CL_STATUS_INVALID_HANDLE                           (ERROR_MASK | CUSTOMER_BIT | GENERAL_MASK | 0x0039UL)
 
 // introspection errors
 #define CL_STATUS_INTRO_INVALID_SYSCALL_HANDLER            (ERROR_MASK | CUSTOMER_BIT | INTRO_MASK | 0x0001UL )
@@ -187,6 +191,14 @@ C_HEADER_START
 #define CL_STATUS_DEVICE_SPACE_RANGE_EXCEEDED              (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x001DUL)
 #define CL_STATUS_DEVICE_TYPE_INVALID                      (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x001EUL)
 #define CL_STATUS_DEVICE_BUSY                              (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x001FUL)
+#define CL_STATUS_DEVICE_TRANSFER_ERROR                    (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0020UL)
+#define CL_STATUS_NETWORK_UNREACHABLE                      (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0021UL)
+#define CL_STATUS_NETWORK_HOST_UNREACHABLE                 (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0022UL)
+#define CL_STATUS_NETWORK_ADDRESS_IN_USE                   (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0023UL)
+#define CL_STATUS_CONNECTION_REFUSED                       (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0024UL)
+#define CL_STATUS_CONNECTION_RESET                         (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0025UL)
+#define CL_STATUS_CONNECTION_CLOSED                        (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0026UL)
+#define CL_STATUS_SOCKET_INVALID_STATE                     (ERROR_MASK | CUSTOMER_BIT | DEVICE_MASK | 0x0027UL)
 
 // success status
 #define CL_STATUS_SUCCESS                                  0UL
@@ -245,6 +257,10 @@ typedef _Return_type_success_(SUCCEEDED(return)) DWORD  STATUS;
 #define STATUS_SIZE_INVALID                             CL_STATUS_SIZE_INVALID
 #define STATUS_VALUE_MISMATCH                           CL_STATUS_VALUE_MISMATCH
 #define STATUS_OPERATION_REQUIRES_HIGHER_CPL            CL_STATUS_OPERATION_REQUIRES_HIGHER_CPL
+#define STATUS_PENDING                                  CL_STATUS_PENDING
+#define STATUS_MORE_PROCESSING_REQUIRED                 CL_STATUS_MORE_PROCESSING_REQUIRED
+#define STATUS_TIMEOUT                                  CL_STATUS_TIMEOUT
+#define STATUS_INVALID_HANDLE                           CL_STATUS_INVALID_HANDLE
 
 // introspection errors
 #define STATUS_INTRO_INVALID_SYSCALL_HANDLER            CL_STATUS_INTRO_INVALID_SYSCALL_HANDLER
@@ -358,6 +374,14 @@ typedef _Return_type_success_(SUCCEEDED(return)) DWORD  STATUS;
 #define STATUS_DEVICE_SPACE_RANGE_EXCEEDED              CL_STATUS_DEVICE_SPACE_RANGE_EXCEEDED
 #define STATUS_DEVICE_TYPE_INVALID                      CL_STATUS_DEVICE_TYPE_INVALID
 #define STATUS_DEVICE_BUSY                              CL_STATUS_DEVICE_BUSY
+#define STATUS_DEVICE_TRANSFER_ERROR                    CL_STATUS_DEVICE_TRANSFER_ERROR
+#define STATUS_NETWORK_UNREACHABLE                      CL_STATUS_NETWORK_UNREACHABLE
+#define STATUS_NETWORK_HOST_UNREACHABLE                 CL_STATUS_NETWORK_HOST_UNREACHABLE
+#define STATUS_NETWORK_ADDRESS_IN_USE                   CL_STATUS_NETWORK_ADDRESS_IN_USE
+#define STATUS_CONNECTION_REFUSED                       CL_STATUS_CONNECTION_REFUSED
+#define STATUS_CONNECTION_RESET                         CL_STATUS_CONNECTION_RESET
+#define STATUS_CONNECTION_CLOSED                        CL_STATUS_CONNECTION_CLOSED
+#define STATUS_SOCKET_INVALID_STATE                     CL_STATUS_SOCKET_INVALID_STATE
 
 // success status
 #define STATUS_SUCCESS                                  CL_STATUS_SUCCESS
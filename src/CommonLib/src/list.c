@@ -149,6 +149,33 @@ InsertHeadList(
     ListHead->Flink = Entry;
 }
 
+void
+AppendTailList(
+    INOUT PLIST_ENTRY ListHead,
+    INOUT PLIST_ENTRY ListToAppend
+    )
+{
+    PLIST_ENTRY Blink;
+
+#ifdef DEBUG
+    ASSERT(_ValidateListEntry(ListHead));
+    ASSERT(_ValidateListEntry(ListToAppend));
+#endif
+
+    if (ListToAppend->Flink == ListToAppend)
+    {
+        return;
+    }
+
+    Blink = ListHead->Blink;
+    Blink->Flink = ListToAppend->Flink;
+    ListToAppend->Flink->Blink = Blink;
+    ListToAppend->Blink->Flink = ListHead;
+    ListHead->Blink = ListToAppend->Blink;
+
+    InitializeListHead(ListToAppend);
+}
+
 void
 InsertOrderedList(
     INOUT   PLIST_ENTRY             ListHead,
@@ -152,6 +152,10 @@ _DiskInitialize(
         }
         pDiskDevice->DeviceAlignment = HardDiskControllerDevice->DeviceAlignment;
 
+        // the disk only forwards the requests to the controller, which
+        // synchronizes them itself
+        pDiskDevice->ConcurrentDispatch = TRUE;
+
         pDiskData = IoGetDeviceExtension(pDiskDevice);
         ASSERT(NULL != pDiskData);
 
@@ -204,6 +208,7 @@ _DiskRead(
     PIRP pIrp;
     PIO_STACK_LOCATION pStackLocation;
     QWORD byteOffset;
+    IO_STACK_IRP stackIrp;
 
     if (NULL == DiskDevice)
     {
@@ -227,7 +232,7 @@ _DiskRead(
             __leave;
         }
 
-        pIrp = IoAllocateIrp(DiskDevice->StackSize);
+        pIrp = IoAllocateIrpEx(DiskDevice->StackSize, Asynchronous ? NULL : &stackIrp);
         ASSERT(NULL != pIrp);
 
         // setup next stack location
@@ -81,6 +81,7 @@ STATUS
 
     Irp->IoStatus.Information = information;
     Irp->IoStatus.Status = status;
+    IoCompleteIrp(Irp);
 
     return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "io.h"
 #include "log.h"
 #include "ex.h"
+#include "thread.h"
 #include "network.h"
 #include "network_utils.h"
 #include "eth_82574L_structures.h"
\ No newline at end of file
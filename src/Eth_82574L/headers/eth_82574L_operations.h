@@ -1,24 +1,46 @@
 #pragma once
 
+// Multiple queues are used only if the device is MSI-X capable and its MSI-X
+// table can be mapped
 STATUS
 EthInitializeDevice(
     IN_READS(ETH_NO_OF_BARS_USED)   PPCI_BAR        Bars,
+    IN                              BOOLEAN         MsiXCapable,
     INOUT                           PETH_DEVICE     Device
     );
 
 _No_competing_thread_
 STATUS
 EthReceiveFrame(
-    IN                              PETH_DEVICE     Device,
-    IN_OPT                          WORD            MaximumNumberOfFrames
+    IN                              PETH_RX_QUEUE   Queue,
+    IN_OPT                          WORD            MaximumNumberOfFrames,
+    OUT_OPT                         WORD*           NumberOfFramesReceived
     );
 
+// Drains the RX ring of a queue each time the ISR schedules a poll, the RX
+// interrupts of the queue are unmasked only after a pass finds it empty
+FUNC_ThreadStart                    EthRxPollFunction;
+
+// Fills the consecutive descriptors of NumberOfFrames frames of a queue and
+// moves the tail of the queue a single time, only the last descriptor asks
+// the device to report its status. A frame which requests offloads starts
+// with a context descriptor followed by extended data descriptors.
 _No_competing_thread_
 STATUS
-EthSendFrame(
+EthSendFrames(
+    IN                              PETH_DEVICE     Device,
+    IN                              WORD            FirstDescriptorIndex,
+    IN                              WORD            NumberOfFrames,
+    IN_READS(NumberOfFrames)        struct _MINIPORT_TX_FRAME* Frames
+    );
+
+// Returns the number of descriptors of the queue which were sent since the
+// previous call, it only reads the descriptors from memory
+_No_competing_thread_
+DWORD
+EthReclaimTxDescriptors(
     IN                              PETH_DEVICE     Device,
-    IN                              WORD            DescriptorIndex,
-    IN                              WORD            Length
+    IN                              DWORD           QueueIndex
     );
 
 _No_competing_thread_
@@ -27,9 +49,36 @@ EthHandleInterrupt(
     IN                              PETH_DEVICE     Device
     );
 
+// Vector is the index in MINIPORT_DEVICE.InterruptVectors
+BOOLEAN
+EthHandleVectorInterrupt(
+    IN                              PETH_DEVICE     Device,
+    IN                              DWORD           Vector
+    );
+
 _No_competing_thread_
 void
 EthChangeDeviceStatus(
     IN                              PETH_DEVICE             Device,
     IN                              PNETWORK_DEVICE_STATUS  DeviceStatus
-    );
\ No newline at end of file
+    );
+
+void
+EthGetTuning(
+    IN                              PETH_DEVICE             Device,
+    OUT                             PNETWORK_DEVICE_TUNING  Tuning
+    );
+
+// If Tuning->AdaptiveModeration is set the timers are chosen again from the
+// observed traffic, else the timers given are programmed and remain fixed
+STATUS
+EthSetTuning(
+    IN                              PETH_DEVICE             Device,
+    IN                              PNETWORK_DEVICE_TUNING  Tuning
+    );
+
+void
+EthGetStatistics(
+    IN                              PETH_DEVICE             Device,
+    INOUT                           PNETWORK_DEVICE_STATS   Statistics
+    );
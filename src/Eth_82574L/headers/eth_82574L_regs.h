@@ -96,6 +96,21 @@ typedef union _DEVICE_STATUS_REGISTER
 } DEVICE_STATUS_REGISTER, *PDEVICE_STATUS_REGISTER;
 STATIC_ASSERT(sizeof(DEVICE_STATUS_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
+// 0x18 - RW
+typedef union _EXTENDED_DEVICE_CONTROL_REGISTER
+{
+    struct
+    {
+        DWORD               __Reserved0                     : 31;
+
+        // Must be set when MSI-X is used, the pending interrupts are then
+        // reported through the PBA structure of the MSI-X BAR.
+        DWORD               PbaSupport                      : 1;
+    };
+    DWORD                   Raw;
+} EXTENDED_DEVICE_CONTROL_REGISTER, *PEXTENDED_DEVICE_CONTROL_REGISTER;
+STATIC_ASSERT(sizeof(EXTENDED_DEVICE_CONTROL_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Interrupt Register Descriptors                     ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -138,7 +153,20 @@ typedef union _INT_CAUSE_READ_REGISTER
 
         DWORD               __Reserved2                     : 1;
 
-        DWORD               __Reserved3                     : 22;
+        DWORD               __Reserved3                     : 11;
+
+        // Set when an interrupt is pending for the corresponding queue,
+        // valid only in MSI-X mode.
+        DWORD               RxQueue0                        : 1;
+        DWORD               RxQueue1                        : 1;
+        DWORD               TxQueue0                        : 1;
+        DWORD               TxQueue1                        : 1;
+
+        // Set in MSI-X mode for the causes which are not queue related,
+        // e.g. link status change.
+        DWORD               OtherInterrupt                  : 1;
+
+        DWORD               __Reserved4                     : 6;
 
         // This bit is set when the LAN port has a pending interrupt.If the
         // interrupt is enabled in the PCI configuration space, an interrupt is
@@ -149,6 +177,21 @@ typedef union _INT_CAUSE_READ_REGISTER
 } INT_CAUSE_READ_REGISTER, *PINT_CAUSE_READ_REGISTER;
 STATIC_ASSERT(sizeof(INT_CAUSE_READ_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
+// 0xC4 - RW
+typedef union _INTERRUPT_THROTTLING_REGISTER
+{
+    struct
+    {
+        // Minimum inter-interrupt interval measured in increments of 256 ns
+        // (0 = throttling disabled).
+        WORD                    Interval;
+
+        WORD                    __Reserved;
+    };
+    DWORD                       Raw;
+} INTERRUPT_THROTTLING_REGISTER, *PINTERRUPT_THROTTLING_REGISTER;
+STATIC_ASSERT(sizeof(INTERRUPT_THROTTLING_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 // 0xD0 - RW
 typedef union _INT_MASK_SET_REGISTER
 {
@@ -286,6 +329,37 @@ typedef union _INT_MASK_CLEAR_REGISTER
     DWORD                   Raw;
 } INT_MASK_CLEAR_REGISTER, *PINT_MASK_CLEAR_REGISTER;
 
+// 0xE4 - RW
+typedef union _INTERRUPT_VECTOR_ALLOCATION_REGISTER
+{
+    struct
+    {
+        // For each cause the MSI-X vector used and a valid bit.
+        DWORD               RxQueue0Vector                  : 3;
+        DWORD               RxQueue0Valid                   : 1;
+
+        DWORD               RxQueue1Vector                  : 3;
+        DWORD               RxQueue1Valid                   : 1;
+
+        DWORD               TxQueue0Vector                  : 3;
+        DWORD               TxQueue0Valid                   : 1;
+
+        DWORD               TxQueue1Vector                  : 3;
+        DWORD               TxQueue1Valid                   : 1;
+
+        DWORD               OtherVector                     : 3;
+        DWORD               OtherValid                      : 1;
+
+        DWORD               __Reserved0                     : 11;
+
+        // When set a TX interrupt is raised on every descriptor write back,
+        // else only when the TX delay timers expire.
+        DWORD               TxOnEveryWriteBack              : 1;
+    };
+    DWORD                   Raw;
+} INTERRUPT_VECTOR_ALLOCATION_REGISTER, *PINTERRUPT_VECTOR_ALLOCATION_REGISTER;
+STATIC_ASSERT(sizeof(INTERRUPT_VECTOR_ALLOCATION_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Receive Register Descriptors                       ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -575,6 +649,61 @@ typedef union _RECEIVE_FILTER_CONTROL_REGISTER
 } RECEIVE_FILTER_CONTROL_REGISTER, *PRECEIVE_FILTER_CONTROL_REGISTER;
 STATIC_ASSERT(sizeof(RECEIVE_FILTER_CONTROL_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
+// 0x5000 - RW
+typedef union _RECEIVE_CHECKSUM_CONTROL_REGISTER
+{
+    struct
+    {
+        DWORD                   PacketChecksumStart             : 8;
+
+        DWORD                   IpChecksumOffload               : 1;
+
+        DWORD                   TcpUdpChecksumOffload           : 1;
+
+        DWORD                   __Reserved0                     : 3;
+
+        // When set the RSS hash is reported in the receive descriptor
+        // instead of the packet checksum, must be set when RSS is enabled.
+        DWORD                   PacketChecksumDisable           : 1;
+
+        DWORD                   __Reserved1                     : 18;
+    };
+    DWORD                       Raw;
+} RECEIVE_CHECKSUM_CONTROL_REGISTER, *PRECEIVE_CHECKSUM_CONTROL_REGISTER;
+STATIC_ASSERT(sizeof(RECEIVE_CHECKSUM_CONTROL_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
+#define MRQC_MULTIPLE_QUEUES_DISABLED       0b00
+#define MRQC_MULTIPLE_QUEUES_RSS            0b01
+
+// 0x5818 - RW
+typedef union _MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER
+{
+    struct
+    {
+        DWORD                   MultipleQueuesEnable            : 2;
+
+        DWORD                   __Reserved0                     : 14;
+
+        // the fields of the frame used for the RSS hash
+        DWORD                   HashTcpIp4                      : 1;
+        DWORD                   HashIp4                         : 1;
+        DWORD                   HashTcpIp6Ex                    : 1;
+        DWORD                   HashIp6Ex                       : 1;
+        DWORD                   HashIp6                         : 1;
+        DWORD                   HashTcpIp6                      : 1;
+
+        DWORD                   __Reserved1                     : 10;
+    };
+    DWORD                       Raw;
+} MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER, *PMULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER;
+STATIC_ASSERT(sizeof(MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
+// the redirection table has 128 entries of a byte, the most significant
+// bit of each entry is the queue index
+#define ETH_RSS_REDIRECTION_ENTRIES         128
+#define ETH_RSS_REDIRECTION_QUEUE_SHIFT     7
+#define ETH_RSS_KEY_SIZE                    40
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Transmit Register Descriptors                      ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -2,6 +2,7 @@
 
 #include "eth_82574L_regs.h"
 #include "lock_common.h"
+#include "ex_event.h"
 
 #define INTEL_82574L_DEV_ID                     0x10D3
 
@@ -14,27 +15,85 @@
 #define ETH_FLASH_SIZE                          (4*KB_SIZE)
 #define ETH_MSI_X_TABLES_SIZE                   (16*KB_SIZE)
 
+#define ETH_OFFSET_CTRL_EXT                     0x0018
 #define ETH_OFFSET_ICR                          0x00C0
+#define ETH_OFFSET_ITR                          0x00C4
 #define ETH_OFFSET_IMS                          0x00D0
+#define ETH_OFFSET_EIAC                         0x00DC
+#define ETH_OFFSET_IVAR                         0x00E4
+#define ETH_OFFSET_EITR                         0x00E8
 #define ETH_OFFSET_RCTL                         0x0100
 #define ETH_OFFSET_TCTL                         0x0400
 #define ETH_OFFSET_RDBAL                        0x2800
 #define ETH_OFFSET_TDBAL                        0x3800
+#define ETH_OFFSET_TARC                         0x3840
+#define ETH_OFFSET_RXCSUM                       0x5000
 #define ETH_OFFSET_RFCTL                        0x5008
+#define ETH_OFFSET_MRQC                         0x5818
 #define ETH_OFFSET_TO_IP_ADDRESS_VALID          0x5838
+#define ETH_OFFSET_RETA                         0x5C00
+#define ETH_OFFSET_RSSRK                        0x5C80
+
+// the ring registers (RDBAL - RDT, TDBAL - TDT) and TARC of the second
+// queue follow those of the first queue at this stride
+#define ETH_QUEUE_REGISTER_STRIDE               0x100
+
+#define ETH_QUEUE_REGISTER(Regs,Field,Queue)    (*(VOL_DWORD*)((PBYTE)&(Regs)->Field + (Queue) * ETH_QUEUE_REGISTER_STRIDE))
+
+// the transmit queue is enabled for arbitration
+#define ETH_TARC_ENABLE                         (1UL<<10)
+
+#define ETH_MAX_NO_OF_QUEUES                    2
+
+// in MSI-X mode each queue has its own vector, the other causes share a
+// fifth one
+#define ETH_MSI_X_VECTOR_RX_QUEUE(Queue)        (Queue)
+#define ETH_MSI_X_VECTOR_TX_QUEUE(Queue)        (ETH_MAX_NO_OF_QUEUES + (Queue))
+#define ETH_MSI_X_VECTOR_OTHER                  (2 * ETH_MAX_NO_OF_QUEUES)
+#define ETH_NO_OF_MSI_X_VECTORS                 (ETH_MSI_X_VECTOR_OTHER + 1)
+
+#define ETH_NO_OF_EITR                          ETH_NO_OF_MSI_X_VECTORS
 
 #define ETH_DESCRIPTOR_SIZE                     16
 
 #define ETH_DESCRIPTOR_BUFFER_ALIGNMENT         128
 #define ETH_DATA_BUFFER_ALIGNMENT               4
 
-#define ETH_NO_OF_RX_DESCS                      32
-#define ETH_NO_OF_TX_DESCS                      32
+// the ring lengths must be multiples of 128 bytes => of 8 descriptors
+#define ETH_DESCRIPTOR_COUNT_ALIGNMENT          (ETH_DESCRIPTOR_BUFFER_ALIGNMENT / ETH_DESCRIPTOR_SIZE)
+
+// the port driver allocates the default number of descriptors, if there is
+// not enough continuous memory it falls back to smaller rings, but never
+// below the minimum
+#define ETH_DEFAULT_NO_OF_RX_DESCS              256
+#define ETH_DEFAULT_NO_OF_TX_DESCS              256
+#define ETH_MIN_NO_OF_DESCS                     32
+
+// RDLEN/TDLEN would allow larger rings, but a ring of 4096 descriptors
+// already needs 16MB of buffers and the counts must fit in a WORD
+#define ETH_MAX_NO_OF_DESCS                     4096
+
+STATIC_ASSERT(ETH_DEFAULT_NO_OF_RX_DESCS <= ETH_MAX_NO_OF_DESCS && ETH_DEFAULT_NO_OF_RX_DESCS % ETH_DESCRIPTOR_COUNT_ALIGNMENT == 0);
+STATIC_ASSERT(ETH_DEFAULT_NO_OF_TX_DESCS <= ETH_MAX_NO_OF_DESCS && ETH_DEFAULT_NO_OF_TX_DESCS % ETH_DESCRIPTOR_COUNT_ALIGNMENT == 0);
+STATIC_ASSERT(ETH_MIN_NO_OF_DESCS % ETH_DESCRIPTOR_COUNT_ALIGNMENT == 0);
 
 #define ETH_BUFFER_SIZE                         4*KB_SIZE
 
 #define ETH_BSIZE_4KB_SEX                       0b11
 
+// maximum number of RX descriptors processed by a poll pass, if a pass
+// consumes its whole budget the RX interrupts remain masked and another pass
+// follows after the other threads had a chance to run
+#define ETH_RX_POLL_BUDGET                      16
+
+// the interrupt moderation settings are re-evaluated by the poll thread
+// after each interval, the traffic seen in it is classified by the frame
+// rate and the average frame size
+#define ETH_MODERATION_INTERVAL_US              (10 * MS_IN_US)
+#define ETH_MODERATION_LOW_FRAME_RATE           4000
+#define ETH_MODERATION_BULK_FRAME_RATE          20000
+#define ETH_MODERATION_BULK_FRAME_SIZE          1024
+
 #pragma pack(push,1)
 
 #pragma warning(push)
@@ -77,12 +136,18 @@ typedef struct _ETH_INTERNAL_REGS
     // 0x14 - RW
     VOL_DWORD                               EepromReadRegister;
 
-    BYTE                                    __Reserved1[0xA8];
+    // 0x18 - RW
+    VOL_DWORD                               ExtendedDeviceControlRegister;
+
+    BYTE                                    __Reserved1[0xA4];
 
     // 0xC0 - RC/WC
     VOL_DWORD                               InterruptCauseReadRegister;
 
-    BYTE                                    __Reserved99[0xC];
+    // 0xC4 - RW
+    VOL_DWORD                               InterruptThrottlingRegister;
+
+    BYTE                                    __Reserved99[0x8];
 
     // 0xD0 - RW
     VOL_DWORD                               InterruptMaskSetRegister;
@@ -92,7 +157,18 @@ typedef struct _ETH_INTERNAL_REGS
     // 0xD8 - W
     VOL_DWORD                               InterruptMaskClearRegister;
 
-    BYTE                                    __Reserved2[0x24];
+    // 0xDC - RW
+    VOL_DWORD                               ExtendedInterruptAutoClear;
+
+    VOL_DWORD                               __Reserved2;
+
+    // 0xE4 - RW
+    VOL_DWORD                               InterruptVectorAllocation;
+
+    // 0xE8 - 0xF8 - RW
+    VOL_DWORD                               ExtendedInterruptThrottling[ETH_NO_OF_EITR];
+
+    VOL_DWORD                               __Reserved19;
 
     // 0x100 - RW
     VOL_DWORD                               ReceiveControlRegister;
@@ -166,12 +242,27 @@ typedef struct _ETH_INTERNAL_REGS
     // 0x382C - RW
     VOL_DWORD                               TransmitInterruptAbsoluteDelayTimer;
 
-    BYTE                                    __Reserved15[0x17D8];
+    BYTE                                    __Reserved15[0x10];
+
+    // 0x3840 - RW
+    VOL_DWORD                               TransmitArbitrationCount;
+
+    BYTE                                    __Reserved20[0x17BC];
+
+    // 0x5000 - RW
+    VOL_DWORD                               ReceiveChecksumControlRegister;
+
+    VOL_DWORD                               __Reserved21;
 
     // 0x5008 - RW
     VOL_DWORD                               ReceiveFilterControlRegister;
 
-    BYTE                                    __Reserved16[0x82C];
+    BYTE                                    __Reserved16[0x80C];
+
+    // 0x5818 - RW
+    VOL_DWORD                               MultipleReceiveQueuesCommand;
+
+    BYTE                                    __Reserved22[0x1C];
 
     // 0x5838 - RW
     VOL_DWORD                               IpAddressValid;
@@ -181,15 +272,33 @@ typedef struct _ETH_INTERNAL_REGS
 
     // 0x5840
     VOL_DWORD                               IpAddress0;
+
+    BYTE                                    __Reserved23[0x3BC];
+
+    // 0x5C00 - RW
+    VOL_DWORD                               RssRedirectionTable[ETH_RSS_REDIRECTION_ENTRIES / sizeof(DWORD)];
+
+    // 0x5C80 - RW
+    VOL_DWORD                               RssRandomKey[ETH_RSS_KEY_SIZE / sizeof(DWORD)];
 } ETH_INTERNAL_REGS, *PETH_INTERNAL_REGS;
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ExtendedDeviceControlRegister) == ETH_OFFSET_CTRL_EXT);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptCauseReadRegister) == ETH_OFFSET_ICR);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptThrottlingRegister) == ETH_OFFSET_ITR);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptMaskSetRegister) == ETH_OFFSET_IMS);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ExtendedInterruptAutoClear) == ETH_OFFSET_EIAC);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptVectorAllocation) == ETH_OFFSET_IVAR);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ExtendedInterruptThrottling) == ETH_OFFSET_EITR);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveControlRegister) == ETH_OFFSET_RCTL);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TransmitControlRegister) == ETH_OFFSET_TCTL);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveDescriptorAddressLow) == ETH_OFFSET_RDBAL);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TransmitDescriptorAddressLow) == ETH_OFFSET_TDBAL);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TransmitArbitrationCount) == ETH_OFFSET_TARC);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveChecksumControlRegister) == ETH_OFFSET_RXCSUM);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveFilterControlRegister) == ETH_OFFSET_RFCTL);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,MultipleReceiveQueuesCommand) == ETH_OFFSET_MRQC);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,IpAddressValid) == ETH_OFFSET_TO_IP_ADDRESS_VALID );
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,RssRedirectionTable) == ETH_OFFSET_RETA);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,RssRandomKey) == ETH_OFFSET_RSSRK);
 STATIC_ASSERT(sizeof(ETH_INTERNAL_REGS) <= ETH_INTERNAL_REGISTER_SIZE);
 
 typedef struct _RECEIVE_DESCRIPTOR_SHADOW
@@ -203,7 +312,9 @@ typedef struct _RECEIVE_DESCRIPTOR_SHADOW
         {
             BYTE                            DescriptorDone      : 1;
             BYTE                            EOP                 : 1;
-            BYTE                            __Reserved0         : 1;
+
+            // Ignore checksum indication, the checksum bits below are not valid
+            BYTE                            IXSM                : 1;
 
             // Packet is 802.1q (matched VET)
             BYTE                            VP                  : 1;
@@ -220,7 +331,34 @@ typedef struct _RECEIVE_DESCRIPTOR_SHADOW
         };
         BYTE                                Raw;
     } Status;
-    BYTE                                    Errors;
+    union
+    {
+        struct
+        {
+            // CRC or alignment error
+            BYTE                            CE                  : 1;
+
+            // symbol error
+            BYTE                            SE                  : 1;
+
+            // sequence error
+            BYTE                            SEQ                 : 1;
+            BYTE                            __Reserved0         : 1;
+
+            // carrier extension error
+            BYTE                            CXE                 : 1;
+
+            // TCP/UDP checksum error, valid only if TCPCS or UDPCS is set
+            BYTE                            TCPE                : 1;
+
+            // IPv4 checksum error, valid only if IPCS is set
+            BYTE                            IPE                 : 1;
+
+            // RX data error
+            BYTE                            RXE                 : 1;
+        };
+        BYTE                                Raw;
+    } Errors;
     WORD                                    VlanTag;
 } RECEIVE_DESCRIPTOR_SHADOW, *PRECEIVE_DESCRIPTOR_SHADOW;
 typedef volatile RECEIVE_DESCRIPTOR_SHADOW RECEIVE_DESCRIPTOR, *PRECEIVE_DESCRIPTOR;
@@ -301,6 +439,88 @@ typedef struct _TRANSMIT_DESCRIPTOR_SHADOW
 typedef volatile TRANSMIT_DESCRIPTOR_SHADOW TRANSMIT_DESCRIPTOR, *PTRANSMIT_DESCRIPTOR;
 STATIC_ASSERT(sizeof(TRANSMIT_DESCRIPTOR_SHADOW) == ETH_DESCRIPTOR_SIZE);
 
+// The extended descriptors share the RS bit and the DD bit with the legacy
+// descriptor, they may be placed in the same ring and viewed through
+// TRANSMIT_DESCRIPTOR when their status is checked.
+#define ETH_TX_DESCRIPTOR_TYPE_CONTEXT          0b0000
+#define ETH_TX_DESCRIPTOR_TYPE_DATA             0b0001
+
+// The context descriptor describes the offloads of the frames which follow
+// it, it does not have a buffer.
+typedef struct _TRANSMIT_CONTEXT_DESCRIPTOR_SHADOW
+{
+    // the IPv4 header checksum is computed from IPCSS to IPCSE (inclusive)
+    // and placed at IPCSO, all of them are offsets from the start of the frame
+    BYTE                                    IpChecksumStart;
+    BYTE                                    IpChecksumOffset;
+    WORD                                    IpChecksumEnd;
+
+    // the TCP/UDP checksum is computed from TUCSS to TUCSE (inclusive) and
+    // placed at TUCSO, a TUCSE of 0 means the end of the frame
+    BYTE                                    TcpUdpChecksumStart;
+    BYTE                                    TcpUdpChecksumOffset;
+    WORD                                    TcpUdpChecksumEnd;
+
+    // used only for segmentation, the TCP payload length without the headers
+    DWORD                                   PayloadLength       : 20;
+    DWORD                                   DescriptorType      : 4;
+
+    // TUCMD - the TCP bit selects the TCP or the UDP checksum, the IP bit
+    // selects IPv4 or IPv6
+    DWORD                                   TCP                 : 1;
+    DWORD                                   IP                  : 1;
+    DWORD                                   TSE                 : 1;
+    DWORD                                   RS                  : 1;
+    DWORD                                   __Reserved0         : 1;
+    DWORD                                   DEXT                : 1;
+    DWORD                                   __Reserved1         : 1;
+    DWORD                                   IDE                 : 1;
+
+    BYTE                                    DescriptorDone      : 1;
+    BYTE                                    __Reserved2         : 7;
+
+    // used only for segmentation, the length of the headers replicated in
+    // each segment and the maximum TCP payload of a segment
+    BYTE                                    HeaderLength;
+    WORD                                    MaximumSegmentSize;
+} TRANSMIT_CONTEXT_DESCRIPTOR_SHADOW, *PTRANSMIT_CONTEXT_DESCRIPTOR_SHADOW;
+typedef volatile TRANSMIT_CONTEXT_DESCRIPTOR_SHADOW TRANSMIT_CONTEXT_DESCRIPTOR, *PTRANSMIT_CONTEXT_DESCRIPTOR;
+STATIC_ASSERT(sizeof(TRANSMIT_CONTEXT_DESCRIPTOR_SHADOW) == ETH_DESCRIPTOR_SIZE);
+
+// The data descriptor describes a buffer of a frame whose offloads are
+// described by the preceding context descriptor.
+typedef struct _TRANSMIT_DATA_DESCRIPTOR_SHADOW
+{
+    PHYSICAL_ADDRESS                        BufferAddress;
+
+    DWORD                                   Length              : 20;
+    DWORD                                   DescriptorType      : 4;
+
+    // DCMD - same meaning as in the legacy descriptor, TSE marks the
+    // buffers of a frame which is segmented
+    DWORD                                   EOP                 : 1;
+    DWORD                                   IFCS                : 1;
+    DWORD                                   TSE                 : 1;
+    DWORD                                   RS                  : 1;
+    DWORD                                   __Reserved0         : 1;
+    DWORD                                   DEXT                : 1;
+    DWORD                                   VLE                 : 1;
+    DWORD                                   IDE                 : 1;
+
+    BYTE                                    DescriptorDone      : 1;
+    BYTE                                    __Reserved1         : 7;
+
+    // POPTS - insert the IPv4 checksum and the TCP/UDP checksum as described
+    // by the context descriptor, valid in the first descriptor of the frame
+    BYTE                                    IXSM                : 1;
+    BYTE                                    TXSM                : 1;
+    BYTE                                    __Reserved2         : 6;
+
+    WORD                                    VLAN;
+} TRANSMIT_DATA_DESCRIPTOR_SHADOW, *PTRANSMIT_DATA_DESCRIPTOR_SHADOW;
+typedef volatile TRANSMIT_DATA_DESCRIPTOR_SHADOW TRANSMIT_DATA_DESCRIPTOR, *PTRANSMIT_DATA_DESCRIPTOR;
+STATIC_ASSERT(sizeof(TRANSMIT_DATA_DESCRIPTOR_SHADOW) == ETH_DESCRIPTOR_SIZE);
+
 #pragma pack(pop)
 
 typedef struct _ETH_BUFFERS
@@ -310,19 +530,126 @@ typedef struct _ETH_BUFFERS
     WORD                                    BufferSize;
 } ETH_BUFFERS, *PETH_BUFFERS;
 
-typedef struct _RX_DATA
+typedef struct _ETH_RX_POLL
+{
+    // set while the RX interrupts of the queue are masked and the poll
+    // thread owns its descriptors
+    volatile BOOLEAN                        Scheduled;
+
+    EX_EVENT                                PollRequested;
+    struct _THREAD*                         PollThread;
+
+    // the interrupts are counted by the ISR, everything else by the poll
+    // thread
+    NETWORK_RX_POLL_STATS                   Statistics;
+} ETH_RX_POLL, *PETH_RX_POLL;
+
+// the ring given by the port driver is split in equal slices, one for each
+// queue, the descriptor indexes in ETH_BUFFERS are relative to the slice
+typedef struct _ETH_RX_QUEUE
 {
+    struct _ETH_DEVICE*                     Device;
+    DWORD                                   QueueIndex;
+
     PRECEIVE_DESCRIPTOR                     ReceiveBuffer;
+    WORD                                    FirstDescriptor;
     ETH_BUFFERS                             Buffers;
+
+    ETH_RX_POLL                             Poll;
+
+    // written only by the poll thread, the moderation code samples them
+    volatile QWORD                          FramesReceived;
+    volatile QWORD                          BytesReceived;
+} ETH_RX_QUEUE, *PETH_RX_QUEUE;
+
+typedef struct _RX_DATA
+{
+    // the whole ring
+    PRECEIVE_DESCRIPTOR                     ReceiveBuffer;
+    WORD                                    NumberOfDescriptors;
+    WORD                                    BufferSize;
+
+    ETH_RX_QUEUE                            Queues[ETH_MAX_NO_OF_QUEUES];
 } RX_DATA, *PRX_DATA;
 
-typedef struct _TX_DATA
+typedef struct _ETH_TX_QUEUE
 {
+    DWORD                                   QueueIndex;
+
     PTRANSMIT_DESCRIPTOR                    TransmitBuffer;
+    WORD                                    FirstDescriptor;
     ETH_BUFFERS                             Buffers;
-    LOCK                                    TxInterruptLock;
+
+    // the oldest descriptor not yet reclaimed, the ones between it and
+    // Buffers.CurrentDescriptor are owned by the device
+    WORD                                    NextToReclaim;
+
+    QWORD                                   Interrupts;
+} ETH_TX_QUEUE, *PETH_TX_QUEUE;
+
+typedef struct _TX_DATA
+{
+    // the whole ring
+    PTRANSMIT_DESCRIPTOR                    TransmitBuffer;
+    WORD                                    NumberOfDescriptors;
+    WORD                                    BufferSize;
+
+    // the buffer of each descriptor, a context descriptor overwrites the
+    // address which must be restored when the descriptor describes data again
+    PHYSICAL_ADDRESS*                       BufferAddresses;
+
+    ETH_TX_QUEUE                            Queues[ETH_MAX_NO_OF_QUEUES];
 } TX_DATA, *PTX_DATA;
 
+typedef enum _ETH_TRAFFIC_CLASS
+{
+    // few frames => interrupt as soon as possible
+    EthTrafficClassLowestLatency,
+    EthTrafficClassLowLatency,
+
+    // many or large frames => coalesce as many of them as possible
+    EthTrafficClassBulk,
+    EthTrafficClassReserved
+} ETH_TRAFFIC_CLASS;
+
+// all the timers are in microseconds
+typedef struct _ETH_MODERATION_SETTINGS
+{
+    WORD                                    ThrottleUs;
+    WORD                                    RxDelayUs;
+    WORD                                    RxAbsoluteDelayUs;
+    WORD                                    TxDelayUs;
+    WORD                                    TxAbsoluteDelayUs;
+} ETH_MODERATION_SETTINGS, *PETH_MODERATION_SETTINGS;
+
+typedef struct _ETH_MODERATION
+{
+    LOCK                                    Lock;
+
+    // if cleared the settings were fixed by the user
+    _Guarded_by_(Lock)
+    BOOLEAN                                 Adaptive;
+
+    _Guarded_by_(Lock)
+    ETH_TRAFFIC_CLASS                       TrafficClass;
+
+    // the values currently programmed in the device
+    _Guarded_by_(Lock)
+    ETH_MODERATION_SETTINGS                 Settings;
+
+    // the totals received by all the queues when the current interval
+    // started, the traffic of the interval is the difference to the
+    // current totals
+    _Guarded_by_(Lock)
+    QWORD                                   IntervalStartUs;
+
+    _Guarded_by_(Lock)
+    QWORD                                   IntervalStartFrames;
+
+    _Guarded_by_(Lock)
+    QWORD                                   IntervalStartBytes;
+} ETH_MODERATION, *PETH_MODERATION;
+
 #pragma warning(pop)
 
 typedef struct _ETH_DEVICE
@@ -333,8 +660,15 @@ typedef struct _ETH_DEVICE
     volatile DWORD*                         Flash;
     volatile DWORD*                         MsiX;
 
+    // more than one queue is used only in MSI-X mode, the frames are
+    // distributed to the RX queues by RSS
+    DWORD                                   NumberOfQueues;
+    BOOLEAN                                 MsiXEnabled;
+
     RX_DATA                                 RxData;
     TX_DATA                                 TxData;
+
+    ETH_MODERATION                          Moderation;
 } ETH_DEVICE, *PETH_DEVICE;
 
 // General
@@ -354,6 +688,17 @@ EthGetDeviceStatusRegister(
     IN      PETH_DEVICE         Device
     );
 
+EXTENDED_DEVICE_CONTROL_REGISTER
+EthGetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE         Device
+    );
+
+void
+EthSetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      EXTENDED_DEVICE_CONTROL_REGISTER    ControlRegister
+    );
+
 // Interrupt
 INT_CAUSE_READ_REGISTER
 EthGetInterruptReason(
@@ -377,6 +722,31 @@ EthSetInterruptMaskClearRegister(
     IN      INT_MASK_CLEAR_REGISTER     Mask
     );
 
+WORD
+EthGetInterruptThrottling(
+    IN      PETH_DEVICE         Device
+    );
+
+// In MSI-X mode the interval is also programmed for each vector
+void
+EthSetInterruptThrottling(
+    IN      PETH_DEVICE         Device,
+    IN      WORD                Microseconds
+    );
+
+void
+EthSetInterruptVectorAllocation(
+    IN      PETH_DEVICE                             Device,
+    IN      INTERRUPT_VECTOR_ALLOCATION_REGISTER    Allocation
+    );
+
+// The causes set in Mask are cleared from ICR when their MSI-X message is sent
+void
+EthSetInterruptAutoClear(
+    IN      PETH_DEVICE             Device,
+    IN      INT_MASK_SET_REGISTER   Mask
+    );
+
 // Receive
 DWORD
 EthGetRxControlRegister(
@@ -395,37 +765,55 @@ EthSetRxFilterControlRegister(
     IN      RECEIVE_FILTER_CONTROL_REGISTER     FilterRegister
     );
 
+void
+EthSetRxChecksumControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      RECEIVE_CHECKSUM_CONTROL_REGISTER   ChecksumRegister
+    );
+
+void
+EthSetMultipleReceiveQueuesCommand(
+    IN      PETH_DEVICE                                 Device,
+    IN      MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER    Command
+    );
+
 void
 EthSetRxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      PHYSICAL_ADDRESS    Address
     );
 
 void
 EthSetRxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      DWORD               Size
     );
 
 WORD
 EthGetRxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     );
 
 void
 EthSetRxHead(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     );
 
 WORD
 EthGetRxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     );
 
 void
 EthSetRxTail(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     );
 
@@ -467,34 +855,40 @@ EthSetTxControlRegister(
 void
 EthSetTxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      PHYSICAL_ADDRESS    Address
     );
 
 void
 EthSetTxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      DWORD               Size
     );
 
 WORD
 EthGetTxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     );
 
 void
 EthSetTxHead(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     );
 
 WORD
 EthGetTxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     );
 
 void
 EthSetTxTail(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     );
 
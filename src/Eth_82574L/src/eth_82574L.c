@@ -4,30 +4,32 @@
 #include "network_port.h"
 
 static FUNC_NetworkMiniportInitializeDevice     _Eth82574LInitializeMiniport;
-static FUNC_NetworkMiniportSendBuffer           _Eth82574LSendBuffer;
+static FUNC_NetworkMiniportSendBuffers          _Eth82574LSendBuffers;
+static FUNC_NetworkMiniportReclaimTxDescriptors _Eth82574LReclaimTxDescriptors;
 static FUNC_NetworkMiniportInterruptHandler     _Eth82574LReceiveInterrupt;
+static FUNC_NetworkMiniportVectorInterruptHandler   _Eth82574LVectorInterrupt;
 static FUNC_NetworkMiniportChangeDeviceStatus   _Eth82574LChangeDeviceStatus;
+static FUNC_NetworkMiniportGetStatistics        _Eth82574LGetStatistics;
+static FUNC_NetworkMiniportGetTuning            _Eth82574LGetTuning;
+static FUNC_NetworkMiniportSetTuning            _Eth82574LSetTuning;
 
 __forceinline
 void
 _EthInitializeBuffers(
     IN          PMINIPORT_BUFFER_INITIALIZATION     BufferInit,
-    OUT         PETH_BUFFERS                        Buffers,
     IN          BOOLEAN                             TransmitBuffers
     )
 {
     DWORD i;
 
     ASSERT( NULL != BufferInit );
-    ASSERT( NULL != Buffers );
 
     i = 0;
 
     ASSERT( BufferInit->NumberOfBuffers <= MAX_WORD );
-    Buffers->NumberOfDescriptors = (WORD) BufferInit->NumberOfBuffers;
 
     memzero(BufferInit->RingBuffer,
-            Buffers->NumberOfDescriptors * ( TransmitBuffers ? sizeof(TRANSMIT_DESCRIPTOR_SHADOW) : sizeof(RECEIVE_DESCRIPTOR_SHADOW) ) );
+            BufferInit->NumberOfBuffers * ( TransmitBuffers ? sizeof(TRANSMIT_DESCRIPTOR_SHADOW) : sizeof(RECEIVE_DESCRIPTOR_SHADOW) ) );
     for (i = 0; i < BufferInit->NumberOfBuffers; ++i)
     {
         if (TransmitBuffers)
@@ -46,8 +48,6 @@ _EthInitializeBuffers(
             pRxBuffer[i].BufferAddress = BufferInit->Buffers[i];
         }
     }
-    Buffers->CurrentDescriptor = 0;
-    Buffers->BufferSize = BufferInit->BufferSize;
 }
 
 STATUS
@@ -70,7 +70,8 @@ STATUS
 
     registration.RxBuffers.BufferSize = ETH_BUFFER_SIZE;
     registration.RxBuffers.DescriptorSize = ETH_DESCRIPTOR_SIZE;
-    registration.RxBuffers.NumberOfBuffers = ETH_NO_OF_RX_DESCS;
+    registration.RxBuffers.NumberOfBuffers = ETH_DEFAULT_NO_OF_RX_DESCS;
+    registration.RxBuffers.MinimumNumberOfBuffers = ETH_MIN_NO_OF_DESCS;
 
     registration.Specification.MatchVendor = TRUE;
     registration.Specification.MatchDevice = TRUE;
@@ -79,13 +80,19 @@ STATUS
 
     registration.TxBuffers.BufferSize = ETH_BUFFER_SIZE;
     registration.TxBuffers.DescriptorSize = ETH_DESCRIPTOR_SIZE;
-    registration.TxBuffers.NumberOfBuffers = ETH_NO_OF_TX_DESCS;
+    registration.TxBuffers.NumberOfBuffers = ETH_DEFAULT_NO_OF_TX_DESCS;
+    registration.TxBuffers.MinimumNumberOfBuffers = ETH_MIN_NO_OF_DESCS;
 
     registration.MiniportFunctions.MiniportInitializeDevice = _Eth82574LInitializeMiniport;
     registration.MiniportFunctions.MiniportUninitializeDevice = NULL;
-    registration.MiniportFunctions.MiniportSendBuffer = _Eth82574LSendBuffer;
+    registration.MiniportFunctions.MiniportSendBuffers = _Eth82574LSendBuffers;
+    registration.MiniportFunctions.MiniportReclaimTxDescriptors = _Eth82574LReclaimTxDescriptors;
     registration.MiniportFunctions.MiniportInterruptHandler = _Eth82574LReceiveInterrupt;
+    registration.MiniportFunctions.MiniportVectorInterruptHandler = _Eth82574LVectorInterrupt;
     registration.MiniportFunctions.MiniportChangeDeviceStatus = _Eth82574LChangeDeviceStatus;
+    registration.MiniportFunctions.MiniportGetStatistics = _Eth82574LGetStatistics;
+    registration.MiniportFunctions.MiniportGetTuning = _Eth82574LGetTuning;
+    registration.MiniportFunctions.MiniportSetTuning = _Eth82574LSetTuning;
 
     // if we don't have any devices or we haven't managed to actually initialize
     // any device there is no reason for the driver to remain 'loaded' =>
@@ -113,17 +120,16 @@ STATUS
 {
     STATUS status;
     PETH_DEVICE pEthDevice;
+    DWORD addressesSize;
 
     ASSERT( NULL != MiniportDevice );
     ASSERT( NULL != MiniportInitialization );
     ASSERT( NULL != MiniportInitialization->PciBar );
 
-    ASSERT( ETH_NO_OF_RX_DESCS == MiniportInitialization->RxBuffers.NumberOfBuffers );
     ASSERT( NULL != MiniportInitialization->RxBuffers.Buffers );
     ASSERT( NULL != MiniportInitialization->RxBuffers.RingBuffer );
     ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->RxBuffers.BufferSize );
 
-    ASSERT(ETH_NO_OF_TX_DESCS == MiniportInitialization->TxBuffers.NumberOfBuffers);
     ASSERT(NULL != MiniportInitialization->TxBuffers.Buffers);
     ASSERT(NULL != MiniportInitialization->TxBuffers.RingBuffer);
     ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->TxBuffers.BufferSize );
@@ -133,18 +139,54 @@ STATUS
     status = STATUS_SUCCESS;
     pEthDevice = NULL;
 
+    // the port driver may have chosen smaller rings than the ones we asked
+    // for, but the ring lengths must still be valid for the hardware
+    if (MiniportInitialization->RxBuffers.NumberOfBuffers < ETH_MIN_NO_OF_DESCS
+        || MiniportInitialization->RxBuffers.NumberOfBuffers > ETH_MAX_NO_OF_DESCS
+        || 0 != MiniportInitialization->RxBuffers.NumberOfBuffers % ETH_DESCRIPTOR_COUNT_ALIGNMENT)
+    {
+        LOG_ERROR("Invalid number of RX descriptors %u\n", MiniportInitialization->RxBuffers.NumberOfBuffers);
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (MiniportInitialization->TxBuffers.NumberOfBuffers < ETH_MIN_NO_OF_DESCS
+        || MiniportInitialization->TxBuffers.NumberOfBuffers > ETH_MAX_NO_OF_DESCS
+        || 0 != MiniportInitialization->TxBuffers.NumberOfBuffers % ETH_DESCRIPTOR_COUNT_ALIGNMENT)
+    {
+        LOG_ERROR("Invalid number of TX descriptors %u\n", MiniportInitialization->TxBuffers.NumberOfBuffers);
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    LOG("Using %u RX descriptors and %u TX descriptors\n",
+        MiniportInitialization->RxBuffers.NumberOfBuffers,
+        MiniportInitialization->TxBuffers.NumberOfBuffers);
+
     pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
     ASSERT( NULL != pEthDevice );
 
-    _EthInitializeBuffers(&MiniportInitialization->RxBuffers, &pEthDevice->RxData.Buffers, FALSE );
+    _EthInitializeBuffers(&MiniportInitialization->RxBuffers, FALSE );
     pEthDevice->RxData.ReceiveBuffer = MiniportInitialization->RxBuffers.RingBuffer;
+    pEthDevice->RxData.NumberOfDescriptors = (WORD) MiniportInitialization->RxBuffers.NumberOfBuffers;
+    pEthDevice->RxData.BufferSize = MiniportInitialization->RxBuffers.BufferSize;
 
-    _EthInitializeBuffers(&MiniportInitialization->TxBuffers, &pEthDevice->TxData.Buffers, TRUE );
+    _EthInitializeBuffers(&MiniportInitialization->TxBuffers, TRUE );
     pEthDevice->TxData.TransmitBuffer = MiniportInitialization->TxBuffers.RingBuffer;
+    pEthDevice->TxData.NumberOfDescriptors = (WORD) MiniportInitialization->TxBuffers.NumberOfBuffers;
+    pEthDevice->TxData.BufferSize = MiniportInitialization->TxBuffers.BufferSize;
+
+    // the port driver frees its array once the initialization is done
+    addressesSize = MiniportInitialization->TxBuffers.NumberOfBuffers * sizeof(PHYSICAL_ADDRESS);
+    pEthDevice->TxData.BufferAddresses = ExAllocatePoolWithTag(0, addressesSize, HEAP_ETH_TAG, 0);
+    if (NULL == pEthDevice->TxData.BufferAddresses)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", addressesSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memcpy(pEthDevice->TxData.BufferAddresses, MiniportInitialization->TxBuffers.Buffers, addressesSize);
 
     pEthDevice->MiniportDevice = MiniportDevice;
 
-    status = EthInitializeDevice( MiniportInitialization->PciBar, pEthDevice );
+    status = EthInitializeDevice( MiniportInitialization->PciBar, MiniportInitialization->MsiXCapable, pEthDevice );
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("EthInitializeDevice", status );
@@ -158,10 +200,29 @@ STATUS
 
 static
 STATUS
-(__cdecl _Eth82574LSendBuffer)(
+(__cdecl _Eth82574LSendBuffers)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfFrames,
+    IN_READS(NumberOfFrames)
+        MINIPORT_TX_FRAME*          Frames
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT(NULL != MiniportDevice);
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT(NULL != pEthDevice);
+
+    return EthSendFrames(pEthDevice, FirstDescriptorIndex, NumberOfFrames, Frames);
+}
+
+static
+DWORD
+(__cdecl _Eth82574LReclaimTxDescriptors)(
     IN  PMINIPORT_DEVICE            MiniportDevice,
-    IN  WORD                        DescriptorIndex,
-    IN  WORD                        Length
+    IN  DWORD                       QueueIndex
     )
 {
     PETH_DEVICE pEthDevice;
@@ -171,7 +232,7 @@ STATUS
     pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
     ASSERT(NULL != pEthDevice);
 
-    return EthSendFrame(pEthDevice, DescriptorIndex, Length);
+    return EthReclaimTxDescriptors(pEthDevice, QueueIndex);
 }
 
 static
@@ -190,6 +251,23 @@ BOOLEAN
     return EthHandleInterrupt(pEthDevice);
 }
 
+static
+BOOLEAN
+(__cdecl _Eth82574LVectorInterrupt)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  DWORD                       Vector
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pEthDevice );
+
+    return EthHandleVectorInterrupt(pEthDevice, Vector);
+}
+
 static
 void
 (__cdecl _Eth82574LChangeDeviceStatus)(
@@ -206,4 +284,58 @@ void
     ASSERT(NULL != pEthDevice);
 
     EthChangeDeviceStatus(pEthDevice, DeviceStatus );
+}
+
+static
+void
+(__cdecl _Eth82574LGetStatistics)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    INOUT PNETWORK_DEVICE_STATS     Statistics
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Statistics );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT(NULL != pEthDevice);
+
+    EthGetStatistics(pEthDevice, Statistics);
+}
+
+static
+void
+(__cdecl _Eth82574LGetTuning)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    OUT PNETWORK_DEVICE_TUNING      Tuning
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Tuning );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT(NULL != pEthDevice);
+
+    EthGetTuning(pEthDevice, Tuning);
+}
+
+static
+STATUS
+(__cdecl _Eth82574LSetTuning)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  PNETWORK_DEVICE_TUNING      Tuning
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Tuning );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT(NULL != pEthDevice);
+
+    return EthSetTuning(pEthDevice, Tuning);
 }
\ No newline at end of file
@@ -3,6 +3,27 @@
 #include "eth_eeprom.h"
 #include "network_port.h"
 
+// the values programmed for each traffic class: ITR, RDTR, RADV, TIDV, TADV
+static const ETH_MODERATION_SETTINGS ETH_MODERATION_PROFILES[EthTrafficClassReserved] =
+{
+    {  20,   0,   0,   8,  32 },        // EthTrafficClassLowestLatency
+    {  50,   8,  32,  16,  64 },        // EthTrafficClassLowLatency
+    { 250,  32, 128,  64, 256 }         // EthTrafficClassBulk
+};
+
+// the key commonly used for Toeplitz hashing, it spreads the IPv4 and TCP
+// flows evenly between the queues
+static const BYTE ETH_RSS_KEY[ETH_RSS_KEY_SIZE] =
+{
+    0x6D, 0x5A, 0x56, 0xDA, 0x25, 0x5B, 0x0E, 0xC2,
+    0x41, 0x67, 0x25, 0x3D, 0x43, 0xA3, 0x8F, 0xB0,
+    0xD0, 0xCA, 0x2B, 0xCB, 0xAE, 0x7B, 0x30, 0xB4,
+    0x77, 0xCB, 0x2D, 0xA3, 0x80, 0x30, 0xF2, 0x0C,
+    0x6A, 0x42, 0xB7, 0x3B, 0xBE, 0xAC, 0x01, 0xFA
+};
+
+STATIC_ASSERT(ETH_MAX_NO_OF_QUEUES <= NETWORK_MAX_QUEUES);
+
 __forceinline
 static
 void
@@ -37,6 +58,161 @@ _EthChangeTxStatus(
     EthSetTxControlRegister(Device, ctrlRegister);
 }
 
+__forceinline
+static
+void
+_EthChangeRxInterruptsStatus(
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
+    IN      BOOLEAN             Enable
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( Queue < Device->NumberOfQueues );
+
+    // in MSI-X mode each RX queue has its own cause, the other queues are
+    // not affected
+    if (Enable)
+    {
+        INT_MASK_SET_REGISTER intSetMaskReg;
+
+        intSetMaskReg.Raw = 0;
+        if (Device->MsiXEnabled)
+        {
+            intSetMaskReg.RxQueue0 = (0 == Queue);
+            intSetMaskReg.RxQueue1 = (1 == Queue);
+        }
+        else
+        {
+            intSetMaskReg.RdMinimumThresholdHit = TRUE;
+            intSetMaskReg.ReceiverOverrun = TRUE;
+            intSetMaskReg.ReceiverTimerInterrupt = TRUE;
+        }
+
+        EthSetInterruptMaskSetRegister(Device, intSetMaskReg);
+    }
+    else
+    {
+        INT_MASK_CLEAR_REGISTER intClearMaskReg;
+
+        intClearMaskReg.Raw = 0;
+        if (Device->MsiXEnabled)
+        {
+            intClearMaskReg.RxQueue0 = (0 == Queue);
+            intClearMaskReg.RxQueue1 = (1 == Queue);
+        }
+        else
+        {
+            intClearMaskReg.RdMinimumThresholdHit = TRUE;
+            intClearMaskReg.ReceiverOverrun = TRUE;
+            intClearMaskReg.ReceiverTimerInterrupt = TRUE;
+        }
+
+        EthSetInterruptMaskClearRegister(Device, intClearMaskReg);
+    }
+}
+
+__forceinline
+static
+BOOLEAN
+_EthIsRxFramePending(
+    IN      PETH_RX_QUEUE       Queue
+    )
+{
+    ASSERT( NULL != Queue );
+
+    return (BOOLEAN) Queue->ReceiveBuffer[Queue->Buffers.CurrentDescriptor].Status.DescriptorDone;
+}
+
+__forceinline
+static
+void
+_EthScheduleRxPoll(
+    IN      PETH_RX_QUEUE       Queue
+    )
+{
+    ASSERT( NULL != Queue );
+
+    Queue->Poll.Statistics.Interrupts++;
+
+    // the frames are not processed here, the RX interrupts of the queue
+    // remain masked until its poll thread finds the ring empty
+    if (FALSE == _InterlockedCompareExchange8(&Queue->Poll.Scheduled, TRUE, FALSE))
+    {
+        _EthChangeRxInterruptsStatus(Queue->Device, Queue->QueueIndex, FALSE);
+        ExEventSignal(&Queue->Poll.PollRequested);
+    }
+}
+
+__forceinline
+static
+void
+_EthServiceTxInterrupt(
+    IN      PETH_DEVICE         Device,
+    IN      PETH_TX_QUEUE       Queue
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Queue );
+
+    Queue->Interrupts++;
+
+    // the descriptors are reclaimed by the sender when it needs them, it
+    // only has to be woken up if it waits for them
+    NetworkPortNotifyTxDescriptorAvailable(Device->MiniportDevice, Queue->QueueIndex);
+}
+
+__forceinline
+static
+DWORD
+_EthGetRxChecksumStatus(
+    IN      PRECEIVE_DESCRIPTOR Descriptor
+    )
+{
+    DWORD checksumStatus;
+
+    ASSERT( NULL != Descriptor );
+
+    checksumStatus = 0;
+
+    if (Descriptor->Status.IXSM)
+    {
+        return checksumStatus;
+    }
+
+    if (Descriptor->Status.IPCS)
+    {
+        checksumStatus |= Descriptor->Errors.IPE ? NETWORK_RX_CHECKSUM_IP4_BAD : NETWORK_RX_CHECKSUM_IP4_GOOD;
+    }
+
+    if (Descriptor->Status.TCPCS || Descriptor->Status.UDPCS)
+    {
+        checksumStatus |= Descriptor->Errors.TCPE ? NETWORK_RX_CHECKSUM_TCP_UDP_BAD : NETWORK_RX_CHECKSUM_TCP_UDP_GOOD;
+    }
+
+    return checksumStatus;
+}
+
+__forceinline
+static
+void
+_EthServiceLinkStatusChange(
+    IN      PETH_DEVICE         Device
+    )
+{
+    DEVICE_STATUS_REGISTER devStatus;
+
+    ASSERT( NULL != Device );
+
+    devStatus = EthGetDeviceStatusRegister(Device);
+
+    LOG("Link status is [%s]\n", devStatus.LinkUp ? "UP" : "DOWN" );
+
+    NetworkPortNotifyLinkStatusChange(Device->MiniportDevice,
+                                      (BOOLEAN) devStatus.LinkUp
+                                      );
+}
+
 static
 PTR_SUCCESS
 PVOID
@@ -52,18 +228,67 @@ _EthRetrieveMacAddress(
     OUT     PMAC_ADDRESS        MacAddress
     );
 
+static
+void
+_EthQueuesInit(
+    IN      PETH_DEVICE         Device,
+    IN      BOOLEAN             UseMsiX
+    );
+
+_No_competing_thread_
+static
+WORD
+_EthFillOffloadDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      PETH_TX_QUEUE       Queue,
+    IN      WORD                CurrentIndex,
+    IN      PMINIPORT_TX_FRAME  Frame,
+    OUT     PTRANSMIT_DESCRIPTOR* LastDescriptor
+    );
+
 static
 STATUS
 _EthRxInit(
     IN      PETH_DEVICE         Device
     );
 
+static
+void
+_EthRssInit(
+    IN      PETH_DEVICE         Device
+    );
+
 static
 STATUS
 _EthTxInit(
     IN      PETH_DEVICE         Device
     );
 
+static
+STATUS
+_EthRxPollInit(
+    IN      PETH_DEVICE         Device
+    );
+
+static
+void
+_EthModerationInit(
+    IN      PETH_DEVICE         Device
+    );
+
+static
+void
+_EthProgramModeration(
+    IN      PETH_DEVICE                     Device,
+    IN      const ETH_MODERATION_SETTINGS*  Settings
+    );
+
+static
+void
+_EthAdjustModeration(
+    IN      PETH_DEVICE         Device
+    );
+
 static
 STATUS
 _EthInterruptInit(
@@ -72,19 +297,20 @@ _EthInterruptInit(
 
 static
 void
-_EthDeviceControlsInit(
+_EthMsiXInit(
     IN      PETH_DEVICE         Device
     );
 
 static
 void
-_EthSignalTxQueueFullIfNecessary(
+_EthDeviceControlsInit(
     IN      PETH_DEVICE         Device
     );
 
 STATUS
 EthInitializeDevice(
     IN_READS(ETH_NO_OF_BARS_USED)   PPCI_BAR        Bars,
+    IN                              BOOLEAN         MsiXCapable,
     INOUT                           PETH_DEVICE     Device
     )
 {
@@ -143,6 +369,9 @@ EthInitializeDevice(
         LOG("Ip address valid: 0x%x\n", pInternalRegs->IpAddressValid);
         LOG("Ip address 0: 0x%x\n", pInternalRegs->IpAddress0);
 
+        _EthQueuesInit(Device, MsiXCapable && NULL != Device->MsiX);
+        LOG("Using %u queue(s), MSI-X %s\n", Device->NumberOfQueues, Device->MsiXEnabled ? "enabled" : "disabled");
+
         status = _EthRxInit(Device);
         if (!SUCCEEDED(status))
         {
@@ -161,6 +390,17 @@ EthInitializeDevice(
         LOG_TRACE_NETWORK("_EthTxInit succeeded\n");
         Device->MiniportDevice->DeviceStatus.TxEnabled = TRUE;
 
+        _EthModerationInit(Device);
+        LOG_TRACE_NETWORK("_EthModerationInit succeeded\n");
+
+        status = _EthRxPollInit(Device);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_EthRxPollInit", status);
+            __leave;
+        }
+        LOG_TRACE_NETWORK("_EthRxPollInit succeeded\n");
+
         status = _EthInterruptInit(Device);
         if (!SUCCEEDED(status))
         {
@@ -206,90 +446,202 @@ EthInitializeDevice(
 _No_competing_thread_
 STATUS
 EthReceiveFrame(
-    IN                              PETH_DEVICE     Device,
-    IN_OPT                          WORD            MaximumNumberOfFrames
+    IN                              PETH_RX_QUEUE   Queue,
+    IN_OPT                          WORD            MaximumNumberOfFrames,
+    OUT_OPT                         WORD*           NumberOfFramesReceived
     )
 {
     STATUS status;
+    PETH_DEVICE pDevice;
     WORD curRxIndex;
     WORD prevRxIndex;
     WORD noOfFramesReceived;
+    PHYSICAL_ADDRESS nextBuffer;
 
-    ASSERT( NULL != Device );
+    ASSERT( NULL != Queue );
 
     status = STATUS_SUCCESS;
-    curRxIndex = Device->RxData.Buffers.CurrentDescriptor;
-    ASSERT( curRxIndex < Device->RxData.Buffers.NumberOfDescriptors );
+    pDevice = Queue->Device;
+    curRxIndex = Queue->Buffers.CurrentDescriptor;
+    ASSERT( curRxIndex < Queue->Buffers.NumberOfDescriptors );
 
     noOfFramesReceived = 0;
 
-    while (Device->RxData.ReceiveBuffer[curRxIndex].Status.DescriptorDone)
+    while (Queue->ReceiveBuffer[curRxIndex].Status.DescriptorDone)
     {
-        WORD len = Device->RxData.ReceiveBuffer[curRxIndex].Length;
-
-        ASSERT( len <= Device->RxData.Buffers.BufferSize );
-        ASSERT( 1 == Device->RxData.ReceiveBuffer[curRxIndex].Status.EOP );
-
-        status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice, curRxIndex, len );
+        WORD len = Queue->ReceiveBuffer[curRxIndex].Length;
+
+        ASSERT( len <= Queue->Buffers.BufferSize );
+        ASSERT( 1 == Queue->ReceiveBuffer[curRxIndex].Status.EOP );
+
+        // the buffer is lent to the port driver, the descriptor receives a
+        // fresh one from the receive pool
+        status = NetworkPortNotifyReceiveBuffer(pDevice->MiniportDevice,
+                                                Queue->FirstDescriptor + curRxIndex,
+                                                len,
+                                                _EthGetRxChecksumStatus(&Queue->ReceiveBuffer[curRxIndex]),
+                                                &nextBuffer );
         ASSERT( SUCCEEDED(status));
 
-        Device->RxData.ReceiveBuffer[curRxIndex].Status.DescriptorDone = 0;
+        Queue->ReceiveBuffer[curRxIndex].BufferAddress = nextBuffer;
+        Queue->ReceiveBuffer[curRxIndex].Status.DescriptorDone = 0;
         prevRxIndex = curRxIndex;
-        curRxIndex = (curRxIndex + 1) % Device->RxData.Buffers.NumberOfDescriptors;
-        EthSetRxTail(Device, prevRxIndex);
+        curRxIndex = (curRxIndex + 1) % Queue->Buffers.NumberOfDescriptors;
+        EthSetRxTail(pDevice, Queue->QueueIndex, prevRxIndex);
 
         noOfFramesReceived = noOfFramesReceived + 1;
 
+        Queue->FramesReceived++;
+        Queue->BytesReceived += len;
+
         if (noOfFramesReceived == MaximumNumberOfFrames)
         {
             break;
         }
     }
 
-    Device->RxData.Buffers.CurrentDescriptor = curRxIndex;
+    Queue->Buffers.CurrentDescriptor = curRxIndex;
+
+    if (NULL != NumberOfFramesReceived)
+    {
+        *NumberOfFramesReceived = noOfFramesReceived;
+    }
 
     return status;
 }
 
 _No_competing_thread_
 STATUS
-EthSendFrame(
+EthSendFrames(
     IN                              PETH_DEVICE     Device,
-    IN                              WORD            DescriptorIndex,
-    IN                              WORD            Length
+    IN                              WORD            FirstDescriptorIndex,
+    IN                              WORD            NumberOfFrames,
+    IN_READS(NumberOfFrames)        PMINIPORT_TX_FRAME Frames
     )
 {
+    PETH_TX_QUEUE pQueue;
     WORD curTxIndex;
     PTRANSMIT_DESCRIPTOR pDescriptor;
+    WORD i;
 
     ASSERT( NULL != Device );
-    ASSERT( Length <= Device->TxData.Buffers.BufferSize );
-
-    curTxIndex = DescriptorIndex;
-    ASSERT( curTxIndex == Device->TxData.Buffers.CurrentDescriptor );
-    ASSERT( curTxIndex < Device->TxData.Buffers.NumberOfDescriptors );
-    pDescriptor = &Device->TxData.TransmitBuffer[curTxIndex];
-    ASSERT(pDescriptor->DescriptorDone);
-
-    pDescriptor->Command.DEXT = FALSE;
-    pDescriptor->Command.IC = FALSE;
-    pDescriptor->Command.IFCS = TRUE;
-    pDescriptor->Command.EOP = TRUE;
+    ASSERT( 0 != NumberOfFrames );
+    ASSERT( NULL != Frames );
+    ASSERT( FirstDescriptorIndex < Device->TxData.NumberOfDescriptors );
+
+    // the index is global to the ring, each queue owns an equal slice of it
+    pQueue = &Device->TxData.Queues[FirstDescriptorIndex / Device->TxData.Queues[0].Buffers.NumberOfDescriptors];
+    ASSERT( pQueue->QueueIndex < Device->NumberOfQueues );
+
+    curTxIndex = FirstDescriptorIndex - pQueue->FirstDescriptor;
+    ASSERT( curTxIndex == pQueue->Buffers.CurrentDescriptor );
+    pDescriptor = NULL;
+
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        ASSERT( Frames[i].NumberOfDescriptors < pQueue->Buffers.NumberOfDescriptors );
+
+        if (0 == Frames[i].Offloads)
+        {
+            ASSERT( 1 == Frames[i].NumberOfDescriptors );
+            ASSERT( Frames[i].Length <= Device->TxData.BufferSize );
+
+            pDescriptor = &pQueue->TransmitBuffer[curTxIndex];
+            ASSERT(pDescriptor->DescriptorDone);
+
+            // the descriptor may have been a context descriptor before
+            pDescriptor->BufferAddress = Device->TxData.BufferAddresses[pQueue->FirstDescriptor + curTxIndex];
+            pDescriptor->ChecksumOffset = 0;
+            pDescriptor->ChecksumStart = 0;
+            pDescriptor->VLAN = 0;
+
+            pDescriptor->Command.DEXT = FALSE;
+            pDescriptor->Command.IC = FALSE;
+            pDescriptor->Command.IFCS = TRUE;
+            pDescriptor->Command.EOP = TRUE;
+            pDescriptor->Command.VLE = FALSE;
+
+            // the device processes the descriptors in order => it is enough for
+            // the last one to report its status
+            pDescriptor->Command.IDE = FALSE;
+            pDescriptor->Command.RS = FALSE;
+
+            pDescriptor->DescriptorDone = 0;
+            pDescriptor->Length = (WORD) Frames[i].Length;
+
+            curTxIndex = (curTxIndex + 1) % pQueue->Buffers.NumberOfDescriptors;
+        }
+        else
+        {
+            curTxIndex = _EthFillOffloadDescriptors(Device, pQueue, curTxIndex, &Frames[i], &pDescriptor);
+        }
+    }
+
+    ASSERT( NULL != pDescriptor );
     pDescriptor->Command.IDE = TRUE;
     pDescriptor->Command.RS = TRUE;
-    pDescriptor->Command.VLE = FALSE;
 
-    pDescriptor->DescriptorDone = 0;
-    pDescriptor->Length = Length;
+    pQueue->Buffers.CurrentDescriptor = curTxIndex;
 
-    curTxIndex = (curTxIndex + 1) % Device->TxData.Buffers.NumberOfDescriptors;
-    Device->TxData.Buffers.CurrentDescriptor = curTxIndex;
+    // a single tail update for the whole batch, each MMIO write is expensive
+    // (a VM exit when virtualized)
+    EthSetTxTail(Device, pQueue->QueueIndex, curTxIndex);
 
-    _EthSignalTxQueueFullIfNecessary(Device);
+    return STATUS_SUCCESS;
+}
+
+_No_competing_thread_
+DWORD
+EthReclaimTxDescriptors(
+    IN                              PETH_DEVICE     Device,
+    IN                              DWORD           QueueIndex
+    )
+{
+    PETH_TX_QUEUE pQueue;
+    PTRANSMIT_DESCRIPTOR pDescriptor;
+    WORD curTxIndex;
+    DWORD noOfPending;
+    DWORD noOfReclaimed;
 
-    EthSetTxTail(Device, curTxIndex);
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
 
-    return STATUS_SUCCESS;
+    pQueue = &Device->TxData.Queues[QueueIndex];
+    curTxIndex = pQueue->NextToReclaim;
+    noOfPending = 0;
+    noOfReclaimed = 0;
+
+    // only the last descriptor of each batch reports its status, when it is
+    // done all the descriptors before it are done too
+    while (curTxIndex != pQueue->Buffers.CurrentDescriptor)
+    {
+        pDescriptor = &pQueue->TransmitBuffer[curTxIndex];
+
+        noOfPending++;
+        curTxIndex = (curTxIndex + 1) % pQueue->Buffers.NumberOfDescriptors;
+
+        if (!pDescriptor->Command.RS)
+        {
+            continue;
+        }
+
+        if (!pDescriptor->DescriptorDone)
+        {
+            break;
+        }
+
+        // mark the whole batch as available for software
+        while (pQueue->NextToReclaim != curTxIndex)
+        {
+            pQueue->TransmitBuffer[pQueue->NextToReclaim].DescriptorDone = 1;
+            pQueue->NextToReclaim = (pQueue->NextToReclaim + 1) % pQueue->Buffers.NumberOfDescriptors;
+        }
+
+        noOfReclaimed += noOfPending;
+        noOfPending = 0;
+    }
+
+    return noOfReclaimed;
 }
 
 _No_competing_thread_
@@ -317,45 +669,143 @@ EthHandleInterrupt(
         return FALSE;
     }
 
+    // without MSI-X there is a single queue
+    ASSERT( 1 == Device->NumberOfQueues );
+
     if (intReason.RdMinimumThresholdHit || intReason.ReceiverTimerInterrupt)
     {
-        status = EthReceiveFrame(Device, 0);
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("EthReceiveFrame", status);
-            return FALSE;
-        }
+        _EthScheduleRxPoll(&Device->RxData.Queues[0]);
+
         bSolvedInterrupt = TRUE;
     }
 
     if (intReason.TdWrittenBack || intReason.TxQueueEmpty)
     {
-        INTR_STATE dummyState;
-
-        LockAcquire(&Device->TxData.TxInterruptLock, &dummyState );
+        _EthServiceTxInterrupt(Device, &Device->TxData.Queues[0]);
 
-        // notify port driver we have free descriptors
-        NetworkPortNotifyTxDescriptorAvailable(Device->MiniportDevice);
+        bSolvedInterrupt = TRUE;
+    }
 
-        LockRelease(&Device->TxData.TxInterruptLock, INTR_OFF );
+    if (intReason.LinkStatusChange)
+    {
+        _EthServiceLinkStatusChange(Device);
 
         bSolvedInterrupt = TRUE;
     }
 
-    if (intReason.LinkStatusChange)
+    return bSolvedInterrupt;
+}
+
+BOOLEAN
+EthHandleVectorInterrupt(
+    IN                              PETH_DEVICE     Device,
+    IN                              DWORD           Vector
+    )
+{
+    DWORD msiXEntry;
+    INT_CAUSE_READ_REGISTER intReason;
+
+    ASSERT( NULL != Device );
+    ASSERT( Device->MsiXEnabled );
+    ASSERT( Vector < Device->MiniportDevice->NumberOfInterruptVectors );
+
+    msiXEntry = Device->MiniportDevice->InterruptVectors[Vector].MsiXEntry;
+
+    LOG_TRACE_COMP(LogComponentNetwork | LogComponentInterrupt,
+                   "MSI-X entry %u on device 0x%X\n", msiXEntry, Device);
+
+    // the queue causes are cleared from ICR automatically when their
+    // message is sent (EIAC), only the other causes need to be read
+    if (ETH_MSI_X_VECTOR_OTHER == msiXEntry)
     {
-        DEVICE_STATUS_REGISTER devStatus = EthGetDeviceStatusRegister(Device);
+        intReason = EthGetInterruptReason(Device);
 
-        LOG("Link status is [%s]\n", devStatus.LinkUp ? "UP" : "DOWN" );
+        if (intReason.LinkStatusChange)
+        {
+            _EthServiceLinkStatusChange(Device);
+        }
+    }
+    else if (msiXEntry >= ETH_MSI_X_VECTOR_TX_QUEUE(0))
+    {
+        ASSERT( msiXEntry - ETH_MSI_X_VECTOR_TX_QUEUE(0) < Device->NumberOfQueues );
 
-        NetworkPortNotifyLinkStatusChange(Device->MiniportDevice,
-                                          (BOOLEAN) devStatus.LinkUp
-                                          );
+        _EthServiceTxInterrupt(Device, &Device->TxData.Queues[msiXEntry - ETH_MSI_X_VECTOR_TX_QUEUE(0)]);
+    }
+    else
+    {
+        ASSERT( msiXEntry - ETH_MSI_X_VECTOR_RX_QUEUE(0) < Device->NumberOfQueues );
 
-        bSolvedInterrupt = TRUE;
+        _EthScheduleRxPoll(&Device->RxData.Queues[msiXEntry - ETH_MSI_X_VECTOR_RX_QUEUE(0)]);
     }
 
-    return bSolvedInterrupt;
+    // the vectors are not shared
+    return TRUE;
+}
+
+STATUS
+(__cdecl EthRxPollFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PETH_RX_QUEUE pQueue;
+    PETH_DEVICE pDevice;
+    PETH_RX_POLL pPoll;
+    STATUS status;
+    WORD noOfFrames;
+    BOOLEAN bPoll;
+
+    ASSERT( NULL != Context );
+
+    pQueue = Context;
+    pDevice = pQueue->Device;
+    pPoll = &pQueue->Poll;
+    status = STATUS_SUCCESS;
+
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        ExEventWaitForSignal(&pPoll->PollRequested);
+        ASSERT( pPoll->Scheduled );
+
+        bPoll = TRUE;
+        while (bPoll)
+        {
+            noOfFrames = 0;
+
+            status = EthReceiveFrame(pQueue, ETH_RX_POLL_BUDGET, &noOfFrames);
+            ASSERT( SUCCEEDED(status) );
+
+            pPoll->Statistics.PollPasses++;
+            pPoll->Statistics.FramesPolled += noOfFrames;
+
+            if (ETH_RX_POLL_BUDGET == noOfFrames)
+            {
+                // the ring may still hold frames, let the consumers run
+                // before the next pass
+                pPoll->Statistics.BudgetExhausted++;
+                ThreadYield();
+                continue;
+            }
+
+            _EthAdjustModeration(pDevice);
+
+            // the ring is empty => switch back to interrupts
+            _InterlockedExchange8(&pPoll->Scheduled, FALSE);
+            _EthChangeRxInterruptsStatus(pDevice, pQueue->QueueIndex, TRUE);
+
+            // a frame may have been received after the last pass while the
+            // interrupts were still masked, if the ISR did not already
+            // schedule a new poll for it we take care of it ourselves
+            bPoll = _EthIsRxFramePending(pQueue)
+                    && (FALSE == _InterlockedCompareExchange8(&pPoll->Scheduled, TRUE, FALSE));
+            if (bPoll)
+            {
+                _EthChangeRxInterruptsStatus(pDevice, pQueue->QueueIndex, FALSE);
+            }
+        }
+    }
+
+    return status;
 }
 
 _No_competing_thread_
@@ -399,6 +849,107 @@ EthChangeDeviceStatus(
     LOG_FUNC_END;
 }
 
+void
+EthGetTuning(
+    IN                              PETH_DEVICE             Device,
+    OUT                             PNETWORK_DEVICE_TUNING  Tuning
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Tuning );
+
+    Tuning->RxRingSize = Device->RxData.NumberOfDescriptors;
+    Tuning->TxRingSize = Device->TxData.NumberOfDescriptors;
+
+    LockAcquire(&Device->Moderation.Lock, &oldState);
+    Tuning->AdaptiveModeration = Device->Moderation.Adaptive;
+    Tuning->InterruptThrottleUs = Device->Moderation.Settings.ThrottleUs;
+    Tuning->RxDelayUs = Device->Moderation.Settings.RxDelayUs;
+    Tuning->RxAbsoluteDelayUs = Device->Moderation.Settings.RxAbsoluteDelayUs;
+    Tuning->TxDelayUs = Device->Moderation.Settings.TxDelayUs;
+    Tuning->TxAbsoluteDelayUs = Device->Moderation.Settings.TxAbsoluteDelayUs;
+    LockRelease(&Device->Moderation.Lock, oldState);
+}
+
+STATUS
+EthSetTuning(
+    IN                              PETH_DEVICE             Device,
+    IN                              PNETWORK_DEVICE_TUNING  Tuning
+    )
+{
+    ETH_MODERATION_SETTINGS settings;
+    INTR_STATE oldState;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Tuning );
+
+    memzero(&settings, sizeof(ETH_MODERATION_SETTINGS));
+
+    if (!Tuning->AdaptiveModeration)
+    {
+        // all the timers have 16 bits and the TX delay cannot be 0
+        if (Tuning->InterruptThrottleUs > MAX_WORD
+            || Tuning->RxDelayUs > MAX_WORD
+            || Tuning->RxAbsoluteDelayUs > MAX_WORD
+            || Tuning->TxDelayUs > MAX_WORD
+            || Tuning->TxAbsoluteDelayUs > MAX_WORD
+            || 0 == Tuning->TxDelayUs)
+        {
+            return STATUS_INVALID_PARAMETER2;
+        }
+
+        settings.ThrottleUs = (WORD) Tuning->InterruptThrottleUs;
+        settings.RxDelayUs = (WORD) Tuning->RxDelayUs;
+        settings.RxAbsoluteDelayUs = (WORD) Tuning->RxAbsoluteDelayUs;
+        settings.TxDelayUs = (WORD) Tuning->TxDelayUs;
+        settings.TxAbsoluteDelayUs = (WORD) Tuning->TxAbsoluteDelayUs;
+    }
+
+    LockAcquire(&Device->Moderation.Lock, &oldState);
+    Device->Moderation.Adaptive = Tuning->AdaptiveModeration;
+    if (Device->Moderation.Adaptive)
+    {
+        // start from the low latency profile, the poll thread will choose
+        // the right one after the first interval
+        Device->Moderation.TrafficClass = EthTrafficClassLowLatency;
+        _EthProgramModeration(Device, &ETH_MODERATION_PROFILES[EthTrafficClassLowLatency]);
+    }
+    else
+    {
+        _EthProgramModeration(Device, &settings);
+    }
+    LockRelease(&Device->Moderation.Lock, oldState);
+
+    return STATUS_SUCCESS;
+}
+
+void
+EthGetStatistics(
+    IN                              PETH_DEVICE             Device,
+    INOUT                           PNETWORK_DEVICE_STATS   Statistics
+    )
+{
+    DWORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Statistics );
+
+    for (i = 0; i < Device->NumberOfQueues; ++i)
+    {
+        PNETWORK_RX_POLL_STATS pPollStats = &Device->RxData.Queues[i].Poll.Statistics;
+
+        Statistics->RxPollStats.Interrupts += pPollStats->Interrupts;
+        Statistics->RxPollStats.FramesPolled += pPollStats->FramesPolled;
+        Statistics->RxPollStats.PollPasses += pPollStats->PollPasses;
+        Statistics->RxPollStats.BudgetExhausted += pPollStats->BudgetExhausted;
+
+        Statistics->QueueStats[i].RxInterrupts = pPollStats->Interrupts;
+        Statistics->QueueStats[i].TxInterrupts = Device->TxData.Queues[i].Interrupts;
+    }
+}
+
 static
 PTR_SUCCESS
 PVOID
@@ -458,6 +1009,73 @@ _EthRetrieveMacAddress(
     memcpy(&MacAddress->Value[4], &tmp, sizeof(WORD));
 }
 
+static
+void
+_EthQueuesInit(
+    IN      PETH_DEVICE         Device,
+    IN      BOOLEAN             UseMsiX
+    )
+{
+    DWORD noOfQueues;
+    WORD rxDescriptorsPerQueue;
+    WORD txDescriptorsPerQueue;
+    DWORD i;
+
+    ASSERT( NULL != Device );
+
+    // each queue receives an equal slice of the rings, the slices must
+    // still be valid ring lengths
+    noOfQueues = 1;
+    if (UseMsiX
+        && 0 == Device->RxData.NumberOfDescriptors % (ETH_MAX_NO_OF_QUEUES * ETH_DESCRIPTOR_COUNT_ALIGNMENT)
+        && 0 == Device->TxData.NumberOfDescriptors % (ETH_MAX_NO_OF_QUEUES * ETH_DESCRIPTOR_COUNT_ALIGNMENT))
+    {
+        noOfQueues = ETH_MAX_NO_OF_QUEUES;
+    }
+
+    Device->NumberOfQueues = noOfQueues;
+    Device->MsiXEnabled = UseMsiX;
+
+    rxDescriptorsPerQueue = (WORD) (Device->RxData.NumberOfDescriptors / noOfQueues);
+    txDescriptorsPerQueue = (WORD) (Device->TxData.NumberOfDescriptors / noOfQueues);
+
+    for (i = 0; i < noOfQueues; ++i)
+    {
+        PETH_RX_QUEUE pRxQueue = &Device->RxData.Queues[i];
+        PETH_TX_QUEUE pTxQueue = &Device->TxData.Queues[i];
+
+        pRxQueue->Device = Device;
+        pRxQueue->QueueIndex = i;
+        pRxQueue->FirstDescriptor = (WORD) (i * rxDescriptorsPerQueue);
+        pRxQueue->ReceiveBuffer = &Device->RxData.ReceiveBuffer[pRxQueue->FirstDescriptor];
+        pRxQueue->Buffers.NumberOfDescriptors = rxDescriptorsPerQueue;
+        pRxQueue->Buffers.CurrentDescriptor = 0;
+        pRxQueue->Buffers.BufferSize = Device->RxData.BufferSize;
+
+        pTxQueue->QueueIndex = i;
+        pTxQueue->FirstDescriptor = (WORD) (i * txDescriptorsPerQueue);
+        pTxQueue->TransmitBuffer = &Device->TxData.TransmitBuffer[pTxQueue->FirstDescriptor];
+        pTxQueue->Buffers.NumberOfDescriptors = txDescriptorsPerQueue;
+        pTxQueue->Buffers.CurrentDescriptor = 0;
+        pTxQueue->NextToReclaim = 0;
+        pTxQueue->Buffers.BufferSize = Device->TxData.BufferSize;
+    }
+
+    Device->MiniportDevice->NumberOfQueues = noOfQueues;
+
+    // a segmented frame must fit in half of the slice of its queue so that
+    // it does not wait for the whole queue to be empty
+    Device->MiniportDevice->TxOffloadDescriptors = 1;
+    Device->MiniportDevice->OffloadCapabilities.Offloads = NETWORK_OFFLOAD_TX_IP4_CHECKSUM
+                                                         | NETWORK_OFFLOAD_TX_TCP_CHECKSUM
+                                                         | NETWORK_OFFLOAD_TX_UDP_CHECKSUM
+                                                         | NETWORK_OFFLOAD_TX_TCP_SEGMENTATION
+                                                         | NETWORK_OFFLOAD_RX_IP4_CHECKSUM
+                                                         | NETWORK_OFFLOAD_RX_TCP_UDP_CHECKSUM;
+    Device->MiniportDevice->OffloadCapabilities.MaximumSegmentationSize =
+        min(MAX_WORD, (txDescriptorsPerQueue / 2 - Device->MiniportDevice->TxOffloadDescriptors) * Device->TxData.BufferSize);
+}
+
 static
 STATUS
 _EthRxInit(
@@ -468,6 +1086,8 @@ _EthRxInit(
     PHYSICAL_ADDRESS ringBufferPa;
     RECEIVE_CONTROL_REGISTER ctrlRegister;
     RECEIVE_FILTER_CONTROL_REGISTER filterRegister;
+    RECEIVE_CHECKSUM_CONTROL_REGISTER checksumRegister;
+    DWORD i;
 
     ASSERT(NULL != Device);
 
@@ -477,26 +1097,45 @@ _EthRxInit(
     ringBufferPa = NULL;
     ctrlRegister.Raw = 0;
     filterRegister.Raw = 0;
+    checksumRegister.Raw = 0;
 
-    ringBufferPa = IoGetPhysicalAddress((PVOID)Device->RxData.ReceiveBuffer);
-    if (NULL == ringBufferPa)
+    for (i = 0; i < Device->NumberOfQueues; ++i)
     {
-        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", Device->RxData.ReceiveBuffer);
-        return STATUS_MEMORY_CANNOT_BE_MAPPED;
-    }
+        PETH_RX_QUEUE pQueue = &Device->RxData.Queues[i];
 
-    LOG_TRACE_NETWORK("Ring buffer PA: 0x%X\n", ringBufferPa );
+        ringBufferPa = IoGetPhysicalAddress((PVOID)pQueue->ReceiveBuffer);
+        if (NULL == ringBufferPa)
+        {
+            LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pQueue->ReceiveBuffer);
+            return STATUS_MEMORY_CANNOT_BE_MAPPED;
+        }
 
-    EthSetRxRingBufferAddress(Device, ringBufferPa);
+        LOG_TRACE_NETWORK("Queue %u ring buffer PA: 0x%X\n", i, ringBufferPa );
 
-    EthSetRxRingBufferSize(Device, Device->RxData.Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE );
+        EthSetRxRingBufferAddress(Device, i, ringBufferPa);
 
-    EthSetRxHead(Device, 0 );
+        EthSetRxRingBufferSize(Device, i, pQueue->Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE );
 
-    // this is a HACK to simplify LIFE
-    // simply state that the last descriptor is not available
-    // and make it available only after the first packet is processed
-    EthSetRxTail(Device, Device->RxData.Buffers.NumberOfDescriptors - 1);
+        EthSetRxHead(Device, i, 0 );
+
+        // this is a HACK to simplify LIFE
+        // simply state that the last descriptor is not available
+        // and make it available only after the first packet is processed
+        EthSetRxTail(Device, i, pQueue->Buffers.NumberOfDescriptors - 1);
+    }
+
+    // the device verifies the IPv4 and TCP/UDP checksums and reports the
+    // result in the status and errors of the descriptor, when RSS is used the
+    // hash replaces the packet checksum in the descriptor
+    checksumRegister.IpChecksumOffload = TRUE;
+    checksumRegister.TcpUdpChecksumOffload = TRUE;
+    checksumRegister.PacketChecksumDisable = Device->NumberOfQueues > 1;
+    EthSetRxChecksumControlRegister(Device, checksumRegister);
+
+    if (Device->NumberOfQueues > 1)
+    {
+        _EthRssInit(Device);
+    }
 
     // Enable RX
     ctrlRegister.Enable = TRUE;
@@ -521,18 +1160,53 @@ _EthRxInit(
 
     EthSetRxFilterControlRegister( Device, filterRegister );
 
-    EthSetRxInterruptRelativeDelay( Device, 10 * MS_IN_US );
-    EthSetRxInterruptAbsoluteDelay( Device, 64 * MS_IN_US );
-
-    LOG_TRACE_NETWORK("Relative delay: %u, absolute delay: %u\n",
-         EthGetRxInterruptRelativeDelay(Device),
-         EthGetRxInterruptAbsoluteDelay(Device));
-
     LOG_FUNC_END;
 
     return status;
 }
 
+static
+void
+_EthRssInit(
+    IN      PETH_DEVICE         Device
+    )
+{
+    MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER mrqc;
+    DWORD redirection;
+    DWORD keyPart;
+    DWORD i;
+    DWORD j;
+
+    ASSERT( NULL != Device );
+    ASSERT( Device->NumberOfQueues > 1 );
+
+    for (i = 0; i < ETH_RSS_KEY_SIZE / sizeof(DWORD); ++i)
+    {
+        memcpy(&keyPart, &ETH_RSS_KEY[i * sizeof(DWORD)], sizeof(DWORD));
+        Device->InternalRegisters->RssRandomKey[i] = keyPart;
+    }
+
+    // the hash results are distributed round robin between the queues
+    for (i = 0; i < ETH_RSS_REDIRECTION_ENTRIES / sizeof(DWORD); ++i)
+    {
+        redirection = 0;
+        for (j = 0; j < sizeof(DWORD); ++j)
+        {
+            DWORD queue = (i * sizeof(DWORD) + j) % Device->NumberOfQueues;
+
+            redirection = redirection | ((queue << ETH_RSS_REDIRECTION_QUEUE_SHIFT) << (j * BITS_PER_BYTE));
+        }
+
+        Device->InternalRegisters->RssRedirectionTable[i] = redirection;
+    }
+
+    mrqc.Raw = 0;
+    mrqc.MultipleQueuesEnable = MRQC_MULTIPLE_QUEUES_RSS;
+    mrqc.HashIp4 = TRUE;
+    mrqc.HashTcpIp4 = TRUE;
+    EthSetMultipleReceiveQueuesCommand(Device, mrqc);
+}
+
 static
 STATUS
 _EthTxInit(
@@ -542,6 +1216,7 @@ _EthTxInit(
     STATUS status;
     PHYSICAL_ADDRESS ringBufferPa;
     TRANSMIT_CONTROL_REGISTER ctrlRegister;
+    DWORD i;
 
     ASSERT( NULL != Device );
 
@@ -551,22 +1226,30 @@ _EthTxInit(
     ctrlRegister.Raw = 0;
     ringBufferPa = NULL;
 
-    ringBufferPa = IoGetPhysicalAddress((PVOID)Device->TxData.TransmitBuffer);
-    if (NULL == ringBufferPa)
+    for (i = 0; i < Device->NumberOfQueues; ++i)
     {
-        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", Device->TxData.TransmitBuffer);
-        return STATUS_MEMORY_CANNOT_BE_MAPPED;
-    }
+        PETH_TX_QUEUE pQueue = &Device->TxData.Queues[i];
+
+        ringBufferPa = IoGetPhysicalAddress((PVOID)pQueue->TransmitBuffer);
+        if (NULL == ringBufferPa)
+        {
+            LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pQueue->TransmitBuffer);
+            return STATUS_MEMORY_CANNOT_BE_MAPPED;
+        }
 
-    LOG_TRACE_NETWORK("Ring buffer PA: 0x%X\n", ringBufferPa);
+        LOG_TRACE_NETWORK("Queue %u ring buffer PA: 0x%X\n", i, ringBufferPa);
 
-    EthSetTxRingBufferAddress(Device, ringBufferPa);
+        EthSetTxRingBufferAddress(Device, i, ringBufferPa);
 
-    EthSetTxRingBufferSize(Device, Device->TxData.Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE);
+        EthSetTxRingBufferSize(Device, i, pQueue->Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE);
 
-    EthSetTxHead(Device, 0);
+        EthSetTxHead(Device, i, 0);
 
-    EthSetTxTail(Device, 0);
+        EthSetTxTail(Device, i, 0);
+
+        // the queues are served round robin by the transmit arbiter
+        ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitArbitrationCount, i) |= ETH_TARC_ENABLE;
+    }
 
     // enable TX
     ctrlRegister.Enable = TRUE;
@@ -576,14 +1259,51 @@ _EthTxInit(
 
     EthSetTxControlRegister(Device, ctrlRegister );
 
-    EthSetTxInterruptRelativeDelay(Device, 10 * MS_IN_US);
-    EthSetTxInterruptAbsoluteDelay(Device, 64 * MS_IN_US);
+    LOG_FUNC_END;
 
-    LOG_TRACE_NETWORK("Relative delay: %u, absolute delay: %u\n",
-         EthGetTxInterruptRelativeDelay(Device),
-         EthGetTxInterruptAbsoluteDelay(Device));
+    return status;
+}
 
-    LockInit(&Device->TxData.TxInterruptLock);
+static
+STATUS
+_EthRxPollInit(
+    IN      PETH_DEVICE         Device
+    )
+{
+    STATUS status;
+    DWORD i;
+
+    ASSERT( NULL != Device );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+
+    // each queue has its own poll thread, in MSI-X mode the queues are
+    // serviced in parallel
+    for (i = 0; i < Device->NumberOfQueues; ++i)
+    {
+        PETH_RX_QUEUE pQueue = &Device->RxData.Queues[i];
+
+        status = ExEventInit(&pQueue->Poll.PollRequested, ExEventTypeSynchronization, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            return status;
+        }
+
+        status = ThreadCreate("Eth RX poll",
+                              ThreadPriorityDefault,
+                              EthRxPollFunction,
+                              pQueue,
+                              &pQueue->Poll.PollThread
+                              );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ThreadCreate", status);
+            return status;
+        }
+    }
 
     LOG_FUNC_END;
 
@@ -617,10 +1337,23 @@ _EthInterruptInit(
 
     // clear all interrupts then set those which we want to intercept
 
-    intSetMaskReg.RdMinimumThresholdHit = TRUE;
-    intSetMaskReg.ReceiverOverrun = TRUE;
-    intSetMaskReg.ReceiverTimerInterrupt = TRUE;
-    intSetMaskReg.TdWrittenBack = TRUE;
+    if (Device->MsiXEnabled)
+    {
+        _EthMsiXInit(Device);
+
+        intSetMaskReg.RxQueue0 = TRUE;
+        intSetMaskReg.TxQueue0 = TRUE;
+        intSetMaskReg.RxQueue1 = (Device->NumberOfQueues > 1);
+        intSetMaskReg.TxQueue1 = (Device->NumberOfQueues > 1);
+        intSetMaskReg.OtherInterrupt = TRUE;
+    }
+    else
+    {
+        intSetMaskReg.RdMinimumThresholdHit = TRUE;
+        intSetMaskReg.ReceiverOverrun = TRUE;
+        intSetMaskReg.ReceiverTimerInterrupt = TRUE;
+        intSetMaskReg.TdWrittenBack = TRUE;
+    }
     intSetMaskReg.LinkStatusChange = TRUE;
 
     EthSetInterruptMaskClearRegister(Device, intClearMaskReg);
@@ -631,6 +1364,78 @@ _EthInterruptInit(
     return status;
 }
 
+static
+void
+_EthMsiXInit(
+    IN      PETH_DEVICE         Device
+    )
+{
+    PMINIPORT_DEVICE pMiniportDevice;
+    EXTENDED_DEVICE_CONTROL_REGISTER extCtrl;
+    INTERRUPT_VECTOR_ALLOCATION_REGISTER ivar;
+    INT_MASK_SET_REGISTER autoClear;
+    DWORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( Device->MsiXEnabled );
+
+    pMiniportDevice = Device->MiniportDevice;
+
+    extCtrl = EthGetExtendedDeviceControlRegister(Device);
+    extCtrl.PbaSupport = TRUE;
+    EthSetExtendedDeviceControlRegister(Device, extCtrl);
+
+    ivar.Raw = 0;
+    autoClear.Raw = 0;
+
+    ivar.RxQueue0Vector = ETH_MSI_X_VECTOR_RX_QUEUE(0);
+    ivar.RxQueue0Valid = TRUE;
+    ivar.TxQueue0Vector = ETH_MSI_X_VECTOR_TX_QUEUE(0);
+    ivar.TxQueue0Valid = TRUE;
+    autoClear.RxQueue0 = TRUE;
+    autoClear.TxQueue0 = TRUE;
+
+    if (Device->NumberOfQueues > 1)
+    {
+        ivar.RxQueue1Vector = ETH_MSI_X_VECTOR_RX_QUEUE(1);
+        ivar.RxQueue1Valid = TRUE;
+        ivar.TxQueue1Vector = ETH_MSI_X_VECTOR_TX_QUEUE(1);
+        ivar.TxQueue1Valid = TRUE;
+        autoClear.RxQueue1 = TRUE;
+        autoClear.TxQueue1 = TRUE;
+    }
+
+    ivar.OtherVector = ETH_MSI_X_VECTOR_OTHER;
+    ivar.OtherValid = TRUE;
+
+    EthSetInterruptVectorAllocation(Device, ivar);
+    EthSetInterruptAutoClear(Device, autoClear);
+
+    // the MSI-X table is at the start of BAR 3, both vectors of a queue are
+    // sent to the same CPU and each queue to a different one
+    pMiniportDevice->MsiXTable = (PVOID) Device->MsiX;
+    pMiniportDevice->NumberOfInterruptVectors = 0;
+    for (i = 0; i < Device->NumberOfQueues; ++i)
+    {
+        PMINIPORT_INTERRUPT_VECTOR pRxVector = &pMiniportDevice->InterruptVectors[pMiniportDevice->NumberOfInterruptVectors++];
+        PMINIPORT_INTERRUPT_VECTOR pTxVector = &pMiniportDevice->InterruptVectors[pMiniportDevice->NumberOfInterruptVectors++];
+
+        pRxVector->MsiXEntry = (WORD) ETH_MSI_X_VECTOR_RX_QUEUE(i);
+        pRxVector->TargetCpu = TRUE;
+        pRxVector->CpuIndex = i;
+
+        pTxVector->MsiXEntry = (WORD) ETH_MSI_X_VECTOR_TX_QUEUE(i);
+        pTxVector->TargetCpu = TRUE;
+        pTxVector->CpuIndex = i;
+    }
+
+    pMiniportDevice->InterruptVectors[pMiniportDevice->NumberOfInterruptVectors].MsiXEntry = ETH_MSI_X_VECTOR_OTHER;
+    pMiniportDevice->InterruptVectors[pMiniportDevice->NumberOfInterruptVectors].TargetCpu = FALSE;
+    pMiniportDevice->NumberOfInterruptVectors++;
+
+    ASSERT( pMiniportDevice->NumberOfInterruptVectors <= MINIPORT_MAX_INTERRUPT_VECTORS );
+}
+
 static
 void
 _EthDeviceControlsInit(
@@ -654,29 +1459,232 @@ _EthDeviceControlsInit(
 
 static
 void
-_EthSignalTxQueueFullIfNecessary(
+_EthModerationInit(
     IN      PETH_DEVICE         Device
     )
 {
-    WORD nextTxIndex;
-    INTR_STATE intrState;
+    PETH_MODERATION pModeration;
 
     ASSERT( NULL != Device );
 
-    nextTxIndex = ( Device->TxData.Buffers.CurrentDescriptor + 1 ) % Device->TxData.Buffers.NumberOfDescriptors;
+    pModeration = &Device->Moderation;
+
+    LockInit(&pModeration->Lock);
+
+    pModeration->Adaptive = TRUE;
+    pModeration->TrafficClass = EthTrafficClassLowLatency;
+    _EthProgramModeration(Device, &ETH_MODERATION_PROFILES[pModeration->TrafficClass]);
+
+    pModeration->IntervalStartUs = IoGetSystemTimeUs();
+    pModeration->IntervalStartFrames = 0;
+    pModeration->IntervalStartBytes = 0;
+}
 
-    // the check is done twice because we don't want each time we send a packet to take the interrupt
-    // lock => in most cases the validation will be quick
-    if (nextTxIndex == EthGetTxHead(Device))
+static
+void
+_EthProgramModeration(
+    IN      PETH_DEVICE                     Device,
+    IN      const ETH_MODERATION_SETTINGS*  Settings
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Settings );
+
+    EthSetInterruptThrottling(Device, Settings->ThrottleUs);
+    EthSetRxInterruptRelativeDelay(Device, Settings->RxDelayUs);
+    EthSetRxInterruptAbsoluteDelay(Device, Settings->RxAbsoluteDelayUs);
+    EthSetTxInterruptRelativeDelay(Device, Settings->TxDelayUs);
+    EthSetTxInterruptAbsoluteDelay(Device, Settings->TxAbsoluteDelayUs);
+
+    Device->Moderation.Settings = *Settings;
+
+    LOG_TRACE_NETWORK("Throttling: %u, RX delays: %u/%u, TX delays: %u/%u\n",
+                      EthGetInterruptThrottling(Device),
+                      EthGetRxInterruptRelativeDelay(Device),
+                      EthGetRxInterruptAbsoluteDelay(Device),
+                      EthGetTxInterruptRelativeDelay(Device),
+                      EthGetTxInterruptAbsoluteDelay(Device));
+}
+
+static
+void
+_EthAdjustModeration(
+    IN      PETH_DEVICE         Device
+    )
+{
+    PETH_MODERATION pModeration;
+    QWORD currentTimeUs;
+    QWORD elapsedUs;
+    QWORD totalFrames;
+    QWORD totalBytes;
+    QWORD intervalFrames;
+    QWORD intervalBytes;
+    QWORD frameRate;
+    QWORD averageFrameSize;
+    ETH_TRAFFIC_CLASS trafficClass;
+    INTR_STATE oldState;
+    DWORD i;
+
+    ASSERT( NULL != Device );
+
+    pModeration = &Device->Moderation;
+
+    // most passes end here, the lock is taken only once per interval
+    currentTimeUs = IoGetSystemTimeUs();
+    if (currentTimeUs - pModeration->IntervalStartUs < ETH_MODERATION_INTERVAL_US)
     {
-        LockAcquire(&Device->TxData.TxInterruptLock, &intrState);
+        return;
+    }
 
-        if (nextTxIndex == EthGetTxHead(Device))
-        {
-            LOGL("Queue is full\n");
-            NetworkPortNotifyTxQueueFull(Device->MiniportDevice);
-        }
+    LockAcquire(&pModeration->Lock, &oldState);
 
-        LockRelease(&Device->TxData.TxInterruptLock, intrState);
+    // the poll thread of another queue may have already closed the interval
+    if (currentTimeUs < pModeration->IntervalStartUs ||
+        currentTimeUs - pModeration->IntervalStartUs < ETH_MODERATION_INTERVAL_US)
+    {
+        LockRelease(&pModeration->Lock, oldState);
+        return;
     }
+    elapsedUs = currentTimeUs - pModeration->IntervalStartUs;
+
+    totalFrames = 0;
+    totalBytes = 0;
+    for (i = 0; i < Device->NumberOfQueues; ++i)
+    {
+        totalFrames += Device->RxData.Queues[i].FramesReceived;
+        totalBytes += Device->RxData.Queues[i].BytesReceived;
+    }
+
+    intervalFrames = totalFrames - pModeration->IntervalStartFrames;
+    intervalBytes = totalBytes - pModeration->IntervalStartBytes;
+
+    frameRate = (intervalFrames * SEC_IN_US) / elapsedUs;
+    averageFrameSize = 0 != intervalFrames ? intervalBytes / intervalFrames : 0;
+
+    if (frameRate < ETH_MODERATION_LOW_FRAME_RATE)
+    {
+        trafficClass = EthTrafficClassLowestLatency;
+    }
+    else if (frameRate >= ETH_MODERATION_BULK_FRAME_RATE
+             || averageFrameSize >= ETH_MODERATION_BULK_FRAME_SIZE)
+    {
+        trafficClass = EthTrafficClassBulk;
+    }
+    else
+    {
+        trafficClass = EthTrafficClassLowLatency;
+    }
+
+    pModeration->IntervalStartUs = currentTimeUs;
+    pModeration->IntervalStartFrames = totalFrames;
+    pModeration->IntervalStartBytes = totalBytes;
+
+    if (pModeration->Adaptive && trafficClass != pModeration->TrafficClass)
+    {
+        LOG_TRACE_NETWORK("Traffic class %u -> %u, %U frames/s of %U bytes\n",
+                          pModeration->TrafficClass, trafficClass,
+                          frameRate, averageFrameSize);
+
+        pModeration->TrafficClass = trafficClass;
+        _EthProgramModeration(Device, &ETH_MODERATION_PROFILES[trafficClass]);
+    }
+    LockRelease(&pModeration->Lock, oldState);
+}
+
+_No_competing_thread_
+static
+WORD
+_EthFillOffloadDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      PETH_TX_QUEUE       Queue,
+    IN      WORD                CurrentIndex,
+    IN      PMINIPORT_TX_FRAME  Frame,
+    OUT     PTRANSMIT_DESCRIPTOR* LastDescriptor
+    )
+{
+    PTRANSMIT_CONTEXT_DESCRIPTOR pContext;
+    PTRANSMIT_DATA_DESCRIPTOR pData;
+    BOOLEAN bSegmentation;
+    BOOLEAN bTcp;
+    DWORD remainingBytes;
+    WORD curTxIndex;
+    WORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Queue );
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != LastDescriptor );
+    ASSERT( 0 != Frame->Offloads );
+    ASSERT( Frame->NumberOfDescriptors > 1 );
+
+    bSegmentation = IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_SEGMENTATION);
+    bTcp = bSegmentation || IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_CHECKSUM);
+    curTxIndex = CurrentIndex;
+
+    // the context is described again for each frame, the device would allow
+    // it to be reused by the following frames with the same offsets
+    pContext = (PTRANSMIT_CONTEXT_DESCRIPTOR) &Queue->TransmitBuffer[curTxIndex];
+    ASSERT( pContext->DescriptorDone );
+
+    pContext->IpChecksumStart = (BYTE) Frame->NetworkHeaderOffset;
+    pContext->IpChecksumOffset = (BYTE) (Frame->NetworkHeaderOffset + FIELD_OFFSET(IP4_PACKET, Checksum));
+    pContext->IpChecksumEnd = Frame->TransportHeaderOffset - 1;
+
+    pContext->TcpUdpChecksumStart = (BYTE) Frame->TransportHeaderOffset;
+    pContext->TcpUdpChecksumOffset = (BYTE) (Frame->TransportHeaderOffset +
+                                             (bTcp ? FIELD_OFFSET(TCP_SEGMENT, Checksum) : FIELD_OFFSET(UDP_DATAGRAM, Checksum)));
+    pContext->TcpUdpChecksumEnd = 0;
+
+    pContext->PayloadLength = bSegmentation ? Frame->Length - Frame->HeadersLength : 0;
+    pContext->DescriptorType = ETH_TX_DESCRIPTOR_TYPE_CONTEXT;
+    pContext->TCP = bTcp;
+    pContext->IP = TRUE;
+    pContext->TSE = bSegmentation;
+    pContext->RS = FALSE;
+    pContext->DEXT = TRUE;
+    pContext->IDE = FALSE;
+    pContext->DescriptorDone = 0;
+    pContext->HeaderLength = bSegmentation ? (BYTE) Frame->HeadersLength : 0;
+    pContext->MaximumSegmentSize = bSegmentation ? Frame->MaximumSegmentSize : 0;
+
+    curTxIndex = (curTxIndex + 1) % Queue->Buffers.NumberOfDescriptors;
+
+    // the data was split by the port driver in full buffers
+    pData = NULL;
+    remainingBytes = Frame->Length;
+    for (i = 1; i < Frame->NumberOfDescriptors; ++i)
+    {
+        ASSERT( 0 != remainingBytes );
+
+        pData = (PTRANSMIT_DATA_DESCRIPTOR) &Queue->TransmitBuffer[curTxIndex];
+        ASSERT( pData->DescriptorDone );
+
+        pData->BufferAddress = Device->TxData.BufferAddresses[Queue->FirstDescriptor + curTxIndex];
+        pData->Length = min(remainingBytes, Device->TxData.BufferSize);
+        pData->DescriptorType = ETH_TX_DESCRIPTOR_TYPE_DATA;
+        pData->EOP = FALSE;
+        pData->IFCS = TRUE;
+        pData->TSE = bSegmentation;
+        pData->RS = FALSE;
+        pData->DEXT = TRUE;
+        pData->VLE = FALSE;
+        pData->IDE = FALSE;
+        pData->DescriptorDone = 0;
+        pData->IXSM = bSegmentation || IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_IP4_CHECKSUM);
+        pData->TXSM = bSegmentation || IsFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_CHECKSUM | NETWORK_OFFLOAD_TX_UDP_CHECKSUM);
+        pData->VLAN = 0;
+
+        remainingBytes = remainingBytes - pData->Length;
+        curTxIndex = (curTxIndex + 1) % Queue->Buffers.NumberOfDescriptors;
+    }
+    ASSERT( NULL != pData );
+    ASSERT( 0 == remainingBytes );
+
+    pData->EOP = TRUE;
+
+    // the RS bit of the last descriptor of the batch is set through the
+    // legacy view, it is in the same position
+    *LastDescriptor = (PTRANSMIT_DESCRIPTOR) pData;
+
+    return curTxIndex;
 }
\ No newline at end of file
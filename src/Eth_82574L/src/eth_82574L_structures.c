@@ -76,6 +76,31 @@ EthGetDeviceStatusRegister(
     return result;
 }
 
+EXTENDED_DEVICE_CONTROL_REGISTER
+EthGetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE         Device
+    )
+{
+    EXTENDED_DEVICE_CONTROL_REGISTER result;
+
+    ASSERT( NULL != Device );
+
+    result.Raw = Device->InternalRegisters->ExtendedDeviceControlRegister;
+
+    return result;
+}
+
+void
+EthSetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      EXTENDED_DEVICE_CONTROL_REGISTER    ControlRegister
+    )
+{
+    ASSERT( NULL != Device );
+
+    Device->InternalRegisters->ExtendedDeviceControlRegister = ControlRegister.Raw;
+}
+
 INT_CAUSE_READ_REGISTER
 EthGetInterruptReason(
     IN      PETH_DEVICE         Device
@@ -126,6 +151,72 @@ EthSetInterruptMaskClearRegister(
     Device->InternalRegisters->InterruptMaskClearRegister = Mask.Raw;
 }
 
+WORD
+EthGetInterruptThrottling(
+    IN      PETH_DEVICE         Device
+    )
+{
+    INTERRUPT_THROTTLING_REGISTER throttling;
+
+    ASSERT(NULL != Device);
+
+    throttling.Raw = Device->InternalRegisters->InterruptThrottlingRegister;
+
+    // the interval is measured in increments of 256 ns
+    return (WORD) (((DWORD) throttling.Interval * 256) / 1000);
+}
+
+void
+EthSetInterruptThrottling(
+    IN      PETH_DEVICE         Device,
+    IN      WORD                Microseconds
+    )
+{
+    INTERRUPT_THROTTLING_REGISTER throttling;
+    DWORD interval;
+    DWORD i;
+
+    ASSERT(NULL != Device);
+
+    interval = ((DWORD) Microseconds * 1000 + 255) / 256;
+
+    throttling.Raw = 0;
+    throttling.Interval = (WORD) min(interval, MAX_WORD);
+
+    Device->InternalRegisters->InterruptThrottlingRegister = throttling.Raw;
+
+    if (Device->MsiXEnabled)
+    {
+        // the EITR registers have the same format as ITR
+        for (i = 0; i < ETH_NO_OF_EITR; ++i)
+        {
+            Device->InternalRegisters->ExtendedInterruptThrottling[i] = throttling.Raw;
+        }
+    }
+}
+
+void
+EthSetInterruptVectorAllocation(
+    IN      PETH_DEVICE                             Device,
+    IN      INTERRUPT_VECTOR_ALLOCATION_REGISTER    Allocation
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->InternalRegisters->InterruptVectorAllocation = Allocation.Raw;
+}
+
+void
+EthSetInterruptAutoClear(
+    IN      PETH_DEVICE             Device,
+    IN      INT_MASK_SET_REGISTER   Mask
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->InternalRegisters->ExtendedInterruptAutoClear = Mask.Raw;
+}
+
 DWORD
 EthGetRxControlRegister(
     IN      PETH_DEVICE                 Device
@@ -158,9 +249,32 @@ EthSetRxFilterControlRegister(
     Device->InternalRegisters->ReceiveFilterControlRegister = FilterRegister.Raw;
 }
 
+void
+EthSetRxChecksumControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      RECEIVE_CHECKSUM_CONTROL_REGISTER   ChecksumRegister
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->InternalRegisters->ReceiveChecksumControlRegister = ChecksumRegister.Raw;
+}
+
+void
+EthSetMultipleReceiveQueuesCommand(
+    IN      PETH_DEVICE                                 Device,
+    IN      MULTIPLE_RECEIVE_QUEUES_COMMAND_REGISTER    Command
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->InternalRegisters->MultipleReceiveQueuesCommand = Command.Raw;
+}
+
 void
 EthSetRxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      PHYSICAL_ADDRESS    Address
     )
 {
@@ -182,13 +296,14 @@ EthSetRxRingBufferAddress(
     rdBal.Raw = ringBufferLow;
     rdBah.BaseAddressHigh = ringBufferHigh;
 
-    Device->InternalRegisters->ReceiveDescriptorAddressLow = rdBal.Raw;
-    Device->InternalRegisters->ReceiveDescriptorAddressHigh = rdBah.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorAddressLow, Queue) = rdBal.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorAddressHigh, Queue) = rdBah.Raw;
 }
 
 void
 EthSetRxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      DWORD               Size
     )
 {
@@ -201,19 +316,20 @@ EthSetRxRingBufferSize(
     // Set descriptor length
     rdLen.Length = Size;
 
-    Device->InternalRegisters->ReceiveDescriptorLength = rdLen.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorLength, Queue) = rdLen.Raw;
 }
 
 WORD
 EthGetRxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     )
 {
     RD_HEAD rdHead;
 
     ASSERT(NULL != Device);
 
-    rdHead.Raw = Device->InternalRegisters->ReceiveDescriptorHead;
+    rdHead.Raw = ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorHead, Queue);
 
     return rdHead.Head;
 }
@@ -221,6 +337,7 @@ EthGetRxHead(
 void
 EthSetRxHead(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     )
 {
@@ -231,19 +348,20 @@ EthSetRxHead(
     rdHead.Raw = 0;
     rdHead.Head = Index;
 
-    Device->InternalRegisters->ReceiveDescriptorHead = rdHead.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorHead, Queue) = rdHead.Raw;
 }
 
 WORD
 EthGetRxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     )
 {
     RD_TAIL rdTail;
 
     ASSERT(NULL != Device);
 
-    rdTail.Raw = Device->InternalRegisters->ReceiveDescriptorTail;
+    rdTail.Raw = ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorTail, Queue);
 
     return rdTail.Tail;
 }
@@ -251,6 +369,7 @@ EthGetRxTail(
 void
 EthSetRxTail(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     )
 {
@@ -261,7 +380,7 @@ EthSetRxTail(
     rdTail.Raw = 0;
     rdTail.Tail = Index;
 
-    Device->InternalRegisters->ReceiveDescriptorTail = rdTail.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, ReceiveDescriptorTail, Queue) = rdTail.Raw;
 }
 
 WORD
@@ -348,6 +467,7 @@ EthSetTxControlRegister(
 void
 EthSetTxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      PHYSICAL_ADDRESS    Address
     )
 {
@@ -369,13 +489,14 @@ EthSetTxRingBufferAddress(
     tdBal.Raw = ringBufferLow;
     tdBah.BaseAddressHigh = ringBufferHigh;
 
-    Device->InternalRegisters->TransmitDescriptorAddressLow = tdBal.Raw;
-    Device->InternalRegisters->TransmitDescriptorAddressHigh = tdBah.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorAddressLow, Queue) = tdBal.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorAddressHigh, Queue) = tdBah.Raw;
 }
 
 void
 EthSetTxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      DWORD               Size
     )
 {
@@ -388,19 +509,20 @@ EthSetTxRingBufferSize(
     // Set descriptor length
     tdLen.Length = Size;
 
-    Device->InternalRegisters->TransmitDescriptorLength = tdLen.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorLength, Queue) = tdLen.Raw;
 }
 
 WORD
 EthGetTxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     )
 {
     TD_HEAD tdHead;
 
     ASSERT(NULL != Device);
 
-    tdHead.Raw = Device->InternalRegisters->TransmitDescriptorHead;
+    tdHead.Raw = ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorHead, Queue);
 
     return tdHead.Head;
 }
@@ -408,6 +530,7 @@ EthGetTxHead(
 void
 EthSetTxHead(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     )
 {
@@ -418,19 +541,20 @@ EthSetTxHead(
     tdHead.Raw = 0;
     tdHead.Head = Index;
 
-    Device->InternalRegisters->TransmitDescriptorHead = tdHead.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorHead, Queue) = tdHead.Raw;
 }
 
 WORD
 EthGetTxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue
     )
 {
     TD_TAIL tdTail;
 
     ASSERT(NULL != Device);
 
-    tdTail.Raw = Device->InternalRegisters->TransmitDescriptorTail;
+    tdTail.Raw = ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorTail, Queue);
 
     return tdTail.Tail;
 }
@@ -438,6 +562,7 @@ EthGetTxTail(
 void
 EthSetTxTail(
     IN      PETH_DEVICE         Device,
+    IN      DWORD               Queue,
     IN      WORD                Index
     )
 {
@@ -448,7 +573,7 @@ EthSetTxTail(
     tdTail.Raw = 0;
     tdTail.Tail = Index;
 
-    Device->InternalRegisters->TransmitDescriptorTail = tdTail.Raw;
+    ETH_QUEUE_REGISTER(Device->InternalRegisters, TransmitDescriptorTail, Queue) = tdTail.Raw;
 }
 
 WORD
@@ -268,6 +268,29 @@ typedef struct _CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF
 } CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF, *PCPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF;
 STATIC_ASSERT(sizeof(CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF) == sizeof(DWORD) * 4);
 
+// 0xD, sub-leaf 1
+typedef struct _CPUID_EAX_EXTENDED_STATE_ENUMERATION_SUB_LEAF
+{
+    DWORD                               XSAVEOPT                                : 1;
+    DWORD                               XSAVEC                                  : 1;
+    DWORD                               XGETBV_ECX1                             : 1;
+    DWORD                               XSAVES                                  : 1;
+    DWORD                               __Reserved4_31                          : 28;
+} CPUID_EAX_EXTENDED_STATE_ENUMERATION_SUB_LEAF, *PCPUID_EAX_EXTENDED_STATE_ENUMERATION_SUB_LEAF;
+STATIC_ASSERT(sizeof(CPUID_EAX_EXTENDED_STATE_ENUMERATION_SUB_LEAF) == sizeof(DWORD));
+
+typedef struct _CPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF
+{
+    CPUID_EAX_EXTENDED_STATE_ENUMERATION_SUB_LEAF   eax;
+
+    DWORD                               SizeRequiredByXssAndXcr0Features;
+
+    DWORD                               XssFeatureSupportLow;
+
+    DWORD                               XssFeatureSupportHigh;
+} CPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF, *PCPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF;
+STATIC_ASSERT(sizeof(CPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF) == sizeof(DWORD) * 4);
+
 // 0x8000'0000
 typedef struct _CPUID_EXTENDED_CPUID_INFORMATION
 {
@@ -361,6 +384,9 @@ typedef struct _CPUID_INFO
         // 0xD
         CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF  ExtendedStateMainLeaf;
 
+        // 0xD, sub-leaf 1
+        CPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF   ExtendedStateSubLeaf;
+
         // 0x8000'0000
         CPUID_EXTENDED_CPUID_INFORMATION            ExtendedInformation;
 
@@ -1,6 +1,6 @@
 #pragma once
 
-#define INCLUDE_FP_SUPPORT                  0
+#define INCLUDE_FP_SUPPORT                  1
 
 typedef QWORD XCR0_SAVED_STATE;
 
@@ -49,11 +49,18 @@ typedef struct  _XSAVE_LEGACY_REGION
     DWORD                       MxCsr_Mask;
     M128A                       FloatRegisters[8];
     M128A                       XmmRegisters[16];
-    BYTE                        Reserved4[96];
+    BYTE                        Reserved4[48];
+
+    // bytes 464:511 are not written by the processor, the kernel uses them
+    // to mark interrupt frames which hold a saved FPU state
+    BYTE                        SoftwareAvailable[48];
 } XSAVE_LEGACY_REGION, *PXSAVE_LEGACY_REGION;
 STATIC_ASSERT_INFO(sizeof(XSAVE_LEGACY_REGION) == PREDEFINED_XSAVE_LEGACY_REGION_SIZE,
     "Intel Software Developer Manual Vol 1 Section 13.4.1 Legacy Region of an XSAVE Area");
 
+// MXCSR value after reset: all SIMD floating-point exceptions masked
+#define XSAVE_MXCSR_DEFAULT_VALUE                   0x1F80
+
 #define PREDEFINED_XSAVE_AREA_HEADER_SIZE           0x40
 
 typedef struct  _XSAVE_AREA_HEADER
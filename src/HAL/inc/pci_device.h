@@ -35,4 +35,20 @@ PciDevProgramMsiInterrupt(
             APIC_PIN_POLARITY       PinPolarity,
     IN _Strict_type_match_
             APIC_TRIGGER_MODE       TriggerMode
-);
\ No newline at end of file
+);
+
+// Programs the entry Entry of the MSI-X table mapped at MsiXTable to deliver
+// Vector and enables MSI-X for the device (MSI is disabled). The MSI-X
+// messages are always edge triggered.
+STATUS
+PciDevProgramMsiXInterrupt(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    IN      PVOID                   MsiXTable,
+    IN      WORD                    Entry,
+    IN      BYTE                    Vector,
+    IN _Strict_type_match_
+            APIC_DESTINATION_MODE   DestinationMode,
+    IN      BYTE                    Destination,
+    IN _Strict_type_match_
+            APIC_DELIVERY_MODE      DeliveryMode
+    );
\ No newline at end of file
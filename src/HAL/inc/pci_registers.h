@@ -14,6 +14,7 @@
 
 #define PREDEFINED_PCI_MSI_ADDRESS_REGISTER_SIZE    4
 #define PREDEFINED_PCI_MSI_DATA_REGISTER_SIZE       2
+#define PREDEFINED_PCI_MSIX_TABLE_ENTRY_SIZE        16
 
 #define PCI_DEVICE_NO_OF_BARS                       6U
 #define PCI_BRIDGE_NO_OF_BARS                       2U
@@ -343,10 +344,65 @@ typedef volatile struct _PCI_CAPABILITY_MSI
 
 typedef volatile struct _PCI_CAPABILITY_MSIX
 {
-    PCI_CAPABILITY_HEADER       Header;
-    WORD                        MessageControl;
+    PCI_CAPABILITY_HEADER               Header;
+    union
+    {
+        struct
+        {
+            // RO - the number of entries in the table minus 1
+            WORD                        TableSize                   :  11;
+
+            WORD                        __Reserved0                 :   3;
+
+            // RW - if set all the vectors are masked regardless of their
+            // vector control
+            WORD                        FunctionMask                :   1;
+
+            // RW
+            WORD                        MsiXEnable                  :   1;
+        };
+        WORD                            Raw;
+    } MessageControl;
+
+    // the table and the pending bit array are placed in the memory space
+    // described by the BAR with the index BIR at the QWORD aligned offset
+    union
+    {
+        struct
+        {
+            DWORD                       Bir                         :   3;
+            DWORD                       OffsetHigh                  :  29;
+        };
+        DWORD                           Raw;
+    } Table;
+
+    union
+    {
+        struct
+        {
+            DWORD                       Bir                         :   3;
+            DWORD                       OffsetHigh                  :  29;
+        };
+        DWORD                           Raw;
+    } PendingBitArray;
 } PCI_CAPABILITY_MSIX, *PPCI_CAPABILITY_MSIX;
 
+#define PCI_MSIX_VECTOR_CONTROL_MASKED          0x1
+
+// an entry of the MSI-X table, the address and data have the same format as
+// the ones of the MSI capability
+typedef volatile struct _PCI_MSIX_TABLE_ENTRY
+{
+    PCI_MSI_ADDRESS_REGISTER            MessageAddressLower;
+    DWORD                               MessageAddressHigher;
+
+    // only the low WORD is used, the high WORD is reserved
+    DWORD                               MessageData;
+
+    DWORD                               VectorControl;
+} PCI_MSIX_TABLE_ENTRY, *PPCI_MSIX_TABLE_ENTRY;
+STATIC_ASSERT(sizeof(PCI_MSIX_TABLE_ENTRY) == PREDEFINED_PCI_MSIX_TABLE_ENTRY_SIZE);
+
 typedef volatile struct _PCI_DEVICE_HEADER
 {
     // 0x10
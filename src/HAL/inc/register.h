@@ -5,6 +5,7 @@
 // CR0 related definitions
 #define CR0_PE                                      ((QWORD)1<<0)
 #define CR0_EM                                      ((QWORD)1<<2)
+#define CR0_TS                                      ((QWORD)1<<3)
 #define CR0_ET                                      ((QWORD)1<<4)
 #define CR0_NE                                      ((QWORD)1<<5)
 #define CR0_WP                                      ((QWORD)1<<16)
@@ -8,6 +8,13 @@ _PciDevProgramIoPortMsiInterrupt(
     IN      PPCI_CAPABILITY_MSI     PciCap
     );
 
+static
+void
+_PciDevWriteCapabilityHeader(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    IN      PPCI_CAPABILITY_HEADER  PciCap
+    );
+
 STATUS
 PciDevRetrieveCapabilityById(
     IN      PPCI_DEVICE             Device,
@@ -189,6 +196,104 @@ PciDevProgramMsiInterrupt(
     return STATUS_SUCCESS;
 }
 
+STATUS
+PciDevProgramMsiXInterrupt(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    IN      PVOID                   MsiXTable,
+    IN      WORD                    Entry,
+    IN      BYTE                    Vector,
+    IN _Strict_type_match_
+            APIC_DESTINATION_MODE   DestinationMode,
+    IN      BYTE                    Destination,
+    IN _Strict_type_match_
+            APIC_DELIVERY_MODE      DeliveryMode
+    )
+{
+    STATUS status;
+    PPCI_CAPABILITY_MSIX pciCap;
+    PPCI_CAPABILITY_MSI pMsiCap;
+    PPCI_MSIX_TABLE_ENTRY pEntry;
+    PCI_MSI_DATA_REGISTER msgData;
+    PCI_MSI_ADDRESS_REGISTER msgAddrLower;
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == MsiXTable)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    pciCap = NULL;
+    pMsiCap = NULL;
+    msgData.Raw = 0;
+    msgAddrLower.Raw = 0;
+
+    status = PciDevRetrieveCapabilityById(Device->DeviceData,
+                                          PCI_CAPABILITY_ID_MSIX,
+                                          (PPCI_CAPABILITY_HEADER*)&pciCap
+    );
+    if (!SUCCEEDED(status))
+    {
+        return STATUS_DEVICE_INTERRUPT_TYPE_NOT_SUPPORTED;
+    }
+    ASSERT(NULL != pciCap);
+
+    if (Entry > pciCap->MessageControl.TableSize)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    // MSI and MSI-X must never be enabled at the same time
+    status = PciDevRetrieveCapabilityById(Device->DeviceData,
+                                          PCI_CAPABILITY_ID_MSI,
+                                          (PPCI_CAPABILITY_HEADER*)&pMsiCap
+    );
+    if (SUCCEEDED(status) && pMsiCap->MessageControl.MsiEnable)
+    {
+        pMsiCap->MessageControl.MsiEnable = FALSE;
+
+        if (!Device->PciExpressDevice)
+        {
+            _PciDevWriteCapabilityHeader(Device, (PPCI_CAPABILITY_HEADER)pMsiCap);
+        }
+    }
+
+    msgAddrLower.DestinationId = Destination;
+    msgAddrLower.DestinationMode = DestinationMode;
+    msgAddrLower.RedirectionHint = TRUE;
+    msgAddrLower.UpperFixedAddress = 0xFEE;
+
+    msgData.Vector = Vector;
+    msgData.DeliveryMode = DeliveryMode;
+    msgData.Assert = ApicPinPolarityActiveHigh;
+    msgData.TriggerMode = ApicTriggerModeEdge;
+
+    pEntry = (PPCI_MSIX_TABLE_ENTRY)MsiXTable + Entry;
+
+    // the entry is masked while it is changed so that the device will not
+    // send a message composed of the old and the new values
+    pEntry->VectorControl = pEntry->VectorControl | PCI_MSIX_VECTOR_CONTROL_MASKED;
+
+    pEntry->MessageAddressLower.Raw = msgAddrLower.Raw;
+    pEntry->MessageAddressHigher = 0;
+    pEntry->MessageData = msgData.Raw;
+
+    pEntry->VectorControl = pEntry->VectorControl & ~PCI_MSIX_VECTOR_CONTROL_MASKED;
+
+    pciCap->MessageControl.FunctionMask = FALSE;
+    pciCap->MessageControl.MsiXEnable = TRUE;
+
+    if (!Device->PciExpressDevice)
+    {
+        _PciDevWriteCapabilityHeader(Device, (PPCI_CAPABILITY_HEADER)pciCap);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 void
 _PciDevProgramIoPortMsiInterrupt(
@@ -234,4 +339,21 @@ _PciDevProgramIoPortMsiInterrupt(
                                (BYTE)(PtrDiff(PciCap, Device->DeviceData)),
                                *(PDWORD)PciCap
                                );
+}
+
+static
+void
+_PciDevWriteCapabilityHeader(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    IN      PPCI_CAPABILITY_HEADER  PciCap
+    )
+{
+    ASSERT(NULL != Device);
+    ASSERT(NULL != PciCap);
+
+    // the first DWORD holds the capability header and the message control
+    PciWriteConfigurationSpace(Device->DeviceLocation,
+                               (BYTE)(PtrDiff(PciCap, Device->DeviceData)),
+                               *(PDWORD)PciCap
+                               );
 }
\ No newline at end of file
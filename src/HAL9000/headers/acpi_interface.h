@@ -48,6 +48,18 @@ AcpiRetrieveNextMcfgEntry(
     OUT_PTR ACPI_MCFG_ALLOCATION**      AcpiEntry
     );
 
+STATUS
+AcpiRetrieveNextCpuAffinity(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SRAT_CPU_AFFINITY**    AcpiEntry
+    );
+
+STATUS
+AcpiRetrieveNextMemoryAffinity(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SRAT_MEM_AFFINITY**    AcpiEntry
+    );
+
 STATUS
 AcpiRetrieveNextPrtEntry(
     IN      BOOLEAN                     RestartSearch,
@@ -5,4 +5,12 @@
 FUNC_GenericCommand CmdListNetworks;
 FUNC_GenericCommand CmdNetRecv;
 FUNC_GenericCommand CmdNetSend;
-FUNC_GenericCommand CmdChangeDevStatus;
\ No newline at end of file
+FUNC_GenericCommand CmdChangeDevStatus;
+FUNC_GenericCommand CmdNetStats;
+FUNC_GenericCommand CmdNetTune;
+FUNC_GenericCommand CmdNetIp;
+FUNC_GenericCommand CmdPing;
+FUNC_GenericCommand CmdUdpEcho;
+FUNC_GenericCommand CmdTcpSend;
+FUNC_GenericCommand CmdTcpReceive;
+FUNC_GenericCommand CmdPacketGenerator;
\ No newline at end of file
@@ -5,4 +5,5 @@
 FUNC_GenericCommand CmdListProcesses;
 FUNC_GenericCommand CmdProcessDump;
 FUNC_GenericCommand CmdStartProcess;
-FUNC_GenericCommand CmdTestProcess;
\ No newline at end of file
+FUNC_GenericCommand CmdTestProcess;
+FUNC_GenericCommand CmdSyscallStats;
\ No newline at end of file
@@ -6,10 +6,28 @@
 #include "list.h"
 #include "synch.h"
 #include "cpu_structures.h"
+#include "mem_structures.h"
 
 #define STACK_DEFAULT_SIZE          (8*PAGE_SIZE)
 #define STACK_GUARD_SIZE            (2*PAGE_SIZE)
 
+// user stacks reserve this much virtual space, their pages are mapped only
+// when first touched
+#define STACK_USER_RESERVE_SIZE     ((DWORD)(1*MB_SIZE))
+
+// kernel stacks of STACK_DEFAULT_SIZE freed on a CPU remain mapped and are
+// handed to the next threads created on it
+#define STACK_CACHE_MAX_DEPTH       8
+
+typedef struct _STACK_CACHE
+{
+    PVOID               Stacks[STACK_CACHE_MAX_DEPTH];
+    BYTE                Depth;
+
+    QWORD               Hits;
+    QWORD               Misses;
+} STACK_CACHE, *PSTACK_CACHE;
+
 typedef struct _THREADING_DATA
 {
     DWORD               RunningThreadTicks;
@@ -23,6 +41,46 @@ typedef struct _THREADING_DATA
     QWORD               KernelTicks;
 } THREADING_DATA, *PTHREADING_DATA;
 
+// IRPs with at most this many stack locations are cached on the CPU which
+// freed them, larger IRPs always come from the heap
+#define IRP_LOOKASIDE_MAX_STACK_SIZE    8
+
+// maximum number of free IRPs kept in each list
+#define IRP_LOOKASIDE_MAX_DEPTH         16
+
+typedef struct _IRP_LOOKASIDE
+{
+    // one list for each stack size, the free IRPs are chained
+    // through their first QWORD
+    PVOID               FreeList[IRP_LOOKASIDE_MAX_STACK_SIZE];
+    BYTE                Depth[IRP_LOOKASIDE_MAX_STACK_SIZE];
+
+    QWORD               Hits;
+    QWORD               Misses;
+} IRP_LOOKASIDE, *PIRP_LOOKASIDE;
+
+// user buffers of at most this size are copied through the bounce window of
+// the CPU instead of having their pages mapped in kernel space
+#define MMU_BOUNCE_WINDOW_SIZE          PAGE_SIZE
+
+typedef struct _MMU_BOUNCE_WINDOW
+{
+    // allocated the first time the window is used and reused afterwards
+    PVOID               Buffer;
+
+    // the window is owned by a single thread at a time, the thread may be
+    // rescheduled on another CPU while it holds it
+    volatile BOOLEAN    InUse;
+
+    // the user buffer the window stands for while it is in use
+    PVOID               UserAddress;
+    DWORD               Size;
+    PAGE_RIGHTS         PageRights;
+
+    QWORD               Hits;
+    QWORD               Misses;
+} MMU_BOUNCE_WINDOW, *PMMU_BOUNCE_WINDOW;
+
 typedef struct _PCPU
 {
     struct _PCPU                *Self;
@@ -46,6 +104,18 @@ typedef struct _PCPU
 
     THREADING_DATA              ThreadData;
 
+    // accessed only with interrupts disabled
+    IRP_LOOKASIDE               IrpLookaside;
+
+    MMU_BOUNCE_WINDOW           BounceWindow;
+
+    // accessed only with interrupts disabled
+    STACK_CACHE                 StackCache;
+
+    // the last thread whose FPU state was loaded on this CPU, CR0.TS is clear
+    // only while it runs and the FPU registers still hold its state
+    struct _THREAD*             FpuOwner;
+
     // IPC data
     LIST_ENTRY                  EventList;
     LOCK                        EventListLock;
@@ -118,6 +188,11 @@ CpuMuIsPcidFeaturePresent(
     void
     );
 
+BOOLEAN
+CpuMuIsXsaveoptFeaturePresent(
+    void
+    );
+
 STATUS
 CpuMuActivateFpuFeatures(
     void
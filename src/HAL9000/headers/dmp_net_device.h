@@ -5,4 +5,16 @@
 void
 DumpNetworkDevice(
     IN      PNETWORK_DEVICE_INFO        NetworkDevice
+    );
+
+void
+DumpNetworkDeviceStatistics(
+    IN      DEVICE_ID                   DeviceId,
+    IN      PNETWORK_DEVICE_STATS       Statistics
+    );
+
+void
+DumpNetworkDeviceTuning(
+    IN      DEVICE_ID                   DeviceId,
+    IN      PNETWORK_DEVICE_TUNING      Tuning
     );
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "syscall_defs.h"
+#include "ref_cnt.h"
+#include "synch.h"
+
+// The handles of a process are translated through a two level table: the low
+// DWORD of a handle is the index of its entry + HANDLE_TABLE_FIRST_HANDLE and
+// the next WORD is the generation of the entry, so a closed handle is not
+// valid anymore after its entry is reused. The first handles are left free for
+// UM_INVALID_HANDLE_VALUE and UM_FILE_HANDLE_STDOUT.
+#define HANDLE_TABLE_FIRST_HANDLE           0x100
+
+#define HANDLE_TABLE_MAX_PAGES              64
+
+typedef enum _HANDLE_TYPE
+{
+    HandleTypeFile = 1,
+    HandleTypeThread,
+    HandleTypeProcess,
+    HandleTypeSocket,
+} HANDLE_TYPE;
+
+typedef struct _HANDLE_TABLE_ENTRY
+{
+    // The REF_COUNT of the object, 0 for a free entry. Bit 0 is set while a
+    // thread references the object or closes the handle.
+    volatile QWORD                  Object;
+
+    // incremented each time a handle of the entry is closed
+    volatile WORD                   Generation;
+    volatile BYTE                   Type;
+    BYTE                            __Reserved;
+
+    // valid only for free entries, index of the next free entry
+    DWORD                           NextFree;
+} HANDLE_TABLE_ENTRY, *PHANDLE_TABLE_ENTRY;
+
+#define HANDLE_TABLE_ENTRIES_PER_PAGE       (PAGE_SIZE / sizeof(HANDLE_TABLE_ENTRY))
+#define HANDLE_TABLE_MAX_HANDLES            (HANDLE_TABLE_MAX_PAGES * HANDLE_TABLE_ENTRIES_PER_PAGE)
+
+typedef struct _HANDLE_TABLE
+{
+    // taken only to insert and to close handles
+    LOCK                            Lock;
+
+    // A page is never freed before the table is destroyed, the handles are
+    // translated without taking the lock
+    PHANDLE_TABLE_ENTRY volatile    Pages[HANDLE_TABLE_MAX_PAGES];
+
+    // entries with a higher index were never used
+    _Guarded_by_(Lock)
+    DWORD                           NumberOfEntries;
+
+    _Guarded_by_(Lock)
+    DWORD                           FreeListHead;
+
+    _Guarded_by_(Lock)
+    DWORD                           NumberOfHandles;
+} HANDLE_TABLE, *PHANDLE_TABLE;
+
+void
+HandleTableInit(
+    OUT         PHANDLE_TABLE           Table
+    );
+
+// Closes the handles still open, nobody may use the table anymore
+void
+HandleTableDestroy(
+    INOUT       PHANDLE_TABLE           Table
+    );
+
+//******************************************************************************
+// Function:     HandleTableInsert
+// Description:  Creates a handle for the object, the table takes over the
+//               reference of the caller. A free entry is reused first, the
+//               table grows by one page when all its entries are used.
+// Returns:      STATUS - STATUS_LIMIT_REACHED if the table is full.
+// Parameter:    INOUT PHANDLE_TABLE Table
+// Parameter:    IN HANDLE_TYPE Type
+// Parameter:    IN PREF_COUNT Object
+// Parameter:    OUT UM_HANDLE* Handle
+//******************************************************************************
+STATUS
+HandleTableInsert(
+    INOUT       PHANDLE_TABLE           Table,
+    IN          HANDLE_TYPE             Type,
+    IN          PREF_COUNT              Object,
+    OUT         UM_HANDLE*              Handle
+    );
+
+//******************************************************************************
+// Function:     HandleTableReference
+// Description:  Translates a handle without taking the lock of the table, only
+//               the entry of the handle is locked while the object is
+//               referenced.
+// Returns:      PREF_COUNT - the referenced object, NULL if the handle is not
+//               valid or if it is not of the type requested.
+// Parameter:    IN PHANDLE_TABLE Table
+// Parameter:    IN UM_HANDLE Handle
+// Parameter:    IN HANDLE_TYPE Type
+//******************************************************************************
+PTR_SUCCESS
+PREF_COUNT
+HandleTableReference(
+    IN          PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle,
+    IN          HANDLE_TYPE             Type
+    );
+
+// The threads which still reference the object keep it alive
+STATUS
+HandleTableClose(
+    INOUT       PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle,
+    IN          HANDLE_TYPE             Type
+    );
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "mem_structures.h"
+
+typedef struct _IMAGE_CACHE_ENTRY* PIMAGE_CACHE_ENTRY;
+typedef struct _PE_NT_HEADER_INFO* PPE_NT_HEADER_INFO;
+
+// maximum number of executables kept in the cache, the least recently used
+// image which is not mapped by any process is evicted to make room
+#define IMAGE_CACHE_MAX_ENTRIES             16
+
+//******************************************************************************
+// Function:     ImageCachePreinit
+// Description:  Initializes the list of cached images and its lock.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+_No_competing_thread_
+void
+ImageCachePreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     ImageCacheReferenceImage
+// Description:  Retrieves the cached image of the executable found at Path, an
+//               image is identified by its path, size and last write time. On a
+//               miss only the NT headers are read from the file, the rest of
+//               the pages are read when they are first needed.
+// Returns:      STATUS
+// Parameter:    IN_Z char* Path
+// Parameter:    OUT_PTR PIMAGE_CACHE_ENTRY* Image - must be released with
+//               ImageCacheDereferenceImage.
+//******************************************************************************
+STATUS
+ImageCacheReferenceImage(
+    IN_Z        char*                   Path,
+    OUT_PTR     PIMAGE_CACHE_ENTRY*     Image
+    );
+
+// Takes another reference to an image the caller already references
+void
+ImageCacheReference(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    );
+
+void
+ImageCacheDereferenceImage(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    );
+
+// The ImageBase of the header information describes the kernel mapping of the
+// cached image
+PPE_NT_HEADER_INFO
+ImageCacheGetHeaderInfo(
+    IN          PIMAGE_CACHE_ENTRY      Image
+    );
+
+//******************************************************************************
+// Function:     ImageCacheGetPage
+// Description:  Brings the page found at Offset bytes from the start of the
+//               image into memory.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if the page is not covered by
+//               the headers or by any section.
+// Parameter:    IN PIMAGE_CACHE_ENTRY Image
+// Parameter:    IN QWORD Offset
+// Parameter:    OUT PAGE_RIGHTS* PageRights - the rights with which the page
+//               must be mapped in a process.
+// Parameter:    OUT_PTR_MAYBE_NULL PVOID* KernelAddress - the kernel mapping of
+//               the page, NULL if the page lies beyond the end of the file and
+//               is initially zero (uninitialized data).
+//******************************************************************************
+STATUS
+ImageCacheGetPage(
+    IN          PIMAGE_CACHE_ENTRY      Image,
+    IN          QWORD                   Offset,
+    OUT         PAGE_RIGHTS*            PageRights,
+    OUT_PTR_MAYBE_NULL
+                PVOID*                  KernelAddress
+    );
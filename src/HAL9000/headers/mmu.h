@@ -5,6 +5,7 @@
 
 typedef struct _PROCESS* PPROCESS;
 typedef struct _PE_NT_HEADER_INFO *PPE_NT_HEADER_INFO;
+typedef struct _MDL *PMDL;
 
 /// TODO: Move BasePhysicalAddress and KernelSpace outside protected region
 typedef struct _PAGING_DATA
@@ -323,6 +324,22 @@ MmuDestroyAddressSpaceForProcess(
     INOUT   PPROCESS                Process
     );
 
+//******************************************************************************
+// Function:     MmuCloneAddressSpaceForProcess
+// Description:  Creates the address space of Process as a copy of the address
+//               space of Parent. The user pages are not copied, they are shared
+//               read-only and each process gets its own copy of a page the
+//               first time it writes it.
+// Returns:      STATUS
+// Parameter:    INOUT PPROCESS Parent
+// Parameter:    INOUT PPROCESS Process - its HeaderInfo must already be set.
+//******************************************************************************
+STATUS
+MmuCloneAddressSpaceForProcess(
+    INOUT   PPROCESS                Parent,
+    INOUT   PPROCESS                Process
+    );
+
 //******************************************************************************
 // Function:     MmuInitVirtualSpaceForSystemProcess
 // Description:  Initializes the address space for the system process.
@@ -364,8 +381,11 @@ MmuChangeProcessSpace(
 // Parameter:    IN DWORD StackSize
 // Parameter:    IN BOOLEAN ProtectStack - if TRUE STACK_GUARD_SIZE of additional
 //               bytes will be reserved in the virtual space at the end of the
-//               stack to detect stack overflows.
-// Parameter:    IN BOOLEAN LazyMap
+//               stack to detect stack overflows. Kernel stacks of
+//               STACK_DEFAULT_SIZE are taken from the stack cache of the CPU
+//               if available and must always be protected.
+// Parameter:    IN BOOLEAN LazyMap - if TRUE only the top page is mapped, the
+//               rest of the pages are mapped as the stack grows.
 // Parameter:    IN_OPT PPROCESS Process - if non-NULL a user-mode stack will
 //               be allocated.
 //******************************************************************************
@@ -380,14 +400,19 @@ MmuAllocStack(
 
 //******************************************************************************
 // Function:     MmuFreeStack
-// Description:  Frees a previously allocated stack with MmuAllocStack.
+// Description:  Frees a previously allocated stack with MmuAllocStack. Kernel
+//               stacks of STACK_DEFAULT_SIZE are kept in the stack cache of
+//               the CPU while it is not full.
 // Returns:      void
-// Parameter:    IN PVOID Stack
+// Parameter:    IN PVOID Stack - for kernel stacks the address returned by
+//               MmuAllocStack.
+// Parameter:    IN DWORD StackSize
 // Parameter:    IN_OPT PPROCESS Process
 //******************************************************************************
 void
 MmuFreeStack(
     IN          PVOID               Stack,
+    IN          DWORD               StackSize,
     IN_OPT      PPROCESS            Process
     );
 
@@ -409,10 +434,46 @@ MmuIsBufferValid(
     IN          PPROCESS            Process
     );
 
+//******************************************************************************
+// Function:     MmuPinUserBuffer
+// Description:  Brings the pages of the user buffer into memory and keeps their
+//               frames from being released until the buffer is unpinned. The
+//               returned MDL describes the frames and may be handed to a
+//               device for DMA (see IoReadDeviceWithMdl).
+// Returns:      STATUS
+// Parameter:    IN PVOID UserAddress
+// Parameter:    IN QWORD Size
+// Parameter:    IN PAGE_RIGHTS PageRights - PAGE_RIGHTS_WRITE if the device
+//               will write to the buffer.
+// Parameter:    IN PPROCESS Process - must be the current process.
+// Parameter:    OUT_PTR PMDL* Mdl - must be released with MmuUnpinUserBuffer.
+//******************************************************************************
+STATUS
+MmuPinUserBuffer(
+    IN          PVOID               UserAddress,
+    IN          QWORD               Size,
+    IN          PAGE_RIGHTS         PageRights,
+    IN          PPROCESS            Process,
+    OUT_PTR     PMDL*               Mdl
+    );
+
+void
+MmuUnpinUserBuffer(
+    INOUT       PMDL                Mdl
+    );
+
 //******************************************************************************
 // Function:     MmuGetSystemVirtualAddressForUserBuffer
 // Description:  Maps the physical memory which backs UserAddress from the
-//               Process process into kernel space with PageRights rights
+//               Process process into kernel space with PageRights rights.
+//               Small buffers of the current process are instead copied into
+//               the bounce window of the CPU. The kernel address is then a
+//               snapshot taken at this call and not an alias of the buffer:
+//               user writes made before it is freed are not seen through it
+//               and writes made through it reach the user buffer only when it
+//               is freed, and only if PageRights includes PAGE_RIGHTS_WRITE.
+//               Callers must not access the user buffer directly while the
+//               kernel address is in use.
 // Returns:      STATUS
 // Parameter:    IN PVOID UserAddress
 // Parameter:    IN QWORD Size
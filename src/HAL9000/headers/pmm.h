@@ -47,6 +47,58 @@ PmmReleaseMemory(
     IN          DWORD                   NoOfFrames
     );
 
+//******************************************************************************
+// Function:     PmmInitNumaTopology
+// Description:  Assigns the physical memory and the CPUs to the NUMA nodes
+//               described by the SRAT, must be called after the ACPI interface
+//               is initialized. Frames reserved without a minimum address are
+//               then taken from the node of the requesting CPU if possible.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+_No_competing_thread_
+void
+PmmInitNumaTopology(
+    void
+    );
+
+//******************************************************************************
+// Function:     PmmInitFrameReferences
+// Description:  Allocates the reference counters of the physical frames, must
+//               be called after the VMM is initialized.
+// Returns:      STATUS
+// Parameter:    void
+//******************************************************************************
+_No_competing_thread_
+STATUS
+PmmInitFrameReferences(
+    void
+    );
+
+// Adds an owner to a reserved frame, each owner must call PmmDereferenceFrame
+// before releasing it
+void
+PmmReferenceFrame(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    );
+
+//******************************************************************************
+// Function:     PmmDereferenceFrame
+// Description:  Removes an owner of the frame.
+// Returns:      BOOLEAN - TRUE if the caller was the last owner and it must
+//               release the frame.
+// Parameter:    IN PHYSICAL_ADDRESS PhysicalAddr
+//******************************************************************************
+BOOLEAN
+PmmDereferenceFrame(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    );
+
+DWORD
+PmmGetFrameReferences(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    );
+
 //******************************************************************************
 // Function:     PmmGetTotalSystemMemory
 // Description:
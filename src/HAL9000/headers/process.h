@@ -24,6 +24,26 @@ ProcessCreate(
     OUT_PTR     PPROCESS*   Process
     );
 
+//******************************************************************************
+// Function:     ProcessClone
+// Description:  Creates a new process running the same executable as Parent,
+//               its address space is a copy-on-write copy of the address space
+//               of Parent. The main thread of the new process starts from the
+//               entry point of the executable with Arguments (may be NULL).
+// Returns:      STATUS
+// Parameter:    IN PPROCESS Parent - cannot be the system process.
+// Parameter:    IN_OPT_Z char * Arguments
+// Parameter:    OUT_PTR PPROCESS * Process
+// NOTE:         The handle received in Process must be closed with
+//               ProcessCloseHandle, the same as for ProcessCreate.
+//******************************************************************************
+STATUS
+ProcessClone(
+    IN          PPROCESS    Parent,
+    IN_OPT_Z    char*       Arguments,
+    OUT_PTR     PPROCESS*   Process
+    );
+
 //******************************************************************************
 // Function:     ProcessWaitForTermination
 // Description:  Blocks until the process received as a parameter terminates
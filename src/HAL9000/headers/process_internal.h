@@ -5,6 +5,7 @@
 #include "process.h"
 #include "synch.h"
 #include "ex_event.h"
+#include "handle_table.h"
 
 #define PROCESS_MAX_PHYSICAL_FRAMES     16
 #define PROCESS_MAX_OPEN_FILES          16
@@ -56,8 +57,19 @@ typedef struct _PROCESS
     // Pointer to the process' NT header information
     struct _PE_NT_HEADER_INFO*      HeaderInfo;
 
+    // The cached image of the executable, its pages are mapped in the process
+    // when they are first accessed
+    struct _IMAGE_CACHE_ENTRY*      Image;
+
     // VaSpace used only for UM virtual memory allocations
     struct _VMM_RESERVATION_SPACE*  VaSpace;
+
+    // Translates the UM handles of the process, each object in the table is
+    // referenced by it
+    HANDLE_TABLE                    HandleTable;
+
+    // Set once by SyscallRingSetup, NULL if the process has no submission ring
+    struct _SYSCALL_RING_CONTEXT*   SyscallRing;
 } PROCESS, *PPROCESS;
 
 //******************************************************************************
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "syscall_defs.h"
+#include "process.h"
+
+typedef struct _SOCKET* PSOCKET;
+
+//******************************************************************************
+// Function:     SocketCreate
+// Description:  Creates an unbound socket. The caller owns a reference to it
+//               and must release it with SocketDereference.
+// Returns:      STATUS
+// Parameter:    IN SOCKET_TYPE Type
+// Parameter:    OUT_PTR PSOCKET* Socket
+//******************************************************************************
+STATUS
+SocketCreate(
+    IN          SOCKET_TYPE             Type,
+    OUT_PTR     PSOCKET*                Socket
+    );
+
+void
+SocketReference(
+    INOUT       PSOCKET                 Socket
+    );
+
+// When the last reference is released the endpoint, listener or connection
+// of the socket is closed
+void
+SocketDereference(
+    INOUT       PSOCKET                 Socket
+    );
+
+STATUS
+SocketBind(
+    INOUT       PSOCKET                 Socket,
+    IN          WORD                    Port
+    );
+
+STATUS
+SocketListen(
+    INOUT       PSOCKET                 Socket,
+    IN          DWORD                   Backlog
+    );
+
+// The accepted socket is returned referenced
+STATUS
+SocketAccept(
+    INOUT       PSOCKET                 Socket,
+    OUT_PTR     PSOCKET*                Connection
+    );
+
+STATUS
+SocketConnect(
+    INOUT       PSOCKET                 Socket,
+    IN          PSOCKET_ADDRESS         Address
+    );
+
+STATUS
+SocketSend(
+    INOUT       PSOCKET                 Socket,
+    IN_READS_BYTES(Size)
+                PVOID                   Buffer,
+    IN          DWORD                   Size,
+    IN_OPT      PSOCKET_ADDRESS         Destination,
+    OUT         DWORD*                  BytesSent
+    );
+
+STATUS
+SocketReceive(
+    INOUT       PSOCKET                 Socket,
+    OUT_WRITES_BYTES(Size)
+                PVOID                   Buffer,
+    IN          DWORD                   Size,
+    OUT_OPT     PSOCKET_ADDRESS         Source,
+    OUT         DWORD*                  BytesReceived
+    );
+
+//******************************************************************************
+// Function:     SocketSendBatch
+// Description:  Sends the datagrams through the endpoint of a datagram socket,
+//               the frames are handed to the network devices in batches.
+// Returns:      STATUS - the error of the first datagram which could not be
+//               sent, only if no datagram was sent.
+// Parameter:    INOUT PSOCKET Socket
+// Parameter:    INOUT_UPDATES(NumberOfDatagrams) PSOCKET_DATAGRAM Datagrams
+// Parameter:    IN DWORD NumberOfDatagrams
+// Parameter:    OUT DWORD* DatagramsSent
+//******************************************************************************
+STATUS
+SocketSendBatch(
+    INOUT       PSOCKET                 Socket,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsSent
+    );
+
+//******************************************************************************
+// Function:     SocketReceiveBatch
+// Description:  Waits for a datagram, then receives as many of the datagrams
+//               already queued as fit in the array.
+// Returns:      STATUS
+// Parameter:    INOUT PSOCKET Socket
+// Parameter:    INOUT_UPDATES(NumberOfDatagrams) PSOCKET_DATAGRAM Datagrams
+// Parameter:    IN DWORD NumberOfDatagrams
+// Parameter:    OUT DWORD* DatagramsReceived
+//******************************************************************************
+STATUS
+SocketReceiveBatch(
+    INOUT       PSOCKET                 Socket,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsReceived
+    );
+
+// Returns the SOCKET_POLL_* flags, it never waits
+DWORD
+SocketPoll(
+    IN          PSOCKET                 Socket
+    );
+
+//******************************************************************************
+// Function:     SocketPollHandles
+// Description:  Checks the sockets of the process until at least one of them
+//               is ready or the timeout expires, yielding the CPU in between.
+//               An invalid handle is reported as SOCKET_POLL_ERROR.
+// Returns:      STATUS - STATUS_TIMEOUT if no socket became ready.
+// Parameter:    IN PPROCESS Process
+// Parameter:    INOUT_UPDATES(NumberOfEntries) PSOCKET_POLL_ENTRY Entries
+// Parameter:    IN DWORD NumberOfEntries
+// Parameter:    IN QWORD TimeoutUs - SOCKET_POLL_INFINITE never expires.
+// Parameter:    OUT DWORD* ReadyEntries
+//******************************************************************************
+STATUS
+SocketPollHandles(
+    IN          PPROCESS                Process,
+    INOUT_UPDATES(NumberOfEntries)
+                PSOCKET_POLL_ENTRY      Entries,
+    IN          DWORD                   NumberOfEntries,
+    IN          QWORD                   TimeoutUs,
+    OUT         DWORD*                  ReadyEntries
+    );
+
+//******************************************************************************
+// Function:     SocketInsertHandle
+// Description:  Stores the socket in the handle table of the process, the
+//               table takes over the reference of the caller.
+// Returns:      STATUS - STATUS_LIMIT_REACHED if the table is full.
+// Parameter:    INOUT PPROCESS Process
+// Parameter:    IN PSOCKET Socket
+// Parameter:    OUT UM_HANDLE* Handle
+//******************************************************************************
+STATUS
+SocketInsertHandle(
+    INOUT       PPROCESS                Process,
+    IN          PSOCKET                 Socket,
+    OUT         UM_HANDLE*              Handle
+    );
+
+// The socket is returned referenced, NULL if the handle is not valid
+PTR_SUCCESS
+PSOCKET
+SocketReferenceByHandle(
+    IN          PPROCESS                Process,
+    IN          UM_HANDLE               Handle
+    );
+
+STATUS
+SocketCloseHandle(
+    INOUT       PPROCESS                Process,
+    IN          UM_HANDLE               Handle
+    );
@@ -1,5 +1,25 @@
 #pragma once
 
+#include "syscall_no.h"
+
+#define SYSCALL_LATENCY_BUCKETS                 12
+
+// Latencies below this number of cycles fall in the first bucket, each of the
+// next buckets covers twice as many cycles as the previous one and the last
+// bucket holds everything above
+#define SYSCALL_LATENCY_FIRST_BUCKET_CYCLES     256
+
+typedef struct _SYSCALL_STATISTICS
+{
+    QWORD               Calls;
+
+    // calls which passed their arguments in registers
+    QWORD               FastCalls;
+
+    QWORD               TotalCycles;
+    QWORD               LatencyBuckets[SYSCALL_LATENCY_BUCKETS];
+} SYSCALL_STATISTICS, *PSYSCALL_STATISTICS;
+
 void
 SyscallPreinitSystem(
     void
@@ -19,3 +39,31 @@ void
 SyscallCpuInit(
     void
     );
+
+//******************************************************************************
+// Function:     SyscallDispatch
+// Description:  Calls the handler of the system call with the arguments
+//               received from the current thread, either in registers, on its
+//               shadow stack or through its submission ring.
+// Returns:      STATUS - STATUS_UNSUPPORTED if the system call is not
+//               implemented.
+// Parameter:    IN SYSCALL_ID SyscallId
+// Parameter:    IN PQWORD Arguments - SYSCALL_MAX_REGISTER_ARGUMENTS values,
+//               the shadow stack may hold more.
+//******************************************************************************
+STATUS
+SyscallDispatch(
+    IN          SYSCALL_ID              SyscallId,
+    IN          PQWORD                  Arguments
+    );
+
+void
+SyscallGetStatistics(
+    OUT_WRITES(SyscallIdReserved)
+            PSYSCALL_STATISTICS     Statistics
+    );
+
+void
+SyscallResetStatistics(
+    void
+    );
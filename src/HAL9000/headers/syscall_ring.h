@@ -0,0 +1,54 @@
+#pragma once
+
+#include "syscall_defs.h"
+#include "process.h"
+
+//******************************************************************************
+// Function:     SyscallRingCreateForProcess
+// Description:  Allocates the submission and completion rings of the process
+//               and maps them in its address space. With
+//               SYSCALL_RING_SETUP_KERNEL_POLLING a kernel thread is started
+//               in the process to consume the submissions.
+// Returns:      STATUS - STATUS_ALREADY_INITIALIZED if the process already has
+//               a ring.
+// Parameter:    INOUT PPROCESS Process
+// Parameter:    IN DWORD Flags - SYSCALL_RING_SETUP_* flags.
+// Parameter:    OUT_PTR PVOID* UserRing - address of the SYSCALL_RING in the
+//               address space of the process.
+//******************************************************************************
+STATUS
+SyscallRingCreateForProcess(
+    INOUT       PPROCESS                Process,
+    IN          DWORD                   Flags,
+    OUT_PTR     PVOID*                  UserRing
+    );
+
+//******************************************************************************
+// Function:     SyscallRingSubmit
+// Description:  Dispatches up to ToSubmit of the published submissions, each
+//               one in order, and posts their completions. When the ring is
+//               polled by a kernel thread the submissions are left to it and
+//               the thread is restarted if it stopped. Then waits, yielding
+//               the CPU, until MinComplete completions are ready to be reaped
+//               or until no submission is left pending.
+// Returns:      STATUS - STATUS_NOT_INITIALIZED if the process has no
+//               ring.
+// Parameter:    INOUT PPROCESS Process
+// Parameter:    IN DWORD ToSubmit
+// Parameter:    IN DWORD MinComplete
+// Parameter:    OUT DWORD* Submitted - number of submissions dispatched by
+//               this call.
+//******************************************************************************
+STATUS
+SyscallRingSubmit(
+    INOUT       PPROCESS                Process,
+    IN          DWORD                   ToSubmit,
+    IN          DWORD                   MinComplete,
+    OUT         DWORD*                  Submitted
+    );
+
+// Called when the process is destroyed, after its address space was destroyed
+void
+SyscallRingDestroyForProcess(
+    INOUT       PPROCESS                Process
+    );
@@ -0,0 +1,13 @@
+#pragma once
+
+//******************************************************************************
+// Function:     TestCreationPerformance
+// Description:  Measures how long it takes to create a thread or a process,
+//               wait for it to terminate and close its handle.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+TestCreationPerformance(
+    void
+    );
@@ -1,5 +1,20 @@
 #pragma once
 
+BOOLEAN
+TestDmaPinnedRead(
+    void
+    );
+
+BOOLEAN
+TestDmaCompletionRoutine(
+    void
+    );
+
+BOOLEAN
+TestDmaDeviceControl(
+    void
+    );
+
 void
 TestDmaPerformance(
     void
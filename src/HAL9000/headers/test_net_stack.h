@@ -2,11 +2,25 @@
 
 #include "network.h"
 
+//******************************************************************************
+// Function:     TestNetwork
+// Description:  Receives or sends frames on all the network devices until the
+//               space key is pressed.
+// Returns:      BOOLEAN
+// Parameter:    IN BOOLEAN Transmit
+// Parameter:    IN BOOLEAN ResendRequets - the received frames are broadcast
+// Parameter:    IN BOOLEAN FastPath - the received frames are lent by the
+//               device with NetReceiveFrameByReference instead of being
+//               copied by NetReceiveFrame, the transmitted frames are handed
+//               to the device in batches with NetSendFrames instead of one
+//               by one with NetSendFrame
+//******************************************************************************
 _No_competing_thread_
 BOOLEAN
 TestNetwork(
         IN      BOOLEAN         Transmit,
     _When_(Transmit, _Reserved_)
     _When_(!Transmit, IN)
-        IN      BOOLEAN         ResendRequets
+        IN      BOOLEAN         ResendRequets,
+        IN      BOOLEAN         FastPath
     );
\ No newline at end of file
@@ -6,6 +6,13 @@ typedef struct _PROCESS_TEST
     char*                       ProcessName;
     char*                       ProcessCommandLine;
     DWORD                       NumberOfProcesses;
+
+    // If set all the processes except the first one are created by cloning it
+    BOOLEAN                     CloneProcesses;
+
+    // If set a syscall ring is set up for the first process before it is
+    // cloned, the ring must remain shared only with the kernel
+    BOOLEAN                     SetupSyscallRing;
 } PROCESS_TEST, *PPROCESS_TEST;
 
 extern const PROCESS_TEST PROCESS_TESTS[];
@@ -31,6 +31,9 @@ typedef DWORD           THREAD_FLAGS;
 #define THREAD_FLAG_FORCE_TERMINATE_PENDING         0x1
 #define THREAD_FLAG_FORCE_TERMINATED                0x2
 
+// the affinity bit of the CPU with the given APIC ID
+#define THREAD_AFFINITY_CPU(ApicId)                 (((THREAD_AFFINITY)1) << ((ApicId) % BITS_FOR_STRUCTURE(THREAD_AFFINITY)))
+
 typedef struct _THREAD
 {
     REF_COUNT               RefCnt;
@@ -89,6 +92,30 @@ typedef struct _THREAD
     // MUST be non-NULL for all threads which belong to user-mode processes
     PVOID                   UserStack;
 
+    // the bounce window of a CPU through which a user buffer is accessed, NULL
+    // if the thread does not hold any (see MmuGetSystemVirtualAddressForUserBuffer)
+    struct _MMU_BOUNCE_WINDOW*  BounceWindow;
+
+    // allocated together with the thread, the FPU state is saved here when
+    // the thread is de-scheduled and loaded back only on the next #NM
+    PXSAVE_AREA             FpuArea;
+
+    // number of interrupt and exception handlers the thread is running, an
+    // #NM taken by a handler must not load the FPU state of the thread
+    DWORD                   InterruptNesting;
+
+    // the CPU on which FpuArea was last loaded, if it is still the FpuOwner of
+    // that CPU the thread resumes there without reloading its FPU state
+    struct _PCPU*           FpuCpu;
+
+    // the thread is scheduled only on the CPUs whose bit is set, the scheduler
+    // reads it with the ready list lock held
+    THREAD_AFFINITY         Affinity;
+
+    // the CPU on which the thread last ran, a CPU prefers to schedule the
+    // threads which left their data in its caches
+    struct _PCPU*           LastCpu;
+
     struct _PROCESS*        Process;
 } THREAD, *PTHREAD;
 
@@ -138,7 +165,9 @@ ThreadSystemInitIdleForCurrentCPU(
 // Function:     ThreadCreateEx
 // Description:  Same as ThreadCreate except it also takes an additional
 //               parameter, the process to which the thread should belong. This
-//               function must be called for creating user-mode threads.
+//               function must be called for creating user-mode threads. The
+//               thread will run only on the CPUs set in Affinity, at least one
+//               of them must be active.
 // Returns:      STATUS
 // Parameter:    IN_Z char * Name
 // Parameter:    IN THREAD_PRIORITY Priority
@@ -146,9 +175,35 @@ ThreadSystemInitIdleForCurrentCPU(
 // Parameter:    IN_OPT PVOID Context
 // Parameter:    OUT_PTR PTHREAD * Thread
 // Parameter:    INOUT struct _PROCESS * Process
+// Parameter:    IN THREAD_AFFINITY Affinity
 //******************************************************************************
 STATUS
 ThreadCreateEx(
+    IN_Z        char*               Name,
+    IN          THREAD_PRIORITY     Priority,
+    IN          PFUNC_ThreadStart   Function,
+    IN_OPT      PVOID               Context,
+    OUT_PTR     PTHREAD*            Thread,
+    INOUT       struct _PROCESS*    Process,
+    IN          THREAD_AFFINITY     Affinity
+    );
+
+//******************************************************************************
+// Function:     ThreadCreateKernelThreadInProcess
+// Description:  Creates a thread which runs Function in kernel mode even if
+//               Process is a user-mode process. The thread uses the address
+//               space of the process, so it can access its memory and its
+//               handles the same way a system call does.
+// Returns:      STATUS
+// Parameter:    IN_Z char * Name
+// Parameter:    IN THREAD_PRIORITY Priority
+// Parameter:    IN PFUNC_ThreadStart Function
+// Parameter:    IN_OPT PVOID Context
+// Parameter:    OUT_PTR PTHREAD * Thread
+// Parameter:    INOUT struct _PROCESS * Process
+//******************************************************************************
+STATUS
+ThreadCreateKernelThreadInProcess(
     IN_Z        char*               Name,
     IN          THREAD_PRIORITY     Priority,
     IN          PFUNC_ThreadStart   Function,
@@ -157,6 +212,25 @@ ThreadCreateEx(
     INOUT       struct _PROCESS*    Process
     );
 
+//******************************************************************************
+// Function:     ThreadSetAffinity
+// Description:  Restricts the CPUs on which Thread may run. If the calling
+//               thread excludes the CPU it is running on it yields and
+//               continues on one of the allowed CPUs.
+// NOTE:         No IPI is sent: if Thread is running on another CPU which is
+//               excluded it continues to run there until its time slice
+//               expires on a clock tick or it blocks
+//               or yields, only then it moves to one of the allowed CPUs.
+// Returns:      STATUS
+// Parameter:    INOUT PTHREAD Thread
+// Parameter:    IN THREAD_AFFINITY Affinity
+//******************************************************************************
+STATUS
+ThreadSetAffinity(
+    INOUT       PTHREAD             Thread,
+    IN          THREAD_AFFINITY     Affinity
+    );
+
 //******************************************************************************
 // Function:     ThreadTick
 // Description:  Called by the timer interrupt at each timer tick. It keeps
@@ -208,6 +282,48 @@ ThreadYieldOnInterrupt(
     void
     );
 
+//******************************************************************************
+// Function:     ThreadHandleDeviceNotAvailable
+// Description:  Called on #NM, i.e. when the running thread first uses the FPU
+//               after it was scheduled on a CPU where the FPU registers do not
+//               hold its state. Loads the state of the thread and makes the
+//               thread the FPU owner of the CPU. If the FPU is used by an
+//               interrupt handler the registers are only made available.
+//               Runs with CR0.TS set, so it calls no function which may be
+//               compiled to SSE instructions.
+// Returns:      BOOLEAN - TRUE if the exception was handled
+// Parameter:    void
+//******************************************************************************
+BOOLEAN
+ThreadHandleDeviceNotAvailable(
+    void
+    );
+
+//******************************************************************************
+// Function:     ThreadEnterInterrupt
+// Description:  Called when an interrupt or exception other than #NM is taken,
+//               until the matching ThreadLeaveInterrupt the FPU registers are
+//               not loaded with the state of the running thread.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+ThreadEnterInterrupt(
+    void
+    );
+
+//******************************************************************************
+// Function:     ThreadLeaveInterrupt
+// Description:  Called before returning from an interrupt or exception, sets
+//               CR0.TS unless the FPU registers hold the state of the thread.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+ThreadLeaveInterrupt(
+    void
+    );
+
 //******************************************************************************
 // Function:     ThreadTerminate
 // Description:  Signals a thread to terminate.
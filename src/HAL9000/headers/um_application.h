@@ -3,10 +3,12 @@
 typedef struct _PROCESS* PPROCESS;
 typedef struct _PE_NT_HEADER_INFO* PPE_NT_HEADER_INFO;
 
+// Retrieves the image of the executable from the image cache and copies its
+// NT header information in the process
 STATUS
 UmApplicationRetrieveHeader(
     IN_Z        char*                   Path,
-    OUT         PPE_NT_HEADER_INFO      NtHeaderInfo
+    INOUT       PPROCESS                Process
     );
 
 STATUS
@@ -106,6 +106,7 @@ VmReservationSpaceAllocRegion(
     IN                      PAGE_RIGHTS             Rights,
     IN                      BOOLEAN                 Uncacheable,
     IN_OPT                  PFILE_OBJECT            FileObject,
+    IN                      BOOLEAN                 Shared,
     OUT                     PVOID*                  MappedAddress,
     OUT                     QWORD*                  MappedSize
     );
@@ -129,3 +130,32 @@ VmReservationReturnRightsForAddress(
     IN                      QWORD                   Size,
     OUT                     PAGE_RIGHTS*            Rights
     );
+
+//******************************************************************************
+// Function:     VmReservationIsAddressShared
+// Description:  Checks if Address belongs to a reservation whose pages map
+//               frames described by a MDL (see VmReservationSpaceAllocRegion).
+// Returns:      BOOLEAN
+// Parameter:    IN PVMM_RESERVATION_SPACE ReservationSpace
+// Parameter:    IN PVOID Address
+//******************************************************************************
+BOOLEAN
+VmReservationIsAddressShared(
+    IN                      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN                      PVOID                   Address
+    );
+
+//******************************************************************************
+// Function:     VmReservationSpaceClone
+// Description:  Copies the reservations and their commit bitmaps into a newly
+//               created reservation space with the same metadata size. The
+//               shared reservations are not copied.
+// Returns:      STATUS - STATUS_UNSUPPORTED if a reservation is file backed.
+// Parameter:    IN PVMM_RESERVATION_SPACE Source
+// Parameter:    INOUT PVMM_RESERVATION_SPACE Destination
+//******************************************************************************
+STATUS
+VmReservationSpaceClone(
+    IN                      PVMM_RESERVATION_SPACE  Source,
+    INOUT                   PVMM_RESERVATION_SPACE  Destination
+    );
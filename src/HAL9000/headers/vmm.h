@@ -287,6 +287,54 @@ VmmDestroyVirtualAddressSpace(
             PVMM_RESERVATION_SPACE          ReservationSpace
     );
 
+//******************************************************************************
+// Function:     VmmCloneVirtualAddressSpace
+// Description:  Copies the reservations of Source into Destination, which must
+//               be a VAS freshly created by VmmCreateVirtualAddressSpace with
+//               the same metadata size.
+// Returns:      STATUS
+// Parameter:    IN PVMM_RESERVATION_SPACE Source
+// Parameter:    INOUT PVMM_RESERVATION_SPACE Destination
+//******************************************************************************
+STATUS
+VmmCloneVirtualAddressSpace(
+    IN      PVMM_RESERVATION_SPACE          Source,
+    INOUT   PVMM_RESERVATION_SPACE          Destination
+    );
+
+//******************************************************************************
+// Function:     VmmCloneUserPagingTables
+// Description:  Maps each page present in the user half of the Source paging
+//               tables at the same address in the Destination tables. The
+//               frames are shared copy-on-write: they become read-only in both
+//               tables and gain a reference for the Destination mapping. The
+//               pages of the shared reservations of SourceVaSpace are not
+//               mapped in Destination. The caller must hold the Source paging
+//               lock and flush its TLB.
+// Returns:      void
+// Parameter:    INOUT PPAGING_DATA Source
+// Parameter:    IN PVMM_RESERVATION_SPACE SourceVaSpace
+// Parameter:    INOUT PPAGING_DATA Destination
+//******************************************************************************
+void
+VmmCloneUserPagingTables(
+    INOUT   PPAGING_DATA                    Source,
+    IN      PVMM_RESERVATION_SPACE          SourceVaSpace,
+    INOUT   PPAGING_DATA                    Destination
+    );
+
+//******************************************************************************
+// Function:     VmmReleaseUserPages
+// Description:  Unmaps each page present in the user half of the paging
+//               tables and releases the reference to its frame.
+// Returns:      void
+// Parameter:    INOUT PPAGING_DATA PagingData - must not be active on any CPU.
+//******************************************************************************
+void
+VmmReleaseUserPages(
+    INOUT   PPAGING_DATA                    PagingData
+    );
+
 //******************************************************************************
 // Function:     VmmIsBufferValid
 // Description:  Checks if the buffer described by Buffer and BufferSize is
@@ -40,6 +40,18 @@ typedef struct _ACPI_MCFG_ENTRY
     LIST_ENTRY                  ListEntry;
 } ACPI_MCFG_ENTRY, *PACPI_MCFG_ENTRY;
 
+typedef struct _ACPI_CPU_AFFINITY_ENTRY
+{
+    ACPI_SRAT_CPU_AFFINITY      Data;
+    LIST_ENTRY                  ListEntry;
+} ACPI_CPU_AFFINITY_ENTRY, *PACPI_CPU_AFFINITY_ENTRY;
+
+typedef struct _ACPI_MEM_AFFINITY_ENTRY
+{
+    ACPI_SRAT_MEM_AFFINITY      Data;
+    LIST_ENTRY                  ListEntry;
+} ACPI_MEM_AFFINITY_ENTRY, *PACPI_MEM_AFFINITY_ENTRY;
+
 typedef struct _ACPI_PRT_ENTRY
 {
     ACPI_PCI_ROUTING_TABLE      Data;
@@ -54,6 +66,8 @@ typedef struct _ACPI_INTERFACE_DATA
     LIST_ENTRY                  IoApicList;
     LIST_ENTRY                  IntOverrideList;
     LIST_ENTRY                  McfgList;
+    LIST_ENTRY                  CpuAffinityList;
+    LIST_ENTRY                  MemAffinityList;
     LIST_ENTRY                  PrtList;
 } ACPI_INTERFACE_DATA, *PACPI_INTERFACE_DATA;
 
@@ -71,6 +85,12 @@ _AcpiInterfaceParseMcfg(
     void
     );
 
+static
+STATUS
+_AcpiInterfaceParseSrat(
+    void
+    );
+
 static
 STATUS
 _AcpiInterfaceParsePrts(
@@ -104,6 +124,8 @@ AcpiInterfacePreinit(
     InitializeListHead(&m_acpiData.IoApicList);
     InitializeListHead(&m_acpiData.IntOverrideList);
     InitializeListHead(&m_acpiData.McfgList);
+    InitializeListHead(&m_acpiData.CpuAffinityList);
+    InitializeListHead(&m_acpiData.MemAffinityList);
     InitializeListHead(&m_acpiData.PrtList);
 }
 
@@ -153,6 +175,23 @@ AcpiInterfaceInit(
         LOGL("Successfully parsed MCFG\n");
     }
 
+    status = _AcpiInterfaceParseSrat();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_AcpiInterfaceParseSrat", status);
+        if (status != STATUS_DEVICE_DOES_NOT_EXIST)
+        {
+            return status;
+        }
+
+        // without a SRAT the whole system is a single NUMA node
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        LOGL("Successfully parsed SRAT\n");
+    }
+
 
     LOG_FUNC_END;
 
@@ -372,6 +411,72 @@ AcpiRetrieveNextMcfgEntry(
     return STATUS_SUCCESS;
 }
 
+STATUS
+AcpiRetrieveNextCpuAffinity(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SRAT_CPU_AFFINITY**    AcpiEntry
+    )
+{
+    PACPI_CPU_AFFINITY_ENTRY pEntry;
+
+    static PLIST_ENTRY __pCurEntry = NULL;
+
+    if (NULL == AcpiEntry)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (RestartSearch)
+    {
+        __pCurEntry = m_acpiData.CpuAffinityList.Flink;
+    }
+
+    if (__pCurEntry == &m_acpiData.CpuAffinityList)
+    {
+        return STATUS_NO_MORE_OBJECTS;
+    }
+
+    pEntry = CONTAINING_RECORD(__pCurEntry, ACPI_CPU_AFFINITY_ENTRY, ListEntry);
+    __pCurEntry = __pCurEntry->Flink;
+
+    *AcpiEntry = &pEntry->Data;
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+AcpiRetrieveNextMemoryAffinity(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SRAT_MEM_AFFINITY**    AcpiEntry
+    )
+{
+    PACPI_MEM_AFFINITY_ENTRY pEntry;
+
+    static PLIST_ENTRY __pCurEntry = NULL;
+
+    if (NULL == AcpiEntry)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (RestartSearch)
+    {
+        __pCurEntry = m_acpiData.MemAffinityList.Flink;
+    }
+
+    if (__pCurEntry == &m_acpiData.MemAffinityList)
+    {
+        return STATUS_NO_MORE_OBJECTS;
+    }
+
+    pEntry = CONTAINING_RECORD(__pCurEntry, ACPI_MEM_AFFINITY_ENTRY, ListEntry);
+    __pCurEntry = __pCurEntry->Flink;
+
+    *AcpiEntry = &pEntry->Data;
+
+    return STATUS_SUCCESS;
+}
+
 STATUS
 AcpiRetrieveNextPrtEntry(
     IN      BOOLEAN                     RestartSearch,
@@ -559,6 +664,88 @@ _AcpiInterfaceParseMcfg(
     return STATUS_SUCCESS;
 }
 
+static
+STATUS
+_AcpiInterfaceParseSrat(
+    void
+    )
+{
+    ACPI_TABLE_HEADER* table;
+    ACPI_STATUS acpiStatus;
+    DWORD actualTableLength;
+    DWORD offsetInTable;
+    ACPI_SUBTABLE_HEADER* pHeader;
+    PBYTE pData;
+
+    acpiStatus = AcpiGetTable(ACPI_SIG_SRAT, 1, &table);
+    if (AE_OK != acpiStatus)
+    {
+        LOG_FUNC_ERROR("AcpiGetTable", acpiStatus);
+        return acpiStatus == AE_NOT_FOUND ? STATUS_DEVICE_DOES_NOT_EXIST : STATUS_UNSUCCESSFUL;
+    }
+
+    offsetInTable = 0;
+    actualTableLength = table->Length - sizeof(ACPI_TABLE_SRAT);
+    pData = (BYTE*)table + sizeof(ACPI_TABLE_SRAT);
+    while (offsetInTable < actualTableLength)
+    {
+        pHeader = (ACPI_SUBTABLE_HEADER*)&(pData[offsetInTable]);
+        if (0 == pHeader->Length)
+        {
+            LOG_ERROR("SRAT entry at offset 0x%x has length 0\n", offsetInTable);
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        if (ACPI_SRAT_TYPE_CPU_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_CPU_AFFINITY* pCpuAffinity = (ACPI_SRAT_CPU_AFFINITY*)pHeader;
+            if (pCpuAffinity->Flags & ACPI_SRAT_CPU_USE_AFFINITY)
+            {
+                PACPI_CPU_AFFINITY_ENTRY pEntry = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(ACPI_CPU_AFFINITY_ENTRY), HEAP_ACPIIF_TAG, 0);
+                if (NULL == pEntry)
+                {
+                    LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", sizeof(ACPI_CPU_AFFINITY_ENTRY));
+                    return STATUS_HEAP_NO_MORE_MEMORY;
+                }
+
+                LOG("\nCPU affinity\n");
+                LOG("APIC ID: 0x%x\n", pCpuAffinity->ApicId);
+                LOG("Proximity domain: 0x%x\n", pCpuAffinity->ProximityDomainLo);
+
+                memcpy(&pEntry->Data, pCpuAffinity, sizeof(ACPI_SRAT_CPU_AFFINITY));
+
+                InsertTailList(&m_acpiData.CpuAffinityList, &pEntry->ListEntry);
+            }
+        }
+        else if (ACPI_SRAT_TYPE_MEMORY_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_MEM_AFFINITY* pMemAffinity = (ACPI_SRAT_MEM_AFFINITY*)pHeader;
+            if (pMemAffinity->Flags & ACPI_SRAT_MEM_ENABLED)
+            {
+                PACPI_MEM_AFFINITY_ENTRY pEntry = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(ACPI_MEM_AFFINITY_ENTRY), HEAP_ACPIIF_TAG, 0);
+                if (NULL == pEntry)
+                {
+                    LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", sizeof(ACPI_MEM_AFFINITY_ENTRY));
+                    return STATUS_HEAP_NO_MORE_MEMORY;
+                }
+
+                LOG("\nMemory affinity\n");
+                LOG("Base address: 0x%X\n", pMemAffinity->BaseAddress);
+                LOG("Length: 0x%X\n", pMemAffinity->Length);
+                LOG("Proximity domain: 0x%x\n", pMemAffinity->ProximityDomain);
+
+                memcpy(&pEntry->Data, pMemAffinity, sizeof(ACPI_SRAT_MEM_AFFINITY));
+
+                InsertTailList(&m_acpiData.MemAffinityList, &pEntry->ListEntry);
+            }
+        }
+
+        offsetInTable = offsetInTable + pHeader->Length;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 STATUS
 _AcpiInterfaceParsePrts(
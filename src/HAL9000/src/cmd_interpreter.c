@@ -77,6 +77,8 @@ static const COMMAND_DEFINITION COMMANDS[] =
     { "procstat", "0x$PID - displays information about a process", CmdProcessDump, 1, 1},
     { "procstart", "$PATH_TO_EXE - starts a process", CmdStartProcess, 1, 1},
     { "proctest", "$TEST_NAME - runs a process test", CmdTestProcess, 1, 1},
+    { "syscalls", "[RESET] - displays the number of calls and the latency histogram of each system call"
+                  "\n\tRESET - clears the statistics after displaying them", CmdSyscallStats, 0, 1},
 
     { "sysinfo", "Retrieves system information", CmdDisplaySysInfo, 0, 0},
     { "getidle", "Retrieves idle timeout", CmdGetIdle, 0, 0},
@@ -92,11 +94,28 @@ static const COMMAND_DEFINITION COMMANDS[] =
               "\n\tIf last parameter is specified will wait until all CPUs acknowledge IPI", CmdSendIpi, 1, 3},
 
     { "networks", "Displays network information", CmdListNetworks, 0, 0},
-    { "netrecv", "[YES|NO] - receive network packets\n\tIf yes will resend the packets received, if no it will not", CmdNetRecv, 0, 1},
-    { "netsend", "Send network packets", CmdNetSend, 0, 0},
+    { "netrecv", "[YES|NO] [COPY|LOAN] - receive network packets\n\tIf yes will resend the packets received, if no it will not"
+                 "\n\tIf LOAN the frames are lent by the device instead of being copied", CmdNetRecv, 0, 2},
+    { "netsend", "[SINGLE|BATCH] - send network packets\n\tIf BATCH the frames are handed to the device in batches", CmdNetSend, 0, 1},
     { "netstatus", "$DEV_ID $RX_EN $TX_EN - changes the state of a network device"
                    "\n\tDevice ID\n\tIf $RX_EN is 1 => will enable receive on device\n\tIf $TX_EN is 1 => will enable send on device",
                     CmdChangeDevStatus, 3, 3},
+    { "netstats", "$DEV_ID - displays the frame and RX polling statistics of a network device", CmdNetStats, 1, 1},
+    { "nettune", "$DEV_ID [ADAPTIVE | $ITR $RDTR $RADV $TIDV $TADV] - displays or changes the ring sizes and interrupt moderation"
+                 "\n\tIf only $DEV_ID is specified displays the current settings"
+                 "\n\tADAPTIVE - the timers are chosen from the observed traffic"
+                 "\n\t$ITR $RDTR $RADV $TIDV $TADV - fixed timer values in uS",
+                 CmdNetTune, 1, 6},
+    { "netip", "$DEV_ID $IP $MASK - assigns an IPv4 address to a network device"
+               "\n\tThe hosts in the subnet are reachable directly through the device", CmdNetIp, 3, 3},
+    { "ping", "$IP [$COUNT] - sends ICMP echo requests to a host on a connected subnet", CmdPing, 1, 2},
+    { "udpecho", "$PORT [$COUNT] - sends back the next $COUNT UDP datagrams received on $PORT"
+                 "\n\tIf $PORT is 0 an ephemeral port is used", CmdUdpEcho, 1, 2},
+    { "tcpsend", "$IP $PORT $BYTES - connects to a TCP port, sends $BYTES bytes and reports the throughput", CmdTcpSend, 3, 3},
+    { "tcprecv", "$PORT - accepts a TCP connection, receives until the peer closes it and reports the throughput", CmdTcpReceive, 1, 1},
+    { "pktgen", "$DEV_ID $FRAME_SIZE $COUNT - sends $COUNT UDP frames of $FRAME_SIZE bytes to the address of a device"
+                "\n\tReports the packet rate, the throughput and the cycles spent per packet in each layer"
+                "\n\tOn the loopback device no other machine is needed", CmdPacketGenerator, 3, 3},
 
     { "tests", "Runs functional tests", CmdRunAllFunctionalTests, 0, 0},
     { "perf", "Runs performance tests", CmdRunAllPerformanceTests, 0, 0},
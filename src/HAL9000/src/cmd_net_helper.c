@@ -1,10 +1,12 @@
 #include "HAL9000.h"
 #include "network.h"
+#include "network_utils.h"
 #include "cmd_net_helper.h"
 #include "print.h"
 #include "dmp_net_device.h"
 #include "test_net_stack.h"
 #include "strutils.h"
+#include "rtc.h"
 
 #pragma warning(push)
 
@@ -81,14 +83,16 @@ CmdListNetworks(
 void
 CmdNetRecv(
     IN      QWORD       NumberOfParameters,
-    IN_Z    char*       ResendString
+    IN_Z    char*       ResendString,
+    IN_Z    char*       ModeString
     )
 {
     BOOLEAN bResend;
+    BOOLEAN bLoan;
 
-    ASSERT(0 <= NumberOfParameters && NumberOfParameters <= 1);
+    ASSERT(0 <= NumberOfParameters && NumberOfParameters <= 2);
 
-    if (1 == NumberOfParameters)
+    if (1 <= NumberOfParameters)
     {
         bResend = (0 == stricmp(ResendString, "YES"));
     }
@@ -97,17 +101,24 @@ CmdNetRecv(
         bResend = FALSE;
     }
 
-    TestNetwork(FALSE, bResend );
+    bLoan = (2 == NumberOfParameters) && (0 == stricmp(ModeString, "LOAN"));
+
+    TestNetwork(FALSE, bResend, bLoan);
 }
 
 void
 CmdNetSend(
-    IN          QWORD       NumberOfParameters
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       ModeString
     )
 {
-    ASSERT(NumberOfParameters == 0);
+    BOOLEAN bBatch;
 
-    TestNetwork(TRUE, FALSE);
+    ASSERT(NumberOfParameters <= 1);
+
+    bBatch = (1 == NumberOfParameters) && (0 == stricmp(ModeString, "BATCH"));
+
+    TestNetwork(TRUE, FALSE, bBatch);
 }
 
 void
@@ -152,4 +163,744 @@ CmdChangeDevStatus(
     }
 }
 
+void
+CmdNetStats(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       DeviceString
+    )
+{
+    STATUS status;
+    NETWORK_DEVICE_STATS stats;
+    DEVICE_ID devId;
+
+    ASSERT(NumberOfParameters == 1);
+
+    atoi32(&devId, DeviceString, BASE_HEXA);
+
+    status = NetGetNetworkDeviceStatistics(devId, &stats);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetGetNetworkDeviceStatistics failed with status: 0x%x\n", status);
+        return;
+    }
+
+    DumpNetworkDeviceStatistics(devId, &stats);
+}
+
+void
+CmdNetTune(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       DeviceString,
+    IN_Z    char*       ThrottleString,
+    IN_Z    char*       RxDelayString,
+    IN_Z    char*       RxAbsoluteDelayString,
+    IN_Z    char*       TxDelayString,
+    IN_Z    char*       TxAbsoluteDelayString
+    )
+{
+    STATUS status;
+    NETWORK_DEVICE_TUNING tuning;
+    DEVICE_ID devId;
+
+    ASSERT(1 <= NumberOfParameters && NumberOfParameters <= 6);
+
+    atoi32(&devId, DeviceString, BASE_HEXA);
+
+    if (NumberOfParameters > 1)
+    {
+        memzero(&tuning, sizeof(NETWORK_DEVICE_TUNING));
+
+        if (NumberOfParameters == 2 && stricmp(ThrottleString, "ADAPTIVE") == 0)
+        {
+            tuning.AdaptiveModeration = TRUE;
+        }
+        else if (NumberOfParameters == 6)
+        {
+            atoi32(&tuning.InterruptThrottleUs, ThrottleString, BASE_TEN);
+            atoi32(&tuning.RxDelayUs, RxDelayString, BASE_TEN);
+            atoi32(&tuning.RxAbsoluteDelayUs, RxAbsoluteDelayString, BASE_TEN);
+            atoi32(&tuning.TxDelayUs, TxDelayString, BASE_TEN);
+            atoi32(&tuning.TxAbsoluteDelayUs, TxAbsoluteDelayString, BASE_TEN);
+        }
+        else
+        {
+            perror("Either ADAPTIVE or all the five timers must be specified\n");
+            return;
+        }
+
+        status = NetSetNetworkDeviceTuning(devId, &tuning);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetSetNetworkDeviceTuning failed with status: 0x%x\n", status);
+            return;
+        }
+    }
+
+    status = NetGetNetworkDeviceTuning(devId, &tuning);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetGetNetworkDeviceTuning failed with status: 0x%x\n", status);
+        return;
+    }
+
+    DumpNetworkDeviceTuning(devId, &tuning);
+}
+
+#define CMD_PING_DEFAULT_COUNT              4
+#define CMD_PING_PAYLOAD_SIZE               56
+#define CMD_PING_TIMEOUT_US                 (1 * SEC_IN_US)
+
+// the largest datagram which fits in an ethernet frame
+#define CMD_UDP_ECHO_MAX_SIZE               (ETHERNET_MTU - IP4_PACKET_SIZE - UDP_DATAGRAM_SIZE)
+
+#define CMD_TCP_BUFFER_SIZE                 (16 * KB_SIZE)
+
+#define CMD_PKTGEN_MIN_FRAME_SIZE           (ETHERNET_FRAME_SIZE + IP4_PACKET_SIZE + UDP_DATAGRAM_SIZE)
+#define CMD_PKTGEN_MAX_FRAME_SIZE           (ETHERNET_FRAME_SIZE + ETHERNET_MTU)
+#define CMD_PKTGEN_BATCH_SIZE               16
+
+// the frames still in flight once everything was sent are considered lost
+// if none of them arrives for this long
+#define CMD_PKTGEN_IDLE_TIMEOUT_US          (100 * MS_IN_US)
+
+static const char* CMD_NET_LAYER_NAMES[NetLayerReserved] =
+{
+    "UDP send", "IPv4 send", "Device send", "IPv4 receive", "UDP receive"
+};
+
+static
+void
+_CmdTcpReportThroughput(
+    IN          QWORD       Bytes,
+    IN          QWORD       ElapsedUs
+    );
+
+static
+STATUS
+_CmdNetGetDeviceInfo(
+    IN          DEVICE_ID               DeviceId,
+    OUT         PNETWORK_DEVICE_INFO    DeviceInfo
+    );
+
+static
+DWORD
+_CmdPktgenDrain(
+    IN          PNET_UDP_ENDPOINT       Endpoint,
+    OUT_WRITES_BYTES(CMD_UDP_ECHO_MAX_SIZE)
+                PBYTE                   Buffer
+    );
+
+void
+CmdNetIp(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       DeviceString,
+    IN_Z    char*       AddressString,
+    IN_Z    char*       MaskString
+    )
+{
+    STATUS status;
+    DEVICE_ID devId;
+    IP4_ADDRESS address;
+    IP4_ADDRESS mask;
+
+    ASSERT(NumberOfParameters == 3);
+
+    atoi32(&devId, DeviceString, BASE_HEXA);
+
+    status = NetUtilTextToIp4Address(AddressString, &address);
+    if (!SUCCEEDED(status))
+    {
+        perror("[%s] is not a valid IPv4 address\n", AddressString);
+        return;
+    }
+
+    status = NetUtilTextToIp4Address(MaskString, &mask);
+    if (!SUCCEEDED(status))
+    {
+        perror("[%s] is not a valid subnet mask\n", MaskString);
+        return;
+    }
+
+    status = NetSetIp4Address(devId, address, mask);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetSetIp4Address failed with status: 0x%x\n", status);
+        return;
+    }
+
+    LOG("Device 0x%x has address [%s]\n", devId, AddressString);
+}
+
+void
+CmdPing(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       AddressString,
+    IN_Z    char*       CountString
+    )
+{
+    STATUS status;
+    IP4_ADDRESS address;
+    DWORD count;
+    DWORD noOfReplies;
+    QWORD roundTripTime;
+
+    ASSERT(1 <= NumberOfParameters && NumberOfParameters <= 2);
+
+    status = NetUtilTextToIp4Address(AddressString, &address);
+    if (!SUCCEEDED(status))
+    {
+        perror("[%s] is not a valid IPv4 address\n", AddressString);
+        return;
+    }
+
+    count = CMD_PING_DEFAULT_COUNT;
+    if (NumberOfParameters > 1)
+    {
+        atoi32(&count, CountString, BASE_TEN);
+    }
+
+    noOfReplies = 0;
+    for (DWORD i = 0; i < count; ++i)
+    {
+        status = NetIcmpEcho(address, (WORD) i, CMD_PING_PAYLOAD_SIZE, CMD_PING_TIMEOUT_US, &roundTripTime);
+        if (STATUS_TIMEOUT == status)
+        {
+            pwarn("Request %u to [%s] timed out\n", i, AddressString);
+            continue;
+        }
+        else if (!SUCCEEDED(status))
+        {
+            perror("NetIcmpEcho failed with status: 0x%x\n", status);
+            break;
+        }
+
+        LOG("Reply from [%s]: seq=%u time=%U us\n", AddressString, i, roundTripTime);
+        noOfReplies++;
+    }
+
+    LOG("%u requests sent, %u replies received\n", count, noOfReplies);
+}
+
+void
+CmdUdpEcho(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       PortString,
+    IN_Z    char*       CountString
+    )
+{
+    STATUS status;
+    PNET_UDP_ENDPOINT pEndpoint;
+    DWORD port;
+    DWORD count;
+    BYTE buffer[CMD_UDP_ECHO_MAX_SIZE];
+    char sourceText[TEXT_IP4_ADDRESS_CHARS_REQUIRED];
+    WORD bytesReceived;
+    IP4_ADDRESS source;
+    PORT_NUMBER sourcePort;
+
+    ASSERT(1 <= NumberOfParameters && NumberOfParameters <= 2);
+
+    atoi32(&port, PortString, BASE_TEN);
+    if (port > MAX_WORD)
+    {
+        perror("%u is not a valid port\n", port);
+        return;
+    }
+
+    count = 1;
+    if (NumberOfParameters > 1)
+    {
+        atoi32(&count, CountString, BASE_TEN);
+    }
+
+    status = NetUdpOpen((PORT_NUMBER) port, &pEndpoint);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetUdpOpen failed with status: 0x%x\n", status);
+        return;
+    }
+
+    LOG("Echoing %u datagrams on port %u\n", count, NetUdpGetLocalPort(pEndpoint));
+
+    for (DWORD i = 0; i < count; ++i)
+    {
+        status = NetUdpReceive(pEndpoint, buffer, sizeof(buffer), &bytesReceived, &source, &sourcePort);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetUdpReceive failed with status: 0x%x\n", status);
+            break;
+        }
+
+        LOG("Received %u bytes from [%s]:%u\n", bytesReceived, NetUtilIp4AddressToText(source, sourceText), sourcePort);
+
+        status = NetUdpSend(pEndpoint, source, sourcePort, buffer, bytesReceived);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetUdpSend failed with status: 0x%x\n", status);
+            break;
+        }
+    }
+
+    NetUdpClose(pEndpoint);
+}
+
+void
+CmdTcpSend(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       AddressString,
+    IN_Z    char*       PortString,
+    IN_Z    char*       BytesString
+    )
+{
+    STATUS status;
+    IP4_ADDRESS address;
+    DWORD port;
+    QWORD bytesToSend;
+    QWORD totalBytesSent;
+    DWORD bytesSent;
+    PBYTE pBuffer;
+    PNET_TCP_CONNECTION pConnection;
+    QWORD startTime;
+
+    ASSERT(NumberOfParameters == 3);
+
+    status = NetUtilTextToIp4Address(AddressString, &address);
+    if (!SUCCEEDED(status))
+    {
+        perror("[%s] is not a valid IPv4 address\n", AddressString);
+        return;
+    }
+
+    atoi32(&port, PortString, BASE_TEN);
+    if (0 == port || port > MAX_WORD)
+    {
+        perror("%u is not a valid port\n", port);
+        return;
+    }
+
+    atoi64(&bytesToSend, BytesString, BASE_TEN);
+
+    pBuffer = ExAllocatePoolWithTag(0, CMD_TCP_BUFFER_SIZE, HEAP_TEMP_TAG, 0);
+    if (NULL == pBuffer)
+    {
+        perror("ExAllocatePoolWithTag failed for %u bytes\n", CMD_TCP_BUFFER_SIZE);
+        return;
+    }
+
+    for (DWORD i = 0; i < CMD_TCP_BUFFER_SIZE; ++i)
+    {
+        pBuffer[i] = (BYTE) i;
+    }
+
+    status = NetTcpConnect(address, (PORT_NUMBER) port, &pConnection);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetTcpConnect failed with status: 0x%x\n", status);
+        ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+        return;
+    }
+
+    totalBytesSent = 0;
+    startTime = IoGetSystemTimeUs();
+
+    while (totalBytesSent < bytesToSend)
+    {
+        status = NetTcpSend(pConnection,
+                            pBuffer,
+                            (DWORD) min(bytesToSend - totalBytesSent, CMD_TCP_BUFFER_SIZE),
+                            &bytesSent);
+        totalBytesSent += bytesSent;
+        if (!SUCCEEDED(status))
+        {
+            perror("NetTcpSend failed with status: 0x%x\n", status);
+            break;
+        }
+    }
+
+    _CmdTcpReportThroughput(totalBytesSent, IoGetSystemTimeUs() - startTime);
+
+    NetTcpClose(pConnection);
+    ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+}
+
+void
+CmdTcpReceive(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       PortString
+    )
+{
+    STATUS status;
+    DWORD port;
+    QWORD totalBytesReceived;
+    DWORD bytesReceived;
+    PBYTE pBuffer;
+    PNET_TCP_LISTENER pListener;
+    PNET_TCP_CONNECTION pConnection;
+    QWORD startTime;
+
+    ASSERT(NumberOfParameters == 1);
+
+    atoi32(&port, PortString, BASE_TEN);
+    if (0 == port || port > MAX_WORD)
+    {
+        perror("%u is not a valid port\n", port);
+        return;
+    }
+
+    pBuffer = ExAllocatePoolWithTag(0, CMD_TCP_BUFFER_SIZE, HEAP_TEMP_TAG, 0);
+    if (NULL == pBuffer)
+    {
+        perror("ExAllocatePoolWithTag failed for %u bytes\n", CMD_TCP_BUFFER_SIZE);
+        return;
+    }
+
+    status = NetTcpListen((PORT_NUMBER) port, 1, &pListener);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetTcpListen failed with status: 0x%x\n", status);
+        ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+        return;
+    }
+
+    LOG("Waiting for a connection on port %u\n", port);
+
+    status = NetTcpAccept(pListener, &pConnection);
+    NetTcpCloseListener(pListener);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetTcpAccept failed with status: 0x%x\n", status);
+        ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+        return;
+    }
+
+    totalBytesReceived = 0;
+    startTime = IoGetSystemTimeUs();
+
+    // the peer closing the connection ends the transfer
+    do
+    {
+        status = NetTcpReceive(pConnection, pBuffer, CMD_TCP_BUFFER_SIZE, &bytesReceived);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetTcpReceive failed with status: 0x%x\n", status);
+            break;
+        }
+        totalBytesReceived += bytesReceived;
+    } while (0 != bytesReceived);
+
+    _CmdTcpReportThroughput(totalBytesReceived, IoGetSystemTimeUs() - startTime);
+
+    NetTcpClose(pConnection);
+    ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+}
+
+void
+CmdPacketGenerator(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       DeviceString,
+    IN_Z    char*       FrameSizeString,
+    IN_Z    char*       CountString
+    )
+{
+    STATUS status;
+    DEVICE_ID devId;
+    DWORD frameSize;
+    DWORD count;
+    WORD payloadSize;
+    NETWORK_DEVICE_INFO devInfo;
+    PNET_UDP_ENDPOINT pEndpoint;
+    PORT_NUMBER port;
+    PBYTE pBuffer;
+    NET_UDP_DATAGRAM datagrams[CMD_PKTGEN_BATCH_SIZE];
+    NETWORK_DEVICE_STATS statsBefore;
+    NETWORK_DEVICE_STATS statsAfter;
+    NET_LAYER_STATS layerStats[NetLayerReserved];
+    DWORD batchSize;
+    DWORD batchSent;
+    DWORD received;
+    DWORD sent;
+    QWORD startTime;
+    QWORD endTime;
+    QWORD startTicks;
+    QWORD elapsedTicks;
+    QWORD elapsedUs;
+    QWORD txFrames;
+    QWORD megabitsPerSecond;
+
+    ASSERT(NumberOfParameters == 3);
+
+    atoi32(&devId, DeviceString, BASE_HEXA);
+    atoi32(&frameSize, FrameSizeString, BASE_TEN);
+    atoi32(&count, CountString, BASE_TEN);
+
+    if (frameSize < CMD_PKTGEN_MIN_FRAME_SIZE || frameSize > CMD_PKTGEN_MAX_FRAME_SIZE)
+    {
+        perror("The frame size must be between %u and %u bytes\n", CMD_PKTGEN_MIN_FRAME_SIZE, CMD_PKTGEN_MAX_FRAME_SIZE);
+        return;
+    }
+    payloadSize = (WORD) (frameSize - CMD_PKTGEN_MIN_FRAME_SIZE);
+
+    if (0 == count)
+    {
+        perror("At least a frame must be sent\n");
+        return;
+    }
+
+    status = _CmdNetGetDeviceInfo(devId, &devInfo);
+    if (!SUCCEEDED(status))
+    {
+        perror("_CmdNetGetDeviceInfo failed with status: 0x%x\n", status);
+        return;
+    }
+
+    // the frames are sent to the device itself, on the loopback device they
+    // cross the whole stack twice without leaving the machine
+    if (!devInfo.Ip4Configured)
+    {
+        perror("Device 0x%x has no IPv4 address, assign one with netip\n", devId);
+        return;
+    }
+
+    // the first half of the buffer is sent, the datagrams are received in
+    // the second one
+    pBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, 2 * CMD_UDP_ECHO_MAX_SIZE, HEAP_TEMP_TAG, 0);
+    if (NULL == pBuffer)
+    {
+        perror("ExAllocatePoolWithTag failed for %u bytes\n", 2 * CMD_UDP_ECHO_MAX_SIZE);
+        return;
+    }
+
+    status = NetUdpOpen(0, &pEndpoint);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetUdpOpen failed with status: 0x%x\n", status);
+        ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+        return;
+    }
+    port = NetUdpGetLocalPort(pEndpoint);
+
+    for (DWORD i = 0; i < CMD_PKTGEN_BATCH_SIZE; ++i)
+    {
+        datagrams[i].Buffer = pBuffer;
+        datagrams[i].Size = payloadSize;
+        datagrams[i].Address = devInfo.Ip4Address;
+        datagrams[i].Port = port;
+    }
+
+    status = NetGetNetworkDeviceStatistics(devId, &statsBefore);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetGetNetworkDeviceStatistics failed with status: 0x%x\n", status);
+        NetUdpClose(pEndpoint);
+        ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+        return;
+    }
+
+    LOG("Sending %u frames of %u bytes through device 0x%x\n", count, frameSize, devId);
+
+    NetSetLayerProfiling(TRUE);
+
+    sent = 0;
+    received = 0;
+    startTime = IoGetSystemTimeUs();
+    startTicks = RtcGetTickCount();
+
+    while (sent < count)
+    {
+        batchSize = min(count - sent, CMD_PKTGEN_BATCH_SIZE);
+
+        // the array is not changed by the send
+        status = NetUdpSendBatch(pEndpoint, datagrams, batchSize, &batchSent);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetUdpSendBatch failed with status: 0x%x\n", status);
+            break;
+        }
+        sent += batchSent;
+
+        // the queue of the endpoint is short, it must be drained while
+        // sending or most of the datagrams would be dropped
+        received += _CmdPktgenDrain(pEndpoint, pBuffer + CMD_UDP_ECHO_MAX_SIZE);
+    }
+
+    endTime = IoGetSystemTimeUs();
+    elapsedTicks = RtcGetTickCount() - startTicks;
+
+    while (received < sent)
+    {
+        DWORD drained = _CmdPktgenDrain(pEndpoint, pBuffer + CMD_UDP_ECHO_MAX_SIZE);
+
+        if (0 != drained)
+        {
+            received += drained;
+            endTime = IoGetSystemTimeUs();
+            elapsedTicks = RtcGetTickCount() - startTicks;
+        }
+        else if (IoGetSystemTimeUs() - endTime >= CMD_PKTGEN_IDLE_TIMEOUT_US)
+        {
+            break;
+        }
+        else
+        {
+            ThreadYield();
+        }
+    }
+
+    NetSetLayerProfiling(FALSE);
+    NetGetLayerStatistics(layerStats);
+
+    status = NetGetNetworkDeviceStatistics(devId, &statsAfter);
+    if (!SUCCEEDED(status))
+    {
+        perror("NetGetNetworkDeviceStatistics failed with status: 0x%x\n", status);
+        memcpy(&statsAfter, &statsBefore, sizeof(NETWORK_DEVICE_STATS));
+    }
+
+    NetUdpClose(pEndpoint);
+    ExFreePoolWithTag(pBuffer, HEAP_TEMP_TAG);
+
+    elapsedUs = endTime - startTime;
+
+    LOG("Sent %u frames, received %u, lost %u, dropped by the device %U\n",
+        sent, received, sent - received, statsAfter.RxFramesDropped - statsBefore.RxFramesDropped);
+
+    if (0 == received || 0 == elapsedUs)
+    {
+        return;
+    }
+
+    // bits per microsecond are megabits per second
+    megabitsPerSecond = ((QWORD) received * frameSize * BITS_PER_BYTE) / elapsedUs;
+
+    LOG("%U us => %U packets/s, %U.%03U Gbit/s\n",
+        elapsedUs,
+        (QWORD) received * SEC_IN_US / elapsedUs,
+        megabitsPerSecond / 1000, megabitsPerSecond % 1000);
+
+    LOG("Cycles per packet:\n");
+    for (DWORD i = 0; i < NetLayerReserved; ++i)
+    {
+        if (0 != layerStats[i].Packets)
+        {
+            LOG("%s: %U\n", CMD_NET_LAYER_NAMES[i], layerStats[i].Cycles / layerStats[i].Packets);
+        }
+    }
+
+    txFrames = statsAfter.TxStats.NumberOfFrames - statsBefore.TxStats.NumberOfFrames;
+    if (0 != txFrames)
+    {
+        LOG("Port transmit: %U\n", (statsAfter.TxCycles - statsBefore.TxCycles) / txFrames);
+    }
+
+    LOG("Total: %U\n", elapsedTicks / received);
+}
+
+static
+void
+_CmdTcpReportThroughput(
+    IN          QWORD       Bytes,
+    IN          QWORD       ElapsedUs
+    )
+{
+    LOG("Transferred %U bytes in %U us", Bytes, ElapsedUs);
+    if (0 != ElapsedUs)
+    {
+        LOG(" => %U KB/s", (Bytes * SEC_IN_US / KB_SIZE) / ElapsedUs);
+    }
+    LOG("\n");
+}
+
+static
+STATUS
+_CmdNetGetDeviceInfo(
+    IN          DEVICE_ID               DeviceId,
+    OUT         PNETWORK_DEVICE_INFO    DeviceInfo
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE_INFO pNetDevices;
+    DWORD noOfDevices;
+
+    ASSERT(NULL != DeviceInfo);
+
+    status = NetGetNetworkDevices(NULL, &noOfDevices);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (0 == noOfDevices)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    pNetDevices = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NETWORK_DEVICE_INFO) * noOfDevices, HEAP_TEMP_TAG, 0);
+    if (NULL == pNetDevices)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    status = NetGetNetworkDevices(pNetDevices, &noOfDevices);
+    if (SUCCEEDED(status))
+    {
+        status = STATUS_DEVICE_DOES_NOT_EXIST;
+        for (DWORD i = 0; i < noOfDevices; ++i)
+        {
+            if (pNetDevices[i].DeviceId == DeviceId)
+            {
+                memcpy(DeviceInfo, &pNetDevices[i], sizeof(NETWORK_DEVICE_INFO));
+                status = STATUS_SUCCESS;
+                break;
+            }
+        }
+    }
+
+    ExFreePoolWithTag(pNetDevices, HEAP_TEMP_TAG);
+
+    return status;
+}
+
+// Receives all the datagrams already queued without waiting, all of them are
+// placed in the same buffer
+static
+DWORD
+_CmdPktgenDrain(
+    IN          PNET_UDP_ENDPOINT       Endpoint,
+    OUT_WRITES_BYTES(CMD_UDP_ECHO_MAX_SIZE)
+                PBYTE                   Buffer
+    )
+{
+    STATUS status;
+    NET_UDP_DATAGRAM datagrams[CMD_PKTGEN_BATCH_SIZE];
+    DWORD received;
+    DWORD total;
+
+    ASSERT(NULL != Endpoint);
+    ASSERT(NULL != Buffer);
+
+    total = 0;
+
+    // we are the only receiver => NetUdpReceiveBatch does not wait once
+    // the endpoint was found readable
+    while (IsBooleanFlagOn(NetUdpPoll(Endpoint), NET_POLL_READ))
+    {
+        for (DWORD i = 0; i < CMD_PKTGEN_BATCH_SIZE; ++i)
+        {
+            datagrams[i].Buffer = Buffer;
+            datagrams[i].Size = CMD_UDP_ECHO_MAX_SIZE;
+        }
+
+        status = NetUdpReceiveBatch(Endpoint, datagrams, CMD_PKTGEN_BATCH_SIZE, &received);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetUdpReceiveBatch failed with status: 0x%x\n", status);
+            break;
+        }
+
+        total += received;
+    }
+
+    return total;
+}
+
 #pragma warning(pop)
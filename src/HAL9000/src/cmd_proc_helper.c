@@ -7,6 +7,7 @@
 #include "dmp_process.h"
 #include "strutils.h"
 #include "test_process.h"
+#include "syscall.h"
 
 typedef struct _PROC_STAT_CTX
 {
@@ -14,6 +15,20 @@ typedef struct _PROC_STAT_CTX
     BOOLEAN         FoundProcess;
 } PROC_STAT_CTX, *PPROC_STAT_CTX;
 
+static const char* SYSCALL_NAMES[] =
+{
+    "IdentifyVersion",
+    "ThreadExit", "ThreadCreate", "ThreadGetTid", "ThreadWaitForTermination", "ThreadCloseHandle",
+    "ProcessExit", "ProcessCreate", "ProcessGetPid", "ProcessWaitForTermination", "ProcessCloseHandle",
+    "VirtualAlloc", "VirtualFree",
+    "FileCreate", "FileClose", "FileRead", "FileWrite",
+    "SocketCreate", "SocketClose", "SocketBind", "SocketListen", "SocketAccept", "SocketConnect",
+    "SocketSend", "SocketReceive", "SocketSendBatch", "SocketReceiveBatch", "SocketPoll",
+    "RingSetup", "RingEnter",
+    "ThreadSetAffinity",
+};
+STATIC_ASSERT(ARRAYSIZE(SYSCALL_NAMES) == SyscallIdReserved);
+
 #pragma warning(push)
 
 // warning C4212: nonstandard extension used: function declaration used ellipsis
@@ -146,6 +161,61 @@ STATUS
     return STATUS_SUCCESS;
 }
 
+void
+(__cdecl CmdSyscallStats)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       ResetString
+    )
+{
+    PSYSCALL_STATISTICS pStatistics;
+    DWORD i;
+    DWORD bucket;
+
+    ASSERT(NumberOfParameters <= 1);
+
+    pStatistics = ExAllocatePoolWithTag(0, sizeof(SYSCALL_STATISTICS) * SyscallIdReserved, HEAP_TEMP_TAG, 0);
+    if (pStatistics == NULL)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(SYSCALL_STATISTICS) * SyscallIdReserved);
+        return;
+    }
+
+    SyscallGetStatistics(pStatistics);
+
+    printf("Latency buckets start at %u cycles and double the range each\n", SYSCALL_LATENCY_FIRST_BUCKET_CYCLES);
+
+    for (i = 0; i < SyscallIdReserved; ++i)
+    {
+        PSYSCALL_STATISTICS pCurrent = &pStatistics[i];
+
+        if (pCurrent->Calls == 0)
+        {
+            continue;
+        }
+
+        printf("%s: calls %U, in registers %U, cycles per call %U\n",
+            SYSCALL_NAMES[i],
+            pCurrent->Calls,
+            pCurrent->FastCalls,
+            pCurrent->TotalCycles / pCurrent->Calls
+            );
+
+        printf("Histogram:");
+        for (bucket = 0; bucket < SYSCALL_LATENCY_BUCKETS; ++bucket)
+        {
+            printf(" %U", pCurrent->LatencyBuckets[bucket]);
+        }
+        printf("\n");
+    }
+
+    ExFreePoolWithTag(pStatistics, HEAP_TEMP_TAG);
+
+    if (NumberOfParameters == 1 && 0 == stricmp(ResetString, "RESET"))
+    {
+        SyscallResetStatistics();
+    }
+}
+
 #include "test_common.h"
 
 void
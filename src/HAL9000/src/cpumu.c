@@ -26,6 +26,7 @@ typedef struct _CPUMU_DATA
     CPUID_EXTENDED_CPUID_INFORMATION                ExtendedCpuidInformation;
     CPUID_EXTENDED_FEATURE_INFORMATION              ExtendedFeatureInformation;
     CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF      ExtendedStateMainLeaf;
+    CPUID_EXTENDED_STATE_ENUMERATION_SUB_LEAF       ExtendedStateSubLeaf;
 } CPUMU_DATA, *PCPMU_DATA;
 
 static CPUMU_DATA m_cpuMuData;
@@ -91,6 +92,7 @@ _CpuMuCollectBasicInformation(
     if (m_cpuMuData.BasicInformation.MaxValueForBasicInfo >= CpuidIdxExtendedStateEnumerationMainLeaf)
     {
         __cpuidex((int*)&m_cpuMuData.ExtendedStateMainLeaf, CpuidIdxExtendedStateEnumerationMainLeaf, 0x0);
+        __cpuidex((int*)&m_cpuMuData.ExtendedStateSubLeaf, CpuidIdxExtendedStateEnumerationMainLeaf, 0x1);
     }
 }
 
@@ -409,6 +411,14 @@ CpuMuIsPcidFeaturePresent(
     return (m_cpuMuData.FeatureInformation.ecx.PCID == 1);
 }
 
+BOOLEAN
+CpuMuIsXsaveoptFeaturePresent(
+    void
+    )
+{
+    return (m_cpuMuData.ExtendedStateSubLeaf.eax.XSAVEOPT == 1);
+}
+
 STATUS
 CpuMuActivateFpuFeatures(
     void
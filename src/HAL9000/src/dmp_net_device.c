@@ -9,6 +9,8 @@ DumpNetworkDevice(
     )
 {
     char macAddress[TEXT_MAC_ADDRESS_CHARS_REQUIRED];
+    char ipAddress[TEXT_IP4_ADDRESS_CHARS_REQUIRED];
+    char subnetMask[TEXT_IP4_ADDRESS_CHARS_REQUIRED];
     INTR_STATE intrState;
 
     ASSERT( NULL != NetworkDevice );
@@ -26,5 +28,119 @@ DumpNetworkDevice(
     LOG("Device TX is [%s]\n",
         NetworkDevice->DeviceStatus.TxEnabled ? "ENABLED" : "DISABLED"
         );
+    LOG("Offloads: 0x%x, maximum segmentation size: %u bytes\n",
+        NetworkDevice->OffloadCapabilities.Offloads,
+        NetworkDevice->OffloadCapabilities.MaximumSegmentationSize
+        );
+    if (NetworkDevice->Ip4Configured)
+    {
+        NetUtilIp4AddressToText(NetworkDevice->Ip4Address, ipAddress);
+        NetUtilIp4AddressToText(NetworkDevice->SubnetMask, subnetMask);
+
+        LOG("IPv4 address [%s], subnet mask [%s]\n", ipAddress, subnetMask);
+    }
+    else
+    {
+        LOG("IPv4 is not configured\n");
+    }
+    DumpReleaseLock(intrState);
+}
+
+static
+void
+_DumpNetworkFrameStatistics(
+    IN_Z    char*                       Name,
+    IN      PNETWORK_FRAME_STATS        Statistics
+    )
+{
+    ASSERT( NULL != Name );
+    ASSERT( NULL != Statistics );
+
+    LOG("%s frames: %U, bytes: %U, smallest: %U, largest: %U\n",
+        Name,
+        Statistics->NumberOfFrames,
+        Statistics->TotalBytes,
+        Statistics->SmallestPacket,
+        Statistics->LargestPacket
+        );
+}
+
+void
+DumpNetworkDeviceStatistics(
+    IN      DEVICE_ID                   DeviceId,
+    IN      PNETWORK_DEVICE_STATS       Statistics
+    )
+{
+    INTR_STATE intrState;
+    PNETWORK_RX_POLL_STATS pPollStats;
+    DWORD i;
+
+    ASSERT( NULL != Statistics );
+
+    pPollStats = &Statistics->RxPollStats;
+
+    intrState = DumpTakeLock();
+    LOG("Device ID: 0x%x\n", DeviceId );
+
+    _DumpNetworkFrameStatistics("RX", &Statistics->RxStats);
+    _DumpNetworkFrameStatistics("TX", &Statistics->TxStats);
+    LOG("RX frames dropped: %U\n", Statistics->RxFramesDropped );
+
+    LOG("RX interrupts: %U, frames per interrupt: %U\n",
+        pPollStats->Interrupts,
+        0 != pPollStats->Interrupts ? pPollStats->FramesPolled / pPollStats->Interrupts : 0
+        );
+    LOG("RX poll passes: %U, budget exhausted: %U\n",
+        pPollStats->PollPasses,
+        pPollStats->BudgetExhausted
+        );
+    LOG("TX batches: %U, frames per batch: %U\n",
+        Statistics->TxBatches,
+        0 != Statistics->TxBatches ? Statistics->TxStats.NumberOfFrames / Statistics->TxBatches : 0
+        );
+    LOG("TX cycles per frame: %U\n",
+        0 != Statistics->TxStats.NumberOfFrames ? Statistics->TxCycles / Statistics->TxStats.NumberOfFrames : 0
+        );
+
+    if (Statistics->NumberOfQueues > 1)
+    {
+        for (i = 0; i < Statistics->NumberOfQueues; ++i)
+        {
+            PNETWORK_QUEUE_STATS pQueueStats = &Statistics->QueueStats[i];
+
+            LOG("Queue %u RX frames: %U, bytes: %U, interrupts: %U\n",
+                i,
+                pQueueStats->RxStats.NumberOfFrames,
+                pQueueStats->RxStats.TotalBytes,
+                pQueueStats->RxInterrupts
+                );
+            LOG("Queue %u TX frames: %U, bytes: %U, interrupts: %U\n",
+                i,
+                pQueueStats->TxStats.NumberOfFrames,
+                pQueueStats->TxStats.TotalBytes,
+                pQueueStats->TxInterrupts
+                );
+        }
+    }
+    DumpReleaseLock(intrState);
+}
+
+void
+DumpNetworkDeviceTuning(
+    IN      DEVICE_ID                   DeviceId,
+    IN      PNETWORK_DEVICE_TUNING      Tuning
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT( NULL != Tuning );
+
+    intrState = DumpTakeLock();
+    LOG("Device ID: 0x%x\n", DeviceId );
+    LOG("RX ring size: %u, TX ring size: %u\n", Tuning->RxRingSize, Tuning->TxRingSize );
+    LOG("Interrupt moderation: %s\n", Tuning->AdaptiveModeration ? "adaptive" : "fixed" );
+    LOG("Interrupt throttling: %u uS\n", Tuning->InterruptThrottleUs );
+    LOG("RX delay: %u uS, RX absolute delay: %u uS\n", Tuning->RxDelayUs, Tuning->RxAbsoluteDelayUs );
+    LOG("TX delay: %u uS, TX absolute delay: %u uS\n", Tuning->TxDelayUs, Tuning->TxAbsoluteDelayUs );
     DumpReleaseLock(intrState);
 }
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "HAL9000.h"
+#include "handle_table.h"
+
+#define HANDLE_TABLE_ENTRY_LOCKED           ((QWORD)1)
+
+#define HANDLE_TABLE_NO_FREE_ENTRY          MAX_DWORD
+
+STATIC_ASSERT(sizeof(HANDLE_TABLE_ENTRY) == 16);
+
+static
+PTR_SUCCESS
+PHANDLE_TABLE_ENTRY
+_HandleTableGetEntry(
+    IN          PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle
+    );
+
+static
+QWORD
+_HandleTableLockEntry(
+    INOUT       PHANDLE_TABLE_ENTRY     Entry
+    );
+
+static
+STATUS
+_HandleTableAllocateEntry(
+    INOUT       PHANDLE_TABLE           Table,
+    OUT         DWORD*                  Index
+    );
+
+__forceinline
+static
+UM_HANDLE
+_HandleTableBuildHandle(
+    IN          DWORD                   Index,
+    IN          WORD                    Generation
+    )
+{
+    return ((QWORD) Generation << 32) | (Index + HANDLE_TABLE_FIRST_HANDLE);
+}
+
+__forceinline
+static
+WORD
+_HandleTableGetGeneration(
+    IN          UM_HANDLE               Handle
+    )
+{
+    return (WORD) (Handle >> 32);
+}
+
+void
+HandleTableInit(
+    OUT         PHANDLE_TABLE           Table
+    )
+{
+    ASSERT(NULL != Table);
+
+    memzero(Table, sizeof(HANDLE_TABLE));
+
+    LockInit(&Table->Lock);
+    Table->FreeListHead = HANDLE_TABLE_NO_FREE_ENTRY;
+}
+
+void
+HandleTableDestroy(
+    INOUT       PHANDLE_TABLE           Table
+    )
+{
+    PHANDLE_TABLE_ENTRY pEntry;
+    DWORD i;
+
+    ASSERT(NULL != Table);
+
+    for (i = 0; i < Table->NumberOfEntries; ++i)
+    {
+        pEntry = &Table->Pages[i / HANDLE_TABLE_ENTRIES_PER_PAGE][i % HANDLE_TABLE_ENTRIES_PER_PAGE];
+
+        ASSERT(!IsBooleanFlagOn(pEntry->Object, HANDLE_TABLE_ENTRY_LOCKED));
+
+        if (0 != pEntry->Object)
+        {
+            RfcDereference((PREF_COUNT) pEntry->Object);
+            pEntry->Object = 0;
+        }
+    }
+
+    for (i = 0; i < HANDLE_TABLE_MAX_PAGES && NULL != Table->Pages[i]; ++i)
+    {
+        ExFreePoolWithTag(Table->Pages[i], HEAP_PROCESS_TAG);
+        Table->Pages[i] = NULL;
+    }
+
+    Table->NumberOfEntries = 0;
+    Table->NumberOfHandles = 0;
+    Table->FreeListHead = HANDLE_TABLE_NO_FREE_ENTRY;
+}
+
+STATUS
+HandleTableInsert(
+    INOUT       PHANDLE_TABLE           Table,
+    IN          HANDLE_TYPE             Type,
+    IN          PREF_COUNT              Object,
+    OUT         UM_HANDLE*              Handle
+    )
+{
+    STATUS status;
+    PHANDLE_TABLE_ENTRY pEntry;
+    INTR_STATE oldState;
+    DWORD index;
+    WORD generation;
+
+    ASSERT(NULL != Table);
+    ASSERT(NULL != Object);
+    ASSERT(!IsBooleanFlagOn((QWORD) Object, HANDLE_TABLE_ENTRY_LOCKED));
+    ASSERT(NULL != Handle);
+
+    status = _HandleTableAllocateEntry(Table, &index);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    pEntry = &Table->Pages[index / HANDLE_TABLE_ENTRIES_PER_PAGE][index % HANDLE_TABLE_ENTRIES_PER_PAGE];
+
+    LockAcquire(&Table->Lock, &oldState);
+
+    // the entry is not visible until its object is set, the readers find
+    // the type and generation already written
+    pEntry->Type = (BYTE) Type;
+    generation = pEntry->Generation;
+    _InterlockedExchange64(&pEntry->Object, (QWORD) Object);
+
+    Table->NumberOfHandles++;
+
+    LockRelease(&Table->Lock, oldState);
+
+    *Handle = _HandleTableBuildHandle(index, generation);
+
+    return STATUS_SUCCESS;
+}
+
+PTR_SUCCESS
+PREF_COUNT
+HandleTableReference(
+    IN          PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle,
+    IN          HANDLE_TYPE             Type
+    )
+{
+    PHANDLE_TABLE_ENTRY pEntry;
+    PREF_COUNT pObject;
+    QWORD object;
+
+    ASSERT(NULL != Table);
+
+    pEntry = _HandleTableGetEntry(Table, Handle);
+    if (NULL == pEntry)
+    {
+        return NULL;
+    }
+
+    object = _HandleTableLockEntry(pEntry);
+    if (0 == object)
+    {
+        return NULL;
+    }
+
+    // the handle cannot be closed while the entry is locked
+    pObject = NULL;
+    if (pEntry->Generation == _HandleTableGetGeneration(Handle)
+        && pEntry->Type == (BYTE) Type)
+    {
+        pObject = (PREF_COUNT) object;
+        RfcReference(pObject);
+    }
+
+    _InterlockedExchange64(&pEntry->Object, object);
+
+    return pObject;
+}
+
+STATUS
+HandleTableClose(
+    INOUT       PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle,
+    IN          HANDLE_TYPE             Type
+    )
+{
+    PHANDLE_TABLE_ENTRY pEntry;
+    INTR_STATE oldState;
+    QWORD object;
+
+    ASSERT(NULL != Table);
+
+    pEntry = _HandleTableGetEntry(Table, Handle);
+    if (NULL == pEntry)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    object = _HandleTableLockEntry(pEntry);
+    if (0 == object)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    if (pEntry->Generation != _HandleTableGetGeneration(Handle)
+        || pEntry->Type != (BYTE) Type)
+    {
+        _InterlockedExchange64(&pEntry->Object, object);
+        return STATUS_INVALID_HANDLE;
+    }
+
+    LockAcquire(&Table->Lock, &oldState);
+
+    // clearing the object also unlocks the entry
+    pEntry->Generation++;
+    pEntry->NextFree = Table->FreeListHead;
+    Table->FreeListHead = (DWORD) ((Handle & MAX_DWORD) - HANDLE_TABLE_FIRST_HANDLE);
+    _InterlockedExchange64(&pEntry->Object, 0);
+
+    ASSERT(Table->NumberOfHandles > 0);
+    Table->NumberOfHandles--;
+
+    LockRelease(&Table->Lock, oldState);
+
+    RfcDereference((PREF_COUNT) object);
+
+    return STATUS_SUCCESS;
+}
+
+static
+PTR_SUCCESS
+PHANDLE_TABLE_ENTRY
+_HandleTableGetEntry(
+    IN          PHANDLE_TABLE           Table,
+    IN          UM_HANDLE               Handle
+    )
+{
+    PHANDLE_TABLE_ENTRY pPage;
+    QWORD index;
+
+    ASSERT(NULL != Table);
+
+    // the bits above the generation must be clear
+    if (Handle >> 48 != 0 || (Handle & MAX_DWORD) < HANDLE_TABLE_FIRST_HANDLE)
+    {
+        return NULL;
+    }
+
+    index = (Handle & MAX_DWORD) - HANDLE_TABLE_FIRST_HANDLE;
+    if (index >= HANDLE_TABLE_MAX_HANDLES)
+    {
+        return NULL;
+    }
+
+    pPage = Table->Pages[index / HANDLE_TABLE_ENTRIES_PER_PAGE];
+    if (NULL == pPage)
+    {
+        return NULL;
+    }
+
+    return &pPage[index % HANDLE_TABLE_ENTRIES_PER_PAGE];
+}
+
+static
+QWORD
+_HandleTableLockEntry(
+    INOUT       PHANDLE_TABLE_ENTRY     Entry
+    )
+{
+    QWORD object;
+
+    ASSERT(NULL != Entry);
+
+    while (TRUE)
+    {
+        object = Entry->Object;
+        if (0 == object)
+        {
+            return 0;
+        }
+
+        if (IsBooleanFlagOn(object, HANDLE_TABLE_ENTRY_LOCKED))
+        {
+            // the entry is held only while a reference is taken
+            _mm_pause();
+            continue;
+        }
+
+        if (object == (QWORD) _InterlockedCompareExchange64(&Entry->Object,
+                                                             object | HANDLE_TABLE_ENTRY_LOCKED,
+                                                             object))
+        {
+            return object;
+        }
+    }
+}
+
+static
+STATUS
+_HandleTableAllocateEntry(
+    INOUT       PHANDLE_TABLE           Table,
+    OUT         DWORD*                  Index
+    )
+{
+    PHANDLE_TABLE_ENTRY pPage;
+    INTR_STATE oldState;
+    DWORD pageIndex;
+    BOOLEAN bAllocated;
+
+    ASSERT(NULL != Table);
+    ASSERT(NULL != Index);
+
+    pPage = NULL;
+    bAllocated = FALSE;
+
+    while (!bAllocated)
+    {
+        LockAcquire(&Table->Lock, &oldState);
+        if (HANDLE_TABLE_NO_FREE_ENTRY != Table->FreeListHead)
+        {
+            *Index = Table->FreeListHead;
+            Table->FreeListHead = Table->Pages[*Index / HANDLE_TABLE_ENTRIES_PER_PAGE][*Index % HANDLE_TABLE_ENTRIES_PER_PAGE].NextFree;
+            bAllocated = TRUE;
+        }
+        else if (Table->NumberOfEntries < HANDLE_TABLE_MAX_HANDLES)
+        {
+            pageIndex = Table->NumberOfEntries / HANDLE_TABLE_ENTRIES_PER_PAGE;
+
+            if (NULL == Table->Pages[pageIndex] && NULL != pPage)
+            {
+                Table->Pages[pageIndex] = pPage;
+                pPage = NULL;
+            }
+
+            if (NULL != Table->Pages[pageIndex])
+            {
+                *Index = Table->NumberOfEntries++;
+                bAllocated = TRUE;
+            }
+        }
+        else
+        {
+            LockRelease(&Table->Lock, oldState);
+            break;
+        }
+        LockRelease(&Table->Lock, oldState);
+
+        if (!bAllocated)
+        {
+            // the page is allocated without holding the lock, another thread
+            // may grow the table in the meantime
+            pPage = ExAllocatePoolWithTag(PoolAllocateZeroMemory, PAGE_SIZE, HEAP_PROCESS_TAG, 0);
+            if (NULL == pPage)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", PAGE_SIZE);
+                return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            }
+        }
+    }
+
+    if (NULL != pPage)
+    {
+        ExFreePoolWithTag(pPage, HEAP_PROCESS_TAG);
+    }
+
+    return bAllocated ? STATUS_SUCCESS : STATUS_LIMIT_REACHED;
+}
@@ -0,0 +1,611 @@
+#include "HAL9000.h"
+#include "image_cache.h"
+#include "mutex.h"
+#include "io.h"
+#include "vmm.h"
+#include "mmu.h"
+#include "pe_parser.h"
+
+// marks the pages of the image not covered by the headers or by any section
+#define IMAGE_PAGE_NOT_MAPPED               MAX_BYTE
+
+typedef struct _IMAGE_CACHE_ENTRY
+{
+    REF_COUNT                   RefCnt;
+
+    // Links the entry in the list of cached images, the list holds a
+    // reference to each image it contains
+    LIST_ENTRY                  ListEntry;
+
+    char*                       Path;
+
+    // together with the path these identify the contents of the file, if the
+    // executable is overwritten the cached image becomes stale
+    QWORD                       FileSize;
+    DATETIME                    LastWriteTime;
+
+    PFILE_OBJECT                File;
+
+    // Kernel mapping of the executable backed by the file, a page is read
+    // from the disk only when it is first touched. The frames of the pages
+    // which are not written by the processes are mapped in all of them.
+    PVOID                       Contents;
+
+    PE_NT_HEADER_INFO           HeaderInfo;
+
+    // the rights of each page of the image, IMAGE_PAGE_NOT_MAPPED if the page
+    // does not belong to the headers or to any section
+    DWORD                       NumberOfPages;
+    PBYTE                       PageRights;
+
+    // value of the use counter of the cache when the image was last referenced
+    QWORD                       LastUse;
+} IMAGE_CACHE_ENTRY;
+
+typedef struct _IMAGE_CACHE_DATA
+{
+    MUTEX                       Lock;
+
+    _Guarded_by_(Lock)
+    LIST_ENTRY                  ImageList;
+
+    _Guarded_by_(Lock)
+    DWORD                       NumberOfImages;
+
+    _Guarded_by_(Lock)
+    QWORD                       UseCounter;
+} IMAGE_CACHE_DATA, *PIMAGE_CACHE_DATA;
+
+static IMAGE_CACHE_DATA m_imageCacheData;
+
+static FUNC_FreeFunction        _ImageCacheDestroyEntry;
+
+REQUIRES_EXCL_LOCK(m_imageCacheData.Lock)
+static
+PTR_SUCCESS
+PIMAGE_CACHE_ENTRY
+_ImageCacheFindEntry(
+    IN_Z        char*                   Path,
+    IN          PFILE_INFORMATION       FileInformation
+    );
+
+REQUIRES_EXCL_LOCK(m_imageCacheData.Lock)
+static
+void
+_ImageCacheEvictEntry(
+    void
+    );
+
+static
+STATUS
+_ImageCacheCreateEntry(
+    IN_Z        char*                   Path,
+    IN          PFILE_OBJECT            File,
+    IN          PFILE_INFORMATION       FileInformation,
+    OUT_PTR     PIMAGE_CACHE_ENTRY*     Image
+    );
+
+static
+STATUS
+_ImageCacheComputePageRights(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    );
+
+_No_competing_thread_
+void
+ImageCachePreinit(
+    void
+    )
+{
+    memzero(&m_imageCacheData, sizeof(IMAGE_CACHE_DATA));
+
+    MutexInit(&m_imageCacheData.Lock, FALSE);
+    InitializeListHead(&m_imageCacheData.ImageList);
+}
+
+STATUS
+ImageCacheReferenceImage(
+    IN_Z        char*                   Path,
+    OUT_PTR     PIMAGE_CACHE_ENTRY*     Image
+    )
+{
+    STATUS status;
+    PFILE_OBJECT pFile;
+    FILE_INFORMATION fileInfo;
+    PIMAGE_CACHE_ENTRY pImage;
+
+    if (Path == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Image == NULL)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pFile = NULL;
+    memzero(&fileInfo, sizeof(FILE_INFORMATION));
+    pImage = NULL;
+
+    status = IoCreateFile(&pFile,
+                          Path,
+                          FALSE,
+                          FALSE,
+                          FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_TRACE_USERMODE("[ERROR] IoCreateFile with status 0x%x\n", status);
+        return status;
+    }
+
+    // The lock is held while the headers of a new image are read, this way
+    // two processes started from the same executable do not both load it
+    MutexAcquire(&m_imageCacheData.Lock);
+
+    __try
+    {
+        status = IoQueryInformationFile(pFile,
+                                        &fileInfo);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoQueryInformationFile", status);
+            __leave;
+        }
+
+        pImage = _ImageCacheFindEntry(Path, &fileInfo);
+        if (pImage != NULL)
+        {
+            LOG_TRACE_USERMODE("Image of [%s] found in cache at 0x%X\n", Path, pImage);
+            __leave;
+        }
+
+        if (m_imageCacheData.NumberOfImages >= IMAGE_CACHE_MAX_ENTRIES)
+        {
+            _ImageCacheEvictEntry();
+        }
+
+        // the new image takes over the file object
+        status = _ImageCacheCreateEntry(Path,
+                                        pFile,
+                                        &fileInfo,
+                                        &pImage);
+        pFile = NULL;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_ImageCacheCreateEntry", status);
+            __leave;
+        }
+
+        InsertTailList(&m_imageCacheData.ImageList, &pImage->ListEntry);
+        m_imageCacheData.NumberOfImages++;
+
+        LOG_TRACE_USERMODE("Image of [%s] with %u pages added to cache at 0x%X\n",
+                           Path, pImage->NumberOfPages, pImage);
+    }
+    __finally
+    {
+        if (SUCCEEDED(status))
+        {
+            ASSERT(pImage != NULL);
+
+            // reference held by the caller
+            RfcReference(&pImage->RefCnt);
+            pImage->LastUse = ++m_imageCacheData.UseCounter;
+
+            *Image = pImage;
+        }
+
+        MutexRelease(&m_imageCacheData.Lock);
+
+        if (pFile != NULL)
+        {
+            IoCloseFile(pFile);
+            pFile = NULL;
+        }
+    }
+
+    return status;
+}
+
+void
+ImageCacheReference(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    )
+{
+    ASSERT(Image != NULL);
+
+    RfcReference(&Image->RefCnt);
+}
+
+void
+ImageCacheDereferenceImage(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    )
+{
+    ASSERT(Image != NULL);
+
+    RfcDereference(&Image->RefCnt);
+}
+
+PPE_NT_HEADER_INFO
+ImageCacheGetHeaderInfo(
+    IN          PIMAGE_CACHE_ENTRY      Image
+    )
+{
+    ASSERT(Image != NULL);
+
+    return &Image->HeaderInfo;
+}
+
+STATUS
+ImageCacheGetPage(
+    IN          PIMAGE_CACHE_ENTRY      Image,
+    IN          QWORD                   Offset,
+    OUT         PAGE_RIGHTS*            PageRights,
+    OUT_PTR_MAYBE_NULL
+                PVOID*                  KernelAddress
+    )
+{
+    QWORD pageIndex;
+    PVOID pPage;
+
+    ASSERT(Image != NULL);
+    ASSERT(PageRights != NULL);
+    ASSERT(KernelAddress != NULL);
+
+    pageIndex = Offset / PAGE_SIZE;
+    if (pageIndex >= Image->NumberOfPages || Image->PageRights[pageIndex] == IMAGE_PAGE_NOT_MAPPED)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pPage = NULL;
+    if (pageIndex * PAGE_SIZE < Image->FileSize)
+    {
+        pPage = PtrOffset(Image->Contents, pageIndex * PAGE_SIZE);
+
+        // if this is the first time the page is needed it is read from the
+        // file by the VMM
+        MmuProbeMemory(pPage, PAGE_SIZE);
+    }
+
+    *PageRights = Image->PageRights[pageIndex];
+    *KernelAddress = pPage;
+
+    return STATUS_SUCCESS;
+}
+
+REQUIRES_EXCL_LOCK(m_imageCacheData.Lock)
+static
+PTR_SUCCESS
+PIMAGE_CACHE_ENTRY
+_ImageCacheFindEntry(
+    IN_Z        char*                   Path,
+    IN          PFILE_INFORMATION       FileInformation
+    )
+{
+    PLIST_ENTRY pEntry;
+    PIMAGE_CACHE_ENTRY pImage;
+
+    for (pEntry = m_imageCacheData.ImageList.Flink;
+         pEntry != &m_imageCacheData.ImageList;
+         pEntry = pEntry->Flink)
+    {
+        pImage = CONTAINING_RECORD(pEntry, IMAGE_CACHE_ENTRY, ListEntry);
+
+        if (stricmp(pImage->Path, Path) != 0)
+        {
+            continue;
+        }
+
+        if (pImage->FileSize == FileInformation->FileSize
+            && memcmp(&pImage->LastWriteTime, &FileInformation->LastWriteTime, sizeof(DATETIME)) == 0)
+        {
+            return pImage;
+        }
+
+        // The executable was modified since it was cached, the processes
+        // already running keep using the old image until they terminate
+        LOG_TRACE_USERMODE("Image of [%s] is stale, will remove it from cache\n", Path);
+
+        RemoveEntryList(&pImage->ListEntry);
+        m_imageCacheData.NumberOfImages--;
+        RfcDereference(&pImage->RefCnt);
+
+        // there is at most one entry for each path
+        break;
+    }
+
+    return NULL;
+}
+
+REQUIRES_EXCL_LOCK(m_imageCacheData.Lock)
+static
+void
+_ImageCacheEvictEntry(
+    void
+    )
+{
+    PLIST_ENTRY pEntry;
+    PIMAGE_CACHE_ENTRY pImage;
+    PIMAGE_CACHE_ENTRY pVictim;
+
+    pVictim = NULL;
+
+    for (pEntry = m_imageCacheData.ImageList.Flink;
+         pEntry != &m_imageCacheData.ImageList;
+         pEntry = pEntry->Flink)
+    {
+        pImage = CONTAINING_RECORD(pEntry, IMAGE_CACHE_ENTRY, ListEntry);
+
+        // images mapped by a process are not evicted, new references are only
+        // taken with the lock held so the count cannot increase meanwhile
+        if (pImage->RefCnt.ReferenceCount != 1)
+        {
+            continue;
+        }
+
+        if (pVictim == NULL || pImage->LastUse < pVictim->LastUse)
+        {
+            pVictim = pImage;
+        }
+    }
+
+    if (pVictim == NULL)
+    {
+        // all the images are in use, the cache grows over its limit until
+        // one of them is no longer mapped
+        LOG_WARNING("All the %u cached images are in use!\n", m_imageCacheData.NumberOfImages);
+        return;
+    }
+
+    LOG_TRACE_USERMODE("Will evict image of [%s] from cache\n", pVictim->Path);
+
+    RemoveEntryList(&pVictim->ListEntry);
+    m_imageCacheData.NumberOfImages--;
+    RfcDereference(&pVictim->RefCnt);
+}
+
+static
+STATUS
+_ImageCacheCreateEntry(
+    IN_Z        char*                   Path,
+    IN          PFILE_OBJECT            File,
+    IN          PFILE_INFORMATION       FileInformation,
+    OUT_PTR     PIMAGE_CACHE_ENTRY*     Image
+    )
+{
+    STATUS status;
+    PIMAGE_CACHE_ENTRY pImage;
+    DWORD pathSize;
+
+    ASSERT(Path != NULL);
+    ASSERT(File != NULL);
+    ASSERT(FileInformation != NULL);
+    ASSERT(Image != NULL);
+
+    status = STATUS_SUCCESS;
+    pathSize = strlen(Path) + 1;
+
+    pImage = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(IMAGE_CACHE_ENTRY), HEAP_IMAGE_TAG, 0);
+    if (pImage == NULL)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(IMAGE_CACHE_ENTRY));
+        IoCloseFile(File);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    // from this point on the file is closed by _ImageCacheDestroyEntry
+    pImage->File = File;
+    pImage->FileSize = FileInformation->FileSize;
+    pImage->LastWriteTime = FileInformation->LastWriteTime;
+
+    RfcPreInit(&pImage->RefCnt);
+
+    // the reference of the cache list
+    status = RfcInit(&pImage->RefCnt, _ImageCacheDestroyEntry, NULL);
+    ASSERT(SUCCEEDED(status));
+
+    __try
+    {
+        pImage->Path = ExAllocatePoolWithTag(PoolAllocateZeroMemory, pathSize, HEAP_IMAGE_TAG, 0);
+        if (pImage->Path == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", pathSize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+        strcpy(pImage->Path, Path);
+
+        LOG_TRACE_USERMODE("Executable has %U bytes length, file object at 0x%X!\n", pImage->FileSize, File);
+        ASSERT(pImage->FileSize <= MAX_DWORD);
+
+        // Only reserve the mapping of the file, its pages are read when they
+        // are first accessed
+        pImage->Contents = VmmAllocRegionEx(NULL,
+                                            pImage->FileSize,
+                                            VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                                            PAGE_RIGHTS_READWRITE,
+                                            FALSE,
+                                            File,
+                                            NULL,
+                                            NULL,
+                                            NULL);
+        if (pImage->Contents == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", pImage->FileSize);
+            status = STATUS_MEMORY_CANNOT_BE_COMMITED;
+            __leave;
+        }
+
+        // the parser only touches the pages holding the headers
+        status = PeRetrieveNtHeader(pImage->Contents,
+                                    (DWORD)pImage->FileSize,
+                                    &pImage->HeaderInfo);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PeRetrieveNtHeader", status);
+            __leave;
+        }
+
+        // The offset of each page in the file must be the same as its offset
+        // in the image for the frames of the file to be mapped in processes
+        if (pImage->HeaderInfo.FileAlignment != pImage->HeaderInfo.ImageAlignment)
+        {
+            LOG_ERROR("We do not support loading PEs which have a different file alignment 0x%x than section alignment 0x%x!\n",
+                      pImage->HeaderInfo.FileAlignment, pImage->HeaderInfo.ImageAlignment);
+            status = STATUS_NOT_IMPLEMENTED;
+            __leave;
+        }
+
+        status = _ImageCacheComputePageRights(pImage);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_ImageCacheComputePageRights", status);
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (SUCCEEDED(status))
+        {
+            *Image = pImage;
+        }
+        else
+        {
+            RfcDereference(&pImage->RefCnt);
+            pImage = NULL;
+        }
+    }
+
+    return status;
+}
+
+static
+STATUS
+_ImageCacheComputePageRights(
+    INOUT       PIMAGE_CACHE_ENTRY      Image
+    )
+{
+    STATUS status;
+    PE_SECTION_INFO section;
+    PAGE_RIGHTS sectionRights;
+    QWORD startOffset;
+    QWORD endOffset;
+    DWORD pageIndex;
+    DWORD i;
+
+    ASSERT(Image != NULL);
+
+    status = STATUS_SUCCESS;
+
+    Image->NumberOfPages = (DWORD) (AlignAddressUpper(Image->HeaderInfo.Size, PAGE_SIZE) / PAGE_SIZE);
+
+    Image->PageRights = ExAllocatePoolWithTag(0, Image->NumberOfPages, HEAP_IMAGE_TAG, 0);
+    if (Image->PageRights == NULL)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", Image->NumberOfPages);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memset(Image->PageRights, IMAGE_PAGE_NOT_MAPPED, Image->NumberOfPages);
+
+    // the headers are mapped read-only
+    for (pageIndex = 0;
+         pageIndex < AlignAddressUpper(Image->HeaderInfo.SizeOfHeaders, PAGE_SIZE) / PAGE_SIZE && pageIndex < Image->NumberOfPages;
+         ++pageIndex)
+    {
+        Image->PageRights[pageIndex] = PAGE_RIGHTS_READ;
+    }
+
+    for (i = 0; i < Image->HeaderInfo.NumberOfSections; ++i)
+    {
+        status = PeRetrieveSection(&Image->HeaderInfo,
+                                   i,
+                                   &section);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PeRetrieveSection", status);
+            return status;
+        }
+
+        sectionRights  = IsBooleanFlagOn(section.Characteristics, IMAGE_SCN_MEM_READ) ? PAGE_RIGHTS_READ : 0;
+        sectionRights |= IsBooleanFlagOn(section.Characteristics, IMAGE_SCN_MEM_WRITE) ? PAGE_RIGHTS_WRITE : 0;
+        sectionRights |= IsBooleanFlagOn(section.Characteristics, IMAGE_SCN_MEM_EXECUTE) ? PAGE_RIGHTS_EXECUTE : 0;
+
+        // The PE header tells us the section of the size without regard to the image's alignment
+        startOffset = PtrDiff(section.BaseAddress, Image->HeaderInfo.ImageBase);
+        endOffset = startOffset + AlignAddressUpper(section.Size, Image->HeaderInfo.ImageAlignment);
+
+        LOG_TRACE_USERMODE("Section %u at offset 0x%X of size 0x%x has rights 0x%x\n",
+                           i, startOffset, section.Size, sectionRights);
+
+        // a page shared by several sections gets the rights of all of them
+        for (pageIndex = (DWORD) (startOffset / PAGE_SIZE);
+             pageIndex < AlignAddressUpper(endOffset, PAGE_SIZE) / PAGE_SIZE && pageIndex < Image->NumberOfPages;
+             ++pageIndex)
+        {
+            if (Image->PageRights[pageIndex] == IMAGE_PAGE_NOT_MAPPED)
+            {
+                Image->PageRights[pageIndex] = (BYTE) sectionRights;
+            }
+            else
+            {
+                Image->PageRights[pageIndex] |= (BYTE) sectionRights;
+            }
+
+            // Because the alignment of the sections may be less than a PAGE_SIZE we may incur executables which
+            // have this undesirable property (of having a PAGE mapped with both execute and write rights)
+            if (IsBooleanFlagOn(Image->PageRights[pageIndex], PAGE_RIGHTS_EXECUTE | PAGE_RIGHTS_WRITE))
+            {
+                LOG_WARNING("Page %u of the image will be Write + Execute!!\n", pageIndex);
+            }
+        }
+    }
+
+    return status;
+}
+
+static
+void
+(__cdecl _ImageCacheDestroyEntry)(
+    IN      PVOID                   Object,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PIMAGE_CACHE_ENTRY pImage;
+
+    ASSERT( NULL != Object );
+    ASSERT( NULL == Context );
+
+    pImage = CONTAINING_RECORD(Object, IMAGE_CACHE_ENTRY, RefCnt);
+
+    LOG_TRACE_USERMODE("Will destroy cached image 0x%X\n", pImage);
+
+    // No process maps the image anymore, the frames read from the file can be
+    // released
+    if (pImage->Contents != NULL)
+    {
+        VmmFreeRegionEx(pImage->Contents, 0, VMM_FREE_TYPE_RELEASE, TRUE, NULL, NULL);
+        pImage->Contents = NULL;
+    }
+
+    if (pImage->PageRights != NULL)
+    {
+        ExFreePoolWithTag(pImage->PageRights, HEAP_IMAGE_TAG);
+        pImage->PageRights = NULL;
+    }
+
+    if (pImage->Path != NULL)
+    {
+        ExFreePoolWithTag(pImage->Path, HEAP_IMAGE_TAG);
+        pImage->Path = NULL;
+    }
+
+    ASSERT(pImage->File != NULL);
+    IoCloseFile(pImage->File);
+    pImage->File = NULL;
+
+    ExFreePoolWithTag(pImage, HEAP_IMAGE_TAG);
+}
@@ -9,6 +9,22 @@
 #include "mmu.h"
 #include "vmm.h"
 #include "os_time.h"
+#include "cpumu.h"
+#include "ex_event.h"
+
+struct _IO_COMPLETION_QUEUE
+{
+    LOCK                        Lock;
+
+    _Guarded_by_(Lock)
+    LIST_ENTRY                  CompletedList;
+
+    _Guarded_by_(Lock)
+    DWORD                       NumberOfEntries;
+
+    // signaled while CompletedList is not empty
+    EX_EVENT                    EntriesAvailable;
+};
 
 /// TODO: These function calls cross trust boundaries, validate parameters
 /// and do not ASSERT
@@ -29,12 +45,34 @@ _IoReadWriteDevice(
     _When_(Write,OUT_WRITES_BYTES(*Length))
     _When_(!Write,IN_READS_BYTES(*Length))
                 PVOID                   Buffer,
+    IN_OPT      PMDL                    Mdl,
     INOUT       QWORD*                  Length,
     IN          QWORD                   Offset,
     IN          BOOLEAN                 Write,
     IN          BOOLEAN                 Asynchronous
     );
 
+static
+STATUS
+_IoReadWriteDeviceAsync(
+    IN          PDEVICE_OBJECT          DeviceObject,
+    _When_(!Write,OUT_WRITES_BYTES(Length))
+    _When_(Write,IN_READS_BYTES(Length))
+                PVOID                   Buffer,
+    IN          QWORD                   Length,
+    IN          QWORD                   Offset,
+    IN          BOOLEAN                 Write,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    );
+
+static
+void
+_IoCompletionQueuePost(
+    INOUT       PIO_COMPLETION_QUEUE    Queue,
+    INOUT       PIRP                    Irp
+    );
+
 static
 void
 _IoAllocateVpb(
@@ -260,28 +298,127 @@ IoAttachDevice(
     SourceDevice->StackSize = TargetDevice->StackSize + 1;
 }
 
-PTR_SUCCESS
+static
 PIRP
-IoAllocateIrp(
+_IoLookasidePopIrp(
     IN      BYTE            StackSize
     )
+{
+    PIRP_LOOKASIDE pLookaside;
+    PIRP pIrp;
+    INTR_STATE oldState;
+
+    ASSERT(StackSize > 0);
+
+    if (StackSize > IRP_LOOKASIDE_MAX_STACK_SIZE)
+    {
+        return NULL;
+    }
+
+    oldState = CpuIntrDisable();
+
+    pLookaside = &GetCurrentPcpu()->IrpLookaside;
+
+    pIrp = pLookaside->FreeList[StackSize - 1];
+    if (NULL != pIrp)
+    {
+        pLookaside->FreeList[StackSize - 1] = *((PVOID*)pIrp);
+        pLookaside->Depth[StackSize - 1]--;
+        pLookaside->Hits++;
+    }
+    else
+    {
+        pLookaside->Misses++;
+    }
+
+    CpuIntrSetState(oldState);
+
+    return pIrp;
+}
+
+static
+BOOLEAN
+_IoLookasidePushIrp(
+    IN      PIRP            Irp
+    )
+{
+    PIRP_LOOKASIDE pLookaside;
+    BYTE stackSize;
+    BOOLEAN bCached;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Irp);
+
+    stackSize = Irp->StackSize;
+    ASSERT(stackSize > 0);
+
+    if (stackSize > IRP_LOOKASIDE_MAX_STACK_SIZE)
+    {
+        return FALSE;
+    }
+
+    oldState = CpuIntrDisable();
+
+    pLookaside = &GetCurrentPcpu()->IrpLookaside;
+
+    bCached = pLookaside->Depth[stackSize - 1] < IRP_LOOKASIDE_MAX_DEPTH;
+    if (bCached)
+    {
+        *((PVOID*)Irp) = pLookaside->FreeList[stackSize - 1];
+        pLookaside->FreeList[stackSize - 1] = Irp;
+        pLookaside->Depth[stackSize - 1]++;
+    }
+
+    CpuIntrSetState(oldState);
+
+    return bCached;
+}
+
+PTR_SUCCESS
+PIRP
+IoAllocateIrpEx(
+    IN      BYTE            StackSize,
+    OUT_OPT PIO_STACK_IRP   StackIrp
+    )
 {
     PIRP pIrp;
     DWORD irpSize;
+    BOOLEAN bCallerAllocated;
 
     ASSERT(StackSize > 0);
 
     pIrp = NULL;
-    irpSize = sizeof(IRP) + StackSize * sizeof(IO_STACK_LOCATION);
+    irpSize = IO_IRP_SIZE(StackSize);
+    bCallerAllocated = FALSE;
 
     LOG_TRACE_IO("Irp has %d stack locations\n", StackSize);
 
-    pIrp = ExAllocatePoolWithTag(PoolAllocateZeroMemory, irpSize, HEAP_IRP_TAG, 0);
-    if (NULL == pIrp)
+    if (NULL != StackIrp && StackSize <= IO_STACK_IRP_MAX_STACK_SIZE)
     {
-        LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", irpSize );
-        return NULL;
+        pIrp = (PIRP) StackIrp;
+        bCallerAllocated = TRUE;
     }
+    else
+    {
+        pIrp = _IoLookasidePopIrp(StackSize);
+    }
+
+    if (NULL != pIrp)
+    {
+        memzero(pIrp, irpSize);
+    }
+    else
+    {
+        pIrp = ExAllocatePoolWithTag(PoolAllocateZeroMemory, irpSize, HEAP_IRP_TAG, 0);
+        if (NULL == pIrp)
+        {
+            LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", irpSize );
+            return NULL;
+        }
+    }
+
+    pIrp->Flags.CallerAllocated = bCallerAllocated;
+    pIrp->StackSize = StackSize;
 
     // set current stack location
     // this is intentionally not set to StackSize - 1 because
@@ -301,10 +438,20 @@ IoFreeIrp(
 {
     ASSERT(NULL != Irp);
 
-    if (NULL != Irp->Mdl)
+    if (NULL != Irp->Mdl && !Irp->Flags.CallerMdl)
     {
         IoFreeMdl(Irp->Mdl);
-        Irp->Mdl = NULL;
+    }
+    Irp->Mdl = NULL;
+
+    if (Irp->Flags.CallerAllocated)
+    {
+        return;
+    }
+
+    if (_IoLookasidePushIrp(Irp))
+    {
+        return;
     }
 
     ExFreePoolWithTag(Irp, HEAP_IRP_TAG);
@@ -352,6 +499,28 @@ IoCopyCurrentStackLocationToNext(
     LOG_TRACE_IO("Current stack location: %d\n", currentStackLocation);
 
     memcpy(&Irp->StackLocations[currentStackLocation - 1], &Irp->StackLocations[currentStackLocation], sizeof(IO_STACK_LOCATION));
+
+    // the completion routine belongs to the driver above us
+    Irp->StackLocations[currentStackLocation - 1].CompletionRoutine = NULL;
+    Irp->StackLocations[currentStackLocation - 1].CompletionContext = NULL;
+}
+
+void
+IoSetCompletionRoutine(
+    INOUT   PIRP                        Irp,
+    IN      PFUNC_IoCompletionRoutine   CompletionRoutine,
+    IN_OPT  PVOID                       Context
+    )
+{
+    PIO_STACK_LOCATION pStackLocation;
+
+    ASSERT(NULL != Irp);
+    ASSERT(NULL != CompletionRoutine);
+
+    pStackLocation = IoGetNextIrpStackLocation(Irp);
+
+    pStackLocation->CompletionRoutine = CompletionRoutine;
+    pStackLocation->CompletionContext = Context;
 }
 
 STATUS
@@ -364,6 +533,9 @@ IoCallDriver(
     PIO_STACK_LOCATION pStackLocation;
     PDRIVER_OBJECT pDriver;
     PFUNC_DriverDispatch pDispatchFunction;
+    BOOLEAN bWaitForCompletion;
+    EX_EVENT completionEvent;
+    INTR_STATE intrState;
 
     ASSERT(NULL != Device);
     ASSERT(NULL != Irp);
@@ -373,10 +545,18 @@ IoCallDriver(
     status = STATUS_SUCCESS;
     pStackLocation = NULL;
 
+    // if the originator has no way of being notified of the completion we
+    // wait for it here, this keeps the IRP synchronous for the callers which
+    // expect the result to be available as soon as we return
+    bWaitForCompletion = Irp->CurrentStackLocation == Irp->StackSize
+                         && NULL == Irp->CompletionQueue
+                         && NULL == IoGetNextIrpStackLocation(Irp)->CompletionRoutine;
+
     ASSERT(0 != Irp->CurrentStackLocation);
     Irp->CurrentStackLocation = Irp->CurrentStackLocation - 1;
 
     pStackLocation = IoGetCurrentIrpStackLocation(Irp);
+    pStackLocation->DeviceObject = Device;
 
     if ((IRP_MJ_READ == pStackLocation->MajorFunction) || (IRP_MJ_WRITE == pStackLocation->MajorFunction))
     {
@@ -395,6 +575,14 @@ IoCallDriver(
         }
     }
 
+    if (bWaitForCompletion)
+    {
+        status = ExEventInit(&completionEvent, ExEventTypeNotification, FALSE);
+        ASSERT(SUCCEEDED(status));
+
+        Irp->CompletionEvent = &completionEvent;
+    }
+
     pDriver = Device->DriverObject;
     ASSERT(NULL != pDriver);
 
@@ -403,6 +591,11 @@ IoCallDriver(
     {
         status = STATUS_DEVICE_INVALID_OPERATION;
     }
+    else if (Device->ConcurrentDispatch)
+    {
+        // the driver synchronizes its own requests
+        status = pDispatchFunction(Device, Irp);
+    }
     else
     {
         MutexAcquire(&Device->DeviceLock);
@@ -411,12 +604,37 @@ IoCallDriver(
     }
     if (!SUCCEEDED(status))
     {
+        if (bWaitForCompletion)
+        {
+            Irp->CompletionEvent = NULL;
+        }
+
         return status;
     }
 
+    // if the IRP is pending we must not touch it unless we wait for it: the
+    // originator may free it as soon as it completes
+    if (bWaitForCompletion)
+    {
+        if (STATUS_PENDING == status)
+        {
+            ExEventWaitForSignal(&completionEvent);
+
+            // the completion path may still hold the event lock after the signal
+            // was seen, make sure it is done with it before the event goes away
+            LockAcquire(&completionEvent.EventLock, &intrState);
+            LockRelease(&completionEvent.EventLock, intrState);
+
+            status = STATUS_SUCCESS;
+        }
+
+        ASSERT(IoIsIrpComplete(Irp));
+        Irp->CompletionEvent = NULL;
+    }
+
     LOG_FUNC_END;
 
-    return STATUS_SUCCESS;
+    return status;
 }
 
 void
@@ -424,10 +642,214 @@ IoCompleteIrp(
     INOUT   PIRP            Irp
     )
 {
+    PIO_STACK_LOCATION pStackLocation;
+    PFUNC_IoCompletionRoutine pCompletionRoutine;
+    PDEVICE_OBJECT pDevice;
+    PIO_COMPLETION_QUEUE pQueue;
+    PEX_EVENT pEvent;
+    BYTE i;
+
     ASSERT(NULL != Irp);
     ASSERT(FALSE == Irp->Flags.Completed);
 
+    // unwind the stack from the driver completing the IRP up to the originator
+    for (i = Irp->CurrentStackLocation; i < Irp->StackSize; ++i)
+    {
+        pStackLocation = &Irp->StackLocations[i];
+
+        pCompletionRoutine = pStackLocation->CompletionRoutine;
+        if (NULL == pCompletionRoutine)
+        {
+            continue;
+        }
+
+        // each routine is called once, even if the IRP is completed again
+        pStackLocation->CompletionRoutine = NULL;
+
+        // the routine belongs to the driver owning the previous stack location
+        Irp->CurrentStackLocation = i + 1;
+        pDevice = (i + 1 < Irp->StackSize) ? Irp->StackLocations[i + 1].DeviceObject : NULL;
+
+        if (STATUS_MORE_PROCESSING_REQUIRED == pCompletionRoutine(pDevice, Irp, pStackLocation->CompletionContext))
+        {
+            // the routine took ownership of the IRP
+            return;
+        }
+    }
+
+    pQueue = Irp->CompletionQueue;
+    pEvent = Irp->CompletionEvent;
+
     Irp->Flags.Completed = TRUE;
+
+    // the IRP may be freed by its owner as soon as it is posted
+    if (NULL != pQueue)
+    {
+        _IoCompletionQueuePost(pQueue, Irp);
+    }
+    else if (NULL != pEvent)
+    {
+        ExEventSignal(pEvent);
+    }
+}
+
+STATUS
+IoCreateCompletionQueue(
+    OUT_PTR     PIO_COMPLETION_QUEUE*   Queue
+    )
+{
+    STATUS status;
+    PIO_COMPLETION_QUEUE pQueue;
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    pQueue = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(IO_COMPLETION_QUEUE), HEAP_IO_COMPLETION_TAG, 0);
+    if (NULL == pQueue)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(IO_COMPLETION_QUEUE));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    LockInit(&pQueue->Lock);
+    InitializeListHead(&pQueue->CompletedList);
+
+    status = ExEventInit(&pQueue->EntriesAvailable, ExEventTypeNotification, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        ExFreePoolWithTag(pQueue, HEAP_IO_COMPLETION_TAG);
+        return status;
+    }
+
+    *Queue = pQueue;
+
+    return STATUS_SUCCESS;
+}
+
+void
+IoDestroyCompletionQueue(
+    IN          PIO_COMPLETION_QUEUE    Queue
+    )
+{
+    PIRP pIrp;
+
+    ASSERT(NULL != Queue);
+
+    while (SUCCEEDED(IoRemoveCompletionQueueEntry(Queue, FALSE, &pIrp, NULL)))
+    {
+        IoFreeIrp(pIrp);
+    }
+
+    ExFreePoolWithTag(Queue, HEAP_IO_COMPLETION_TAG);
+}
+
+void
+IoSetIrpCompletionQueue(
+    INOUT       PIRP                    Irp,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    )
+{
+    ASSERT(NULL != Irp);
+    ASSERT(NULL != Queue);
+
+    // a queued IRP is freed by whoever removes it from the queue
+    ASSERT(!Irp->Flags.CallerAllocated);
+
+    Irp->CompletionQueue = Queue;
+    Irp->CompletionKey = CompletionKey;
+}
+
+STATUS
+IoRemoveCompletionQueueEntry(
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN          BOOLEAN                 Wait,
+    OUT_PTR     PIRP*                   Irp,
+    OUT_OPT     PVOID*                  CompletionKey
+    )
+{
+    PLIST_ENTRY pEntry;
+    PIRP pIrp;
+    INTR_STATE intrState;
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Irp)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pIrp = NULL;
+
+    for (;;)
+    {
+        if (Wait)
+        {
+            ExEventWaitForSignal(&Queue->EntriesAvailable);
+        }
+
+        LockAcquire(&Queue->Lock, &intrState);
+
+        pEntry = RemoveHeadList(&Queue->CompletedList);
+        if (pEntry != &Queue->CompletedList)
+        {
+            pIrp = CONTAINING_RECORD(pEntry, IRP, CompletionListEntry);
+            Queue->NumberOfEntries--;
+        }
+
+        // the event is cleared only while holding the lock and only if the
+        // list is empty => a post following this will signal it again
+        if (IsListEmpty(&Queue->CompletedList))
+        {
+            ExEventClearSignal(&Queue->EntriesAvailable);
+        }
+
+        LockRelease(&Queue->Lock, intrState);
+
+        if (NULL != pIrp || !Wait)
+        {
+            break;
+        }
+    }
+
+    if (NULL == pIrp)
+    {
+        return STATUS_NO_DATA_AVAILABLE;
+    }
+
+    *Irp = pIrp;
+    if (NULL != CompletionKey)
+    {
+        *CompletionKey = pIrp->CompletionKey;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_IoCompletionQueuePost(
+    INOUT       PIO_COMPLETION_QUEUE    Queue,
+    INOUT       PIRP                    Irp
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Queue);
+    ASSERT(NULL != Irp);
+
+    LockAcquire(&Queue->Lock, &intrState);
+    InsertTailList(&Queue->CompletedList, &Irp->CompletionListEntry);
+    Queue->NumberOfEntries++;
+    LockRelease(&Queue->Lock, intrState);
+
+    ExEventSignal(&Queue->EntriesAvailable);
 }
 
 static
@@ -437,6 +859,7 @@ _IoReadWriteDevice(
     _When_(!Write,OUT_WRITES_BYTES(*Length))
     _When_(Write,IN_READS_BYTES(*Length))
                 PVOID                   Buffer,
+    IN_OPT      PMDL                    Mdl,
     INOUT       QWORD*                  Length,
     IN          QWORD                   Offset,
     IN          BOOLEAN                 Write,
@@ -446,6 +869,7 @@ _IoReadWriteDevice(
     STATUS status;
     PIRP pIrp;
     PIO_STACK_LOCATION pStackLocation;
+    IO_STACK_IRP stackIrp;
 
     ASSERT(NULL != DeviceObject);
     ASSERT(NULL != Buffer);
@@ -455,7 +879,9 @@ _IoReadWriteDevice(
     pIrp = NULL;
     pStackLocation = NULL;
 
-    pIrp = IoAllocateIrp(DeviceObject->StackSize);
+    // a synchronous request is completed before IoCallDriver returns => the
+    // IRP can live on our stack
+    pIrp = IoAllocateIrpEx(DeviceObject->StackSize, Asynchronous ? NULL : &stackIrp);
     ASSERT(NULL != pIrp);
 
     pStackLocation = IoGetNextIrpStackLocation(pIrp);
@@ -464,6 +890,12 @@ _IoReadWriteDevice(
     pIrp->Buffer = Buffer;
     pIrp->Flags.Asynchronous = Asynchronous;
 
+    if (NULL != Mdl)
+    {
+        pIrp->Mdl = Mdl;
+        pIrp->Flags.CallerMdl = TRUE;
+    }
+
     pStackLocation->Parameters.ReadWrite.Length = *Length;
     pStackLocation->Parameters.ReadWrite.Offset = Offset;
 
@@ -498,6 +930,70 @@ _IoReadWriteDevice(
     return status;
 }
 
+static
+STATUS
+_IoReadWriteDeviceAsync(
+    IN          PDEVICE_OBJECT          DeviceObject,
+    _When_(!Write,OUT_WRITES_BYTES(Length))
+    _When_(Write,IN_READS_BYTES(Length))
+                PVOID                   Buffer,
+    IN          QWORD                   Length,
+    IN          QWORD                   Offset,
+    IN          BOOLEAN                 Write,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    PIO_STACK_LOCATION pStackLocation;
+
+    if (NULL == DeviceObject)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER6;
+    }
+
+    pIrp = IoAllocateIrp(DeviceObject->StackSize);
+    if (NULL == pIrp)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateIrp", IO_IRP_SIZE(DeviceObject->StackSize));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pStackLocation = IoGetNextIrpStackLocation(pIrp);
+    pStackLocation->MajorFunction = Write ? IRP_MJ_WRITE : IRP_MJ_READ;
+    pStackLocation->Parameters.ReadWrite.Length = Length;
+    pStackLocation->Parameters.ReadWrite.Offset = Offset;
+
+    pIrp->Buffer = Buffer;
+    pIrp->Flags.Asynchronous = TRUE;
+
+    IoSetIrpCompletionQueue(pIrp, Queue, CompletionKey);
+
+    status = IoCallDriver(DeviceObject, pIrp);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoCallDriver", status);
+
+        // the IRP was not completed => it will never reach the queue
+        IoFreeIrp(pIrp);
+        return status;
+    }
+
+    // even if the driver already completed it the result is found on the queue
+    return STATUS_PENDING;
+}
+
 static
 void
 _IoAllocateVpb(
@@ -755,13 +1251,14 @@ PIRP
 // I'm really not proud of this, but there is no other way to tell SAL what's going on
 // and Microsoft does the exact same hack... You learn from the best!
 #pragma warning(suppress: 6101)
-IoBuildDeviceIoControlRequest(
+IoBuildDeviceIoControlRequestEx(
     IN          DWORD            IoControlCode,
     IN          PDEVICE_OBJECT   DeviceObject,
     IN_OPT      PVOID            InputBuffer,
     IN          DWORD            InputBufferLength,
     OUT_OPT     PVOID            OutputBuffer,
-    IN          DWORD            OutputBufferLength
+    IN          DWORD            OutputBufferLength,
+    OUT_OPT     PIO_STACK_IRP    StackIrp
     )
 {
     PIRP pIrp;
@@ -769,10 +1266,10 @@ IoBuildDeviceIoControlRequest(
 
     ASSERT(NULL != DeviceObject);
 
-    pIrp = IoAllocateIrp(DeviceObject->StackSize);
+    pIrp = IoAllocateIrpEx(DeviceObject->StackSize, StackIrp);
     if (NULL == pIrp)
     {
-        LOG_ERROR("IoAllocateIrp failed!\n");
+        LOG_ERROR("IoAllocateIrpEx failed!\n");
         return NULL;
     }
 
@@ -800,7 +1297,7 @@ IoReadDeviceEx(
 {
     LOG_FUNC_START;
 
-    return _IoReadWriteDevice(DeviceObject, Buffer, Length, Offset, FALSE, Asynchronous);
+    return _IoReadWriteDevice(DeviceObject, Buffer, NULL, Length, Offset, FALSE, Asynchronous);
 }
 
 STATUS
@@ -814,7 +1311,79 @@ IoWriteDeviceEx(
 {
     LOG_FUNC_START;
 
-    return _IoReadWriteDevice(DeviceObject, Buffer, Length, Offset, TRUE, Asynchronous);
+    return _IoReadWriteDevice(DeviceObject, Buffer, NULL, Length, Offset, TRUE, Asynchronous);
+}
+
+STATUS
+IoReadDeviceWithMdl(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN                          PMDL                    Mdl,
+    INOUT                       QWORD*                  Length,
+    IN                          QWORD                   Offset
+    )
+{
+    LOG_FUNC_START;
+
+    if (NULL == Mdl)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Length || *Length > Mdl->ByteCount)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    return _IoReadWriteDevice(DeviceObject, Mdl->StartVa + Mdl->ByteOffset, Mdl, Length, Offset, FALSE, FALSE);
+}
+
+STATUS
+IoWriteDeviceWithMdl(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN                          PMDL                    Mdl,
+    INOUT                       QWORD*                  Length,
+    IN                          QWORD                   Offset
+    )
+{
+    LOG_FUNC_START;
+
+    if (NULL == Mdl)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Length || *Length > Mdl->ByteCount)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    return _IoReadWriteDevice(DeviceObject, Mdl->StartVa + Mdl->ByteOffset, Mdl, Length, Offset, TRUE, FALSE);
+}
+
+STATUS
+IoReadDeviceAsync(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    OUT_WRITES_BYTES(Length)    PVOID                   Buffer,
+    IN                          QWORD                   Length,
+    IN                          QWORD                   Offset,
+    IN                          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT                      PVOID                   CompletionKey
+    )
+{
+    return _IoReadWriteDeviceAsync(DeviceObject, Buffer, Length, Offset, FALSE, Queue, CompletionKey);
+}
+
+STATUS
+IoWriteDeviceAsync(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN_READS_BYTES(Length)      PVOID                   Buffer,
+    IN                          QWORD                   Length,
+    IN                          QWORD                   Offset,
+    IN                          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT                      PVOID                   CompletionKey
+    )
+{
+    return _IoReadWriteDeviceAsync(DeviceObject, Buffer, Length, Offset, TRUE, Queue, CompletionKey);
 }
 
 STATUS
@@ -878,6 +1447,32 @@ IoFreeMdl(
     LOG_FUNC_END;
 }
 
+PTR_SUCCESS
+PMDL
+IoGetCallerMdl(
+    IN          PIRP            Irp,
+    IN          PVOID           Buffer,
+    IN          DWORD           Length
+    )
+{
+    PMDL pMdl;
+
+    ASSERT(NULL != Irp);
+
+    pMdl = Irp->Mdl;
+    if (NULL == pMdl || !Irp->Flags.CallerMdl)
+    {
+        return NULL;
+    }
+
+    if (pMdl->StartVa + pMdl->ByteOffset != Buffer || pMdl->ByteCount < Length)
+    {
+        return NULL;
+    }
+
+    return pMdl;
+}
+
 SIZE_SUCCESS
 DWORD
 IoMdlGetNumberOfPairs(
@@ -1015,3 +1610,11 @@ IoGetCurrentDateTime(
 {
     return OsTimeGetCurrentDateTime();
 }
+
+QWORD
+IoGetSystemTimeUs(
+    void
+    )
+{
+    return IomuGetSystemTimeUs();
+}
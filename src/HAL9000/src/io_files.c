@@ -89,6 +89,20 @@ _IoReadWriteFile(
     IN          BOOLEAN                 Write
     );
 
+static
+STATUS
+_IoReadWriteFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    _When_(!Write,OUT_WRITES_BYTES(Length))
+    _When_(Write,IN_READS_BYTES(Length))
+                PVOID                   Buffer,
+    IN          QWORD                   Length,
+    IN          QWORD                   FileOffset,
+    IN          BOOLEAN                 Write,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    );
+
 STATUS
 IoCreateFile(
     OUT_PTR     PFILE_OBJECT*           Handle,
@@ -287,6 +301,46 @@ IoWriteFile(
                             TRUE);
 }
 
+STATUS
+IoReadFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    IN          QWORD                   BytesToRead,
+    IN          QWORD                   FileOffset,
+    OUT_WRITES_BYTES(BytesToRead)
+                PVOID                   Buffer,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    )
+{
+    return _IoReadWriteFileAsync(FileHandle,
+                                 Buffer,
+                                 BytesToRead,
+                                 FileOffset,
+                                 FALSE,
+                                 Queue,
+                                 CompletionKey);
+}
+
+STATUS
+IoWriteFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    IN          QWORD                   BytesToWrite,
+    IN          QWORD                   FileOffset,
+    IN_READS_BYTES(BytesToWrite)
+                PVOID                   Buffer,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    )
+{
+    return _IoReadWriteFileAsync(FileHandle,
+                                 Buffer,
+                                 BytesToWrite,
+                                 FileOffset,
+                                 TRUE,
+                                 Queue,
+                                 CompletionKey);
+}
+
 STATUS
 IoGetFileSize(
     IN          PFILE_OBJECT            FileHandle,
@@ -546,4 +600,73 @@ _IoReadWriteFile(
     }
 
     return status;
-}
\ No newline at end of file
+}
+
+static
+STATUS
+_IoReadWriteFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    _When_(!Write,OUT_WRITES_BYTES(Length))
+    _When_(Write,IN_READS_BYTES(Length))
+                PVOID                   Buffer,
+    IN          QWORD                   Length,
+    IN          QWORD                   FileOffset,
+    IN          BOOLEAN                 Write,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    PDEVICE_OBJECT pFileSystemDevice;
+    PIO_STACK_LOCATION pStackLocation;
+
+    if (NULL == FileHandle)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER6;
+    }
+
+    pFileSystemDevice = FileHandle->FileSystemDevice;
+    ASSERT(NULL != pFileSystemDevice);
+
+    pIrp = IoAllocateIrp(pFileSystemDevice->StackSize);
+    if (NULL == pIrp)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateIrp", sizeof(IRP));
+        return STATUS_HEAP_NO_MORE_MEMORY;
+    }
+    pIrp->Buffer = Buffer;
+
+    // the lower layers may complete the IRP from their interrupt handlers
+    pIrp->Flags.Asynchronous = TRUE;
+
+    pStackLocation = IoGetNextIrpStackLocation(pIrp);
+    pStackLocation->MajorFunction = Write ? IRP_MJ_WRITE : IRP_MJ_READ;
+    pStackLocation->DeviceObject = pFileSystemDevice;
+    pStackLocation->Parameters.ReadWrite.Length = Length;
+    pStackLocation->Parameters.ReadWrite.Offset = FileOffset;
+    pStackLocation->FileObject = FileHandle;
+
+    IoSetIrpCompletionQueue(pIrp, Queue, CompletionKey);
+
+    status = IoCallDriver(pFileSystemDevice, pIrp);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoCallDriver", status);
+
+        IoFreeIrp(pIrp);
+        return status;
+    }
+
+    return STATUS_PENDING;
+}
@@ -9,6 +9,7 @@
 #include "disk.h"
 #include "volume.h"
 #include "ata.h"
+#include "ahci.h"
 #include "filesystem.h"
 #include "fat32.h"
 #include "swapfs.h"
@@ -17,11 +18,13 @@
 #include "isr.h"
 #include "os_info.h"
 #include "eth_82574L.h"
+#include "loopback.h"
 #include "system_driver.h"
 #include "ioapic_system.h"
 #include "bitmap.h"
 #include "pit.h"
 #include "smp.h"
+#include "cpumu.h"
 #include "ex_system.h"
 #include "lock_common.h"
 
@@ -52,6 +55,8 @@ typedef struct _REGISTERED_INTERRUPT_ENTRY
     LIST_ENTRY                  ListEntry;
 
     PFUNC_InterruptFunction     Function;
+    PFUNC_InterruptFunctionEx   FunctionEx;
+    PVOID                       Context;
     PDEVICE_OBJECT              Device;
 } REGISTERED_INTERRUPT_ENTRY, *PREGISTERED_INTERRUPT_ENTRY;
 
@@ -114,11 +119,13 @@ static const DRIVER_DECLARATION SYSTEM_DRIVER = DECLARE_DRIVER( "system", System
 
 static const DRIVER_DECLARATION DRIVER_NAMES[] = {
     DECLARE_DRIVER("ata", AtaDriverEntry, FALSE),
+    DECLARE_DRIVER("ahci", AhciDriverEntry, FALSE),
     DECLARE_DRIVER("disk", DiskDriverEntry, FALSE),
     DECLARE_DRIVER("vol", VolDriverEntry, FALSE),
     DECLARE_DRIVER("fat", FatDriverEntry, FALSE),
     DECLARE_DRIVER("swapfs", SwapFsDriverEntry, FALSE),
-    DECLARE_DRIVER("eth82574L", Eth82574LDriverEntry, FALSE)
+    DECLARE_DRIVER("eth82574L", Eth82574LDriverEntry, FALSE),
+    DECLARE_DRIVER("loopback", LoopbackDriverEntry, FALSE)
 };
 
 static FUNC_CompareFunction     _VpbCompareFunction;
@@ -203,12 +210,19 @@ _IomuIsDeviceMsiCapable(
 static
 STATUS
 _IomuProgramPciInterrupt(
-    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PIO_INTERRUPT               Interrupt,
     IN          BYTE                        Vector,
+    IN          BYTE                        Destination,
     IN _Strict_type_match_
                 APIC_DELIVERY_MODE          DeliveryMode
     );
 
+static
+BYTE
+_IomuGetInterruptDestination(
+    IN          DWORD                       CpuIndex
+    );
+
 void
 _No_competing_thread_
 IomuPreinitSystem(
@@ -763,9 +777,10 @@ IomuRegisterInterrupt(
     INTR_STATE intrState;
     BOOLEAN bAcquiredListLock;
     INTR_STATE dummyState;
+    BYTE destination;
 
     ASSERT( NULL != Interrupt );
-    ASSERT( NULL != Interrupt->ServiceRoutine );
+    ASSERT( NULL != Interrupt->ServiceRoutine || NULL != Interrupt->ServiceRoutineEx );
 
 
     status = STATUS_SUCCESS;
@@ -776,6 +791,7 @@ IomuRegisterInterrupt(
     bIoApicEntryRegistered = FALSE;
     interruptVector = 0;
     apicDeliveryMode = Interrupt->BroadcastInterrupt ? ApicDeliveryModeFixed : ApicDeliveryModeLowest;
+    destination = MAX_BYTE;
     bMsiCapable = FALSE;
     bAcquiredListLock = FALSE;
     interruptIndex = MAX_BYTE;
@@ -789,10 +805,20 @@ IomuRegisterInterrupt(
     __try
     {
 
+        if (Interrupt->TargetCpu)
+        {
+            // a fixed interrupt delivered to a single logical destination
+            destination = _IomuGetInterruptDestination(Interrupt->CpuIndex);
+            apicDeliveryMode = ApicDeliveryModeFixed;
+        }
+
         interruptLine = MAX_BYTE;
         if (Interrupt->Type == IoInterruptTypePci)
         {
-            bMsiCapable = _IomuIsDeviceMsiCapable(Interrupt->Pci.PciDevice);
+            // if the caller asks for MSI-X the device must support it, there
+            // is no fallback to a shared interrupt because the caller most
+            // likely registers multiple vectors
+            bMsiCapable = (NULL != Interrupt->Pci.MsiXTable) || _IomuIsDeviceMsiCapable(Interrupt->Pci.PciDevice);
             if (!bMsiCapable)
             {
                 DWORD temp = IoApicGetInterruptLineForPciDevice(Interrupt->Pci.PciDevice);
@@ -917,6 +943,8 @@ IomuRegisterInterrupt(
         }
 
         pNewEntry->Function = Interrupt->ServiceRoutine;
+        pNewEntry->FunctionEx = Interrupt->ServiceRoutineEx;
+        pNewEntry->Context = Interrupt->ServiceContext;
         pNewEntry->Device = pDevObj;
 
         // there is no reason to maintain information about device exclusivity
@@ -935,8 +963,9 @@ IomuRegisterInterrupt(
                                 Interrupt->Pci.PciDevice->DeviceLocation.Device,
                                 Interrupt->Pci.PciDevice->DeviceLocation.Function);
 
-            status = _IomuProgramPciInterrupt(Interrupt->Pci.PciDevice,
+            status = _IomuProgramPciInterrupt(Interrupt,
                                               interruptVector,
+                                              destination,
                                               apicDeliveryMode);
             if (!SUCCEEDED(status))
             {
@@ -959,7 +988,7 @@ IomuRegisterInterrupt(
                                               apicDeliveryMode,
                                               (Interrupt->Type == IoInterruptTypePci) ? ApicPinPolarityActiveLow : ApicPinPolarityActiveHigh,
                                               (Interrupt->Type == IoInterruptTypePci) ? ApicTriggerModeLevel : ApicTriggerModeEdge,
-                                              MAX_BYTE,
+                                              destination,
                                               FALSE);
             if (!SUCCEEDED(status))
             {
@@ -1113,7 +1142,9 @@ BOOLEAN
     {
         PREGISTERED_INTERRUPT_ENTRY pEntry = CONTAINING_RECORD(pListEntry, REGISTERED_INTERRUPT_ENTRY, ListEntry);
 
-        bHandledInterrupt = pEntry->Function( pEntry->Device );
+        bHandledInterrupt = (NULL != pEntry->FunctionEx)
+                          ? pEntry->FunctionEx( pEntry->Device, pEntry->Context )
+                          : pEntry->Function( pEntry->Device );
         if (bHandledInterrupt)
         {
             break;
@@ -1328,16 +1359,22 @@ _IomuIsDeviceMsiCapable(
 static
 STATUS
 _IomuProgramPciInterrupt(
-    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PIO_INTERRUPT               Interrupt,
     IN          BYTE                        Vector,
+    IN          BYTE                        Destination,
     IN _Strict_type_match_
                 APIC_DELIVERY_MODE          DeliveryMode
     )
 {
     STATUS status;
+    PPCI_DEVICE_DESCRIPTION PciDevice;
+
+    ASSERT( NULL != Interrupt );
+    ASSERT( IoInterruptTypePci == Interrupt->Type );
 
+    PciDevice = Interrupt->Pci.PciDevice;
     ASSERT( NULL != PciDevice );
-    ASSERT(_IomuIsDeviceMsiCapable(PciDevice));
+    ASSERT( NULL != Interrupt->Pci.MsiXTable || _IomuIsDeviceMsiCapable(PciDevice));
 
     LOG_FUNC_START;
 
@@ -1350,21 +1387,76 @@ _IomuProgramPciInterrupt(
     LOG_TRACE_INTERRUPT("Successfully disabled legacy interrupts for PCI device at (%u.%u.%u)\n",
                         PciDevice->DeviceLocation.Bus, PciDevice->DeviceLocation.Device, PciDevice->DeviceLocation.Function );
 
-    status = PciDevProgramMsiInterrupt(PciDevice,
-                                       Vector,
-                                       ApicDestinationModeLogical,
-                                       MAX_BYTE,
-                                       DeliveryMode,
-                                       ApicPinPolarityActiveHigh,
-                                       ApicTriggerModeLevel
-                                       );
-    if (!SUCCEEDED(status))
+    if (NULL != Interrupt->Pci.MsiXTable)
     {
-        LOG_FUNC_ERROR("PciDevProgramMsiInterrupt", status );
-        return status;
+        status = PciDevProgramMsiXInterrupt(PciDevice,
+                                            Interrupt->Pci.MsiXTable,
+                                            Interrupt->Pci.MsiXEntry,
+                                            Vector,
+                                            ApicDestinationModeLogical,
+                                            Destination,
+                                            DeliveryMode
+                                            );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciDevProgramMsiXInterrupt", status );
+            return status;
+        }
+    }
+    else
+    {
+        status = PciDevProgramMsiInterrupt(PciDevice,
+                                           Vector,
+                                           ApicDestinationModeLogical,
+                                           Destination,
+                                           DeliveryMode,
+                                           ApicPinPolarityActiveHigh,
+                                           ApicTriggerModeLevel
+                                           );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciDevProgramMsiInterrupt", status );
+            return status;
+        }
     }
 
     LOG_FUNC_END;
 
     return status;
+}
+
+static
+BYTE
+_IomuGetInterruptDestination(
+    IN          DWORD                       CpuIndex
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    DWORD noOfCpus;
+    DWORD i;
+
+    pCpuListHead = NULL;
+
+    noOfCpus = SmpGetNumberOfActiveCpus();
+    ASSERT( 0 != noOfCpus );
+
+    SmpGetCpuList(&pCpuListHead);
+
+    // the CPUs are never removed from the list once they are woken up
+    pCurEntry = pCpuListHead->Flink;
+    for (i = 0; i < CpuIndex % noOfCpus && pCurEntry->Flink != pCpuListHead; ++i)
+    {
+        pCurEntry = pCurEntry->Flink;
+    }
+
+    if (pCurEntry == pCpuListHead)
+    {
+        // no CPU in the list yet => let any CPU take it
+        return MAX_BYTE;
+    }
+
+    // we use the flat logical destination model => the logical APIC ID
+    // selects exactly one CPU
+    return CONTAINING_RECORD(pCurEntry, PCPU, ListEntry)->LogicalApicId;
 }
\ No newline at end of file
@@ -69,6 +69,20 @@ IsrCommonHandler(
         pPcpu->InterruptsTriggered[InterruptIndex] += 1;
     }
 
+    // CR0.TS was set when the thread was scheduled, its FPU state is loaded
+    // only now that it is actually used. This is handled before calling any
+    // other function because while CR0.TS is set any SSE instruction the
+    // compiler may have emitted on the way would trigger another #NM.
+    if (ExceptionDeviceNotAvailable == InterruptIndex
+        && ThreadHandleDeviceNotAvailable())
+    {
+        return;
+    }
+
+    // the #NM handler must tell apart the handlers using the FPU from the
+    // thread they interrupted
+    ThreadEnterInterrupt();
+
     if (InterruptIndex < NO_OF_RESERVED_EXCEPTIONS)
     {
         _IsrExceptionHandler(InterruptIndex, StackPointer, ErrorCodeAvailable, ProcessorState);
@@ -77,6 +91,8 @@ IsrCommonHandler(
     {
         _IsrInterruptHandler(InterruptIndex);
     }
+
+    ThreadLeaveInterrupt();
 }
 
 static
@@ -15,6 +15,7 @@
 #include "thread_internal.h"
 #include "io.h"
 #include "mdl.h"
+#include "smp.h"
 
 #define PAGING_STRUCTURES_BASE_MEMORY                           (128*KB_SIZE)
 
@@ -34,6 +35,18 @@
 #define VA_METADATA_SIZE_FOR_UM_PROCESS                         (5*GB_SIZE)
 #define VA_ALLOCATIONS_START_OFFSET_FROM_IMAGE_BASE             (1*GB_SIZE)
 
+// how many times the pages of a user buffer are brought in again when one of
+// them is remapped before its frame could be pinned
+#define MMU_PIN_MAX_ATTEMPTS                                    4
+
+// the top of a lazily mapped stack is mapped right away because the initial
+// frame of the thread is built there before it runs
+#define STACK_INITIAL_COMMIT_SIZE                               PAGE_SIZE
+
+// maximum number of paging structures of destroyed processes which are kept
+// mapped to be reused by the next processes created
+#define MMU_PAGING_TABLES_CACHE_MAX_DEPTH                       4
+
 // [0x0000'0000'0000'1000 -> 0x0000'7FFF'FFFF'FFFF] belongs to UM
 // [0xFFFF'8000'0000'0000 -> 0xFFFF'FFFF'FFFF'FFFF] belongs to KM
 #define PML4_OFFSET_OF_KERNEL_STRUCTURES                        (PAGE_SIZE / 2)
@@ -118,6 +131,14 @@ typedef struct _MMU_DATA
     MMU_ZERO_THREAD_DATA            ZeroThreadData;
 
     MMU_HEAP_DATA                   Heaps[MmuHeapIndexReserved];
+
+    LOCK                            PagingTablesCacheLock;
+
+    _Guarded_by_(PagingTablesCacheLock)
+    PPAGING_LOCK_DATA               CachedPagingTables[MMU_PAGING_TABLES_CACHE_MAX_DEPTH];
+
+    _Guarded_by_(PagingTablesCacheLock)
+    DWORD                           NumberOfCachedPagingTables;
 } MMU_DATA, *PMMU_DATA;
 
 static MMU_DATA m_mmuData;
@@ -206,12 +227,55 @@ _MmuRemapDisplay(
     IN          PPAGING_DATA            PagingData
     );
 
+static
+PHYSICAL_ADDRESS
+_MmuGetMdlFrame(
+    IN          PMDL                    Mdl,
+    IN          DWORD                   PageIndex
+    );
+
+static
+PTR_SUCCESS
+PVOID
+_MmuStackCachePop(
+    void
+    );
+
+static
+BOOLEAN
+_MmuStackCachePush(
+    IN          PVOID                   Stack
+    );
+
+static
+PTR_SUCCESS
+PVOID
+_MmuAcquireBounceWindow(
+    IN          PVOID                   UserAddress,
+    IN          QWORD                   Size,
+    IN          PAGE_RIGHTS             PageRights,
+    IN          PPROCESS                Process
+    );
+
+static
+BOOLEAN
+_MmuReleaseBounceWindow(
+    IN          PVOID                   KernelAddress
+    );
+
 static
 STATUS
 _MmuCreatePagingTables(
     OUT_PTR     PPAGING_LOCK_DATA*            PagingTables
     );
 
+static
+void
+_MmuReleasePagingTables(
+    _Pre_valid_ _Post_ptr_invalid_
+        PPAGING_LOCK_DATA       PagingTables
+    );
+
 _No_competing_thread_
 static
 void
@@ -222,6 +286,8 @@ _MmuDestroyPagingTables(
 
 static FUNC_ThreadStart                 _MmuZeroWorkerThreadFunction;
 
+static FUNC_IpcProcessEvent             _MmuFlushProcessTranslations;
+
 __forceinline
 static
 DWORD
@@ -252,6 +318,8 @@ MmuPreinitSystem(
     InitializeListHead(&m_mmuData.ZeroThreadData.PagesToZeroList);
     LockInit(&m_mmuData.ZeroThreadData.PagesLock);
 
+    LockInit(&m_mmuData.PagingTablesCacheLock);
+
     m_mmuData.PcidSupportAvailable = CpuMuIsPcidFeaturePresent();
 
     PmmPreinitSystem();
@@ -471,6 +539,13 @@ MmuInitSystem(
     }
     LOG("_MmuInitializeHeap succeeded for special heap\n");
 
+    status = PmmInitFrameReferences();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("PmmInitFrameReferences", status);
+        return status;
+    }
+
     return status;
 }
 
@@ -708,6 +783,15 @@ MmuReleaseMemory(
     bListEmpty = FALSE;
     pItem = NULL;
 
+    // Only single frames mapped in UM can be shared, the frame must not be
+    // zeroed while other address spaces still map it
+    if (NoOfFrames == 1 && !PmmDereferenceFrame(PhysicalAddr))
+    {
+        LOG_TRACE_MMU("Frame 0x%X is still in use\n", PhysicalAddr);
+        LOG_FUNC_END_CPU;
+        return;
+    }
+
     pItem = _MmuAllocateFromPoolWithTag(MmuHeapIndexSpecial,
                                         PoolAllocateZeroMemory,
                                         sizeof(MMU_ZERO_WORKER_ITEM),
@@ -977,11 +1061,82 @@ MmuDestroyAddressSpaceForProcess(
         // restore previous paging table
         ProcessActivatePagingTables(GetCurrentThread()->Process, !m_mmuData.PcidSupportAvailable);
 
-        _MmuDestroyPagingTables(Process->PagingData);
+        // The frames of the process are released, those still shared with
+        // other processes or with the image cache only lose a reference
+        VmmReleaseUserPages(&Process->PagingData->Data);
+
+        _MmuReleasePagingTables(Process->PagingData);
         Process->PagingData = NULL;
     }
 }
 
+STATUS
+MmuCloneAddressSpaceForProcess(
+    INOUT   PPROCESS                Parent,
+    INOUT   PPROCESS                Process
+    )
+{
+    STATUS status;
+    INTR_STATE oldState;
+
+    ASSERT(Parent != NULL);
+    ASSERT(!ProcessIsSystem(Parent));
+    ASSERT(Process != NULL);
+    ASSERT(!ProcessIsSystem(Process));
+
+    status = STATUS_SUCCESS;
+
+    __try
+    {
+        status = MmuCreateAddressSpaceForProcess(Process);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("MmuCreateAddressSpaceForProcess", status);
+            __leave;
+        }
+
+        status = VmmCloneVirtualAddressSpace(Parent->VaSpace, Process->VaSpace);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VmmCloneVirtualAddressSpace", status);
+            __leave;
+        }
+
+        RecRwSpinlockAcquireExclusive(&Parent->PagingData->Lock, &oldState);
+        VmmCloneUserPagingTables(&Parent->PagingData->Data, Parent->VaSpace, &Process->PagingData->Data);
+        RecRwSpinlockReleaseExclusive(&Parent->PagingData->Lock, oldState);
+
+        // the writable pages of the parent became read-only, its threads
+        // running on other CPUs must not keep writing through cached
+        // translations to the frames now shared with the child, wait for all
+        // the CPUs to flush them before returning
+        _MmuFlushProcessTranslations(Parent);
+
+        status = SmpSendGenericIpi(_MmuFlushProcessTranslations, Parent, NULL, NULL, TRUE);
+        if (STATUS_CPU_NO_MATCHES == status)
+        {
+            // there are no other CPUs
+            status = STATUS_SUCCESS;
+        }
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpi", status);
+            __leave;
+        }
+
+        LOG_TRACE_MMU("Cloned the address space of process [%s]\n", ProcessGetName(Parent));
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            MmuDestroyAddressSpaceForProcess(Process);
+        }
+    }
+
+    return status;
+}
+
 _No_competing_thread_
 void
 MmuInitAddressSpaceForSystemProcess(
@@ -1050,14 +1205,27 @@ MmuAllocStack(
 {
     PBYTE pStackBase;
     PBYTE pCommitedStackBase;
+    PVOID pCachedStack;
     DWORD totalAllocationSize;
     DWORD stackGuardSize;
+    DWORD lazySize;
     VMM_ALLOC_TYPE allocTypeCommit;
     PPAGING_LOCK_DATA pPagingData;
     PVMM_RESERVATION_SPACE pVaSpace;
 
     ASSERT( IsAddressAligned( StackSize, PAGE_SIZE ));
 
+    if (Process == NULL && StackSize == STACK_DEFAULT_SIZE && !LazyMap)
+    {
+        ASSERT(ProtectStack);
+
+        pCachedStack = _MmuStackCachePop();
+        if (pCachedStack != NULL)
+        {
+            return pCachedStack;
+        }
+    }
+
     /// TODO: could also add upper protection for the stack (should not happen on normal execution because
     /// the stack grows downwards, but it may happen when the stack contents are manipulated by our functions
     /// such as GSConvertCookiesForNewStack, _ThreadSetupInitialState or _ThreadSetupMainThreadUserStack
@@ -1067,6 +1235,7 @@ MmuAllocStack(
     totalAllocationSize = StackSize + stackGuardSize;
     allocTypeCommit = VMM_ALLOC_TYPE_COMMIT;
     allocTypeCommit |= (LazyMap ? 0 : VMM_ALLOC_TYPE_NOT_LAZY);
+    lazySize = (LazyMap && StackSize > STACK_INITIAL_COMMIT_SIZE) ? StackSize - STACK_INITIAL_COMMIT_SIZE : 0;
     pPagingData = (Process == NULL) ? &m_mmuData.PagingData : Process->PagingData;
     pVaSpace = (Process == NULL) ? NULL : Process->VaSpace;
 
@@ -1095,8 +1264,30 @@ MmuAllocStack(
     // commit the memory only after the stack guard
     // This way we'll have STACK_GUARD_SIZE bytes unmapped and uncommitted after the
     // stack is depleted and we'll easily detect a stack overflow
-    pCommitedStackBase = VmmAllocRegionEx(pStackBase + stackGuardSize,
-                                          StackSize,
+    if (lazySize != 0)
+    {
+        // the pages below the top are mapped on the first access, as the stack grows
+        pCommitedStackBase = VmmAllocRegionEx(pStackBase + stackGuardSize,
+                                              lazySize,
+                                              allocTypeCommit,
+                                              PAGE_RIGHTS_READWRITE,
+                                              FALSE,
+                                              NULL,
+                                              pVaSpace,
+                                              pPagingData,
+                                              NULL
+                                              );
+        if (NULL == pCommitedStackBase)
+        {
+            LOG_ERROR("VmmAllocRegion didn't manage to commit previously reserved memory!\n");
+            return NULL;
+        }
+
+        allocTypeCommit |= VMM_ALLOC_TYPE_NOT_LAZY;
+    }
+
+    pCommitedStackBase = VmmAllocRegionEx(pStackBase + stackGuardSize + lazySize,
+                                          StackSize - lazySize,
                                           allocTypeCommit,
                                           PAGE_RIGHTS_READWRITE,
                                           FALSE,
@@ -1119,6 +1310,7 @@ MmuAllocStack(
 void
 MmuFreeStack(
     IN          PVOID       Stack,
+    IN          DWORD       StackSize,
     IN_OPT      PPROCESS    Process
     )
 {
@@ -1127,6 +1319,14 @@ MmuFreeStack(
 
     ASSERT(Stack != NULL);
 
+    // the stack stays mapped while it is cached
+    if (Process == NULL
+        && StackSize == STACK_DEFAULT_SIZE
+        && _MmuStackCachePush(Stack))
+    {
+        return;
+    }
+
     pPagingData = (Process == NULL) ? &m_mmuData.PagingData : Process->PagingData;
     pVaSpace = (Process == NULL) ? NULL : Process->VaSpace;
 
@@ -1177,6 +1377,151 @@ MmuIsBufferValid(
                             Process->PagingData->Data.KernelSpace);
 }
 
+STATUS
+MmuPinUserBuffer(
+    IN          PVOID               UserAddress,
+    IN          QWORD               Size,
+    IN          PAGE_RIGHTS         PageRights,
+    IN          PPROCESS            Process,
+    OUT_PTR     PMDL*               Mdl
+    )
+{
+    STATUS status;
+    PMDL pMdl;
+    PBYTE pAlignedAddress;
+    DWORD noOfPages;
+    DWORD i;
+    DWORD attempt;
+    PML4 cr3;
+    INTR_STATE oldState;
+    BOOLEAN bPinned;
+
+    if (UserAddress == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Size == 0 || Size > MAX_DWORD)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    // the pages are brought in by touching them
+    if (Process == NULL || Process != GetCurrentProcess())
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (Mdl == NULL)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = MmuIsBufferValid(UserAddress, Size, PageRights, Process);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("MmuIsBufferValid", status);
+        return status;
+    }
+
+    pMdl = NULL;
+    pAlignedAddress = (PBYTE)AlignAddressLower(UserAddress, PAGE_SIZE);
+    noOfPages = (DWORD)(AlignAddressUpper(Size + AddressOffset(UserAddress, PAGE_SIZE), PAGE_SIZE) / PAGE_SIZE);
+    bPinned = FALSE;
+
+    for (attempt = 0; attempt < MMU_PIN_MAX_ATTEMPTS && !bPinned; ++attempt)
+    {
+        for (i = 0; i < noOfPages; ++i)
+        {
+            PBYTE pPage = pAlignedAddress + (QWORD)i * PAGE_SIZE;
+
+            // a write also breaks the copy-on-write sharing of the page, else
+            // the device would write to a frame the process no longer maps
+            if (IsBooleanFlagOn(PageRights, PAGE_RIGHTS_WRITE))
+            {
+                _InterlockedOr8((volatile char*)pPage, 0);
+            }
+            else
+            {
+                BYTE temp = *pPage;temp;
+            }
+        }
+
+        pMdl = MdlAllocateEx(UserAddress,
+                             (DWORD)Size,
+                             NULL,
+                             Process->PagingData);
+        if (pMdl == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("MdlAllocateEx", Size);
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        // the pages may have been remapped after the MDL was built, the frames
+        // are referenced only if none of them changed
+        RecRwSpinlockAcquireExclusive(&Process->PagingData->Lock, &oldState);
+
+        cr3.Raw = (QWORD)Process->PagingData->Data.BasePhysicalAddress;
+        for (i = 0; i < noOfPages; ++i)
+        {
+            if (VmmGetPhysicalAddress(cr3, pAlignedAddress + (QWORD)i * PAGE_SIZE) != _MmuGetMdlFrame(pMdl, i))
+            {
+                break;
+            }
+        }
+
+        bPinned = (i == noOfPages);
+        if (bPinned)
+        {
+            for (i = 0; i < noOfPages; ++i)
+            {
+                PmmReferenceFrame(_MmuGetMdlFrame(pMdl, i));
+            }
+        }
+
+        RecRwSpinlockReleaseExclusive(&Process->PagingData->Lock, oldState);
+
+        if (!bPinned)
+        {
+            LOG_TRACE_MMU("Buffer 0x%X was remapped while being pinned\n", UserAddress);
+            MdlFree(pMdl);
+            pMdl = NULL;
+        }
+    }
+
+    if (!bPinned)
+    {
+        LOG_ERROR("Could not pin buffer 0x%X of size 0x%X after %u attempts\n",
+                  UserAddress, Size, MMU_PIN_MAX_ATTEMPTS);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    *Mdl = pMdl;
+
+    return STATUS_SUCCESS;
+}
+
+void
+MmuUnpinUserBuffer(
+    INOUT       PMDL                Mdl
+    )
+{
+    DWORD noOfPages;
+    DWORD i;
+
+    ASSERT(Mdl != NULL);
+
+    noOfPages = (DWORD)(AlignAddressUpper(Mdl->ByteCount + Mdl->ByteOffset, PAGE_SIZE) / PAGE_SIZE);
+
+    // each frame is freed here if the process unmapped it while it was pinned
+    for (i = 0; i < noOfPages; ++i)
+    {
+        MmuReleaseMemory(_MmuGetMdlFrame(Mdl, i), 1);
+    }
+
+    MdlFree(Mdl);
+}
+
 STATUS
 MmuGetSystemVirtualAddressForUserBuffer(
     IN          PVOID               UserAddress,
@@ -1216,6 +1561,15 @@ MmuGetSystemVirtualAddressForUserBuffer(
 
     pMdl = NULL;
 
+    // small buffers are copied, which is cheaper than creating and later
+    // removing a kernel mapping for their pages
+    pKernelAddress = _MmuAcquireBounceWindow(UserAddress, Size, PageRights, Process);
+    if (pKernelAddress != NULL)
+    {
+        *KernelAddress = pKernelAddress;
+        return STATUS_SUCCESS;
+    }
+
     __try
     {
         pMdl = MdlAllocateEx(UserAddress,
@@ -1272,6 +1626,11 @@ MmuFreeSystemVirtualAddressForUserBuffer(
 {
     ASSERT(KernelAddress != NULL);
 
+    if (_MmuReleaseBounceWindow(KernelAddress))
+    {
+        return;
+    }
+
     VmmFreeRegionEx(KernelAddress,
                     0,
                     VMM_FREE_TYPE_RELEASE,
@@ -1280,6 +1639,221 @@ MmuFreeSystemVirtualAddressForUserBuffer(
                     NULL);
 }
 
+static
+PHYSICAL_ADDRESS
+_MmuGetMdlFrame(
+    IN          PMDL                    Mdl,
+    IN          DWORD                   PageIndex
+    )
+{
+    QWORD offset;
+    DWORD i;
+
+    ASSERT(Mdl != NULL);
+
+    // offset in the buffer of the first byte found in the page, only the first
+    // translation pair starts in the middle of a page
+    offset = (PageIndex == 0) ? 0 : (QWORD)PageIndex * PAGE_SIZE - Mdl->ByteOffset;
+
+    for (i = 0; i < Mdl->NumberOfTranslationPairs; ++i)
+    {
+        if (offset < Mdl->Translations[i].NumberOfBytes)
+        {
+            return (PHYSICAL_ADDRESS)AlignAddressLower(PtrOffset(Mdl->Translations[i].Address, offset), PAGE_SIZE);
+        }
+
+        offset = offset - Mdl->Translations[i].NumberOfBytes;
+    }
+
+    NOT_REACHED;
+
+    return NULL;
+}
+
+static
+PTR_SUCCESS
+PVOID
+_MmuStackCachePop(
+    void
+    )
+{
+    PPCPU pCpu;
+    PSTACK_CACHE pCache;
+    PVOID pStack;
+    INTR_STATE oldState;
+
+    pStack = NULL;
+
+    oldState = CpuIntrDisable();
+
+    // the stacks of the BSP are allocated before its PCPU structure exists
+    pCpu = GetCurrentPcpu();
+    if (pCpu == NULL)
+    {
+        CpuIntrSetState(oldState);
+        return NULL;
+    }
+
+    pCache = &pCpu->StackCache;
+    if (pCache->Depth > 0)
+    {
+        pCache->Depth--;
+        pStack = pCache->Stacks[pCache->Depth];
+        pCache->Stacks[pCache->Depth] = NULL;
+        pCache->Hits++;
+    }
+    else
+    {
+        pCache->Misses++;
+    }
+
+    CpuIntrSetState(oldState);
+
+    return pStack;
+}
+
+static
+BOOLEAN
+_MmuStackCachePush(
+    IN          PVOID                   Stack
+    )
+{
+    PPCPU pCpu;
+    PSTACK_CACHE pCache;
+    BOOLEAN bCached;
+    INTR_STATE oldState;
+
+    ASSERT(Stack != NULL);
+
+    oldState = CpuIntrDisable();
+
+    pCpu = GetCurrentPcpu();
+    if (pCpu == NULL)
+    {
+        CpuIntrSetState(oldState);
+        return FALSE;
+    }
+
+    pCache = &pCpu->StackCache;
+    bCached = pCache->Depth < STACK_CACHE_MAX_DEPTH;
+    if (bCached)
+    {
+        pCache->Stacks[pCache->Depth] = Stack;
+        pCache->Depth++;
+    }
+
+    CpuIntrSetState(oldState);
+
+    return bCached;
+}
+
+static
+PTR_SUCCESS
+PVOID
+_MmuAcquireBounceWindow(
+    IN          PVOID                   UserAddress,
+    IN          QWORD                   Size,
+    IN          PAGE_RIGHTS             PageRights,
+    IN          PPROCESS                Process
+    )
+{
+    PTHREAD pThread;
+    PMMU_BOUNCE_WINDOW pWindow;
+    INTR_STATE oldState;
+    BOOLEAN bAcquired;
+
+    pThread = GetCurrentThread();
+
+    // the data is copied in the context of the caller, a thread may hold a
+    // single window at a time
+    if (Size > MMU_BOUNCE_WINDOW_SIZE
+        || pThread == NULL
+        || Process != GetCurrentProcess()
+        || pThread->BounceWindow != NULL)
+    {
+        return NULL;
+    }
+
+    if (!SUCCEEDED(MmuIsBufferValid(UserAddress, Size, PageRights, Process)))
+    {
+        return NULL;
+    }
+
+    oldState = CpuIntrDisable();
+
+    pWindow = &GetCurrentPcpu()->BounceWindow;
+
+    bAcquired = (_InterlockedCompareExchange8(&pWindow->InUse, TRUE, FALSE) == FALSE);
+    if (bAcquired)
+    {
+        pWindow->Hits++;
+    }
+    else
+    {
+        pWindow->Misses++;
+    }
+
+    CpuIntrSetState(oldState);
+
+    if (!bAcquired)
+    {
+        return NULL;
+    }
+
+    if (pWindow->Buffer == NULL)
+    {
+        pWindow->Buffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, MMU_BOUNCE_WINDOW_SIZE, HEAP_MMU_TAG, 0);
+        if (pWindow->Buffer == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", MMU_BOUNCE_WINDOW_SIZE);
+            _InterlockedExchange8(&pWindow->InUse, FALSE);
+            return NULL;
+        }
+    }
+
+    pWindow->UserAddress = UserAddress;
+    pWindow->Size = (DWORD)Size;
+    pWindow->PageRights = PageRights;
+
+    memcpy(pWindow->Buffer, UserAddress, (DWORD)Size);
+
+    pThread->BounceWindow = pWindow;
+
+    return pWindow->Buffer;
+}
+
+static
+BOOLEAN
+_MmuReleaseBounceWindow(
+    IN          PVOID                   KernelAddress
+    )
+{
+    PTHREAD pThread;
+    PMMU_BOUNCE_WINDOW pWindow;
+
+    pThread = GetCurrentThread();
+    if (pThread == NULL)
+    {
+        return FALSE;
+    }
+
+    pWindow = pThread->BounceWindow;
+    if (pWindow == NULL || pWindow->Buffer != KernelAddress)
+    {
+        return FALSE;
+    }
+
+    if (IsBooleanFlagOn(pWindow->PageRights, PAGE_RIGHTS_WRITE))
+    {
+        memcpy(pWindow->UserAddress, pWindow->Buffer, pWindow->Size);
+    }
+
+    pThread->BounceWindow = NULL;
+    _InterlockedExchange8(&pWindow->InUse, FALSE);
+
+    return TRUE;
+}
+
 static
 STATUS
 _MmuCreatePagingTables(
@@ -1296,6 +1870,32 @@ _MmuCreatePagingTables(
 
     status = STATUS_SUCCESS;
     basePa = NULL;
+    pPagingData = NULL;
+
+    LockAcquire(&m_mmuData.PagingTablesCacheLock, &oldState);
+    if (m_mmuData.NumberOfCachedPagingTables > 0)
+    {
+        m_mmuData.NumberOfCachedPagingTables--;
+        pPagingData = m_mmuData.CachedPagingTables[m_mmuData.NumberOfCachedPagingTables];
+        m_mmuData.CachedPagingTables[m_mmuData.NumberOfCachedPagingTables] = NULL;
+    }
+    LockRelease(&m_mmuData.PagingTablesCacheLock, oldState);
+
+    if (pPagingData != NULL)
+    {
+        // The frames are still mapped, only the PML4 must be cleared, the
+        // other tables are zeroed again when they are handed out
+        RecRwSpinlockInit(0, &pPagingData->Lock);
+        pPagingData->Data.CurrentIndex = 1;
+
+        memzero((PVOID)PA2VA(pPagingData->Data.BasePhysicalAddress), PML4_OFFSET_OF_KERNEL_STRUCTURES);
+        memcpy((PVOID)PA2VA(PtrOffset(pPagingData->Data.BasePhysicalAddress, PML4_OFFSET_OF_KERNEL_STRUCTURES)),
+               (PVOID)PA2VA(PtrOffset(m_mmuData.PagingData.Data.BasePhysicalAddress, PML4_OFFSET_OF_KERNEL_STRUCTURES)),
+               PML4_NO_OF_KERNEL_ENTRIES);
+
+        *PagingTables = pPagingData;
+        return STATUS_SUCCESS;
+    }
 
     pPagingData = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
                                         sizeof(PAGING_LOCK_DATA),
@@ -1373,6 +1973,36 @@ _MmuCreatePagingTables(
     return status;
 }
 
+static
+void
+_MmuReleasePagingTables(
+    _Pre_valid_ _Post_ptr_invalid_
+        PPAGING_LOCK_DATA       PagingTables
+    )
+{
+    INTR_STATE oldState;
+    BOOLEAN bCached;
+
+    ASSERT(PagingTables != NULL);
+    ASSERT(!PagingTables->Data.KernelSpace);
+
+    // the user pages were already released, the tables describing them are
+    // kept mapped so the next process does not have to map them again
+    LockAcquire(&m_mmuData.PagingTablesCacheLock, &oldState);
+    bCached = m_mmuData.NumberOfCachedPagingTables < MMU_PAGING_TABLES_CACHE_MAX_DEPTH;
+    if (bCached)
+    {
+        m_mmuData.CachedPagingTables[m_mmuData.NumberOfCachedPagingTables] = PagingTables;
+        m_mmuData.NumberOfCachedPagingTables++;
+    }
+    LockRelease(&m_mmuData.PagingTablesCacheLock, oldState);
+
+    if (!bCached)
+    {
+        _MmuDestroyPagingTables(PagingTables);
+    }
+}
+
 _No_competing_thread_
 static
 void
@@ -2079,4 +2709,24 @@ _MmuZeroWorkerThreadFunction(
     NOT_REACHED;
 
     return status;
-}
\ No newline at end of file
+}
+static
+STATUS
+(__cdecl _MmuFlushProcessTranslations)(
+    IN_OPT      PVOID           Context
+    )
+{
+    PPROCESS pProcess;
+
+    ASSERT(NULL != Context);
+
+    pProcess = (PPROCESS) Context;
+
+    // flush the translations tagged with the PCID of the process the same way
+    // a destroyed address space is flushed, then go back to the paging tables
+    // of the thread running on this CPU
+    ProcessActivatePagingTables(pProcess, TRUE);
+    ProcessActivatePagingTables(GetCurrentThread()->Process, !m_mmuData.PcidSupportAvailable);
+
+    return STATUS_SUCCESS;
+}
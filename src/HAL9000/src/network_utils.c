@@ -40,4 +40,109 @@ NetUtilIp4AddressToText(
              );
 
     return Buffer;
+}
+
+STATUS
+NetUtilTextToIp4Address(
+    IN_Z                                                        char*               Text,
+    OUT                                                         IP4_ADDRESS*        Address
+    )
+{
+    char* pCurrent;
+    DWORD byteValue;
+    DWORD noOfDigits;
+    DWORD i;
+
+    if (NULL == Text)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Address)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    pCurrent = Text;
+
+    for (i = 0; i < IP4_ADDRESS_SIZE; ++i)
+    {
+        byteValue = 0;
+        for (noOfDigits = 0; '0' <= *pCurrent && *pCurrent <= '9'; ++noOfDigits, ++pCurrent)
+        {
+            byteValue = byteValue * 10 + (*pCurrent - '0');
+            if (byteValue > MAX_BYTE)
+            {
+                return STATUS_PARSE_FAILED;
+            }
+        }
+
+        if (0 == noOfDigits)
+        {
+            return STATUS_PARSE_FAILED;
+        }
+
+        // the last byte must end the string, the others must end with a dot
+        if (*pCurrent != (i == IP4_ADDRESS_SIZE - 1 ? '\0' : '.'))
+        {
+            return STATUS_PARSE_FAILED;
+        }
+        pCurrent++;
+
+        Address->ByteAddress[i] = (BYTE) byteValue;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+DWORD
+NetUtilChecksumAdd(
+    IN_READS_BYTES(Length)                                      PVOID               Buffer,
+    IN                                                          DWORD               Length,
+    IN                                                          DWORD               PartialSum
+    )
+{
+    QWORD sum;
+    PWORD pWords;
+    DWORD i;
+
+    ASSERT( NULL != Buffer || 0 == Length );
+
+    sum = PartialSum;
+    pWords = Buffer;
+
+    for (i = 0; i < Length / sizeof(WORD); ++i)
+    {
+        sum = sum + pWords[i];
+    }
+
+    if (0 != Length % sizeof(WORD))
+    {
+        // the missing byte is considered 0
+        sum = sum + ((PBYTE)Buffer)[Length - 1];
+    }
+
+    // keep the carries, they are added back when the sum is finished
+    while (sum > MAX_DWORD)
+    {
+        sum = (sum & MAX_DWORD) + (sum >> 32);
+    }
+
+    return (DWORD) sum;
+}
+
+WORD
+NetUtilChecksumFinish(
+    IN                                                          DWORD               PartialSum
+    )
+{
+    DWORD sum;
+
+    sum = PartialSum;
+    while (sum > MAX_WORD)
+    {
+        sum = (sum & MAX_WORD) + (sum >> 16);
+    }
+
+    return (WORD) ~sum;
 }
\ No newline at end of file
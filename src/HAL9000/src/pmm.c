@@ -3,6 +3,24 @@
 #include "int15.h"
 #include "bitmap.h"
 #include "synch.h"
+#include "vmm.h"
+#include "acpi_interface.h"
+
+// maximum number of SRAT memory ranges used for node-local allocations, the
+// ones beyond it are treated as not belonging to any node
+#define PMM_MAX_NUMA_RANGES             32
+
+#define PMM_NO_NUMA_NODE                MAX_DWORD
+
+typedef struct _PMM_NUMA_RANGE
+{
+    DWORD               Node;
+
+    DWORD               BaseFrame;
+
+    // the first frame after the range
+    DWORD               EndFrame;
+} PMM_NUMA_RANGE, *PPMM_NUMA_RANGE;
 
 typedef struct _MEMORY_REGION_LIST
 {
@@ -36,6 +54,23 @@ typedef struct _PMM_DATA
 
     _Guarded_by_(AllocationLock)
     BITMAP              AllocationBitmap;
+
+    // Indexed by the frame number, holds the number of owners of each frame
+    // besides the one which reserved it. Frames are shared by the address
+    // spaces cloned copy-on-write and by the processes mapping the same image.
+    _Interlocked_
+    volatile WORD*      FrameReferences;
+
+    // Set on initialization only if the SRAT describes more than one node, in
+    // that case frames are first searched in the memory of the node of the
+    // requesting CPU
+    BOOLEAN             NumaPlacement;
+
+    DWORD               NumberOfNumaRanges;
+    PMM_NUMA_RANGE      NumaRanges[PMM_MAX_NUMA_RANGES];
+
+    // Indexed by APIC ID, PMM_NO_NUMA_NODE if the SRAT does not describe the CPU
+    DWORD               CpuNode[MAX_BYTE + 1];
 } PMM_DATA, *PPMM_DATA;
 
 static PMM_DATA m_pmmData;
@@ -62,6 +97,12 @@ _PmmInitializeAllocationBitmap(
     OUT                         DWORD*                      SizeReserved
     );
 
+static
+DWORD
+_PmmReserveNodeLocalFrames(
+    IN                          DWORD                       NoOfFrames
+    );
+
 _No_competing_thread_
 void
 PmmPreinitSystem(
@@ -171,7 +212,13 @@ PmmReserveMemoryEx(
     }
 
     LockAcquire( &m_pmmData.AllocationLock, &oldState);
-    idx = BitmapScanFromAndFlip(&m_pmmData.AllocationBitmap, (DWORD) startIdx, NoOfFrames, FALSE );
+
+    // callers which need frames above an address do not care about locality
+    idx = (m_pmmData.NumaPlacement && NULL == MinPhysAddr) ? _PmmReserveNodeLocalFrames(NoOfFrames) : MAX_DWORD;
+    if (MAX_DWORD == idx)
+    {
+        idx = BitmapScanFromAndFlip(&m_pmmData.AllocationBitmap, (DWORD) startIdx, NoOfFrames, FALSE );
+    }
     if (MAX_DWORD == idx)
     {
         LockRelease( &m_pmmData.AllocationLock, oldState);
@@ -203,6 +250,173 @@ PmmReleaseMemory(
     LockRelease( &m_pmmData.AllocationLock, oldState);
 }
 
+_No_competing_thread_
+void
+PmmInitNumaTopology(
+    void
+    )
+{
+    STATUS status;
+    ACPI_SRAT_CPU_AFFINITY* pCpuAffinity;
+    ACPI_SRAT_MEM_AFFINITY* pMemAffinity;
+    PPMM_NUMA_RANGE pRange;
+    QWORD baseFrame;
+    QWORD endFrame;
+    DWORD maxFrames;
+    DWORD i;
+    BOOLEAN bMultipleNodes;
+
+    for (i = 0; i < ARRAYSIZE(m_pmmData.CpuNode); ++i)
+    {
+        m_pmmData.CpuNode[i] = PMM_NO_NUMA_NODE;
+    }
+
+    for (status = AcpiRetrieveNextCpuAffinity(TRUE, &pCpuAffinity);
+         SUCCEEDED(status);
+         status = AcpiRetrieveNextCpuAffinity(FALSE, &pCpuAffinity))
+    {
+        m_pmmData.CpuNode[pCpuAffinity->ApicId] = pCpuAffinity->ProximityDomainLo
+                                                | ((DWORD)pCpuAffinity->ProximityDomainHi[0] << 8)
+                                                | ((DWORD)pCpuAffinity->ProximityDomainHi[1] << 16)
+                                                | ((DWORD)pCpuAffinity->ProximityDomainHi[2] << 24);
+    }
+
+    maxFrames = BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap);
+    bMultipleNodes = FALSE;
+
+    for (status = AcpiRetrieveNextMemoryAffinity(TRUE, &pMemAffinity);
+         SUCCEEDED(status);
+         status = AcpiRetrieveNextMemoryAffinity(FALSE, &pMemAffinity))
+    {
+        baseFrame = AlignAddressUpper(pMemAffinity->BaseAddress, PAGE_SIZE) / PAGE_SIZE;
+        endFrame = min((pMemAffinity->BaseAddress + pMemAffinity->Length) / PAGE_SIZE, maxFrames);
+        if (baseFrame >= endFrame)
+        {
+            continue;
+        }
+
+        if (m_pmmData.NumberOfNumaRanges == PMM_MAX_NUMA_RANGES)
+        {
+            LOG_WARNING("There are more than %u SRAT memory ranges, the rest will not be used for local allocations\n",
+                        PMM_MAX_NUMA_RANGES);
+            break;
+        }
+
+        pRange = &m_pmmData.NumaRanges[m_pmmData.NumberOfNumaRanges++];
+        pRange->Node = pMemAffinity->ProximityDomain;
+        pRange->BaseFrame = (DWORD) baseFrame;
+        pRange->EndFrame = (DWORD) endFrame;
+
+        bMultipleNodes = bMultipleNodes || (pRange->Node != m_pmmData.NumaRanges[0].Node);
+
+        LOG("Node %u has frames [0x%x, 0x%x)\n", pRange->Node, pRange->BaseFrame, pRange->EndFrame);
+    }
+
+    // with a single node every frame is equally close to every CPU
+    m_pmmData.NumaPlacement = bMultipleNodes;
+
+    LOG("Node-local frame allocation is %s\n", m_pmmData.NumaPlacement ? "enabled" : "disabled");
+}
+
+STATUS
+PmmInitFrameReferences(
+    void
+    )
+{
+    QWORD size;
+
+    ASSERT(m_pmmData.FrameReferences == NULL);
+
+    size = (QWORD) BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap) * sizeof(WORD);
+
+    // The counters are accessed while solving #PFs, they must always be mapped
+    m_pmmData.FrameReferences = VmmAllocRegion(NULL,
+                                               size,
+                                               VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
+                                               PAGE_RIGHTS_READWRITE);
+    if (m_pmmData.FrameReferences == NULL)
+    {
+        LOG_FUNC_ERROR_ALLOC("VmmAllocRegion", size);
+        return STATUS_MEMORY_CANNOT_BE_COMMITED;
+    }
+
+    LOG("Frame reference counters occupy %U KB\n", size / KB_SIZE);
+
+    return STATUS_SUCCESS;
+}
+
+void
+PmmReferenceFrame(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    )
+{
+    QWORD index;
+    WORD references;
+
+    ASSERT(IsAddressAligned(PhysicalAddr, PAGE_SIZE));
+    ASSERT(m_pmmData.FrameReferences != NULL);
+
+    index = (QWORD) PhysicalAddr / PAGE_SIZE;
+    ASSERT(index < BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap));
+    ASSERT(BitmapGetBitValue(&m_pmmData.AllocationBitmap, (DWORD) index));
+
+    references = _InterlockedIncrement16(&m_pmmData.FrameReferences[index]);
+    ASSERT_INFO(references != 0, "Too many owners for frame 0x%X", PhysicalAddr);
+}
+
+BOOLEAN
+PmmDereferenceFrame(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    )
+{
+    QWORD index;
+    WORD references;
+
+    ASSERT(IsAddressAligned(PhysicalAddr, PAGE_SIZE));
+
+    if (m_pmmData.FrameReferences == NULL)
+    {
+        return TRUE;
+    }
+
+    index = (QWORD) PhysicalAddr / PAGE_SIZE;
+    ASSERT(index < BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap));
+
+    do
+    {
+        references = m_pmmData.FrameReferences[index];
+        if (references == 0)
+        {
+            // the caller is the only owner of the frame
+            return TRUE;
+        }
+    } while (references != _InterlockedCompareExchange16(&m_pmmData.FrameReferences[index],
+                                                          (WORD) (references - 1),
+                                                          references));
+
+    return FALSE;
+}
+
+DWORD
+PmmGetFrameReferences(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr
+    )
+{
+    QWORD index;
+
+    ASSERT(IsAddressAligned(PhysicalAddr, PAGE_SIZE));
+
+    if (m_pmmData.FrameReferences == NULL)
+    {
+        return 1;
+    }
+
+    index = (QWORD) PhysicalAddr / PAGE_SIZE;
+    ASSERT(index < BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap));
+
+    return (DWORD) m_pmmData.FrameReferences[index] + 1;
+}
+
 QWORD
 PmmGetTotalSystemMemory(
     void
@@ -367,4 +581,45 @@ _PmmInitializeAllocationBitmap(
     }
 
     LOG_FUNC_END;
-}
\ No newline at end of file
+}
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+DWORD
+_PmmReserveNodeLocalFrames(
+    IN                          DWORD                       NoOfFrames
+    )
+{
+    DWORD node;
+    DWORD idx;
+    DWORD i;
+
+    ASSERT(LockIsOwner(&m_pmmData.AllocationLock));
+
+    // the thread may have been moved to another CPU since, the frames are then
+    // only less close to it
+    node = m_pmmData.CpuNode[CpuGetApicId()];
+    if (PMM_NO_NUMA_NODE == node)
+    {
+        return MAX_DWORD;
+    }
+
+    for (i = 0; i < m_pmmData.NumberOfNumaRanges; ++i)
+    {
+        if (m_pmmData.NumaRanges[i].Node != node)
+        {
+            continue;
+        }
+
+        idx = BitmapScanFromToAndFlip(&m_pmmData.AllocationBitmap,
+                                      m_pmmData.NumaRanges[i].BaseFrame,
+                                      m_pmmData.NumaRanges[i].EndFrame,
+                                      NoOfFrames,
+                                      FALSE);
+        if (MAX_DWORD != idx)
+        {
+            return idx;
+        }
+    }
+
+    return MAX_DWORD;
+}
@@ -7,6 +7,11 @@
 #include "bitmap.h"
 #include "pte.h"
 #include "pe_exports.h"
+#include "image_cache.h"
+#include "syscall_ring.h"
+
+// maximum number of destroyed processes kept for reuse
+#define PROCESS_CACHE_MAX_DEPTH         16
 
 typedef struct _PROCESS_SYSTEM_DATA
 {
@@ -20,6 +25,16 @@ typedef struct _PROCESS_SYSTEM_DATA
 
     LIST_ENTRY      ProcessList;
     MUTEX           ProcessListLock;
+
+    LOCK            CachedProcessesLock;
+
+    // destroyed processes whose structure and header information are reused
+    // by the next processes created, linked through their NextProcess entry
+    _Guarded_by_(CachedProcessesLock)
+    LIST_ENTRY      CachedProcessesList;
+
+    _Guarded_by_(CachedProcessesLock)
+    DWORD           NumberOfCachedProcesses;
 } PROCESS_SYSTEM_DATA, *PPROCESS_SYSTEM_DATA;
 
 static PROCESS_SYSTEM_DATA m_processData;
@@ -101,6 +116,19 @@ _ProcessParseCommandLine(
 // Called when the reference count reaches zero
 static FUNC_FreeFunction            _ProcessDestroy;
 
+static
+PTR_SUCCESS
+PPROCESS
+_ProcessCachePop(
+    void
+    );
+
+static
+BOOLEAN
+_ProcessCachePush(
+    IN      PPROCESS                Process
+    );
+
 _No_competing_thread_
 void
 ProcessSystemPreinit(
@@ -120,6 +148,9 @@ ProcessSystemPreinit(
 
     MutexInit(&m_processData.ProcessListLock, FALSE);
     InitializeListHead(&m_processData.ProcessList);
+
+    LockInit(&m_processData.CachedProcessesLock);
+    InitializeListHead(&m_processData.CachedProcessesList);
 }
 
 _No_competing_thread_
@@ -254,7 +285,7 @@ ProcessCreate(
         // This function must be called before MmuCreateAddressSpaceForProcess to be able to
         // determine the address from which the VA allocations should start (so they'll not
         // conflict with the PE image)
-        status = UmApplicationRetrieveHeader(PathToExe, pProcess->HeaderInfo);
+        status = UmApplicationRetrieveHeader(PathToExe, pProcess);
         if (!SUCCEEDED(status))
         {
             LOG_TRACE_USERMODE("[ERROR]UmApplicationRetrieveHeader failed with status 0x%x\n", status);
@@ -308,6 +339,90 @@ ProcessCreate(
     return status;
 }
 
+STATUS
+ProcessClone(
+    IN          PPROCESS    Parent,
+    IN_OPT_Z    char*       Arguments,
+    OUT_PTR     PPROCESS*   Process
+    )
+{
+    STATUS status;
+    PPROCESS pProcess;
+
+    if (Parent == NULL || ProcessIsSystem(Parent))
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Process == NULL)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+    pProcess = NULL;
+
+    __try
+    {
+        status = _ProcessInit(Parent->ProcessName,
+                              Arguments,
+                              &pProcess);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_ProcessInit", status);
+            __leave;
+        }
+
+        // The image pages not yet written by the parent are mapped from the
+        // image cache, the same as for any other process running the executable
+        ASSERT(Parent->Image != NULL);
+        ImageCacheReference(Parent->Image);
+        pProcess->Image = Parent->Image;
+
+        memcpy(pProcess->HeaderInfo, Parent->HeaderInfo, sizeof(PE_NT_HEADER_INFO));
+
+        status = MmuCloneAddressSpaceForProcess(Parent, pProcess);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("MmuCloneAddressSpaceForProcess", status);
+            __leave;
+        }
+        LOG_TRACE_PROCESS("Successfully cloned the VA space of process [%s]!\n", Parent->ProcessName);
+
+        status = UmApplicationRun(pProcess, FALSE, NULL);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("UmApplicationRun", status);
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            if (pProcess != NULL)
+            {
+                _ProcessDereference(pProcess);
+                pProcess = NULL;
+            }
+        }
+        else
+        {
+            ASSERT(pProcess != NULL);
+
+            // same as for ProcessCreate, the process is valid until its handle is closed
+            _ProcessReference(pProcess);
+            *Process = pProcess;
+        }
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
 void
 ProcessWaitForTermination(
     IN          PPROCESS    Process,
@@ -434,11 +549,13 @@ _ProcessInit(
     STATUS status;
     DWORD nameSize;
     BOOLEAN bRefCntInitialized;
+    PPE_NT_HEADER_INFO pHeaderInfo;
 
     ASSERT(Name != NULL);
     ASSERT(Process != NULL);
 
     pProcess = NULL;
+    pHeaderInfo = NULL;
     status = STATUS_SUCCESS;
 
     // we add +1 because of the NULL terminator
@@ -447,12 +564,26 @@ _ProcessInit(
 
     __try
     {
-        pProcess = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PROCESS), HEAP_PROCESS_TAG, 0);
-        if (pProcess == NULL)
+        pProcess = _ProcessCachePop();
+        if (pProcess != NULL)
         {
-            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PROCESS));
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
+            // only the header information structure of a cached process is
+            // kept, the rest of the structure is initialized again
+            pHeaderInfo = pProcess->HeaderInfo;
+            memzero(pProcess, sizeof(PROCESS));
+
+            memzero(pHeaderInfo, sizeof(PE_NT_HEADER_INFO));
+            pProcess->HeaderInfo = pHeaderInfo;
+        }
+        else
+        {
+            pProcess = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PROCESS), HEAP_PROCESS_TAG, 0);
+            if (pProcess == NULL)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PROCESS));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
         }
 
         RfcPreInit(&pProcess->RefCnt);
@@ -478,12 +609,15 @@ _ProcessInit(
 
         InitializeListHead(&pProcess->NextProcess);
 
-        pProcess->HeaderInfo = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PE_NT_HEADER_INFO), HEAP_PROCESS_TAG, 0);
         if (NULL == pProcess->HeaderInfo)
         {
-            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PE_NT_HEADER_INFO));
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
+            pProcess->HeaderInfo = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PE_NT_HEADER_INFO), HEAP_PROCESS_TAG, 0);
+            if (NULL == pProcess->HeaderInfo)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PE_NT_HEADER_INFO));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
         }
 
         pProcess->ProcessName = ExAllocatePoolWithTag(PoolAllocateZeroMemory, nameSize, HEAP_PROCESS_TAG, 0);
@@ -507,6 +641,8 @@ _ProcessInit(
         InitializeListHead(&pProcess->ThreadList);
         LockInit(&pProcess->ThreadListLock);
 
+        HandleTableInit(&pProcess->HandleTable);
+
         // Do this as late as possible - we want to interfere as little as possible
         // with the system management in case something goes wrong (PID + full process
         // list management)
@@ -730,6 +866,10 @@ _ProcessDestroy(
     RemoveEntryList(&Process->NextProcess);
     MutexRelease(&m_processData.ProcessListLock);
 
+    // The handles left open are closed, the ports of the sockets can be bound
+    // again
+    HandleTableDestroy(&Process->HandleTable);
+
     if (NULL != Process->FullCommandLine)
     {
         ExFreePoolWithTag(Process->FullCommandLine, HEAP_PROCESS_TAG);
@@ -742,16 +882,21 @@ _ProcessDestroy(
         Process->ProcessName = NULL;
     }
 
-    if (NULL != Process->HeaderInfo)
-    {
-        ExFreePoolWithTag(Process->HeaderInfo, HEAP_PROCESS_TAG);
-        Process->HeaderInfo = NULL;
-    }
-
     // Because the system process will never be destroyed it is ok to free
     // these memory addresses unconditionally
     MmuDestroyAddressSpaceForProcess(Process);
 
+    // The frames of the image may be released only after they are no longer
+    // mapped in the address space of the process
+    if (NULL != Process->Image)
+    {
+        ImageCacheDereferenceImage(Process->Image);
+        Process->Image = NULL;
+    }
+
+    // The same goes for the frames of the submission ring
+    SyscallRingDestroyForProcess(Process);
+
     if (Process->Id != 0)
     {
         // This should be done only after MmuDestroyVirtualSpaceForProcess, that
@@ -760,5 +905,63 @@ _ProcessDestroy(
         _ProcessSystemFreePid(Process->Id);
     }
 
+    // The structure is reused together with its header information
+    if (NULL != Process->HeaderInfo && _ProcessCachePush(Process))
+    {
+        return;
+    }
+
+    if (NULL != Process->HeaderInfo)
+    {
+        ExFreePoolWithTag(Process->HeaderInfo, HEAP_PROCESS_TAG);
+        Process->HeaderInfo = NULL;
+    }
+
     ExFreePoolWithTag(Process, HEAP_PROCESS_TAG);
 }
+
+static
+PTR_SUCCESS
+PPROCESS
+_ProcessCachePop(
+    void
+    )
+{
+    PPROCESS pProcess;
+    INTR_STATE oldState;
+
+    pProcess = NULL;
+
+    LockAcquire(&m_processData.CachedProcessesLock, &oldState);
+    if (!IsListEmpty(&m_processData.CachedProcessesList))
+    {
+        pProcess = CONTAINING_RECORD(RemoveHeadList(&m_processData.CachedProcessesList), PROCESS, NextProcess);
+        m_processData.NumberOfCachedProcesses--;
+    }
+    LockRelease(&m_processData.CachedProcessesLock, oldState);
+
+    return pProcess;
+}
+
+static
+BOOLEAN
+_ProcessCachePush(
+    IN      PPROCESS                Process
+    )
+{
+    INTR_STATE oldState;
+    BOOLEAN bCached;
+
+    ASSERT(NULL != Process);
+
+    LockAcquire(&m_processData.CachedProcessesLock, &oldState);
+    bCached = m_processData.NumberOfCachedProcesses < PROCESS_CACHE_MAX_DEPTH;
+    if (bCached)
+    {
+        InsertHeadList(&m_processData.CachedProcessesList, &Process->NextProcess);
+        m_processData.NumberOfCachedProcesses++;
+    }
+    LockRelease(&m_processData.CachedProcessesLock, oldState);
+
+    return bCached;
+}
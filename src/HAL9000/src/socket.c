@@ -0,0 +1,1039 @@
+#include "HAL9000.h"
+#include "network.h"
+#include "socket.h"
+#include "process_internal.h"
+#include "mutex.h"
+#include "thread.h"
+#include "io.h"
+
+// the poll flags are passed through from the network stack
+STATIC_ASSERT(SOCKET_POLL_READ == NET_POLL_READ &&
+              SOCKET_POLL_WRITE == NET_POLL_WRITE &&
+              SOCKET_POLL_ERROR == NET_POLL_ERROR);
+
+// the datagrams of a batch are handed to the network stack in chunks of this
+// size, an endpoint never has more datagrams queued
+#define SOCKET_BATCH_CHUNK_SIZE         32
+
+typedef enum _SOCKET_STATE
+{
+    SocketStateCreated,
+
+    // datagram sockets have their endpoint opened, stream sockets only
+    // remember the port until they listen on it
+    SocketStateBound,
+    SocketStateListening,
+
+    // a thread of the process waits in NetTcpConnect
+    SocketStateConnecting,
+    SocketStateConnected
+} SOCKET_STATE;
+
+typedef struct _SOCKET
+{
+    REF_COUNT                   RefCnt;
+
+    SOCKET_TYPE                 Type;
+
+    // held while changing the state, the operations which may wait only
+    // take it to find out the object of the network stack they work with
+    MUTEX                       StateLock;
+
+    _Guarded_by_(StateLock)
+    SOCKET_STATE                State;
+
+    // in host byte order
+    _Guarded_by_(StateLock)
+    PORT_NUMBER                 LocalPort;
+
+    // set by connecting a datagram socket, a 0 address means none
+    _Guarded_by_(StateLock)
+    SOCKET_ADDRESS              DefaultDestination;
+
+    // once set they do not change until the socket is destroyed
+    union
+    {
+        PNET_UDP_ENDPOINT       Endpoint;
+        PNET_TCP_LISTENER       Listener;
+        PNET_TCP_CONNECTION     Connection;
+    };
+} SOCKET;
+
+static FUNC_FreeFunction        _SocketDestroy;
+
+static
+STATUS
+_SocketAllocate(
+    IN          SOCKET_TYPE             Type,
+    OUT_PTR     PSOCKET*                Socket
+    );
+
+REQUIRES_EXCL_LOCK(Socket->StateLock)
+static
+STATUS
+_SocketOpenEndpoint(
+    INOUT       PSOCKET                 Socket,
+    IN          PORT_NUMBER             Port
+    );
+
+static
+STATUS
+_SocketGetEndpoint(
+    INOUT       PSOCKET                 Socket,
+    OUT         PNET_UDP_ENDPOINT*      Endpoint,
+    OUT_OPT     PSOCKET_ADDRESS         DefaultDestination
+    );
+
+static
+STATUS
+_SocketGetConnection(
+    IN          PSOCKET                 Socket,
+    OUT         PNET_TCP_CONNECTION*    Connection
+    );
+
+STATUS
+SocketCreate(
+    IN          SOCKET_TYPE             Type,
+    OUT_PTR     PSOCKET*                Socket
+    )
+{
+    if (Type >= SocketTypeReserved)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    return _SocketAllocate(Type, Socket);
+}
+
+void
+SocketReference(
+    INOUT       PSOCKET                 Socket
+    )
+{
+    ASSERT( NULL != Socket );
+
+    RfcReference(&Socket->RefCnt);
+}
+
+void
+SocketDereference(
+    INOUT       PSOCKET                 Socket
+    )
+{
+    ASSERT( NULL != Socket );
+
+    RfcDereference(&Socket->RefCnt);
+}
+
+STATUS
+SocketBind(
+    INOUT       PSOCKET                 Socket,
+    IN          WORD                    Port
+    )
+{
+    STATUS status;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    // the listening stream sockets need a well known port
+    if (SocketTypeStream == Socket->Type && 0 == Port)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+
+    MutexAcquire(&Socket->StateLock);
+    if (SocketStateCreated != Socket->State)
+    {
+        status = STATUS_SOCKET_INVALID_STATE;
+    }
+    else if (SocketTypeDatagram == Socket->Type)
+    {
+        status = _SocketOpenEndpoint(Socket, Port);
+    }
+    else
+    {
+        Socket->LocalPort = Port;
+        Socket->State = SocketStateBound;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    return status;
+}
+
+STATUS
+SocketListen(
+    INOUT       PSOCKET                 Socket,
+    IN          DWORD                   Backlog
+    )
+{
+    STATUS status;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == Backlog)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (SocketTypeStream != Socket->Type)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    MutexAcquire(&Socket->StateLock);
+    if (SocketStateBound != Socket->State)
+    {
+        status = STATUS_SOCKET_INVALID_STATE;
+    }
+    else
+    {
+        status = NetTcpListen(Socket->LocalPort, Backlog, &Socket->Listener);
+        if (SUCCEEDED(status))
+        {
+            Socket->State = SocketStateListening;
+        }
+    }
+    MutexRelease(&Socket->StateLock);
+
+    return status;
+}
+
+STATUS
+SocketAccept(
+    INOUT       PSOCKET                 Socket,
+    OUT_PTR     PSOCKET*                Connection
+    )
+{
+    STATUS status;
+    PNET_TCP_LISTENER pListener;
+    PNET_TCP_CONNECTION pConnection;
+    PSOCKET pSocket;
+    PORT_NUMBER localPort;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (SocketTypeStream != Socket->Type)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    pListener = NULL;
+    pConnection = NULL;
+    pSocket = NULL;
+    localPort = 0;
+
+    MutexAcquire(&Socket->StateLock);
+    if (SocketStateListening == Socket->State)
+    {
+        pListener = Socket->Listener;
+        localPort = Socket->LocalPort;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    if (NULL == pListener)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    __try
+    {
+        status = _SocketAllocate(SocketTypeStream, &pSocket);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_SocketAllocate", status);
+            __leave;
+        }
+
+        // the reference of the caller keeps the listener open
+        status = NetTcpAccept(pListener, &pConnection);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        pSocket->Connection = pConnection;
+        pSocket->LocalPort = localPort;
+        pSocket->State = SocketStateConnected;
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status) && NULL != pSocket)
+        {
+            SocketDereference(pSocket);
+            pSocket = NULL;
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        *Connection = pSocket;
+    }
+
+    return status;
+}
+
+STATUS
+SocketConnect(
+    INOUT       PSOCKET                 Socket,
+    IN          PSOCKET_ADDRESS         Address
+    )
+{
+    STATUS status;
+    SOCKET_STATE previousState;
+    PNET_TCP_CONNECTION pConnection;
+    IP4_ADDRESS destination;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Address)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+
+    if (SocketTypeDatagram == Socket->Type)
+    {
+        MutexAcquire(&Socket->StateLock);
+        if (SocketStateCreated == Socket->State)
+        {
+            status = _SocketOpenEndpoint(Socket, 0);
+        }
+        if (SUCCEEDED(status))
+        {
+            Socket->DefaultDestination = *Address;
+        }
+        MutexRelease(&Socket->StateLock);
+
+        return status;
+    }
+
+    if (0 == Address->Address || 0 == Address->Port)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    MutexAcquire(&Socket->StateLock);
+    previousState = Socket->State;
+    if (SocketStateCreated == previousState || SocketStateBound == previousState)
+    {
+        Socket->State = SocketStateConnecting;
+    }
+    else
+    {
+        status = STATUS_SOCKET_INVALID_STATE;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    // the handshake may take seconds, the state keeps the other threads
+    // from using the socket meanwhile
+    destination.DwordAddress = Address->Address;
+    pConnection = NULL;
+    status = NetTcpConnect(destination, Address->Port, &pConnection);
+
+    MutexAcquire(&Socket->StateLock);
+    if (SUCCEEDED(status))
+    {
+        Socket->Connection = pConnection;
+        Socket->State = SocketStateConnected;
+    }
+    else
+    {
+        Socket->State = previousState;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    return status;
+}
+
+STATUS
+SocketSend(
+    INOUT       PSOCKET                 Socket,
+    IN_READS_BYTES(Size)
+                PVOID                   Buffer,
+    IN          DWORD                   Size,
+    IN_OPT      PSOCKET_ADDRESS         Destination,
+    OUT         DWORD*                  BytesSent
+    )
+{
+    STATUS status;
+    PNET_UDP_ENDPOINT pEndpoint;
+    PNET_TCP_CONNECTION pConnection;
+    SOCKET_ADDRESS destination;
+    IP4_ADDRESS address;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesSent)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    *BytesSent = 0;
+
+    if (SocketTypeStream == Socket->Type)
+    {
+        status = _SocketGetConnection(Socket, &pConnection);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+
+        return NetTcpSend(pConnection, Buffer, Size, BytesSent);
+    }
+
+    if (Size > MAX_WORD)
+    {
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    status = _SocketGetEndpoint(Socket, &pEndpoint, &destination);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (NULL != Destination)
+    {
+        destination = *Destination;
+    }
+
+    if (0 == destination.Address)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    address.DwordAddress = destination.Address;
+    status = NetUdpSend(pEndpoint, address, destination.Port, Buffer, (WORD) Size);
+    if (SUCCEEDED(status))
+    {
+        *BytesSent = Size;
+    }
+
+    return status;
+}
+
+STATUS
+SocketReceive(
+    INOUT       PSOCKET                 Socket,
+    OUT_WRITES_BYTES(Size)
+                PVOID                   Buffer,
+    IN          DWORD                   Size,
+    OUT_OPT     PSOCKET_ADDRESS         Source,
+    OUT         DWORD*                  BytesReceived
+    )
+{
+    STATUS status;
+    PNET_UDP_ENDPOINT pEndpoint;
+    PNET_TCP_CONNECTION pConnection;
+    IP4_ADDRESS address;
+    PORT_NUMBER port;
+    WORD bytesReceived;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesReceived)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    *BytesReceived = 0;
+
+    if (SocketTypeStream == Socket->Type)
+    {
+        status = _SocketGetConnection(Socket, &pConnection);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+
+        status = NetTcpReceive(pConnection, Buffer, Size, BytesReceived);
+        if (SUCCEEDED(status) && NULL != Source)
+        {
+            NetTcpGetRemoteAddress(pConnection, &address, &port);
+            Source->Address = address.DwordAddress;
+            Source->Port = port;
+        }
+
+        return status;
+    }
+
+    status = _SocketGetEndpoint(Socket, &pEndpoint, NULL);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = NetUdpReceive(pEndpoint,
+                           Buffer,
+                           (WORD) min(Size, MAX_WORD),
+                           &bytesReceived,
+                           &address,
+                           &port);
+    if (SUCCEEDED(status))
+    {
+        *BytesReceived = bytesReceived;
+        if (NULL != Source)
+        {
+            Source->Address = address.DwordAddress;
+            Source->Port = port;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+SocketSendBatch(
+    INOUT       PSOCKET                 Socket,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsSent
+    )
+{
+    STATUS status;
+    STATUS sendStatus;
+    PNET_UDP_ENDPOINT pEndpoint;
+    SOCKET_ADDRESS defaultDestination;
+    NET_UDP_DATAGRAM datagrams[SOCKET_BATCH_CHUNK_SIZE];
+    PSOCKET_DATAGRAM pDatagram;
+    DWORD first;
+    DWORD count;
+    DWORD sent;
+    DWORD totalSent;
+    DWORD i;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Datagrams && 0 != NumberOfDatagrams)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == DatagramsSent)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    *DatagramsSent = 0;
+
+    if (SocketTypeDatagram != Socket->Type)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    status = _SocketGetEndpoint(Socket, &pEndpoint, &defaultDestination);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    totalSent = 0;
+
+    for (first = 0; first < NumberOfDatagrams && SUCCEEDED(status); first += count)
+    {
+        for (count = 0;
+             count < SOCKET_BATCH_CHUNK_SIZE && first + count < NumberOfDatagrams;
+             ++count)
+        {
+            pDatagram = &Datagrams[first + count];
+            pDatagram->BytesTransferred = 0;
+
+            if (pDatagram->Size > MAX_WORD)
+            {
+                status = STATUS_BUFFER_TOO_LARGE;
+                break;
+            }
+
+            datagrams[count].Buffer = pDatagram->Buffer;
+            datagrams[count].Size = (WORD) pDatagram->Size;
+
+            if (0 != pDatagram->Address.Address)
+            {
+                datagrams[count].Address.DwordAddress = pDatagram->Address.Address;
+                datagrams[count].Port = pDatagram->Address.Port;
+            }
+            else if (0 != defaultDestination.Address)
+            {
+                datagrams[count].Address.DwordAddress = defaultDestination.Address;
+                datagrams[count].Port = defaultDestination.Port;
+            }
+            else
+            {
+                status = STATUS_SOCKET_INVALID_STATE;
+                break;
+            }
+        }
+
+        if (0 == count)
+        {
+            break;
+        }
+
+        sent = 0;
+        sendStatus = NetUdpSendBatch(pEndpoint, datagrams, count, &sent);
+
+        for (i = 0; i < sent; ++i)
+        {
+            Datagrams[first + i].BytesTransferred = Datagrams[first + i].Size;
+        }
+        totalSent += sent;
+
+        if (!SUCCEEDED(sendStatus))
+        {
+            status = sendStatus;
+        }
+        else if (sent < count)
+        {
+            // the error of the datagram which stopped the batch is reported
+            // when the caller retries it
+            break;
+        }
+    }
+
+    *DatagramsSent = totalSent;
+
+    return 0 != totalSent ? STATUS_SUCCESS : status;
+}
+
+STATUS
+SocketReceiveBatch(
+    INOUT       PSOCKET                 Socket,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsReceived
+    )
+{
+    STATUS status;
+    PNET_UDP_ENDPOINT pEndpoint;
+    NET_UDP_DATAGRAM datagrams[SOCKET_BATCH_CHUNK_SIZE];
+    DWORD count;
+    DWORD received;
+    DWORD i;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Datagrams || 0 == NumberOfDatagrams)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == DatagramsReceived)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    *DatagramsReceived = 0;
+
+    if (SocketTypeDatagram != Socket->Type)
+    {
+        return STATUS_SOCKET_INVALID_STATE;
+    }
+
+    status = _SocketGetEndpoint(Socket, &pEndpoint, NULL);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    // a single call, only the first datagram is waited for
+    count = min(NumberOfDatagrams, SOCKET_BATCH_CHUNK_SIZE);
+    for (i = 0; i < count; ++i)
+    {
+        datagrams[i].Buffer = Datagrams[i].Buffer;
+        datagrams[i].Size = (WORD) min(Datagrams[i].Size, MAX_WORD);
+    }
+
+    received = 0;
+    status = NetUdpReceiveBatch(pEndpoint, datagrams, count, &received);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    for (i = 0; i < received; ++i)
+    {
+        Datagrams[i].BytesTransferred = datagrams[i].Size;
+        Datagrams[i].Address.Address = datagrams[i].Address.DwordAddress;
+        Datagrams[i].Address.Port = datagrams[i].Port;
+    }
+
+    *DatagramsReceived = received;
+
+    return status;
+}
+
+DWORD
+SocketPoll(
+    IN          PSOCKET                 Socket
+    )
+{
+    DWORD events;
+
+    ASSERT( NULL != Socket );
+
+    events = 0;
+
+    MutexAcquire(&Socket->StateLock);
+    switch (Socket->State)
+    {
+    case SocketStateCreated:
+        // the first datagram sent binds the socket
+        if (SocketTypeDatagram == Socket->Type)
+        {
+            events = SOCKET_POLL_WRITE;
+        }
+        break;
+    case SocketStateBound:
+        if (SocketTypeDatagram == Socket->Type)
+        {
+            events = NetUdpPoll(Socket->Endpoint);
+        }
+        break;
+    case SocketStateListening:
+        events = NetTcpPollListener(Socket->Listener);
+        break;
+    case SocketStateConnected:
+        events = NetTcpPoll(Socket->Connection);
+        break;
+    default:
+        break;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    return events;
+}
+
+STATUS
+SocketPollHandles(
+    IN          PPROCESS                Process,
+    INOUT_UPDATES(NumberOfEntries)
+                PSOCKET_POLL_ENTRY      Entries,
+    IN          DWORD                   NumberOfEntries,
+    IN          QWORD                   TimeoutUs,
+    OUT         DWORD*                  ReadyEntries
+    )
+{
+    PSOCKET pSocket;
+    QWORD nowUs;
+    QWORD deadlineUs;
+    DWORD readyEntries;
+    DWORD i;
+
+    if (NULL == Process)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Entries || 0 == NumberOfEntries)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == ReadyEntries)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    nowUs = IoGetSystemTimeUs();
+    deadlineUs = (TimeoutUs > MAX_QWORD - nowUs) ? MAX_QWORD : nowUs + TimeoutUs;
+
+    // the network stack has no way to notify a set of sockets, we check all
+    // of them and yield the CPU until one becomes ready
+    // warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        readyEntries = 0;
+
+        for (i = 0; i < NumberOfEntries; ++i)
+        {
+            pSocket = SocketReferenceByHandle(Process, Entries[i].Socket);
+            if (NULL == pSocket)
+            {
+                Entries[i].ReadyEvents = SOCKET_POLL_ERROR;
+            }
+            else
+            {
+                Entries[i].ReadyEvents = SocketPoll(pSocket) & (Entries[i].Events | SOCKET_POLL_ERROR);
+                SocketDereference(pSocket);
+            }
+
+            if (0 != Entries[i].ReadyEvents)
+            {
+                readyEntries++;
+            }
+        }
+
+        if (0 != readyEntries || IoGetSystemTimeUs() >= deadlineUs)
+        {
+            break;
+        }
+
+        ThreadYield();
+    }
+
+    *ReadyEntries = readyEntries;
+
+    return 0 != readyEntries ? STATUS_SUCCESS : STATUS_TIMEOUT;
+}
+
+STATUS
+SocketInsertHandle(
+    INOUT       PPROCESS                Process,
+    IN          PSOCKET                 Socket,
+    OUT         UM_HANDLE*              Handle
+    )
+{
+    ASSERT( NULL != Process );
+    ASSERT( NULL != Socket );
+    ASSERT( NULL != Handle );
+
+    return HandleTableInsert(&Process->HandleTable, HandleTypeSocket, &Socket->RefCnt, Handle);
+}
+
+PTR_SUCCESS
+PSOCKET
+SocketReferenceByHandle(
+    IN          PPROCESS                Process,
+    IN          UM_HANDLE               Handle
+    )
+{
+    PREF_COUNT pObject;
+
+    ASSERT( NULL != Process );
+
+    pObject = HandleTableReference(&Process->HandleTable, Handle, HandleTypeSocket);
+
+    return (NULL != pObject) ? CONTAINING_RECORD(pObject, SOCKET, RefCnt) : NULL;
+}
+
+STATUS
+SocketCloseHandle(
+    INOUT       PPROCESS                Process,
+    IN          UM_HANDLE               Handle
+    )
+{
+    ASSERT( NULL != Process );
+
+    // the threads still using the socket keep it alive until they return
+    return HandleTableClose(&Process->HandleTable, Handle, HandleTypeSocket);
+}
+
+static
+STATUS
+_SocketAllocate(
+    IN          SOCKET_TYPE             Type,
+    OUT_PTR     PSOCKET*                Socket
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+
+    ASSERT( NULL != Socket );
+
+    pSocket = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(SOCKET), HEAP_SOCKET_TAG, 0);
+    if (NULL == pSocket)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(SOCKET));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    RfcPreInit(&pSocket->RefCnt);
+
+    status = RfcInit(&pSocket->RefCnt, _SocketDestroy, NULL);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RfcInit", status);
+        ExFreePoolWithTag(pSocket, HEAP_SOCKET_TAG);
+        return status;
+    }
+
+    pSocket->Type = Type;
+    pSocket->State = SocketStateCreated;
+    MutexInit(&pSocket->StateLock, FALSE);
+
+    *Socket = pSocket;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+(__cdecl _SocketDestroy)(
+    IN      PVOID                   Object,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PSOCKET pSocket;
+
+    ASSERT( NULL != Object );
+    ASSERT( NULL == Context );
+
+    pSocket = CONTAINING_RECORD(Object, SOCKET, RefCnt);
+
+    // no thread can use the socket anymore, the state cannot change
+    if (SocketTypeDatagram == pSocket->Type)
+    {
+        if (SocketStateBound == pSocket->State)
+        {
+            NetUdpClose(pSocket->Endpoint);
+        }
+    }
+    else if (SocketStateListening == pSocket->State)
+    {
+        NetTcpCloseListener(pSocket->Listener);
+    }
+    else if (SocketStateConnected == pSocket->State)
+    {
+        NetTcpClose(pSocket->Connection);
+    }
+
+    ExFreePoolWithTag(pSocket, HEAP_SOCKET_TAG);
+}
+
+REQUIRES_EXCL_LOCK(Socket->StateLock)
+static
+STATUS
+_SocketOpenEndpoint(
+    INOUT       PSOCKET                 Socket,
+    IN          PORT_NUMBER             Port
+    )
+{
+    STATUS status;
+
+    ASSERT( NULL != Socket );
+    ASSERT( SocketTypeDatagram == Socket->Type );
+    ASSERT( SocketStateCreated == Socket->State );
+
+    status = NetUdpOpen(Port, &Socket->Endpoint);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    Socket->LocalPort = NetUdpGetLocalPort(Socket->Endpoint);
+    Socket->State = SocketStateBound;
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_SocketGetEndpoint(
+    INOUT       PSOCKET                 Socket,
+    OUT         PNET_UDP_ENDPOINT*      Endpoint,
+    OUT_OPT     PSOCKET_ADDRESS         DefaultDestination
+    )
+{
+    STATUS status;
+
+    ASSERT( NULL != Socket );
+    ASSERT( SocketTypeDatagram == Socket->Type );
+    ASSERT( NULL != Endpoint );
+
+    status = STATUS_SUCCESS;
+
+    MutexAcquire(&Socket->StateLock);
+
+    // using an unbound socket binds it to an ephemeral port
+    if (SocketStateCreated == Socket->State)
+    {
+        status = _SocketOpenEndpoint(Socket, 0);
+    }
+
+    if (SUCCEEDED(status))
+    {
+        *Endpoint = Socket->Endpoint;
+        if (NULL != DefaultDestination)
+        {
+            *DefaultDestination = Socket->DefaultDestination;
+        }
+    }
+
+    MutexRelease(&Socket->StateLock);
+
+    return status;
+}
+
+static
+STATUS
+_SocketGetConnection(
+    IN          PSOCKET                 Socket,
+    OUT         PNET_TCP_CONNECTION*    Connection
+    )
+{
+    STATUS status;
+
+    ASSERT( NULL != Socket );
+    ASSERT( SocketTypeStream == Socket->Type );
+    ASSERT( NULL != Connection );
+
+    status = STATUS_SUCCESS;
+
+    MutexAcquire(&Socket->StateLock);
+    if (SocketStateConnected == Socket->State)
+    {
+        *Connection = Socket->Connection;
+    }
+    else
+    {
+        status = STATUS_SOCKET_INVALID_STATE;
+    }
+    MutexRelease(&Socket->StateLock);
+
+    return status;
+}
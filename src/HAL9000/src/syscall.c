@@ -6,12 +6,46 @@
 #include "syscall_no.h"
 #include "mmu.h"
 #include "process_internal.h"
+#include "thread_internal.h"
 #include "dmp_cpu.h"
+#include "socket.h"
+#include "rtc.h"
+#include "syscall_ring.h"
 
 extern void SyscallEntry();
 
 #define SYSCALL_IF_VERSION_KM       SYSCALL_IMPLEMENTED_IF_VERSION
 
+// Indexed by the SYSCALL_ID, updated by all the CPUs
+static SYSCALL_STATISTICS m_syscallStatistics[SyscallIdReserved];
+
+static
+void
+_SyscallUpdateStatistics(
+    IN          SYSCALL_ID              SyscallId,
+    IN          BOOLEAN                 FastCall,
+    IN          QWORD                   Cycles
+    );
+
+static
+STATUS
+_SyscallCaptureArray(
+    IN          PVOID                   UserArray,
+    IN          DWORD                   ElementSize,
+    IN          DWORD                   NumberOfElements,
+    IN          DWORD                   MaximumElements,
+    OUT_PTR     PVOID*                  KernelArray
+    );
+
+static
+STATUS
+_SyscallValidateDatagrams(
+    IN_READS(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    IN          PAGE_RIGHTS             BufferRights
+    );
+
 void
 SyscallHandler(
     INOUT   COMPLETE_PROCESSOR_STATE    *CompleteProcessorState
@@ -22,6 +56,9 @@ SyscallHandler(
     PQWORD pParameters;
     STATUS status;
     REGISTER_AREA* usermodeProcessorState;
+    QWORD registerArguments[SYSCALL_MAX_REGISTER_ARGUMENTS];
+    BOOLEAN bFastCall;
+    QWORD startTicks;
 
     ASSERT(CompleteProcessorState != NULL);
 
@@ -31,12 +68,16 @@ SyscallHandler(
     ASSERT(CpuIntrGetState() == INTR_OFF);
     CpuIntrSetState(INTR_ON);
 
+    startTicks = RtcGetTickCount();
+
     LOG_TRACE_USERMODE("The syscall handler has been called!\n");
 
     status = STATUS_SUCCESS;
     pSyscallParameters = NULL;
     pParameters = NULL;
     usermodeProcessorState = &CompleteProcessorState->RegisterArea;
+    bFastCall = IsBooleanFlagOn(usermodeProcessorState->RegisterValues[RegisterR8], SYSCALL_FAST_CALL_FLAG);
+    sysCallId = (SYSCALL_ID) (usermodeProcessorState->RegisterValues[RegisterR8] & ~SYSCALL_FAST_CALL_FLAG);
 
     __try
     {
@@ -45,35 +86,39 @@ SyscallHandler(
             DumpProcessorState(CompleteProcessorState);
         }
 
-        // Check if indeed the shadow stack is valid (the shadow stack is mandatory)
-        pParameters = (PQWORD)usermodeProcessorState->RegisterValues[RegisterRbp];
-        status = MmuIsBufferValid(pParameters, SHADOW_STACK_SIZE, PAGE_RIGHTS_READ, GetCurrentProcess());
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("MmuIsBufferValid", status);
-            __leave;
-        }
-
-        sysCallId = usermodeProcessorState->RegisterValues[RegisterR8];
-
         LOG_TRACE_USERMODE("System call ID is %u\n", sysCallId);
 
-        // The first parameter is the system call ID, we don't care about it => +1
-        pSyscallParameters = (PQWORD)usermodeProcessorState->RegisterValues[RegisterRbp] + 1;
-
-        // Dispatch syscalls
-        switch (sysCallId)
+        if (bFastCall)
         {
-        case SyscallIdIdentifyVersion:
-            status = SyscallValidateInterface((SYSCALL_IF_VERSION)*pSyscallParameters);
-            break;
-        // STUDENT TODO: implement the rest of the syscalls
-        default:
-            LOG_ERROR("Unimplemented syscall called from User-space!\n");
-            status = STATUS_UNSUPPORTED;
-            break;
+            // The arguments were captured with the rest of the UM registers,
+            // there is no user memory to validate. The pointers received are
+            // validated by each system call, the same as on the slow path.
+            registerArguments[0] = usermodeProcessorState->RegisterValues[RegisterR9];
+            registerArguments[1] = usermodeProcessorState->RegisterValues[RegisterR10];
+            registerArguments[2] = usermodeProcessorState->RegisterValues[RegisterRbx];
+            registerArguments[3] = usermodeProcessorState->RegisterValues[RegisterRsi];
+            registerArguments[4] = usermodeProcessorState->RegisterValues[RegisterR12];
+            registerArguments[5] = usermodeProcessorState->RegisterValues[RegisterR13];
+
+            pSyscallParameters = registerArguments;
+        }
+        else
+        {
+            // Check if indeed the shadow stack is valid (the shadow stack is mandatory)
+            pParameters = (PQWORD)usermodeProcessorState->RegisterValues[RegisterRbp];
+            status = MmuIsBufferValid(pParameters, SHADOW_STACK_SIZE, PAGE_RIGHTS_READ, GetCurrentProcess());
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("MmuIsBufferValid", status);
+                __leave;
+            }
+
+            // The first parameter is the system call ID, we don't care about it => +1
+            pSyscallParameters = pParameters + 1;
         }
 
+        // Dispatch syscalls
+        status = SyscallDispatch(sysCallId, pSyscallParameters);
     }
     __finally
     {
@@ -81,10 +126,108 @@ SyscallHandler(
 
         usermodeProcessorState->RegisterValues[RegisterRax] = status;
 
+        if ((DWORD) sysCallId < SyscallIdReserved)
+        {
+            _SyscallUpdateStatistics(sysCallId, bFastCall, RtcGetTickCount() - startTicks);
+        }
+
         CpuIntrSetState(INTR_OFF);
     }
 }
 
+STATUS
+SyscallDispatch(
+    IN          SYSCALL_ID              SyscallId,
+    IN          PQWORD                  Arguments
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Arguments);
+
+    switch (SyscallId)
+    {
+    case SyscallIdIdentifyVersion:
+        status = SyscallValidateInterface((SYSCALL_IF_VERSION)*Arguments);
+        break;
+    case SyscallIdThreadSetAffinity:
+        status = SyscallThreadSetAffinity((UM_HANDLE)Arguments[0],
+                                          (THREAD_AFFINITY)Arguments[1]);
+        break;
+    case SyscallIdSocketCreate:
+        status = SyscallSocketCreate((SOCKET_TYPE)Arguments[0],
+                                     (UM_HANDLE*)Arguments[1]);
+        break;
+    case SyscallIdSocketClose:
+        status = SyscallSocketClose((UM_HANDLE)Arguments[0]);
+        break;
+    case SyscallIdSocketBind:
+        status = SyscallSocketBind((UM_HANDLE)Arguments[0],
+                                   (WORD)Arguments[1]);
+        break;
+    case SyscallIdSocketListen:
+        status = SyscallSocketListen((UM_HANDLE)Arguments[0],
+                                     (DWORD)Arguments[1]);
+        break;
+    case SyscallIdSocketAccept:
+        status = SyscallSocketAccept((UM_HANDLE)Arguments[0],
+                                     (UM_HANDLE*)Arguments[1]);
+        break;
+    case SyscallIdSocketConnect:
+        status = SyscallSocketConnect((UM_HANDLE)Arguments[0],
+                                      (PSOCKET_ADDRESS)Arguments[1]);
+        break;
+    case SyscallIdSocketSend:
+        status = SyscallSocketSend((UM_HANDLE)Arguments[0],
+                                   (PVOID)Arguments[1],
+                                   Arguments[2],
+                                   (PSOCKET_ADDRESS)Arguments[3],
+                                   (QWORD*)Arguments[4]);
+        break;
+    case SyscallIdSocketReceive:
+        status = SyscallSocketReceive((UM_HANDLE)Arguments[0],
+                                      (PVOID)Arguments[1],
+                                      Arguments[2],
+                                      (PSOCKET_ADDRESS)Arguments[3],
+                                      (QWORD*)Arguments[4]);
+        break;
+    case SyscallIdSocketSendBatch:
+        status = SyscallSocketSendBatch((UM_HANDLE)Arguments[0],
+                                        (PSOCKET_DATAGRAM)Arguments[1],
+                                        (DWORD)Arguments[2],
+                                        (DWORD*)Arguments[3]);
+        break;
+    case SyscallIdSocketReceiveBatch:
+        status = SyscallSocketReceiveBatch((UM_HANDLE)Arguments[0],
+                                           (PSOCKET_DATAGRAM)Arguments[1],
+                                           (DWORD)Arguments[2],
+                                           (DWORD*)Arguments[3]);
+        break;
+    case SyscallIdSocketPoll:
+        status = SyscallSocketPoll((PSOCKET_POLL_ENTRY)Arguments[0],
+                                   (DWORD)Arguments[1],
+                                   Arguments[2],
+                                   (DWORD*)Arguments[3]);
+        break;
+    case SyscallIdRingSetup:
+        status = SyscallRingSetup((DWORD)Arguments[0],
+                                  (PVOID*)Arguments[1]);
+        break;
+    case SyscallIdRingEnter:
+        status = SyscallRingEnter((DWORD)Arguments[0],
+                                  (DWORD)Arguments[1],
+                                  (DWORD*)Arguments[2]);
+        break;
+    // STUDENT TODO: implement the rest of the syscalls
+    default:
+        LOG_ERROR("Unimplemented syscall called from User-space!\n");
+        status = STATUS_UNSUPPORTED;
+        break;
+    }
+
+    return status;
+}
+
 void
 SyscallPreinitSystem(
     void
@@ -109,6 +252,54 @@ SyscallUninitSystem(
     return STATUS_SUCCESS;
 }
 
+void
+SyscallGetStatistics(
+    OUT_WRITES(SyscallIdReserved)
+            PSYSCALL_STATISTICS     Statistics
+    )
+{
+    ASSERT(Statistics != NULL);
+
+    // the counters are not read atomically as a whole, this is only a snapshot
+    memcpy(Statistics, m_syscallStatistics, sizeof(m_syscallStatistics));
+}
+
+void
+SyscallResetStatistics(
+    void
+    )
+{
+    memzero(m_syscallStatistics, sizeof(m_syscallStatistics));
+}
+
+static
+void
+_SyscallUpdateStatistics(
+    IN          SYSCALL_ID              SyscallId,
+    IN          BOOLEAN                 FastCall,
+    IN          QWORD                   Cycles
+    )
+{
+    PSYSCALL_STATISTICS pStatistics;
+    DWORD bucket;
+
+    ASSERT((DWORD) SyscallId < SyscallIdReserved);
+
+    pStatistics = &m_syscallStatistics[SyscallId];
+
+    for (bucket = 0;
+         bucket < SYSCALL_LATENCY_BUCKETS - 1 && Cycles >= ((QWORD)SYSCALL_LATENCY_FIRST_BUCKET_CYCLES << bucket);
+         ++bucket);
+
+    _InterlockedIncrement64(&pStatistics->Calls);
+    if (FastCall)
+    {
+        _InterlockedIncrement64(&pStatistics->FastCalls);
+    }
+    _InterlockedExchangeAdd64(&pStatistics->TotalCycles, Cycles);
+    _InterlockedIncrement64(&pStatistics->LatencyBuckets[bucket]);
+}
+
 void
 SyscallCpuInit(
     void
@@ -169,4 +360,638 @@ SyscallValidateInterface(
     return STATUS_SUCCESS;
 }
 
-// STUDENT TODO: implement the rest of the syscalls
\ No newline at end of file
+// SyscallIdThreadSetAffinity
+STATUS
+SyscallThreadSetAffinity(
+    IN_OPT      UM_HANDLE               ThreadHandle,
+    IN          THREAD_AFFINITY         Affinity
+    )
+{
+    STATUS status;
+    PREF_COUNT pObject;
+    PTHREAD pThread;
+
+    if (UM_INVALID_HANDLE_VALUE == ThreadHandle)
+    {
+        return ThreadSetAffinity(GetCurrentThread(), Affinity);
+    }
+
+    pObject = HandleTableReference(&GetCurrentProcess()->HandleTable, ThreadHandle, HandleTypeThread);
+    if (NULL == pObject)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    pThread = CONTAINING_RECORD(pObject, THREAD, RefCnt);
+
+    status = ThreadSetAffinity(pThread, Affinity);
+
+    ThreadCloseHandle(pThread);
+
+    return status;
+}
+
+// STUDENT TODO: implement the rest of the syscalls
+// SyscallIdSocketCreate
+STATUS
+SyscallSocketCreate(
+    IN          SOCKET_TYPE             Type,
+    OUT         UM_HANDLE*              SocketHandle
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    UM_HANDLE handle;
+
+    status = MmuIsBufferValid(SocketHandle, sizeof(UM_HANDLE), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = SocketCreate(Type, &pSocket);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = SocketInsertHandle(GetCurrentProcess(), pSocket, &handle);
+    if (!SUCCEEDED(status))
+    {
+        SocketDereference(pSocket);
+        return status;
+    }
+
+    *SocketHandle = handle;
+
+    return STATUS_SUCCESS;
+}
+
+// SyscallIdSocketClose
+STATUS
+SyscallSocketClose(
+    IN          UM_HANDLE               SocketHandle
+    )
+{
+    return SocketCloseHandle(GetCurrentProcess(), SocketHandle);
+}
+
+// SyscallIdSocketBind
+STATUS
+SyscallSocketBind(
+    IN          UM_HANDLE               SocketHandle,
+    IN          WORD                    Port
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    status = SocketBind(pSocket, Port);
+
+    SocketDereference(pSocket);
+
+    return status;
+}
+
+// SyscallIdSocketListen
+STATUS
+SyscallSocketListen(
+    IN          UM_HANDLE               SocketHandle,
+    IN          DWORD                   Backlog
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    status = SocketListen(pSocket, Backlog);
+
+    SocketDereference(pSocket);
+
+    return status;
+}
+
+// SyscallIdSocketAccept
+STATUS
+SyscallSocketAccept(
+    IN          UM_HANDLE               SocketHandle,
+    OUT         UM_HANDLE*              ConnectionHandle
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    PSOCKET pConnection;
+    UM_HANDLE handle;
+
+    status = MmuIsBufferValid(ConnectionHandle, sizeof(UM_HANDLE), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    pConnection = NULL;
+
+    __try
+    {
+        status = SocketAccept(pSocket, &pConnection);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        status = SocketInsertHandle(GetCurrentProcess(), pConnection, &handle);
+        if (!SUCCEEDED(status))
+        {
+            SocketDereference(pConnection);
+            __leave;
+        }
+
+        *ConnectionHandle = handle;
+    }
+    __finally
+    {
+        SocketDereference(pSocket);
+    }
+
+    return status;
+}
+
+// SyscallIdSocketConnect
+STATUS
+SyscallSocketConnect(
+    IN          UM_HANDLE               SocketHandle,
+    IN          PSOCKET_ADDRESS         Address
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    SOCKET_ADDRESS address;
+
+    status = MmuIsBufferValid(Address, sizeof(SOCKET_ADDRESS), PAGE_RIGHTS_READ, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+    address = *Address;
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    status = SocketConnect(pSocket, &address);
+
+    SocketDereference(pSocket);
+
+    return status;
+}
+
+// SyscallIdSocketSend
+STATUS
+SyscallSocketSend(
+    IN          UM_HANDLE               SocketHandle,
+    IN_READS_BYTES(BytesToSend)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToSend,
+    IN_OPT      PSOCKET_ADDRESS         Destination,
+    OUT         QWORD*                  BytesSent
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    SOCKET_ADDRESS destination;
+    DWORD bytesSent;
+
+    if (BytesToSend > MAX_DWORD)
+    {
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    status = MmuIsBufferValid(Buffer, BytesToSend, PAGE_RIGHTS_READ, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = MmuIsBufferValid(BytesSent, sizeof(QWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (NULL != Destination)
+    {
+        status = MmuIsBufferValid(Destination, sizeof(SOCKET_ADDRESS), PAGE_RIGHTS_READ, GetCurrentProcess());
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+        destination = *Destination;
+    }
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    bytesSent = 0;
+    status = SocketSend(pSocket,
+                        Buffer,
+                        (DWORD) BytesToSend,
+                        NULL != Destination ? &destination : NULL,
+                        &bytesSent);
+
+    SocketDereference(pSocket);
+
+    *BytesSent = bytesSent;
+
+    return status;
+}
+
+// SyscallIdSocketReceive
+STATUS
+SyscallSocketReceive(
+    IN          UM_HANDLE               SocketHandle,
+    OUT_WRITES_BYTES(BytesToReceive)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToReceive,
+    OUT_OPT     PSOCKET_ADDRESS         Source,
+    OUT         QWORD*                  BytesReceived
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    SOCKET_ADDRESS source;
+    DWORD bytesReceived;
+
+    status = MmuIsBufferValid(Buffer, BytesToReceive, PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = MmuIsBufferValid(BytesReceived, sizeof(QWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (NULL != Source)
+    {
+        status = MmuIsBufferValid(Source, sizeof(SOCKET_ADDRESS), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+    if (NULL == pSocket)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    bytesReceived = 0;
+    memzero(&source, sizeof(SOCKET_ADDRESS));
+
+    // a larger buffer is used only partially
+    status = SocketReceive(pSocket,
+                           Buffer,
+                           (DWORD) min(BytesToReceive, MAX_DWORD),
+                           &source,
+                           &bytesReceived);
+
+    SocketDereference(pSocket);
+
+    *BytesReceived = bytesReceived;
+    if (NULL != Source)
+    {
+        *Source = source;
+    }
+
+    return status;
+}
+
+// SyscallIdSocketSendBatch
+STATUS
+SyscallSocketSendBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsSent
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    PSOCKET_DATAGRAM pDatagrams;
+    DWORD datagramsSent;
+    DWORD i;
+
+    status = MmuIsBufferValid(DatagramsSent, sizeof(DWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    // the descriptors are captured, else the process could change the
+    // buffers after they were validated
+    status = _SyscallCaptureArray(Datagrams, sizeof(SOCKET_DATAGRAM), NumberOfDatagrams, SOCKET_MAX_BATCH_SIZE, (PVOID*) &pDatagrams);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    pSocket = NULL;
+    datagramsSent = 0;
+
+    __try
+    {
+        status = _SyscallValidateDatagrams(pDatagrams, NumberOfDatagrams, PAGE_RIGHTS_READ);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+        if (NULL == pSocket)
+        {
+            status = STATUS_INVALID_HANDLE;
+            __leave;
+        }
+
+        status = SocketSendBatch(pSocket, pDatagrams, NumberOfDatagrams, &datagramsSent);
+
+        for (i = 0; i < datagramsSent; ++i)
+        {
+            Datagrams[i].BytesTransferred = pDatagrams[i].BytesTransferred;
+        }
+
+        *DatagramsSent = datagramsSent;
+    }
+    __finally
+    {
+        if (NULL != pSocket)
+        {
+            SocketDereference(pSocket);
+        }
+
+        ExFreePoolWithTag(pDatagrams, HEAP_TEMP_TAG);
+    }
+
+    return status;
+}
+
+// SyscallIdSocketReceiveBatch
+STATUS
+SyscallSocketReceiveBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsReceived
+    )
+{
+    STATUS status;
+    PSOCKET pSocket;
+    PSOCKET_DATAGRAM pDatagrams;
+    DWORD datagramsReceived;
+    DWORD i;
+
+    status = MmuIsBufferValid(DatagramsReceived, sizeof(DWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = _SyscallCaptureArray(Datagrams, sizeof(SOCKET_DATAGRAM), NumberOfDatagrams, SOCKET_MAX_BATCH_SIZE, (PVOID*) &pDatagrams);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    pSocket = NULL;
+    datagramsReceived = 0;
+
+    __try
+    {
+        status = _SyscallValidateDatagrams(pDatagrams, NumberOfDatagrams, PAGE_RIGHTS_READWRITE);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        pSocket = SocketReferenceByHandle(GetCurrentProcess(), SocketHandle);
+        if (NULL == pSocket)
+        {
+            status = STATUS_INVALID_HANDLE;
+            __leave;
+        }
+
+        status = SocketReceiveBatch(pSocket, pDatagrams, NumberOfDatagrams, &datagramsReceived);
+
+        for (i = 0; i < datagramsReceived; ++i)
+        {
+            Datagrams[i].BytesTransferred = pDatagrams[i].BytesTransferred;
+            Datagrams[i].Address = pDatagrams[i].Address;
+        }
+
+        *DatagramsReceived = datagramsReceived;
+    }
+    __finally
+    {
+        if (NULL != pSocket)
+        {
+            SocketDereference(pSocket);
+        }
+
+        ExFreePoolWithTag(pDatagrams, HEAP_TEMP_TAG);
+    }
+
+    return status;
+}
+
+// SyscallIdSocketPoll
+STATUS
+SyscallSocketPoll(
+    INOUT_UPDATES(NumberOfEntries)
+                PSOCKET_POLL_ENTRY      Entries,
+    IN          DWORD                   NumberOfEntries,
+    IN          QWORD                   TimeoutUs,
+    OUT         DWORD*                  ReadyEntries
+    )
+{
+    STATUS status;
+    PSOCKET_POLL_ENTRY pEntries;
+    DWORD readyEntries;
+    DWORD i;
+
+    status = MmuIsBufferValid(ReadyEntries, sizeof(DWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = _SyscallCaptureArray(Entries, sizeof(SOCKET_POLL_ENTRY), NumberOfEntries, SOCKET_MAX_POLL_ENTRIES, (PVOID*) &pEntries);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    readyEntries = 0;
+    status = SocketPollHandles(GetCurrentProcess(), pEntries, NumberOfEntries, TimeoutUs, &readyEntries);
+    if (SUCCEEDED(status) || STATUS_TIMEOUT == status)
+    {
+        for (i = 0; i < NumberOfEntries; ++i)
+        {
+            Entries[i].ReadyEvents = pEntries[i].ReadyEvents;
+        }
+
+        *ReadyEntries = readyEntries;
+    }
+
+    ExFreePoolWithTag(pEntries, HEAP_TEMP_TAG);
+
+    return status;
+}
+
+// SyscallIdRingSetup
+STATUS
+SyscallRingSetup(
+    IN          DWORD                   Flags,
+    OUT         PVOID*                  Ring
+    )
+{
+    STATUS status;
+    PVOID pRing;
+
+    status = MmuIsBufferValid(Ring, sizeof(PVOID), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = SyscallRingCreateForProcess(GetCurrentProcess(), Flags, &pRing);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    *Ring = pRing;
+
+    return STATUS_SUCCESS;
+}
+
+// SyscallIdRingEnter
+STATUS
+SyscallRingEnter(
+    IN          DWORD                   ToSubmit,
+    IN          DWORD                   MinComplete,
+    OUT         DWORD*                  Submitted
+    )
+{
+    STATUS status;
+    DWORD submitted;
+
+    status = MmuIsBufferValid(Submitted, sizeof(DWORD), PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    submitted = 0;
+    status = SyscallRingSubmit(GetCurrentProcess(), ToSubmit, MinComplete, &submitted);
+
+    *Submitted = submitted;
+
+    return status;
+}
+
+static
+STATUS
+_SyscallCaptureArray(
+    IN          PVOID                   UserArray,
+    IN          DWORD                   ElementSize,
+    IN          DWORD                   NumberOfElements,
+    IN          DWORD                   MaximumElements,
+    OUT_PTR     PVOID*                  KernelArray
+    )
+{
+    STATUS status;
+    PVOID pArray;
+    DWORD size;
+
+    ASSERT( NULL != KernelArray );
+
+    if (0 == NumberOfElements || NumberOfElements > MaximumElements)
+    {
+        return STATUS_SIZE_INVALID;
+    }
+
+    size = ElementSize * NumberOfElements;
+
+    // the kernel writes its results back into the array
+    status = MmuIsBufferValid(UserArray, size, PAGE_RIGHTS_READWRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    pArray = ExAllocatePoolWithTag(0, size, HEAP_TEMP_TAG, 0);
+    if (NULL == pArray)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", size);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    memcpy(pArray, UserArray, size);
+
+    *KernelArray = pArray;
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_SyscallValidateDatagrams(
+    IN_READS(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    IN          PAGE_RIGHTS             BufferRights
+    )
+{
+    STATUS status;
+    DWORD i;
+
+    ASSERT( NULL != Datagrams );
+
+    for (i = 0; i < NumberOfDatagrams; ++i)
+    {
+        status = MmuIsBufferValid(Datagrams[i].Buffer, Datagrams[i].Size, BufferRights, GetCurrentProcess());
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
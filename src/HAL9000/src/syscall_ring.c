@@ -0,0 +1,534 @@
+#include "HAL9000.h"
+#include "syscall_ring.h"
+#include "syscall.h"
+#include "process_internal.h"
+#include "thread_internal.h"
+#include "mutex.h"
+#include "vmm.h"
+#include "mdl.h"
+#include "io.h"
+
+// the polling thread stops after it found no submission for this long, the
+// process must then call SyscallRingEnter to restart it
+#define SYSCALL_RING_POLLER_IDLE_US         (10 * MS_IN_US)
+
+#define SYSCALL_RING_SIZE                   AlignAddressUpper(sizeof(SYSCALL_RING), PAGE_SIZE)
+
+typedef struct _SYSCALL_RING_CONTEXT
+{
+    // kernel mapping of the ring, the same frames are mapped in the process at
+    // UserRing
+    PSYSCALL_RING               Ring;
+    PVOID                       UserRing;
+
+    PPROCESS                    Process;
+
+    BOOLEAN                     KernelPolling;
+
+    // serializes the consumers of the submissions
+    MUTEX                       ConsumerLock;
+
+    // the process may write any value in the indices of the ring, the kernel
+    // works only with its own copies and publishes them in the ring
+    _Guarded_by_(ConsumerLock)
+    DWORD                       SubmissionHead;
+
+    _Guarded_by_(ConsumerLock)
+    DWORD                       CompletionTail;
+
+    // held while the polling thread is started or decides to stop
+    MUTEX                       PollerLock;
+
+    _Guarded_by_(PollerLock)
+    BOOLEAN                     PollerRunning;
+} SYSCALL_RING_CONTEXT, *PSYSCALL_RING_CONTEXT;
+
+static FUNC_ThreadStart         _SyscallRingPoller;
+
+REQUIRES_EXCL_LOCK(Context->PollerLock)
+static
+STATUS
+_SyscallRingStartPoller(
+    INOUT       PSYSCALL_RING_CONTEXT   Context
+    );
+
+REQUIRES_EXCL_LOCK(Context->ConsumerLock)
+static
+DWORD
+_SyscallRingConsume(
+    INOUT       PSYSCALL_RING_CONTEXT   Context,
+    IN          DWORD                   MaxSubmissions
+    );
+
+static
+BOOLEAN
+_SyscallRingHasSubmissions(
+    IN          PSYSCALL_RING_CONTEXT   Context
+    );
+
+static
+STATUS
+_SyscallRingDispatch(
+    IN          PSYSCALL_RING_SUBMISSION    Submission
+    );
+
+static
+void
+_SyscallRingFree(
+    IN          PSYSCALL_RING_CONTEXT   Context
+    );
+
+STATUS
+SyscallRingCreateForProcess(
+    INOUT       PPROCESS                Process,
+    IN          DWORD                   Flags,
+    OUT_PTR     PVOID*                  UserRing
+    )
+{
+    STATUS status;
+    PSYSCALL_RING_CONTEXT pContext;
+    PMDL pMdl;
+    INTR_STATE oldState;
+    BOOLEAN bInserted;
+
+    ASSERT(NULL != Process);
+    ASSERT(NULL != UserRing);
+
+    if (0 != (Flags & ~SYSCALL_RING_SETUP_KERNEL_POLLING))
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL != Process->SyscallRing)
+    {
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    status = STATUS_SUCCESS;
+    pMdl = NULL;
+    bInserted = FALSE;
+
+    pContext = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(SYSCALL_RING_CONTEXT), HEAP_SYSCALL_TAG, 0);
+    if (NULL == pContext)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(SYSCALL_RING_CONTEXT));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    __try
+    {
+        pContext->Process = Process;
+        pContext->KernelPolling = IsBooleanFlagOn(Flags, SYSCALL_RING_SETUP_KERNEL_POLLING);
+        MutexInit(&pContext->ConsumerLock, FALSE);
+        MutexInit(&pContext->PollerLock, FALSE);
+
+        pContext->Ring = VmmAllocRegion(NULL,
+                                        SYSCALL_RING_SIZE,
+                                        VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
+                                        PAGE_RIGHTS_READWRITE);
+        if (NULL == pContext->Ring)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegion", SYSCALL_RING_SIZE);
+            status = STATUS_MEMORY_CANNOT_BE_COMMITED;
+            __leave;
+        }
+        memzero(pContext->Ring, SYSCALL_RING_SIZE);
+
+        pMdl = MdlAllocate(pContext->Ring, (DWORD) SYSCALL_RING_SIZE);
+        if (NULL == pMdl)
+        {
+            LOG_FUNC_ERROR_ALLOC("MdlAllocate", SYSCALL_RING_SIZE);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+
+        // the process maps the same frames, it never takes a fault on the ring
+        pContext->UserRing = VmmAllocRegionEx(NULL,
+                                              SYSCALL_RING_SIZE,
+                                              VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
+                                              PAGE_RIGHTS_READWRITE,
+                                              FALSE,
+                                              NULL,
+                                              Process->VaSpace,
+                                              Process->PagingData,
+                                              pMdl);
+        if (NULL == pContext->UserRing)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", SYSCALL_RING_SIZE);
+            status = STATUS_MEMORY_CANNOT_BE_COMMITED;
+            __leave;
+        }
+
+        // two threads of the process may set up a ring at the same time
+        LockAcquire(&Process->ThreadListLock, &oldState);
+        if (NULL == Process->SyscallRing)
+        {
+            Process->SyscallRing = pContext;
+            bInserted = TRUE;
+        }
+        LockRelease(&Process->ThreadListLock, oldState);
+
+        if (!bInserted)
+        {
+            status = STATUS_ALREADY_INITIALIZED;
+            __leave;
+        }
+
+        if (pContext->KernelPolling)
+        {
+            MutexAcquire(&pContext->PollerLock);
+            status = _SyscallRingStartPoller(pContext);
+            MutexRelease(&pContext->PollerLock);
+            if (!SUCCEEDED(status))
+            {
+                // the ring remains usable, SyscallRingEnter retries to start
+                // the thread
+                LOG_FUNC_ERROR("_SyscallRingStartPoller", status);
+                status = STATUS_SUCCESS;
+            }
+        }
+
+        *UserRing = pContext->UserRing;
+    }
+    __finally
+    {
+        if (NULL != pMdl)
+        {
+            MdlFree(pMdl);
+            pMdl = NULL;
+        }
+
+        if (!SUCCEEDED(status))
+        {
+            if (NULL != pContext->UserRing)
+            {
+                VmmFreeRegionEx(pContext->UserRing,
+                                0,
+                                VMM_FREE_TYPE_RELEASE,
+                                TRUE,
+                                Process->VaSpace,
+                                Process->PagingData);
+                pContext->UserRing = NULL;
+            }
+
+            _SyscallRingFree(pContext);
+            pContext = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+SyscallRingSubmit(
+    INOUT       PPROCESS                Process,
+    IN          DWORD                   ToSubmit,
+    IN          DWORD                   MinComplete,
+    OUT         DWORD*                  Submitted
+    )
+{
+    STATUS status;
+    PSYSCALL_RING_CONTEXT pContext;
+    PSYSCALL_RING pRing;
+    DWORD submitted;
+
+    ASSERT(NULL != Process);
+    ASSERT(NULL != Submitted);
+
+    pContext = Process->SyscallRing;
+    if (NULL == pContext)
+    {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (MinComplete > SYSCALL_RING_ENTRIES)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = STATUS_SUCCESS;
+    pRing = pContext->Ring;
+    submitted = 0;
+
+    if (pContext->KernelPolling)
+    {
+        // ToSubmit has no meaning, the thread consumes all the submissions
+        if (IsBooleanFlagOn(pRing->Flags, SYSCALL_RING_FLAG_NEED_WAKEUP))
+        {
+            MutexAcquire(&pContext->PollerLock);
+            if (!pContext->PollerRunning)
+            {
+                status = _SyscallRingStartPoller(pContext);
+            }
+            MutexRelease(&pContext->PollerLock);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_SyscallRingStartPoller", status);
+                return status;
+            }
+        }
+    }
+    else if (0 != ToSubmit)
+    {
+        MutexAcquire(&pContext->ConsumerLock);
+        submitted = _SyscallRingConsume(pContext, ToSubmit);
+        MutexRelease(&pContext->ConsumerLock);
+    }
+
+    // only the polling thread completes the submissions asynchronously, the
+    // wait ends if it has nothing left to complete
+    while (pContext->KernelPolling
+           && pContext->CompletionTail - pRing->CompletionHead < MinComplete
+           && (_SyscallRingHasSubmissions(pContext) || pContext->SubmissionHead != pContext->CompletionTail))
+    {
+        ThreadYield();
+    }
+
+    *Submitted = submitted;
+
+    return status;
+}
+
+void
+SyscallRingDestroyForProcess(
+    INOUT       PPROCESS                Process
+    )
+{
+    PSYSCALL_RING_CONTEXT pContext;
+
+    ASSERT(NULL != Process);
+
+    // the polling thread belongs to the process, it terminated before the
+    // process is destroyed
+    ASSERT(0 == Process->NumberOfThreads);
+
+    pContext = Process->SyscallRing;
+    if (NULL == pContext)
+    {
+        return;
+    }
+
+    // the mapping in the process was released together with its address
+    // space, the frames are freed by releasing the kernel mapping
+    pContext->UserRing = NULL;
+    _SyscallRingFree(pContext);
+
+    Process->SyscallRing = NULL;
+}
+
+static
+STATUS
+(__cdecl _SyscallRingPoller)(
+    IN_OPT      PVOID                   Context
+    )
+{
+    PSYSCALL_RING_CONTEXT pContext;
+    PSYSCALL_RING pRing;
+    QWORD lastSubmissionUs;
+    DWORD consumed;
+
+    ASSERT(NULL != Context);
+
+    pContext = (PSYSCALL_RING_CONTEXT) Context;
+    pRing = pContext->Ring;
+    lastSubmissionUs = IoGetSystemTimeUs();
+
+    while (TRUE)
+    {
+        MutexAcquire(&pContext->ConsumerLock);
+        consumed = _SyscallRingConsume(pContext, MAX_DWORD);
+        MutexRelease(&pContext->ConsumerLock);
+
+        if (0 != consumed)
+        {
+            lastSubmissionUs = IoGetSystemTimeUs();
+            continue;
+        }
+
+        // the thread must not keep a process alive after all of its other
+        // threads are gone
+        if (1 < pContext->Process->ActiveThreads
+            && IoGetSystemTimeUs() - lastSubmissionUs < SYSCALL_RING_POLLER_IDLE_US)
+        {
+            ThreadYield();
+            continue;
+        }
+
+        // The process checks the flag only after it published its submissions,
+        // so either it sees the flag set or the thread sees the submission
+        MutexAcquire(&pContext->PollerLock);
+        _InterlockedOr(&pRing->Flags, SYSCALL_RING_FLAG_NEED_WAKEUP);
+        if (_SyscallRingHasSubmissions(pContext)
+            && 1 < pContext->Process->ActiveThreads)
+        {
+            _InterlockedAnd(&pRing->Flags, ~SYSCALL_RING_FLAG_NEED_WAKEUP);
+            MutexRelease(&pContext->PollerLock);
+
+            lastSubmissionUs = IoGetSystemTimeUs();
+            continue;
+        }
+        pContext->PollerRunning = FALSE;
+        MutexRelease(&pContext->PollerLock);
+
+        break;
+    }
+
+    LOG_TRACE_USERMODE("Ring poller of process 0x%X stops\n", pContext->Process->Id);
+
+    return STATUS_SUCCESS;
+}
+
+REQUIRES_EXCL_LOCK(Context->PollerLock)
+static
+STATUS
+_SyscallRingStartPoller(
+    INOUT       PSYSCALL_RING_CONTEXT   Context
+    )
+{
+    STATUS status;
+    PTHREAD pThread;
+
+    ASSERT(NULL != Context);
+    ASSERT(!Context->PollerRunning);
+
+    // the flag is cleared first, the submissions published from now on are
+    // seen by the new thread
+    _InterlockedAnd(&Context->Ring->Flags, ~SYSCALL_RING_FLAG_NEED_WAKEUP);
+
+    status = ThreadCreateKernelThreadInProcess("RingPoller",
+                                               ThreadPriorityDefault,
+                                               _SyscallRingPoller,
+                                               Context,
+                                               &pThread,
+                                               Context->Process);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreateKernelThreadInProcess", status);
+        _InterlockedOr(&Context->Ring->Flags, SYSCALL_RING_FLAG_NEED_WAKEUP);
+        return status;
+    }
+
+    // the thread is never waited for, it clears PollerRunning when it stops
+    ThreadCloseHandle(pThread);
+
+    Context->PollerRunning = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+REQUIRES_EXCL_LOCK(Context->ConsumerLock)
+static
+DWORD
+_SyscallRingConsume(
+    INOUT       PSYSCALL_RING_CONTEXT   Context,
+    IN          DWORD                   MaxSubmissions
+    )
+{
+    PSYSCALL_RING pRing;
+    PSYSCALL_RING_COMPLETION pCompletion;
+    SYSCALL_RING_SUBMISSION submission;
+    DWORD consumed;
+    DWORD pending;
+
+    ASSERT(NULL != Context);
+
+    pRing = Context->Ring;
+    consumed = 0;
+
+    pending = pRing->SubmissionTail - Context->SubmissionHead;
+    if (pending > SYSCALL_RING_ENTRIES)
+    {
+        LOG_TRACE_USERMODE("Submission tail 0x%x is not valid, head is 0x%x\n",
+                           pRing->SubmissionTail, Context->SubmissionHead);
+        return 0;
+    }
+
+    while (consumed < min(pending, MaxSubmissions))
+    {
+        // a submission is taken only if its completion can be posted
+        if (Context->CompletionTail - pRing->CompletionHead >= SYSCALL_RING_ENTRIES)
+        {
+            break;
+        }
+
+        // the process may change the entry at any time, the kernel works on
+        // a copy
+        submission = pRing->Submissions[Context->SubmissionHead % SYSCALL_RING_ENTRIES];
+        Context->SubmissionHead++;
+        _InterlockedExchange(&pRing->SubmissionHead, Context->SubmissionHead);
+
+        pCompletion = &pRing->Completions[Context->CompletionTail % SYSCALL_RING_ENTRIES];
+        pCompletion->UserData = submission.UserData;
+        pCompletion->Status = _SyscallRingDispatch(&submission);
+
+        // the completion is written before it is published
+        Context->CompletionTail++;
+        _InterlockedExchange(&pRing->CompletionTail, Context->CompletionTail);
+
+        consumed++;
+    }
+
+    return consumed;
+}
+
+static
+BOOLEAN
+_SyscallRingHasSubmissions(
+    IN          PSYSCALL_RING_CONTEXT   Context
+    )
+{
+    DWORD pending;
+
+    ASSERT(NULL != Context);
+
+    // a tail which is not valid is the same as no submission
+    pending = Context->Ring->SubmissionTail - Context->SubmissionHead;
+
+    return 0 != pending && pending <= SYSCALL_RING_ENTRIES;
+}
+
+static
+STATUS
+_SyscallRingDispatch(
+    IN          PSYSCALL_RING_SUBMISSION    Submission
+    )
+{
+    ASSERT(NULL != Submission);
+
+    switch (Submission->SyscallId)
+    {
+    // a ring operation would recurse and the exit system calls never return
+    case SyscallIdRingSetup:
+    case SyscallIdRingEnter:
+    case SyscallIdThreadExit:
+    case SyscallIdProcessExit:
+        return STATUS_UNSUPPORTED;
+    default:
+        break;
+    }
+
+    if (Submission->SyscallId >= SyscallIdReserved)
+    {
+        return STATUS_UNSUPPORTED;
+    }
+
+    return SyscallDispatch((SYSCALL_ID) Submission->SyscallId, Submission->Arguments);
+}
+
+static
+void
+_SyscallRingFree(
+    IN          PSYSCALL_RING_CONTEXT   Context
+    )
+{
+    ASSERT(NULL != Context);
+    ASSERT(NULL == Context->UserRing);
+
+    if (NULL != Context->Ring)
+    {
+        VmmFreeRegion(Context->Ring, 0, VMM_FREE_TYPE_RELEASE);
+        Context->Ring = NULL;
+    }
+
+    ExFreePoolWithTag(Context, HEAP_SYSCALL_TAG);
+}
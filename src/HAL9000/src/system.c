@@ -9,6 +9,7 @@
 #include "print.h"
 #include "synch.h"
 #include "mmu.h"
+#include "pmm.h"
 #include "thread_internal.h"
 #include "gdtmu.h"
 #include "lapic_system.h"
@@ -21,6 +22,7 @@
 #include "ex_system.h"
 #include "process_internal.h"
 #include "boot_module.h"
+#include "image_cache.h"
 
 #define NO_OF_TSS_STACKS             7
 STATIC_ASSERT(NO_OF_TSS_STACKS <= NO_OF_IST);
@@ -57,6 +59,7 @@ SystemPreinit(
     CorePreinit();
     NetworkStackPreinit();
     ProcessSystemPreinit();
+    ImageCachePreinit();
 }
 
 STATUS
@@ -174,6 +177,9 @@ SystemInit(
     }
     LOGL("AcpiInterfaceInit suceeded\n");
 
+    // the SRAT is available only after the ACPI tables are parsed
+    PmmInitNumaTopology();
+
     status = LapicSystemInit();
     if (!SUCCEEDED(status))
     {
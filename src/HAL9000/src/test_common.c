@@ -4,6 +4,7 @@
 #include "test_vmm.h"
 #include "test_file_io.h"
 #include "test_dma.h"
+#include "test_creation.h"
 #include "test_thread.h"
 #include "smp.h"
 
@@ -18,6 +19,9 @@ TestRunAllFunctional(
     TestPmmReserveAndReleaseFunctions();
     TestVmmAllocAndFreeFunctions();
     TestFileRead();
+    TestDmaPinnedRead();
+    TestDmaCompletionRoutine();
+    TestDmaDeviceControl();
     TestAllThreadFunctionalities(SmpGetNumberOfActiveCpus() * 2 );
 }
 
@@ -28,4 +32,5 @@ TestRunAllPerformance(
 {
     TestFileReadPerformance();
     TestDmaPerformance();
+    TestCreationPerformance();
 }
\ No newline at end of file
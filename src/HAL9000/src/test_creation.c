@@ -0,0 +1,136 @@
+#include "HAL9000.h"
+#include "test_creation.h"
+#include "perf_framework.h"
+#include "thread.h"
+#include "process.h"
+#include "iomu.h"
+
+#define CREATION_TEST_ITERATION_COUNT       100
+
+// the application does nothing but return from its main function
+#define CREATION_TEST_PROCESS_NAME          "Dummy"
+
+typedef struct _CREATION_TEST_CTX
+{
+    char                    ProcessPath[MAX_PATH];
+} CREATION_TEST_CTX, *PCREATION_TEST_CTX;
+
+static FUNC_ThreadStart         _TestCreationThreadFunction;
+static FUNC_TestPerformance     _TestThreadCreationPerformance;
+static FUNC_TestPerformance     _TestProcessCreationPerformance;
+
+static const char* STAT_NAMES[2] = { "THREAD", "PROCESS" };
+
+void
+TestCreationPerformance(
+    void
+    )
+{
+    CREATION_TEST_CTX ctx;
+    PERFORMANCE_STATS perfStats[2];
+    const char* pSystemPartition;
+    DWORD noOfStats;
+
+    memzero(&ctx, sizeof(CREATION_TEST_CTX));
+    memzero(&perfStats, sizeof(perfStats));
+    noOfStats = 1;
+
+    RunPerformanceFunction(_TestThreadCreationPerformance,
+                           &ctx,
+                           CREATION_TEST_ITERATION_COUNT,
+                           TRUE,
+                           &perfStats[0]
+                           );
+
+    pSystemPartition = IomuGetSystemPartitionPath();
+    if (pSystemPartition != NULL)
+    {
+        snprintf(ctx.ProcessPath, MAX_PATH,
+                 "%s%s\\%s.exe", pSystemPartition, "APPLICATIONS",
+                 CREATION_TEST_PROCESS_NAME);
+
+        RunPerformanceFunction(_TestProcessCreationPerformance,
+                               &ctx,
+                               CREATION_TEST_ITERATION_COUNT,
+                               TRUE,
+                               &perfStats[1]
+                               );
+        noOfStats = 2;
+    }
+    else
+    {
+        LOG_WARNING("Cannot measure process creation without knowing the system partition!\n");
+    }
+
+    LOGL("Create + exit + wait times in us\n");
+    DisplayPerformanceStats(perfStats, noOfStats, STAT_NAMES);
+
+    for (DWORD i = 0; i < noOfStats; ++i)
+    {
+        if (perfStats[i].Mean != 0)
+        {
+            LOGL("%s rate: %U per second\n", STAT_NAMES[i], SEC_IN_US / perfStats[i].Mean);
+        }
+    }
+}
+
+static
+STATUS
+(__cdecl _TestCreationThreadFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+(__cdecl _TestThreadCreationPerformance)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PTHREAD pThread;
+    STATUS status;
+    STATUS exitStatus;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    status = ThreadCreate("CreationTest",
+                          ThreadPriorityDefault,
+                          _TestCreationThreadFunction,
+                          NULL,
+                          &pThread
+                          );
+    ASSERT(SUCCEEDED(status));
+
+    ThreadWaitForTermination(pThread, &exitStatus);
+    ASSERT(SUCCEEDED(exitStatus));
+
+    ThreadCloseHandle(pThread);
+}
+
+static
+void
+(__cdecl _TestProcessCreationPerformance)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PCREATION_TEST_CTX pCtx;
+    PPROCESS pProcess;
+    STATUS status;
+    STATUS exitStatus;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PCREATION_TEST_CTX) Context;
+
+    status = ProcessCreate(pCtx->ProcessPath, NULL, &pProcess);
+    ASSERT(SUCCEEDED(status));
+
+    ProcessWaitForTermination(pProcess, &exitStatus);
+    ASSERT(SUCCEEDED(exitStatus));
+
+    ProcessCloseHandle(pProcess);
+}
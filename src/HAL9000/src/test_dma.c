@@ -4,22 +4,409 @@
 #include "io.h"
 #include "mmu.h"
 #include "cpumu.h"
+#include "vmm.h"
+#include "mdl.h"
 
 #define DMA_TEST_ITERATION_COUNT            10
 
+// the buffer is split in at most this many reads which are all in flight
+// at the same time
+#define DMA_TEST_OVERLAPPED_READS           4
+
+// the pinned buffer starts in the middle of a lazily committed region so the
+// pages are brought in by the pin and its MDL starts with a partial page
+#define DMA_TEST_PINNED_READ_SIZE           (8 * PAGE_SIZE)
+#define DMA_TEST_PINNED_READ_OFFSET         SECTOR_SIZE
+
+#define DMA_TEST_COMPLETION_READ_SIZE       PAGE_SIZE
+
+// large enough for the layout of any MBR partitioned disk
+#define DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE PAGE_SIZE
+
 typedef struct _RAW_TEST_CTX
 {
-    QWORD           BytesToRead;
-    BOOLEAN         Asynchronous;
-    PDEVICE_OBJECT  Device;
-    PVOID           Buffer;
+    QWORD                   BytesToRead;
+    BOOLEAN                 Asynchronous;
+    PDEVICE_OBJECT          Device;
+    PVOID                   Buffer;
+    PIO_COMPLETION_QUEUE    CompletionQueue;
 } RAW_TEST_CTX, *PRAW_TEST_CTX;
 
+typedef struct _COMPLETION_TEST_CTX
+{
+    // status returned by the completion routine
+    STATUS                  RoutineStatus;
+    volatile DWORD          NumberOfCalls;
+    EX_EVENT                RoutineCalled;
+} COMPLETION_TEST_CTX, *PCOMPLETION_TEST_CTX;
+
+typedef struct _DEVICE_CONTROL_TEST
+{
+    DEVICE_TYPE             DeviceType;
+    DWORD                   IoControlCode;
+    DWORD                   MinimumInformation;
+} DEVICE_CONTROL_TEST, *PDEVICE_CONTROL_TEST;
+
 static FUNC_TestPerformance     _TestRawReadPerformance;
+static FUNC_TestPerformance     _TestOverlappedReadPerformance;
+static FUNC_IoCompletionRoutine _TestDmaCompletionRoutine;
 
-static const DWORD BYTES_TO_READ[] = { SECTOR_SIZE, PAGE_SIZE, 4 * PAGE_SIZE, 8 * PAGE_SIZE, 15 * PAGE_SIZE };
+// the last values are larger than what a single PRD table can describe if the
+// buffer is physically fragmented => they are served in multiple steps
+static const DWORD BYTES_TO_READ[] = { SECTOR_SIZE, PAGE_SIZE, 4 * PAGE_SIZE, 8 * PAGE_SIZE, 15 * PAGE_SIZE, 64 * PAGE_SIZE, 1024 * PAGE_SIZE };
 static const DWORD NO_OF_BYTES_VALUES = ARRAYSIZE(BYTES_TO_READ);
-static const char* STAT_NAMES[2] = { "SYNCHRONOUS", "ASYNCHRONOUS" };
+static const char* STAT_NAMES[3] = { "SYNCHRONOUS", "ASYNCHRONOUS", "OVERLAPPED" };
+
+// the IOCTLs the storage stack sends to itself while initializing
+static const DEVICE_CONTROL_TEST DEVICE_CONTROL_TESTS[] =
+{
+    { DeviceTypeHarddiskController, IOCTL_DISK_GET_LENGTH_INFO, sizeof(GET_LENGTH_INFORMATION) },
+    { DeviceTypeDisk, IOCTL_DISK_LAYOUT_INFO, sizeof(DISK_LAYOUT_INFORMATION) },
+    { DeviceTypeVolume, IOCTL_VOLUME_PARTITION_INFO, sizeof(PARTITION_INFORMATION) },
+};
+
+static
+PDEVICE_OBJECT
+_TestDmaGetVolume(
+    void
+    );
+
+static
+STATUS
+_TestDmaReadWithCompletionRoutine(
+    IN          PDEVICE_OBJECT          Device,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    OUT_WRITES_BYTES(DMA_TEST_COMPLETION_READ_SIZE)
+                PVOID                   Buffer,
+    IN          STATUS                  RoutineStatus
+    );
+
+static
+STATUS
+_TestDmaSendDeviceControl(
+    IN          PDEVICE_OBJECT          Device,
+    IN          DWORD                   IoControlCode,
+    OUT_WRITES_BYTES(DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE)
+                PVOID                   OutputBuffer,
+    OUT         STATUS*                 IoStatus,
+    OUT         QWORD*                  Information
+    );
+
+BOOLEAN
+TestDmaDeviceControl(
+    void
+    )
+{
+    STATUS status;
+    STATUS ioStatus;
+    PDEVICE_OBJECT* pDeviceObjects;
+    DWORD noOfDevices;
+    PVOID pOutput;
+    QWORD information;
+    DWORD i;
+    DWORD j;
+
+    pDeviceObjects = NULL;
+    noOfDevices = 0;
+    pOutput = NULL;
+    status = STATUS_SUCCESS;
+
+    __try
+    {
+        pOutput = ExAllocatePoolWithTag(PoolAllocateZeroMemory, DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE, HEAP_TEST_TAG, 0);
+        if (NULL == pOutput)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE);
+            __leave;
+        }
+
+        for (i = 0; i < ARRAYSIZE(DEVICE_CONTROL_TESTS); ++i)
+        {
+            status = IoGetDevicesByType(DEVICE_CONTROL_TESTS[i].DeviceType, &pDeviceObjects, &noOfDevices);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("IoGetDevicesByType", status);
+                __leave;
+            }
+
+            for (j = 0; j < noOfDevices; ++j)
+            {
+                status = _TestDmaSendDeviceControl(pDeviceObjects[j],
+                                                   DEVICE_CONTROL_TESTS[i].IoControlCode,
+                                                   pOutput,
+                                                   &ioStatus,
+                                                   &information);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_TestDmaSendDeviceControl", status);
+                    __leave;
+                }
+
+                if (!SUCCEEDED(ioStatus) || information < DEVICE_CONTROL_TESTS[i].MinimumInformation)
+                {
+                    LOG_ERROR("IOCTL 0x%x to device 0x%X completed with status 0x%x and information 0x%X\n",
+                              DEVICE_CONTROL_TESTS[i].IoControlCode, pDeviceObjects[j], ioStatus, information);
+                    status = STATUS_UNSUCCESSFUL;
+                    __leave;
+                }
+
+                // a request the device does not understand must be completed too
+                status = _TestDmaSendDeviceControl(pDeviceObjects[j],
+                                                   IOCTL_NET_GET_DEVICE_STATUS,
+                                                   pOutput,
+                                                   &ioStatus,
+                                                   &information);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_TestDmaSendDeviceControl", status);
+                    __leave;
+                }
+
+                if (STATUS_UNSUPPORTED != ioStatus)
+                {
+                    LOG_ERROR("Unsupported IOCTL to device 0x%X completed with status 0x%x\n",
+                              pDeviceObjects[j], ioStatus);
+                    status = STATUS_UNSUCCESSFUL;
+                    __leave;
+                }
+            }
+
+            if (NULL != pDeviceObjects)
+            {
+                IoFreeTemporaryData(pDeviceObjects);
+                pDeviceObjects = NULL;
+            }
+        }
+    }
+    __finally
+    {
+        if (NULL != pDeviceObjects)
+        {
+            IoFreeTemporaryData(pDeviceObjects);
+            pDeviceObjects = NULL;
+        }
+
+        if (NULL != pOutput)
+        {
+            ExFreePoolWithTag(pOutput, HEAP_TEST_TAG);
+            pOutput = NULL;
+        }
+    }
+
+    return SUCCEEDED(status);
+}
+
+BOOLEAN
+TestDmaCompletionRoutine(
+    void
+    )
+{
+    STATUS status;
+    PDEVICE_OBJECT pVolumeDevice;
+    PIO_COMPLETION_QUEUE pQueue;
+    PVOID pExpected;
+    PVOID pBuffer;
+    QWORD bytesRead;
+    DWORD i;
+
+    // the IRP is first completed normally and then held back by the routine
+    static const STATUS ROUTINE_STATUSES[] = { STATUS_SUCCESS, STATUS_MORE_PROCESSING_REQUIRED };
+
+    pQueue = NULL;
+    pExpected = NULL;
+    pBuffer = NULL;
+    status = STATUS_SUCCESS;
+
+    pVolumeDevice = _TestDmaGetVolume();
+
+    __try
+    {
+        pExpected = ExAllocatePoolWithTag(PoolAllocateZeroMemory, DMA_TEST_COMPLETION_READ_SIZE, HEAP_TEST_TAG, 0);
+        if (NULL == pExpected)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", DMA_TEST_COMPLETION_READ_SIZE);
+            __leave;
+        }
+
+        pBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, DMA_TEST_COMPLETION_READ_SIZE, HEAP_TEST_TAG, 0);
+        if (NULL == pBuffer)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", DMA_TEST_COMPLETION_READ_SIZE);
+            __leave;
+        }
+
+        bytesRead = DMA_TEST_COMPLETION_READ_SIZE;
+        status = IoReadDevice(pVolumeDevice, pExpected, &bytesRead, 0);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoReadDevice", status);
+            __leave;
+        }
+
+        status = IoCreateCompletionQueue(&pQueue);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCreateCompletionQueue", status);
+            __leave;
+        }
+
+        for (i = 0; i < ARRAYSIZE(ROUTINE_STATUSES); ++i)
+        {
+            memzero(pBuffer, DMA_TEST_COMPLETION_READ_SIZE);
+
+            status = _TestDmaReadWithCompletionRoutine(pVolumeDevice, pQueue, pBuffer, ROUTINE_STATUSES[i]);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_TestDmaReadWithCompletionRoutine", status);
+                __leave;
+            }
+
+            if (0 != memcmp(pBuffer, pExpected, DMA_TEST_COMPLETION_READ_SIZE))
+            {
+                LOG_ERROR("The data read with a completion routine returning 0x%x differs from the data read by IoReadDevice\n",
+                          ROUTINE_STATUSES[i]);
+                status = STATUS_UNSUCCESSFUL;
+                __leave;
+            }
+        }
+    }
+    __finally
+    {
+        if (NULL != pQueue)
+        {
+            IoDestroyCompletionQueue(pQueue);
+            pQueue = NULL;
+        }
+
+        if (NULL != pBuffer)
+        {
+            ExFreePoolWithTag(pBuffer, HEAP_TEST_TAG);
+            pBuffer = NULL;
+        }
+
+        if (NULL != pExpected)
+        {
+            ExFreePoolWithTag(pExpected, HEAP_TEST_TAG);
+            pExpected = NULL;
+        }
+    }
+
+    return SUCCEEDED(status);
+}
+
+BOOLEAN
+TestDmaPinnedRead(
+    void
+    )
+{
+    STATUS status;
+    PDEVICE_OBJECT pVolumeDevice;
+    PBYTE pRegion;
+    PBYTE pPinnedBuffer;
+    PVOID pExpected;
+    PMDL pMdl;
+    QWORD bytesRead;
+
+    pRegion = NULL;
+    pExpected = NULL;
+    pMdl = NULL;
+    status = STATUS_SUCCESS;
+
+    pVolumeDevice = _TestDmaGetVolume();
+
+    __try
+    {
+        pExpected = ExAllocatePoolWithTag(PoolAllocateZeroMemory, DMA_TEST_PINNED_READ_SIZE, HEAP_TEST_TAG, 0);
+        if (NULL == pExpected)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", DMA_TEST_PINNED_READ_SIZE);
+            __leave;
+        }
+
+        bytesRead = DMA_TEST_PINNED_READ_SIZE;
+        status = IoReadDevice(pVolumeDevice, pExpected, &bytesRead, 0);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoReadDevice", status);
+            __leave;
+        }
+
+        pRegion = VmmAllocRegion(NULL,
+                                 DMA_TEST_PINNED_READ_SIZE + PAGE_SIZE,
+                                 VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                                 PAGE_RIGHTS_READWRITE);
+        if (NULL == pRegion)
+        {
+            status = STATUS_MEMORY_CANNOT_BE_COMMITED;
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegion", DMA_TEST_PINNED_READ_SIZE + PAGE_SIZE);
+            __leave;
+        }
+
+        pPinnedBuffer = pRegion + DMA_TEST_PINNED_READ_OFFSET;
+
+        status = MmuPinUserBuffer(pPinnedBuffer,
+                                  DMA_TEST_PINNED_READ_SIZE,
+                                  PAGE_RIGHTS_WRITE,
+                                  GetCurrentProcess(),
+                                  &pMdl);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("MmuPinUserBuffer", status);
+            __leave;
+        }
+
+        // the device writes to the frames of the MDL, no bounce buffer or
+        // MDL of the driver is involved
+        bytesRead = DMA_TEST_PINNED_READ_SIZE;
+        status = IoReadDeviceWithMdl(pVolumeDevice, pMdl, &bytesRead, 0);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoReadDeviceWithMdl", status);
+            __leave;
+        }
+
+        if (bytesRead != DMA_TEST_PINNED_READ_SIZE)
+        {
+            LOG_ERROR("Read 0x%X bytes into the pinned buffer instead of 0x%X\n",
+                      bytesRead, DMA_TEST_PINNED_READ_SIZE);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+
+        if (0 != memcmp(pPinnedBuffer, pExpected, DMA_TEST_PINNED_READ_SIZE))
+        {
+            LOG_ERROR("The data read into the pinned buffer differs from the data read by IoReadDevice\n");
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (NULL != pMdl)
+        {
+            MmuUnpinUserBuffer(pMdl);
+            pMdl = NULL;
+        }
+
+        if (NULL != pRegion)
+        {
+            VmmFreeRegion(pRegion, 0, VMM_FREE_TYPE_RELEASE);
+            pRegion = NULL;
+        }
+
+        if (NULL != pExpected)
+        {
+            ExFreePoolWithTag(pExpected, HEAP_TEST_TAG);
+            pExpected = NULL;
+        }
+    }
+
+    return SUCCEEDED(status);
+}
 
 void
 TestDmaPerformance(
@@ -27,34 +414,21 @@ TestDmaPerformance(
     )
 {
     RAW_TEST_CTX ctx;
-    PERFORMANCE_STATS perfStats[2];
+    PERFORMANCE_STATS perfStats[3];
     DWORD i;
     DWORD async;
     DWORD bytesToRead;
     PVOID pBuffer;
-    PDEVICE_OBJECT pVolumeDevice;
     STATUS status;
-    PDEVICE_OBJECT* pDeviceObjects;
-    DWORD noOfDevices;
 
     memzero(&ctx, sizeof(RAW_TEST_CTX));
     bytesToRead = 0;
     pBuffer = NULL;
-    pVolumeDevice = NULL;
-
-    status = IoGetDevicesByType(DeviceTypeVolume,
-                                &pDeviceObjects,
-                                &noOfDevices
-                                );
-    ASSERT(SUCCEEDED(status));
-    ASSERT( NULL != pDeviceObjects );
-    ASSERT(noOfDevices > 0 );
 
-    pVolumeDevice = pDeviceObjects[0];
-    ctx.Device = pVolumeDevice;
+    ctx.Device = _TestDmaGetVolume();
 
-    IoFreeTemporaryData(pDeviceObjects);
-    pDeviceObjects = NULL;
+    status = IoCreateCompletionQueue(&ctx.CompletionQueue);
+    ASSERT(SUCCEEDED(status));
 
     for (i = 0; i < NO_OF_BYTES_VALUES; ++i)
     {
@@ -87,8 +461,15 @@ TestDmaPerformance(
                                    );
         }
 
+        RunPerformanceFunction(_TestOverlappedReadPerformance,
+                               &ctx,
+                               DMA_TEST_ITERATION_COUNT,
+                               FALSE,
+                               &perfStats[2]
+                               );
+
         LOGL("Volume read with chunk size 0x%x bytes\n", bytesToRead);
-        DisplayPerformanceStats(perfStats, 2, STAT_NAMES);
+        DisplayPerformanceStats(perfStats, 3, STAT_NAMES);
     }
 
     if (NULL != pBuffer)
@@ -96,6 +477,9 @@ TestDmaPerformance(
         ExFreePoolWithTag(pBuffer, HEAP_TEST_TAG);
         pBuffer = NULL;
     }
+
+    IoDestroyCompletionQueue(ctx.CompletionQueue);
+    ctx.CompletionQueue = NULL;
 }
 
 
@@ -126,3 +510,313 @@ void
 
     LOG_FUNC_END_CPU;
 }
+
+void
+(__cdecl _TestOverlappedReadPerformance)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PRAW_TEST_CTX pCtx;
+    QWORD bytesPerRead;
+    QWORD offset;
+    QWORD bytesRead;
+    DWORD noOfReads;
+    DWORD i;
+    PIRP pIrp;
+    STATUS status;
+
+    LOG_FUNC_START_CPU;
+
+    ASSERT( NULL != Context );
+
+    pCtx = (PRAW_TEST_CTX) Context;
+    noOfReads = 0;
+    bytesRead = 0;
+
+    bytesPerRead = AlignAddressUpper(pCtx->BytesToRead / DMA_TEST_OVERLAPPED_READS, SECTOR_SIZE);
+
+    // start all the reads before waiting for any of them
+    for (offset = 0; offset < pCtx->BytesToRead; offset = offset + bytesPerRead)
+    {
+        status = IoReadDeviceAsync(pCtx->Device,
+                                   PtrOffset(pCtx->Buffer, offset),
+                                   min(bytesPerRead, pCtx->BytesToRead - offset),
+                                   offset,
+                                   pCtx->CompletionQueue,
+                                   NULL
+                                   );
+        ASSERT(STATUS_PENDING == status);
+
+        noOfReads++;
+    }
+
+    for (i = 0; i < noOfReads; ++i)
+    {
+        status = IoRemoveCompletionQueueEntry(pCtx->CompletionQueue, TRUE, &pIrp, NULL);
+        ASSERT(SUCCEEDED(status));
+
+        ASSERT(SUCCEEDED(pIrp->IoStatus.Status));
+        bytesRead = bytesRead + pIrp->IoStatus.Information;
+
+        IoFreeIrp(pIrp);
+    }
+    ASSERT(bytesRead == pCtx->BytesToRead);
+
+    LOG_FUNC_END_CPU;
+}
+
+STATUS
+(__cdecl _TestDmaCompletionRoutine)(
+    IN_OPT      PDEVICE_OBJECT      DeviceObject,
+    INOUT       PIRP                Irp,
+    IN_OPT      PVOID               Context
+    )
+{
+    PCOMPLETION_TEST_CTX pCtx;
+    STATUS routineStatus;
+
+    ASSERT(NULL != Irp);
+    ASSERT(NULL != Context);
+
+    // the routine was set by the originator of the IRP
+    ASSERT(NULL == DeviceObject);
+
+    pCtx = (PCOMPLETION_TEST_CTX) Context;
+    routineStatus = pCtx->RoutineStatus;
+
+    _InterlockedIncrement(&pCtx->NumberOfCalls);
+
+    // we may be called from the interrupt handler of the device => we must not
+    // block, the test thread continues the processing and the context must not
+    // be touched once signaled
+    ExEventSignal(&pCtx->RoutineCalled);
+
+    return routineStatus;
+}
+
+static
+STATUS
+_TestDmaReadWithCompletionRoutine(
+    IN          PDEVICE_OBJECT          Device,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    OUT_WRITES_BYTES(DMA_TEST_COMPLETION_READ_SIZE)
+                PVOID                   Buffer,
+    IN          STATUS                  RoutineStatus
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    PIRP pCompletedIrp;
+    PIO_STACK_LOCATION pStackLocation;
+    COMPLETION_TEST_CTX ctx;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Queue);
+    ASSERT(NULL != Buffer);
+
+    pCompletedIrp = NULL;
+    memzero(&ctx, sizeof(COMPLETION_TEST_CTX));
+
+    ctx.RoutineStatus = RoutineStatus;
+
+    status = ExEventInit(&ctx.RoutineCalled, ExEventTypeNotification, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    pIrp = IoAllocateIrp(Device->StackSize);
+    if (NULL == pIrp)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateIrp", IO_IRP_SIZE(Device->StackSize));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pStackLocation = IoGetNextIrpStackLocation(pIrp);
+    pStackLocation->MajorFunction = IRP_MJ_READ;
+    pStackLocation->Parameters.ReadWrite.Length = DMA_TEST_COMPLETION_READ_SIZE;
+    pStackLocation->Parameters.ReadWrite.Offset = 0;
+
+    pIrp->Buffer = Buffer;
+    pIrp->Flags.Asynchronous = TRUE;
+
+    IoSetIrpCompletionQueue(pIrp, Queue, NULL);
+    IoSetCompletionRoutine(pIrp, _TestDmaCompletionRoutine, &ctx);
+
+    status = IoCallDriver(Device, pIrp);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoCallDriver", status);
+        IoFreeIrp(pIrp);
+        return status;
+    }
+
+    ExEventWaitForSignal(&ctx.RoutineCalled);
+
+    // the routine may still hold the event lock after the signal was seen,
+    // make sure it is done with it before the event goes away
+    LockAcquire(&ctx.RoutineCalled.EventLock, &intrState);
+    LockRelease(&ctx.RoutineCalled.EventLock, intrState);
+
+    __try
+    {
+        if (STATUS_MORE_PROCESSING_REQUIRED == RoutineStatus)
+        {
+            // the routine took ownership of the IRP => it must not have been
+            // posted to the queue
+            if (IoIsIrpComplete(pIrp)
+                || STATUS_NO_DATA_AVAILABLE != IoRemoveCompletionQueueEntry(Queue, FALSE, &pCompletedIrp, NULL))
+            {
+                LOG_ERROR("IRP 0x%X held back by its completion routine was completed\n", pIrp);
+                status = STATUS_UNSUCCESSFUL;
+
+                // a completed IRP belongs to the queue or was just removed
+                // from it => it is freed only once
+                if (IoIsIrpComplete(pIrp))
+                {
+                    pIrp = NULL;
+                }
+                __leave;
+            }
+
+            // finish the completion, the routine is not called again
+            IoCompleteIrp(pIrp);
+        }
+
+        status = IoRemoveCompletionQueueEntry(Queue, TRUE, &pCompletedIrp, NULL);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoRemoveCompletionQueueEntry", status);
+            __leave;
+        }
+
+        if (pCompletedIrp != pIrp)
+        {
+            LOG_ERROR("IRP 0x%X was removed from the queue instead of 0x%X\n", pCompletedIrp, pIrp);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+
+        if (1 != ctx.NumberOfCalls)
+        {
+            LOG_ERROR("The completion routine was called %u times\n", ctx.NumberOfCalls);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        if (DMA_TEST_COMPLETION_READ_SIZE != pIrp->IoStatus.Information)
+        {
+            LOG_ERROR("Read 0x%X bytes instead of 0x%X\n", pIrp->IoStatus.Information, DMA_TEST_COMPLETION_READ_SIZE);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (NULL != pCompletedIrp && pCompletedIrp != pIrp)
+        {
+            IoFreeIrp(pCompletedIrp);
+            pCompletedIrp = NULL;
+        }
+
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+static
+STATUS
+_TestDmaSendDeviceControl(
+    IN          PDEVICE_OBJECT          Device,
+    IN          DWORD                   IoControlCode,
+    OUT_WRITES_BYTES(DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE)
+                PVOID                   OutputBuffer,
+    OUT         STATUS*                 IoStatus,
+    OUT         QWORD*                  Information
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != OutputBuffer);
+    ASSERT(NULL != IoStatus);
+    ASSERT(NULL != Information);
+
+    pIrp = IoBuildDeviceIoControlRequestEx(IoControlCode,
+                                           Device,
+                                           NULL,
+                                           0,
+                                           OutputBuffer,
+                                           DMA_TEST_DEVICE_CONTROL_OUTPUT_SIZE,
+                                           &stackIrp);
+    if (NULL == pIrp)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoBuildDeviceIoControlRequestEx", IO_IRP_SIZE(Device->StackSize));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    // no completion queue or routine => the IRP is complete when IoCallDriver
+    // returns, as long as the driver completed it
+    status = IoCallDriver(Device, pIrp);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoCallDriver", status);
+    }
+    else if (!IoIsIrpComplete(pIrp))
+    {
+        LOG_ERROR("IOCTL 0x%x was not completed by device 0x%X\n", IoControlCode, Device);
+        status = STATUS_UNSUCCESSFUL;
+    }
+    else
+    {
+        *IoStatus = pIrp->IoStatus.Status;
+        *Information = pIrp->IoStatus.Information;
+    }
+
+    IoFreeIrp(pIrp);
+
+    return status;
+}
+
+static
+PDEVICE_OBJECT
+_TestDmaGetVolume(
+    void
+    )
+{
+    PDEVICE_OBJECT pVolumeDevice;
+    STATUS status;
+    PDEVICE_OBJECT* pDeviceObjects;
+    DWORD noOfDevices;
+
+    status = IoGetDevicesByType(DeviceTypeVolume,
+                                &pDeviceObjects,
+                                &noOfDevices
+                                );
+    ASSERT(SUCCEEDED(status));
+    ASSERT( NULL != pDeviceObjects );
+    ASSERT(noOfDevices > 0 );
+
+    pVolumeDevice = pDeviceObjects[0];
+
+    IoFreeTemporaryData(pDeviceObjects);
+    pDeviceObjects = NULL;
+
+    return pVolumeDevice;
+}
@@ -11,6 +11,9 @@
 #define RECEIVE_THREAD_INITIAL_BUFFER_SIZE                  sizeof(NET_RECEIVE_FRAME_OUTPUT)//64*KB_SIZE
 #define TRANSMIT_THREAD_BUFFER_SIZE                         1*KB_SIZE
 
+// number of frames handed to the device with a single request
+#define TRANSMIT_THREAD_FRAMES_PER_BATCH                    16
+
 #define BUFFER_TO_SEND                                      "This is the c00le$t buffer ev4r made!!!!!"
 
 typedef struct _NET_TRAFFIC_THREAD_CONTEXT
@@ -24,15 +27,20 @@ typedef struct _NET_TRAFFIC_THREAD_CONTEXT
 
 static FUNC_ThreadStart _TestReceivePacketsForAdapter;
 
+static FUNC_ThreadStart _TestReceiveLoanedPacketsForAdapter;
+
 static FUNC_ThreadStart _TestTransmitPacketsForAdapter;
 
+static FUNC_ThreadStart _TestTransmitPacketBatchesForAdapter;
+
 _No_competing_thread_
 BOOLEAN
 TestNetwork(
         IN      BOOLEAN         Transmit,
     _When_(Transmit, _Reserved_)
     _When_(!Transmit, IN)
-        IN      BOOLEAN         ResendRequets
+        IN      BOOLEAN         ResendRequets,
+        IN      BOOLEAN         FastPath
     )
 {
     STATUS status;
@@ -44,6 +52,7 @@ TestNetwork(
     volatile BOOLEAN bStopRequests;
     DWORD temp;
     PNETWORK_DEVICE_INFO pNetDevices;
+    PFUNC_ThreadStart pThreadFunction;
 
     LOG_FUNC_START;
 
@@ -52,6 +61,16 @@ TestNetwork(
     pThreads = NULL;
     pThreadContexts = NULL;
     pNetDevices = NULL;
+
+    if (Transmit)
+    {
+        pThreadFunction = FastPath ? _TestTransmitPacketBatchesForAdapter : _TestTransmitPacketsForAdapter;
+    }
+    else
+    {
+        pThreadFunction = FastPath ? _TestReceiveLoanedPacketsForAdapter : _TestReceivePacketsForAdapter;
+    }
+
     // C28113: Accessing a local variable via an Interlocked function : This is an unusual usage which could be reconsidered
 #pragma warning(suppress: 28113)
     _InterlockedExchange8(&bStopRequests, FALSE);
@@ -106,7 +125,7 @@ TestNetwork(
             );
             status = ThreadCreate(threadName,
                                   ThreadPriorityDefault,
-                                  Transmit ? _TestTransmitPacketsForAdapter : _TestReceivePacketsForAdapter,
+                                  pThreadFunction,
                                   &pThreadContexts[i],
                                   &pThreads[i]
             );
@@ -263,6 +282,82 @@ STATUS
     return status;
 }
 
+STATUS
+(__cdecl _TestReceiveLoanedPacketsForAdapter)(
+    IN_OPT      PVOID       Context
+    )
+{
+    STATUS status;
+    PNET_TRAFFIC_THREAD_CONTEXT pCtx;
+    PNET_LOANED_FRAME pLoanedFrame;
+
+    ASSERT( NULL != Context );
+
+    LOG_FUNC_START_THREAD;
+
+    status = STATUS_SUCCESS;
+    pCtx = (PNET_TRAFFIC_THREAD_CONTEXT) Context;
+    pLoanedFrame = NULL;
+
+    while (!*pCtx->StopRequests)
+    {
+        // the frame is lent directly from the receive buffer of the device,
+        // no copy is made and no buffer needs to be sized for it
+        status = NetReceiveFrameByReference(pCtx->NetworkDevice,
+                                            &pLoanedFrame
+                                            );
+        if (STATUS_DEVICE_DISABLED == status)
+        {
+            status = STATUS_SUCCESS;
+            LOG("Device RX has been disabled!\n");
+            break;
+        }
+        else if (STATUS_DEVICE_NOT_CONNECTED == status)
+        {
+            status = STATUS_SUCCESS;
+            LOG("Device link is down!\n");
+            break;
+        }
+
+        ASSERT(SUCCEEDED(status));
+        ASSERT(NULL != pLoanedFrame);
+
+        DumpEthernetFrame(pLoanedFrame->Frame, pLoanedFrame->Length);
+
+        if (pCtx->ResendRequests)
+        {
+            status = NetSendFrame(FALSE,
+                                  pCtx->NetworkDevice,
+                                  pLoanedFrame->Frame,
+                                  pLoanedFrame->Length,
+                                  MAC_BROADCAST
+                                  );
+            if (STATUS_DEVICE_DISABLED == status)
+            {
+                LOG_WARNING("Could not send network frame because TX functionality is disabled! :(\n");
+                status = STATUS_SUCCESS;
+            }
+            else if (STATUS_DEVICE_NOT_CONNECTED == status)
+            {
+                status = STATUS_SUCCESS;
+                LOG("Device link is down!\n");
+                NetReleaseFrame(pLoanedFrame);
+                pLoanedFrame = NULL;
+                break;
+            }
+            ASSERT(SUCCEEDED(status));
+        }
+
+        NetReleaseFrame(pLoanedFrame);
+        pLoanedFrame = NULL;
+    }
+
+    LOGTPL("Exit status: 0x%x\n", status );
+    LOG_FUNC_END_THREAD;
+
+    return status;
+}
+
 STATUS
 (__cdecl _TestTransmitPacketsForAdapter)(
     IN_OPT      PVOID       Context
@@ -325,5 +420,82 @@ STATUS
     LOGTPL("Exit status: 0x%x\n", status);
     LOG_FUNC_END_THREAD;
 
+    return status;
+}
+
+STATUS
+(__cdecl _TestTransmitPacketBatchesForAdapter)(
+    IN_OPT      PVOID       Context
+    )
+{
+    STATUS status;
+    PNET_TRAFFIC_THREAD_CONTEXT pCtx;
+    PBYTE pBuffer;
+    NET_FRAME_BUFFER frames[TRANSMIT_THREAD_FRAMES_PER_BATCH];
+    DWORD bufferSize;
+    QWORD packetIndex;
+    DWORD i;
+
+    ASSERT(NULL != Context);
+
+    LOG_FUNC_START_THREAD;
+
+    status = STATUS_SUCCESS;
+    pCtx = (PNET_TRAFFIC_THREAD_CONTEXT)Context;
+    pBuffer = NULL;
+    bufferSize = TRANSMIT_THREAD_BUFFER_SIZE;
+
+    pBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, bufferSize * TRANSMIT_THREAD_FRAMES_PER_BATCH, HEAP_TEST_TAG, 0 );
+    ASSERT( NULL != pBuffer );
+
+    for (i = 0; i < TRANSMIT_THREAD_FRAMES_PER_BATCH; ++i)
+    {
+        frames[i].Frame = (PETHERNET_FRAME) (pBuffer + i * bufferSize);
+        frames[i].Length = bufferSize;
+        frames[i].Offloads = 0;
+        frames[i].MaximumSegmentSize = 0;
+
+        frames[i].Frame->Type = htonw(ETHERNET_FRAME_TYPE_IP4);
+        memcpy(frames[i].Frame->Data, BUFFER_TO_SEND, sizeof(BUFFER_TO_SEND));
+    }
+    packetIndex = 0;
+
+    while (!*pCtx->StopRequests)
+    {
+        for (i = 0; i < TRANSMIT_THREAD_FRAMES_PER_BATCH; ++i)
+        {
+            memcpy(frames[i].Frame->Data + sizeof(BUFFER_TO_SEND), &packetIndex, sizeof(QWORD));
+            packetIndex++;
+        }
+
+        status = NetSendFrames(pCtx->NetworkDevice,
+                               TRANSMIT_THREAD_FRAMES_PER_BATCH,
+                               frames
+                               );
+        if (STATUS_DEVICE_DISABLED == status)
+        {
+            status = STATUS_SUCCESS;
+            LOG("Device TX has been disabled!\n");
+            break;
+        }
+        else if (STATUS_DEVICE_NOT_CONNECTED == status)
+        {
+            status = STATUS_SUCCESS;
+            LOG("Device link is down!\n");
+            break;
+        }
+
+        ASSERT(SUCCEEDED(status));
+    }
+
+    if (NULL != pBuffer)
+    {
+        ExFreePoolWithTag(pBuffer, HEAP_TEST_TAG);
+        pBuffer = NULL;
+    }
+
+    LOGTPL("Exit status: 0x%x\n", status);
+    LOG_FUNC_END_THREAD;
+
     return status;
 }
\ No newline at end of file
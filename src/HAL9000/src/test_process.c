@@ -1,7 +1,10 @@
 #include "test_common.h"
 #include "test_process.h"
-#include "process.h"
+#include "process_internal.h"
 #include "iomu.h"
+#include "mmu.h"
+#include "pmm.h"
+#include "syscall_ring.h"
 
 #define MAX_PROCESSES_TO_SPAWN          16
 
@@ -14,6 +17,8 @@ const PROCESS_TEST PROCESS_TESTS[] =
     { "TestUserArgsOne", "Args", "Argument"},
     { "TestUserArgsMany", "Args", "Johnny is a good kid"},
     { "TestUserArgsAll", "Args", "a b c d e f g h i j k l m n o p r s t u v q x y z"},
+    { "TestUserArgsCloned", "Args", "Argument", 4, TRUE},
+    { "TestUserArgsClonedRing", "Args", "Argument", 4, TRUE, TRUE},
 
     // bad-actions
     { "BadJumpKernel", "BadJumpKernel", NULL},
@@ -99,6 +104,7 @@ const PROCESS_TEST PROCESS_TESTS[] =
     // swap
     { "SwapLinear", "SwapLinear", NULL},
     { "SwapMultiple", "SwapLinear", NULL, 4},
+    { "SwapMultipleCloned", "SwapLinear", NULL, 4, TRUE},
     { "SwapMultipleShared", "SwapMultipleShared", "0"},
     { "SwapZeros", "SwapZeros", NULL},
     { "SwapZerosWritten", "SwapZerosWritten", NULL},
@@ -128,6 +134,16 @@ const PROCESS_TEST PROCESS_TESTS[] =
 
 const DWORD PROCESS_TOTAL_NO_OF_TESTS = ARRAYSIZE(PROCESS_TESTS);
 
+static
+STATUS
+_TstProcessValidateClonedRing(
+    IN_READS(NumberOfProcesses)
+            PPROCESS*                   Processes,
+    IN      DWORD                       NumberOfProcesses,
+    IN      PVOID                       UserRing,
+    IN      PHYSICAL_ADDRESS            RingFrame,
+    IN      DWORD                       RingFrameReferences
+    );
 
 void
 TestProcessFunctionality(
@@ -140,7 +156,13 @@ TestProcessFunctionality(
     char fullPath[MAX_PATH];
     const char* pSystemPartition;
     DWORD noOfProcesses;
+    PVOID pUserRing;
+    PHYSICAL_ADDRESS ringFrame;
+    DWORD ringFrameReferences;
 
+    pUserRing = NULL;
+    ringFrame = NULL;
+    ringFrameReferences = 0;
     pSystemPartition = IomuGetSystemPartitionPath();
     noOfProcesses = (ProcessTest->NumberOfProcesses == 0) ? 1 : ProcessTest->NumberOfProcesses;
     ASSERT(noOfProcesses <= MAX_PROCESSES_TO_SPAWN);
@@ -163,6 +185,20 @@ TestProcessFunctionality(
 
         for (DWORD i = 0; i < noOfProcesses; ++i)
         {
+            if (ProcessTest->CloneProcesses && i != 0)
+            {
+                status = ProcessClone(pProcesses[0],
+                                      ProcessTest->ProcessCommandLine,
+                                      &pProcesses[i]);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("ProcessClone", status);
+                    __leave;
+                }
+
+                continue;
+            }
+
             status = ProcessCreate(fullPath,
                                    ProcessTest->ProcessCommandLine,
                                    &pProcesses[i]);
@@ -171,6 +207,32 @@ TestProcessFunctionality(
                 LOG_FUNC_ERROR("ProcessCreate", status);
                 __leave;
             }
+
+            if (ProcessTest->SetupSyscallRing)
+            {
+                status = SyscallRingCreateForProcess(pProcesses[i], 0, &pUserRing);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("SyscallRingCreateForProcess", status);
+                    __leave;
+                }
+
+                ringFrame = MmuGetPhysicalAddressEx(pUserRing, pProcesses[i]->PagingData, NULL);
+                ringFrameReferences = PmmGetFrameReferences(ringFrame);
+            }
+        }
+
+        if (ProcessTest->SetupSyscallRing)
+        {
+            status = _TstProcessValidateClonedRing(pProcesses,
+                                                   noOfProcesses,
+                                                   pUserRing,
+                                                   ringFrame,
+                                                   ringFrameReferences);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_TstProcessValidateClonedRing", status);
+            }
         }
 
         for (DWORD i = 0; i < noOfProcesses; ++i)
@@ -197,3 +259,53 @@ TestAllProcessFunctionalities(
         TestProcessFunctionality(&PROCESS_TESTS[i]);
     }
 }
+
+static
+STATUS
+_TstProcessValidateClonedRing(
+    IN_READS(NumberOfProcesses)
+            PPROCESS*                   Processes,
+    IN      DWORD                       NumberOfProcesses,
+    IN      PVOID                       UserRing,
+    IN      PHYSICAL_ADDRESS            RingFrame,
+    IN      DWORD                       RingFrameReferences
+    )
+{
+    PHYSICAL_ADDRESS pa;
+    DWORD references;
+
+    ASSERT(Processes != NULL);
+    ASSERT(UserRing != NULL);
+    ASSERT(RingFrame != NULL);
+
+    // if the ring became copy-on-write the first write of the parent would map
+    // a private copy and the kernel would no longer see its submissions
+    pa = MmuGetPhysicalAddressEx(UserRing, Processes[0]->PagingData, NULL);
+    if (pa != RingFrame)
+    {
+        LOG_ERROR("The ring of the parent is mapped at PA 0x%X instead of 0x%X\n", pa, RingFrame);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    references = PmmGetFrameReferences(RingFrame);
+    if (references != RingFrameReferences)
+    {
+        LOG_ERROR("The ring frame has %u references after the clone instead of %u\n",
+                  references, RingFrameReferences);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    for (DWORD i = 1; i < NumberOfProcesses; ++i)
+    {
+        pa = MmuGetPhysicalAddressEx(UserRing, Processes[i]->PagingData, NULL);
+        if (pa != NULL)
+        {
+            LOG_ERROR("Clone %u maps the ring of its parent at PA 0x%X\n", i, pa);
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    LOG_TEST_LOG("The ring remained shared only between the parent and the kernel\n");
+
+    return STATUS_SUCCESS;
+}
@@ -5,6 +5,7 @@
 #include "test_priority_donation.h"
 
 #include "mutex.h"
+#include "thread_internal.h"
 
 
 FUNC_ThreadStart                TestThreadYield;
@@ -13,6 +14,15 @@ FUNC_ThreadStart                TestMutexes;
 
 FUNC_ThreadStart                TestCpuIntense;
 
+FUNC_ThreadStart                TestFpuState;
+
+static
+void
+_TestFpuMoveToNextCpu(
+    IN      PTHREAD             Thread,
+    INOUT   DWORD*              CpuIndex
+    );
+
 static FUNC_ThreadPrepareTest   _ThreadTestPassContext;
 
 const THREAD_TEST THREADS_TEST[] =
@@ -21,6 +31,7 @@ const THREAD_TEST THREADS_TEST[] =
     { "ThreadYield", TestThreadYield, NULL, NULL, NULL, NULL, FALSE, FALSE },
     { "Mutex", TestMutexes, TestPrepareMutex, (PVOID) FALSE, NULL, NULL, FALSE, FALSE },
     { "CpuIntense", TestCpuIntense, NULL, NULL, NULL, NULL, FALSE, FALSE },
+    { "FpuState", TestFpuState, NULL, NULL, NULL, NULL, FALSE, FALSE },
 
     // Actual tests used for validating the project
 
@@ -195,6 +206,11 @@ const DWORD THREADS_TOTAL_NO_OF_TESTS = ARRAYSIZE(THREADS_TEST);
 
 #define CPU_INTENSE_MEMORY_SIZE         PAGE_SIZE
 
+// each thread moves to another CPU after every round, the rounds are long
+// enough for the timer to also preempt the threads in the middle of them
+#define FPU_TEST_NO_OF_ROUNDS           0x40
+#define FPU_TEST_ROUND_ITERATIONS       0x10000
+
 typedef struct _TEST_THREAD_INFO
 {
     PTHREAD                             Thread;
@@ -389,6 +405,89 @@ STATUS
     return STATUS_SUCCESS;
 }
 
+STATUS
+(__cdecl TestFpuState)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PTHREAD pThread;
+    DWORD cpuIndex;
+    QWORD seed;
+    double acc[4];
+    double step[4];
+    double expected;
+    STATUS status;
+
+    ASSERT( NULL == Context );
+
+    pThread = GetCurrentThread();
+    cpuIndex = 0;
+    seed = ThreadGetId(pThread);
+    status = STATUS_SUCCESS;
+
+    // the values are integers small enough to be exact, they differ from one
+    // thread to another and live in the XMM registers while each round runs
+    for (DWORD k = 0; k < ARRAYSIZE(acc); ++k)
+    {
+        acc[k] = (double)(seed + k);
+        step[k] = (double)(seed * (k + 2) + 1);
+    }
+
+    for (DWORD round = 0; round < FPU_TEST_NO_OF_ROUNDS; ++round)
+    {
+        for (DWORD i = 0; i < FPU_TEST_ROUND_ITERATIONS; ++i)
+        {
+            acc[0] = acc[0] + step[0];
+            acc[1] = acc[1] + step[1];
+            acc[2] = acc[2] + step[2];
+            acc[3] = acc[3] + step[3];
+        }
+
+        _TestFpuMoveToNextCpu(pThread, &cpuIndex);
+    }
+
+    ThreadSetAffinity(pThread, THREAD_AFFINITY_ALL_CPUS);
+
+    for (DWORD k = 0; k < ARRAYSIZE(acc); ++k)
+    {
+        expected = (double)(seed + k + (QWORD)FPU_TEST_NO_OF_ROUNDS * FPU_TEST_ROUND_ITERATIONS * (seed * (k + 2) + 1));
+        if (acc[k] != expected)
+        {
+            LOG_ERROR("Thread 0x%X lost its FPU state, value %u is 0x%X instead of 0x%X\n",
+                      seed, k, (QWORD)acc[k], (QWORD)expected);
+            status = STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    return status;
+}
+
+static
+void
+_TestFpuMoveToNextCpu(
+    IN      PTHREAD             Thread,
+    INOUT   DWORD*              CpuIndex
+    )
+{
+    DWORD cpuIndex;
+
+    ASSERT(NULL != Thread);
+    ASSERT(NULL != CpuIndex);
+
+    // the first active CPU after the current index, the thread yields right
+    // away if it is running on another one
+    for (DWORD i = 1; i <= BITS_FOR_STRUCTURE(THREAD_AFFINITY); ++i)
+    {
+        cpuIndex = (*CpuIndex + i) % BITS_FOR_STRUCTURE(THREAD_AFFINITY);
+
+        if (SUCCEEDED(ThreadSetAffinity(Thread, THREAD_AFFINITY_CPU(cpuIndex))))
+        {
+            *CpuIndex = cpuIndex;
+            return;
+        }
+    }
+}
+
 static
 void
 (__cdecl _ThreadTestPassContext)(
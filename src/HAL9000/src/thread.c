@@ -14,6 +14,13 @@
 
 #define THREAD_TIME_SLICE           1
 
+// maximum number of destroyed threads kept for reuse
+#define THREAD_CACHE_MAX_DEPTH      32
+
+// number of threads at the head of the ready list among which a CPU looks for
+// one which last ran on it before taking the first one it may run
+#define THREAD_SCHEDULE_LOOKAHEAD   4
+
 extern void ThreadStart();
 
 typedef
@@ -36,6 +43,19 @@ typedef struct _THREAD_SYSTEM_DATA
 
     _Guarded_by_(ReadyThreadsLock)
     LIST_ENTRY          ReadyThreadsList;
+
+    LOCK                CachedThreadsLock;
+
+    // destroyed threads whose structure and kernel stack are reused by the
+    // next threads created, they are linked through their AllList entry
+    _Guarded_by_(CachedThreadsLock)
+    LIST_ENTRY          CachedThreadsList;
+
+    _Guarded_by_(CachedThreadsLock)
+    DWORD               NumberOfCachedThreads;
+
+    // the affinity bits of the CPUs which initialized their main thread
+    volatile THREAD_AFFINITY    ActiveCpus;
 } THREAD_SYSTEM_DATA, *PTHREAD_SYSTEM_DATA;
 
 static THREAD_SYSTEM_DATA m_threadSystemData;
@@ -61,6 +81,19 @@ _ThreadInit(
     IN          BOOLEAN             AllocateKernelStack
     );
 
+static
+PTR_SUCCESS
+PTHREAD
+_ThreadCachePop(
+    void
+    );
+
+static
+BOOLEAN
+_ThreadCachePush(
+    IN      PTHREAD             Thread
+    );
+
 static
 STATUS
 _ThreadSetupInitialState(
@@ -71,6 +104,19 @@ _ThreadSetupInitialState(
     IN      BOOLEAN             KernelStack
     );
 
+static
+STATUS
+_ThreadCreateInProcess(
+    IN_Z        char*               Name,
+    IN          THREAD_PRIORITY     Priority,
+    IN          PFUNC_ThreadStart   Function,
+    IN_OPT      PVOID               Context,
+    OUT_PTR     PTHREAD*            Thread,
+    INOUT       struct _PROCESS*    Process,
+    IN          BOOLEAN             UserMode,
+    IN          THREAD_AFFINITY     Affinity
+    );
+
 static
 STATUS
 _ThreadSetupMainThreadUserStack(
@@ -109,6 +155,18 @@ _ThreadForcedExit(
     void
     );
 
+static
+void
+_ThreadFpuSaveState(
+    IN      PTHREAD                 Thread
+    );
+
+static
+void
+_ThreadFpuResume(
+    void
+    );
+
 static
 void
 _ThreadReference(
@@ -145,6 +203,9 @@ ThreadSystemPreinit(
 
     InitializeListHead(&m_threadSystemData.ReadyThreadsList);
     LockInit(&m_threadSystemData.ReadyThreadsLock);
+
+    InitializeListHead(&m_threadSystemData.CachedThreadsList);
+    LockInit(&m_threadSystemData.CachedThreadsLock);
 }
 
 STATUS
@@ -181,8 +242,18 @@ ThreadSystemInitMainForCurrentCPU(
     pThread->StackSize = pCpu->StackSize;
 
     pThread->State = ThreadStateRunning;
+    pThread->LastCpu = pCpu;
     SetCurrentThread(pThread);
 
+    _InterlockedOr64((volatile __int64*)&m_threadSystemData.ActiveCpus, THREAD_AFFINITY_CPU(pCpu->ApicId));
+
+#if INCLUDE_FP_SUPPORT
+    // no thread owns the FPU registers yet, the first thread to use them on
+    // this CPU will take an #NM
+    pCpu->FpuOwner = NULL;
+    __writecr0(__readcr0() | CR0_TS);
+#endif
+
     // In case of the main thread of the BSP the process will be NULL so we need to handle that case
     // When the system process will be initialized it will insert into its thread list the current thread (which will
     // be the main thread of the BSP)
@@ -274,11 +345,43 @@ ThreadCreate(
                           Function,
                           Context,
                           Thread,
-                          ProcessRetrieveSystemProcess());
+                          ProcessRetrieveSystemProcess(),
+                          THREAD_AFFINITY_ALL_CPUS);
 }
 
 STATUS
 ThreadCreateEx(
+    IN_Z        char*               Name,
+    IN          THREAD_PRIORITY     Priority,
+    IN          PFUNC_ThreadStart   Function,
+    IN_OPT      PVOID               Context,
+    OUT_PTR     PTHREAD*            Thread,
+    INOUT       struct _PROCESS*    Process,
+    IN          THREAD_AFFINITY     Affinity
+    )
+{
+    if (NULL == Process)
+    {
+        return STATUS_INVALID_PARAMETER6;
+    }
+
+    if (0 == (Affinity & m_threadSystemData.ActiveCpus))
+    {
+        return STATUS_INVALID_PARAMETER7;
+    }
+
+    return _ThreadCreateInProcess(Name,
+                                  Priority,
+                                  Function,
+                                  Context,
+                                  Thread,
+                                  Process,
+                                  !Process->PagingData->Data.KernelSpace,
+                                  Affinity);
+}
+
+STATUS
+ThreadCreateKernelThreadInProcess(
     IN_Z        char*               Name,
     IN          THREAD_PRIORITY     Priority,
     IN          PFUNC_ThreadStart   Function,
@@ -286,6 +389,29 @@ ThreadCreateEx(
     OUT_PTR     PTHREAD*            Thread,
     INOUT       struct _PROCESS*    Process
     )
+{
+    return _ThreadCreateInProcess(Name,
+                                  Priority,
+                                  Function,
+                                  Context,
+                                  Thread,
+                                  Process,
+                                  FALSE,
+                                  THREAD_AFFINITY_ALL_CPUS);
+}
+
+static
+STATUS
+_ThreadCreateInProcess(
+    IN_Z        char*               Name,
+    IN          THREAD_PRIORITY     Priority,
+    IN          PFUNC_ThreadStart   Function,
+    IN_OPT      PVOID               Context,
+    OUT_PTR     PTHREAD*            Thread,
+    INOUT       struct _PROCESS*    Process,
+    IN          BOOLEAN             UserMode,
+    IN          THREAD_AFFINITY     Affinity
+    )
 {
     STATUS status;
     PTHREAD pThread;
@@ -334,20 +460,22 @@ ThreadCreateEx(
 
     ProcessInsertThreadInList(Process, pThread);
 
+    pThread->Affinity = Affinity;
+
     // the reference must be done outside _ThreadInit
     _ThreadReference(pThread);
 
-    if (!Process->PagingData->Data.KernelSpace)
+    if (UserMode)
     {
-        // Create user-mode stack
-        pThread->UserStack = MmuAllocStack(STACK_DEFAULT_SIZE,
+        // Create user-mode stack, it grows on demand up to its reserved size
+        pThread->UserStack = MmuAllocStack(STACK_USER_RESERVE_SIZE,
+                                           TRUE,
                                            TRUE,
-                                           FALSE,
                                            Process);
         if (pThread->UserStack == NULL)
         {
             status = STATUS_MEMORY_CANNOT_BE_COMMITED;
-            LOG_FUNC_ERROR_ALLOC("MmuAllocStack", STACK_DEFAULT_SIZE);
+            LOG_FUNC_ERROR_ALLOC("MmuAllocStack", STACK_USER_RESERVE_SIZE);
             return status;
         }
 
@@ -394,7 +522,7 @@ ThreadCreateEx(
                                       pStartFunction,
                                       firstArg,
                                       secondArg,
-                                      Process->PagingData->Data.KernelSpace);
+                                      !UserMode);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("_ThreadSetupInitialState", status);
@@ -418,6 +546,54 @@ ThreadCreateEx(
     return status;
 }
 
+STATUS
+ThreadSetAffinity(
+    INOUT       PTHREAD             Thread,
+    IN          THREAD_AFFINITY     Affinity
+    )
+{
+    INTR_STATE oldState;
+    BOOLEAN bMustYield;
+
+    if (NULL == Thread)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == (Affinity & m_threadSystemData.ActiveCpus))
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    // the scheduler reads the affinity of the ready threads with this lock
+    // held => it never sees the thread allowed on a mix of old and new CPUs
+    // while choosing the next thread to run
+    LockAcquire(&m_threadSystemData.ReadyThreadsLock, &oldState);
+    Thread->Affinity = Affinity;
+    LockRelease(&m_threadSystemData.ReadyThreadsLock, oldState);
+
+    if (Thread != GetCurrentThread())
+    {
+        // a thread which is ready or blocked will be picked up only by the CPUs
+        // it is allowed to run on the next time it is scheduled, a thread
+        // running on another CPU keeps running there until it is preempted
+        return STATUS_SUCCESS;
+    }
+
+    oldState = CpuIntrDisable();
+    bMustYield = !IsFlagOn(Affinity, THREAD_AFFINITY_CPU(GetCurrentPcpu()->ApicId));
+    CpuIntrSetState(oldState);
+
+    if (bMustYield)
+    {
+        // this CPU will skip the thread in the ready list, one of the CPUs it
+        // is allowed on will schedule it
+        ThreadYield();
+    }
+
+    return STATUS_SUCCESS;
+}
+
 void
 ThreadTick(
     void
@@ -577,6 +753,101 @@ ThreadYieldOnInterrupt(
     return GetCurrentPcpu()->ThreadData.YieldOnInterruptReturn;
 }
 
+void
+ThreadEnterInterrupt(
+    void
+    )
+{
+#if INCLUDE_FP_SUPPORT
+    PTHREAD pThread;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pThread = GetCurrentThread();
+    if (NULL != pThread)
+    {
+        pThread->InterruptNesting++;
+    }
+#endif // INCLUDE_FP_SUPPORT
+}
+
+void
+ThreadLeaveInterrupt(
+    void
+    )
+{
+#if INCLUDE_FP_SUPPORT
+    PTHREAD pThread;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pThread = GetCurrentThread();
+    if (NULL == pThread)
+    {
+        return;
+    }
+
+    ASSERT(pThread->InterruptNesting > 0);
+    pThread->InterruptNesting--;
+
+    // The handler may have used the registers or the thread may have been
+    // moved to another CPU, the interrupted code may use them right away only
+    // if they still hold its state. A state saved in the interrupt frame is
+    // restored after this, through an #NM if CR0.TS is set.
+    _ThreadFpuResume();
+#endif // INCLUDE_FP_SUPPORT
+}
+
+BOOLEAN
+ThreadHandleDeviceNotAvailable(
+    void
+    )
+{
+#if INCLUDE_FP_SUPPORT
+    PTHREAD pThread;
+    PPCPU pCpu;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pThread = GetCurrentThread();
+    pCpu = GetCurrentPcpu();
+
+    // CR0.TS is set only after the threading system is initialized
+    if (NULL == pThread || NULL == pCpu)
+    {
+        return FALSE;
+    }
+
+    // Nothing may be called from here while CR0.TS is set: the compiler is
+    // free to use SSE in any function and each use would trigger another #NM.
+    // This is why the area is allocated together with the thread.
+    ASSERT(NULL != pThread->FpuArea);
+
+    // The state of the previous owner was already saved when it was
+    // de-scheduled, the registers can be overwritten
+    __writecr0(__readcr0() & ~CR0_TS);
+
+    if (pThread->InterruptNesting > 0)
+    {
+        // The FPU is used by an interrupt handler and not by the thread. The
+        // registers are left to the handler, which does not preserve them, so
+        // they do not belong to anyone and ThreadLeaveInterrupt sets CR0.TS
+        // back once the handler returns.
+        pCpu->FpuOwner = NULL;
+        return TRUE;
+    }
+
+    _xrstor64(pThread->FpuArea, MAX_QWORD);
+
+    pCpu->FpuOwner = pThread;
+    pThread->FpuCpu = pCpu;
+
+    return TRUE;
+#else
+    return FALSE;
+#endif // INCLUDE_FP_SUPPORT
+}
+
 void
 ThreadTakeBlockLock(
     void
@@ -740,12 +1011,27 @@ _ThreadInit(
 
     __try
     {
-        pThread = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(THREAD), HEAP_THREAD_TAG, 0);
-        if (NULL == pThread)
+        pThread = AllocateKernelStack ? _ThreadCachePop() : NULL;
+        if (NULL != pThread)
         {
-            LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", sizeof(THREAD));
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
+            // only the kernel stack of a cached thread is kept, the rest of
+            // the structure is initialized again
+            pStack = pThread->InitialStackBase;
+            memzero(pThread, sizeof(THREAD));
+
+            pThread->Stack = pStack;
+            pThread->InitialStackBase = pStack;
+            pThread->StackSize = STACK_DEFAULT_SIZE;
+        }
+        else
+        {
+            pThread = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(THREAD), HEAP_THREAD_TAG, 0);
+            if (NULL == pThread)
+            {
+                LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", sizeof(THREAD));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
         }
 
         RfcPreInit(&pThread->RefCnt);
@@ -766,7 +1052,7 @@ _ThreadInit(
             __leave;
         }
 
-        if (AllocateKernelStack)
+        if (AllocateKernelStack && NULL == pThread->Stack)
         {
             pStack = MmuAllocStack(STACK_DEFAULT_SIZE, TRUE, FALSE, NULL);
             if (NULL == pStack)
@@ -790,6 +1076,22 @@ _ThreadInit(
 
         strcpy(pThread->Name, Name);
 
+#if INCLUDE_FP_SUPPORT
+        // the area must exist before the first #NM of the thread, the
+        // exception handler cannot allocate it
+        pThread->FpuArea = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(XSAVE_AREA), HEAP_THREAD_TAG, XSAVE_AREA_REQUIRED_ALIGNMENT);
+        if (NULL == pThread->FpuArea)
+        {
+            LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", sizeof(XSAVE_AREA));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        // with an empty header XRSTOR puts all the components in their
+        // initial state, only MXCSR is loaded from memory
+        pThread->FpuArea->LegacyState.MxCsr = XSAVE_MXCSR_DEFAULT_VALUE;
+#endif // INCLUDE_FP_SUPPORT
+
         pThread->Id = _ThreadSystemGetNextTid();
         pThread->State = ThreadStateBlocked;
         pThread->Priority = Priority;
@@ -1000,6 +1302,9 @@ _ThreadSchedule(
         // appearing to cause inconsistencies
         pCurrentThread->UninterruptedTicks = 0;
 
+        // the FPU state is not part of the state saved by ThreadSwitch
+        _ThreadFpuSaveState(pCurrentThread);
+
         SetCurrentThread(pNextThread);
         ThreadSwitch( &pCurrentThread->Stack, pNextThread->Stack);
 
@@ -1040,6 +1345,9 @@ ThreadCleanupPostSchedule(
 
     GetCurrentPcpu()->ThreadData.RunningThreadTicks = 0;
     prevThread = GetCurrentPcpu()->ThreadData.PreviousThread;
+    GetCurrentThread()->LastCpu = GetCurrentPcpu();
+
+    _ThreadFpuResume();
 
     LockRelease(&m_threadSystemData.ReadyThreadsLock, INTR_OFF);
 
@@ -1108,25 +1416,58 @@ _ThreadGetReadyThread(
     )
 {
     PTHREAD pNextThread;
+    PTHREAD pThread;
     PLIST_ENTRY pEntry;
     BOOLEAN bIdleScheduled;
+    PPCPU pCpu;
+    THREAD_AFFINITY cpuAffinity;
+    DWORD eligibleThreads;
 
     ASSERT( INTR_OFF == CpuIntrGetState());
     ASSERT( LockIsOwner(&m_threadSystemData.ReadyThreadsLock));
 
     pNextThread = NULL;
+    pCpu = GetCurrentPcpu();
+    cpuAffinity = THREAD_AFFINITY_CPU(pCpu->ApicId);
+    eligibleThreads = 0;
+
+    // take the first thread which may run on this CPU unless one of the next
+    // few eligible threads last ran here and may still have warm caches
+    for (pEntry = m_threadSystemData.ReadyThreadsList.Flink;
+         pEntry != &m_threadSystemData.ReadyThreadsList && eligibleThreads < THREAD_SCHEDULE_LOOKAHEAD;
+         pEntry = pEntry->Flink)
+    {
+        pThread = CONTAINING_RECORD(pEntry, THREAD, ReadyList);
 
-    pEntry = RemoveHeadList(&m_threadSystemData.ReadyThreadsList);
-    if (pEntry == &m_threadSystemData.ReadyThreadsList)
+        ASSERT(pThread->State == ThreadStateReady);
+
+        if (!IsFlagOn(pThread->Affinity, cpuAffinity))
+        {
+            continue;
+        }
+
+        if (NULL == pNextThread)
+        {
+            pNextThread = pThread;
+        }
+
+        if (pThread->LastCpu == pCpu)
+        {
+            pNextThread = pThread;
+            break;
+        }
+
+        eligibleThreads++;
+    }
+
+    if (NULL == pNextThread)
     {
-        pNextThread = GetCurrentPcpu()->ThreadData.IdleThread;
+        pNextThread = pCpu->ThreadData.IdleThread;
         bIdleScheduled = TRUE;
     }
     else
     {
-        pNextThread = CONTAINING_RECORD( pEntry, THREAD, ReadyList );
-
-        ASSERT( pNextThread->State == ThreadStateReady );
+        RemoveEntryList(&pNextThread->ReadyList);
         bIdleScheduled = FALSE;
     }
 
@@ -1152,6 +1493,71 @@ _ThreadForcedExit(
     NOT_REACHED;
 }
 
+static
+void
+_ThreadFpuSaveState(
+    IN      PTHREAD                 Thread
+    )
+{
+#if INCLUDE_FP_SUPPORT
+    ASSERT(NULL != Thread);
+
+    // CR0.TS is clear only while the registers hold the state of the running
+    // thread, if it is set the thread did not use the FPU since it was
+    // scheduled and its area is already up to date. The registers may also
+    // have been taken by an interrupt handler of the thread, which is
+    // de-scheduled before the interrupt returns, they have no owner then.
+    if (IsBooleanFlagOn(__readcr0(), CR0_TS)
+        || GetCurrentPcpu()->FpuOwner != Thread
+        || ThreadStateDying == Thread->State)
+    {
+        return;
+    }
+
+    ASSERT(NULL != Thread->FpuArea);
+
+    // XSAVEOPT does not write the components which are in their initial state
+    // or which were not modified since they were loaded from this same area
+    if (CpuMuIsXsaveoptFeaturePresent())
+    {
+        _xsaveopt64(Thread->FpuArea, MAX_QWORD);
+    }
+    else
+    {
+        _xsave64(Thread->FpuArea, MAX_QWORD);
+    }
+#else
+    UNREFERENCED_PARAMETER(Thread);
+#endif // INCLUDE_FP_SUPPORT
+}
+
+static
+void
+_ThreadFpuResume(
+    void
+    )
+{
+#if INCLUDE_FP_SUPPORT
+    PTHREAD pThread;
+    PPCPU pCpu;
+    QWORD cr0;
+    QWORD newCr0;
+
+    pThread = GetCurrentThread();
+    pCpu = GetCurrentPcpu();
+    cr0 = __readcr0();
+
+    // if no other thread loaded its FPU state on this CPU since the thread
+    // last did it, the registers still hold its state and it may use them
+    // right away, else the first FPU instruction will trigger an #NM
+    newCr0 = (pCpu->FpuOwner == pThread && pThread->FpuCpu == pCpu) ? (cr0 & ~CR0_TS) : (cr0 | CR0_TS);
+    if (newCr0 != cr0)
+    {
+        __writecr0(newCr0);
+    }
+#endif // INCLUDE_FP_SUPPORT
+}
+
 static
 void
 _ThreadReference(
@@ -1197,7 +1603,7 @@ _ThreadDestroy(
     if (NULL != pThread->UserStack)
     {
         // Free UM stack
-        MmuFreeStack(pThread->UserStack, pThread->Process);
+        MmuFreeStack(pThread->UserStack, STACK_USER_RESERVE_SIZE, pThread->Process);
         pThread->UserStack = NULL;
     }
 
@@ -1209,17 +1615,80 @@ _ThreadDestroy(
         pThread->Name = NULL;
     }
 
+    // A CPU may still have the thread as its FpuOwner, but the area is never
+    // accessed through the owner and FpuCpu is cleared when the structure is
+    // reused
+    if (NULL != pThread->FpuArea)
+    {
+        ExFreePoolWithTag(pThread->FpuArea, HEAP_THREAD_TAG);
+        pThread->FpuArea = NULL;
+    }
+
+    // The structure is reused together with its kernel stack
+    if (NULL != pThread->Stack
+        && STACK_DEFAULT_SIZE == pThread->StackSize
+        && _ThreadCachePush(pThread))
+    {
+        return;
+    }
+
     if (NULL != pThread->Stack)
     {
         // This is the kernel mode stack
         // It does not 'belong' to any process => pass NULL
-        MmuFreeStack(pThread->Stack, NULL);
+        MmuFreeStack(pThread->InitialStackBase, pThread->StackSize, NULL);
         pThread->Stack = NULL;
     }
 
     ExFreePoolWithTag(pThread, HEAP_THREAD_TAG);
 }
 
+static
+PTR_SUCCESS
+PTHREAD
+_ThreadCachePop(
+    void
+    )
+{
+    PTHREAD pThread;
+    INTR_STATE oldState;
+
+    pThread = NULL;
+
+    LockAcquire(&m_threadSystemData.CachedThreadsLock, &oldState);
+    if (!IsListEmpty(&m_threadSystemData.CachedThreadsList))
+    {
+        pThread = CONTAINING_RECORD(RemoveHeadList(&m_threadSystemData.CachedThreadsList), THREAD, AllList);
+        m_threadSystemData.NumberOfCachedThreads--;
+    }
+    LockRelease(&m_threadSystemData.CachedThreadsLock, oldState);
+
+    return pThread;
+}
+
+static
+BOOLEAN
+_ThreadCachePush(
+    IN      PTHREAD             Thread
+    )
+{
+    INTR_STATE oldState;
+    BOOLEAN bCached;
+
+    ASSERT(NULL != Thread);
+
+    LockAcquire(&m_threadSystemData.CachedThreadsLock, &oldState);
+    bCached = m_threadSystemData.NumberOfCachedThreads < THREAD_CACHE_MAX_DEPTH;
+    if (bCached)
+    {
+        InsertHeadList(&m_threadSystemData.CachedThreadsList, &Thread->AllList);
+        m_threadSystemData.NumberOfCachedThreads++;
+    }
+    LockRelease(&m_threadSystemData.CachedThreadsLock, oldState);
+
+    return bCached;
+}
+
 static
 void
 _ThreadKernelFunction(
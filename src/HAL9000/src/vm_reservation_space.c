@@ -38,6 +38,11 @@ typedef struct _VMM_RESERVATION
     // Indicates the file which holds the data
     PFILE_OBJECT            BackingFile;
 
+    // If TRUE the pages map frames described by a MDL which are owned by
+    // someone else (e.g. a ring shared with the kernel), they are never
+    // copied or shared copy-on-write with a cloned address space
+    BOOLEAN                 Shared;
+
     // Describes which pages of the virtual memory reserved are actually
     // committed, i.e. which are valid when a #PF occurs
     BITMAP                  CommitBitmap;
@@ -103,6 +108,7 @@ _VmInitializeReservation(
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      BOOLEAN                 Shared,
     OUT     PVMM_RESERVATION        VmmReservation
     );
 
@@ -126,7 +132,8 @@ _VmChangeVaReservationState(
     IN      VMM_ALLOC_TYPE          AllocationType,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
-    IN_OPT  PFILE_OBJECT            FileObject
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      BOOLEAN                 Shared
     );
 
 // This function should be called only on a copy of the reservation to be uninitialized
@@ -310,6 +317,7 @@ _VmInitializeReservation(
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      BOOLEAN                 Shared,
     OUT     PVMM_RESERVATION        VmmReservation
     )
 {
@@ -332,6 +340,7 @@ _VmInitializeReservation(
     VmmReservation->PageRights = PageRights;
     VmmReservation->Uncacheable = Uncacheable;
     VmmReservation->BackingFile = FileObject;
+    VmmReservation->Shared = Shared;
 
     LOG_TRACE_VMM("StartVa: 0x%X\n", Address );
     LOG_TRACE_VMM("Size: 0x%X\n", Size );
@@ -374,7 +383,8 @@ _VmChangeVaReservationState(
     IN      VMM_ALLOC_TYPE          AllocationType,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
-    IN_OPT  PFILE_OBJECT            FileObject
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      BOOLEAN                 Shared
     )
 {
     PVMM_RESERVATION pReservation;
@@ -439,6 +449,7 @@ _VmChangeVaReservationState(
                                 PageRights,
                                 Uncacheable,
                                 FileObject,
+                                Shared,
                                 pReservation
                                 );
         break;
@@ -760,6 +771,7 @@ VmReservationSpaceAllocRegion(
     IN      PAGE_RIGHTS             Rights,
     IN      BOOLEAN                 Uncacheable,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      BOOLEAN                 Shared,
     OUT     PVOID*                  MappedAddress,
     OUT     QWORD*                  MappedSize
     )
@@ -820,7 +832,8 @@ VmReservationSpaceAllocRegion(
                                                 VMM_ALLOC_TYPE_RESERVE,
                                                 Rights,
                                                 Uncacheable,
-                                                FileObject
+                                                FileObject,
+                                                Shared
             );
             if (!SUCCEEDED(status))
             {
@@ -840,7 +853,8 @@ VmReservationSpaceAllocRegion(
                                                  VMM_ALLOC_TYPE_COMMIT,
                                                  Rights,
                                                  Uncacheable,
-                                                 FileObject
+                                                 FileObject,
+                                                 Shared
             );
             if (!SUCCEEDED(status))
             {
@@ -1016,3 +1030,106 @@ VmReservationReturnRightsForAddress(
 
     return bFullyCommited ? STATUS_SUCCESS : STATUS_MEMORY_IS_NOT_COMMITED;
 }
+
+BOOLEAN
+VmReservationIsAddressShared(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address
+    )
+{
+    PVMM_RESERVATION pReservation;
+    INTR_STATE oldState;
+    BOOLEAN bShared;
+
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Address != NULL);
+
+    bShared = FALSE;
+
+    RwSpinlockAcquireShared(&ReservationSpace->ReservationLock, &oldState);
+    if (SUCCEEDED(_VmFindReservation(ReservationSpace, Address, 1, &pReservation)))
+    {
+        bShared = pReservation->Shared;
+    }
+    RwSpinlockReleaseShared(&ReservationSpace->ReservationLock, oldState);
+
+    return bShared;
+}
+
+STATUS
+VmReservationSpaceClone(
+    IN      PVMM_RESERVATION_SPACE  Source,
+    INOUT   PVMM_RESERVATION_SPACE  Destination
+    )
+{
+    PVMM_RESERVATION pCurrentReservation;
+    PVMM_RESERVATION pDestinationReservation;
+    QWORD bitmapAreaSize;
+    INTR_STATE oldState;
+    STATUS status;
+
+    ASSERT(Source != NULL);
+    ASSERT(Destination != NULL);
+    ASSERT(Source->ReservedAreaSize == Destination->ReservedAreaSize);
+
+    status = STATUS_SUCCESS;
+
+    RwSpinlockAcquireShared(&Source->ReservationLock, &oldState);
+
+    __try
+    {
+        for (pCurrentReservation = Source->ReservationList;
+             (PVOID)pCurrentReservation < Source->BitmapAddressStart;
+             pCurrentReservation = pCurrentReservation + 1)
+        {
+            pDestinationReservation = Destination->ReservationList + (pCurrentReservation - Source->ReservationList);
+
+            *pDestinationReservation = *pCurrentReservation;
+
+            if (VmmReservationStateLast == pCurrentReservation->State)
+            {
+                break;
+            }
+
+            if (VmmReservationStateUsed != pCurrentReservation->State)
+            {
+                continue;
+            }
+
+            // the frames belong to the owner of the MDL which described them,
+            // the clone does not receive the region
+            if (pCurrentReservation->Shared)
+            {
+                memzero(pDestinationReservation, sizeof(VMM_RESERVATION));
+                pDestinationReservation->State = VmmReservationStateFree;
+                continue;
+            }
+
+            // there is no way of referencing a file object, the file could
+            // be closed twice
+            if (pCurrentReservation->BackingFile != NULL)
+            {
+                status = STATUS_UNSUPPORTED;
+                LOG_ERROR("Cannot clone the file backed reservation at 0x%X\n", pCurrentReservation->StartVa);
+                __leave;
+            }
+
+            // the commit bitmaps have the same offsets in both bitmap areas
+            pDestinationReservation->CommitBitmap.BitmapBuffer =
+                (PBYTE) PtrOffset(Destination->BitmapAddressStart,
+                                  PtrDiff(pCurrentReservation->CommitBitmap.BitmapBuffer, Source->BitmapAddressStart));
+        }
+
+        bitmapAreaSize = PtrDiff(Source->FreeBitmapAddress, Source->BitmapAddressStart);
+        memcpy(Destination->BitmapAddressStart, Source->BitmapAddressStart, bitmapAreaSize);
+
+        Destination->FreeBitmapAddress = (PBYTE) PtrOffset(Destination->BitmapAddressStart, bitmapAreaSize);
+        Destination->FreeVirtualAddressPointer = Source->FreeVirtualAddressPointer;
+    }
+    __finally
+    {
+        RwSpinlockReleaseShared(&Source->ReservationLock, oldState);
+    }
+
+    return status;
+}
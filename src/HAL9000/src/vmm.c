@@ -10,6 +10,7 @@
 #include "thread_internal.h"
 #include "process_internal.h"
 #include "mdl.h"
+#include "image_cache.h"
 
 #define VMM_SIZE_FOR_RESERVATION_METADATA            (5*TB_SIZE)
 
@@ -65,6 +66,21 @@ typedef struct _VMM_RETRIEVE_PHYS_ACCESS_PAGE_WALK_CONTEXT
     BOOLEAN                         ClearDirty;
 } VMM_RETRIEVE_PHYS_ACCESS_PAGE_WALK_CONTEXT, *PVMM_RETRIEVE_PHYS_ACCESS_PAGE_WALK_CONTEXT;
 
+// Used when copying the user mappings of an address space in _VmCloneUserPage
+// and _VmClonePage
+typedef struct _VMM_CLONE_PAGE_WALK_CONTEXT
+{
+    // Paging structures of the destination address space
+    PPAGING_DATA                    PagingData;
+    PML4                            Cr3;
+
+    // VA space of the source address space
+    PVMM_RESERVATION_SPACE          SourceVaSpace;
+
+    // The leaf entry of the source address space
+    PT_ENTRY                        Entry;
+} VMM_CLONE_PAGE_WALK_CONTEXT, *PVMM_CLONE_PAGE_WALK_CONTEXT;
+
 static VMM_DATA m_vmmData;
 
 static
@@ -97,6 +113,39 @@ static FUNC_PageWalkCallback            _VmMapPage;
 static FUNC_PageWalkCallback            _VmUnmapPage;
 static FUNC_PageWalkCallback            _VmRetrievePhyAccess;
 
+static
+BOOLEAN
+_VmmSolveImagePageFault(
+    IN      PPROCESS                Process,
+    IN      PVOID                   FaultingAddress,
+    IN      PAGE_RIGHTS             RightsRequested,
+    IN      PPAGING_LOCK_DATA       PagingData
+    );
+
+static
+BOOLEAN
+_VmmCopyOnWrite(
+    IN      PVOID                   AlignedAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    );
+
+static FUNC_PageWalkCallback            _VmClonePage;
+static FUNC_PageWalkCallback            _VmCloneUserPage;
+static FUNC_PageWalkCallback            _VmReleaseUserPage;
+
+static
+void
+_VmWalkUserPagingStructure(
+    IN      PML4                        Cr3,
+    IN      PHYSICAL_ADDRESS            PagingStructure,
+    IN      BYTE                        PageLevel,
+    IN      PVOID                       VirtualAddressBase,
+    IN      PFUNC_PageWalkCallback      LeafCallback,
+    IN_OPT  PVOID                       Context
+    );
+
 __forceinline
 static
 PHYSICAL_ADDRESS
@@ -503,6 +552,16 @@ _VmmMapDescribedRegion(
                              FALSE,
                              PagingData);
 
+        // each UM mapping owns a reference to its frames, the frames are
+        // released only after they are unmapped from the kernel as well
+        if (PagingData != NULL && !PagingData->Data.KernelSpace)
+        {
+            for (QWORD offset = 0; offset < alignedPaSize; offset += PAGE_SIZE)
+            {
+                PmmReferenceFrame(PtrOffset(alignedPa, offset));
+            }
+        }
+
         // advance to the next VA->PA physical mapping
         currentOffset += alignedPaSize;
     }
@@ -561,6 +620,7 @@ VmmAllocRegionEx(
                                                Rights,
                                                Uncacheable,
                                                FileObject,
+                                               Mdl != NULL,
                                                &pBaseAddress,
                                                &alignedSize);
         if (!SUCCEEDED(status))
@@ -746,6 +806,7 @@ VmmSolvePageFault(
     QWORD fileOffset;
     BOOLEAN bKernelAddress;
     QWORD bytesReadFromFile;
+    PPROCESS pProcess;
 
     ASSERT(INTR_OFF == CpuIntrGetState());
     ASSERT(PagingData != NULL);
@@ -765,8 +826,32 @@ VmmSolvePageFault(
     }
     else if (!bKernelAddress && PagingData->Data.KernelSpace)
     {
-        LOG_ERROR("Kernel code should not access UM pages!\n");
-        return FALSE;
+        // While serving a system call the kernel accesses the memory of the
+        // current process, it may touch pages the process did not access yet
+        if (GetCurrentThread() == NULL || ProcessIsSystem(NULL))
+        {
+            LOG_ERROR("Kernel code should not access UM pages!\n");
+            return FALSE;
+        }
+
+        PagingData = GetCurrentProcess()->PagingData;
+    }
+
+    if (!bKernelAddress)
+    {
+        pProcess = GetCurrentProcess();
+
+        // The image of the executable is not described by the VA space of the
+        // process, its pages are mapped from the image cache
+        if (pProcess->Image != NULL
+            && pProcess->HeaderInfo->Preferred.ImageBase <= FaultingAddress
+            && FaultingAddress < (PVOID)PtrOffset(pProcess->HeaderInfo->Preferred.ImageBase, pProcess->HeaderInfo->Size))
+        {
+            return _VmmSolveImagePageFault(pProcess,
+                                           FaultingAddress,
+                                           RightsRequested,
+                                           PagingData);
+        }
     }
 
     bSolvedPageFault = FALSE;
@@ -796,14 +881,27 @@ VmmSolvePageFault(
             PHYSICAL_ADDRESS pa;
             PVOID alignedAddress;
 
+            alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
+
+            // The page may be present but write protected because it is
+            // shared with a cloned address space
+            if (IsBooleanFlagOn(RightsRequested, PAGE_RIGHTS_WRITE)
+                && _VmmCopyOnWrite(alignedAddress, pageRights, uncacheable, PagingData))
+            {
+                if (NULL != pCpu)
+                {
+                    pCpu->PageFaults = pCpu->PageFaults + 1;
+                }
+                bSolvedPageFault = TRUE;
+                __leave;
+            }
+
             // solve #PF
 
             // 1. Reserve one frame of physical memory
             pa = PmmReserveMemory(1);
             ASSERT(NULL != pa);
 
-            alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
-
             // 2. Map the aligned faulting address to the newly acquired physical frame
             MmuMapMemoryInternal(pa,
                                  PAGE_SIZE,
@@ -863,6 +961,166 @@ VmmSolvePageFault(
     return bSolvedPageFault;
 }
 
+static
+BOOLEAN
+_VmmSolveImagePageFault(
+    IN      PPROCESS                Process,
+    IN      PVOID                   FaultingAddress,
+    IN      PAGE_RIGHTS             RightsRequested,
+    IN      PPAGING_LOCK_DATA       PagingData
+    )
+{
+    STATUS status;
+    PPCPU pCpu;
+    PVOID alignedAddress;
+    PAGE_RIGHTS pageRights;
+    PVOID pCachedPage;
+    PHYSICAL_ADDRESS pa;
+
+    ASSERT(NULL != Process);
+    ASSERT(NULL != Process->Image);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pCpu = GetCurrentPcpu();
+    alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
+    pageRights = 0;
+    pCachedPage = NULL;
+
+    status = ImageCacheGetPage(Process->Image,
+                               PtrDiff(alignedAddress, Process->HeaderInfo->Preferred.ImageBase),
+                               &pageRights,
+                               &pCachedPage);
+    if (!SUCCEEDED(status))
+    {
+        LOG_TRACE_VMM("Address 0x%X is not part of any section of the image\n", FaultingAddress);
+        return FALSE;
+    }
+
+    if (!IsBooleanFlagOn(pageRights, RightsRequested))
+    {
+        LOG_TRACE_VMM("Access 0x%x denied to image page 0x%X mapped with rights 0x%x\n",
+                      RightsRequested, alignedAddress, pageRights);
+        return FALSE;
+    }
+
+    if (IsBooleanFlagOn(RightsRequested, PAGE_RIGHTS_WRITE)
+        && _VmmCopyOnWrite(alignedAddress, pageRights, FALSE, PagingData))
+    {
+        // the page was already mapped read-only, either from the cache or
+        // from the address space this one was cloned from
+    }
+    else if (pCachedPage != NULL && !IsBooleanFlagOn(RightsRequested, PAGE_RIGHTS_WRITE))
+    {
+        // Map the frame of the cache, it is shared with all the processes
+        // running the executable. Writable pages are mapped read-only until
+        // they are first written.
+        pa = MmuGetPhysicalAddress(pCachedPage);
+
+        PmmReferenceFrame(pa);
+        MmuMapMemoryInternal(pa,
+                             PAGE_SIZE,
+                             pageRights & ~PAGE_RIGHTS_WRITE,
+                             alignedAddress,
+                             TRUE,
+                             FALSE,
+                             PagingData
+                             );
+    }
+    else
+    {
+        // The process gets its own copy of the page, either because it writes
+        // it or because it is beyond the end of the file (uninitialized data)
+        pa = PmmReserveMemory(1);
+        ASSERT(NULL != pa);
+
+        MmuMapMemoryInternal(pa,
+                             PAGE_SIZE,
+                             pageRights,
+                             alignedAddress,
+                             TRUE,
+                             FALSE,
+                             PagingData
+                             );
+
+        __writecr0(__readcr0() & ~CR0_WP);
+        if (pCachedPage != NULL)
+        {
+            memcpy(alignedAddress, pCachedPage, PAGE_SIZE);
+        }
+        else
+        {
+            memzero(alignedAddress, PAGE_SIZE);
+        }
+        __writecr0(__readcr0() | CR0_WP);
+    }
+
+    if (NULL != pCpu)
+    {
+        pCpu->PageFaults = pCpu->PageFaults + 1;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+_VmmCopyOnWrite(
+    IN      PVOID                   AlignedAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    )
+{
+    PHYSICAL_ADDRESS pa;
+    PHYSICAL_ADDRESS newPa;
+    PVOID pCopy;
+    PML4 cr3;
+
+    ASSERT(NULL != AlignedAddress);
+    ASSERT(NULL != PagingData);
+
+    cr3.Raw = (QWORD) PagingData->Data.BasePhysicalAddress;
+
+    pa = VmmGetPhysicalAddress(cr3, AlignedAddress);
+    if (NULL == pa)
+    {
+        // nothing mapped yet, the fault is solved as usual
+        return FALSE;
+    }
+
+    if (PmmGetFrameReferences(pa) > 1)
+    {
+        // The frame is still mapped by other address spaces, give this one
+        // its own copy
+        newPa = PmmReserveMemory(1);
+        ASSERT(NULL != newPa);
+
+        pCopy = MmuMapSystemMemory(newPa, PAGE_SIZE);
+        ASSERT(NULL != pCopy);
+
+        memcpy(pCopy, AlignedAddress, PAGE_SIZE);
+
+        MmuUnmapSystemMemory(pCopy, PAGE_SIZE);
+
+        // drop the reference of this address space
+        MmuReleaseMemory(pa, 1);
+
+        pa = newPa;
+    }
+
+    // the last owner of the frame simply gets its write access back
+    MmuMapMemoryInternal(pa,
+                         PAGE_SIZE,
+                         PageRights,
+                         AlignedAddress,
+                         TRUE,
+                         Uncacheable,
+                         PagingData
+                         );
+
+    return TRUE;
+}
+
 PVMM_RESERVATION_SPACE
 VmmRetrieveReservationSpaceForSystemProcess(
     void
@@ -968,8 +1226,8 @@ VmmDestroyVirtualAddressSpace(
 
     if (ReservationSpace->ReservationList != NULL)
     {
-        /// TODO: go through each reservation belonging to the process and
-        /// release all the physical frames used (else we have physical memory leaks :) - not fun)
+        // the physical frames used by the process are released by VmmReleaseUserPages
+        // when its paging tables are destroyed
 
         VmmFreeRegion(ReservationSpace->ReservationList, 0, VMM_FREE_TYPE_RELEASE);
         ReservationSpace->ReservationList = NULL;
@@ -978,6 +1236,71 @@ VmmDestroyVirtualAddressSpace(
     ExFreePoolWithTag(ReservationSpace, HEAP_PROCESS_TAG);
 }
 
+STATUS
+VmmCloneVirtualAddressSpace(
+    IN      PVMM_RESERVATION_SPACE          Source,
+    INOUT   PVMM_RESERVATION_SPACE          Destination
+    )
+{
+    if (Source == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Destination == NULL)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    return VmReservationSpaceClone(Source, Destination);
+}
+
+void
+VmmCloneUserPagingTables(
+    INOUT   PPAGING_DATA                    Source,
+    IN      PVMM_RESERVATION_SPACE          SourceVaSpace,
+    INOUT   PPAGING_DATA                    Destination
+    )
+{
+    VMM_CLONE_PAGE_WALK_CONTEXT ctx = { 0 };
+    PML4 cr3;
+
+    ASSERT(Source != NULL && !Source->KernelSpace);
+    ASSERT(SourceVaSpace != NULL);
+    ASSERT(Destination != NULL && !Destination->KernelSpace);
+
+    ctx.PagingData = Destination;
+    ctx.Cr3.Raw = (QWORD) Destination->BasePhysicalAddress;
+    ctx.SourceVaSpace = SourceVaSpace;
+    cr3.Raw = (QWORD) Source->BasePhysicalAddress;
+
+    _VmWalkUserPagingStructure(cr3,
+                               Source->BasePhysicalAddress,
+                               PAGING_TABLES_FIRST_LEVEL,
+                               NULL,
+                               _VmCloneUserPage,
+                               &ctx);
+}
+
+void
+VmmReleaseUserPages(
+    INOUT   PPAGING_DATA                    PagingData
+    )
+{
+    PML4 cr3;
+
+    ASSERT(PagingData != NULL && !PagingData->KernelSpace);
+
+    cr3.Raw = (QWORD) PagingData->BasePhysicalAddress;
+
+    _VmWalkUserPagingStructure(cr3,
+                               PagingData->BasePhysicalAddress,
+                               PAGING_TABLES_FIRST_LEVEL,
+                               NULL,
+                               _VmReleaseUserPage,
+                               NULL);
+}
+
 STATUS
 VmmIsBufferValid(
     IN          PVOID                               Buffer,
@@ -1370,4 +1693,201 @@ BOOLEAN
     }
 
     return bContinue;
+}
+
+// Unlike _VmWalkPagingTables this goes only through the present entries, it
+// calls LeafCallback for each page mapped in the user half of the address space
+static
+void
+_VmWalkUserPagingStructure(
+    IN      PML4                        Cr3,
+    IN      PHYSICAL_ADDRESS            PagingStructure,
+    IN      BYTE                        PageLevel,
+    IN      PVOID                       VirtualAddressBase,
+    IN      PFUNC_PageWalkCallback      LeafCallback,
+    IN_OPT  PVOID                       Context
+    )
+{
+    PT_ENTRY* pEntries;
+    DWORD noOfEntries;
+    BYTE entryShift;
+
+    ASSERT(NULL != PagingStructure);
+    ASSERT(PAGING_TABLES_FIRST_LEVEL <= PageLevel && PageLevel <= PAGING_TABLES_LAST_LEVEL);
+    ASSERT(NULL != LeafCallback);
+
+    pEntries = (PT_ENTRY*)PA2VA(PagingStructure);
+
+    // each level translates 9 bits of the virtual address
+    entryShift = (BYTE)(PAGE_SHIFT + 9 * (PAGING_TABLES_LAST_LEVEL - PageLevel));
+
+    // the upper half of the PML4 maps the kernel, it is shared by all the
+    // address spaces
+    noOfEntries = (PageLevel == PAGING_TABLES_FIRST_LEVEL)
+                ? (1 << (VA_HIGHEST_VALID_BIT - entryShift))
+                : (PAGE_SIZE / sizeof(PT_ENTRY));
+
+    for (DWORD i = 0; i < noOfEntries; ++i)
+    {
+        PVOID currentVa;
+
+        if (!PteIsPresent(&pEntries[i]))
+        {
+            continue;
+        }
+
+        currentVa = PtrOffset(VirtualAddressBase, (QWORD)i << entryShift);
+
+        if (PageLevel != PAGING_TABLES_LAST_LEVEL)
+        {
+            ASSERT(((PD_ENTRY_PT*)&pEntries[i])->PageSize == 0);
+
+            _VmWalkUserPagingStructure(Cr3,
+                                       PteGetPhysicalAddress(&pEntries[i]),
+                                       PageLevel + 1,
+                                       currentVa,
+                                       LeafCallback,
+                                       Context);
+            continue;
+        }
+
+        LeafCallback(Cr3, &pEntries[i], currentVa, PageLevel, Context);
+    }
+}
+
+static
+BOOLEAN
+(__cdecl _VmCloneUserPage)(
+    IN      PML4                    Cr3,
+    IN      PVOID                   PageTable,
+    IN      PVOID                   VirtualAddress,
+    IN      BYTE                    PageLevel,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PVMM_CLONE_PAGE_WALK_CONTEXT pPageContext;
+    PT_ENTRY* pPtEntry;
+    PHYSICAL_ADDRESS pa;
+    PHYSICAL_ADDRESS newPa;
+    PVOID pSource;
+    PVOID pCopy;
+
+    UNREFERENCED_PARAMETER(Cr3);
+
+    ASSERT(PageTable != NULL);
+    ASSERT(PageLevel == PAGING_TABLES_LAST_LEVEL);
+
+    pPageContext = (PVMM_CLONE_PAGE_WALK_CONTEXT) Context;
+    ASSERT(pPageContext != NULL);
+
+    pPtEntry = (PT_ENTRY*) PageTable;
+
+    // The frames of a shared region remain mapped writable only in the source,
+    // the clone receives neither the reservation nor the mapping
+    if (VmReservationIsAddressShared(pPageContext->SourceVaSpace, VirtualAddress))
+    {
+        return TRUE;
+    }
+
+    pa = PteGetPhysicalAddress(pPtEntry);
+
+    if (pPtEntry->ReadWrite && PmmGetFrameReferences(pa) > 1)
+    {
+        // A private writable frame has more than one owner only while it is
+        // pinned (see MmuPinUserBuffer): a device may still write to it so the
+        // source keeps its mapping and the clone gets its own copy right away
+        newPa = PmmReserveMemory(1);
+        ASSERT(NULL != newPa);
+
+        pSource = MmuMapSystemMemory(pa, PAGE_SIZE);
+        ASSERT(NULL != pSource);
+
+        pCopy = MmuMapSystemMemory(newPa, PAGE_SIZE);
+        ASSERT(NULL != pCopy);
+
+        memcpy(pCopy, pSource, PAGE_SIZE);
+
+        MmuUnmapSystemMemory(pCopy, PAGE_SIZE);
+        MmuUnmapSystemMemory(pSource, PAGE_SIZE);
+
+        pPageContext->Entry = *pPtEntry;
+        pPageContext->Entry.PhysicalAddress = (QWORD) newPa >> SHIFT_FOR_PHYSICAL_ADDR;
+    }
+    else
+    {
+        // Both address spaces use the frame until one of them writes it
+        pPtEntry->ReadWrite = FALSE;
+        PmmReferenceFrame(pa);
+
+        pPageContext->Entry = *pPtEntry;
+    }
+
+    _VmWalkPagingTables(pPageContext->Cr3,
+                        VirtualAddress,
+                        PAGE_SIZE,
+                        _VmClonePage,
+                        pPageContext);
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+(__cdecl _VmReleaseUserPage)(
+    IN      PML4                    Cr3,
+    IN      PVOID                   PageTable,
+    IN      PVOID                   VirtualAddress,
+    IN      BYTE                    PageLevel,
+    IN_OPT  PVOID                   Context
+    )
+{
+    UNREFERENCED_PARAMETER(Cr3);
+    UNREFERENCED_PARAMETER(VirtualAddress);
+    UNREFERENCED_PARAMETER(Context);
+
+    ASSERT(PageTable != NULL);
+    ASSERT(PageLevel == PAGING_TABLES_LAST_LEVEL);
+
+    // frames shared with other address spaces only lose a reference
+    MmuReleaseMemory(PteGetPhysicalAddress(PageTable), 1);
+
+    PteUnmap(PageTable);
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+(__cdecl _VmClonePage)(
+    IN      PML4                    Cr3,
+    IN      PVOID                   PageTable,
+    IN      PVOID                   VirtualAddress,
+    IN      BYTE                    PageLevel,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PVMM_CLONE_PAGE_WALK_CONTEXT pPageContext;
+
+    UNREFERENCED_PARAMETER(Cr3);
+    UNREFERENCED_PARAMETER(VirtualAddress);
+
+    ASSERT(PageTable != NULL);
+    ASSERT(PAGING_TABLES_FIRST_LEVEL <= PageLevel && PageLevel <= PAGING_TABLES_LAST_LEVEL);
+
+    pPageContext = (PVMM_CLONE_PAGE_WALK_CONTEXT) Context;
+    ASSERT(pPageContext != NULL);
+
+    if (PageLevel == PAGING_TABLES_LAST_LEVEL)
+    {
+        ASSERT(!PteIsPresent(PageTable));
+
+        // the destination address space is not active yet, nothing to invalidate
+        *((PT_ENTRY*)PageTable) = pPageContext->Entry;
+    }
+    else if (!PteIsPresent(PageTable))
+    {
+        _VmSetupPagingStructure(pPageContext->PagingData, PageTable);
+    }
+
+    return TRUE;
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common_lib.h"
+#include "io.h"
+#include "log.h"
+#include "network.h"
+#include "network_port.h"
+
+#define LOOPBACK_NO_OF_DESCRIPTORS          256
+#define LOOPBACK_MIN_NO_OF_DESCRIPTORS      32
+
+// a frame always fits in a single buffer
+#define LOOPBACK_BUFFER_SIZE                PAGE_SIZE
+
+// the descriptors are not read by anybody, they only hold the physical
+// address of their buffer as a real ring would
+#define LOOPBACK_DESCRIPTOR_SIZE            sizeof(PHYSICAL_ADDRESS)
+
+// the frames never leave the memory => their checksums cannot be wrong
+#define LOOPBACK_RX_CHECKSUM_STATUS         (NETWORK_RX_CHECKSUM_IP4_GOOD | NETWORK_RX_CHECKSUM_TCP_UDP_GOOD)
+
+typedef struct _LOOPBACK_DEVICE
+{
+    PMINIPORT_DEVICE                MiniportDevice;
+
+    DWORD                           NumberOfRxDescriptors;
+    DWORD                           NumberOfTxDescriptors;
+    WORD                            TxBufferSize;
+    WORD                            RxBufferSize;
+
+    // the fields below are accessed only by the transmit thread of the
+    // single queue, the frames are received from MiniportSendBuffers
+
+    // the RX descriptors are filled in order
+    DWORD                           NextRxDescriptor;
+
+    // TX descriptors sent since they were last reclaimed
+    DWORD                           TxDescriptorsCompleted;
+
+    // frames sent while the reception was disabled
+    QWORD                           FramesDropped;
+} LOOPBACK_DEVICE, *PLOOPBACK_DEVICE;
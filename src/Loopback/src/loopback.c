@@ -0,0 +1,294 @@
+#include "loopback_base.h"
+#include "loopback.h"
+
+static FUNC_NetworkMiniportInitializeDevice     _LoopbackInitializeMiniport;
+static FUNC_NetworkMiniportSendBuffers          _LoopbackSendBuffers;
+static FUNC_NetworkMiniportReclaimTxDescriptors _LoopbackReclaimTxDescriptors;
+static FUNC_NetworkMiniportChangeDeviceStatus   _LoopbackChangeDeviceStatus;
+static FUNC_NetworkMiniportGetStatistics        _LoopbackGetStatistics;
+
+static
+BOOLEAN
+_LoopbackDeliverFrame(
+    INOUT       PLOOPBACK_DEVICE        Device,
+    IN          DWORD                   FirstTxDescriptor,
+    IN          PMINIPORT_TX_FRAME      Frame
+    );
+
+STATUS
+(__cdecl LoopbackDriverEntry)(
+    INOUT       PDRIVER_OBJECT      DriverObject
+    )
+{
+    STATUS status;
+    MINIPORT_REGISTRATION registration;
+
+    ASSERT( NULL != DriverObject );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+
+    memzero(&registration, sizeof(MINIPORT_REGISTRATION));
+
+    registration.NumberOfVirtualDevices = 1;
+    registration.DeviceContextSize = sizeof(LOOPBACK_DEVICE);
+
+    registration.RxBuffers.BufferSize = LOOPBACK_BUFFER_SIZE;
+    registration.RxBuffers.DescriptorSize = LOOPBACK_DESCRIPTOR_SIZE;
+    registration.RxBuffers.NumberOfBuffers = LOOPBACK_NO_OF_DESCRIPTORS;
+    registration.RxBuffers.MinimumNumberOfBuffers = LOOPBACK_MIN_NO_OF_DESCRIPTORS;
+
+    registration.TxBuffers.BufferSize = LOOPBACK_BUFFER_SIZE;
+    registration.TxBuffers.DescriptorSize = LOOPBACK_DESCRIPTOR_SIZE;
+    registration.TxBuffers.NumberOfBuffers = LOOPBACK_NO_OF_DESCRIPTORS;
+    registration.TxBuffers.MinimumNumberOfBuffers = LOOPBACK_MIN_NO_OF_DESCRIPTORS;
+
+    registration.MiniportFunctions.MiniportInitializeDevice = _LoopbackInitializeMiniport;
+    registration.MiniportFunctions.MiniportUninitializeDevice = NULL;
+    registration.MiniportFunctions.MiniportSendBuffers = _LoopbackSendBuffers;
+    registration.MiniportFunctions.MiniportReclaimTxDescriptors = _LoopbackReclaimTxDescriptors;
+    registration.MiniportFunctions.MiniportInterruptHandler = NULL;
+    registration.MiniportFunctions.MiniportVectorInterruptHandler = NULL;
+    registration.MiniportFunctions.MiniportChangeDeviceStatus = _LoopbackChangeDeviceStatus;
+    registration.MiniportFunctions.MiniportGetStatistics = _LoopbackGetStatistics;
+    registration.MiniportFunctions.MiniportGetTuning = NULL;
+    registration.MiniportFunctions.MiniportSetTuning = NULL;
+
+    status = NetworkPortRegisterMiniportDriver(DriverObject,
+                                               &registration
+                                               );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkPortRegisterMiniportDriver", status );
+        return status;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _LoopbackInitializeMiniport)(
+    INOUT                           PMINIPORT_DEVICE                    MiniportDevice,
+    IN                              PMINIPORT_DEVICE_INITIALIZATION     MiniportInitialization
+    )
+{
+    PLOOPBACK_DEVICE pDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != MiniportInitialization );
+    ASSERT( NULL == MiniportInitialization->PciBar );
+
+    ASSERT( LOOPBACK_BUFFER_SIZE == MiniportInitialization->RxBuffers.BufferSize );
+    ASSERT( LOOPBACK_BUFFER_SIZE == MiniportInitialization->TxBuffers.BufferSize );
+
+    LOG_FUNC_START;
+
+    pDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pDevice );
+
+    memzero(pDevice, sizeof(LOOPBACK_DEVICE));
+
+    pDevice->MiniportDevice = MiniportDevice;
+    pDevice->NumberOfRxDescriptors = MiniportInitialization->RxBuffers.NumberOfBuffers;
+    pDevice->NumberOfTxDescriptors = MiniportInitialization->TxBuffers.NumberOfBuffers;
+    pDevice->RxBufferSize = MiniportInitialization->RxBuffers.BufferSize;
+    pDevice->TxBufferSize = MiniportInitialization->TxBuffers.BufferSize;
+
+    LOG("Using %u RX descriptors and %u TX descriptors\n",
+        pDevice->NumberOfRxDescriptors, pDevice->NumberOfTxDescriptors);
+
+    // nobody reads the descriptors, they only mirror the addresses of the
+    // buffers as the ring of a real device would
+    memcpy(MiniportInitialization->RxBuffers.RingBuffer,
+           MiniportInitialization->RxBuffers.Buffers,
+           pDevice->NumberOfRxDescriptors * LOOPBACK_DESCRIPTOR_SIZE);
+    memcpy(MiniportInitialization->TxBuffers.RingBuffer,
+           MiniportInitialization->TxBuffers.Buffers,
+           pDevice->NumberOfTxDescriptors * LOOPBACK_DESCRIPTOR_SIZE);
+
+    // the frames are addressed to the IP of the device, the MAC address only
+    // has to be the same on both sides of the link
+    memzero(&MiniportDevice->PhysicalAddress, sizeof(MAC_ADDRESS));
+
+    MiniportDevice->LinkUp = TRUE;
+    MiniportDevice->DeviceStatus.RxEnabled = TRUE;
+    MiniportDevice->DeviceStatus.TxEnabled = TRUE;
+    MiniportDevice->NumberOfQueues = 1;
+
+    // the stack may skip the checksums of the frames it sends, they are
+    // never verified and reported as good on reception
+    MiniportDevice->OffloadCapabilities.Offloads = NETWORK_OFFLOAD_TX_IP4_CHECKSUM
+                                                 | NETWORK_OFFLOAD_TX_TCP_CHECKSUM
+                                                 | NETWORK_OFFLOAD_TX_UDP_CHECKSUM
+                                                 | NETWORK_OFFLOAD_RX_IP4_CHECKSUM
+                                                 | NETWORK_OFFLOAD_RX_TCP_UDP_CHECKSUM;
+    MiniportDevice->TxOffloadDescriptors = 0;
+
+    LOG_FUNC_END;
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _LoopbackSendBuffers)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfFrames,
+    IN_READS(NumberOfFrames)
+        MINIPORT_TX_FRAME*          Frames
+    )
+{
+    PLOOPBACK_DEVICE pDevice;
+    DWORD curDescriptor;
+    DWORD i;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Frames );
+
+    pDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pDevice );
+
+    curDescriptor = FirstDescriptorIndex;
+
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        if (!MiniportDevice->DeviceStatus.RxEnabled
+            || !_LoopbackDeliverFrame(pDevice, curDescriptor, &Frames[i]))
+        {
+            pDevice->FramesDropped++;
+        }
+
+        // the frame was consumed synchronously => its descriptors can be
+        // reclaimed right away
+        curDescriptor = (curDescriptor + Frames[i].NumberOfDescriptors) % pDevice->NumberOfTxDescriptors;
+        pDevice->TxDescriptorsCompleted += Frames[i].NumberOfDescriptors;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+DWORD
+(__cdecl _LoopbackReclaimTxDescriptors)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  DWORD                       QueueIndex
+    )
+{
+    PLOOPBACK_DEVICE pDevice;
+    DWORD completed;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( 0 == QueueIndex );
+
+    pDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pDevice );
+
+    completed = pDevice->TxDescriptorsCompleted;
+    pDevice->TxDescriptorsCompleted = 0;
+
+    return completed;
+}
+
+static
+void
+(__cdecl _LoopbackChangeDeviceStatus)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  PNETWORK_DEVICE_STATUS      DeviceStatus
+    )
+{
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != DeviceStatus );
+
+    // there is nothing to program, the port driver updates the status of
+    // the device which _LoopbackSendBuffers checks for each frame
+    UNREFERENCED_PARAMETER(MiniportDevice);
+    UNREFERENCED_PARAMETER(DeviceStatus);
+}
+
+static
+void
+(__cdecl _LoopbackGetStatistics)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    INOUT PNETWORK_DEVICE_STATS     Statistics
+    )
+{
+    PLOOPBACK_DEVICE pDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Statistics );
+
+    pDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pDevice );
+
+    Statistics->RxFramesDropped += pDevice->FramesDropped;
+}
+
+static
+BOOLEAN
+_LoopbackDeliverFrame(
+    INOUT       PLOOPBACK_DEVICE        Device,
+    IN          DWORD                   FirstTxDescriptor,
+    IN          PMINIPORT_TX_FRAME      Frame
+    )
+{
+    STATUS status;
+    PBYTE pRxBuffer;
+    DWORD curDescriptor;
+    DWORD bytesLeft;
+    WORD i;
+    PHYSICAL_ADDRESS nextBuffer;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+
+    if (0 == Frame->Length || Frame->Length > Device->RxBufferSize)
+    {
+        return FALSE;
+    }
+
+    pRxBuffer = NetworkPortGetRxBuffer(Device->MiniportDevice, Device->NextRxDescriptor);
+    ASSERT( NULL != pRxBuffer );
+
+    // gather the frame from its TX buffers, all of them are full except for
+    // the last one
+    curDescriptor = FirstTxDescriptor;
+    bytesLeft = Frame->Length;
+    for (i = 0; i < Frame->NumberOfDescriptors; ++i)
+    {
+        DWORD bytesToCopy;
+        PVOID pTxBuffer;
+
+        pTxBuffer = NetworkPortGetTxBuffer(Device->MiniportDevice, curDescriptor);
+        ASSERT( NULL != pTxBuffer );
+
+        bytesToCopy = min(bytesLeft, Device->TxBufferSize);
+
+        memcpy(pRxBuffer + Frame->Length - bytesLeft, pTxBuffer, bytesToCopy);
+        bytesLeft -= bytesToCopy;
+
+        curDescriptor = (curDescriptor + 1) % Device->NumberOfTxDescriptors;
+    }
+    ASSERT( 0 == bytesLeft );
+
+    status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice,
+                                            Device->NextRxDescriptor,
+                                            Frame->Length,
+                                            LOOPBACK_RX_CHECKSUM_STATUS,
+                                            &nextBuffer);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkPortNotifyReceiveBuffer", status);
+        return FALSE;
+    }
+
+    // the port placed the replacement buffer in the ring itself, we reach it
+    // through NetworkPortGetRxBuffer and have no use for its address
+    Device->NextRxDescriptor = (Device->NextRxDescriptor + 1) % Device->NumberOfRxDescriptors;
+
+    return TRUE;
+}
@@ -24,21 +24,113 @@ typedef struct _PORT_BUFFERS
     EX_EVENT                    FramesListNotEmptyEvent;
 
     volatile QWORD              NumberOfFramesTransferred;
+
+    // updated only by the single consumer of the TX buffers, the RX
+    // statistics are kept for each queue in RX_DATA
+    NETWORK_FRAME_STATS         FrameStatistics;
 } PORT_BUFFERS, *PPORT_BUFFERS;
 
+// number of receive buffers allocated for each descriptor of the RX ring,
+// the buffers which are not placed in the ring replace the ones lent to the
+// consumers of the received frames
+#define PORT_RX_BUFFERS_PER_DESCRIPTOR      4
+
+typedef struct _RX_BUFFER
+{
+    // element in the received frames list or in the free list of the pool
+    LIST_ENTRY                  ListEntry;
+
+    NET_LOANED_FRAME            LoanedFrame;
+
+    PVOID                       Data;
+    PHYSICAL_ADDRESS            PhysicalAddress;
+
+    struct _NETWORK_PORT_DEVICE* PortDevice;
+} RX_BUFFER, *PRX_BUFFER;
+
+typedef struct _RX_BUFFER_POOL
+{
+    LOCK                        Lock;
+
+    _Guarded_by_(Lock)
+    LIST_ENTRY                  FreeList;
+
+    _Guarded_by_(Lock)
+    DWORD                       FreeBuffers;
+
+    DWORD                       NumberOfBuffers;
+    PRX_BUFFER                  Buffers;
+
+    // frames dropped because all the spare buffers were lent
+    volatile QWORD              FramesDropped;
+} RX_BUFFER_POOL, *PRX_BUFFER_POOL;
+
 typedef struct _RX_DATA
 {
+    // the frames list holds RX_BUFFER structures
     PORT_BUFFERS                Buffers;
+
+    RX_BUFFER_POOL              Pool;
+
+    // the buffer currently owned by each descriptor of the ring
+    PRX_BUFFER*                 RingBuffers;
+
+    // the ring is split in equal slices, one for each queue, each queue has
+    // a single producer which updates the statistics of its slice
+    DWORD                       NumberOfQueues;
+    DWORD                       DescriptorsPerQueue;
+    NETWORK_FRAME_STATS         QueueStatistics[NETWORK_MAX_QUEUES];
 } RX_DATA, *PRX_DATA;
 
-typedef struct _TX_DATA
+// maximum number of frames handed to the miniport with a single call, the
+// device is notified once for all of them
+#define PORT_TX_MAX_FRAMES_PER_BATCH        64
+
+typedef struct _TX_QUEUE
 {
+    // the buffers of the slice of the ring owned by the queue, the frames
+    // list holds the frames waiting to be sent through this queue
     PORT_BUFFERS                Buffers;
 
+    // index in the whole ring of the first descriptor of the slice
+    DWORD                       FirstDescriptor;
+    DWORD                       QueueIndex;
+
+    // signaled by the miniport when the device finished sending frames, the
+    // transmit thread waits for it only when no descriptor can be reclaimed
     EX_EVENT                    DescriptorsAvailable;
 
     struct _THREAD*             TransmitWorkerThread;
+
+    // the fields below are accessed only by the transmit thread
+
+    // relative to FirstDescriptor
     WORD                        CurrentTxIndex;
+
+    // descriptors known to be free, the ones the device finished with are
+    // reclaimed only after all of these were used. A descriptor is always
+    // kept unused, else a full ring could not be told apart from an empty one
+    DWORD                       FreeDescriptors;
+
+    // number of times the frames were handed to the miniport
+    QWORD                       Batches;
+
+    // TSC cycles spent copying the frames of the batches to the ring and
+    // handing them to the miniport
+    QWORD                       TxCycles;
+
+    struct _NETWORK_PORT_DEVICE* PortDevice;
+} TX_QUEUE, *PTX_QUEUE;
+
+typedef struct _TX_DATA
+{
+    // all the buffers of the ring, the queues use consecutive slices of it
+    PVOID*                      Buffers;
+    DWORD                       NumberOfBuffers;
+    WORD                        BufferSize;
+
+    DWORD                       NumberOfQueues;
+    TX_QUEUE                    Queues[NETWORK_MAX_QUEUES];
 } TX_DATA, *PTX_DATA;
 
 typedef struct _NETWORK_PORT_DEVICE
@@ -52,6 +144,15 @@ typedef struct _NETWORK_PORT_DEVICE
 typedef struct _FRAME_DESCRIPTOR
 {
     DWORD               BufferSize;
+
+    // NETWORK_OFFLOAD_TX_*, the header offsets are valid only if it is not 0,
+    // they have the same meaning as in MINIPORT_TX_FRAME
+    DWORD               Offloads;
+    WORD                NetworkHeaderOffset;
+    WORD                TransportHeaderOffset;
+    WORD                HeadersLength;
+    WORD                MaximumSegmentSize;
+
     BYTE                Buffer[0];
 } FRAME_DESCRIPTOR, *PFRAME_DESCRIPTOR;
 STATIC_ASSERT_INFO(sizeof(FRAME_DESCRIPTOR) == FIELD_OFFSET(FRAME_DESCRIPTOR, Buffer),
@@ -60,7 +161,6 @@ STATIC_ASSERT_INFO(sizeof(FRAME_DESCRIPTOR) == FIELD_OFFSET(FRAME_DESCRIPTOR, Bu
 typedef struct _FRAME_DESCRIPTOR_ENTRY
 {
     LIST_ENTRY          ListEntry;
-    BYTE                __Padding[4];
     FRAME_DESCRIPTOR    Frame;
 } FRAME_DESCRIPTOR_ENTRY, *PFRAME_DESCRIPTOR_ENTRY;
 STATIC_ASSERT_INFO(sizeof(FRAME_DESCRIPTOR_ENTRY) - sizeof(FRAME_DESCRIPTOR) == FIELD_OFFSET(FRAME_DESCRIPTOR_ENTRY, Frame),
@@ -73,6 +173,8 @@ NetworkPortDevicePreinit(
     OUT         PNETWORK_PORT_DEVICE    PortDevice
     );
 
+// The number of queues is taken from MiniportDevice, it must already be
+// initialized
 STATUS
 NetworkPortDeviceInit(
     INOUT       PNETWORK_PORT_DEVICE    PortDevice,
@@ -99,4 +201,27 @@ NetworkPortAllocateFrameDescriptor(
 void
 NetworkPortFreeFrameDescriptor(
     IN          PFRAME_DESCRIPTOR_ENTRY Descriptor
+    );
+
+void
+NetworkPortUpdateFrameStatistics(
+    INOUT       PNETWORK_FRAME_STATS    Statistics,
+    IN          DWORD                   FrameSize
+    );
+
+void
+NetworkPortMergeFrameStatistics(
+    INOUT       PNETWORK_FRAME_STATS    Total,
+    IN          PNETWORK_FRAME_STATS    Statistics
+    );
+
+PTR_SUCCESS
+PRX_BUFFER
+NetworkPortAllocateRxBuffer(
+    INOUT       PNETWORK_PORT_DEVICE    PortDevice
+    );
+
+void
+NetworkPortFreeRxBuffer(
+    IN          PRX_BUFFER              Buffer
     );
\ No newline at end of file
@@ -1,5 +1,17 @@
 #pragma once
 
+#define MINIPORT_MAX_INTERRUPT_VECTORS  8
+
+typedef struct _MINIPORT_INTERRUPT_VECTOR
+{
+    // the entry of the MSI-X table which delivers the vector
+    WORD                            MsiXEntry;
+
+    // if set the vector is delivered only to the CPU with this index
+    BOOLEAN                         TargetCpu;
+    DWORD                           CpuIndex;
+} MINIPORT_INTERRUPT_VECTOR, *PMINIPORT_INTERRUPT_VECTOR;
+
 typedef struct _MINIPORT_DEVICE
 {
     // IN - completed by NetworkPortRegisterMiniportDriver
@@ -12,6 +24,27 @@ typedef struct _MINIPORT_DEVICE
 
     NETWORK_DEVICE_STATUS           DeviceStatus;
     volatile BOOLEAN                LinkUp;
+
+    // OUT - the number of RX/TX queue pairs used, 0 is the same as 1. Each
+    // ring is split in NumberOfQueues slices of equal size, queue i owns the
+    // descriptors [i * N / NumberOfQueues, (i + 1) * N / NumberOfQueues)
+    DWORD                           NumberOfQueues;
+
+    // OUT - optional, if NumberOfInterruptVectors is not 0 the port driver
+    // registers an interrupt for each vector through the MSI-X table mapped
+    // at MsiXTable and calls MiniportVectorInterruptHandler, else it
+    // registers a single interrupt serviced by MiniportInterruptHandler
+    PVOID                           MsiXTable;
+    DWORD                           NumberOfInterruptVectors;
+    MINIPORT_INTERRUPT_VECTOR       InterruptVectors[MINIPORT_MAX_INTERRUPT_VECTORS];
+
+    // OUT - optional, the offloads the device can perform
+    NETWORK_OFFLOAD_CAPABILITIES    OffloadCapabilities;
+
+    // OUT - the number of descriptors which precede the data of a frame
+    // which requests TX offloads, they describe the offloads to the device
+    // and their buffers are not used
+    WORD                            TxOffloadDescriptors;
 } MINIPORT_DEVICE, *PMINIPORT_DEVICE;
 
 typedef struct _MINIPORT_BUFFER_INITIALIZATION
@@ -24,8 +57,12 @@ typedef struct _MINIPORT_BUFFER_INITIALIZATION
 
 typedef struct _MINIPORT_DEVICE_INITIALIZATION
 {
+    // NULL for the virtual devices
     PPCI_BAR                        PciBar;
 
+    // the device has a MSI-X capability => it may ask for multiple vectors
+    BOOLEAN                         MsiXCapable;
+
     MINIPORT_BUFFER_INITIALIZATION  RxBuffers;
     MINIPORT_BUFFER_INITIALIZATION  TxBuffers;
 } MINIPORT_DEVICE_INITIALIZATION, *PMINIPORT_DEVICE_INITIALIZATION;
@@ -47,15 +84,57 @@ STATUS
 
 typedef FUNC_NetworkMiniportUninitializeDevice* PFUNC_NetworkMiniportUninitializeDevice;
 
+typedef struct _MINIPORT_TX_FRAME
+{
+    DWORD                           Length;
+
+    // descriptors used by the frame: the TxOffloadDescriptors ones if any
+    // offload is requested, followed by the ones whose buffers hold the
+    // data, all of them full except for the last one
+    WORD                            NumberOfDescriptors;
+
+    // NETWORK_OFFLOAD_TX_*, the fields below are valid only if it is not 0
+    DWORD                           Offloads;
+
+    // offsets from the start of the frame of the IPv4 and TCP/UDP headers
+    WORD                            NetworkHeaderOffset;
+    WORD                            TransportHeaderOffset;
+
+    // valid only for segmentation, the length of the headers (including
+    // the TCP options) replicated in each segment
+    WORD                            HeadersLength;
+    WORD                            MaximumSegmentSize;
+} MINIPORT_TX_FRAME, *PMINIPORT_TX_FRAME;
+
+// Hands NumberOfFrames frames to the device with a single notification.
+// They occupy consecutive descriptors of the same queue, FirstDescriptorIndex
+// is relative to the start of the whole TX ring and the queue follows from
+// the slice it falls in, the descriptors wrap around at the end of the slice.
+// Different queues may send at the same time, each queue sends from a single
+// thread.
 typedef
 STATUS
-(__cdecl FUNC_NetworkMiniportSendBuffer)(
+(__cdecl FUNC_NetworkMiniportSendBuffers)(
     IN  PMINIPORT_DEVICE            MiniportDevice,
-    IN  WORD                        DesccriptorIndex,
-    IN  WORD                        Length
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfFrames,
+    IN_READS(NumberOfFrames)
+        MINIPORT_TX_FRAME*          Frames
     );
 
-typedef FUNC_NetworkMiniportSendBuffer*         PFUNC_NetworkMiniportSendBuffer;
+typedef FUNC_NetworkMiniportSendBuffers*        PFUNC_NetworkMiniportSendBuffers;
+
+// Returns the number of descriptors of the queue the device finished sending
+// since the previous call, they are reclaimed in the order in which they were
+// sent. Called only by the thread which sends through the queue.
+typedef
+DWORD
+(__cdecl FUNC_NetworkMiniportReclaimTxDescriptors)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  DWORD                       QueueIndex
+    );
+
+typedef FUNC_NetworkMiniportReclaimTxDescriptors* PFUNC_NetworkMiniportReclaimTxDescriptors;
 
 typedef
 BOOLEAN
@@ -65,6 +144,16 @@ BOOLEAN
 
 typedef FUNC_NetworkMiniportInterruptHandler*   PFUNC_NetworkMiniportInterruptHandler;
 
+// Vector is the index of the vector in MINIPORT_DEVICE.InterruptVectors
+typedef
+BOOLEAN
+(__cdecl FUNC_NetworkMiniportVectorInterruptHandler)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  DWORD                       Vector
+    );
+
+typedef FUNC_NetworkMiniportVectorInterruptHandler* PFUNC_NetworkMiniportVectorInterruptHandler;
+
 typedef
 void
 (__cdecl FUNC_NetworkMiniportChangeDeviceStatus)(
@@ -74,22 +163,70 @@ void
 
 typedef FUNC_NetworkMiniportChangeDeviceStatus* PFUNC_NetworkMiniportChangeDeviceStatus;
 
+// Optional, fills in the statistics only the miniport can collect, the port
+// driver completes the frame statistics
+typedef
+void
+(__cdecl FUNC_NetworkMiniportGetStatistics)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    INOUT PNETWORK_DEVICE_STATS     Statistics
+    );
+
+typedef FUNC_NetworkMiniportGetStatistics*      PFUNC_NetworkMiniportGetStatistics;
+
+// Optional, if missing the tuning IOCTLs fail with STATUS_UNSUPPORTED
+typedef
+void
+(__cdecl FUNC_NetworkMiniportGetTuning)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    OUT PNETWORK_DEVICE_TUNING      Tuning
+    );
+
+typedef FUNC_NetworkMiniportGetTuning*          PFUNC_NetworkMiniportGetTuning;
+
+typedef
+STATUS
+(__cdecl FUNC_NetworkMiniportSetTuning)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  PNETWORK_DEVICE_TUNING      Tuning
+    );
+
+typedef FUNC_NetworkMiniportSetTuning*          PFUNC_NetworkMiniportSetTuning;
+
 typedef struct _MINIPORT_FUNCTIONS
 {
     PFUNC_NetworkMiniportInitializeDevice       MiniportInitializeDevice;
 
     PFUNC_NetworkMiniportUninitializeDevice     MiniportUninitializeDevice;
 
-    PFUNC_NetworkMiniportSendBuffer             MiniportSendBuffer;
+    PFUNC_NetworkMiniportSendBuffers            MiniportSendBuffers;
 
+    PFUNC_NetworkMiniportReclaimTxDescriptors   MiniportReclaimTxDescriptors;
+
+    // Optional only for the virtual devices, no interrupt is registered
+    // for them
     PFUNC_NetworkMiniportInterruptHandler       MiniportInterruptHandler;
 
+    // Optional, needed only by the miniports which ask for multiple vectors
+    PFUNC_NetworkMiniportVectorInterruptHandler MiniportVectorInterruptHandler;
+
     PFUNC_NetworkMiniportChangeDeviceStatus     MiniportChangeDeviceStatus;
+
+    PFUNC_NetworkMiniportGetStatistics          MiniportGetStatistics;
+
+    PFUNC_NetworkMiniportGetTuning              MiniportGetTuning;
+
+    PFUNC_NetworkMiniportSetTuning              MiniportSetTuning;
 } MINIPORT_FUNCTIONS, *PMINIPORT_FUNCTIONS;
 
 typedef struct _MINIPORT_BUFFER_DESCRIPTION
 {
+    // the port driver tries to allocate NumberOfBuffers buffers, if there is
+    // not enough continuous memory it halves the number until it reaches
+    // MinimumNumberOfBuffers (0 means no fallback), the number chosen is
+    // given to the miniport in MINIPORT_BUFFER_INITIALIZATION
     DWORD                                       NumberOfBuffers;
+    DWORD                                       MinimumNumberOfBuffers;
     DWORD                                       DescriptorSize;
     WORD                                        BufferSize;
 } MINIPORT_BUFFER_DESCRIPTION, *PMINIPORT_BUFFER_DESCRIPTION;
@@ -98,6 +235,13 @@ typedef struct _MINIPORT_REGISTRATION
 {
     PCI_SPEC                                    Specification;
 
+    // if not 0 the Specification is ignored and NumberOfVirtualDevices
+    // software devices are created instead of binding to PCI devices. They
+    // have no registers and no interrupts, the miniport must complete the
+    // frames from MiniportSendBuffers and reach the data of the buffers
+    // through NetworkPortGetRxBuffer and NetworkPortGetTxBuffer
+    DWORD                                       NumberOfVirtualDevices;
+
     DWORD                                       DeviceContextSize;
 
     MINIPORT_BUFFER_DESCRIPTION                 RxBuffers;
@@ -118,21 +262,49 @@ NetworkPortGetMiniportExtension(
     IN      PMINIPORT_DEVICE        Device
     );
 
+// The virtual address of the buffer currently placed in a descriptor of the
+// RX ring, the index is relative to the start of the whole ring. Meant for
+// the virtual devices, which cannot access the buffers through DMA.
+PTR_SUCCESS
+PVOID
+NetworkPortGetRxBuffer(
+    IN      PMINIPORT_DEVICE        Device,
+    IN      DWORD                   DescriptorIndex
+    );
+
+// Same as NetworkPortGetRxBuffer for the TX ring, the buffers of the TX
+// descriptors never change
+PTR_SUCCESS
+PVOID
+NetworkPortGetTxBuffer(
+    IN      PMINIPORT_DEVICE        Device,
+    IN      DWORD                   DescriptorIndex
+    );
+
+// Hands the buffer of the descriptor up to the consumers without copying it,
+// the descriptor index is relative to the start of the whole ring, not to
+// the slice of the queue which received the frame.
+// NextBuffer receives the physical address of the buffer which must replace
+// it in the descriptor before the descriptor is given back to the device. If
+// no replacement is available the frame is dropped and NextBuffer is the
+// address of the same buffer.
+// ChecksumStatus holds the NETWORK_RX_CHECKSUM_* flags for the checksums the
+// device verified.
 STATUS
 NetworkPortNotifyReceiveBuffer(
     IN                          PMINIPORT_DEVICE        Device,
     IN                          DWORD                   DesciptorIndex,
-    IN                          DWORD                   BufferSize
+    IN                          DWORD                   BufferSize,
+    IN                          DWORD                   ChecksumStatus,
+    OUT                         PHYSICAL_ADDRESS*       NextBuffer
     );
 
+// Called when the device finished sending some of the frames of the queue,
+// wakes up the sender if it waits for descriptors to be reclaimed
 void
 NetworkPortNotifyTxDescriptorAvailable(
-    IN                          PMINIPORT_DEVICE        Device
-    );
-
-void
-NetworkPortNotifyTxQueueFull(
-    IN                          PMINIPORT_DEVICE        Device
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          DWORD                   QueueIndex
     );
 
 void
@@ -1,6 +1,16 @@
 #include "network_port_base.h"
 #include "network_dispatch.h"
 #include "ex.h"
+#include "rtc.h"
+
+static
+STATUS
+_NetDispatchDequeueFrame(
+    INOUT                                   PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       MaximumFrameSize,
+    OUT                                     PRX_BUFFER*                 Buffer,
+    OUT                                     DWORD*                      FrameSize
+    );
 
 static
 STATUS
@@ -13,10 +23,40 @@ _NetDispatchReceiveFrame(
 
 static
 STATUS
-_NetDispatchSendFrame(
+_NetDispatchReceiveFrameReference(
+    INOUT                                   PNETWORK_PORT_DEVICE                Device,
+    OUT                                     PNET_RECEIVE_FRAME_REFERENCE_OUTPUT ReceiveOutput
+    );
+
+static
+STATUS
+_NetDispatchSendFrames(
     INOUT                                   PNETWORK_PORT_DEVICE        Device,
-    IN                                      DWORD                       InputBufferSize,
-    IN_READS_BYTES(InputBufferSize)         PNET_RECEIVE_FRAME_OUTPUT   SendBuffer
+    IN                                      DWORD                       NumberOfFrames,
+    IN_READS(NumberOfFrames)                NET_FRAME_BUFFER*           Frames
+    );
+
+static
+STATUS
+_NetDispatchValidateFrame(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      PNET_FRAME_BUFFER           Frame,
+    OUT                                     PFRAME_DESCRIPTOR           Header
+    );
+
+static
+DWORD
+_NetDispatchSelectTxQueue(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       FrameSize,
+    IN_READS_BYTES(FrameSize)               PETHERNET_FRAME             Frame
+    );
+
+static
+DWORD
+_NetDispatchTxDescriptorsForFrame(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      PFRAME_DESCRIPTOR           Frame
     );
 
 static
@@ -26,6 +66,13 @@ _NetDispatchChangeDeviceStatus(
     IN                                      PNET_GET_SET_DEVICE_STATUS  DeviceStatus
     );
 
+static
+void
+_NetDispatchGetStatistics(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    OUT                                     PNET_GET_DEVICE_STATISTICS  Statistics
+    );
+
 STATUS
 NetPortDeviceControl(
     INOUT       PDEVICE_OBJECT          DeviceObject,
@@ -63,6 +110,18 @@ NetPortDeviceControl(
 
         status = _NetDispatchReceiveFrame(pPortDevice, pStackLocation->Parameters.DeviceControl.OutputBufferLength, pStackLocation->Parameters.DeviceControl.OutputBuffer, &information );
 
+        break;
+    case IOCTL_NET_RECEIVE_FRAME_REFERENCE:
+        information = sizeof(NET_RECEIVE_FRAME_REFERENCE_OUTPUT);
+
+        if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        status = _NetDispatchReceiveFrameReference(pPortDevice, pStackLocation->Parameters.DeviceControl.OutputBuffer);
+
         break;
     case IOCTL_NET_GET_PHYSICAL_ADDRESS:
         information = sizeof(NET_GET_SET_PHYSICAL_ADDRESS);
@@ -76,7 +135,28 @@ NetPortDeviceControl(
         memcpy(pStackLocation->Parameters.DeviceControl.OutputBuffer, &pPortDevice->Miniport->PhysicalAddress, sizeof(MAC_ADDRESS));
         break;
     case IOCTL_NET_SEND_FRAME:
-        status = _NetDispatchSendFrame(pPortDevice, pStackLocation->Parameters.DeviceControl.InputBufferLength, Irp->Buffer );
+        {
+            NET_FRAME_BUFFER frame;
+
+            frame.Frame = Irp->Buffer;
+            frame.Length = pStackLocation->Parameters.DeviceControl.InputBufferLength;
+            frame.Offloads = 0;
+            frame.MaximumSegmentSize = 0;
+
+            status = _NetDispatchSendFrames(pPortDevice, 1, &frame);
+        }
+        break;
+    case IOCTL_NET_SEND_FRAMES:
+        if (pStackLocation->Parameters.DeviceControl.InputBufferLength < sizeof(NET_SEND_FRAMES_INPUT))
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        status = _NetDispatchSendFrames(pPortDevice,
+                                        ((PNET_SEND_FRAMES_INPUT)Irp->Buffer)->NumberOfFrames,
+                                        ((PNET_SEND_FRAMES_INPUT)Irp->Buffer)->Frames
+                                        );
         break;
     case IOCTL_NET_GET_DEVICE_STATUS:
         {
@@ -119,6 +199,75 @@ NetPortDeviceControl(
             pLinkStatus->LinkUp = pPortDevice->Miniport->LinkUp;
         }
         break;
+    case IOCTL_NET_GET_DEVICE_STATISTICS:
+        information = sizeof(NET_GET_DEVICE_STATISTICS);
+
+        if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        _NetDispatchGetStatistics(pPortDevice, pStackLocation->Parameters.DeviceControl.OutputBuffer);
+        break;
+    case IOCTL_NET_GET_DEVICE_TUNING:
+        {
+            PNETWORK_PORT_DRIVER_DATA pDriverExtension = IoGetDriverExtension(DeviceObject);
+            PNET_GET_SET_DEVICE_TUNING pTuning = (PNET_GET_SET_DEVICE_TUNING) pStackLocation->Parameters.DeviceControl.OutputBuffer;
+
+            information = sizeof(NET_GET_SET_DEVICE_TUNING);
+
+            if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            if (NULL == pDriverExtension->MiniportFunctions.MiniportGetTuning)
+            {
+                status = STATUS_UNSUPPORTED;
+                break;
+            }
+
+            pDriverExtension->MiniportFunctions.MiniportGetTuning(pPortDevice->Miniport, &pTuning->Tuning);
+        }
+        break;
+    case IOCTL_NET_SET_DEVICE_TUNING:
+        {
+            PNETWORK_PORT_DRIVER_DATA pDriverExtension = IoGetDriverExtension(DeviceObject);
+
+            information = sizeof(NET_GET_SET_DEVICE_TUNING);
+
+            if (pStackLocation->Parameters.DeviceControl.InputBufferLength < information)
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            if (NULL == pDriverExtension->MiniportFunctions.MiniportSetTuning)
+            {
+                status = STATUS_UNSUPPORTED;
+                break;
+            }
+
+            status = pDriverExtension->MiniportFunctions.MiniportSetTuning(pPortDevice->Miniport,
+                                                                           &((PNET_GET_SET_DEVICE_TUNING)Irp->Buffer)->Tuning
+                                                                           );
+        }
+        break;
+    case IOCTL_NET_GET_OFFLOAD_CAPABILITIES:
+        information = sizeof(NET_GET_OFFLOAD_CAPABILITIES);
+
+        if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        memcpy(&((PNET_GET_OFFLOAD_CAPABILITIES)pStackLocation->Parameters.DeviceControl.OutputBuffer)->Capabilities,
+               &pPortDevice->Miniport->OffloadCapabilities,
+               sizeof(NETWORK_OFFLOAD_CAPABILITIES));
+        break;
     default:
         status = STATUS_UNSUPPORTED;
     }
@@ -137,20 +286,27 @@ STATUS
     IN_OPT      PVOID       Context
     )
 {
+    PTX_QUEUE pQueue;
     PNETWORK_PORT_DEVICE pPortDevice;
     PNETWORK_PORT_DRIVER_DATA pDriverExtension;
     INTR_STATE intrState;
-    PLIST_ENTRY pEntry;
-    BOOLEAN bListEmpty;
+    LIST_ENTRY pendingFrames;
     PFRAME_DESCRIPTOR_ENTRY pDescriptorEntry;
     STATUS status;
+    MINIPORT_TX_FRAME frames[PORT_TX_MAX_FRAMES_PER_BATCH];
+    PMINIPORT_TX_FRAME pTxFrame;
+    WORD noOfFrames;
+    WORD firstTxIndex;
     WORD curTxIndex;
+    DWORD descriptorsNeeded;
+    DWORD offset;
+    DWORD bytesToCopy;
+    QWORD startTicks;
 
     ASSERT( NULL != Context );
 
-    pPortDevice = Context;
-    pEntry = NULL;
-    bListEmpty = FALSE;
+    pQueue = Context;
+    pPortDevice = pQueue->PortDevice;
     status = STATUS_SUCCESS;
     pDriverExtension = NULL;
 
@@ -159,48 +315,105 @@ STATUS
     pDriverExtension = IoGetDriverExtension(pPortDevice->Miniport->DeviceObject);
     ASSERT(NULL != pDriverExtension);
 
+    InitializeListHead(&pendingFrames);
+
 #pragma warning(suppress:4127)
     while (TRUE)
     {
-        pDescriptorEntry = NULL;
+        if (IsListEmpty(&pendingFrames))
+        {
+            // wait to have actual data to send
+            ExEventWaitForSignal(&pQueue->Buffers.FramesListNotEmptyEvent);
 
-        // wait to have actual data to send
-        ExEventWaitForSignal(&pPortDevice->TxData.Buffers.FramesListNotEmptyEvent);
+            // take all the frames queued so far at once, the senders can
+            // continue to queue frames while these are handed to the device
+            LockAcquire(&pQueue->Buffers.FramesLock, &intrState);
+            AppendTailList(&pendingFrames, &pQueue->Buffers.FramesList);
+            ExEventClearSignal(&pQueue->Buffers.FramesListNotEmptyEvent);
+            LockRelease(&pQueue->Buffers.FramesLock, intrState );
 
-        LockAcquire(&pPortDevice->TxData.Buffers.FramesLock, &intrState);
-        pEntry = RemoveHeadList(&pPortDevice->TxData.Buffers.FramesList);
-        bListEmpty = ( pEntry == &pPortDevice->TxData.Buffers.FramesList );
+            continue;
+        }
 
-        if (bListEmpty)
+        // the descriptors the device finished with are reclaimed in bulk only
+        // after the ones known to be free do not suffice for the next frame
+        pDescriptorEntry = CONTAINING_RECORD(pendingFrames.Flink, FRAME_DESCRIPTOR_ENTRY, ListEntry);
+        descriptorsNeeded = _NetDispatchTxDescriptorsForFrame(pPortDevice, &pDescriptorEntry->Frame);
+        if (pQueue->FreeDescriptors < descriptorsNeeded)
         {
-            ExEventClearSignal(&pPortDevice->TxData.Buffers.FramesListNotEmptyEvent);
+            // the event is cleared before reclaiming: if the device finishes
+            // a frame after the descriptors were checked the event is signaled
+            // again and the wait below does not block
+            ExEventClearSignal(&pQueue->DescriptorsAvailable);
+
+            pQueue->FreeDescriptors += pDriverExtension->MiniportFunctions.MiniportReclaimTxDescriptors(pPortDevice->Miniport,
+                                                                                                        pQueue->QueueIndex);
+            ASSERT(pQueue->FreeDescriptors < pQueue->Buffers.NumberOfBuffers);
+
+            if (pQueue->FreeDescriptors < descriptorsNeeded)
+            {
+                ExEventWaitForSignal(&pQueue->DescriptorsAvailable);
+                continue;
+            }
         }
 
-        LockRelease(&pPortDevice->TxData.Buffers.FramesLock, intrState );
+        firstTxIndex = pQueue->CurrentTxIndex;
+        curTxIndex = firstTxIndex;
+        startTicks = RtcGetTickCount();
 
-        if (bListEmpty)
+        for (noOfFrames = 0; noOfFrames < PORT_TX_MAX_FRAMES_PER_BATCH && !IsListEmpty(&pendingFrames); ++noOfFrames)
         {
-            // list is empty :(
-            continue;
-        }
+            pDescriptorEntry = CONTAINING_RECORD(pendingFrames.Flink, FRAME_DESCRIPTOR_ENTRY, ListEntry);
+            descriptorsNeeded = _NetDispatchTxDescriptorsForFrame(pPortDevice, &pDescriptorEntry->Frame);
+            if (pQueue->FreeDescriptors < descriptorsNeeded)
+            {
+                // the frame will start the next batch
+                break;
+            }
+            RemoveHeadList(&pendingFrames);
+
+            pTxFrame = &frames[noOfFrames];
+            pTxFrame->Length = pDescriptorEntry->Frame.BufferSize;
+            pTxFrame->NumberOfDescriptors = (WORD) descriptorsNeeded;
+            pTxFrame->Offloads = pDescriptorEntry->Frame.Offloads;
+            pTxFrame->NetworkHeaderOffset = pDescriptorEntry->Frame.NetworkHeaderOffset;
+            pTxFrame->TransportHeaderOffset = pDescriptorEntry->Frame.TransportHeaderOffset;
+            pTxFrame->HeadersLength = pDescriptorEntry->Frame.HeadersLength;
+            pTxFrame->MaximumSegmentSize = pDescriptorEntry->Frame.MaximumSegmentSize;
+
+            // the buffers of the descriptors which describe the offloads
+            // are not used
+            if (0 != pTxFrame->Offloads)
+            {
+                curTxIndex = (curTxIndex + pPortDevice->Miniport->TxOffloadDescriptors) % pQueue->Buffers.NumberOfBuffers;
+            }
 
-        pDescriptorEntry = CONTAINING_RECORD(pEntry, FRAME_DESCRIPTOR_ENTRY, ListEntry );
-        curTxIndex = pPortDevice->TxData.CurrentTxIndex;
+            for (offset = 0; offset < pDescriptorEntry->Frame.BufferSize; offset += bytesToCopy)
+            {
+                bytesToCopy = min(pDescriptorEntry->Frame.BufferSize - offset, pQueue->Buffers.BufferSize);
 
-        ExEventWaitForSignal(&pPortDevice->TxData.DescriptorsAvailable);
+                memcpy( pQueue->Buffers.Buffers[curTxIndex], pDescriptorEntry->Frame.Buffer + offset, bytesToCopy );
+                curTxIndex = ( curTxIndex + 1 ) % pQueue->Buffers.NumberOfBuffers;
+            }
 
-        ASSERT( pDescriptorEntry->Frame.BufferSize <= MAX_WORD );
-        memcpy( pPortDevice->TxData.Buffers.Buffers[curTxIndex], pDescriptorEntry->Frame.Buffer, pDescriptorEntry->Frame.BufferSize );
+            NetworkPortUpdateFrameStatistics(&pQueue->Buffers.FrameStatistics, pDescriptorEntry->Frame.BufferSize);
+            pQueue->FreeDescriptors -= descriptorsNeeded;
 
-        status = pDriverExtension->MiniportFunctions.MiniportSendBuffer( pPortDevice->Miniport, curTxIndex, (WORD) pDescriptorEntry->Frame.BufferSize );
-        ASSERT(SUCCEEDED(status));
+            NetworkPortFreeFrameDescriptor(pDescriptorEntry);
+            pDescriptorEntry = NULL;
+        }
+        ASSERT( 0 != noOfFrames );
 
-        curTxIndex = ( curTxIndex + 1 ) % pPortDevice->TxData.Buffers.NumberOfBuffers;
-        _InterlockedIncrement64(&pPortDevice->TxData.Buffers.NumberOfFramesTransferred);
-        pPortDevice->TxData.CurrentTxIndex = curTxIndex;
+        status = pDriverExtension->MiniportFunctions.MiniportSendBuffers( pPortDevice->Miniport,
+                                                                          (WORD) (pQueue->FirstDescriptor + firstTxIndex),
+                                                                          noOfFrames,
+                                                                          frames );
+        ASSERT(SUCCEEDED(status));
 
-        NetworkPortFreeFrameDescriptor(pDescriptorEntry);
-        pDescriptorEntry = NULL;
+        pQueue->TxCycles += RtcGetTickCount() - startTicks;
+        pQueue->CurrentTxIndex = curTxIndex;
+        pQueue->Batches++;
+        _InterlockedExchangeAdd64(&pQueue->Buffers.NumberOfFramesTransferred, noOfFrames);
     }
 
     LOG_FUNC_END;
@@ -210,29 +423,28 @@ STATUS
 
 static
 STATUS
-_NetDispatchReceiveFrame(
+_NetDispatchDequeueFrame(
     INOUT                                   PNETWORK_PORT_DEVICE        Device,
-    IN                                      DWORD                       OutputBufferSize,
-    OUT_WRITES_BYTES(OutputBufferSize)      PNET_RECEIVE_FRAME_OUTPUT   ReceiveOutput,
-    OUT                                     QWORD*                      Information
+    IN                                      DWORD                       MaximumFrameSize,
+    OUT                                     PRX_BUFFER*                 Buffer,
+    OUT                                     DWORD*                      FrameSize
     )
 {
     STATUS status;
     INTR_STATE oldState;
     PLIST_ENTRY pListEntry;
     BOOLEAN bListEmpty;
-    PFRAME_DESCRIPTOR_ENTRY pFrame;
+    PRX_BUFFER pRxBuffer;
     DWORD bufferSize;
 
     ASSERT( NULL != Device );
-    ASSERT( OutputBufferSize >= sizeof(NET_RECEIVE_FRAME_OUTPUT) );
-    ASSERT( NULL != ReceiveOutput );
-    ASSERT( NULL != Information );
+    ASSERT( NULL != Buffer );
+    ASSERT( NULL != FrameSize );
 
     status = STATUS_SUCCESS;
     pListEntry = NULL;
     bListEmpty = FALSE;
-    pFrame = NULL;
+    pRxBuffer = NULL;
     bufferSize = 0;
 
 // warning C4127: conditional expression is constant
@@ -246,12 +458,12 @@ _NetDispatchReceiveFrame(
 
         if (!bListEmpty)
         {
-            pFrame = CONTAINING_RECORD(pListEntry, FRAME_DESCRIPTOR_ENTRY, ListEntry);
-            bufferSize = pFrame->Frame.BufferSize;
+            pRxBuffer = CONTAINING_RECORD(pListEntry, RX_BUFFER, ListEntry);
+            bufferSize = pRxBuffer->LoanedFrame.Length;
 
-            if (bufferSize > OutputBufferSize)
+            if (bufferSize > MaximumFrameSize)
             {
-                LOGL("Buffer received of size %u is too small. Required: %u\n", OutputBufferSize, bufferSize );
+                LOGL("Buffer received of size %u is too small. Required: %u\n", MaximumFrameSize, bufferSize );
                 status = STATUS_BUFFER_TOO_SMALL;
             }
             else
@@ -302,40 +514,118 @@ _NetDispatchReceiveFrame(
         }
     }
 
+    // set frame size received/required
+    *FrameSize = bufferSize;
+
+    if (SUCCEEDED(status))
+    {
+        ASSERT(NULL != pRxBuffer);
+        ASSERT(!bListEmpty);
+
+        *Buffer = pRxBuffer;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_NetDispatchReceiveFrame(
+    INOUT                                   PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       OutputBufferSize,
+    OUT_WRITES_BYTES(OutputBufferSize)      PNET_RECEIVE_FRAME_OUTPUT   ReceiveOutput,
+    OUT                                     QWORD*                      Information
+    )
+{
+    STATUS status;
+    PRX_BUFFER pRxBuffer;
+    DWORD bufferSize;
+
+    ASSERT( NULL != Device );
+    ASSERT( OutputBufferSize >= sizeof(NET_RECEIVE_FRAME_OUTPUT) );
+    ASSERT( NULL != ReceiveOutput );
+    ASSERT( NULL != Information );
+
+    pRxBuffer = NULL;
+    bufferSize = 0;
+
+    status = _NetDispatchDequeueFrame(Device, OutputBufferSize, &pRxBuffer, &bufferSize);
+
     // set output buffer size written/required
     *Information = bufferSize;
 
     if (SUCCEEDED(status))
     {
-        ASSERT(NULL != pFrame);
-        ASSERT(!bListEmpty);
+        ASSERT(NULL != pRxBuffer);
+
+        // the caller wants its own copy => the loaned buffer goes straight
+        // back to the receive pool
+        memcpy( &ReceiveOutput->Buffer, pRxBuffer->LoanedFrame.Frame, bufferSize);
+
+        ASSERT( 1 == pRxBuffer->LoanedFrame.ReferenceCount );
+        pRxBuffer->LoanedFrame.ReferenceCount = 0;
+
+        NetworkPortFreeRxBuffer(pRxBuffer);
+        pRxBuffer = NULL;
+    }
+
+    return status;
+}
 
-        memcpy( &ReceiveOutput->Buffer,pFrame->Frame.Buffer, pFrame->Frame.BufferSize);
+static
+STATUS
+_NetDispatchReceiveFrameReference(
+    INOUT                                   PNETWORK_PORT_DEVICE                Device,
+    OUT                                     PNET_RECEIVE_FRAME_REFERENCE_OUTPUT ReceiveOutput
+    )
+{
+    STATUS status;
+    PRX_BUFFER pRxBuffer;
+    DWORD bufferSize;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != ReceiveOutput );
+
+    pRxBuffer = NULL;
+    bufferSize = 0;
 
-        NetworkPortFreeFrameDescriptor(pFrame);
-        pFrame = NULL;
+    status = _NetDispatchDequeueFrame(Device, MAX_DWORD, &pRxBuffer, &bufferSize);
+    if (!SUCCEEDED(status))
+    {
+        return status;
     }
 
+    ASSERT(NULL != pRxBuffer);
+
+    // the reference taken when the frame was received is transferred to the
+    // caller
+    ReceiveOutput->Frame = &pRxBuffer->LoanedFrame;
 
     return status;
 }
 
 static
 STATUS
-_NetDispatchSendFrame(
+_NetDispatchSendFrames(
     INOUT                                   PNETWORK_PORT_DEVICE        Device,
-    IN                                      DWORD                       InputBufferSize,
-    IN_READS_BYTES(InputBufferSize)         PNET_RECEIVE_FRAME_OUTPUT   SendBuffer
+    IN                                      DWORD                       NumberOfFrames,
+    IN_READS(NumberOfFrames)                NET_FRAME_BUFFER*           Frames
     )
 {
     STATUS status;
     PFRAME_DESCRIPTOR_ENTRY pFrameDescriptor;
     INTR_STATE intrState;
     BOOLEAN bListWasEmpty;
+    PTX_QUEUE pQueue;
+    LIST_ENTRY queueFrames[NETWORK_MAX_QUEUES];
+    DWORD i;
 
     ASSERT(NULL != Device);
-    ASSERT(0 != InputBufferSize);
-    ASSERT(NULL != SendBuffer);
+
+    if (0 == NumberOfFrames || NULL == Frames)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
 
     if (!Device->Miniport->LinkUp)
     {
@@ -349,41 +639,207 @@ _NetDispatchSendFrame(
         return STATUS_DEVICE_DISABLED;
     }
 
-    if (InputBufferSize > Device->TxData.Buffers.BufferSize)
-    {
-        LOG_ERROR("Transmit buffer size %u bytes too large for device buffer size of %u bytes\n",
-             InputBufferSize, Device->TxData.Buffers.BufferSize );
-        return STATUS_BUFFER_TOO_LARGE;
-    }
-
     status = STATUS_SUCCESS;
     pFrameDescriptor = NULL;
     bListWasEmpty = FALSE;
 
-    pFrameDescriptor = NetworkPortAllocateFrameDescriptor(InputBufferSize);
-    if (NULL == pFrameDescriptor)
+    for (i = 0; i < NETWORK_MAX_QUEUES; ++i)
     {
-        LOG_FUNC_ERROR_ALLOC("NetworkPortAllocateFrameDescriptor", InputBufferSize);
-        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+        InitializeListHead(&queueFrames[i]);
     }
 
-    pFrameDescriptor->Frame.BufferSize = InputBufferSize;
-    memcpy( pFrameDescriptor->Frame.Buffer, SendBuffer, InputBufferSize);
+    // the frames are sorted by queue first so that each queue is locked and
+    // its transmit thread woken up only once for the whole batch
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        FRAME_DESCRIPTOR header;
 
-    LockAcquire(&Device->TxData.Buffers.FramesLock, &intrState);
-    bListWasEmpty = IsListEmpty(&Device->TxData.Buffers.FramesList);
-    InsertTailList(&Device->TxData.Buffers.FramesList, &pFrameDescriptor->ListEntry);
-    LockRelease(&Device->TxData.Buffers.FramesLock, intrState);
-    pFrameDescriptor = NULL;
+        status = _NetDispatchValidateFrame(Device, &Frames[i], &header);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_NetDispatchValidateFrame", status);
+            break;
+        }
+
+        pFrameDescriptor = NetworkPortAllocateFrameDescriptor(Frames[i].Length);
+        if (NULL == pFrameDescriptor)
+        {
+            LOG_FUNC_ERROR_ALLOC("NetworkPortAllocateFrameDescriptor", Frames[i].Length);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        memcpy( &pFrameDescriptor->Frame, &header, sizeof(FRAME_DESCRIPTOR));
+        memcpy( pFrameDescriptor->Frame.Buffer, Frames[i].Frame, Frames[i].Length);
 
-    if (bListWasEmpty)
+        // all the frames of a flow go through the same queue so that they
+        // leave in the order in which they were sent
+        InsertTailList(&queueFrames[_NetDispatchSelectTxQueue(Device, Frames[i].Length, Frames[i].Frame)],
+                       &pFrameDescriptor->ListEntry);
+        pFrameDescriptor = NULL;
+    }
+
+    for (i = 0; i < Device->TxData.NumberOfQueues; ++i)
     {
-        ExEventSignal(&Device->TxData.Buffers.FramesListNotEmptyEvent);
+        if (IsListEmpty(&queueFrames[i]))
+        {
+            continue;
+        }
+
+        if (!SUCCEEDED(status))
+        {
+            while (!IsListEmpty(&queueFrames[i]))
+            {
+                NetworkPortFreeFrameDescriptor(CONTAINING_RECORD(RemoveHeadList(&queueFrames[i]), FRAME_DESCRIPTOR_ENTRY, ListEntry));
+            }
+            continue;
+        }
+
+        pQueue = &Device->TxData.Queues[i];
+
+        LockAcquire(&pQueue->Buffers.FramesLock, &intrState);
+        bListWasEmpty = IsListEmpty(&pQueue->Buffers.FramesList);
+        AppendTailList(&pQueue->Buffers.FramesList, &queueFrames[i]);
+        LockRelease(&pQueue->Buffers.FramesLock, intrState);
+
+        if (bListWasEmpty)
+        {
+            ExEventSignal(&pQueue->Buffers.FramesListNotEmptyEvent);
+        }
     }
 
     return status;
 }
 
+static
+STATUS
+_NetDispatchValidateFrame(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      PNET_FRAME_BUFFER           Frame,
+    OUT                                     PFRAME_DESCRIPTOR           Header
+    )
+{
+    PNETWORK_OFFLOAD_CAPABILITIES pCapabilities;
+    PIP4_PACKET pIpPacket;
+    PTCP_SEGMENT pTcpSegment;
+    DWORD maxLength;
+    DWORD ipHeaderLength;
+    DWORD transportHeaderLength;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Frame);
+    ASSERT(NULL != Header);
+
+    if (NULL == Frame->Frame || 0 == Frame->Length)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (0 != (Frame->Offloads & ~NETWORK_OFFLOAD_TX_MASK))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pCapabilities = &Device->Miniport->OffloadCapabilities;
+    if ((Frame->Offloads & pCapabilities->Offloads) != Frame->Offloads)
+    {
+        LOG_ERROR("Offloads 0x%x requested, the device supports only 0x%x\n",
+                  Frame->Offloads, pCapabilities->Offloads);
+        return STATUS_UNSUPPORTED;
+    }
+
+    memzero(Header, sizeof(FRAME_DESCRIPTOR));
+    Header->BufferSize = Frame->Length;
+
+    maxLength = IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_SEGMENTATION)
+        ? pCapabilities->MaximumSegmentationSize
+        : Device->TxData.BufferSize;
+    if (Frame->Length > maxLength)
+    {
+        LOG_ERROR("Transmit buffer size %u bytes too large, maximum size is %u bytes\n",
+                  Frame->Length, maxLength);
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    if (0 == Frame->Offloads)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // the offsets of the headers are found once here, the miniport only
+    // copies them in its descriptors
+    if (Frame->Length < sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET) ||
+        NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4) != Frame->Frame->Type)
+    {
+        LOG_ERROR("Offloads can only be requested for IPv4 frames\n");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pIpPacket = (PIP4_PACKET) Frame->Frame->Data;
+    ipHeaderLength = pIpPacket->InternetHeaderLength * sizeof(DWORD);
+    if (ipHeaderLength < sizeof(IP4_PACKET) ||
+        Frame->Length < sizeof(ETHERNET_FRAME) + ipHeaderLength)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    transportHeaderLength = 0;
+    if (IsFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_CHECKSUM | NETWORK_OFFLOAD_TX_TCP_SEGMENTATION))
+    {
+        if (IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_UDP_CHECKSUM) ||
+            IP_PROTOCOL_TCP != pIpPacket->Protocol ||
+            Frame->Length < sizeof(ETHERNET_FRAME) + ipHeaderLength + sizeof(TCP_SEGMENT))
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        pTcpSegment = (PTCP_SEGMENT) ((PBYTE) pIpPacket + ipHeaderLength);
+        transportHeaderLength = pTcpSegment->DataOffset * sizeof(DWORD);
+        if (transportHeaderLength < sizeof(TCP_SEGMENT) ||
+            Frame->Length < sizeof(ETHERNET_FRAME) + ipHeaderLength + transportHeaderLength)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+    else if (IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_UDP_CHECKSUM))
+    {
+        if (IP_PROTOCOL_UDP != pIpPacket->Protocol ||
+            Frame->Length < sizeof(ETHERNET_FRAME) + ipHeaderLength + sizeof(UDP_DATAGRAM))
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        transportHeaderLength = sizeof(UDP_DATAGRAM);
+    }
+
+    if (IsBooleanFlagOn(Frame->Offloads, NETWORK_OFFLOAD_TX_TCP_SEGMENTATION))
+    {
+        // each segment must fit in a device buffer
+        if (0 == Frame->MaximumSegmentSize ||
+            sizeof(ETHERNET_FRAME) + ipHeaderLength + transportHeaderLength + Frame->MaximumSegmentSize > Device->TxData.BufferSize)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        Header->MaximumSegmentSize = Frame->MaximumSegmentSize;
+    }
+
+    Header->Offloads = Frame->Offloads;
+    Header->NetworkHeaderOffset = sizeof(ETHERNET_FRAME);
+    Header->TransportHeaderOffset = (WORD) (sizeof(ETHERNET_FRAME) + ipHeaderLength);
+    Header->HeadersLength = (WORD) (sizeof(ETHERNET_FRAME) + ipHeaderLength + transportHeaderLength);
+
+    // the whole frame must fit in the slice of a queue, a descriptor of
+    // which is always kept unused
+    if (_NetDispatchTxDescriptorsForFrame(Device, Header) >= Device->TxData.Queues[0].Buffers.NumberOfBuffers)
+    {
+        LOG_ERROR("Frame of %u bytes needs more descriptors than a queue has\n", Frame->Length);
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 STATUS
 _NetDispatchChangeDeviceStatus(
@@ -415,4 +871,115 @@ _NetDispatchChangeDeviceStatus(
     LOG_FUNC_END;
 
     return status;
+}
+
+static
+void
+_NetDispatchGetStatistics(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    OUT                                     PNET_GET_DEVICE_STATISTICS  Statistics
+    )
+{
+    PNETWORK_PORT_DRIVER_DATA pDriverExtension;
+    DWORD i;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Statistics);
+
+    pDriverExtension = IoGetDriverExtension(Device->Miniport->DeviceObject);
+    ASSERT(NULL != pDriverExtension);
+
+    memzero(Statistics, sizeof(NET_GET_DEVICE_STATISTICS));
+
+    ASSERT(Device->RxData.NumberOfQueues == Device->TxData.NumberOfQueues);
+
+    Statistics->Statistics.NumberOfQueues = Device->TxData.NumberOfQueues;
+    for (i = 0; i < Statistics->Statistics.NumberOfQueues; ++i)
+    {
+        PNETWORK_QUEUE_STATS pQueueStats = &Statistics->Statistics.QueueStats[i];
+
+        memcpy(&pQueueStats->RxStats, &Device->RxData.QueueStatistics[i], sizeof(NETWORK_FRAME_STATS));
+        memcpy(&pQueueStats->TxStats, &Device->TxData.Queues[i].Buffers.FrameStatistics, sizeof(NETWORK_FRAME_STATS));
+
+        NetworkPortMergeFrameStatistics(&Statistics->Statistics.RxStats, &pQueueStats->RxStats);
+        NetworkPortMergeFrameStatistics(&Statistics->Statistics.TxStats, &pQueueStats->TxStats);
+
+        Statistics->Statistics.TxBatches += Device->TxData.Queues[i].Batches;
+        Statistics->Statistics.TxCycles += Device->TxData.Queues[i].TxCycles;
+    }
+    Statistics->Statistics.RxFramesDropped = Device->RxData.Pool.FramesDropped;
+
+    if (NULL != pDriverExtension->MiniportFunctions.MiniportGetStatistics)
+    {
+        pDriverExtension->MiniportFunctions.MiniportGetStatistics(Device->Miniport,
+                                                                  &Statistics->Statistics
+                                                                  );
+    }
+}
+
+static
+DWORD
+_NetDispatchSelectTxQueue(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       FrameSize,
+    IN_READS_BYTES(FrameSize)               PETHERNET_FRAME             Frame
+    )
+{
+    PIP4_PACKET pIpPacket;
+    PORT_NUMBER* pPorts;
+    DWORD headerLength;
+    DWORD hash;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Frame);
+
+    if (Device->TxData.NumberOfQueues <= 1)
+    {
+        return 0;
+    }
+
+    // only IPv4 traffic is spread, everything else goes through the first queue
+    if (FrameSize < sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET) ||
+        NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4) != Frame->Type)
+    {
+        return 0;
+    }
+
+    pIpPacket = (PIP4_PACKET) Frame->Data;
+    headerLength = pIpPacket->InternetHeaderLength * sizeof(DWORD);
+
+    hash = pIpPacket->Source.DwordAddress ^ pIpPacket->Destination.DwordAddress;
+    if ((IP_PROTOCOL_TCP == pIpPacket->Protocol || IP_PROTOCOL_UDP == pIpPacket->Protocol) &&
+        FrameSize >= sizeof(ETHERNET_FRAME) + headerLength + 2 * sizeof(PORT_NUMBER))
+    {
+        // both TCP and UDP headers start with the source and destination ports
+        pPorts = (PORT_NUMBER*) ((PBYTE) pIpPacket + headerLength);
+        hash ^= ((DWORD) pPorts[0] << 16) | pPorts[1];
+    }
+
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+
+    return hash % Device->TxData.NumberOfQueues;
+}
+
+static
+DWORD
+_NetDispatchTxDescriptorsForFrame(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      PFRAME_DESCRIPTOR           Frame
+    )
+{
+    DWORD noOfDescriptors;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Frame);
+
+    noOfDescriptors = (Frame->BufferSize + Device->TxData.BufferSize - 1) / Device->TxData.BufferSize;
+    if (0 != Frame->Offloads)
+    {
+        noOfDescriptors += Device->Miniport->TxOffloadDescriptors;
+    }
+
+    return noOfDescriptors;
 }
\ No newline at end of file
@@ -5,28 +5,31 @@ STATUS
 NetworkPortNotifyReceiveBuffer(
     IN                          PMINIPORT_DEVICE        Device,
     IN                          DWORD                   DesciptorIndex,
-    IN                          DWORD                   BufferSize
+    IN                          DWORD                   BufferSize,
+    IN                          DWORD                   ChecksumStatus,
+    OUT                         PHYSICAL_ADDRESS*       NextBuffer
     )
 {
-    STATUS status;
     PDEVICE_OBJECT pDevObject;
     PNETWORK_PORT_DEVICE pPortDevice;
     INTR_STATE oldState;
-    PLIST_ENTRY pListEntry;
-    PFRAME_DESCRIPTOR_ENTRY pFrameDescriptor;
     BOOLEAN bListWasEmpty;
-    PVOID pReceiveBuffer;
+    PRX_BUFFER pReceivedBuffer;
+    PRX_BUFFER pReplacementBuffer;
 
     ASSERT( NULL != Device );
     ASSERT( 0 != BufferSize );
 
-    status = STATUS_SUCCESS;
-    pListEntry = NULL;
     pDevObject = NULL;
     pPortDevice = NULL;
-    pFrameDescriptor = NULL;
     bListWasEmpty = FALSE;
-    pReceiveBuffer = NULL;
+    pReceivedBuffer = NULL;
+    pReplacementBuffer = NULL;
+
+    if (NULL == NextBuffer)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
 
     pDevObject = Device->DeviceObject;
     ASSERT( NULL != pDevObject );
@@ -44,23 +47,32 @@ NetworkPortNotifyReceiveBuffer(
         return STATUS_INVALID_PARAMETER3;
     }
 
-    pFrameDescriptor = NetworkPortAllocateFrameDescriptor(BufferSize);
-    if (NULL == pFrameDescriptor)
+    pReceivedBuffer = pPortDevice->RxData.RingBuffers[DesciptorIndex];
+    ASSERT( NULL != pReceivedBuffer );
+
+    pReplacementBuffer = NetworkPortAllocateRxBuffer(pPortDevice);
+    if (NULL == pReplacementBuffer)
     {
-        LOG_FUNC_ERROR_ALLOC("NetworkPortAllocateFrameDescriptor", BufferSize);
-        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+        // all the spare buffers are lent to consumers which did not return
+        // them yet => the frame is dropped and the descriptor keeps its buffer
+        *NextBuffer = pReceivedBuffer->PhysicalAddress;
+        _InterlockedIncrement64(&pPortDevice->RxData.Pool.FramesDropped);
+        return STATUS_SUCCESS;
     }
 
-    pFrameDescriptor->Frame.BufferSize = BufferSize;
-    pReceiveBuffer = pPortDevice->RxData.Buffers.Buffers[DesciptorIndex];
-    ASSERT( NULL != pReceiveBuffer );
+    pPortDevice->RxData.RingBuffers[DesciptorIndex] = pReplacementBuffer;
+    *NextBuffer = pReplacementBuffer->PhysicalAddress;
 
-    memcpy( pFrameDescriptor->Frame.Buffer, pReceiveBuffer, BufferSize );
+    // the frame is not copied, the buffer in which the device placed it is
+    // lent to the consumer which will dequeue it
+    pReceivedBuffer->LoanedFrame.Length = BufferSize;
+    pReceivedBuffer->LoanedFrame.ChecksumStatus = ChecksumStatus;
+    pReceivedBuffer->LoanedFrame.ReferenceCount = 1;
 
     LockAcquire(&pPortDevice->RxData.Buffers.FramesLock, &oldState);
 
     bListWasEmpty = IsListEmpty(&pPortDevice->RxData.Buffers.FramesList);
-    InsertTailList(&pPortDevice->RxData.Buffers.FramesList, &pFrameDescriptor->ListEntry);
+    InsertTailList(&pPortDevice->RxData.Buffers.FramesList, &pReceivedBuffer->ListEntry);
 
     LockRelease(&pPortDevice->RxData.Buffers.FramesLock, oldState);
 
@@ -72,12 +84,18 @@ NetworkPortNotifyReceiveBuffer(
 
     _InterlockedIncrement64(&pPortDevice->RxData.Buffers.NumberOfFramesTransferred);
 
-    return status;
+    // each queue is drained by a single thread => the statistics of the
+    // queue need no lock
+    NetworkPortUpdateFrameStatistics(&pPortDevice->RxData.QueueStatistics[DesciptorIndex / pPortDevice->RxData.DescriptorsPerQueue],
+                                     BufferSize);
+
+    return STATUS_SUCCESS;
 }
 
 void
 NetworkPortNotifyTxDescriptorAvailable(
-    IN                          PMINIPORT_DEVICE        Device
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          DWORD                   QueueIndex
     )
 {
     PNETWORK_PORT_DEVICE pPortDevice;
@@ -93,45 +111,68 @@ NetworkPortNotifyTxDescriptorAvailable(
     pPortDevice = IoGetDeviceExtension(pDevObject);
     ASSERT(NULL != pPortDevice);
 
-    ExEventSignal(&pPortDevice->TxData.DescriptorsAvailable);
+    ASSERT(QueueIndex < pPortDevice->TxData.NumberOfQueues);
+
+    ExEventSignal(&pPortDevice->TxData.Queues[QueueIndex].DescriptorsAvailable);
 
     LOG_FUNC_END;
 }
 
 void
-NetworkPortNotifyTxQueueFull(
-    IN                          PMINIPORT_DEVICE        Device
+NetworkPortNotifyLinkStatusChange(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BOOLEAN                 LinkUp
     )
 {
-    PNETWORK_PORT_DEVICE pPortDevice;
-    PDEVICE_OBJECT pDevObject;
-
     ASSERT(NULL != Device);
 
     LOG_FUNC_START;
 
-    pDevObject = Device->DeviceObject;
-    ASSERT(NULL != pDevObject);
+    _InterlockedExchange8(&Device->LinkUp, LinkUp);
 
-    pPortDevice = IoGetDeviceExtension(pDevObject);
+    LOG_FUNC_END;
+}
+
+PTR_SUCCESS
+PVOID
+NetworkPortGetRxBuffer(
+    IN      PMINIPORT_DEVICE        Device,
+    IN      DWORD                   DescriptorIndex
+    )
+{
+    PNETWORK_PORT_DEVICE pPortDevice;
+
+    ASSERT(NULL != Device);
+
+    pPortDevice = IoGetDeviceExtension(Device->DeviceObject);
     ASSERT(NULL != pPortDevice);
 
-    ExEventClearSignal(&pPortDevice->TxData.DescriptorsAvailable);
+    if (DescriptorIndex >= pPortDevice->RxData.Buffers.NumberOfBuffers)
+    {
+        return NULL;
+    }
 
-    LOG_FUNC_END;
+    return pPortDevice->RxData.RingBuffers[DescriptorIndex]->Data;
 }
 
-void
-NetworkPortNotifyLinkStatusChange(
-    IN                          PMINIPORT_DEVICE        Device,
-    IN                          BOOLEAN                 LinkUp
+PTR_SUCCESS
+PVOID
+NetworkPortGetTxBuffer(
+    IN      PMINIPORT_DEVICE        Device,
+    IN      DWORD                   DescriptorIndex
     )
 {
+    PNETWORK_PORT_DEVICE pPortDevice;
+
     ASSERT(NULL != Device);
 
-    LOG_FUNC_START;
+    pPortDevice = IoGetDeviceExtension(Device->DeviceObject);
+    ASSERT(NULL != pPortDevice);
 
-    _InterlockedExchange8(&Device->LinkUp, LinkUp);
+    if (DescriptorIndex >= pPortDevice->TxData.NumberOfBuffers)
+    {
+        return NULL;
+    }
 
-    LOG_FUNC_END;
+    return pPortDevice->TxData.Buffers[DescriptorIndex];
 }
\ No newline at end of file
@@ -4,18 +4,21 @@
 #include "ex.h"
 
 static FUNC_InterruptFunction   _NetworkPortGenericInterrupt;
+static FUNC_InterruptFunctionEx _NetworkPortVectorInterrupt;
 
 __forceinline
 BOOLEAN
 _NetworkPortValidateMiniportFunctions(
-    IN      PMINIPORT_FUNCTIONS     MiniportFunctions
+    IN      PMINIPORT_FUNCTIONS     MiniportFunctions,
+    IN      BOOLEAN                 VirtualDevices
     )
 {
     ASSERT( NULL != MiniportFunctions );
 
     if ((NULL == MiniportFunctions->MiniportInitializeDevice)   ||
-        (NULL == MiniportFunctions->MiniportSendBuffer)         ||
-        (NULL == MiniportFunctions->MiniportInterruptHandler)   ||
+        (NULL == MiniportFunctions->MiniportSendBuffers)        ||
+        (NULL == MiniportFunctions->MiniportReclaimTxDescriptors) ||
+        (!VirtualDevices && NULL == MiniportFunctions->MiniportInterruptHandler) ||
         (NULL == MiniportFunctions->MiniportChangeDeviceStatus)
         )
     {
@@ -35,7 +38,8 @@ _NetworkPortValidateBufferDescription(
 
     if ((0 == BufferDescription->NumberOfBuffers) ||
         (0 == BufferDescription->DescriptorSize) ||
-        (0 == BufferDescription->BufferSize)
+        (0 == BufferDescription->BufferSize) ||
+        (BufferDescription->MinimumNumberOfBuffers > BufferDescription->NumberOfBuffers)
         )
     {
         return FALSE;
@@ -49,7 +53,7 @@ STATUS
 _NetworkPortConfigureDevice(
     IN                          PDRIVER_OBJECT          DriverObject,
     IN                          PMINIPORT_REGISTRATION  MiniportRegistration,
-    IN                          PPCI_DEVICE_DESCRIPTION PciDevice,
+    IN_OPT                      PPCI_DEVICE_DESCRIPTION PciDevice,
     OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers)
                                 PHYSICAL_ADDRESS*       RxPhysicalAddresses,
     OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers)
@@ -66,6 +70,17 @@ _NetworkPortInitializeMiniportBuffers(
     OUT_PTR PVOID*                                          DescriptorArray
     );
 
+static
+STATUS
+_NetworkPortChooseMiniportBuffers(
+    IN      PMINIPORT_BUFFER_DESCRIPTION                    BufferDescription,
+    OUT_WRITES_ALL(BufferDescription->NumberOfBuffers)
+            PHYSICAL_ADDRESS*                               PhysicalAddresses,
+    OUT_PTR PVOID**                                         BufferArray,
+    OUT_PTR PVOID*                                          DescriptorArray,
+    OUT     DWORD*                                          NumberOfBuffers
+    );
+
 STATUS
 NetworkPortRegisterMiniportDriver(
     IN      PDRIVER_OBJECT          DriverObject,
@@ -102,7 +117,8 @@ NetworkPortRegisterMiniportDriver(
         return STATUS_INVALID_BUFFER;
     }
 
-    if (!_NetworkPortValidateMiniportFunctions(&MiniportRegistration->MiniportFunctions))
+    if (!_NetworkPortValidateMiniportFunctions(&MiniportRegistration->MiniportFunctions,
+                                               0 != MiniportRegistration->NumberOfVirtualDevices))
     {
         return STATUS_INVALID_FUNCTION;
     }
@@ -123,14 +139,21 @@ NetworkPortRegisterMiniportDriver(
 
     __try
     {
-        status = IoGetPciDevicesMatchingSpecification(MiniportRegistration->Specification,
-                                                      &pPciDevices,
-                                                      &noOfDevices
-        );
-        if (!SUCCEEDED(status))
+        if (0 != MiniportRegistration->NumberOfVirtualDevices)
         {
-            LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
-            __leave;
+            noOfDevices = MiniportRegistration->NumberOfVirtualDevices;
+        }
+        else
+        {
+            status = IoGetPciDevicesMatchingSpecification(MiniportRegistration->Specification,
+                                                          &pPciDevices,
+                                                          &noOfDevices
+            );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
+                __leave;
+            }
         }
 
         ASSERT(NULL == DriverObject->DriverExtension);
@@ -176,7 +199,7 @@ NetworkPortRegisterMiniportDriver(
             // configure current PCI device
             status = _NetworkPortConfigureDevice(DriverObject,
                                                  MiniportRegistration,
-                                                 pPciDevices[i],
+                                                 NULL != pPciDevices ? pPciDevices[i] : NULL,
                                                  pRxPhysicalAddresses,
                                                  pTxPhysicalAddresses
             );
@@ -186,11 +209,18 @@ NetworkPortRegisterMiniportDriver(
                 continue;
             }
 
-            LOGL("Successfully configured network device found on PCI location (%u.%u.%u)\n",
-                 pPciDevices[i]->DeviceLocation.Bus,
-                 pPciDevices[i]->DeviceLocation.Device,
-                 pPciDevices[i]->DeviceLocation.Function
-            );
+            if (NULL != pPciDevices)
+            {
+                LOGL("Successfully configured network device found on PCI location (%u.%u.%u)\n",
+                     pPciDevices[i]->DeviceLocation.Bus,
+                     pPciDevices[i]->DeviceLocation.Device,
+                     pPciDevices[i]->DeviceLocation.Function
+                );
+            }
+            else
+            {
+                LOGL("Successfully configured virtual network device %u\n", i);
+            }
 
             // if we're here => we successfully initialized the device
             noOfDevicesInitialized = noOfDevicesInitialized + 1;
@@ -242,7 +272,7 @@ NetworkPortRegisterMiniportDriver(
         }
 
         // if we initialized at least a device we can say we did our job :)
-        status = noOfDevicesInitialized > 1 ? STATUS_SUCCESS : STATUS_DEVICE_DOES_NOT_EXIST;
+        status = noOfDevicesInitialized >= 1 ? STATUS_SUCCESS : STATUS_DEVICE_DOES_NOT_EXIST;
 
         if (!SUCCEEDED(status))
         {
@@ -275,7 +305,7 @@ STATUS
 _NetworkPortConfigureDevice(
     IN                          PDRIVER_OBJECT          DriverObject,
     IN                          PMINIPORT_REGISTRATION  MiniportRegistration,
-    IN                          PPCI_DEVICE_DESCRIPTION PciDevice,
+    IN_OPT                      PPCI_DEVICE_DESCRIPTION PciDevice,
     OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers)
                                 PHYSICAL_ADDRESS*       RxPhysicalAddresses,
     OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers)
@@ -289,12 +319,17 @@ _NetworkPortConfigureDevice(
     PMINIPORT_DEVICE pMiniportDevice;
     PVOID* pRxBuffers;
     PVOID* pTxBuffers;
+    DWORD noOfRxBuffers;
+    DWORD noOfTxBuffers;
     DWORD i;
     IO_INTERRUPT ioInterrupt;
+    PPCI_CAPABILITY_HEADER pMsiXCapability;
 
     ASSERT( NULL != DriverObject );
     ASSERT( NULL != MiniportRegistration );
-    ASSERT( NULL != PciDevice );
+
+    // only the virtual devices are not backed by a PCI device
+    ASSERT( (NULL == PciDevice) == (0 != MiniportRegistration->NumberOfVirtualDevices) );
 
     status = STATUS_SUCCESS;
     memzero(&initialization, sizeof(MINIPORT_DEVICE_INITIALIZATION));
@@ -303,7 +338,10 @@ _NetworkPortConfigureDevice(
     pMiniportDevice= NULL;
     pRxBuffers = NULL;
     pTxBuffers = NULL;
+    noOfRxBuffers = 0;
+    noOfTxBuffers = 0;
     memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+    pMsiXCapability = NULL;
 
     __try
     {
@@ -344,35 +382,45 @@ _NetworkPortConfigureDevice(
             }
         }
 
-        status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->RxBuffers,
-                                                       RxPhysicalAddresses,
-                                                       &pRxBuffers,
-                                                       &initialization.RxBuffers.RingBuffer
+        status = _NetworkPortChooseMiniportBuffers(&MiniportRegistration->RxBuffers,
+                                                   RxPhysicalAddresses,
+                                                   &pRxBuffers,
+                                                   &initialization.RxBuffers.RingBuffer,
+                                                   &noOfRxBuffers
         );
         if (!SUCCEEDED(status))
         {
-            LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
+            LOG_FUNC_ERROR("_NetworkPortChooseMiniportBuffers", status);
             __leave;
         }
 
-        status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->TxBuffers,
-                                                       TxPhysicalAddresses,
-                                                       &pTxBuffers,
-                                                       &initialization.TxBuffers.RingBuffer
+        status = _NetworkPortChooseMiniportBuffers(&MiniportRegistration->TxBuffers,
+                                                   TxPhysicalAddresses,
+                                                   &pTxBuffers,
+                                                   &initialization.TxBuffers.RingBuffer,
+                                                   &noOfTxBuffers
         );
         if (!SUCCEEDED(status))
         {
-            LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
+            LOG_FUNC_ERROR("_NetworkPortChooseMiniportBuffers", status);
             __leave;
         }
 
-        initialization.PciBar = PciDevice->DeviceData->Header.Device.Bar;
+        LOG_TRACE_NETWORK("Will use %u RX buffers and %u TX buffers\n", noOfRxBuffers, noOfTxBuffers);
 
-        initialization.RxBuffers.NumberOfBuffers = MiniportRegistration->RxBuffers.NumberOfBuffers;
+        if (NULL != PciDevice)
+        {
+            initialization.PciBar = PciDevice->DeviceData->Header.Device.Bar;
+            initialization.MsiXCapable = SUCCEEDED(PciDevRetrieveCapabilityById(PciDevice->DeviceData,
+                                                                                PCI_CAPABILITY_ID_MSIX,
+                                                                                &pMsiXCapability));
+        }
+
+        initialization.RxBuffers.NumberOfBuffers = noOfRxBuffers;
         initialization.RxBuffers.Buffers = RxPhysicalAddresses;
         initialization.RxBuffers.BufferSize = MiniportRegistration->RxBuffers.BufferSize;
 
-        initialization.TxBuffers.NumberOfBuffers = MiniportRegistration->TxBuffers.NumberOfBuffers;
+        initialization.TxBuffers.NumberOfBuffers = noOfTxBuffers;
         initialization.TxBuffers.Buffers = TxPhysicalAddresses;
         initialization.TxBuffers.BufferSize = MiniportRegistration->TxBuffers.BufferSize;
 
@@ -391,10 +439,10 @@ _NetworkPortConfigureDevice(
         // initialize port device
         status = NetworkPortDeviceInit(pPortDevice,
                                        pMiniportDevice,
-                                       MiniportRegistration->RxBuffers.NumberOfBuffers,
+                                       noOfRxBuffers,
                                        pRxBuffers,
                                        MiniportRegistration->RxBuffers.BufferSize,
-                                       MiniportRegistration->TxBuffers.NumberOfBuffers,
+                                       noOfTxBuffers,
                                        pTxBuffers,
                                        MiniportRegistration->TxBuffers.BufferSize
         );
@@ -404,17 +452,61 @@ _NetworkPortConfigureDevice(
             __leave;
         }
 
-        // register interrupt
-        ioInterrupt.Type = IoInterruptTypePci;
-        ioInterrupt.Irql = IrqlNetworkLevel;
-        ioInterrupt.ServiceRoutine = _NetworkPortGenericInterrupt;
-        ioInterrupt.Exclusive = FALSE;
-        ioInterrupt.Pci.PciDevice = PciDevice;
+        if (NULL == PciDevice)
+        {
+            // a virtual device completes its frames synchronously
+            ASSERT(0 == pMiniportDevice->NumberOfInterruptVectors);
+        }
+        else if (0 != pMiniportDevice->NumberOfInterruptVectors)
+        {
+            ASSERT(NULL != MiniportRegistration->MiniportFunctions.MiniportVectorInterruptHandler);
+            ASSERT(NULL != pMiniportDevice->MsiXTable);
+            ASSERT(pMiniportDevice->NumberOfInterruptVectors <= MINIPORT_MAX_INTERRUPT_VECTORS);
 
-        status = IoRegisterInterrupt(&ioInterrupt, pDevObj);
-        ASSERT(SUCCEEDED(status));
+            // register an interrupt for each MSI-X vector the miniport uses,
+            // the context received by the ISR is the index of the vector
+            for (i = 0; i < pMiniportDevice->NumberOfInterruptVectors; ++i)
+            {
+                PMINIPORT_INTERRUPT_VECTOR pVector = &pMiniportDevice->InterruptVectors[i];
+
+                memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+
+                ioInterrupt.Type = IoInterruptTypePci;
+                ioInterrupt.Irql = IrqlNetworkLevel;
+                ioInterrupt.ServiceRoutineEx = _NetworkPortVectorInterrupt;
+                ioInterrupt.ServiceContext = (PVOID) (QWORD) i;
+                ioInterrupt.Exclusive = TRUE;
+                ioInterrupt.TargetCpu = pVector->TargetCpu;
+                ioInterrupt.CpuIndex = pVector->CpuIndex;
+                ioInterrupt.Pci.PciDevice = PciDevice;
+                ioInterrupt.Pci.MsiXTable = pMiniportDevice->MsiXTable;
+                ioInterrupt.Pci.MsiXEntry = pVector->MsiXEntry;
+
+                status = IoRegisterInterrupt(&ioInterrupt, pDevObj);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+                    __leave;
+                }
+            }
+
+            LOG_TRACE_NETWORK("Successfully registered %u MSI-X interrupts for network device\n",
+                              pMiniportDevice->NumberOfInterruptVectors);
+        }
+        else
+        {
+            // register interrupt
+            ioInterrupt.Type = IoInterruptTypePci;
+            ioInterrupt.Irql = IrqlNetworkLevel;
+            ioInterrupt.ServiceRoutine = _NetworkPortGenericInterrupt;
+            ioInterrupt.Exclusive = FALSE;
+            ioInterrupt.Pci.PciDevice = PciDevice;
 
-        LOG_TRACE_NETWORK("Successfully registered interrupt for network device\n");
+            status = IoRegisterInterrupt(&ioInterrupt, pDevObj);
+            ASSERT(SUCCEEDED(status));
+
+            LOG_TRACE_NETWORK("Successfully registered interrupt for network device\n");
+        }
     }
     __finally
     {
@@ -446,7 +538,7 @@ _NetworkPortConfigureDevice(
 
             if (NULL != pRxBuffers)
             {
-                for (i = 0; i < MiniportRegistration->RxBuffers.NumberOfBuffers; ++i)
+                for (i = 0; i < noOfRxBuffers; ++i)
                 {
                     if (NULL != pRxBuffers[i])
                     {
@@ -461,7 +553,7 @@ _NetworkPortConfigureDevice(
 
             if (NULL != pTxBuffers)
             {
-                for (i = 0; i < MiniportRegistration->TxBuffers.NumberOfBuffers; ++i)
+                for (i = 0; i < noOfTxBuffers; ++i)
                 {
                     if (NULL != pTxBuffers[i])
                     {
@@ -570,6 +662,54 @@ _NetworkPortInitializeMiniportBuffers(
     return status;
 }
 
+static
+STATUS
+_NetworkPortChooseMiniportBuffers(
+    IN      PMINIPORT_BUFFER_DESCRIPTION                    BufferDescription,
+    OUT_WRITES_ALL(BufferDescription->NumberOfBuffers)
+            PHYSICAL_ADDRESS*                               PhysicalAddresses,
+    OUT_PTR PVOID**                                         BufferArray,
+    OUT_PTR PVOID*                                          DescriptorArray,
+    OUT     DWORD*                                          NumberOfBuffers
+    )
+{
+    STATUS status;
+    MINIPORT_BUFFER_DESCRIPTION description;
+    DWORD minimumNumberOfBuffers;
+
+    ASSERT( NULL != BufferDescription );
+    ASSERT( NULL != NumberOfBuffers );
+
+    memcpy(&description, BufferDescription, sizeof(MINIPORT_BUFFER_DESCRIPTION));
+    minimumNumberOfBuffers = (0 != BufferDescription->MinimumNumberOfBuffers) ?
+                                BufferDescription->MinimumNumberOfBuffers : BufferDescription->NumberOfBuffers;
+
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        status = _NetworkPortInitializeMiniportBuffers(&description,
+                                                       PhysicalAddresses,
+                                                       BufferArray,
+                                                       DescriptorArray
+                                                       );
+        if (SUCCEEDED(status) || description.NumberOfBuffers / 2 < minimumNumberOfBuffers)
+        {
+            break;
+        }
+
+        LOG_WARNING("Could not allocate %u buffers of %u bytes, will retry with half of them\n",
+                    description.NumberOfBuffers, description.BufferSize);
+        description.NumberOfBuffers = description.NumberOfBuffers / 2;
+    }
+
+    if (SUCCEEDED(status))
+    {
+        *NumberOfBuffers = description.NumberOfBuffers;
+    }
+
+    return status;
+}
+
 static
 BOOLEAN
 (__cdecl _NetworkPortGenericInterrupt)(
@@ -594,4 +734,28 @@ BOOLEAN
     ASSERT( NULL != pDriverExtension->MiniportFunctions.MiniportInterruptHandler);
 
     return pDriverExtension->MiniportFunctions.MiniportInterruptHandler( pMiniportDevice );
+}
+
+static
+BOOLEAN
+(__cdecl _NetworkPortVectorInterrupt)(
+    IN      PDEVICE_OBJECT  Device,
+    IN_OPT  PVOID           Context
+    )
+{
+    PNETWORK_PORT_DEVICE pPortDevice;
+    PNETWORK_PORT_DRIVER_DATA pDriverExtension;
+
+    ASSERT(NULL != Device);
+
+    pPortDevice = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPortDevice);
+    ASSERT(NULL != pPortDevice->Miniport);
+
+    pDriverExtension = IoGetDriverExtension( Device );
+    ASSERT( NULL != pDriverExtension );
+
+    ASSERT( NULL != pDriverExtension->MiniportFunctions.MiniportVectorInterruptHandler);
+
+    return pDriverExtension->MiniportFunctions.MiniportVectorInterruptHandler( pPortDevice->Miniport, (DWORD) (QWORD) Context );
 }
\ No newline at end of file
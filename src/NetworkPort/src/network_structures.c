@@ -33,10 +33,14 @@ _NetworkPortDeviceInitBuffers(
     PortBuffers->BufferSize = BufferSize;
 }
 
+static FUNC_NetFrameFree         _NetworkPortRxFrameFree;
+
 static
 STATUS
 _NetworkPortDeviceInitRx(
     INOUT       PRX_DATA                RxData,
+    IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          DWORD                   NumberOfQueues,
     IN          DWORD                   NumberOfReceiveBuffers,
     IN          PVOID*                  ReceiveBuffers,
     IN          WORD                    ReceiveBufferSize
@@ -47,6 +51,7 @@ STATUS
 _NetworkPortDeviceInitTx(
     INOUT       PTX_DATA                TxData,
     IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          DWORD                   NumberOfQueues,
     IN          DWORD                   NumberOfTransmitBuffers,
     IN          PVOID*                  TransmitBuffers,
     IN          WORD                    TransmitBufferSize
@@ -57,12 +62,21 @@ NetworkPortDevicePreinit(
     OUT         PNETWORK_PORT_DEVICE    PortDevice
     )
 {
+    DWORD i;
+
     ASSERT( NULL != PortDevice );
 
     memzero(PortDevice, sizeof(NETWORK_PORT_DEVICE));
 
     _NetworkPortPreinitBuffers(&PortDevice->RxData.Buffers);
-    _NetworkPortPreinitBuffers(&PortDevice->TxData.Buffers);
+
+    for (i = 0; i < NETWORK_MAX_QUEUES; ++i)
+    {
+        _NetworkPortPreinitBuffers(&PortDevice->TxData.Queues[i].Buffers);
+    }
+
+    LockInit(&PortDevice->RxData.Pool.Lock);
+    InitializeListHead(&PortDevice->RxData.Pool.FreeList);
 }
 
 STATUS
@@ -78,6 +92,7 @@ NetworkPortDeviceInit(
     )
 {
     STATUS status;
+    DWORD noOfQueues;
 
     if (NULL == PortDevice)
     {
@@ -120,10 +135,23 @@ NetworkPortDeviceInit(
     }
 
     status = STATUS_SUCCESS;
+    noOfQueues = (0 != MiniportDevice->NumberOfQueues) ? MiniportDevice->NumberOfQueues : 1;
+
+    // each queue must receive an equal slice of both rings
+    if (noOfQueues > NETWORK_MAX_QUEUES
+        || 0 != NumberOfReceiveBuffers % noOfQueues
+        || 0 != NumberOfTransmitBuffers % noOfQueues)
+    {
+        LOG_ERROR("Cannot split %u RX and %u TX buffers in %u queues\n",
+                  NumberOfReceiveBuffers, NumberOfTransmitBuffers, noOfQueues);
+        return STATUS_INVALID_PARAMETER2;
+    }
 
     PortDevice->Miniport = MiniportDevice;
 
     status = _NetworkPortDeviceInitRx(&PortDevice->RxData,
+                                      PortDevice,
+                                      noOfQueues,
                                       NumberOfReceiveBuffers,
                                       ReceiveBuffers,
                                       ReceiveBufferSize
@@ -136,6 +164,7 @@ NetworkPortDeviceInit(
 
     status = _NetworkPortDeviceInitTx(&PortDevice->TxData,
                                       PortDevice,
+                                      noOfQueues,
                                       NumberOfTransmitBuffers,
                                       TransmitBuffers,
                                       TransmitBufferSize
@@ -185,16 +214,41 @@ NetworkPortDeviceUninit(
         pMiniportDevice = NULL;
     }
 
+    if (NULL != PortDevice->RxData.Pool.Buffers)
+    {
+        DWORD i;
+
+        // the first buffers of the pool are the ones given to the miniport at
+        // initialization, only the spare buffers were allocated by us
+        for (i = PortDevice->RxData.Buffers.NumberOfBuffers; i < PortDevice->RxData.Pool.NumberOfBuffers; ++i)
+        {
+            if (NULL != PortDevice->RxData.Pool.Buffers[i].Data)
+            {
+                IoFreeContinuousMemory(PortDevice->RxData.Pool.Buffers[i].Data);
+                PortDevice->RxData.Pool.Buffers[i].Data = NULL;
+            }
+        }
+
+        ExFreePoolWithTag(PortDevice->RxData.Pool.Buffers, HEAP_PORT_TAG);
+        PortDevice->RxData.Pool.Buffers = NULL;
+    }
+
+    if (NULL != PortDevice->RxData.RingBuffers)
+    {
+        ExFreePoolWithTag(PortDevice->RxData.RingBuffers, HEAP_PORT_TAG);
+        PortDevice->RxData.RingBuffers = NULL;
+    }
+
     if (NULL != PortDevice->RxData.Buffers.Buffers)
     {
         ExFreePoolWithTag(PortDevice->RxData.Buffers.Buffers, HEAP_PORT_TAG);
         PortDevice->RxData.Buffers.Buffers = NULL;
     }
 
-    if (NULL != PortDevice->TxData.Buffers.Buffers)
+    if (NULL != PortDevice->TxData.Buffers)
     {
-        ExFreePoolWithTag(PortDevice->TxData.Buffers.Buffers, HEAP_PORT_TAG);
-        PortDevice->TxData.Buffers.Buffers = NULL;
+        ExFreePoolWithTag(PortDevice->TxData.Buffers, HEAP_PORT_TAG);
+        PortDevice->TxData.Buffers = NULL;
     }
 
     memzero(PortDevice, sizeof(NETWORK_PORT_DEVICE));
@@ -221,20 +275,122 @@ NetworkPortFreeFrameDescriptor(
     ExFreePoolWithTag(Descriptor, HEAP_PORT_TAG);
 }
 
+void
+NetworkPortUpdateFrameStatistics(
+    INOUT       PNETWORK_FRAME_STATS    Statistics,
+    IN          DWORD                   FrameSize
+    )
+{
+    ASSERT( NULL != Statistics );
+
+    if (0 == Statistics->NumberOfFrames || FrameSize < Statistics->SmallestPacket)
+    {
+        Statistics->SmallestPacket = FrameSize;
+    }
+
+    if (FrameSize > Statistics->LargestPacket)
+    {
+        Statistics->LargestPacket = FrameSize;
+    }
+
+    Statistics->NumberOfFrames = Statistics->NumberOfFrames + 1;
+    Statistics->TotalBytes = Statistics->TotalBytes + FrameSize;
+}
+
+void
+NetworkPortMergeFrameStatistics(
+    INOUT       PNETWORK_FRAME_STATS    Total,
+    IN          PNETWORK_FRAME_STATS    Statistics
+    )
+{
+    ASSERT( NULL != Total );
+    ASSERT( NULL != Statistics );
+
+    if (0 == Statistics->NumberOfFrames)
+    {
+        return;
+    }
+
+    if (0 == Total->NumberOfFrames || Statistics->SmallestPacket < Total->SmallestPacket)
+    {
+        Total->SmallestPacket = Statistics->SmallestPacket;
+    }
+
+    if (Statistics->LargestPacket > Total->LargestPacket)
+    {
+        Total->LargestPacket = Statistics->LargestPacket;
+    }
+
+    Total->NumberOfFrames = Total->NumberOfFrames + Statistics->NumberOfFrames;
+    Total->TotalBytes = Total->TotalBytes + Statistics->TotalBytes;
+}
+
+PTR_SUCCESS
+PRX_BUFFER
+NetworkPortAllocateRxBuffer(
+    INOUT       PNETWORK_PORT_DEVICE    PortDevice
+    )
+{
+    PRX_BUFFER_POOL pPool;
+    PLIST_ENTRY pEntry;
+    INTR_STATE oldState;
+
+    ASSERT( NULL != PortDevice );
+
+    pPool = &PortDevice->RxData.Pool;
+
+    LockAcquire(&pPool->Lock, &oldState);
+    pEntry = RemoveHeadList(&pPool->FreeList);
+    if (pEntry != &pPool->FreeList)
+    {
+        ASSERT( 0 != pPool->FreeBuffers );
+        pPool->FreeBuffers = pPool->FreeBuffers - 1;
+    }
+    LockRelease(&pPool->Lock, oldState);
+
+    return (pEntry != &pPool->FreeList) ? CONTAINING_RECORD(pEntry, RX_BUFFER, ListEntry) : NULL;
+}
+
+void
+NetworkPortFreeRxBuffer(
+    IN          PRX_BUFFER              Buffer
+    )
+{
+    PRX_BUFFER_POOL pPool;
+    INTR_STATE oldState;
+
+    ASSERT( NULL != Buffer );
+    ASSERT( NULL != Buffer->PortDevice );
+
+    pPool = &Buffer->PortDevice->RxData.Pool;
+
+    LockAcquire(&pPool->Lock, &oldState);
+    InsertTailList(&pPool->FreeList, &Buffer->ListEntry);
+    pPool->FreeBuffers = pPool->FreeBuffers + 1;
+    ASSERT( pPool->FreeBuffers <= pPool->NumberOfBuffers );
+    LockRelease(&pPool->Lock, oldState);
+}
+
 static
 STATUS
 _NetworkPortDeviceInitRx(
     INOUT       PRX_DATA                RxData,
+    IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          DWORD                   NumberOfQueues,
     IN          DWORD                   NumberOfReceiveBuffers,
     IN          PVOID*                  ReceiveBuffers,
     IN          WORD                    ReceiveBufferSize
     )
 {
     STATUS status;
+    DWORD noOfPoolBuffers;
+    DWORD i;
 
     ASSERT( NULL != RxData );
+    ASSERT( NULL != PortDevice );
 
     status = STATUS_SUCCESS;
+    noOfPoolBuffers = NumberOfReceiveBuffers * PORT_RX_BUFFERS_PER_DESCRIPTOR;
 
     _NetworkPortDeviceInitBuffers(&RxData->Buffers,
                                   NumberOfReceiveBuffers,
@@ -242,6 +398,65 @@ _NetworkPortDeviceInitRx(
                                   ReceiveBufferSize
                                   );
 
+    RxData->NumberOfQueues = NumberOfQueues;
+    RxData->DescriptorsPerQueue = NumberOfReceiveBuffers / NumberOfQueues;
+
+    RxData->RingBuffers = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                sizeof(PRX_BUFFER) * NumberOfReceiveBuffers,
+                                                HEAP_PORT_TAG,
+                                                0
+                                                );
+    if (NULL == RxData->RingBuffers)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PRX_BUFFER) * NumberOfReceiveBuffers);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    RxData->Pool.Buffers = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                 sizeof(RX_BUFFER) * noOfPoolBuffers,
+                                                 HEAP_PORT_TAG,
+                                                 0
+                                                 );
+    if (NULL == RxData->Pool.Buffers)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(RX_BUFFER) * noOfPoolBuffers);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    RxData->Pool.NumberOfBuffers = noOfPoolBuffers;
+
+    for (i = 0; i < noOfPoolBuffers; ++i)
+    {
+        PRX_BUFFER pBuffer = &RxData->Pool.Buffers[i];
+
+        if (i < NumberOfReceiveBuffers)
+        {
+            // the buffers the miniport already placed in its ring
+            pBuffer->Data = ReceiveBuffers[i];
+            RxData->RingBuffers[i] = pBuffer;
+        }
+        else
+        {
+            pBuffer->Data = IoAllocateContinuousMemory(ReceiveBufferSize);
+            if (NULL == pBuffer->Data)
+            {
+                LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", ReceiveBufferSize);
+                return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            }
+        }
+
+        pBuffer->PhysicalAddress = IoGetPhysicalAddress(pBuffer->Data);
+        ASSERT( NULL != pBuffer->PhysicalAddress );
+
+        pBuffer->PortDevice = PortDevice;
+        pBuffer->LoanedFrame.Frame = pBuffer->Data;
+        pBuffer->LoanedFrame.FreeRoutine = _NetworkPortRxFrameFree;
+
+        if (i >= NumberOfReceiveBuffers)
+        {
+            NetworkPortFreeRxBuffer(pBuffer);
+        }
+    }
+
     status = ExEventInit(&RxData->Buffers.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
     if (!SUCCEEDED(status))
     {
@@ -257,48 +472,87 @@ STATUS
 _NetworkPortDeviceInitTx(
     INOUT       PTX_DATA                TxData,
     IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          DWORD                   NumberOfQueues,
     IN          DWORD                   NumberOfTransmitBuffers,
     IN          PVOID*                  TransmitBuffers,
     IN          WORD                    TransmitBufferSize
     )
 {
     STATUS status;
+    DWORD buffersPerQueue;
+    DWORD i;
 
     ASSERT(NULL != TxData);
+    ASSERT(0 != NumberOfQueues && NumberOfQueues <= NETWORK_MAX_QUEUES);
 
     status = STATUS_SUCCESS;
+    buffersPerQueue = NumberOfTransmitBuffers / NumberOfQueues;
 
-    _NetworkPortDeviceInitBuffers(&TxData->Buffers,
-                                  NumberOfTransmitBuffers,
-                                  TransmitBuffers,
-                                  TransmitBufferSize
-                                  );
+    TxData->Buffers = TransmitBuffers;
+    TxData->NumberOfBuffers = NumberOfTransmitBuffers;
+    TxData->BufferSize = TransmitBufferSize;
+    TxData->NumberOfQueues = NumberOfQueues;
 
-    status = ExEventInit(&TxData->Buffers.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
-    if (!SUCCEEDED(status))
+    for (i = 0; i < NumberOfQueues; ++i)
     {
-        LOG_FUNC_ERROR("ExEventInit", status);
-        return status;
-    }
+        PTX_QUEUE pQueue = &TxData->Queues[i];
 
-    status = ExEventInit(&TxData->DescriptorsAvailable, ExEventTypeNotification, TRUE);
-    if (!SUCCEEDED(status))
-    {
-        LOG_FUNC_ERROR("ExEventInit", status);
-        return status;
-    }
+        pQueue->PortDevice = PortDevice;
+        pQueue->QueueIndex = i;
+        pQueue->FirstDescriptor = i * buffersPerQueue;
 
-    status = ThreadCreate("TX worker thread",
-                          ThreadPriorityDefault,
-                          NetPortTransmitFunction,
-                          PortDevice,
-                          &PortDevice->TxData.TransmitWorkerThread
-                          );
-    if (!SUCCEEDED(status))
-    {
-        LOG_FUNC_ERROR("ThreadCreate", status);
-        return status;
+        _NetworkPortDeviceInitBuffers(&pQueue->Buffers,
+                                      buffersPerQueue,
+                                      &TransmitBuffers[pQueue->FirstDescriptor],
+                                      TransmitBufferSize
+                                      );
+
+        ASSERT(buffersPerQueue > 1);
+        pQueue->CurrentTxIndex = 0;
+        pQueue->FreeDescriptors = buffersPerQueue - 1;
+
+        status = ExEventInit(&pQueue->Buffers.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            return status;
+        }
+
+        status = ExEventInit(&pQueue->DescriptorsAvailable, ExEventTypeNotification, TRUE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            return status;
+        }
+
+        status = ThreadCreate("TX worker thread",
+                              ThreadPriorityDefault,
+                              NetPortTransmitFunction,
+                              pQueue,
+                              &pQueue->TransmitWorkerThread
+                              );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ThreadCreate", status);
+            return status;
+        }
     }
 
     return status;
+}
+
+static
+void
+(__cdecl _NetworkPortRxFrameFree)(
+    INOUT   struct _NET_LOANED_FRAME*   Frame
+    )
+{
+    PRX_BUFFER pBuffer;
+
+    ASSERT( NULL != Frame );
+    ASSERT( 0 == Frame->ReferenceCount );
+
+    pBuffer = CONTAINING_RECORD(Frame, RX_BUFFER, LoanedFrame);
+
+    NetworkPortFreeRxBuffer(pBuffer);
 }
\ No newline at end of file
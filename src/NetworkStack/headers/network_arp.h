@@ -0,0 +1,33 @@
+#pragma once
+
+// an entry which was not confirmed in this interval is considered stale
+#define NET_ARP_ENTRY_LIFETIME_US           (60 * SEC_IN_US)
+
+#define NET_ARP_RETRANSMIT_INTERVAL_US      (250 * MS_IN_US)
+#define NET_ARP_RESOLVE_TIMEOUT_US          (1 * SEC_IN_US)
+
+void
+NetArpCacheInit(
+    OUT         PNET_ARP_CACHE          Cache
+    );
+
+// Finds the physical address of a host on the subnet of the device. If the
+// address is not cached an ARP request is broadcast and, only if Wait is
+// set, the function waits for the reply. The receive thread of the device
+// must never wait, it is the one which processes the replies.
+STATUS
+NetArpResolve(
+    IN          PNETWORK_DEVICE         Device,
+    IN          IP4_ADDRESS             Address,
+    IN          BOOLEAN                 Wait,
+    OUT         PMAC_ADDRESS            PhysicalAddress
+    );
+
+// Called by the receive thread of the device for each ARP packet
+void
+NetArpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN_READS_BYTES(Length)
+                PARP_PACKET             Packet,
+    IN          DWORD                   Length
+    );
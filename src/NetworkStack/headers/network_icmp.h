@@ -0,0 +1,13 @@
+#pragma once
+
+// the identifiers of the echo requests we send, one for each pending slot
+#define NET_ICMP_ECHO_IDENTIFIER_BASE       0x4800
+
+void
+NetIcmpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    );
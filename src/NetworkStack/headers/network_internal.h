@@ -1,7 +1,36 @@
 #pragma once
 
 #include "lock_common.h"
+#include "hash_table.h"
+#include "ex_event.h"
 #include "network_device.h"
+#include "network.h"
+#include "rtc.h"
+
+#define NET_ARP_CACHE_SETS              16
+#define NET_ARP_CACHE_WAYS              4
+
+typedef struct _NET_ARP_ENTRY
+{
+    IP4_ADDRESS                 Address;
+    MAC_ADDRESS                 PhysicalAddress;
+    BOOLEAN                     Valid;
+
+    // the entry is discarded NET_ARP_ENTRY_LIFETIME_US after this moment
+    QWORD                       UpdateTimeUs;
+} NET_ARP_ENTRY, *PNET_ARP_ENTRY;
+
+// Set associative cache, an address can only be placed in one of the
+// NET_ARP_CACHE_WAYS entries of its set => a lookup never walks more than
+// a few entries and the cache never has to allocate memory
+typedef struct _NET_ARP_CACHE
+{
+    // taken shared by the senders, exclusively by the receive thread
+    RW_SPINLOCK                 Lock;
+
+    _Guarded_by_(Lock)
+    NET_ARP_ENTRY               Entries[NET_ARP_CACHE_SETS][NET_ARP_CACHE_WAYS];
+} NET_ARP_CACHE, *PNET_ARP_CACHE;
 
 typedef struct _NETWORK_DEVICE
 {
@@ -9,8 +38,238 @@ typedef struct _NETWORK_DEVICE
     LIST_ENTRY                  NextDevice;
 
     NETWORK_DEVICE_INFO         Info;
+
+    NET_ARP_CACHE               ArpCache;
+
+    // identification of the next IPv4 packet sent
+    volatile DWORD              NextIp4Id;
+
+    // consumes the frames received by the device once it has an IPv4
+    // address and hands them to the protocol layer
+    PTHREAD                     ReceiveThread;
 } NETWORK_DEVICE, *PNETWORK_DEVICE;
 
+#define NET_UDP_ENDPOINT_QUEUE_SIZE     32
+
+typedef struct _NET_UDP_QUEUED_DATAGRAM
+{
+    // the datagram is not copied, the frame is released when the datagram
+    // is received or dropped
+    PNET_LOANED_FRAME           Frame;
+    PBYTE                       Data;
+    WORD                        Length;
+
+    IP4_ADDRESS                 Source;
+    PORT_NUMBER                 SourcePort;
+} NET_UDP_QUEUED_DATAGRAM, *PNET_UDP_QUEUED_DATAGRAM;
+
+typedef struct _NET_UDP_ENDPOINT
+{
+    HASH_ENTRY                  HashEntry;
+
+    // in host byte order
+    PORT_NUMBER                 LocalPort;
+
+    LOCK                        QueueLock;
+
+    _Guarded_by_(QueueLock)
+    DWORD                       QueueHead;
+
+    _Guarded_by_(QueueLock)
+    DWORD                       QueueCount;
+
+    _Guarded_by_(QueueLock)
+    NET_UDP_QUEUED_DATAGRAM     Queue[NET_UDP_ENDPOINT_QUEUE_SIZE];
+
+    // datagrams dropped because the queue was full
+    _Guarded_by_(QueueLock)
+    QWORD                       DatagramsDropped;
+
+    EX_EVENT                    DatagramAvailable;
+} NET_UDP_ENDPOINT, *PNET_UDP_ENDPOINT;
+
+#define NET_ICMP_MAX_PENDING_ECHOES     8
+
+typedef struct _NET_ICMP_PENDING_ECHO
+{
+    // the slot is claimed with an interlocked operation, its index
+    // identifies the echo requests sent with it
+    volatile BYTE               InUse;
+
+    WORD                        SequenceNumber;
+
+    volatile BYTE               ReplyReceived;
+    QWORD                       ReplyTimeUs;
+} NET_ICMP_PENDING_ECHO, *PNET_ICMP_PENDING_ECHO;
+
+typedef enum _NET_TCP_STATE
+{
+    NetTcpStateClosed,
+    NetTcpStateSynSent,
+    NetTcpStateSynReceived,
+    NetTcpStateEstablished,
+    NetTcpStateFinWait1,
+    NetTcpStateFinWait2,
+    NetTcpStateCloseWait,
+    NetTcpStateClosing,
+    NetTcpStateLastAck,
+    NetTcpStateTimeWait
+} NET_TCP_STATE;
+
+// The key of a connection, the ports are in host byte order
+typedef struct _NET_TCP_TUPLE
+{
+    IP4_ADDRESS                 LocalAddress;
+    IP4_ADDRESS                 RemoteAddress;
+    PORT_NUMBER                 LocalPort;
+    PORT_NUMBER                 RemotePort;
+} NET_TCP_TUPLE, *PNET_TCP_TUPLE;
+
+typedef struct _NET_TCP_LISTENER
+{
+    HASH_ENTRY                  HashEntry;
+
+    // in host byte order
+    PORT_NUMBER                 LocalPort;
+
+    // the listener is referenced by its handle and by each connection
+    // which was not yet accepted
+    REF_COUNT                   RefCnt;
+
+    DWORD                       Backlog;
+
+    LOCK                        Lock;
+
+    // established connections waiting to be accepted
+    _Guarded_by_(Lock)
+    LIST_ENTRY                  AcceptQueue;
+
+    // connections in the accept queue or still in their handshake
+    _Guarded_by_(Lock)
+    DWORD                       PendingConnections;
+
+    _Guarded_by_(Lock)
+    BOOLEAN                     Closed;
+
+    EX_EVENT                    ConnectionAvailable;
+} NET_TCP_LISTENER, *PNET_TCP_LISTENER;
+
+typedef struct _NET_TCP_CONNECTION
+{
+    HASH_ENTRY                  HashEntry;
+    NET_TCP_TUPLE               Tuple;
+
+    // all the connections in the hash table, walked by the timer thread
+    LIST_ENTRY                  ConnectionListEntry;
+
+    // used only by the timer thread to collect the expired connections
+    LIST_ENTRY                  TimerListEntry;
+
+    // the connection is referenced by the hash table and by its handle, it
+    // leaves the table once it reaches the closed state
+    REF_COUNT                   RefCnt;
+
+    // guarded by the TcpLock of the stack
+    BOOLEAN                     Unlinked;
+
+    PNETWORK_DEVICE             Device;
+
+    // the listener which created a passive connection, it is referenced
+    // for the whole lifetime of the connection
+    PNET_TCP_LISTENER           Listener;
+
+    _Guarded_by_(Listener->Lock)
+    LIST_ENTRY                  AcceptListEntry;
+
+    _Guarded_by_(Listener->Lock)
+    BOOLEAN                     InAcceptQueue;
+
+    _Guarded_by_(Listener->Lock)
+    BOOLEAN                     Accepted;
+
+    LOCK                        Lock;
+
+    _Guarded_by_(Lock)
+    NET_TCP_STATE               State;
+
+    // the reason for which the connection was aborted
+    _Guarded_by_(Lock)
+    STATUS                      Error;
+
+    _Guarded_by_(Lock)
+    BOOLEAN                     HandleClosed;
+
+    // send sequence space, RFC 793
+    DWORD                       Iss;
+    DWORD                       SndUna;
+    DWORD                       SndNxt;
+
+    // the highest sequence number sent, SndNxt goes back to SndUna when
+    // the retransmission timer expires
+    DWORD                       SndMax;
+    DWORD                       SndWnd;
+    DWORD                       SndWl1;
+    DWORD                       SndWl2;
+    BYTE                        SndWndShift;
+
+    // receive sequence space
+    DWORD                       Irs;
+    DWORD                       RcvNxt;
+    BYTE                        RcvWndShift;
+
+    // right edge of the last window advertised
+    DWORD                       RcvAdv;
+
+    // maximum segment size accepted by the peer
+    WORD                        Mss;
+
+    // circular buffers, the first byte of the send buffer is at SndUna
+    PBYTE                       SendBuffer;
+    DWORD                       SendHead;
+    DWORD                       SendBytes;
+
+    PBYTE                       ReceiveBuffer;
+    DWORD                       ReceiveHead;
+    DWORD                       ReceiveBytes;
+
+    BOOLEAN                     FinQueued;
+    BOOLEAN                     FinAcked;
+    BOOLEAN                     FinReceived;
+
+    // an ACK must be sent as soon as possible
+    BOOLEAN                     AckPending;
+
+    // a zero window is probed with a single byte
+    BOOLEAN                     ProbeWindow;
+
+    // NewReno congestion control, RFC 5681 and RFC 6582
+    DWORD                       Cwnd;
+    DWORD                       Ssthresh;
+    DWORD                       DupAcks;
+    DWORD                       Recover;
+    BOOLEAN                     FastRecovery;
+
+    // the segment at SndUna must be retransmitted without going back to it
+    BOOLEAN                     RetransmitUna;
+
+    // round trip time estimation, RFC 6298
+    QWORD                       SrttUs;
+    QWORD                       RttVarUs;
+    QWORD                       RtoUs;
+    BOOLEAN                     RttTiming;
+    DWORD                       RttSequence;
+    QWORD                       RttStartUs;
+    DWORD                       Retransmissions;
+
+    // the timers are 0 when not armed
+    QWORD                       RetransmitDeadlineUs;
+    QWORD                       DelayedAckDeadlineUs;
+    QWORD                       CloseDeadlineUs;
+
+    // signaled on each change of state or of the buffers
+    EX_EVENT                    StateChanged;
+} NET_TCP_CONNECTION, *PNET_TCP_CONNECTION;
+
 typedef struct _NETWORK_STACK_DATA
 {
     BOOLEAN                     NetworkingEnabled;
@@ -23,6 +282,41 @@ typedef struct _NETWORK_STACK_DATA
 
     _Guarded_by_(DeviceLock)
     LIST_ENTRY                  NetworkDeviceList;             
+
+    RW_SPINLOCK                 UdpLock;
+
+    // the bound NET_UDP_ENDPOINTs, keyed by their local port
+    _Guarded_by_(UdpLock)
+    HASH_TABLE                  UdpEndpoints;
+
+    _Guarded_by_(UdpLock)
+    PORT_NUMBER                 NextEphemeralPort;
+
+    NET_ICMP_PENDING_ECHO       PendingEchoes[NET_ICMP_MAX_PENDING_ECHOES];
+
+    // taken before the lock of any connection or listener
+    RW_SPINLOCK                 TcpLock;
+
+    // NET_TCP_CONNECTIONs keyed by their tuple
+    _Guarded_by_(TcpLock)
+    HASH_TABLE                  TcpConnections;
+
+    _Guarded_by_(TcpLock)
+    LIST_ENTRY                  TcpConnectionList;
+
+    // NET_TCP_LISTENERs keyed by their local port
+    _Guarded_by_(TcpLock)
+    HASH_TABLE                  TcpListeners;
+
+    _Guarded_by_(TcpLock)
+    PORT_NUMBER                 NextTcpEphemeralPort;
+
+    PTHREAD                     TcpTimerThread;
+
+    // the layers are profiled only on demand, reading the TSC around each
+    // of them is not free
+    volatile BOOLEAN            LayerProfiling;
+    NET_LAYER_STATS             LayerStats[NetLayerReserved];
 } NETWORK_STACK_DATA, *PNETWORK_STACK_DATA;
 
 _No_competing_thread_
@@ -39,4 +333,41 @@ NetworkDeviceInitialize(
     INOUT    PNETWORK_DEVICE    Device
     );
 
-extern NETWORK_STACK_DATA m_netStackData;
\ No newline at end of file
+// Called once, when the first IPv4 address is assigned to the device
+STATUS
+NetworkDeviceStartReceiveThread(
+    INOUT    PNETWORK_DEVICE    Device
+    );
+
+extern NETWORK_STACK_DATA m_netStackData;
+
+// Returns 0 if the layers are not profiled
+__forceinline
+QWORD
+NetProfileStart(
+    void
+    )
+{
+    return m_netStackData.LayerProfiling ? RtcGetTickCount() : 0;
+}
+
+__forceinline
+void
+NetProfileEnd(
+    IN      NET_LAYER           Layer,
+    IN      QWORD               StartTicks,
+    IN      DWORD               NumberOfPackets
+    )
+{
+    ASSERT( Layer < NetLayerReserved );
+
+    if (0 == StartTicks)
+    {
+        return;
+    }
+
+    // the senders and the receive threads of all the devices update the
+    // statistics at the same time
+    _InterlockedExchangeAdd64(&m_netStackData.LayerStats[Layer].Cycles, RtcGetTickCount() - StartTicks);
+    _InterlockedExchangeAdd64(&m_netStackData.LayerStats[Layer].Packets, NumberOfPackets);
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+// The frames built by the protocol layer are never larger than this,
+// they can be placed on the stack
+#define NET_IP4_FRAME_MAX_SIZE              (ETHERNET_FRAME_SIZE + ETHERNET_MTU)
+#define NET_IP4_MAX_PAYLOAD_SIZE            (ETHERNET_MTU - IP4_PACKET_SIZE)
+
+#define NET_IP4_PAYLOAD(Frame)              ((PBYTE)(Frame) + ETHERNET_FRAME_SIZE + IP4_PACKET_SIZE)
+
+// Returns the configured device whose subnet contains Destination, only the
+// hosts on directly connected subnets are reachable
+PTR_SUCCESS
+PNETWORK_DEVICE
+NetIp4Route(
+    IN          IP4_ADDRESS             Destination
+    );
+
+// Sum of the pseudo header which precedes the TCP and UDP headers in their
+// checksums, Length is the size of the L4 header and data
+DWORD
+NetIp4PseudoHeaderSum(
+    IN          IP4_ADDRESS             Source,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    Length
+    );
+
+// Fills in the ethernet and IPv4 headers of a frame whose payload was
+// already placed at NET_IP4_PAYLOAD(Frame) and sends it. Offloads are the
+// NETWORK_OFFLOAD_TX_* L4 offloads requested by the caller, the IPv4 header
+// checksum is offloaded whenever the device supports it.
+STATUS
+NetIp4SendPacket(
+    IN          PNETWORK_DEVICE         Device,
+    INOUT       PETHERNET_FRAME         Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    PayloadSize,
+    IN          DWORD                   Offloads,
+    IN          BOOLEAN                 WaitForResolution
+    );
+
+// Same as NetIp4SendPacket, but the frame is only described in FrameBuffer,
+// the caller may send multiple such frames with a single NetSendFrames call
+STATUS
+NetIp4BuildPacket(
+    IN          PNETWORK_DEVICE         Device,
+    INOUT       PETHERNET_FRAME         Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    PayloadSize,
+    IN          DWORD                   Offloads,
+    IN          BOOLEAN                 WaitForResolution,
+    OUT         PNET_FRAME_BUFFER       FrameBuffer
+    );
+
+// Called by the receive thread of the device for each IPv4 frame
+void
+NetIp4ProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame
+    );
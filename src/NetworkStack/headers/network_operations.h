@@ -28,4 +28,10 @@ STATUS
 NetOpGetLinkStatus(
     IN          PDEVICE_OBJECT          DeviceObject,
     OUT         BOOLEAN*                LinkStatus
+    );
+
+STATUS
+NetOpGetOffloadCapabilities(
+    IN          PDEVICE_OBJECT                  DeviceObject,
+    OUT         PNETWORK_OFFLOAD_CAPABILITIES   Capabilities
     );
\ No newline at end of file
@@ -3,4 +3,7 @@
 #include "common_lib.h"
 #include "log.h"
 #include "io.h"
-#include "ex.h"
\ No newline at end of file
+#include "ex.h"
+#include "ex_event.h"
+#include "thread.h"
+#include "network_utils.h"
\ No newline at end of file
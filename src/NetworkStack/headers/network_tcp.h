@@ -0,0 +1,63 @@
+#pragma once
+
+// the ports assigned to the connections initiated by us
+#define NET_TCP_FIRST_EPHEMERAL_PORT        49152
+
+// number of buckets of the connection table, the table keeps working
+// with more connections, only the chains get longer
+#define NET_TCP_MAX_CONNECTION_KEYS         1024
+#define NET_TCP_MAX_LISTENER_KEYS           64
+
+#define NET_TCP_SEND_BUFFER_SIZE            (32 * KB_SIZE)
+
+// the receive buffer is larger than 64KB - 1 => the advertised window
+// must be scaled
+#define NET_TCP_RECEIVE_BUFFER_SIZE         (64 * KB_SIZE)
+#define NET_TCP_RECEIVE_WINDOW_SHIFT        1
+
+// RFC 879: the MSS assumed if the peer does not announce one
+#define NET_TCP_DEFAULT_MSS                 536
+
+// RFC 6928
+#define NET_TCP_INITIAL_WINDOW_SEGMENTS     10
+
+// granularity of all the TCP timers
+#define NET_TCP_TIMER_TICK_US               (10 * MS_IN_US)
+
+// an ACK is delayed at most this long, every second full segment is
+// acknowledged immediately
+#define NET_TCP_DELAYED_ACK_US              (40 * MS_IN_US)
+
+// RFC 6298
+#define NET_TCP_INITIAL_RTO_US              (1 * SEC_IN_US)
+#define NET_TCP_MIN_RTO_US                  (200 * MS_IN_US)
+#define NET_TCP_MAX_RTO_US                  (60 * SEC_IN_US)
+
+// the connection is aborted once a segment is retransmitted this many times
+#define NET_TCP_MAX_SYN_RETRANSMISSIONS     5
+#define NET_TCP_MAX_RETRANSMISSIONS         10
+
+// 2 * MSL
+#define NET_TCP_TIME_WAIT_US                (60 * SEC_IN_US)
+
+// a closed connection does not wait forever for the FIN of the peer
+#define NET_TCP_FIN_WAIT2_TIMEOUT_US        (60 * SEC_IN_US)
+
+_No_competing_thread_
+STATUS
+NetTcpInit(
+    void
+    );
+
+// Delivers the segment to the connection it belongs to, creates passive
+// connections for the SYNs sent to a listening port and resets everything
+// else
+void
+NetTcpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    );
@@ -0,0 +1,24 @@
+#pragma once
+
+// the ports assigned to the endpoints bound to port 0
+#define NET_UDP_FIRST_EPHEMERAL_PORT        49152
+
+#define NET_UDP_MAX_ENDPOINT_KEYS           64
+
+_No_competing_thread_
+STATUS
+NetUdpInit(
+    void
+    );
+
+// Queues the datagram to the endpoint bound to its destination port, the
+// endpoint takes a reference to the frame
+void
+NetUdpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    );
@@ -0,0 +1,320 @@
+#include "network_stack_base.h"
+#include "network.h"
+#include "network_internal.h"
+#include "network_arp.h"
+
+__forceinline
+static
+DWORD
+_NetArpGetSetIndex(
+    IN          IP4_ADDRESS             Address
+    )
+{
+    // the hosts of a subnet differ mostly in the last bytes of the address
+    return (Address.ByteAddress[2] ^ Address.ByteAddress[3]) % NET_ARP_CACHE_SETS;
+}
+
+static
+BOOLEAN
+_NetArpLookup(
+    IN          PNET_ARP_CACHE          Cache,
+    IN          IP4_ADDRESS             Address,
+    OUT         PMAC_ADDRESS            PhysicalAddress
+    );
+
+// Updates the entry of Address if it is cached, if Insert is set and it is
+// not cached it replaces the oldest entry of its set. Returns TRUE if the
+// address was cached before the call.
+static
+BOOLEAN
+_NetArpUpdate(
+    INOUT       PNET_ARP_CACHE          Cache,
+    IN          IP4_ADDRESS             Address,
+    IN          MAC_ADDRESS             PhysicalAddress,
+    IN          BOOLEAN                 Insert
+    );
+
+static
+STATUS
+_NetArpSendPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          ARP_OPERATION           Operation,
+    IN          MAC_ADDRESS             TargetPhysicalAddress,
+    IN          IP4_ADDRESS             TargetAddress
+    );
+
+void
+NetArpCacheInit(
+    OUT         PNET_ARP_CACHE          Cache
+    )
+{
+    ASSERT( NULL != Cache );
+
+    memzero(Cache->Entries, sizeof(Cache->Entries));
+    RwSpinlockInit(&Cache->Lock);
+}
+
+STATUS
+NetArpResolve(
+    IN          PNETWORK_DEVICE         Device,
+    IN          IP4_ADDRESS             Address,
+    IN          BOOLEAN                 Wait,
+    OUT         PMAC_ADDRESS            PhysicalAddress
+    )
+{
+    STATUS status;
+    QWORD startTime;
+    QWORD lastRequestTime;
+    QWORD currentTime;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != PhysicalAddress );
+
+    if (_NetArpLookup(&Device->ArpCache, Address, PhysicalAddress))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    status = _NetArpSendPacket(Device, ARP_OPERATION_REQUEST, MAC_BROADCAST, Address);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_NetArpSendPacket", status);
+        return status;
+    }
+
+    if (!Wait)
+    {
+        return STATUS_NETWORK_HOST_UNREACHABLE;
+    }
+
+    startTime = IoGetSystemTimeUs();
+    lastRequestTime = startTime;
+
+    // the reply is processed by the receive thread of the device, we only
+    // have to watch the cache
+    while (!_NetArpLookup(&Device->ArpCache, Address, PhysicalAddress))
+    {
+        currentTime = IoGetSystemTimeUs();
+
+        if (currentTime - startTime >= NET_ARP_RESOLVE_TIMEOUT_US)
+        {
+            return STATUS_NETWORK_HOST_UNREACHABLE;
+        }
+
+        if (currentTime - lastRequestTime >= NET_ARP_RETRANSMIT_INTERVAL_US)
+        {
+            status = _NetArpSendPacket(Device, ARP_OPERATION_REQUEST, MAC_BROADCAST, Address);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_NetArpSendPacket", status);
+                return status;
+            }
+
+            lastRequestTime = currentTime;
+        }
+
+        ThreadYield();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetArpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN_READS_BYTES(Length)
+                PARP_PACKET             Packet,
+    IN          DWORD                   Length
+    )
+{
+    STATUS status;
+    BOOLEAN bTargetIsUs;
+    BOOLEAN bMerged;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Packet );
+
+    if (Length < sizeof(ARP_PACKET))
+    {
+        return;
+    }
+
+    if (NETWORK_ORDER_WORD(HARDWARE_TYPE_ETHERNET) != Packet->HardwareType ||
+        NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4) != Packet->ProtocolType ||
+        MAC_ADDRESS_SIZE != Packet->HardwareAddressLength ||
+        IP4_ADDRESS_SIZE != Packet->ProtocolAddressLength)
+    {
+        return;
+    }
+
+    bTargetIsUs = Packet->TargetProtocolAddress.DwordAddress == Device->Info.Ip4Address.DwordAddress;
+
+    // RFC 826: the entry of the sender is refreshed if it is already cached,
+    // it is only added if the packet is meant for us
+    bMerged = _NetArpUpdate(&Device->ArpCache,
+                            Packet->SenderProtocolAddress,
+                            Packet->SenderHardwareAddress,
+                            bTargetIsUs);
+
+    LOG_TRACE_NETWORK("ARP operation %u from %u.%u.%u.%u, merged: %u\n",
+                      NETWORK_ORDER_WORD(Packet->Operation),
+                      Packet->SenderProtocolAddress.ByteAddress[0], Packet->SenderProtocolAddress.ByteAddress[1],
+                      Packet->SenderProtocolAddress.ByteAddress[2], Packet->SenderProtocolAddress.ByteAddress[3],
+                      bMerged);
+
+    if (bTargetIsUs && NETWORK_ORDER_WORD(ARP_OPERATION_REQUEST) == Packet->Operation)
+    {
+        status = _NetArpSendPacket(Device,
+                                   ARP_OPERATION_REPLY,
+                                   Packet->SenderHardwareAddress,
+                                   Packet->SenderProtocolAddress);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_NetArpSendPacket", status);
+        }
+    }
+}
+
+static
+BOOLEAN
+_NetArpLookup(
+    IN          PNET_ARP_CACHE          Cache,
+    IN          IP4_ADDRESS             Address,
+    OUT         PMAC_ADDRESS            PhysicalAddress
+    )
+{
+    PNET_ARP_ENTRY pSet;
+    INTR_STATE intrState;
+    QWORD currentTime;
+    BOOLEAN bFound;
+    DWORD i;
+
+    ASSERT( NULL != Cache );
+    ASSERT( NULL != PhysicalAddress );
+
+    pSet = Cache->Entries[_NetArpGetSetIndex(Address)];
+    currentTime = IoGetSystemTimeUs();
+    bFound = FALSE;
+
+    RwSpinlockAcquireShared(&Cache->Lock, &intrState);
+    for (i = 0; i < NET_ARP_CACHE_WAYS; ++i)
+    {
+        if (pSet[i].Valid && pSet[i].Address.DwordAddress == Address.DwordAddress)
+        {
+            if (currentTime - pSet[i].UpdateTimeUs < NET_ARP_ENTRY_LIFETIME_US)
+            {
+                *PhysicalAddress = pSet[i].PhysicalAddress;
+                bFound = TRUE;
+            }
+            break;
+        }
+    }
+    RwSpinlockReleaseShared(&Cache->Lock, intrState);
+
+    return bFound;
+}
+
+static
+BOOLEAN
+_NetArpUpdate(
+    INOUT       PNET_ARP_CACHE          Cache,
+    IN          IP4_ADDRESS             Address,
+    IN          MAC_ADDRESS             PhysicalAddress,
+    IN          BOOLEAN                 Insert
+    )
+{
+    PNET_ARP_ENTRY pSet;
+    PNET_ARP_ENTRY pEntry;
+    INTR_STATE intrState;
+    BOOLEAN bCached;
+    DWORD i;
+
+    ASSERT( NULL != Cache );
+
+    pSet = Cache->Entries[_NetArpGetSetIndex(Address)];
+    pEntry = NULL;
+    bCached = FALSE;
+
+    RwSpinlockAcquireExclusive(&Cache->Lock, &intrState);
+    for (i = 0; i < NET_ARP_CACHE_WAYS; ++i)
+    {
+        if (pSet[i].Valid && pSet[i].Address.DwordAddress == Address.DwordAddress)
+        {
+            pEntry = &pSet[i];
+            bCached = TRUE;
+            break;
+        }
+
+        if (!Insert)
+        {
+            continue;
+        }
+
+        // prefer a free entry, else replace the least recently updated one
+        if (NULL == pEntry ||
+            (pEntry->Valid && (!pSet[i].Valid || pSet[i].UpdateTimeUs < pEntry->UpdateTimeUs)))
+        {
+            pEntry = &pSet[i];
+        }
+    }
+
+    if (NULL != pEntry)
+    {
+        pEntry->Address = Address;
+        pEntry->PhysicalAddress = PhysicalAddress;
+        pEntry->UpdateTimeUs = IoGetSystemTimeUs();
+        pEntry->Valid = TRUE;
+    }
+    RwSpinlockReleaseExclusive(&Cache->Lock, intrState);
+
+    return bCached;
+}
+
+static
+STATUS
+_NetArpSendPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          ARP_OPERATION           Operation,
+    IN          MAC_ADDRESS             TargetPhysicalAddress,
+    IN          IP4_ADDRESS             TargetAddress
+    )
+{
+    BYTE buffer[ETHERNET_FRAME_SIZE + ARP_PACKET_SIZE];
+    PETHERNET_FRAME pFrame;
+    PARP_PACKET pPacket;
+    NET_FRAME_BUFFER frameBuffer;
+
+    ASSERT( NULL != Device );
+
+    pFrame = (PETHERNET_FRAME) buffer;
+    pPacket = (PARP_PACKET) pFrame->Data;
+
+    pFrame->Destination = TargetPhysicalAddress;
+    pFrame->Type = NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_ARP);
+
+    pPacket->HardwareType = NETWORK_ORDER_WORD(HARDWARE_TYPE_ETHERNET);
+    pPacket->ProtocolType = NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4);
+    pPacket->HardwareAddressLength = MAC_ADDRESS_SIZE;
+    pPacket->ProtocolAddressLength = IP4_ADDRESS_SIZE;
+    pPacket->Operation = NETWORK_ORDER_WORD(Operation);
+    pPacket->SenderHardwareAddress = Device->Info.PhysicalAddress;
+    pPacket->SenderProtocolAddress = Device->Info.Ip4Address;
+
+    // the target hardware address of a request is unknown
+    if (ARP_OPERATION_REQUEST == Operation)
+    {
+        memzero(&pPacket->TargetHardwareAddress, sizeof(MAC_ADDRESS));
+    }
+    else
+    {
+        pPacket->TargetHardwareAddress = TargetPhysicalAddress;
+    }
+    pPacket->TargetProtocolAddress = TargetAddress;
+
+    frameBuffer.Frame = pFrame;
+    frameBuffer.Length = sizeof(buffer);
+    frameBuffer.Offloads = 0;
+    frameBuffer.MaximumSegmentSize = 0;
+
+    return NetSendFrames(Device->Info.DeviceId, 1, &frameBuffer);
+}
@@ -1,6 +1,10 @@
 #include "network_stack_base.h"
 #include "network_internal.h"
 #include "network_operations.h"
+#include "network_arp.h"
+#include "network_ip.h"
+
+static FUNC_ThreadStart     _NetworkDeviceReceiveThread;
 
 _No_competing_thread_
 void
@@ -15,6 +19,8 @@ NetworkDevicePreinit(
 
     Device->PhysicalDevice = DeviceObject;
     Device->Info.DeviceId = DeviceId;
+
+    NetArpCacheInit(&Device->ArpCache);
 }
 
 _No_competing_thread_
@@ -49,7 +55,100 @@ NetworkDeviceInitialize(
         return status;
     }
 
+    status = NetOpGetOffloadCapabilities(Device->PhysicalDevice,
+                                         &Device->Info.OffloadCapabilities
+                                         );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetOpGetOffloadCapabilities", status);
+        return status;
+    }
+
     LOG_FUNC_END;
 
     return status;
+}
+
+STATUS
+NetworkDeviceStartReceiveThread(
+    INOUT    PNETWORK_DEVICE    Device
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL == Device->ReceiveThread);
+
+    status = ThreadCreate("Net RX",
+                          ThreadPriorityDefault,
+                          _NetworkDeviceReceiveThread,
+                          Device,
+                          &Device->ReceiveThread
+                          );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        return status;
+    }
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _NetworkDeviceReceiveThread)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PNETWORK_DEVICE pDevice;
+    PNET_LOANED_FRAME pFrame;
+    STATUS status;
+    STATUS lastStatus;
+
+    ASSERT(NULL != Context);
+
+    pDevice = Context;
+    lastStatus = STATUS_SUCCESS;
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        pFrame = NULL;
+
+        status = NetReceiveFrameByReference(pDevice->Info.DeviceId, &pFrame);
+        if (!SUCCEEDED(status))
+        {
+            // the link is down or RX is disabled, keep trying until the
+            // device is usable again
+            if (status != lastStatus)
+            {
+                LOG_WARNING("NetReceiveFrameByReference failed with status 0x%x\n", status);
+            }
+            lastStatus = status;
+
+            ThreadYield();
+            continue;
+        }
+        lastStatus = status;
+
+        ASSERT(NULL != pFrame);
+
+        // the protocols take their own references to the frames they keep
+        if (pFrame->Length >= ETHERNET_FRAME_SIZE)
+        {
+            if (NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_ARP) == pFrame->Frame->Type)
+            {
+                NetArpProcessPacket(pDevice, (PARP_PACKET) pFrame->Frame->Data, pFrame->Length - ETHERNET_FRAME_SIZE);
+            }
+            else if (NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4) == pFrame->Frame->Type)
+            {
+                NetIp4ProcessPacket(pDevice, pFrame);
+            }
+        }
+
+        NetReleaseFrame(pFrame);
+    }
+
+    NOT_REACHED;
 }
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "network_stack_base.h"
+#include "network.h"
+#include "network_internal.h"
+#include "network_ip.h"
+#include "network_icmp.h"
+
+#define NET_ICMP_MAX_ECHO_DATA_SIZE         (NET_IP4_MAX_PAYLOAD_SIZE - ICMP_ECHO_SIZE)
+
+static
+void
+_NetIcmpSendEchoReply(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PICMP_ECHO              Request,
+    IN          WORD                    Length
+    );
+
+static
+void
+_NetIcmpProcessEchoReply(
+    IN          PICMP_ECHO              Reply
+    );
+
+void
+NetIcmpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    )
+{
+    PICMP_ECHO pEcho;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Header );
+    ASSERT( NULL != Data );
+
+    if (Length < ICMP_ECHO_SIZE)
+    {
+        return;
+    }
+
+    if (0 != NetUtilChecksumFinish(NetUtilChecksumAdd(Data, Length, 0)))
+    {
+        return;
+    }
+
+    pEcho = (PICMP_ECHO) Data;
+
+    switch (pEcho->Type)
+    {
+    case ICMP_TYPE_ECHO_REQUEST:
+        // broadcast echo requests are ignored
+        if (Header->Destination.DwordAddress == Device->Info.Ip4Address.DwordAddress)
+        {
+            _NetIcmpSendEchoReply(Device, Header, pEcho, Length);
+        }
+        break;
+    case ICMP_TYPE_ECHO_REPLY:
+        _NetIcmpProcessEchoReply(pEcho);
+        break;
+    default:
+        LOG_TRACE_NETWORK("Unsupported ICMP type %u\n", pEcho->Type);
+        break;
+    }
+}
+
+STATUS
+NetIcmpEcho(
+    IN              IP4_ADDRESS                     Destination,
+    IN              WORD                            SequenceNumber,
+    IN              WORD                            PayloadSize,
+    IN              QWORD                           TimeoutUs,
+    OUT_OPT         QWORD*                          RoundTripTimeUs
+    )
+{
+    STATUS status;
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    PNETWORK_DEVICE pDevice;
+    PNET_ICMP_PENDING_ECHO pPending;
+    PICMP_ECHO pEcho;
+    QWORD startTime;
+    DWORD slot;
+    WORD i;
+
+    if (PayloadSize > NET_ICMP_MAX_ECHO_DATA_SIZE)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pDevice = NetIp4Route(Destination);
+    if (NULL == pDevice)
+    {
+        return STATUS_NETWORK_UNREACHABLE;
+    }
+
+    pPending = NULL;
+    for (slot = 0; slot < NET_ICMP_MAX_PENDING_ECHOES; ++slot)
+    {
+        if (FALSE == _InterlockedCompareExchange8(&m_netStackData.PendingEchoes[slot].InUse, TRUE, FALSE))
+        {
+            pPending = &m_netStackData.PendingEchoes[slot];
+            break;
+        }
+    }
+
+    if (NULL == pPending)
+    {
+        return STATUS_NO_MORE_OBJECTS;
+    }
+
+    pPending->SequenceNumber = SequenceNumber;
+    _InterlockedExchange8(&pPending->ReplyReceived, FALSE);
+
+    pEcho = (PICMP_ECHO) NET_IP4_PAYLOAD(buffer);
+    pEcho->Type = ICMP_TYPE_ECHO_REQUEST;
+    pEcho->Code = 0;
+    pEcho->Checksum = 0;
+    pEcho->Identifier = NETWORK_ORDER_WORD(NET_ICMP_ECHO_IDENTIFIER_BASE + slot);
+    pEcho->SequenceNumber = NETWORK_ORDER_WORD(SequenceNumber);
+    for (i = 0; i < PayloadSize; ++i)
+    {
+        pEcho->Data[i] = (BYTE) i;
+    }
+    pEcho->Checksum = NetUtilChecksumFinish(NetUtilChecksumAdd(pEcho, ICMP_ECHO_SIZE + PayloadSize, 0));
+
+    startTime = IoGetSystemTimeUs();
+
+    __try
+    {
+        status = NetIp4SendPacket(pDevice,
+                                  (PETHERNET_FRAME) buffer,
+                                  Destination,
+                                  IP_PROTOCOL_ICMP,
+                                  (WORD) (ICMP_ECHO_SIZE + PayloadSize),
+                                  0,
+                                  TRUE);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        // the reply is matched by the receive thread of the device
+        while (!pPending->ReplyReceived)
+        {
+            if (IoGetSystemTimeUs() - startTime >= TimeoutUs)
+            {
+                status = STATUS_TIMEOUT;
+                __leave;
+            }
+
+            ThreadYield();
+        }
+
+        if (NULL != RoundTripTimeUs)
+        {
+            *RoundTripTimeUs = pPending->ReplyTimeUs - startTime;
+        }
+    }
+    __finally
+    {
+        _InterlockedExchange8(&pPending->InUse, FALSE);
+    }
+
+    return status;
+}
+
+static
+void
+_NetIcmpSendEchoReply(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PICMP_ECHO              Request,
+    IN          WORD                    Length
+    )
+{
+    STATUS status;
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    PICMP_ECHO pReply;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Header );
+    ASSERT( NULL != Request );
+
+    if (Length > NET_IP4_MAX_PAYLOAD_SIZE)
+    {
+        return;
+    }
+
+    pReply = (PICMP_ECHO) NET_IP4_PAYLOAD(buffer);
+    memcpy(pReply, Request, Length);
+
+    pReply->Type = ICMP_TYPE_ECHO_REPLY;
+    pReply->Checksum = 0;
+    pReply->Checksum = NetUtilChecksumFinish(NetUtilChecksumAdd(pReply, Length, 0));
+
+    // we run on the receive thread, we cannot wait for an ARP reply
+    status = NetIp4SendPacket(Device,
+                              (PETHERNET_FRAME) buffer,
+                              Header->Source,
+                              IP_PROTOCOL_ICMP,
+                              Length,
+                              0,
+                              FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_TRACE_NETWORK("NetIp4SendPacket failed with status 0x%x\n", status);
+    }
+}
+
+static
+void
+_NetIcmpProcessEchoReply(
+    IN          PICMP_ECHO              Reply
+    )
+{
+    PNET_ICMP_PENDING_ECHO pPending;
+    WORD slot;
+
+    ASSERT( NULL != Reply );
+
+    slot = (WORD) (NETWORK_ORDER_WORD(Reply->Identifier) - NET_ICMP_ECHO_IDENTIFIER_BASE);
+    if (slot >= NET_ICMP_MAX_PENDING_ECHOES)
+    {
+        // not one of ours
+        return;
+    }
+
+    pPending = &m_netStackData.PendingEchoes[slot];
+    if (!pPending->InUse ||
+        pPending->ReplyReceived ||
+        pPending->SequenceNumber != NETWORK_ORDER_WORD(Reply->SequenceNumber))
+    {
+        return;
+    }
+
+    pPending->ReplyTimeUs = IoGetSystemTimeUs();
+    _InterlockedExchange8(&pPending->ReplyReceived, TRUE);
+}
@@ -17,6 +17,7 @@ NetSendFrame(
     STATUS status;
     PNETWORK_DEVICE pNetDevice;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     PETHERNET_FRAME pFrame;
 
     if (NULL == Buffer)
@@ -51,12 +52,100 @@ NetSendFrame(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_SEND_FRAME,
-                                             pNetDevice->PhysicalDevice,
-                                             Buffer,
-                                             Size,
-                                             NULL,
-                                             0
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_SEND_FRAME,
+                                               pNetDevice->PhysicalDevice,
+                                               Buffer,
+                                               Size,
+                                               NULL,
+                                               0,
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(pNetDevice->PhysicalDevice,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+NetSendFrames(
+    IN                      DEVICE_ID           DeviceId,
+    IN                      DWORD               NumberOfFrames,
+    IN_READS(NumberOfFrames)
+                            NET_FRAME_BUFFER*   Frames
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE pNetDevice;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    NET_SEND_FRAMES_INPUT input;
+    DWORD i;
+
+    if (0 == NumberOfFrames)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Frames)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        if (NULL == Frames[i].Frame || Frames[i].Length < sizeof(ETHERNET_FRAME))
+        {
+            return STATUS_INVALID_PARAMETER3;
+        }
+
+        memcpy(&Frames[i].Frame->Source, &pNetDevice->Info.PhysicalAddress, sizeof(MAC_ADDRESS));
+    }
+
+    input.NumberOfFrames = NumberOfFrames;
+    input.Frames = (PNET_FRAME_BUFFER) Frames;
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_SEND_FRAMES,
+                                               pNetDevice->PhysicalDevice,
+                                               &input,
+                                               sizeof(NET_SEND_FRAMES_INPUT),
+                                               NULL,
+                                               0,
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -98,6 +187,7 @@ NetReceiveFrame(
 {
     STATUS status;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     PETHERNET_FRAME pFrame;
     PNETWORK_DEVICE pNetDevice;
 
@@ -128,12 +218,13 @@ NetReceiveFrame(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_RECEIVE_FRAME,
-                                             pNetDevice->PhysicalDevice,
-                                             NULL,
-                                             0,
-                                             Buffer,
-                                             Size
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_RECEIVE_FRAME,
+                                               pNetDevice->PhysicalDevice,
+                                               NULL,
+                                               0,
+                                               Buffer,
+                                               Size,
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -171,6 +262,102 @@ NetReceiveFrame(
     return status;
 }
 
+STATUS
+NetReceiveFrameByReference(
+    IN                      DEVICE_ID           DeviceId,
+    OUT                     PNET_LOANED_FRAME*  Frame
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    PNETWORK_DEVICE pNetDevice;
+    NET_RECEIVE_FRAME_REFERENCE_OUTPUT output;
+
+    if (NULL == Frame)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+    memzero(&output, sizeof(NET_RECEIVE_FRAME_REFERENCE_OUTPUT));
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_RECEIVE_FRAME_REFERENCE,
+                                               pNetDevice->PhysicalDevice,
+                                               NULL,
+                                               0,
+                                               &output,
+                                               sizeof(NET_RECEIVE_FRAME_REFERENCE_OUTPUT),
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(pNetDevice->PhysicalDevice,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        ASSERT(NULL != output.Frame);
+        *Frame = output.Frame;
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+void
+NetReferenceFrame(
+    INOUT                   PNET_LOANED_FRAME   Frame
+    )
+{
+    ASSERT( NULL != Frame );
+    ASSERT( 0 != Frame->ReferenceCount );
+
+    _InterlockedIncrement(&Frame->ReferenceCount);
+}
+
+void
+NetReleaseFrame(
+    INOUT                   PNET_LOANED_FRAME   Frame
+    )
+{
+    ASSERT( NULL != Frame );
+    ASSERT( 0 != Frame->ReferenceCount );
+
+    if (0 == _InterlockedDecrement(&Frame->ReferenceCount))
+    {
+        ASSERT( NULL != Frame->FreeRoutine );
+
+        Frame->FreeRoutine(Frame);
+    }
+}
+
 STATUS
 NetGetNetworkDevices(
     OUT_WRITES_OPT(*NumberOfDevices)
@@ -277,4 +464,294 @@ NetChangeDeviceStatus(
     }
 
     return status;
+}
+
+STATUS
+NetGetNetworkDeviceStatistics(
+    IN              DEVICE_ID                       DeviceId,
+    OUT             PNETWORK_DEVICE_STATS           Statistics
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    PNETWORK_DEVICE pNetDevice;
+    NET_GET_DEVICE_STATISTICS output;
+
+    if (NULL == Statistics)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_DEVICE_STATISTICS,
+                                               pNetDevice->PhysicalDevice,
+                                               NULL,
+                                               0,
+                                               &output,
+                                               sizeof(NET_GET_DEVICE_STATISTICS),
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(pNetDevice->PhysicalDevice,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        memcpy(Statistics, &output.Statistics, sizeof(NETWORK_DEVICE_STATS));
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+NetGetNetworkDeviceTuning(
+    IN              DEVICE_ID                       DeviceId,
+    OUT             PNETWORK_DEVICE_TUNING          Tuning
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    PNETWORK_DEVICE pNetDevice;
+    NET_GET_SET_DEVICE_TUNING output;
+
+    if (NULL == Tuning)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_DEVICE_TUNING,
+                                               pNetDevice->PhysicalDevice,
+                                               NULL,
+                                               0,
+                                               &output,
+                                               sizeof(NET_GET_SET_DEVICE_TUNING),
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(pNetDevice->PhysicalDevice,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        memcpy(Tuning, &output.Tuning, sizeof(NETWORK_DEVICE_TUNING));
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+NetSetNetworkDeviceTuning(
+    IN              DEVICE_ID                       DeviceId,
+    IN              PNETWORK_DEVICE_TUNING          Tuning
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    PNETWORK_DEVICE pNetDevice;
+    NET_GET_SET_DEVICE_TUNING input;
+
+    if (NULL == Tuning)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+    memcpy(&input.Tuning, Tuning, sizeof(NETWORK_DEVICE_TUNING));
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_SET_DEVICE_TUNING,
+                                               pNetDevice->PhysicalDevice,
+                                               &input,
+                                               sizeof(NET_GET_SET_DEVICE_TUNING),
+                                               NULL,
+                                               0,
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(pNetDevice->PhysicalDevice,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+NetSetIp4Address(
+    IN              DEVICE_ID                       DeviceId,
+    IN              IP4_ADDRESS                     Address,
+    IN              IP4_ADDRESS                     SubnetMask
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE pNetDevice;
+    INTR_STATE intrState;
+    BOOLEAN bFirstAddress;
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    status = STATUS_SUCCESS;
+
+    // the routing decisions are taken with the lock held shared
+    RwSpinlockAcquireExclusive(&m_netStackData.DeviceLock, &intrState);
+    bFirstAddress = !pNetDevice->Info.Ip4Configured;
+    pNetDevice->Info.Ip4Address = Address;
+    pNetDevice->Info.SubnetMask = SubnetMask;
+    pNetDevice->Info.Ip4Configured = TRUE;
+    RwSpinlockReleaseExclusive(&m_netStackData.DeviceLock, intrState);
+
+    if (bFirstAddress)
+    {
+        status = NetworkDeviceStartReceiveThread(pNetDevice);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetworkDeviceStartReceiveThread", status);
+
+            RwSpinlockAcquireExclusive(&m_netStackData.DeviceLock, &intrState);
+            pNetDevice->Info.Ip4Configured = FALSE;
+            RwSpinlockReleaseExclusive(&m_netStackData.DeviceLock, intrState);
+
+            return status;
+        }
+    }
+
+    return status;
+}
+void
+NetSetLayerProfiling(
+    IN              BOOLEAN                         Enable
+    )
+{
+    DWORD i;
+
+    m_netStackData.LayerProfiling = FALSE;
+
+    if (!Enable)
+    {
+        return;
+    }
+
+    // a layer which read the TSC before the profiling was disabled may
+    // still account a packet in the new statistics
+    for (i = 0; i < NetLayerReserved; ++i)
+    {
+        _InterlockedExchange64(&m_netStackData.LayerStats[i].Packets, 0);
+        _InterlockedExchange64(&m_netStackData.LayerStats[i].Cycles, 0);
+    }
+
+    m_netStackData.LayerProfiling = TRUE;
+}
+
+void
+NetGetLayerStatistics(
+    OUT_WRITES(NetLayerReserved)
+                    NET_LAYER_STATS*                Statistics
+    )
+{
+    DWORD i;
+
+    ASSERT( NULL != Statistics );
+
+    for (i = 0; i < NetLayerReserved; ++i)
+    {
+        Statistics[i].Packets = m_netStackData.LayerStats[i].Packets;
+        Statistics[i].Cycles = m_netStackData.LayerStats[i].Cycles;
+    }
 }
\ No newline at end of file
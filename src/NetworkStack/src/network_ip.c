@@ -0,0 +1,280 @@
+#include "network_stack_base.h"
+#include "network.h"
+#include "network_internal.h"
+#include "network_arp.h"
+#include "network_ip.h"
+#include "network_icmp.h"
+#include "network_udp.h"
+#include "network_tcp.h"
+
+#define IP4_LIMITED_BROADCAST       MAX_DWORD
+
+__forceinline
+static
+BOOLEAN
+_NetIp4IsOnLink(
+    IN          PNETWORK_DEVICE         Device,
+    IN          IP4_ADDRESS             Address
+    )
+{
+    return (Address.DwordAddress & Device->Info.SubnetMask.DwordAddress) ==
+           (Device->Info.Ip4Address.DwordAddress & Device->Info.SubnetMask.DwordAddress);
+}
+
+__forceinline
+static
+BOOLEAN
+_NetIp4IsBroadcast(
+    IN          PNETWORK_DEVICE         Device,
+    IN          IP4_ADDRESS             Address
+    )
+{
+    return IP4_LIMITED_BROADCAST == Address.DwordAddress ||
+           (_NetIp4IsOnLink(Device, Address) &&
+            IP4_LIMITED_BROADCAST == (Address.DwordAddress | Device->Info.SubnetMask.DwordAddress));
+}
+
+PTR_SUCCESS
+PNETWORK_DEVICE
+NetIp4Route(
+    IN          IP4_ADDRESS             Destination
+    )
+{
+    INTR_STATE intrState;
+    PLIST_ENTRY pEntry;
+    PNETWORK_DEVICE pResult;
+
+    pResult = NULL;
+
+    RwSpinlockAcquireShared(&m_netStackData.DeviceLock, &intrState);
+
+    for (pEntry = m_netStackData.NetworkDeviceList.Flink;
+         pEntry != &m_netStackData.NetworkDeviceList;
+         pEntry = pEntry->Flink)
+    {
+        PNETWORK_DEVICE pNetDevice = CONTAINING_RECORD(pEntry, NETWORK_DEVICE, NextDevice);
+
+        if (pNetDevice->Info.Ip4Configured &&
+            (IP4_LIMITED_BROADCAST == Destination.DwordAddress || _NetIp4IsOnLink(pNetDevice, Destination)))
+        {
+            pResult = pNetDevice;
+            break;
+        }
+    }
+
+    RwSpinlockReleaseShared(&m_netStackData.DeviceLock, intrState);
+
+    return pResult;
+}
+
+DWORD
+NetIp4PseudoHeaderSum(
+    IN          IP4_ADDRESS             Source,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    Length
+    )
+{
+    DWORD sum;
+
+    sum = NetUtilChecksumAdd(&Source, sizeof(IP4_ADDRESS), 0);
+    sum = NetUtilChecksumAdd(&Destination, sizeof(IP4_ADDRESS), sum);
+
+    // the protocol is preceded by a 0 byte
+    return sum + NETWORK_ORDER_WORD(Protocol) + NETWORK_ORDER_WORD(Length);
+}
+
+STATUS
+NetIp4SendPacket(
+    IN          PNETWORK_DEVICE         Device,
+    INOUT       PETHERNET_FRAME         Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    PayloadSize,
+    IN          DWORD                   Offloads,
+    IN          BOOLEAN                 WaitForResolution
+    )
+{
+    STATUS status;
+    NET_FRAME_BUFFER frameBuffer;
+    QWORD startTicks;
+
+    status = NetIp4BuildPacket(Device,
+                               Frame,
+                               Destination,
+                               Protocol,
+                               PayloadSize,
+                               Offloads,
+                               WaitForResolution,
+                               &frameBuffer);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    startTicks = NetProfileStart();
+    status = NetSendFrames(Device->Info.DeviceId, 1, &frameBuffer);
+    NetProfileEnd(NetLayerDeviceSend, startTicks, 1);
+
+    return status;
+}
+
+STATUS
+NetIp4BuildPacket(
+    IN          PNETWORK_DEVICE         Device,
+    INOUT       PETHERNET_FRAME         Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          IP_PROTOCOL             Protocol,
+    IN          WORD                    PayloadSize,
+    IN          DWORD                   Offloads,
+    IN          BOOLEAN                 WaitForResolution,
+    OUT         PNET_FRAME_BUFFER       FrameBuffer
+    )
+{
+    STATUS status;
+    PIP4_PACKET pHeader;
+    QWORD startTicks;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != FrameBuffer );
+
+    startTicks = NetProfileStart();
+
+    if (PayloadSize > NET_IP4_MAX_PAYLOAD_SIZE)
+    {
+        // we never fragment
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    if (_NetIp4IsBroadcast(Device, Destination))
+    {
+        Frame->Destination = MAC_BROADCAST;
+    }
+    else
+    {
+        status = NetArpResolve(Device, Destination, WaitForResolution, &Frame->Destination);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    Frame->Type = NETWORK_ORDER_WORD(ETHERNET_FRAME_TYPE_IP4);
+
+    pHeader = (PIP4_PACKET) Frame->Data;
+    pHeader->Version = IP4_VERSION;
+    pHeader->InternetHeaderLength = IP4_PACKET_SIZE / sizeof(DWORD);
+    pHeader->QoS = 0;
+    pHeader->Length = NETWORK_ORDER_WORD(IP4_PACKET_SIZE + PayloadSize);
+    pHeader->Id = NETWORK_ORDER_WORD(_InterlockedIncrement(&Device->NextIp4Id));
+    pHeader->FragmentInformation = NETWORK_ORDER_WORD(IP4_FLAG_DONT_FRAGMENT);
+    pHeader->TimeToLive = IP4_DEFAULT_TIME_TO_LIVE;
+    pHeader->Protocol = Protocol;
+    pHeader->Checksum = 0;
+    pHeader->Source = Device->Info.Ip4Address;
+    pHeader->Destination = Destination;
+
+    FrameBuffer->Offloads = Offloads;
+    if (IsBooleanFlagOn(Device->Info.OffloadCapabilities.Offloads, NETWORK_OFFLOAD_TX_IP4_CHECKSUM))
+    {
+        FrameBuffer->Offloads |= NETWORK_OFFLOAD_TX_IP4_CHECKSUM;
+    }
+    else
+    {
+        pHeader->Checksum = NetUtilChecksumFinish(NetUtilChecksumAdd(pHeader, IP4_PACKET_SIZE, 0));
+    }
+
+    FrameBuffer->Frame = Frame;
+    FrameBuffer->Length = ETHERNET_FRAME_SIZE + IP4_PACKET_SIZE + PayloadSize;
+    FrameBuffer->MaximumSegmentSize = 0;
+
+    NetProfileEnd(NetLayerIp4Send, startTicks, 1);
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetIp4ProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame
+    )
+{
+    PIP4_PACKET pHeader;
+    DWORD availableLength;
+    WORD headerLength;
+    WORD totalLength;
+    PBYTE pData;
+    QWORD startTicks;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+
+    // the packets which are dropped are not accounted
+    startTicks = NetProfileStart();
+
+    if (Frame->Length < ETHERNET_FRAME_SIZE + IP4_PACKET_SIZE)
+    {
+        return;
+    }
+
+    pHeader = (PIP4_PACKET) Frame->Frame->Data;
+    availableLength = Frame->Length - ETHERNET_FRAME_SIZE;
+    headerLength = (WORD) (pHeader->InternetHeaderLength * sizeof(DWORD));
+    totalLength = NETWORK_ORDER_WORD(pHeader->Length);
+
+    // the frame may be longer than the packet, short frames are padded
+    if (IP4_VERSION != pHeader->Version ||
+        headerLength < IP4_PACKET_SIZE ||
+        totalLength < headerLength ||
+        totalLength > availableLength)
+    {
+        return;
+    }
+
+    if (IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_IP4_BAD))
+    {
+        return;
+    }
+
+    // a valid header sums up to 0xFFFF, including its checksum
+    if (!IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_IP4_GOOD) &&
+        0 != NetUtilChecksumFinish(NetUtilChecksumAdd(pHeader, headerLength, 0)))
+    {
+        return;
+    }
+
+    if (pHeader->Destination.DwordAddress != Device->Info.Ip4Address.DwordAddress &&
+        !_NetIp4IsBroadcast(Device, pHeader->Destination))
+    {
+        return;
+    }
+
+    if (0 != (NETWORK_ORDER_WORD(pHeader->FragmentInformation) & (IP4_FLAG_MORE_FRAGMENTS | IP4_FRAGMENT_OFFSET_MASK)))
+    {
+        LOG_TRACE_NETWORK("Dropping fragment of packet 0x%x\n", NETWORK_ORDER_WORD(pHeader->Id));
+        return;
+    }
+
+    pData = (PBYTE) pHeader + headerLength;
+
+    NetProfileEnd(NetLayerIp4Receive, startTicks, 1);
+
+    switch (pHeader->Protocol)
+    {
+    case IP_PROTOCOL_ICMP:
+        NetIcmpProcessPacket(Device, pHeader, pData, (WORD) (totalLength - headerLength));
+        break;
+    case IP_PROTOCOL_UDP:
+        startTicks = NetProfileStart();
+        NetUdpProcessPacket(Device, Frame, pHeader, pData, (WORD) (totalLength - headerLength));
+        NetProfileEnd(NetLayerUdpReceive, startTicks, 1);
+        break;
+    case IP_PROTOCOL_TCP:
+        NetTcpProcessPacket(Device, Frame, pHeader, pData, (WORD) (totalLength - headerLength));
+        break;
+    default:
+        LOG_TRACE_NETWORK("Unsupported protocol %u\n", pHeader->Protocol);
+        break;
+    }
+}
@@ -10,6 +10,7 @@ NetOpGetPhysicalAddress(
 {
     STATUS status;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     NET_GET_SET_PHYSICAL_ADDRESS physAddr;
 
     LOG_FUNC_START;
@@ -23,12 +24,13 @@ NetOpGetPhysicalAddress(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_GET_PHYSICAL_ADDRESS,
-                                             DeviceObject,
-                                             NULL,
-                                             0,
-                                             &physAddr,
-                                             sizeof(NET_GET_SET_PHYSICAL_ADDRESS)
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_PHYSICAL_ADDRESS,
+                                               DeviceObject,
+                                               NULL,
+                                               0,
+                                               &physAddr,
+                                               sizeof(NET_GET_SET_PHYSICAL_ADDRESS),
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -105,6 +107,7 @@ NetOpGetDeviceStatus(
 {
     STATUS status;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     NET_GET_SET_DEVICE_STATUS devStatus;
 
     LOG_FUNC_START;
@@ -118,12 +121,13 @@ NetOpGetDeviceStatus(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_GET_DEVICE_STATUS,
-                                             DeviceObject,
-                                             NULL,
-                                             0,
-                                             &devStatus,
-                                             sizeof(NET_GET_SET_DEVICE_STATUS)
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_DEVICE_STATUS,
+                                               DeviceObject,
+                                               NULL,
+                                               0,
+                                               &devStatus,
+                                               sizeof(NET_GET_SET_DEVICE_STATUS),
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -167,6 +171,7 @@ NetOpSetDeviceStatus(
 {
     STATUS status;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     NET_GET_SET_DEVICE_STATUS devStatus;
 
     LOG_FUNC_START;
@@ -181,12 +186,13 @@ NetOpSetDeviceStatus(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_SET_DEVICE_STATUS,
-                                             DeviceObject,
-                                             &devStatus,
-                                             sizeof(NET_GET_SET_DEVICE_STATUS),
-                                             NULL,
-                                             0
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_SET_DEVICE_STATUS,
+                                               DeviceObject,
+                                               &devStatus,
+                                               sizeof(NET_GET_SET_DEVICE_STATUS),
+                                               NULL,
+                                               0,
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -228,6 +234,7 @@ NetOpGetLinkStatus(
 {
     STATUS status;
     PIRP pIrp;
+    IO_STACK_IRP stackIrp;
     NET_GET_LINK_STATUS linkStatus;
 
     LOG_FUNC_START;
@@ -241,12 +248,13 @@ NetOpGetLinkStatus(
 
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_GET_LINK_STATUS,
-                                             DeviceObject,
-                                             NULL,
-                                             0,
-                                             &linkStatus,
-                                             sizeof(NET_GET_LINK_STATUS)
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_LINK_STATUS,
+                                               DeviceObject,
+                                               NULL,
+                                               0,
+                                               &linkStatus,
+                                               sizeof(NET_GET_LINK_STATUS),
+                                               &stackIrp
         );
         ASSERT(NULL != pIrp);
 
@@ -279,5 +287,69 @@ NetOpGetLinkStatus(
         LOG_FUNC_END;
     }
 
+    return status;
+}
+
+STATUS
+NetOpGetOffloadCapabilities(
+    IN          PDEVICE_OBJECT                  DeviceObject,
+    OUT         PNETWORK_OFFLOAD_CAPABILITIES   Capabilities
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    IO_STACK_IRP stackIrp;
+    NET_GET_OFFLOAD_CAPABILITIES output;
+
+    LOG_FUNC_START;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Capabilities);
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+    memzero(&output, sizeof(NET_GET_OFFLOAD_CAPABILITIES));
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequestEx(IOCTL_NET_GET_OFFLOAD_CAPABILITIES,
+                                               DeviceObject,
+                                               NULL,
+                                               0,
+                                               &output,
+                                               sizeof(NET_GET_OFFLOAD_CAPABILITIES),
+                                               &stackIrp
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(DeviceObject,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        memcpy(Capabilities, &output.Capabilities, sizeof(NETWORK_OFFLOAD_CAPABILITIES));
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+
+        LOG_FUNC_END;
+    }
+
     return status;
 }
\ No newline at end of file
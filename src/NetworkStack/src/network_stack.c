@@ -2,6 +2,8 @@
 #include "network_stack.h"
 #include "network_internal.h"
 #include "network_operations.h"
+#include "network_udp.h"
+#include "network_tcp.h"
 
 NETWORK_STACK_DATA m_netStackData;
 
@@ -31,6 +33,13 @@ NetworkStackPreinit(
     InitializeListHead(&m_netStackData.NetworkDeviceList);
     RwSpinlockInit(&m_netStackData.DeviceLock);
 
+    RwSpinlockInit(&m_netStackData.UdpLock);
+    m_netStackData.NextEphemeralPort = NET_UDP_FIRST_EPHEMERAL_PORT;
+
+    RwSpinlockInit(&m_netStackData.TcpLock);
+    InitializeListHead(&m_netStackData.TcpConnectionList);
+    m_netStackData.NextTcpEphemeralPort = NET_TCP_FIRST_EPHEMERAL_PORT;
+
     m_netStackData.NetworkingEnabled = TRUE;
 }
 
@@ -53,6 +62,20 @@ NetworkStackInit(
     pNetworkDevices = NULL;
     numberOfDevices = 0;
 
+    status = NetUdpInit();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetUdpInit", status);
+        return status;
+    }
+
+    status = NetTcpInit();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetTcpInit", status);
+        return status;
+    }
+
     status = IoGetDevicesByType(DeviceTypePhysicalNetcard, 
                                 &pNetworkDevices, 
                                 &numberOfDevices
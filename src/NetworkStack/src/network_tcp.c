@@ -0,0 +1,2706 @@
+#include "network_stack_base.h"
+#include "network.h"
+#include "network_internal.h"
+#include "network_ip.h"
+#include "network_tcp.h"
+#include "ex_timer.h"
+#include "rtc.h"
+
+// the sequence numbers wrap around, they are compared modulo 2^32
+#define NET_TCP_SEQ_LT(a,b)                 ((INT32)((DWORD)(a) - (DWORD)(b)) < 0)
+#define NET_TCP_SEQ_LE(a,b)                 ((INT32)((DWORD)(a) - (DWORD)(b)) <= 0)
+#define NET_TCP_SEQ_GT(a,b)                 NET_TCP_SEQ_LT(b,a)
+#define NET_TCP_SEQ_GE(a,b)                 NET_TCP_SEQ_LE(b,a)
+
+// we never send segments which need fragmentation
+#define NET_TCP_LOCAL_MSS                   (NET_IP4_MAX_PAYLOAD_SIZE - TCP_SEGMENT_SIZE)
+
+// the window scale option is preceded by a NOP => the header remains
+// DWORD aligned
+#define NET_TCP_SYN_OPTIONS_SIZE            (TCP_OPTION_MSS_SIZE + 1 + TCP_OPTION_WINDOW_SCALE_SIZE)
+
+#define NET_TCP_FLAG_FIN                    (1<<0)
+#define NET_TCP_FLAG_SYN                    (1<<1)
+#define NET_TCP_FLAG_RST                    (1<<2)
+#define NET_TCP_FLAG_PSH                    (1<<3)
+#define NET_TCP_FLAG_ACK                    (1<<4)
+
+// RFC 5681: number of duplicate ACKs which trigger a fast retransmit
+#define NET_TCP_DUP_ACK_THRESHOLD           3
+
+static FUNC_HashFunction                    _NetTcpHashTuple;
+static FUNC_ThreadStart                     _NetTcpTimerThread;
+static FUNC_FreeFunction                    _NetTcpDestroyConnection;
+static FUNC_FreeFunction                    _NetTcpDestroyListener;
+
+static
+STATUS
+_NetTcpCreateConnection(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    OUT_PTR     PNET_TCP_CONNECTION*    Connection
+    );
+
+static
+void
+_NetTcpInitSequenceSpace(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    );
+
+REQUIRES_EXCL_LOCK(m_netStackData.TcpLock)
+static
+void
+_NetTcpInsertConnection(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    );
+
+static
+void
+_NetTcpUnlinkConnection(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    );
+
+PTR_SUCCESS
+static
+PNET_TCP_CONNECTION
+_NetTcpLookupConnection(
+    IN          PNET_TCP_TUPLE          Tuple
+    );
+
+PTR_SUCCESS
+static
+PNET_TCP_CONNECTION
+_NetTcpCreatePassiveConnection(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    );
+
+static
+void
+_NetTcpParseOptions(
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength,
+    OUT         WORD*                   Mss,
+    OUT         BYTE*                   WindowShift
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpApplySynOptions(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpProcessSegment(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength,
+    IN_READS_BYTES(DataLength)
+                PBYTE                   Data,
+    IN          DWORD                   DataLength
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpProcessSynSent(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpProcessAck(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          DWORD                   Sequence,
+    IN          DWORD                   Ack,
+    IN          WORD                    Window,
+    IN          BOOLEAN                 CarriesData,
+    IN          QWORD                   NowUs
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpSetEstablished(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpSetClosed(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          STATUS                  Error
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpUpdateRto(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   SampleUs
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpProcessTimers(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   NowUs
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpRetransmitTimeout(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   NowUs
+    );
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+WORD
+_NetTcpBuildSegment(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    OUT         PETHERNET_FRAME         Frame,
+    OUT         DWORD*                  Offloads
+    );
+
+static
+WORD
+_NetTcpFillSegment(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    OUT         PTCP_SEGMENT            Segment,
+    IN          DWORD                   Sequence,
+    IN          DWORD                   Ack,
+    IN          BYTE                    Flags,
+    IN          WORD                    Window,
+    IN          BYTE                    OptionsSize,
+    IN          WORD                    DataSize,
+    OUT         DWORD*                  Offloads
+    );
+
+static
+void
+_NetTcpOutput(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          BOOLEAN                 CanWait
+    );
+
+static
+void
+_NetTcpSendReset(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   SegmentLength
+    );
+
+static
+void
+_NetTcpAbort(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    );
+
+static
+void
+_NetTcpRingRead(
+    IN_READS_BYTES(RingSize)
+                PBYTE                   Ring,
+    IN          DWORD                   RingSize,
+    IN          DWORD                   Position,
+    OUT_WRITES_BYTES(Length)
+                PBYTE                   Buffer,
+    IN          DWORD                   Length
+    );
+
+static
+void
+_NetTcpRingWrite(
+    OUT_WRITES_BYTES(RingSize)
+                PBYTE                   Ring,
+    IN          DWORD                   RingSize,
+    IN          DWORD                   Position,
+    IN_READS_BYTES(Length)
+                PBYTE                   Buffer,
+    IN          DWORD                   Length
+    );
+
+__forceinline
+static
+BOOLEAN
+_NetTcpIsDeadlineReached(
+    IN          QWORD                   DeadlineUs,
+    IN          QWORD                   NowUs
+    )
+{
+    return 0 != DeadlineUs && NowUs >= DeadlineUs;
+}
+
+// The right edge of the window we can currently advertise, the data which
+// does not fit in the receive buffer is dropped
+__forceinline
+static
+DWORD
+_NetTcpReceiveSpace(
+    IN          PNET_TCP_CONNECTION     Connection
+    )
+{
+    return NET_TCP_RECEIVE_BUFFER_SIZE - Connection->ReceiveBytes;
+}
+
+_No_competing_thread_
+STATUS
+NetTcpInit(
+    void
+    )
+{
+    STATUS status;
+    DWORD dataSize;
+    PHASH_TABLE_DATA pTableData;
+
+    dataSize = HashTablePreinit(&m_netStackData.TcpConnections, NET_TCP_MAX_CONNECTION_KEYS, sizeof(NET_TCP_TUPLE));
+
+    pTableData = ExAllocatePoolWithTag(PoolAllocateZeroMemory, dataSize, HEAP_NET_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", dataSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&m_netStackData.TcpConnections,
+                  pTableData,
+                  _NetTcpHashTuple,
+                  FIELD_OFFSET(NET_TCP_CONNECTION, Tuple) - FIELD_OFFSET(NET_TCP_CONNECTION, HashEntry));
+
+    dataSize = HashTablePreinit(&m_netStackData.TcpListeners, NET_TCP_MAX_LISTENER_KEYS, sizeof(PORT_NUMBER));
+
+    pTableData = ExAllocatePoolWithTag(PoolAllocateZeroMemory, dataSize, HEAP_NET_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", dataSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&m_netStackData.TcpListeners,
+                  pTableData,
+                  HashFuncGenericIncremental,
+                  FIELD_OFFSET(NET_TCP_LISTENER, LocalPort) - FIELD_OFFSET(NET_TCP_LISTENER, HashEntry));
+
+    status = ThreadCreate("Net TCP timer",
+                          ThreadPriorityDefault,
+                          _NetTcpTimerThread,
+                          NULL,
+                          &m_netStackData.TcpTimerThread
+                          );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        return status;
+    }
+
+    return status;
+}
+
+void
+NetTcpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    )
+{
+    PTCP_SEGMENT pSegment;
+    DWORD headerLength;
+    DWORD dataLength;
+    NET_TCP_TUPLE tuple;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+    BOOLEAN bSendReset;
+    BOOLEAN bClosed;
+    DWORD sum;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != Header );
+    ASSERT( NULL != Data );
+
+    if (Length < TCP_SEGMENT_SIZE)
+    {
+        return;
+    }
+
+    pSegment = (PTCP_SEGMENT) Data;
+    headerLength = pSegment->DataOffset * sizeof(DWORD);
+    if (headerLength < TCP_SEGMENT_SIZE || headerLength > Length)
+    {
+        return;
+    }
+
+    if (IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_TCP_UDP_BAD))
+    {
+        return;
+    }
+
+    if (!IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_TCP_UDP_GOOD))
+    {
+        sum = NetIp4PseudoHeaderSum(Header->Source, Header->Destination, IP_PROTOCOL_TCP, Length);
+        if (0 != NetUtilChecksumFinish(NetUtilChecksumAdd(pSegment, Length, sum)))
+        {
+            return;
+        }
+    }
+
+    // connections are never established to broadcast addresses
+    if (Header->Destination.DwordAddress != Device->Info.Ip4Address.DwordAddress)
+    {
+        return;
+    }
+
+    dataLength = Length - headerLength;
+
+    tuple.LocalAddress = Header->Destination;
+    tuple.RemoteAddress = Header->Source;
+    tuple.LocalPort = NETWORK_ORDER_WORD(pSegment->Destination);
+    tuple.RemotePort = NETWORK_ORDER_WORD(pSegment->Source);
+
+    pConnection = _NetTcpLookupConnection(&tuple);
+    if (NULL == pConnection && pSegment->SYN && !pSegment->ACK && !pSegment->RST)
+    {
+        pConnection = _NetTcpCreatePassiveConnection(Device, &tuple, pSegment, headerLength);
+    }
+
+    if (NULL == pConnection)
+    {
+        _NetTcpSendReset(Device, Header, pSegment, dataLength + pSegment->SYN + pSegment->FIN);
+        return;
+    }
+
+    LockAcquire(&pConnection->Lock, &intrState);
+    bSendReset = _NetTcpProcessSegment(pConnection, pSegment, headerLength, Data + headerLength, dataLength);
+    bClosed = NetTcpStateClosed == pConnection->State;
+    LockRelease(&pConnection->Lock, intrState);
+
+    if (bSendReset)
+    {
+        _NetTcpSendReset(Device, Header, pSegment, dataLength + pSegment->SYN + pSegment->FIN);
+    }
+
+    // the receive thread must never wait for an ARP resolution
+    _NetTcpOutput(pConnection, FALSE);
+
+    if (bClosed)
+    {
+        _NetTcpUnlinkConnection(pConnection);
+    }
+
+    RfcDereference(&pConnection->RefCnt);
+}
+
+STATUS
+NetTcpListen(
+    IN              PORT_NUMBER                     LocalPort,
+    IN              DWORD                           Backlog,
+    OUT             PNET_TCP_LISTENER*              Listener
+    )
+{
+    STATUS status;
+    PNET_TCP_LISTENER pListener;
+    INTR_STATE intrState;
+
+    if (0 == LocalPort)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == Backlog)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Listener)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pListener = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NET_TCP_LISTENER), HEAP_NET_TAG, 0);
+    if (NULL == pListener)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NET_TCP_LISTENER));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pListener->LocalPort = LocalPort;
+    pListener->Backlog = Backlog;
+    LockInit(&pListener->Lock);
+    InitializeListHead(&pListener->AcceptQueue);
+
+    status = ExEventInit(&pListener->ConnectionAvailable, ExEventTypeNotification, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        ExFreePoolWithTag(pListener, HEAP_NET_TAG);
+        return status;
+    }
+
+    RfcPreInit(&pListener->RefCnt);
+
+    status = RfcInit(&pListener->RefCnt, _NetTcpDestroyListener, NULL);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RfcInit", status);
+        ExFreePoolWithTag(pListener, HEAP_NET_TAG);
+        return status;
+    }
+
+    RwSpinlockAcquireExclusive(&m_netStackData.TcpLock, &intrState);
+    if (NULL != HashTableLookup(&m_netStackData.TcpListeners, (PHASH_KEY) &LocalPort))
+    {
+        status = STATUS_NETWORK_ADDRESS_IN_USE;
+    }
+    else
+    {
+        HashTableInsert(&m_netStackData.TcpListeners, &pListener->HashEntry);
+    }
+    RwSpinlockReleaseExclusive(&m_netStackData.TcpLock, intrState);
+
+    if (!SUCCEEDED(status))
+    {
+        RfcDereference(&pListener->RefCnt);
+        return status;
+    }
+
+    *Listener = pListener;
+
+    return status;
+}
+
+STATUS
+NetTcpAccept(
+    IN              PNET_TCP_LISTENER               Listener,
+    OUT             PNET_TCP_CONNECTION*            Connection
+    )
+{
+    STATUS status;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+
+    if (NULL == Listener)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pConnection = NULL;
+
+    while (NULL == pConnection && SUCCEEDED(status))
+    {
+        LockAcquire(&Listener->Lock, &intrState);
+        if (!IsListEmpty(&Listener->AcceptQueue))
+        {
+            pConnection = CONTAINING_RECORD(RemoveHeadList(&Listener->AcceptQueue), NET_TCP_CONNECTION, AcceptListEntry);
+            pConnection->InAcceptQueue = FALSE;
+            pConnection->Accepted = TRUE;
+            Listener->PendingConnections--;
+
+            // while in the accept queue the connection is kept alive by the
+            // reference of the connection table, this one is for the handle
+            RfcReference(&pConnection->RefCnt);
+        }
+        else if (Listener->Closed)
+        {
+            status = STATUS_CONNECTION_CLOSED;
+        }
+        else
+        {
+            ExEventClearSignal(&Listener->ConnectionAvailable);
+        }
+        LockRelease(&Listener->Lock, intrState);
+
+        if (NULL == pConnection && SUCCEEDED(status))
+        {
+            ExEventWaitForSignal(&Listener->ConnectionAvailable);
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        *Connection = pConnection;
+    }
+
+    return status;
+}
+
+DWORD
+NetTcpPollListener(
+    IN              PNET_TCP_LISTENER               Listener
+    )
+{
+    INTR_STATE intrState;
+    DWORD events;
+
+    ASSERT( NULL != Listener );
+
+    events = 0;
+
+    LockAcquire(&Listener->Lock, &intrState);
+    if (!IsListEmpty(&Listener->AcceptQueue))
+    {
+        events |= NET_POLL_READ;
+    }
+    if (Listener->Closed)
+    {
+        events |= NET_POLL_ERROR;
+    }
+    LockRelease(&Listener->Lock, intrState);
+
+    return events;
+}
+
+void
+NetTcpCloseListener(
+    IN              PNET_TCP_LISTENER               Listener
+    )
+{
+    LIST_ENTRY pendingConnections;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+
+    ASSERT( NULL != Listener );
+
+    RwSpinlockAcquireExclusive(&m_netStackData.TcpLock, &intrState);
+    HashTableRemoveEntry(&m_netStackData.TcpListeners, &Listener->HashEntry);
+    RwSpinlockReleaseExclusive(&m_netStackData.TcpLock, intrState);
+
+    InitializeListHead(&pendingConnections);
+
+    // the connections still in their handshake are reset when it completes
+    LockAcquire(&Listener->Lock, &intrState);
+    Listener->Closed = TRUE;
+    while (!IsListEmpty(&Listener->AcceptQueue))
+    {
+        pConnection = CONTAINING_RECORD(RemoveHeadList(&Listener->AcceptQueue), NET_TCP_CONNECTION, AcceptListEntry);
+        pConnection->InAcceptQueue = FALSE;
+        pConnection->Accepted = TRUE;
+        Listener->PendingConnections--;
+
+        RfcReference(&pConnection->RefCnt);
+        InsertTailList(&pendingConnections, &pConnection->AcceptListEntry);
+    }
+    LockRelease(&Listener->Lock, intrState);
+
+    ExEventSignal(&Listener->ConnectionAvailable);
+
+    while (!IsListEmpty(&pendingConnections))
+    {
+        pConnection = CONTAINING_RECORD(RemoveHeadList(&pendingConnections), NET_TCP_CONNECTION, AcceptListEntry);
+
+        _NetTcpAbort(pConnection);
+        RfcDereference(&pConnection->RefCnt);
+    }
+
+    RfcDereference(&Listener->RefCnt);
+}
+
+STATUS
+NetTcpConnect(
+    IN              IP4_ADDRESS                     Destination,
+    IN              PORT_NUMBER                     DestinationPort,
+    OUT             PNET_TCP_CONNECTION*            Connection
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE pDevice;
+    NET_TCP_TUPLE tuple;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+    BOOLEAN bDone;
+    DWORD i;
+
+    if (0 == DestinationPort)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pDevice = NetIp4Route(Destination);
+    if (NULL == pDevice)
+    {
+        return STATUS_NETWORK_UNREACHABLE;
+    }
+
+    tuple.LocalAddress = pDevice->Info.Ip4Address;
+    tuple.RemoteAddress = Destination;
+    tuple.LocalPort = 0;
+    tuple.RemotePort = DestinationPort;
+
+    status = _NetTcpCreateConnection(pDevice, &tuple, &pConnection);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_NetTcpCreateConnection", status);
+        return status;
+    }
+
+    pConnection->State = NetTcpStateSynSent;
+
+    RwSpinlockAcquireExclusive(&m_netStackData.TcpLock, &intrState);
+
+    // a local port may be reused as long as the tuple is unique
+    status = STATUS_NETWORK_ADDRESS_IN_USE;
+    for (i = NET_TCP_FIRST_EPHEMERAL_PORT; i <= MAX_WORD; ++i)
+    {
+        PORT_NUMBER port = m_netStackData.NextTcpEphemeralPort;
+
+        m_netStackData.NextTcpEphemeralPort = (MAX_WORD == port) ? NET_TCP_FIRST_EPHEMERAL_PORT : (PORT_NUMBER) (port + 1);
+
+        pConnection->Tuple.LocalPort = port;
+        if (NULL == HashTableLookup(&m_netStackData.TcpListeners, (PHASH_KEY) &port) &&
+            NULL == HashTableLookup(&m_netStackData.TcpConnections, (PHASH_KEY) &pConnection->Tuple))
+        {
+            status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        _NetTcpInitSequenceSpace(pConnection);
+        _NetTcpInsertConnection(pConnection);
+    }
+
+    RwSpinlockReleaseExclusive(&m_netStackData.TcpLock, intrState);
+
+    if (!SUCCEEDED(status))
+    {
+        RfcDereference(&pConnection->RefCnt);
+        return status;
+    }
+
+    // the reference of the handle
+    RfcReference(&pConnection->RefCnt);
+
+    _NetTcpOutput(pConnection, TRUE);
+
+    bDone = FALSE;
+    while (!bDone)
+    {
+        LockAcquire(&pConnection->Lock, &intrState);
+        if (NetTcpStateSynSent != pConnection->State && NetTcpStateSynReceived != pConnection->State)
+        {
+            status = NetTcpStateClosed == pConnection->State ? pConnection->Error : STATUS_SUCCESS;
+            bDone = TRUE;
+        }
+        else
+        {
+            ExEventClearSignal(&pConnection->StateChanged);
+        }
+        LockRelease(&pConnection->Lock, intrState);
+
+        if (!bDone)
+        {
+            ExEventWaitForSignal(&pConnection->StateChanged);
+        }
+    }
+
+    if (!SUCCEEDED(status))
+    {
+        _NetTcpUnlinkConnection(pConnection);
+        RfcDereference(&pConnection->RefCnt);
+        return status;
+    }
+
+    *Connection = pConnection;
+
+    return status;
+}
+
+STATUS
+NetTcpSend(
+    IN              PNET_TCP_CONNECTION             Connection,
+    IN_READS_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesSent
+    )
+{
+    STATUS status;
+    INTR_STATE intrState;
+    DWORD bytesSent;
+    DWORD bytesToCopy;
+    BOOLEAN bQueued;
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesSent)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    status = STATUS_SUCCESS;
+    bytesSent = 0;
+
+    while (bytesSent < Size && SUCCEEDED(status))
+    {
+        bQueued = FALSE;
+
+        LockAcquire(&Connection->Lock, &intrState);
+        if (Connection->FinQueued ||
+            (NetTcpStateEstablished != Connection->State && NetTcpStateCloseWait != Connection->State))
+        {
+            status = (NetTcpStateClosed == Connection->State && !SUCCEEDED(Connection->Error)) ?
+                Connection->Error : STATUS_CONNECTION_CLOSED;
+        }
+        else if (Connection->SendBytes < NET_TCP_SEND_BUFFER_SIZE)
+        {
+            bytesToCopy = min(NET_TCP_SEND_BUFFER_SIZE - Connection->SendBytes, Size - bytesSent);
+
+            _NetTcpRingWrite(Connection->SendBuffer,
+                             NET_TCP_SEND_BUFFER_SIZE,
+                             Connection->SendHead + Connection->SendBytes,
+                             (PBYTE) Buffer + bytesSent,
+                             bytesToCopy);
+
+            Connection->SendBytes += bytesToCopy;
+            bytesSent += bytesToCopy;
+            bQueued = TRUE;
+        }
+        else
+        {
+            ExEventClearSignal(&Connection->StateChanged);
+        }
+        LockRelease(&Connection->Lock, intrState);
+
+        if (bQueued)
+        {
+            _NetTcpOutput(Connection, TRUE);
+        }
+        else if (SUCCEEDED(status))
+        {
+            // wait for the peer to acknowledge some data
+            ExEventWaitForSignal(&Connection->StateChanged);
+        }
+    }
+
+    *BytesSent = bytesSent;
+
+    return status;
+}
+
+STATUS
+NetTcpReceive(
+    IN              PNET_TCP_CONNECTION             Connection,
+    OUT_WRITES_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesReceived
+    )
+{
+    STATUS status;
+    INTR_STATE intrState;
+    DWORD bytesReceived;
+    BOOLEAN bDone;
+    BOOLEAN bUpdateWindow;
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesReceived)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    status = STATUS_SUCCESS;
+    bytesReceived = 0;
+    bDone = FALSE;
+    bUpdateWindow = FALSE;
+
+    while (!bDone)
+    {
+        LockAcquire(&Connection->Lock, &intrState);
+        if (0 != Connection->ReceiveBytes)
+        {
+            bytesReceived = min(Size, Connection->ReceiveBytes);
+
+            _NetTcpRingRead(Connection->ReceiveBuffer,
+                            NET_TCP_RECEIVE_BUFFER_SIZE,
+                            Connection->ReceiveHead,
+                            Buffer,
+                            bytesReceived);
+
+            Connection->ReceiveHead = (Connection->ReceiveHead + bytesReceived) % NET_TCP_RECEIVE_BUFFER_SIZE;
+            Connection->ReceiveBytes -= bytesReceived;
+
+            // RFC 1122 receiver SWS avoidance: the window is advertised again
+            // only once it can grow by a significant amount
+            if (!Connection->FinReceived &&
+                (Connection->RcvNxt + _NetTcpReceiveSpace(Connection)) - Connection->RcvAdv >=
+                min(NET_TCP_RECEIVE_BUFFER_SIZE / 2, 2 * (DWORD) Connection->Mss))
+            {
+                Connection->AckPending = TRUE;
+                bUpdateWindow = TRUE;
+            }
+
+            bDone = TRUE;
+        }
+        else if (Connection->FinReceived)
+        {
+            // end of stream
+            bDone = TRUE;
+        }
+        else if (NetTcpStateClosed == Connection->State)
+        {
+            status = SUCCEEDED(Connection->Error) ? STATUS_CONNECTION_CLOSED : Connection->Error;
+            bDone = TRUE;
+        }
+        else
+        {
+            ExEventClearSignal(&Connection->StateChanged);
+        }
+        LockRelease(&Connection->Lock, intrState);
+
+        if (!bDone)
+        {
+            ExEventWaitForSignal(&Connection->StateChanged);
+        }
+    }
+
+    if (bUpdateWindow)
+    {
+        _NetTcpOutput(Connection, TRUE);
+    }
+
+    *BytesReceived = bytesReceived;
+
+    return status;
+}
+
+void
+NetTcpGetRemoteAddress(
+    IN              PNET_TCP_CONNECTION             Connection,
+    OUT             IP4_ADDRESS*                    Address,
+    OUT             PORT_NUMBER*                    Port
+    )
+{
+    ASSERT( NULL != Connection );
+    ASSERT( NULL != Address );
+    ASSERT( NULL != Port );
+
+    // the tuple never changes once the connection is created
+    *Address = Connection->Tuple.RemoteAddress;
+    *Port = Connection->Tuple.RemotePort;
+}
+
+DWORD
+NetTcpPoll(
+    IN              PNET_TCP_CONNECTION             Connection
+    )
+{
+    INTR_STATE intrState;
+    DWORD events;
+
+    ASSERT( NULL != Connection );
+
+    events = 0;
+
+    // the conditions match the ones for which NetTcpReceive and NetTcpSend
+    // return without waiting
+    LockAcquire(&Connection->Lock, &intrState);
+    if (0 != Connection->ReceiveBytes ||
+        Connection->FinReceived ||
+        NetTcpStateClosed == Connection->State)
+    {
+        events |= NET_POLL_READ;
+    }
+
+    if (Connection->FinQueued ||
+        (NetTcpStateEstablished != Connection->State && NetTcpStateCloseWait != Connection->State))
+    {
+        // a handshake in progress is the only case in which neither
+        // sending nor failing to send is possible
+        if (NetTcpStateSynSent != Connection->State && NetTcpStateSynReceived != Connection->State)
+        {
+            events |= NET_POLL_WRITE;
+        }
+    }
+    else if (Connection->SendBytes < NET_TCP_SEND_BUFFER_SIZE)
+    {
+        events |= NET_POLL_WRITE;
+    }
+
+    if (NetTcpStateClosed == Connection->State && !SUCCEEDED(Connection->Error))
+    {
+        events |= NET_POLL_ERROR;
+    }
+    LockRelease(&Connection->Lock, intrState);
+
+    return events;
+}
+
+STATUS
+NetTcpShutdown(
+    IN              PNET_TCP_CONNECTION             Connection
+    )
+{
+    INTR_STATE intrState;
+    BOOLEAN bClosed;
+
+    if (NULL == Connection)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    LockAcquire(&Connection->Lock, &intrState);
+    switch (Connection->State)
+    {
+    case NetTcpStateSynSent:
+        _NetTcpSetClosed(Connection, STATUS_CONNECTION_CLOSED);
+        break;
+    case NetTcpStateSynReceived:
+    case NetTcpStateEstablished:
+        Connection->State = NetTcpStateFinWait1;
+        Connection->FinQueued = TRUE;
+        break;
+    case NetTcpStateCloseWait:
+        Connection->State = NetTcpStateLastAck;
+        Connection->FinQueued = TRUE;
+        break;
+    default:
+        // our side is already closed
+        break;
+    }
+    bClosed = NetTcpStateClosed == Connection->State;
+    LockRelease(&Connection->Lock, intrState);
+
+    _NetTcpOutput(Connection, TRUE);
+
+    if (bClosed)
+    {
+        _NetTcpUnlinkConnection(Connection);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetTcpClose(
+    IN              PNET_TCP_CONNECTION             Connection
+    )
+{
+    INTR_STATE intrState;
+    BOOLEAN bAbort;
+
+    ASSERT( NULL != Connection );
+
+    LockAcquire(&Connection->Lock, &intrState);
+    Connection->HandleClosed = TRUE;
+
+    // RFC 2525: closing with unread data resets the connection, the peer
+    // must learn that it was not received
+    bAbort = 0 != Connection->ReceiveBytes;
+
+    if (NetTcpStateFinWait2 == Connection->State)
+    {
+        Connection->CloseDeadlineUs = IoGetSystemTimeUs() + NET_TCP_FIN_WAIT2_TIMEOUT_US;
+    }
+    LockRelease(&Connection->Lock, intrState);
+
+    if (bAbort)
+    {
+        _NetTcpAbort(Connection);
+    }
+    else
+    {
+        NetTcpShutdown(Connection);
+    }
+
+    RfcDereference(&Connection->RefCnt);
+}
+
+static
+QWORD
+(__cdecl _NetTcpHashTuple)(
+    IN_READS_BYTES(KeyLength)   PHASH_KEY   Key,
+    IN                          DWORD       KeyLength,
+    IN                          DWORD       MaxKeys
+    )
+{
+    PBYTE pKey;
+    DWORD hash;
+    DWORD i;
+
+    ASSERT( NULL != Key );
+
+    pKey = (PBYTE) Key;
+
+    // FNV-1a, the connections of a client differ only in a few bits of the
+    // remote port => all the bytes must influence the bucket
+    hash = 2166136261UL;
+    for (i = 0; i < KeyLength; ++i)
+    {
+        hash = (hash ^ pKey[i]) * 16777619UL;
+    }
+
+    return hash % MaxKeys;
+}
+
+static
+STATUS
+(__cdecl _NetTcpTimerThread)(
+    IN_OPT      PVOID       Context
+    )
+{
+    STATUS status;
+    EX_TIMER timer;
+    LIST_ENTRY expiredConnections;
+    PLIST_ENTRY pEntry;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+    QWORD nowUs;
+    BOOLEAN bClosed;
+
+    UNREFERENCED_PARAMETER(Context);
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        // the periodic timers are not reloaded after they trigger, a one
+        // shot timer is armed for each tick
+        status = ExTimerInit(&timer, ExTimerTypeRelativeOnce, NET_TCP_TIMER_TICK_US);
+        ASSERT(SUCCEEDED(status));
+
+        ExTimerStart(&timer);
+        ExTimerWait(&timer);
+        ExTimerUninit(&timer);
+
+        nowUs = IoGetSystemTimeUs();
+        InitializeListHead(&expiredConnections);
+
+        // the deadlines are read without taking the lock of each connection,
+        // a timer armed concurrently is noticed on the next tick
+        RwSpinlockAcquireShared(&m_netStackData.TcpLock, &intrState);
+        for (pEntry = m_netStackData.TcpConnectionList.Flink;
+             pEntry != &m_netStackData.TcpConnectionList;
+             pEntry = pEntry->Flink)
+        {
+            pConnection = CONTAINING_RECORD(pEntry, NET_TCP_CONNECTION, ConnectionListEntry);
+
+            if (_NetTcpIsDeadlineReached(pConnection->RetransmitDeadlineUs, nowUs) ||
+                _NetTcpIsDeadlineReached(pConnection->DelayedAckDeadlineUs, nowUs) ||
+                _NetTcpIsDeadlineReached(pConnection->CloseDeadlineUs, nowUs))
+            {
+                RfcReference(&pConnection->RefCnt);
+                InsertTailList(&expiredConnections, &pConnection->TimerListEntry);
+            }
+        }
+        RwSpinlockReleaseShared(&m_netStackData.TcpLock, intrState);
+
+        while (!IsListEmpty(&expiredConnections))
+        {
+            pConnection = CONTAINING_RECORD(RemoveHeadList(&expiredConnections), NET_TCP_CONNECTION, TimerListEntry);
+
+            LockAcquire(&pConnection->Lock, &intrState);
+            _NetTcpProcessTimers(pConnection, nowUs);
+            bClosed = NetTcpStateClosed == pConnection->State;
+            LockRelease(&pConnection->Lock, intrState);
+
+            _NetTcpOutput(pConnection, FALSE);
+
+            if (bClosed)
+            {
+                _NetTcpUnlinkConnection(pConnection);
+            }
+
+            RfcDereference(&pConnection->RefCnt);
+        }
+    }
+
+    NOT_REACHED;
+}
+
+static
+void
+(__cdecl _NetTcpDestroyConnection)(
+    IN      PVOID                   Object,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PNET_TCP_CONNECTION pConnection;
+
+    ASSERT( NULL != Object );
+    ASSERT( NULL == Context );
+
+    pConnection = CONTAINING_RECORD(Object, NET_TCP_CONNECTION, RefCnt);
+
+    if (NULL != pConnection->Listener)
+    {
+        RfcDereference(&pConnection->Listener->RefCnt);
+    }
+
+    if (NULL != pConnection->ReceiveBuffer)
+    {
+        ExFreePoolWithTag(pConnection->ReceiveBuffer, HEAP_NET_TAG);
+    }
+
+    if (NULL != pConnection->SendBuffer)
+    {
+        ExFreePoolWithTag(pConnection->SendBuffer, HEAP_NET_TAG);
+    }
+
+    ExFreePoolWithTag(pConnection, HEAP_NET_TAG);
+}
+
+static
+void
+(__cdecl _NetTcpDestroyListener)(
+    IN      PVOID                   Object,
+    IN_OPT  PVOID                   Context
+    )
+{
+    ASSERT( NULL != Object );
+    ASSERT( NULL == Context );
+
+    ExFreePoolWithTag(CONTAINING_RECORD(Object, NET_TCP_LISTENER, RefCnt), HEAP_NET_TAG);
+}
+
+static
+STATUS
+_NetTcpCreateConnection(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    OUT_PTR     PNET_TCP_CONNECTION*    Connection
+    )
+{
+    STATUS status;
+    PNET_TCP_CONNECTION pConnection;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Tuple );
+    ASSERT( NULL != Connection );
+
+    status = STATUS_SUCCESS;
+
+    pConnection = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NET_TCP_CONNECTION), HEAP_NET_TAG, 0);
+    if (NULL == pConnection)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NET_TCP_CONNECTION));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    __try
+    {
+        pConnection->SendBuffer = ExAllocatePoolWithTag(0, NET_TCP_SEND_BUFFER_SIZE, HEAP_NET_TAG, 0);
+        if (NULL == pConnection->SendBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", NET_TCP_SEND_BUFFER_SIZE);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        pConnection->ReceiveBuffer = ExAllocatePoolWithTag(0, NET_TCP_RECEIVE_BUFFER_SIZE, HEAP_NET_TAG, 0);
+        if (NULL == pConnection->ReceiveBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", NET_TCP_RECEIVE_BUFFER_SIZE);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        status = ExEventInit(&pConnection->StateChanged, ExEventTypeNotification, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            __leave;
+        }
+
+        RfcPreInit(&pConnection->RefCnt);
+
+        // the initial reference belongs to the connection table
+        status = RfcInit(&pConnection->RefCnt, _NetTcpDestroyConnection, NULL);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("RfcInit", status);
+            __leave;
+        }
+
+        LockInit(&pConnection->Lock);
+
+        pConnection->Tuple = *Tuple;
+        pConnection->Device = Device;
+        pConnection->State = NetTcpStateClosed;
+
+        pConnection->Mss = NET_TCP_DEFAULT_MSS;
+        pConnection->RcvWndShift = NET_TCP_RECEIVE_WINDOW_SHIFT;
+        pConnection->Cwnd = NET_TCP_INITIAL_WINDOW_SEGMENTS * NET_TCP_DEFAULT_MSS;
+        pConnection->Ssthresh = MAX_DWORD;
+        pConnection->RtoUs = NET_TCP_INITIAL_RTO_US;
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            if (NULL != pConnection->ReceiveBuffer)
+            {
+                ExFreePoolWithTag(pConnection->ReceiveBuffer, HEAP_NET_TAG);
+            }
+
+            if (NULL != pConnection->SendBuffer)
+            {
+                ExFreePoolWithTag(pConnection->SendBuffer, HEAP_NET_TAG);
+            }
+
+            ExFreePoolWithTag(pConnection, HEAP_NET_TAG);
+            pConnection = NULL;
+        }
+        else
+        {
+            *Connection = pConnection;
+        }
+    }
+
+    return status;
+}
+
+static
+void
+_NetTcpInitSequenceSpace(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    )
+{
+    DWORD iss;
+
+    ASSERT( NULL != Connection );
+
+    // RFC 6528: a clock driven counter offset by a value which depends on
+    // the tuple => the sequence numbers of different incarnations of a
+    // connection do not overlap
+    iss = (DWORD) (RtcGetTickCount() >> 4) +
+          (DWORD) _NetTcpHashTuple((PHASH_KEY) &Connection->Tuple, sizeof(NET_TCP_TUPLE), MAX_DWORD);
+
+    Connection->Iss = iss;
+    Connection->SndUna = iss;
+    Connection->SndNxt = iss;
+    Connection->SndMax = iss;
+    Connection->Recover = iss;
+}
+
+REQUIRES_EXCL_LOCK(m_netStackData.TcpLock)
+static
+void
+_NetTcpInsertConnection(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    )
+{
+    ASSERT( NULL != Connection );
+
+    HashTableInsert(&m_netStackData.TcpConnections, &Connection->HashEntry);
+    InsertTailList(&m_netStackData.TcpConnectionList, &Connection->ConnectionListEntry);
+}
+
+static
+void
+_NetTcpUnlinkConnection(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    )
+{
+    PNET_TCP_LISTENER pListener;
+    INTR_STATE intrState;
+    BOOLEAN bUnlinked;
+
+    ASSERT( NULL != Connection );
+
+    RwSpinlockAcquireExclusive(&m_netStackData.TcpLock, &intrState);
+    bUnlinked = !Connection->Unlinked;
+    if (bUnlinked)
+    {
+        HashTableRemoveEntry(&m_netStackData.TcpConnections, &Connection->HashEntry);
+        RemoveEntryList(&Connection->ConnectionListEntry);
+        Connection->Unlinked = TRUE;
+    }
+    RwSpinlockReleaseExclusive(&m_netStackData.TcpLock, intrState);
+
+    if (!bUnlinked)
+    {
+        return;
+    }
+
+    // a passive connection which was not accepted no longer occupies a
+    // place in the backlog
+    pListener = Connection->Listener;
+    if (NULL != pListener)
+    {
+        LockAcquire(&pListener->Lock, &intrState);
+        if (Connection->InAcceptQueue)
+        {
+            RemoveEntryList(&Connection->AcceptListEntry);
+            Connection->InAcceptQueue = FALSE;
+        }
+
+        if (!Connection->Accepted)
+        {
+            pListener->PendingConnections--;
+        }
+        LockRelease(&pListener->Lock, intrState);
+    }
+
+    RfcDereference(&Connection->RefCnt);
+}
+
+PTR_SUCCESS
+static
+PNET_TCP_CONNECTION
+_NetTcpLookupConnection(
+    IN          PNET_TCP_TUPLE          Tuple
+    )
+{
+    PHASH_ENTRY pEntry;
+    PNET_TCP_CONNECTION pConnection;
+    INTR_STATE intrState;
+
+    ASSERT( NULL != Tuple );
+
+    pConnection = NULL;
+
+    RwSpinlockAcquireShared(&m_netStackData.TcpLock, &intrState);
+    pEntry = HashTableLookup(&m_netStackData.TcpConnections, (PHASH_KEY) Tuple);
+    if (NULL != pEntry)
+    {
+        pConnection = CONTAINING_RECORD(pEntry, NET_TCP_CONNECTION, HashEntry);
+        RfcReference(&pConnection->RefCnt);
+    }
+    RwSpinlockReleaseShared(&m_netStackData.TcpLock, intrState);
+
+    return pConnection;
+}
+
+PTR_SUCCESS
+static
+PNET_TCP_CONNECTION
+_NetTcpCreatePassiveConnection(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    )
+{
+    STATUS status;
+    PNET_TCP_CONNECTION pConnection;
+    PNET_TCP_CONNECTION pResult;
+    PNET_TCP_LISTENER pListener;
+    PHASH_ENTRY pEntry;
+    INTR_STATE intrState;
+    INTR_STATE listenerIntrState;
+    BOOLEAN bListening;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Tuple );
+    ASSERT( NULL != Segment );
+
+    // the buffers are not allocated under the lock, check first there is
+    // somebody to accept the connection
+    RwSpinlockAcquireShared(&m_netStackData.TcpLock, &intrState);
+    bListening = NULL != HashTableLookup(&m_netStackData.TcpListeners, (PHASH_KEY) &Tuple->LocalPort);
+    RwSpinlockReleaseShared(&m_netStackData.TcpLock, intrState);
+
+    if (!bListening)
+    {
+        return NULL;
+    }
+
+    status = _NetTcpCreateConnection(Device, Tuple, &pConnection);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_NetTcpCreateConnection", status);
+        return NULL;
+    }
+
+    // nobody else can see the connection yet
+    pConnection->State = NetTcpStateSynReceived;
+    pConnection->Irs = NETWORK_ORDER_DWORD(Segment->SequenceNumber);
+    pConnection->RcvNxt = pConnection->Irs + 1;
+    _NetTcpApplySynOptions(pConnection, Segment, HeaderLength);
+
+    // the window of a SYN is never scaled
+    pConnection->SndWnd = NETWORK_ORDER_WORD(Segment->WindowSize);
+    pConnection->SndWl1 = pConnection->Irs;
+
+    _NetTcpInitSequenceSpace(pConnection);
+
+    pResult = NULL;
+
+    RwSpinlockAcquireExclusive(&m_netStackData.TcpLock, &intrState);
+
+    // another receive thread may have created the connection meanwhile
+    pEntry = HashTableLookup(&m_netStackData.TcpConnections, (PHASH_KEY) Tuple);
+    if (NULL != pEntry)
+    {
+        pResult = CONTAINING_RECORD(pEntry, NET_TCP_CONNECTION, HashEntry);
+        RfcReference(&pResult->RefCnt);
+    }
+    else
+    {
+        pEntry = HashTableLookup(&m_netStackData.TcpListeners, (PHASH_KEY) &Tuple->LocalPort);
+        if (NULL != pEntry)
+        {
+            pListener = CONTAINING_RECORD(pEntry, NET_TCP_LISTENER, HashEntry);
+
+            LockAcquire(&pListener->Lock, &listenerIntrState);
+            if (!pListener->Closed && pListener->PendingConnections < pListener->Backlog)
+            {
+                pListener->PendingConnections++;
+                pResult = pConnection;
+            }
+            LockRelease(&pListener->Lock, listenerIntrState);
+
+            if (pResult == pConnection)
+            {
+                RfcReference(&pListener->RefCnt);
+                pConnection->Listener = pListener;
+
+                _NetTcpInsertConnection(pConnection);
+
+                // the reference of the caller
+                RfcReference(&pConnection->RefCnt);
+            }
+        }
+    }
+
+    RwSpinlockReleaseExclusive(&m_netStackData.TcpLock, intrState);
+
+    if (pResult != pConnection)
+    {
+        LOG_TRACE_NETWORK("SYN to port %u not accepted\n", Tuple->LocalPort);
+        RfcDereference(&pConnection->RefCnt);
+    }
+
+    return pResult;
+}
+
+static
+void
+_NetTcpParseOptions(
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength,
+    OUT         WORD*                   Mss,
+    OUT         BYTE*                   WindowShift
+    )
+{
+    PBYTE pOption;
+    PBYTE pEnd;
+    BYTE optionLength;
+
+    ASSERT( NULL != Segment );
+    ASSERT( NULL != Mss );
+    ASSERT( NULL != WindowShift );
+
+    *Mss = NET_TCP_DEFAULT_MSS;
+
+    // MAX_BYTE means the peer does not scale its window
+    *WindowShift = MAX_BYTE;
+
+    pOption = (PBYTE) Segment + TCP_SEGMENT_SIZE;
+    pEnd = (PBYTE) Segment + HeaderLength;
+
+    while (pOption < pEnd && TCP_OPTION_END != pOption[0])
+    {
+        if (TCP_OPTION_NOP == pOption[0])
+        {
+            pOption++;
+            continue;
+        }
+
+        if (pOption + 1 >= pEnd)
+        {
+            break;
+        }
+
+        optionLength = pOption[1];
+        if (optionLength < 2 || pOption + optionLength > pEnd)
+        {
+            break;
+        }
+
+        if (TCP_OPTION_MSS == pOption[0] && TCP_OPTION_MSS_SIZE == optionLength)
+        {
+            *Mss = NETWORK_ORDER_WORD(*(PWORD) (pOption + 2));
+        }
+        else if (TCP_OPTION_WINDOW_SCALE == pOption[0] && TCP_OPTION_WINDOW_SCALE_SIZE == optionLength)
+        {
+            *WindowShift = (BYTE) min(pOption[2], TCP_MAX_WINDOW_SCALE);
+        }
+
+        pOption += optionLength;
+    }
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpApplySynOptions(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    )
+{
+    WORD mss;
+    BYTE windowShift;
+
+    ASSERT( NULL != Connection );
+    ASSERT( NULL != Segment );
+
+    _NetTcpParseOptions(Segment, HeaderLength, &mss, &windowShift);
+
+    Connection->Mss = (WORD) max(min(mss, NET_TCP_LOCAL_MSS), NET_TCP_DEFAULT_MSS / 2);
+
+    // RFC 7323: the windows are scaled only if both sides asked for it
+    if (MAX_BYTE == windowShift)
+    {
+        Connection->SndWndShift = 0;
+        Connection->RcvWndShift = 0;
+    }
+    else
+    {
+        Connection->SndWndShift = windowShift;
+    }
+
+    Connection->Cwnd = NET_TCP_INITIAL_WINDOW_SEGMENTS * Connection->Mss;
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpProcessSegment(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength,
+    IN_READS_BYTES(DataLength)
+                PBYTE                   Data,
+    IN          DWORD                   DataLength
+    )
+{
+    DWORD sequence;
+    DWORD ack;
+    DWORD duplicateLength;
+    BOOLEAN bFin;
+    QWORD nowUs;
+
+    ASSERT( NULL != Connection );
+    ASSERT( NULL != Segment );
+
+    switch (Connection->State)
+    {
+    case NetTcpStateClosed:
+        return !Segment->RST;
+    case NetTcpStateSynSent:
+        return _NetTcpProcessSynSent(Connection, Segment, HeaderLength);
+    default:
+        break;
+    }
+
+    sequence = NETWORK_ORDER_DWORD(Segment->SequenceNumber);
+    ack = NETWORK_ORDER_DWORD(Segment->AckNumber);
+    bFin = (BOOLEAN) Segment->FIN;
+    nowUs = IoGetSystemTimeUs();
+
+    if (Segment->RST)
+    {
+        // RFC 5961: only a reset carrying exactly the next expected sequence
+        // number is accepted, the others may be blind attacks
+        if (sequence == Connection->RcvNxt)
+        {
+            _NetTcpSetClosed(Connection, STATUS_CONNECTION_RESET);
+        }
+        return FALSE;
+    }
+
+    if (Segment->SYN)
+    {
+        if (NetTcpStateSynReceived == Connection->State && sequence == Connection->Irs)
+        {
+            // our SYN-ACK was lost, send it again
+            Connection->SndNxt = Connection->Iss;
+        }
+        else
+        {
+            // RFC 5961: challenge ACK
+            Connection->AckPending = TRUE;
+        }
+        return FALSE;
+    }
+
+    if (!Segment->ACK)
+    {
+        return FALSE;
+    }
+
+    // the data already received is trimmed, the segments which follow a
+    // gap are dropped and will be retransmitted (we do not implement SACK)
+    if (NET_TCP_SEQ_LT(sequence, Connection->RcvNxt))
+    {
+        duplicateLength = Connection->RcvNxt - sequence;
+        if (duplicateLength > DataLength)
+        {
+            DataLength = 0;
+            bFin = FALSE;
+        }
+        else
+        {
+            Data += duplicateLength;
+            DataLength -= duplicateLength;
+        }
+        sequence = Connection->RcvNxt;
+
+        // the peer may have lost our ACK
+        Connection->AckPending = TRUE;
+    }
+    else if (NET_TCP_SEQ_GT(sequence, Connection->RcvNxt))
+    {
+        if (0 != DataLength || bFin)
+        {
+            // the duplicate ACK lets the peer know about the hole
+            Connection->AckPending = TRUE;
+        }
+        DataLength = 0;
+        bFin = FALSE;
+    }
+
+    if (Connection->FinReceived)
+    {
+        DataLength = 0;
+        bFin = FALSE;
+    }
+
+    if (DataLength > _NetTcpReceiveSpace(Connection))
+    {
+        DataLength = _NetTcpReceiveSpace(Connection);
+        bFin = FALSE;
+        Connection->AckPending = TRUE;
+    }
+
+    if (NetTcpStateSynReceived == Connection->State)
+    {
+        if (NET_TCP_SEQ_LE(ack, Connection->SndUna) || NET_TCP_SEQ_GT(ack, Connection->SndMax))
+        {
+            return TRUE;
+        }
+
+        Connection->SndWnd = (DWORD) NETWORK_ORDER_WORD(Segment->WindowSize) << Connection->SndWndShift;
+        Connection->SndWl1 = sequence;
+        Connection->SndWl2 = ack;
+
+        if (!_NetTcpSetEstablished(Connection))
+        {
+            // the listener was closed during the handshake
+            _NetTcpSetClosed(Connection, STATUS_CONNECTION_RESET);
+            return TRUE;
+        }
+    }
+
+    if (NET_TCP_SEQ_GT(ack, Connection->SndMax))
+    {
+        // acknowledges something we never sent
+        Connection->AckPending = TRUE;
+        return FALSE;
+    }
+
+    _NetTcpProcessAck(Connection,
+                      sequence,
+                      ack,
+                      NETWORK_ORDER_WORD(Segment->WindowSize),
+                      0 != DataLength || bFin,
+                      nowUs);
+
+    if (NetTcpStateClosed == Connection->State)
+    {
+        return FALSE;
+    }
+
+    if (0 != DataLength &&
+        (NetTcpStateEstablished == Connection->State ||
+         NetTcpStateFinWait1 == Connection->State ||
+         NetTcpStateFinWait2 == Connection->State))
+    {
+        _NetTcpRingWrite(Connection->ReceiveBuffer,
+                         NET_TCP_RECEIVE_BUFFER_SIZE,
+                         Connection->ReceiveHead + Connection->ReceiveBytes,
+                         Data,
+                         DataLength);
+
+        Connection->ReceiveBytes += DataLength;
+        Connection->RcvNxt += DataLength;
+
+        // RFC 1122: an ACK is delayed, but at least every second full
+        // segment is acknowledged immediately
+        if (0 != Connection->DelayedAckDeadlineUs)
+        {
+            Connection->AckPending = TRUE;
+        }
+        else
+        {
+            Connection->DelayedAckDeadlineUs = nowUs + NET_TCP_DELAYED_ACK_US;
+        }
+
+        ExEventSignal(&Connection->StateChanged);
+    }
+
+    if (bFin)
+    {
+        Connection->RcvNxt++;
+        Connection->FinReceived = TRUE;
+        Connection->AckPending = TRUE;
+
+        switch (Connection->State)
+        {
+        case NetTcpStateEstablished:
+            Connection->State = NetTcpStateCloseWait;
+            break;
+        case NetTcpStateFinWait1:
+            // our FIN was not yet acknowledged
+            Connection->State = NetTcpStateClosing;
+            break;
+        case NetTcpStateFinWait2:
+            Connection->State = NetTcpStateTimeWait;
+            break;
+        default:
+            break;
+        }
+
+        ExEventSignal(&Connection->StateChanged);
+    }
+
+    if (NetTcpStateTimeWait == Connection->State && Connection->AckPending)
+    {
+        // the peer retransmitted its FIN, it must be given time to receive
+        // the ACK
+        Connection->CloseDeadlineUs = nowUs + NET_TCP_TIME_WAIT_US;
+    }
+
+    return FALSE;
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpProcessSynSent(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   HeaderLength
+    )
+{
+    DWORD sequence;
+    DWORD ack;
+
+    ASSERT( NULL != Connection );
+    ASSERT( NULL != Segment );
+
+    sequence = NETWORK_ORDER_DWORD(Segment->SequenceNumber);
+    ack = NETWORK_ORDER_DWORD(Segment->AckNumber);
+
+    if (Segment->ACK &&
+        (NET_TCP_SEQ_LE(ack, Connection->Iss) || NET_TCP_SEQ_GT(ack, Connection->SndMax)))
+    {
+        return !Segment->RST;
+    }
+
+    if (Segment->RST)
+    {
+        if (Segment->ACK)
+        {
+            _NetTcpSetClosed(Connection, STATUS_CONNECTION_REFUSED);
+        }
+        return FALSE;
+    }
+
+    if (!Segment->SYN)
+    {
+        return FALSE;
+    }
+
+    Connection->Irs = sequence;
+    Connection->RcvNxt = sequence + 1;
+    _NetTcpApplySynOptions(Connection, Segment, HeaderLength);
+
+    // the window of a SYN is never scaled
+    Connection->SndWnd = NETWORK_ORDER_WORD(Segment->WindowSize);
+    Connection->SndWl1 = sequence;
+
+    if (!Segment->ACK)
+    {
+        // simultaneous open, our SYN is sent again together with an ACK
+        Connection->State = NetTcpStateSynReceived;
+        Connection->SndNxt = Connection->Iss;
+        return FALSE;
+    }
+
+    Connection->SndWl2 = ack;
+    Connection->SndUna = ack;
+
+    if (Connection->RttTiming)
+    {
+        _NetTcpUpdateRto(Connection, IoGetSystemTimeUs() - Connection->RttStartUs);
+        Connection->RttTiming = FALSE;
+    }
+
+    Connection->Retransmissions = 0;
+    Connection->RetransmitDeadlineUs = 0;
+    Connection->AckPending = TRUE;
+
+    _NetTcpSetEstablished(Connection);
+
+    return FALSE;
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpProcessAck(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          DWORD                   Sequence,
+    IN          DWORD                   Ack,
+    IN          WORD                    Window,
+    IN          BOOLEAN                 CarriesData,
+    IN          QWORD                   NowUs
+    )
+{
+    DWORD window;
+    DWORD acked;
+    DWORD dataAcked;
+    DWORD flightSize;
+
+    ASSERT( NULL != Connection );
+
+    window = (DWORD) Window << Connection->SndWndShift;
+
+    if (NET_TCP_SEQ_LE(Ack, Connection->SndUna))
+    {
+        // RFC 5681: only the pure ACKs which change nothing while data is
+        // outstanding count as duplicates
+        if (Ack == Connection->SndUna &&
+            !CarriesData &&
+            window == Connection->SndWnd &&
+            Connection->SndUna != Connection->SndMax)
+        {
+            Connection->DupAcks++;
+
+            if (Connection->FastRecovery)
+            {
+                // each duplicate means a segment left the network
+                Connection->Cwnd += Connection->Mss;
+            }
+            else if (NET_TCP_DUP_ACK_THRESHOLD == Connection->DupAcks &&
+                     NET_TCP_SEQ_GT(Ack, Connection->Recover))
+            {
+                // fast retransmit, RFC 6582 NewReno
+                flightSize = Connection->SndMax - Connection->SndUna;
+
+                Connection->Ssthresh = max(flightSize / 2, 2 * (DWORD) Connection->Mss);
+                Connection->Cwnd = Connection->Ssthresh + NET_TCP_DUP_ACK_THRESHOLD * Connection->Mss;
+                Connection->Recover = Connection->SndMax;
+                Connection->FastRecovery = TRUE;
+                Connection->RetransmitUna = TRUE;
+                Connection->RttTiming = FALSE;
+            }
+        }
+    }
+    else
+    {
+        acked = Ack - Connection->SndUna;
+
+        // Karn's algorithm, only the segments sent once are timed
+        if (Connection->RttTiming && NET_TCP_SEQ_GT(Ack, Connection->RttSequence))
+        {
+            _NetTcpUpdateRto(Connection, NowUs - Connection->RttStartUs);
+            Connection->RttTiming = FALSE;
+        }
+
+        // the SYN and the FIN occupy a sequence number each, but no place
+        // in the send buffer
+        dataAcked = acked;
+        if (Connection->SndUna == Connection->Iss)
+        {
+            dataAcked--;
+        }
+
+        if (Connection->FinQueued && dataAcked > Connection->SendBytes)
+        {
+            Connection->FinAcked = TRUE;
+            dataAcked = Connection->SendBytes;
+        }
+
+        Connection->SendHead = (Connection->SendHead + dataAcked) % NET_TCP_SEND_BUFFER_SIZE;
+        Connection->SendBytes -= dataAcked;
+
+        Connection->SndUna = Ack;
+        if (NET_TCP_SEQ_LT(Connection->SndNxt, Connection->SndUna))
+        {
+            Connection->SndNxt = Connection->SndUna;
+        }
+
+        if (Connection->FastRecovery)
+        {
+            if (NET_TCP_SEQ_GE(Ack, Connection->Recover))
+            {
+                // full ACK, deflate the window
+                Connection->Cwnd = Connection->Ssthresh;
+                Connection->FastRecovery = FALSE;
+            }
+            else
+            {
+                // partial ACK, the next hole is retransmitted right away
+                Connection->Cwnd = (Connection->Cwnd > acked ? Connection->Cwnd - acked : 0) + Connection->Mss;
+                Connection->RetransmitUna = TRUE;
+            }
+        }
+        else if (Connection->Cwnd < Connection->Ssthresh)
+        {
+            // slow start
+            Connection->Cwnd += min(acked, Connection->Mss);
+        }
+        else
+        {
+            // congestion avoidance, about one MSS per round trip
+            Connection->Cwnd += max(1, Connection->Mss * Connection->Mss / Connection->Cwnd);
+        }
+
+        Connection->DupAcks = 0;
+        Connection->Retransmissions = 0;
+        Connection->RetransmitDeadlineUs = Connection->SndUna == Connection->SndMax ? 0 : NowUs + Connection->RtoUs;
+
+        if (Connection->FinAcked)
+        {
+            switch (Connection->State)
+            {
+            case NetTcpStateFinWait1:
+                Connection->State = NetTcpStateFinWait2;
+                if (Connection->HandleClosed)
+                {
+                    Connection->CloseDeadlineUs = NowUs + NET_TCP_FIN_WAIT2_TIMEOUT_US;
+                }
+                break;
+            case NetTcpStateClosing:
+                Connection->State = NetTcpStateTimeWait;
+                Connection->CloseDeadlineUs = NowUs + NET_TCP_TIME_WAIT_US;
+                break;
+            case NetTcpStateLastAck:
+                _NetTcpSetClosed(Connection, STATUS_SUCCESS);
+                break;
+            default:
+                break;
+            }
+        }
+
+        // there is room in the send buffer
+        ExEventSignal(&Connection->StateChanged);
+    }
+
+    // RFC 793: the window is taken only from the most recent segments
+    if (NET_TCP_SEQ_LT(Connection->SndWl1, Sequence) ||
+        (Connection->SndWl1 == Sequence && NET_TCP_SEQ_LE(Connection->SndWl2, Ack)))
+    {
+        Connection->SndWnd = window;
+        Connection->SndWl1 = Sequence;
+        Connection->SndWl2 = Ack;
+    }
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+BOOLEAN
+_NetTcpSetEstablished(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    )
+{
+    PNET_TCP_LISTENER pListener;
+    INTR_STATE intrState;
+    BOOLEAN bQueued;
+
+    ASSERT( NULL != Connection );
+
+    pListener = Connection->Listener;
+    if (NULL != pListener)
+    {
+        LockAcquire(&pListener->Lock, &intrState);
+        bQueued = !pListener->Closed;
+        if (bQueued)
+        {
+            InsertTailList(&pListener->AcceptQueue, &Connection->AcceptListEntry);
+            Connection->InAcceptQueue = TRUE;
+        }
+        LockRelease(&pListener->Lock, intrState);
+
+        if (!bQueued)
+        {
+            return FALSE;
+        }
+
+        ExEventSignal(&pListener->ConnectionAvailable);
+    }
+
+    Connection->State = NetTcpStateEstablished;
+    ExEventSignal(&Connection->StateChanged);
+
+    return TRUE;
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpSetClosed(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          STATUS                  Error
+    )
+{
+    ASSERT( NULL != Connection );
+
+    LOG_TRACE_NETWORK("Connection %u -> %u closed in state %u with status 0x%x\n",
+                      Connection->Tuple.LocalPort, Connection->Tuple.RemotePort,
+                      Connection->State, Error);
+
+    Connection->State = NetTcpStateClosed;
+    Connection->Error = Error;
+
+    Connection->AckPending = FALSE;
+    Connection->RetransmitDeadlineUs = 0;
+    Connection->DelayedAckDeadlineUs = 0;
+    Connection->CloseDeadlineUs = 0;
+
+    ExEventSignal(&Connection->StateChanged);
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpUpdateRto(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   SampleUs
+    )
+{
+    QWORD delta;
+
+    ASSERT( NULL != Connection );
+
+    // RFC 6298
+    if (0 == Connection->SrttUs)
+    {
+        Connection->SrttUs = SampleUs;
+        Connection->RttVarUs = SampleUs / 2;
+    }
+    else
+    {
+        delta = Connection->SrttUs > SampleUs ? Connection->SrttUs - SampleUs : SampleUs - Connection->SrttUs;
+
+        Connection->RttVarUs = (3 * Connection->RttVarUs + delta) / 4;
+        Connection->SrttUs = (7 * Connection->SrttUs + SampleUs) / 8;
+    }
+
+    Connection->RtoUs = Connection->SrttUs + max(NET_TCP_TIMER_TICK_US, 4 * Connection->RttVarUs);
+    Connection->RtoUs = min(max(Connection->RtoUs, NET_TCP_MIN_RTO_US), NET_TCP_MAX_RTO_US);
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpProcessTimers(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   NowUs
+    )
+{
+    ASSERT( NULL != Connection );
+
+    if (_NetTcpIsDeadlineReached(Connection->DelayedAckDeadlineUs, NowUs))
+    {
+        Connection->DelayedAckDeadlineUs = 0;
+        Connection->AckPending = TRUE;
+    }
+
+    if (_NetTcpIsDeadlineReached(Connection->RetransmitDeadlineUs, NowUs))
+    {
+        _NetTcpRetransmitTimeout(Connection, NowUs);
+    }
+
+    if (_NetTcpIsDeadlineReached(Connection->CloseDeadlineUs, NowUs))
+    {
+        // TIME_WAIT ended or the peer never closed its side
+        _NetTcpSetClosed(Connection,
+                         NetTcpStateTimeWait == Connection->State ? STATUS_SUCCESS : STATUS_TIMEOUT);
+    }
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+void
+_NetTcpRetransmitTimeout(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          QWORD                   NowUs
+    )
+{
+    BOOLEAN bHandshake;
+    DWORD flightSize;
+
+    ASSERT( NULL != Connection );
+
+    bHandshake = NetTcpStateSynSent == Connection->State || NetTcpStateSynReceived == Connection->State;
+
+    if (!bHandshake && 0 == Connection->SndWnd)
+    {
+        // persist timer, the window is probed for as long as the peer
+        // keeps answering
+        Connection->ProbeWindow = TRUE;
+        Connection->SndNxt = Connection->SndUna;
+    }
+    else
+    {
+        Connection->Retransmissions++;
+        if (Connection->Retransmissions > (bHandshake ? NET_TCP_MAX_SYN_RETRANSMISSIONS : NET_TCP_MAX_RETRANSMISSIONS))
+        {
+            _NetTcpSetClosed(Connection, STATUS_TIMEOUT);
+            return;
+        }
+
+        if (bHandshake)
+        {
+            Connection->SndNxt = Connection->Iss;
+        }
+        else
+        {
+            // RFC 5681: the loss is a sign of heavy congestion, restart with
+            // a single segment and go back to the first unacknowledged one
+            flightSize = Connection->SndMax - Connection->SndUna;
+
+            Connection->Ssthresh = max(flightSize / 2, 2 * (DWORD) Connection->Mss);
+            Connection->Cwnd = Connection->Mss;
+            Connection->Recover = Connection->SndMax;
+            Connection->FastRecovery = FALSE;
+            Connection->DupAcks = 0;
+            Connection->SndNxt = Connection->SndUna;
+        }
+    }
+
+    Connection->RttTiming = FALSE;
+    Connection->RtoUs = min(2 * Connection->RtoUs, NET_TCP_MAX_RTO_US);
+    Connection->RetransmitDeadlineUs = NowUs + Connection->RtoUs;
+}
+
+REQUIRES_EXCL_LOCK(Connection->Lock)
+static
+WORD
+_NetTcpBuildSegment(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    OUT         PETHERNET_FRAME         Frame,
+    OUT         DWORD*                  Offloads
+    )
+{
+    PTCP_SEGMENT pSegment;
+    PBYTE pOptions;
+    BYTE optionsSize;
+    DWORD sequence;
+    DWORD offset;
+    DWORD available;
+    DWORD window;
+    DWORD usable;
+    DWORD length;
+    DWORD space;
+    BOOLEAN bFin;
+    BYTE flags;
+    WORD advertisedWindow;
+    WORD tcpLength;
+
+    ASSERT( NULL != Connection );
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != Offloads );
+
+    pSegment = (PTCP_SEGMENT) NET_IP4_PAYLOAD(Frame);
+    space = _NetTcpReceiveSpace(Connection);
+
+    switch (Connection->State)
+    {
+    case NetTcpStateClosed:
+        return 0;
+    case NetTcpStateSynSent:
+    case NetTcpStateSynReceived:
+        if (Connection->SndNxt != Connection->Iss)
+        {
+            return 0;
+        }
+
+        pOptions = (PBYTE) pSegment + TCP_SEGMENT_SIZE;
+        pOptions[0] = TCP_OPTION_MSS;
+        pOptions[1] = TCP_OPTION_MSS_SIZE;
+        *(PWORD) (pOptions + 2) = NETWORK_ORDER_WORD(NET_TCP_LOCAL_MSS);
+
+        optionsSize = TCP_OPTION_MSS_SIZE;
+
+        // we offer to scale the window when connecting, when accepting we
+        // scale it only if the peer offered too
+        if (NetTcpStateSynSent == Connection->State || 0 != Connection->RcvWndShift)
+        {
+            pOptions[4] = TCP_OPTION_NOP;
+            pOptions[5] = TCP_OPTION_WINDOW_SCALE;
+            pOptions[6] = TCP_OPTION_WINDOW_SCALE_SIZE;
+            pOptions[7] = Connection->RcvWndShift;
+            optionsSize = NET_TCP_SYN_OPTIONS_SIZE;
+        }
+
+        flags = NET_TCP_FLAG_SYN;
+        if (NetTcpStateSynReceived == Connection->State)
+        {
+            flags |= NET_TCP_FLAG_ACK;
+        }
+
+        // the window of a SYN is never scaled
+        advertisedWindow = (WORD) min(space, MAX_WORD);
+        Connection->RcvAdv = Connection->RcvNxt + advertisedWindow;
+
+        tcpLength = _NetTcpFillSegment(Connection->Device,
+                                       &Connection->Tuple,
+                                       pSegment,
+                                       Connection->Iss,
+                                       Connection->RcvNxt,
+                                       flags,
+                                       advertisedWindow,
+                                       optionsSize,
+                                       0,
+                                       Offloads);
+
+        if (!Connection->RttTiming && 0 == Connection->Retransmissions)
+        {
+            Connection->RttTiming = TRUE;
+            Connection->RttSequence = Connection->Iss;
+            Connection->RttStartUs = IoGetSystemTimeUs();
+        }
+
+        Connection->SndNxt = Connection->Iss + 1;
+        Connection->SndMax = Connection->SndNxt;
+        if (0 == Connection->RetransmitDeadlineUs)
+        {
+            Connection->RetransmitDeadlineUs = IoGetSystemTimeUs() + Connection->RtoUs;
+        }
+        Connection->AckPending = FALSE;
+
+        return tcpLength;
+    default:
+        break;
+    }
+
+    length = 0;
+    bFin = FALSE;
+    sequence = Connection->SndNxt;
+    offset = Connection->SndNxt - Connection->SndUna;
+
+    // after the FIN was sent the offset is one past the data
+    available = Connection->SendBytes > offset ? Connection->SendBytes - offset : 0;
+
+    if (Connection->RetransmitUna)
+    {
+        // fast retransmit: the first unacknowledged segment is sent outside
+        // the congestion window
+        Connection->RetransmitUna = FALSE;
+
+        sequence = Connection->SndUna;
+        length = min(Connection->SendBytes, Connection->Mss);
+        bFin = Connection->FinQueued && length == Connection->SendBytes;
+    }
+
+    if (0 == length && !bFin)
+    {
+        sequence = Connection->SndNxt;
+
+        window = min(Connection->SndWnd, Connection->Cwnd);
+        usable = window > offset ? window - offset : 0;
+        length = min(min(available, usable), Connection->Mss);
+
+        if (Connection->ProbeWindow && 0 == Connection->SndWnd && 0 != available)
+        {
+            length = 1;
+        }
+        Connection->ProbeWindow = FALSE;
+
+        // sender SWS avoidance: a small segment is sent only if it carries
+        // the last queued data or if nothing else is in flight
+        if (length < Connection->Mss && length < available && 0 != offset)
+        {
+            length = 0;
+        }
+
+        bFin = Connection->FinQueued && offset + length == Connection->SendBytes;
+
+        if (0 != available && 0 == length && 0 == offset && 0 == Connection->RetransmitDeadlineUs)
+        {
+            // the peer closed its window, arm the persist timer
+            Connection->RetransmitDeadlineUs = IoGetSystemTimeUs() + Connection->RtoUs;
+        }
+    }
+
+    if (0 == length && !bFin && !Connection->AckPending)
+    {
+        return 0;
+    }
+
+    _NetTcpRingRead(Connection->SendBuffer,
+                    NET_TCP_SEND_BUFFER_SIZE,
+                    Connection->SendHead + (sequence - Connection->SndUna),
+                    (PBYTE) pSegment + TCP_SEGMENT_SIZE,
+                    length);
+
+    flags = NET_TCP_FLAG_ACK;
+    if (bFin)
+    {
+        flags |= NET_TCP_FLAG_FIN;
+    }
+    if (0 != length && sequence + length == Connection->SndUna + Connection->SendBytes)
+    {
+        flags |= NET_TCP_FLAG_PSH;
+    }
+
+    advertisedWindow = (WORD) min(space >> Connection->RcvWndShift, MAX_WORD);
+    Connection->RcvAdv = Connection->RcvNxt + ((DWORD) advertisedWindow << Connection->RcvWndShift);
+
+    tcpLength = _NetTcpFillSegment(Connection->Device,
+                                   &Connection->Tuple,
+                                   pSegment,
+                                   sequence,
+                                   Connection->RcvNxt,
+                                   flags,
+                                   advertisedWindow,
+                                   0,
+                                   (WORD) length,
+                                   Offloads);
+
+    if (0 != length || bFin)
+    {
+        if (!Connection->RttTiming && NET_TCP_SEQ_GE(sequence, Connection->SndMax))
+        {
+            Connection->RttTiming = TRUE;
+            Connection->RttSequence = sequence;
+            Connection->RttStartUs = IoGetSystemTimeUs();
+        }
+
+        if (NET_TCP_SEQ_GT(sequence + length + bFin, Connection->SndNxt))
+        {
+            Connection->SndNxt = sequence + length + bFin;
+        }
+
+        if (NET_TCP_SEQ_GT(Connection->SndNxt, Connection->SndMax))
+        {
+            Connection->SndMax = Connection->SndNxt;
+        }
+
+        if (0 == Connection->RetransmitDeadlineUs)
+        {
+            Connection->RetransmitDeadlineUs = IoGetSystemTimeUs() + Connection->RtoUs;
+        }
+    }
+
+    // the segment carries the ACK for everything received
+    Connection->AckPending = FALSE;
+    Connection->DelayedAckDeadlineUs = 0;
+
+    return tcpLength;
+}
+
+static
+WORD
+_NetTcpFillSegment(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_TCP_TUPLE          Tuple,
+    OUT         PTCP_SEGMENT            Segment,
+    IN          DWORD                   Sequence,
+    IN          DWORD                   Ack,
+    IN          BYTE                    Flags,
+    IN          WORD                    Window,
+    IN          BYTE                    OptionsSize,
+    IN          WORD                    DataSize,
+    OUT         DWORD*                  Offloads
+    )
+{
+    WORD tcpLength;
+    DWORD sum;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Tuple );
+    ASSERT( NULL != Segment );
+    ASSERT( NULL != Offloads );
+    ASSERT( 0 == OptionsSize % sizeof(DWORD) );
+
+    tcpLength = (WORD) (TCP_SEGMENT_SIZE + OptionsSize + DataSize);
+
+    Segment->Source = NETWORK_ORDER_WORD(Tuple->LocalPort);
+    Segment->Destination = NETWORK_ORDER_WORD(Tuple->RemotePort);
+    Segment->SequenceNumber = NETWORK_ORDER_DWORD(Sequence);
+    Segment->AckNumber = IsBooleanFlagOn(Flags, NET_TCP_FLAG_ACK) ? NETWORK_ORDER_DWORD(Ack) : 0;
+
+    Segment->NS = 0;
+    Segment->__Reserved0 = 0;
+    Segment->DataOffset = (TCP_SEGMENT_SIZE + OptionsSize) / sizeof(DWORD);
+    Segment->FIN = IsBooleanFlagOn(Flags, NET_TCP_FLAG_FIN);
+    Segment->SYN = IsBooleanFlagOn(Flags, NET_TCP_FLAG_SYN);
+    Segment->RST = IsBooleanFlagOn(Flags, NET_TCP_FLAG_RST);
+    Segment->PSH = IsBooleanFlagOn(Flags, NET_TCP_FLAG_PSH);
+    Segment->ACK = IsBooleanFlagOn(Flags, NET_TCP_FLAG_ACK);
+    Segment->URG = 0;
+    Segment->ECE = 0;
+    Segment->CWR = 0;
+
+    Segment->WindowSize = NETWORK_ORDER_WORD(Window);
+    Segment->Checksum = 0;
+    Segment->UrgentPointer = 0;
+
+    sum = NetIp4PseudoHeaderSum(Tuple->LocalAddress, Tuple->RemoteAddress, IP_PROTOCOL_TCP, tcpLength);
+
+    if (IsBooleanFlagOn(Device->Info.OffloadCapabilities.Offloads, NETWORK_OFFLOAD_TX_TCP_CHECKSUM))
+    {
+        // the device adds the segment to the sum of the pseudo header
+        Segment->Checksum = (WORD) ~NetUtilChecksumFinish(sum);
+        *Offloads = NETWORK_OFFLOAD_TX_TCP_CHECKSUM;
+    }
+    else
+    {
+        Segment->Checksum = NetUtilChecksumFinish(NetUtilChecksumAdd(Segment, tcpLength, sum));
+        *Offloads = 0;
+    }
+
+    return tcpLength;
+}
+
+static
+void
+_NetTcpOutput(
+    INOUT       PNET_TCP_CONNECTION     Connection,
+    IN          BOOLEAN                 CanWait
+    )
+{
+    STATUS status;
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    INTR_STATE intrState;
+    WORD tcpLength;
+    DWORD offloads;
+
+    ASSERT( NULL != Connection );
+
+    // the segments are built under the lock, but sent after releasing it
+    do
+    {
+        LockAcquire(&Connection->Lock, &intrState);
+        tcpLength = _NetTcpBuildSegment(Connection, (PETHERNET_FRAME) buffer, &offloads);
+        LockRelease(&Connection->Lock, intrState);
+
+        if (0 != tcpLength)
+        {
+            status = NetIp4SendPacket(Connection->Device,
+                                      (PETHERNET_FRAME) buffer,
+                                      Connection->Tuple.RemoteAddress,
+                                      IP_PROTOCOL_TCP,
+                                      tcpLength,
+                                      offloads,
+                                      CanWait);
+            if (!SUCCEEDED(status))
+            {
+                // the retransmission timer will send the data again
+                LOG_TRACE_NETWORK("NetIp4SendPacket failed with status 0x%x\n", status);
+                break;
+            }
+        }
+    } while (0 != tcpLength);
+}
+
+static
+void
+_NetTcpSendReset(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PIP4_PACKET             Header,
+    IN          PTCP_SEGMENT            Segment,
+    IN          DWORD                   SegmentLength
+    )
+{
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    NET_TCP_TUPLE tuple;
+    WORD tcpLength;
+    DWORD offloads;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Header );
+    ASSERT( NULL != Segment );
+
+    // a reset is never answered
+    if (Segment->RST)
+    {
+        return;
+    }
+
+    tuple.LocalAddress = Header->Destination;
+    tuple.RemoteAddress = Header->Source;
+    tuple.LocalPort = NETWORK_ORDER_WORD(Segment->Destination);
+    tuple.RemotePort = NETWORK_ORDER_WORD(Segment->Source);
+
+    // RFC 793: the reset takes its sequence number from the ACK field if
+    // there is one, else it acknowledges the offending segment
+    if (Segment->ACK)
+    {
+        tcpLength = _NetTcpFillSegment(Device,
+                                       &tuple,
+                                       (PTCP_SEGMENT) NET_IP4_PAYLOAD(buffer),
+                                       NETWORK_ORDER_DWORD(Segment->AckNumber),
+                                       0,
+                                       NET_TCP_FLAG_RST,
+                                       0,
+                                       0,
+                                       0,
+                                       &offloads);
+    }
+    else
+    {
+        tcpLength = _NetTcpFillSegment(Device,
+                                       &tuple,
+                                       (PTCP_SEGMENT) NET_IP4_PAYLOAD(buffer),
+                                       0,
+                                       NETWORK_ORDER_DWORD(Segment->SequenceNumber) + SegmentLength,
+                                       NET_TCP_FLAG_RST | NET_TCP_FLAG_ACK,
+                                       0,
+                                       0,
+                                       0,
+                                       &offloads);
+    }
+
+    NetIp4SendPacket(Device,
+                     (PETHERNET_FRAME) buffer,
+                     tuple.RemoteAddress,
+                     IP_PROTOCOL_TCP,
+                     tcpLength,
+                     offloads,
+                     FALSE);
+}
+
+static
+void
+_NetTcpAbort(
+    INOUT       PNET_TCP_CONNECTION     Connection
+    )
+{
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    INTR_STATE intrState;
+    WORD tcpLength;
+    DWORD offloads;
+
+    ASSERT( NULL != Connection );
+
+    tcpLength = 0;
+
+    LockAcquire(&Connection->Lock, &intrState);
+    if (NetTcpStateClosed != Connection->State)
+    {
+        // the peer knows nothing about us before receiving our SYN-ACK
+        if (NetTcpStateSynSent != Connection->State)
+        {
+            tcpLength = _NetTcpFillSegment(Connection->Device,
+                                           &Connection->Tuple,
+                                           (PTCP_SEGMENT) NET_IP4_PAYLOAD(buffer),
+                                           Connection->SndNxt,
+                                           0,
+                                           NET_TCP_FLAG_RST,
+                                           0,
+                                           0,
+                                           0,
+                                           &offloads);
+        }
+
+        _NetTcpSetClosed(Connection, STATUS_CONNECTION_RESET);
+    }
+    LockRelease(&Connection->Lock, intrState);
+
+    if (0 != tcpLength)
+    {
+        NetIp4SendPacket(Connection->Device,
+                         (PETHERNET_FRAME) buffer,
+                         Connection->Tuple.RemoteAddress,
+                         IP_PROTOCOL_TCP,
+                         tcpLength,
+                         offloads,
+                         FALSE);
+    }
+
+    _NetTcpUnlinkConnection(Connection);
+}
+
+static
+void
+_NetTcpRingRead(
+    IN_READS_BYTES(RingSize)
+                PBYTE                   Ring,
+    IN          DWORD                   RingSize,
+    IN          DWORD                   Position,
+    OUT_WRITES_BYTES(Length)
+                PBYTE                   Buffer,
+    IN          DWORD                   Length
+    )
+{
+    DWORD firstLength;
+
+    ASSERT( NULL != Ring );
+    ASSERT( Length <= RingSize );
+
+    Position %= RingSize;
+    firstLength = min(Length, RingSize - Position);
+
+    memcpy(Buffer, Ring + Position, firstLength);
+    memcpy(Buffer + firstLength, Ring, Length - firstLength);
+}
+
+static
+void
+_NetTcpRingWrite(
+    OUT_WRITES_BYTES(RingSize)
+                PBYTE                   Ring,
+    IN          DWORD                   RingSize,
+    IN          DWORD                   Position,
+    IN_READS_BYTES(Length)
+                PBYTE                   Buffer,
+    IN          DWORD                   Length
+    )
+{
+    DWORD firstLength;
+
+    ASSERT( NULL != Ring );
+    ASSERT( Length <= RingSize );
+
+    Position %= RingSize;
+    firstLength = min(Length, RingSize - Position);
+
+    memcpy(Ring + Position, Buffer, firstLength);
+    memcpy(Ring, Buffer + firstLength, Length - firstLength);
+}
@@ -0,0 +1,783 @@
+#include "network_stack_base.h"
+#include "network.h"
+#include "network_internal.h"
+#include "network_ip.h"
+#include "network_udp.h"
+
+#define NET_UDP_MAX_DATA_SIZE           (NET_IP4_MAX_PAYLOAD_SIZE - UDP_DATAGRAM_SIZE)
+
+// maximum number of frames handed to a device with a single NetSendFrames
+#define NET_UDP_SEND_BATCH_SIZE         16
+
+REQUIRES_EXCL_LOCK(m_netStackData.UdpLock)
+static
+BOOLEAN
+_NetUdpIsPortBound(
+    IN          PORT_NUMBER             Port
+    );
+
+static
+void
+_NetUdpEnqueueDatagram(
+    INOUT       PNET_UDP_ENDPOINT       Endpoint,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length,
+    IN          IP4_ADDRESS             Source,
+    IN          PORT_NUMBER             SourcePort
+    );
+
+static
+DWORD
+_NetUdpDequeueDatagrams(
+    INOUT       PNET_UDP_ENDPOINT       Endpoint,
+    IN          DWORD                   MaximumDatagrams,
+    OUT_WRITES_TO(MaximumDatagrams, return)
+                PNET_UDP_QUEUED_DATAGRAM Datagrams
+    );
+
+static
+WORD
+_NetUdpBuildDatagram(
+    IN          PNET_UDP_ENDPOINT       Endpoint,
+    IN          PNETWORK_DEVICE         Device,
+    OUT_WRITES_BYTES(NET_IP4_FRAME_MAX_SIZE)
+                PBYTE                   Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          PORT_NUMBER             DestinationPort,
+    IN_READS_BYTES(Size)
+                PVOID                   Buffer,
+    IN          WORD                    Size,
+    OUT         DWORD*                  Offloads
+    );
+
+static
+void
+_NetUdpCopyDatagram(
+    IN          PNET_UDP_QUEUED_DATAGRAM Datagram,
+    OUT_WRITES_BYTES(Size)
+                PVOID                   Buffer,
+    IN          WORD                    Size,
+    OUT         WORD*                   BytesReceived
+    );
+
+_No_competing_thread_
+STATUS
+NetUdpInit(
+    void
+    )
+{
+    DWORD dataSize;
+    PHASH_TABLE_DATA pTableData;
+
+    dataSize = HashTablePreinit(&m_netStackData.UdpEndpoints, NET_UDP_MAX_ENDPOINT_KEYS, sizeof(PORT_NUMBER));
+
+    pTableData = ExAllocatePoolWithTag(PoolAllocateZeroMemory, dataSize, HEAP_NET_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", dataSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&m_netStackData.UdpEndpoints,
+                  pTableData,
+                  HashFuncGenericIncremental,
+                  FIELD_OFFSET(NET_UDP_ENDPOINT, LocalPort) - FIELD_OFFSET(NET_UDP_ENDPOINT, HashEntry));
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetUdpProcessPacket(
+    IN          PNETWORK_DEVICE         Device,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN          PIP4_PACKET             Header,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length
+    )
+{
+    PUDP_DATAGRAM pDatagram;
+    WORD udpLength;
+    PORT_NUMBER localPort;
+    PHASH_ENTRY pEntry;
+    INTR_STATE intrState;
+    DWORD sum;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != Header );
+    ASSERT( NULL != Data );
+
+    if (Length < UDP_DATAGRAM_SIZE)
+    {
+        return;
+    }
+
+    pDatagram = (PUDP_DATAGRAM) Data;
+    udpLength = NETWORK_ORDER_WORD(pDatagram->Length);
+    if (udpLength < UDP_DATAGRAM_SIZE || udpLength > Length)
+    {
+        return;
+    }
+
+    if (IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_TCP_UDP_BAD))
+    {
+        return;
+    }
+
+    // a 0 checksum means the sender did not compute it
+    if (!IsBooleanFlagOn(Frame->ChecksumStatus, NETWORK_RX_CHECKSUM_TCP_UDP_GOOD) &&
+        0 != pDatagram->Checksum)
+    {
+        sum = NetIp4PseudoHeaderSum(Header->Source, Header->Destination, IP_PROTOCOL_UDP, udpLength);
+        if (0 != NetUtilChecksumFinish(NetUtilChecksumAdd(pDatagram, udpLength, sum)))
+        {
+            return;
+        }
+    }
+
+    localPort = NETWORK_ORDER_WORD(pDatagram->Destination);
+
+    // the lock keeps the endpoint from being closed while we queue to it
+    RwSpinlockAcquireShared(&m_netStackData.UdpLock, &intrState);
+
+    pEntry = HashTableLookup(&m_netStackData.UdpEndpoints, (PHASH_KEY) &localPort);
+    if (NULL != pEntry)
+    {
+        _NetUdpEnqueueDatagram(CONTAINING_RECORD(pEntry, NET_UDP_ENDPOINT, HashEntry),
+                               Frame,
+                               Data + UDP_DATAGRAM_SIZE,
+                               (WORD) (udpLength - UDP_DATAGRAM_SIZE),
+                               Header->Source,
+                               NETWORK_ORDER_WORD(pDatagram->Source));
+    }
+
+    RwSpinlockReleaseShared(&m_netStackData.UdpLock, intrState);
+}
+
+STATUS
+NetUdpOpen(
+    IN              PORT_NUMBER                     LocalPort,
+    OUT             PNET_UDP_ENDPOINT*              Endpoint
+    )
+{
+    STATUS status;
+    PNET_UDP_ENDPOINT pEndpoint;
+    INTR_STATE intrState;
+    DWORD i;
+
+    if (NULL == Endpoint)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+
+    pEndpoint = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NET_UDP_ENDPOINT), HEAP_NET_TAG, 0);
+    if (NULL == pEndpoint)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NET_UDP_ENDPOINT));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    LockInit(&pEndpoint->QueueLock);
+
+    status = ExEventInit(&pEndpoint->DatagramAvailable, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        ExFreePoolWithTag(pEndpoint, HEAP_NET_TAG);
+        return status;
+    }
+
+    RwSpinlockAcquireExclusive(&m_netStackData.UdpLock, &intrState);
+
+    if (0 == LocalPort)
+    {
+        status = STATUS_NETWORK_ADDRESS_IN_USE;
+        for (i = NET_UDP_FIRST_EPHEMERAL_PORT; i <= MAX_WORD; ++i)
+        {
+            PORT_NUMBER port = m_netStackData.NextEphemeralPort;
+
+            m_netStackData.NextEphemeralPort = (MAX_WORD == port) ? NET_UDP_FIRST_EPHEMERAL_PORT : (PORT_NUMBER) (port + 1);
+
+            if (!_NetUdpIsPortBound(port))
+            {
+                LocalPort = port;
+                status = STATUS_SUCCESS;
+                break;
+            }
+        }
+    }
+    else if (_NetUdpIsPortBound(LocalPort))
+    {
+        status = STATUS_NETWORK_ADDRESS_IN_USE;
+    }
+
+    if (SUCCEEDED(status))
+    {
+        pEndpoint->LocalPort = LocalPort;
+        HashTableInsert(&m_netStackData.UdpEndpoints, &pEndpoint->HashEntry);
+    }
+
+    RwSpinlockReleaseExclusive(&m_netStackData.UdpLock, intrState);
+
+    if (!SUCCEEDED(status))
+    {
+        ExFreePoolWithTag(pEndpoint, HEAP_NET_TAG);
+        return status;
+    }
+
+    *Endpoint = pEndpoint;
+
+    return status;
+}
+
+void
+NetUdpClose(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    )
+{
+    INTR_STATE intrState;
+    DWORD i;
+
+    ASSERT( NULL != Endpoint );
+
+    RwSpinlockAcquireExclusive(&m_netStackData.UdpLock, &intrState);
+    HashTableRemoveEntry(&m_netStackData.UdpEndpoints, &Endpoint->HashEntry);
+    RwSpinlockReleaseExclusive(&m_netStackData.UdpLock, intrState);
+
+    // the receive threads can no longer find the endpoint
+    for (i = 0; i < Endpoint->QueueCount; ++i)
+    {
+        NetReleaseFrame(Endpoint->Queue[(Endpoint->QueueHead + i) % NET_UDP_ENDPOINT_QUEUE_SIZE].Frame);
+    }
+
+    ExFreePoolWithTag(Endpoint, HEAP_NET_TAG);
+}
+
+PORT_NUMBER
+NetUdpGetLocalPort(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    )
+{
+    ASSERT( NULL != Endpoint );
+
+    return Endpoint->LocalPort;
+}
+
+STATUS
+NetUdpSend(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    IN              IP4_ADDRESS                     Destination,
+    IN              PORT_NUMBER                     DestinationPort,
+    IN_READS_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              WORD                            Size
+    )
+{
+    BYTE buffer[NET_IP4_FRAME_MAX_SIZE];
+    PNETWORK_DEVICE pDevice;
+    WORD udpLength;
+    DWORD offloads;
+    QWORD startTicks;
+
+    if (NULL == Endpoint)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (Size > NET_UDP_MAX_DATA_SIZE)
+    {
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    pDevice = NetIp4Route(Destination);
+    if (NULL == pDevice)
+    {
+        return STATUS_NETWORK_UNREACHABLE;
+    }
+
+    startTicks = NetProfileStart();
+    udpLength = _NetUdpBuildDatagram(Endpoint,
+                                     pDevice,
+                                     buffer,
+                                     Destination,
+                                     DestinationPort,
+                                     Buffer,
+                                     Size,
+                                     &offloads);
+    NetProfileEnd(NetLayerUdpSend, startTicks, 1);
+
+    return NetIp4SendPacket(pDevice,
+                            (PETHERNET_FRAME) buffer,
+                            Destination,
+                            IP_PROTOCOL_UDP,
+                            udpLength,
+                            offloads,
+                            TRUE);
+}
+
+STATUS
+NetUdpSendBatch(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    IN_READS(NumberOfDatagrams)
+                    PNET_UDP_DATAGRAM               Datagrams,
+    IN              DWORD                           NumberOfDatagrams,
+    OUT             DWORD*                          DatagramsSent
+    )
+{
+    STATUS status;
+    STATUS sendStatus;
+    PBYTE pFrames;
+    NET_FRAME_BUFFER frameBuffers[NET_UDP_SEND_BATCH_SIZE];
+    PNETWORK_DEVICE pBatchDevice;
+    PNETWORK_DEVICE pDevice;
+    PBYTE pFrame;
+    DWORD batchSize;
+    DWORD datagramsSent;
+    WORD udpLength;
+    DWORD offloads;
+    DWORD i;
+    QWORD startTicks;
+
+    if (NULL == Endpoint)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Datagrams && 0 != NumberOfDatagrams)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == DatagramsSent)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    *DatagramsSent = 0;
+
+    if (0 == NumberOfDatagrams)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    pFrames = ExAllocatePoolWithTag(0, NET_UDP_SEND_BATCH_SIZE * NET_IP4_FRAME_MAX_SIZE, HEAP_NET_TAG, 0);
+    if (NULL == pFrames)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", NET_UDP_SEND_BATCH_SIZE * NET_IP4_FRAME_MAX_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    status = STATUS_SUCCESS;
+    pBatchDevice = NULL;
+    batchSize = 0;
+    datagramsSent = 0;
+
+    for (i = 0; i < NumberOfDatagrams; ++i)
+    {
+        if (NULL == Datagrams[i].Buffer && 0 != Datagrams[i].Size)
+        {
+            status = STATUS_INVALID_BUFFER;
+            break;
+        }
+
+        if (Datagrams[i].Size > NET_UDP_MAX_DATA_SIZE)
+        {
+            status = STATUS_BUFFER_TOO_LARGE;
+            break;
+        }
+
+        pDevice = NetIp4Route(Datagrams[i].Address);
+        if (NULL == pDevice)
+        {
+            status = STATUS_NETWORK_UNREACHABLE;
+            break;
+        }
+
+        // all the frames of a batch go through the same device
+        if (0 != batchSize && (NET_UDP_SEND_BATCH_SIZE == batchSize || pDevice != pBatchDevice))
+        {
+            startTicks = NetProfileStart();
+            sendStatus = NetSendFrames(pBatchDevice->Info.DeviceId, batchSize, frameBuffers);
+            NetProfileEnd(NetLayerDeviceSend, startTicks, batchSize);
+            batchSize = 0;
+            if (!SUCCEEDED(sendStatus))
+            {
+                status = sendStatus;
+                break;
+            }
+            datagramsSent = i;
+        }
+
+        pFrame = pFrames + batchSize * NET_IP4_FRAME_MAX_SIZE;
+
+        startTicks = NetProfileStart();
+        udpLength = _NetUdpBuildDatagram(Endpoint,
+                                         pDevice,
+                                         pFrame,
+                                         Datagrams[i].Address,
+                                         Datagrams[i].Port,
+                                         Datagrams[i].Buffer,
+                                         Datagrams[i].Size,
+                                         &offloads);
+        NetProfileEnd(NetLayerUdpSend, startTicks, 1);
+
+        status = NetIp4BuildPacket(pDevice,
+                                   (PETHERNET_FRAME) pFrame,
+                                   Datagrams[i].Address,
+                                   IP_PROTOCOL_UDP,
+                                   udpLength,
+                                   offloads,
+                                   TRUE,
+                                   &frameBuffers[batchSize]);
+        if (!SUCCEEDED(status))
+        {
+            break;
+        }
+
+        pBatchDevice = pDevice;
+        batchSize++;
+    }
+
+    // the datagrams preceding a failed one are still sent
+    if (0 != batchSize)
+    {
+        startTicks = NetProfileStart();
+        sendStatus = NetSendFrames(pBatchDevice->Info.DeviceId, batchSize, frameBuffers);
+        NetProfileEnd(NetLayerDeviceSend, startTicks, batchSize);
+        if (SUCCEEDED(sendStatus))
+        {
+            datagramsSent += batchSize;
+        }
+        else if (SUCCEEDED(status))
+        {
+            status = sendStatus;
+        }
+    }
+
+    ExFreePoolWithTag(pFrames, HEAP_NET_TAG);
+
+    *DatagramsSent = datagramsSent;
+
+    // the error is reported only if it prevented any progress, the caller
+    // retries the remaining datagrams and gets it then
+    return 0 != datagramsSent ? STATUS_SUCCESS : status;
+}
+
+STATUS
+NetUdpReceive(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    OUT_WRITES_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              WORD                            Size,
+    OUT             WORD*                           BytesReceived,
+    OUT_OPT         IP4_ADDRESS*                    Source,
+    OUT_OPT         PORT_NUMBER*                    SourcePort
+    )
+{
+    NET_UDP_QUEUED_DATAGRAM datagram;
+
+    if (NULL == Endpoint)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesReceived)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    _NetUdpDequeueDatagrams(Endpoint, 1, &datagram);
+
+    _NetUdpCopyDatagram(&datagram, Buffer, Size, BytesReceived);
+
+    if (NULL != Source)
+    {
+        *Source = datagram.Source;
+    }
+
+    if (NULL != SourcePort)
+    {
+        *SourcePort = datagram.SourcePort;
+    }
+
+    NetReleaseFrame(datagram.Frame);
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+NetUdpReceiveBatch(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    INOUT_UPDATES(NumberOfDatagrams)
+                    PNET_UDP_DATAGRAM               Datagrams,
+    IN              DWORD                           NumberOfDatagrams,
+    OUT             DWORD*                          DatagramsReceived
+    )
+{
+    NET_UDP_QUEUED_DATAGRAM queued[NET_UDP_ENDPOINT_QUEUE_SIZE];
+    DWORD count;
+    DWORD i;
+
+    if (NULL == Endpoint)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Datagrams || 0 == NumberOfDatagrams)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == DatagramsReceived)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    for (i = 0; i < NumberOfDatagrams; ++i)
+    {
+        if (NULL == Datagrams[i].Buffer && 0 != Datagrams[i].Size)
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+    }
+
+    // the queue never holds more than NET_UDP_ENDPOINT_QUEUE_SIZE datagrams
+    count = _NetUdpDequeueDatagrams(Endpoint,
+                                    min(NumberOfDatagrams, NET_UDP_ENDPOINT_QUEUE_SIZE),
+                                    queued);
+
+    for (i = 0; i < count; ++i)
+    {
+        _NetUdpCopyDatagram(&queued[i], Datagrams[i].Buffer, Datagrams[i].Size, &Datagrams[i].Size);
+
+        Datagrams[i].Address = queued[i].Source;
+        Datagrams[i].Port = queued[i].SourcePort;
+
+        NetReleaseFrame(queued[i].Frame);
+    }
+
+    *DatagramsReceived = count;
+
+    return STATUS_SUCCESS;
+}
+
+DWORD
+NetUdpPoll(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    )
+{
+    INTR_STATE intrState;
+    DWORD events;
+
+    ASSERT( NULL != Endpoint );
+
+    // the datagrams are sent without any buffering
+    events = NET_POLL_WRITE;
+
+    LockAcquire(&Endpoint->QueueLock, &intrState);
+    if (0 != Endpoint->QueueCount)
+    {
+        events |= NET_POLL_READ;
+    }
+    LockRelease(&Endpoint->QueueLock, intrState);
+
+    return events;
+}
+
+REQUIRES_EXCL_LOCK(m_netStackData.UdpLock)
+static
+BOOLEAN
+_NetUdpIsPortBound(
+    IN          PORT_NUMBER             Port
+    )
+{
+    return NULL != HashTableLookup(&m_netStackData.UdpEndpoints, (PHASH_KEY) &Port);
+}
+
+static
+void
+_NetUdpEnqueueDatagram(
+    INOUT       PNET_UDP_ENDPOINT       Endpoint,
+    IN          PNET_LOANED_FRAME       Frame,
+    IN_READS_BYTES(Length)
+                PBYTE                   Data,
+    IN          WORD                    Length,
+    IN          IP4_ADDRESS             Source,
+    IN          PORT_NUMBER             SourcePort
+    )
+{
+    PNET_UDP_QUEUED_DATAGRAM pDatagram;
+    INTR_STATE intrState;
+    BOOLEAN bQueued;
+
+    ASSERT( NULL != Endpoint );
+    ASSERT( NULL != Frame );
+
+    bQueued = FALSE;
+
+    LockAcquire(&Endpoint->QueueLock, &intrState);
+    if (Endpoint->QueueCount < NET_UDP_ENDPOINT_QUEUE_SIZE)
+    {
+        pDatagram = &Endpoint->Queue[(Endpoint->QueueHead + Endpoint->QueueCount) % NET_UDP_ENDPOINT_QUEUE_SIZE];
+
+        NetReferenceFrame(Frame);
+        pDatagram->Frame = Frame;
+        pDatagram->Data = Data;
+        pDatagram->Length = Length;
+        pDatagram->Source = Source;
+        pDatagram->SourcePort = SourcePort;
+
+        Endpoint->QueueCount++;
+        bQueued = TRUE;
+    }
+    else
+    {
+        Endpoint->DatagramsDropped++;
+    }
+    LockRelease(&Endpoint->QueueLock, intrState);
+
+    if (bQueued)
+    {
+        ExEventSignal(&Endpoint->DatagramAvailable);
+    }
+}
+
+static
+DWORD
+_NetUdpDequeueDatagrams(
+    INOUT       PNET_UDP_ENDPOINT       Endpoint,
+    IN          DWORD                   MaximumDatagrams,
+    OUT_WRITES_TO(MaximumDatagrams, return)
+                PNET_UDP_QUEUED_DATAGRAM Datagrams
+    )
+{
+    INTR_STATE intrState;
+    DWORD count;
+    DWORD i;
+
+    ASSERT( NULL != Endpoint );
+    ASSERT( 0 != MaximumDatagrams );
+    ASSERT( NULL != Datagrams );
+
+    count = 0;
+
+    while (0 == count)
+    {
+        LockAcquire(&Endpoint->QueueLock, &intrState);
+        count = min(MaximumDatagrams, Endpoint->QueueCount);
+        for (i = 0; i < count; ++i)
+        {
+            Datagrams[i] = Endpoint->Queue[Endpoint->QueueHead];
+            Endpoint->QueueHead = (Endpoint->QueueHead + 1) % NET_UDP_ENDPOINT_QUEUE_SIZE;
+        }
+        Endpoint->QueueCount -= count;
+        LockRelease(&Endpoint->QueueLock, intrState);
+
+        if (0 == count)
+        {
+            ExEventWaitForSignal(&Endpoint->DatagramAvailable);
+        }
+    }
+
+    return count;
+}
+
+static
+WORD
+_NetUdpBuildDatagram(
+    IN          PNET_UDP_ENDPOINT       Endpoint,
+    IN          PNETWORK_DEVICE         Device,
+    OUT_WRITES_BYTES(NET_IP4_FRAME_MAX_SIZE)
+                PBYTE                   Frame,
+    IN          IP4_ADDRESS             Destination,
+    IN          PORT_NUMBER             DestinationPort,
+    IN_READS_BYTES(Size)
+                PVOID                   Buffer,
+    IN          WORD                    Size,
+    OUT         DWORD*                  Offloads
+    )
+{
+    PUDP_DATAGRAM pDatagram;
+    WORD udpLength;
+    DWORD sum;
+
+    ASSERT( NULL != Endpoint );
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Frame );
+    ASSERT( Size <= NET_UDP_MAX_DATA_SIZE );
+    ASSERT( NULL != Offloads );
+
+    udpLength = (WORD) (UDP_DATAGRAM_SIZE + Size);
+
+    pDatagram = (PUDP_DATAGRAM) NET_IP4_PAYLOAD(Frame);
+    pDatagram->Source = NETWORK_ORDER_WORD(Endpoint->LocalPort);
+    pDatagram->Destination = NETWORK_ORDER_WORD(DestinationPort);
+    pDatagram->Length = NETWORK_ORDER_WORD(udpLength);
+    pDatagram->Checksum = 0;
+    if (0 != Size)
+    {
+        memcpy((PBYTE) pDatagram + UDP_DATAGRAM_SIZE, Buffer, Size);
+    }
+
+    sum = NetIp4PseudoHeaderSum(Device->Info.Ip4Address, Destination, IP_PROTOCOL_UDP, udpLength);
+
+    if (IsBooleanFlagOn(Device->Info.OffloadCapabilities.Offloads, NETWORK_OFFLOAD_TX_UDP_CHECKSUM))
+    {
+        // the device adds the datagram to the sum of the pseudo header
+        pDatagram->Checksum = (WORD) ~NetUtilChecksumFinish(sum);
+        *Offloads = NETWORK_OFFLOAD_TX_UDP_CHECKSUM;
+    }
+    else
+    {
+        pDatagram->Checksum = NetUtilChecksumFinish(NetUtilChecksumAdd(pDatagram, udpLength, sum));
+
+        // a computed checksum of 0 is sent as all ones, 0 means no checksum
+        if (0 == pDatagram->Checksum)
+        {
+            pDatagram->Checksum = MAX_WORD;
+        }
+        *Offloads = 0;
+    }
+
+    return udpLength;
+}
+
+static
+void
+_NetUdpCopyDatagram(
+    IN          PNET_UDP_QUEUED_DATAGRAM Datagram,
+    OUT_WRITES_BYTES(Size)
+                PVOID                   Buffer,
+    IN          WORD                    Size,
+    OUT         WORD*                   BytesReceived
+    )
+{
+    WORD bytesToCopy;
+
+    ASSERT( NULL != Datagram );
+    ASSERT( NULL != BytesReceived );
+
+    // if the datagram does not fit in the buffer its end is lost
+    bytesToCopy = (WORD) min(Size, Datagram->Length);
+    if (0 != bytesToCopy)
+    {
+        memcpy(Buffer, Datagram->Data, bytesToCopy);
+    }
+
+    *BytesReceived = bytesToCopy;
+}
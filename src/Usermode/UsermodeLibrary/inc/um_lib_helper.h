@@ -24,3 +24,23 @@ UmThreadCreate(
     IN_OPT  PVOID                   Context,
     OUT     UM_HANDLE*              ThreadHandle
     );
+
+// Publishes a submission in the ring created by SyscallRingSetup, only one
+// thread may submit at a time. If the polling thread of the ring stopped it is
+// woken up, else the caller must call SyscallRingEnter to dispatch the
+// submissions. Returns STATUS_LIMIT_REACHED if the ring is full.
+STATUS
+UmRingSubmit(
+    INOUT   PSYSCALL_RING           Ring,
+    IN      SYSCALL_ID              SyscallId,
+    IN_READS(SYSCALL_MAX_REGISTER_ARGUMENTS)
+            QWORD*                  Arguments,
+    IN      QWORD                   UserData
+    );
+
+// Takes the oldest completion from the ring, returns FALSE if there is none
+BOOLEAN
+UmRingReap(
+    INOUT   PSYSCALL_RING           Ring,
+    OUT     PSYSCALL_RING_COMPLETION Completion
+    );
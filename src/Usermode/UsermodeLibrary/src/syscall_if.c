@@ -9,13 +9,22 @@ SyscallEntry(
     ...
     );
 
+// Passes at most SYSCALL_MAX_REGISTER_ARGUMENTS arguments in registers, the
+// kernel does not need to validate and read the shadow stack
+extern
+STATUS
+SyscallEntryFast(
+    IN      SYSCALL_ID              SyscallId,
+    ...
+    );
+
 // SyscallIdIdentifyVersion
 STATUS
 SyscallValidateInterface(
     IN  SYSCALL_IF_VERSION          InterfaceVersion
     )
 {
-    return SyscallEntry(SyscallIdIdentifyVersion, InterfaceVersion);
+    return SyscallEntryFast(SyscallIdIdentifyVersion, InterfaceVersion);
 }
 
 // SyscallIdThreadExit
@@ -24,7 +33,7 @@ SyscallThreadExit(
     IN  STATUS                      ExitStatus
     )
 {
-    return SyscallEntry(SyscallIdThreadExit, ExitStatus);
+    return SyscallEntryFast(SyscallIdThreadExit, ExitStatus);
 }
 
 // SyscallIdThreadCreate
@@ -35,7 +44,7 @@ SyscallThreadCreate(
     OUT     UM_HANDLE*              ThreadHandle
     )
 {
-    return SyscallEntry(SyscallIdThreadCreate, StartFunction, Context, ThreadHandle);
+    return SyscallEntryFast(SyscallIdThreadCreate, StartFunction, Context, ThreadHandle);
 }
 
 // SyscallIdThreadGetTid
@@ -45,7 +54,7 @@ SyscallThreadGetTid(
     OUT     TID*                    ThreadId
     )
 {
-    return SyscallEntry(SyscallIdThreadGetTid, ThreadHandle, ThreadId);
+    return SyscallEntryFast(SyscallIdThreadGetTid, ThreadHandle, ThreadId);
 }
 
 // SyscallIdThreadWaitForTermination
@@ -55,7 +64,7 @@ SyscallThreadWaitForTermination(
     OUT     STATUS*                 TerminationStatus
     )
 {
-    return SyscallEntry(SyscallIdThreadWaitForTermination, ThreadHandle, TerminationStatus);
+    return SyscallEntryFast(SyscallIdThreadWaitForTermination, ThreadHandle, TerminationStatus);
 }
 
 // SyscallIdThreadCloseHandle
@@ -64,7 +73,17 @@ SyscallThreadCloseHandle(
     IN      UM_HANDLE               ThreadHandle
     )
 {
-    return SyscallEntry(SyscallIdThreadCloseHandle, ThreadHandle);
+    return SyscallEntryFast(SyscallIdThreadCloseHandle, ThreadHandle);
+}
+
+// SyscallIdThreadSetAffinity
+STATUS
+SyscallThreadSetAffinity(
+    IN_OPT  UM_HANDLE               ThreadHandle,
+    IN      THREAD_AFFINITY         Affinity
+    )
+{
+    return SyscallEntryFast(SyscallIdThreadSetAffinity, ThreadHandle, Affinity);
 }
 
 // SyscallIdProcessExit
@@ -73,7 +92,7 @@ SyscallProcessExit(
     IN      STATUS                  ExitStatus
     )
 {
-    return SyscallEntry(SyscallIdProcessExit, ExitStatus);
+    return SyscallEntryFast(SyscallIdProcessExit, ExitStatus);
 }
 
 // SyscallIdProcessCreate
@@ -88,7 +107,7 @@ SyscallProcessCreate(
     OUT         UM_HANDLE*          ProcessHandle
     )
 {
-    return SyscallEntry(SyscallIdProcessCreate, ProcessPath, PathLength, Arguments, ArgLength, ProcessHandle);
+    return SyscallEntryFast(SyscallIdProcessCreate, ProcessPath, PathLength, Arguments, ArgLength, ProcessHandle);
 }
 
 // SyscallIdProcessGetPid
@@ -98,7 +117,7 @@ SyscallProcessGetPid(
     OUT     PID*                    ProcessId
     )
 {
-    return SyscallEntry(SyscallIdProcessGetPid, ProcessHandle, ProcessId);
+    return SyscallEntryFast(SyscallIdProcessGetPid, ProcessHandle, ProcessId);
 }
 
 // SyscallIdProcessWaitForTermination
@@ -108,7 +127,7 @@ SyscallProcessWaitForTermination(
     OUT     STATUS*                 TerminationStatus
     )
 {
-    return SyscallEntry(SyscallIdProcessWaitForTermination, ProcessHandle, TerminationStatus);
+    return SyscallEntryFast(SyscallIdProcessWaitForTermination, ProcessHandle, TerminationStatus);
 }
 
 // SyscallIdProcessCloseHandle
@@ -117,7 +136,7 @@ SyscallProcessCloseHandle(
     IN      UM_HANDLE               ProcessHandle
     )
 {
-    return SyscallEntry(SyscallIdProcessCloseHandle, ProcessHandle);
+    return SyscallEntryFast(SyscallIdProcessCloseHandle, ProcessHandle);
 }
 
 // SyscallIdVirtualAlloc
@@ -132,6 +151,7 @@ SyscallVirtualAlloc(
     OUT         PVOID*                  AllocatedAddress
     )
 {
+    // there are too many arguments to pass them in registers
     return SyscallEntry(SyscallIdVirtualAlloc, BaseAddress, Size, AllocType, PageRights, FileHandle, Key, AllocatedAddress);
 }
 
@@ -145,7 +165,7 @@ SyscallVirtualFree(
     IN          VMM_FREE_TYPE           FreeType
     )
 {
-    return SyscallEntry(SyscallIdVirtualFree, Address, Size, FreeType);
+    return SyscallEntryFast(SyscallIdVirtualFree, Address, Size, FreeType);
 }
 
 // SyscallIdFileCreate
@@ -159,7 +179,7 @@ SyscallFileCreate(
     OUT         UM_HANDLE*              FileHandle
     )
 {
-    return SyscallEntry(SyscallIdFileCreate, Path, PathLength, Directory, Create, FileHandle);
+    return SyscallEntryFast(SyscallIdFileCreate, Path, PathLength, Directory, Create, FileHandle);
 }
 
 // SyscallIdFileClose
@@ -168,7 +188,7 @@ SyscallFileClose(
     IN          UM_HANDLE               FileHandle
     )
 {
-    return SyscallEntry(SyscallIdFileClose, FileHandle);
+    return SyscallEntryFast(SyscallIdFileClose, FileHandle);
 }
 
 // SyscallIdFileRead
@@ -181,7 +201,7 @@ SyscallFileRead(
     OUT QWORD*                      BytesRead
     )
 {
-    return SyscallEntry(SyscallIdFileRead, FileHandle, Buffer, BytesToRead, BytesRead);
+    return SyscallEntryFast(SyscallIdFileRead, FileHandle, Buffer, BytesToRead, BytesRead);
 }
 
 // SyscallIdFileWrite
@@ -194,5 +214,152 @@ SyscallFileWrite(
     OUT QWORD*                      BytesWritten
     )
 {
-    return SyscallEntry(SyscallIdFileWrite, FileHandle, Buffer, BytesToWrite, BytesWritten);
+    return SyscallEntryFast(SyscallIdFileWrite, FileHandle, Buffer, BytesToWrite, BytesWritten);
+}
+
+// SyscallIdSocketCreate
+STATUS
+SyscallSocketCreate(
+    IN          SOCKET_TYPE             Type,
+    OUT         UM_HANDLE*              SocketHandle
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketCreate, Type, SocketHandle);
+}
+
+// SyscallIdSocketClose
+STATUS
+SyscallSocketClose(
+    IN          UM_HANDLE               SocketHandle
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketClose, SocketHandle);
+}
+
+// SyscallIdSocketBind
+STATUS
+SyscallSocketBind(
+    IN          UM_HANDLE               SocketHandle,
+    IN          WORD                    Port
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketBind, SocketHandle, Port);
+}
+
+// SyscallIdSocketListen
+STATUS
+SyscallSocketListen(
+    IN          UM_HANDLE               SocketHandle,
+    IN          DWORD                   Backlog
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketListen, SocketHandle, Backlog);
+}
+
+// SyscallIdSocketAccept
+STATUS
+SyscallSocketAccept(
+    IN          UM_HANDLE               SocketHandle,
+    OUT         UM_HANDLE*              ConnectionHandle
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketAccept, SocketHandle, ConnectionHandle);
+}
+
+// SyscallIdSocketConnect
+STATUS
+SyscallSocketConnect(
+    IN          UM_HANDLE               SocketHandle,
+    IN          PSOCKET_ADDRESS         Address
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketConnect, SocketHandle, Address);
+}
+
+// SyscallIdSocketSend
+STATUS
+SyscallSocketSend(
+    IN          UM_HANDLE               SocketHandle,
+    IN_READS_BYTES(BytesToSend)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToSend,
+    IN_OPT      PSOCKET_ADDRESS         Destination,
+    OUT         QWORD*                  BytesSent
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketSend, SocketHandle, Buffer, BytesToSend, Destination, BytesSent);
+}
+
+// SyscallIdSocketReceive
+STATUS
+SyscallSocketReceive(
+    IN          UM_HANDLE               SocketHandle,
+    OUT_WRITES_BYTES(BytesToReceive)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToReceive,
+    OUT_OPT     PSOCKET_ADDRESS         Source,
+    OUT         QWORD*                  BytesReceived
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketReceive, SocketHandle, Buffer, BytesToReceive, Source, BytesReceived);
+}
+
+// SyscallIdSocketSendBatch
+STATUS
+SyscallSocketSendBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsSent
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketSendBatch, SocketHandle, Datagrams, NumberOfDatagrams, DatagramsSent);
+}
+
+// SyscallIdSocketReceiveBatch
+STATUS
+SyscallSocketReceiveBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsReceived
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketReceiveBatch, SocketHandle, Datagrams, NumberOfDatagrams, DatagramsReceived);
+}
+
+// SyscallIdSocketPoll
+STATUS
+SyscallSocketPoll(
+    INOUT_UPDATES(NumberOfEntries)
+                PSOCKET_POLL_ENTRY      Entries,
+    IN          DWORD                   NumberOfEntries,
+    IN          QWORD                   TimeoutUs,
+    OUT         DWORD*                  ReadyEntries
+    )
+{
+    return SyscallEntryFast(SyscallIdSocketPoll, Entries, NumberOfEntries, TimeoutUs, ReadyEntries);
+}
+
+// SyscallIdRingSetup
+STATUS
+SyscallRingSetup(
+    IN          DWORD                   Flags,
+    OUT         PVOID*                  Ring
+    )
+{
+    return SyscallEntryFast(SyscallIdRingSetup, Flags, Ring);
+}
+
+// SyscallIdRingEnter
+STATUS
+SyscallRingEnter(
+    IN          DWORD                   ToSubmit,
+    IN          DWORD                   MinComplete,
+    OUT         DWORD*                  Submitted
+    )
+{
+    return SyscallEntryFast(SyscallIdRingEnter, ToSubmit, MinComplete, Submitted);
 }
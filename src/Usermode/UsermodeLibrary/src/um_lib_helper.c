@@ -91,4 +91,67 @@ STATUS
     NOT_REACHED;
 
     return status;
-}
\ No newline at end of file
+}
+STATUS
+UmRingSubmit(
+    INOUT   PSYSCALL_RING           Ring,
+    IN      SYSCALL_ID              SyscallId,
+    IN_READS(SYSCALL_MAX_REGISTER_ARGUMENTS)
+            QWORD*                  Arguments,
+    IN      QWORD                   UserData
+    )
+{
+    PSYSCALL_RING_SUBMISSION pSubmission;
+    DWORD tail;
+    DWORD submitted;
+
+    ASSERT(Ring != NULL);
+    ASSERT(Arguments != NULL);
+
+    tail = Ring->SubmissionTail;
+    if (tail - Ring->SubmissionHead >= SYSCALL_RING_ENTRIES)
+    {
+        return STATUS_LIMIT_REACHED;
+    }
+
+    pSubmission = &Ring->Submissions[tail % SYSCALL_RING_ENTRIES];
+    pSubmission->SyscallId = SyscallId;
+    memcpy(pSubmission->Arguments, Arguments, sizeof(pSubmission->Arguments));
+    pSubmission->UserData = UserData;
+
+    // The locked exchange orders the publishing of the tail before the read of
+    // the flags, the polling thread checks the tail after it sets the flag
+    _InterlockedExchange(&Ring->SubmissionTail, tail + 1);
+
+    if (IsBooleanFlagOn(Ring->Flags, SYSCALL_RING_FLAG_NEED_WAKEUP))
+    {
+        return SyscallRingEnter(0, 0, &submitted);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+UmRingReap(
+    INOUT   PSYSCALL_RING           Ring,
+    OUT     PSYSCALL_RING_COMPLETION Completion
+    )
+{
+    DWORD head;
+
+    ASSERT(Ring != NULL);
+    ASSERT(Completion != NULL);
+
+    head = Ring->CompletionHead;
+    if (head == Ring->CompletionTail)
+    {
+        return FALSE;
+    }
+
+    *Completion = Ring->Completions[head % SYSCALL_RING_ENTRIES];
+
+    // the entry may be reused by the kernel only after it was copied
+    _InterlockedExchange(&Ring->CompletionHead, head + 1);
+
+    return TRUE;
+}
@@ -188,6 +188,9 @@ _VolInitialize(
         }
         pVolumeDevice->DeviceAlignment = Disk->DeviceAlignment;
 
+        // read and write requests are only translated and forwarded to the disk
+        pVolumeDevice->ConcurrentDispatch = TRUE;
+
         // get volume object
         pVolumeData = (PVOLUME)IoGetDeviceExtension(pVolumeDevice);
         ASSERT(NULL != pVolumeData);
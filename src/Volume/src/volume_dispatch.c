@@ -100,7 +100,8 @@ STATUS
         ASSERT(NULL == Irp);
     }
 
-    return STATUS_SUCCESS;
+    // the disk may complete the IRP later, let the caller know about it
+    return SUCCEEDED(status) ? status : STATUS_SUCCESS;
 }
 
 STATUS
@@ -152,9 +153,9 @@ STATUS
         status = STATUS_UNSUPPORTED;
     }
 
-    IoCompleteIrp(Irp);
     Irp->IoStatus.Status = status;
     Irp->IoStatus.Information = information;
+    IoCompleteIrp(Irp);
 
     return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+typedef enum _SOCKET_TYPE
+{
+    // UDP
+    SocketTypeDatagram,
+
+    // TCP
+    SocketTypeStream,
+
+    SocketTypeReserved = SocketTypeStream + 1
+} SOCKET_TYPE;
+
+typedef struct _SOCKET_ADDRESS
+{
+    // IPv4 address in network byte order
+    DWORD                   Address;
+
+    // in host byte order
+    WORD                    Port;
+} SOCKET_ADDRESS, *PSOCKET_ADDRESS;
+
+// An element of the arrays of SyscallSocketSendBatch and
+// SyscallSocketReceiveBatch
+typedef struct _SOCKET_DATAGRAM
+{
+    PVOID                   Buffer;
+    DWORD                   Size;
+
+    // filled in by the kernel for the datagrams it transferred
+    DWORD                   BytesTransferred;
+
+    // the destination when sending, the source when receiving
+    SOCKET_ADDRESS          Address;
+} SOCKET_DATAGRAM, *PSOCKET_DATAGRAM;
+
+// the maximum number of datagrams transferred by a batch system call
+#define SOCKET_MAX_BATCH_SIZE               64
+
+// the maximum number of sockets which can be polled at once
+#define SOCKET_MAX_POLL_ENTRIES             64
+
+#define SOCKET_POLL_READ                    (1<<0)
+#define SOCKET_POLL_WRITE                   (1<<1)
+
+// always reported, the connection was reset or the listener closed
+#define SOCKET_POLL_ERROR                   (1<<2)
+
+#define SOCKET_POLL_INFINITE                MAX_QWORD
+
+typedef struct _SOCKET_POLL_ENTRY
+{
+    UM_HANDLE               Socket;
+
+    // the SOCKET_POLL_* events the caller waits for
+    DWORD                   Events;
+
+    // filled in by the kernel
+    DWORD                   ReadyEvents;
+} SOCKET_POLL_ENTRY, *PSOCKET_POLL_ENTRY;
@@ -4,6 +4,13 @@ typedef DWORD SYSCALL_IF_VERSION;
 
 #define SYSCALL_IMPLEMENTED_IF_VERSION      0x1
 
+// Set by the user-mode stub in the system call ID register when the arguments
+// are passed in registers (R9, R10, RBX, RSI, R12 and R13) instead of through
+// the shadow stack pointed by RBP
+#define SYSCALL_FAST_CALL_FLAG              ((QWORD)1 << 63)
+
+#define SYSCALL_MAX_REGISTER_ARGUMENTS      6
+
 #define UM_INVALID_HANDLE_VALUE             0
 
 #define UM_FILE_HANDLE_STDOUT               (UM_HANDLE)0x1
@@ -13,3 +20,5 @@ typedef QWORD UM_HANDLE;
 #include "mem_structures.h"
 #include "thread_defs.h"
 #include "process_defs.h"
+#include "socket_defs.h"
+#include "syscall_ring_defs.h"
@@ -87,6 +87,23 @@ SyscallThreadCloseHandle(
     IN      UM_HANDLE               ThreadHandle
     );
 
+// SyscallIdThreadSetAffinity
+//******************************************************************************
+// Function:     SyscallThreadSetAffinity
+// Description:  Restricts the CPUs on which ThreadHandle may run. If
+//               ThreadHandle is UM_INVALID_HANDLE_VALUE the affinity of the
+//               current thread is changed.
+// Returns:      STATUS
+// Parameter:    IN_OPT UM_HANDLE ThreadHandle
+// Parameter:    IN THREAD_AFFINITY Affinity - must contain at least one
+//               active CPU.
+//******************************************************************************
+STATUS
+SyscallThreadSetAffinity(
+    IN_OPT  UM_HANDLE               ThreadHandle,
+    IN      THREAD_AFFINITY         Affinity
+    );
+
 // SyscallIdProcessExit
 //******************************************************************************
 // Function:     SyscallProcessExit
@@ -306,3 +323,244 @@ SyscallFileWrite(
     IN  QWORD                       BytesToWrite,
     OUT QWORD*                      BytesWritten
     );
+
+// SyscallIdSocketCreate
+//******************************************************************************
+// Function:     SyscallSocketCreate
+// Description:  Creates an unbound socket of the given type.
+// Returns:      STATUS
+// Parameter:    IN SOCKET_TYPE Type
+// Parameter:    OUT UM_HANDLE* SocketHandle
+//******************************************************************************
+STATUS
+SyscallSocketCreate(
+    IN          SOCKET_TYPE             Type,
+    OUT         UM_HANDLE*              SocketHandle
+    );
+
+// SyscallIdSocketClose
+//******************************************************************************
+// Function:     SyscallSocketClose
+// Description:  Closes a socket. The TCP connections are shut down gracefully,
+//               the ones not yet accepted by a listening socket are reset.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+//******************************************************************************
+STATUS
+SyscallSocketClose(
+    IN          UM_HANDLE               SocketHandle
+    );
+
+// SyscallIdSocketBind
+//******************************************************************************
+// Function:     SyscallSocketBind
+// Description:  Binds a datagram socket to a local port, if Port is 0 a free
+//               ephemeral port is chosen. For stream sockets the port is only
+//               remembered for SyscallSocketListen.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    IN WORD Port - in host byte order.
+//******************************************************************************
+STATUS
+SyscallSocketBind(
+    IN          UM_HANDLE               SocketHandle,
+    IN          WORD                    Port
+    );
+
+// SyscallIdSocketListen
+//******************************************************************************
+// Function:     SyscallSocketListen
+// Description:  Accepts connections on the port the stream socket was bound
+//               to.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    IN DWORD Backlog - Maximum number of connections waiting to
+//               be accepted.
+//******************************************************************************
+STATUS
+SyscallSocketListen(
+    IN          UM_HANDLE               SocketHandle,
+    IN          DWORD                   Backlog
+    );
+
+// SyscallIdSocketAccept
+//******************************************************************************
+// Function:     SyscallSocketAccept
+// Description:  Waits for a connection on a listening socket.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    OUT UM_HANDLE* ConnectionHandle - a connected stream socket.
+//******************************************************************************
+STATUS
+SyscallSocketAccept(
+    IN          UM_HANDLE               SocketHandle,
+    OUT         UM_HANDLE*              ConnectionHandle
+    );
+
+// SyscallIdSocketConnect
+//******************************************************************************
+// Function:     SyscallSocketConnect
+// Description:  For stream sockets establishes a connection to Address. For
+//               datagram sockets Address becomes the destination of the
+//               datagrams sent without an explicit one, the socket is bound
+//               to an ephemeral port if it was not bound yet.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    IN PSOCKET_ADDRESS Address
+//******************************************************************************
+STATUS
+SyscallSocketConnect(
+    IN          UM_HANDLE               SocketHandle,
+    IN          PSOCKET_ADDRESS         Address
+    );
+
+// SyscallIdSocketSend
+//******************************************************************************
+// Function:     SyscallSocketSend
+// Description:  Sends the content of Buffer. For datagram sockets Buffer is
+//               sent as a single datagram to Destination or, if it is NULL,
+//               to the address the socket was connected to.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    IN_READS_BYTES(BytesToSend) PVOID Buffer
+// Parameter:    IN QWORD BytesToSend
+// Parameter:    IN_OPT PSOCKET_ADDRESS Destination
+// Parameter:    OUT QWORD* BytesSent
+//******************************************************************************
+STATUS
+SyscallSocketSend(
+    IN          UM_HANDLE               SocketHandle,
+    IN_READS_BYTES(BytesToSend)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToSend,
+    IN_OPT      PSOCKET_ADDRESS         Destination,
+    OUT         QWORD*                  BytesSent
+    );
+
+// SyscallIdSocketReceive
+//******************************************************************************
+// Function:     SyscallSocketReceive
+// Description:  Waits for data. For datagram sockets a single datagram is
+//               received, its end is lost if it does not fit in Buffer. For
+//               stream sockets 0 bytes are received once the peer closed
+//               the connection.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    OUT_WRITES_BYTES(BytesToReceive) PVOID Buffer
+// Parameter:    IN QWORD BytesToReceive
+// Parameter:    OUT_OPT PSOCKET_ADDRESS Source - the sender of the datagram
+//               or the peer of the connection.
+// Parameter:    OUT QWORD* BytesReceived
+//******************************************************************************
+STATUS
+SyscallSocketReceive(
+    IN          UM_HANDLE               SocketHandle,
+    OUT_WRITES_BYTES(BytesToReceive)
+                PVOID                   Buffer,
+    IN          QWORD                   BytesToReceive,
+    OUT_OPT     PSOCKET_ADDRESS         Source,
+    OUT         QWORD*                  BytesReceived
+    );
+
+// SyscallIdSocketSendBatch
+//******************************************************************************
+// Function:     SyscallSocketSendBatch
+// Description:  Sends multiple datagrams with a single system call, a
+//               datagram whose address is 0 is sent to the address the socket
+//               was connected to. Stops at the first datagram which cannot be
+//               sent, the error is returned only if no datagram was sent.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    INOUT_UPDATES(NumberOfDatagrams) PSOCKET_DATAGRAM Datagrams
+// Parameter:    IN DWORD NumberOfDatagrams - at most SOCKET_MAX_BATCH_SIZE.
+// Parameter:    OUT DWORD* DatagramsSent
+//******************************************************************************
+STATUS
+SyscallSocketSendBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsSent
+    );
+
+// SyscallIdSocketReceiveBatch
+//******************************************************************************
+// Function:     SyscallSocketReceiveBatch
+// Description:  Waits for a datagram, then receives as many of the datagrams
+//               already queued to the socket as fit in the array.
+// Returns:      STATUS
+// Parameter:    IN UM_HANDLE SocketHandle
+// Parameter:    INOUT_UPDATES(NumberOfDatagrams) PSOCKET_DATAGRAM Datagrams
+// Parameter:    IN DWORD NumberOfDatagrams - at most SOCKET_MAX_BATCH_SIZE.
+// Parameter:    OUT DWORD* DatagramsReceived
+//******************************************************************************
+STATUS
+SyscallSocketReceiveBatch(
+    IN          UM_HANDLE               SocketHandle,
+    INOUT_UPDATES(NumberOfDatagrams)
+                PSOCKET_DATAGRAM        Datagrams,
+    IN          DWORD                   NumberOfDatagrams,
+    OUT         DWORD*                  DatagramsReceived
+    );
+
+// SyscallIdSocketPoll
+//******************************************************************************
+// Function:     SyscallSocketPoll
+// Description:  Waits until at least one of the sockets is ready for the
+//               events requested or until the timeout expires.
+// Returns:      STATUS - STATUS_TIMEOUT if no socket became ready.
+// Parameter:    INOUT_UPDATES(NumberOfEntries) PSOCKET_POLL_ENTRY Entries
+// Parameter:    IN DWORD NumberOfEntries - at most SOCKET_MAX_POLL_ENTRIES.
+// Parameter:    IN QWORD TimeoutUs - 0 checks the sockets without waiting,
+//               SOCKET_POLL_INFINITE waits indefinitely.
+// Parameter:    OUT DWORD* ReadyEntries - number of entries with a non-zero
+//               ReadyEvents.
+//******************************************************************************
+STATUS
+SyscallSocketPoll(
+    INOUT_UPDATES(NumberOfEntries)
+                PSOCKET_POLL_ENTRY      Entries,
+    IN          DWORD                   NumberOfEntries,
+    IN          QWORD                   TimeoutUs,
+    OUT         DWORD*                  ReadyEntries
+    );
+
+// SyscallIdRingSetup
+//******************************************************************************
+// Function:     SyscallRingSetup
+// Description:  Creates the submission and completion rings of the process,
+//               the other system calls can then be issued in batches through
+//               them.
+// Returns:      STATUS - STATUS_ALREADY_INITIALIZED if the process already has
+//               its rings.
+// Parameter:    IN DWORD Flags - SYSCALL_RING_SETUP_KERNEL_POLLING starts a
+//               kernel thread which consumes the submissions without any
+//               system call.
+// Parameter:    OUT PVOID* Ring - receives the address of the SYSCALL_RING.
+//******************************************************************************
+STATUS
+SyscallRingSetup(
+    IN          DWORD                   Flags,
+    OUT         PVOID*                  Ring
+    );
+
+// SyscallIdRingEnter
+//******************************************************************************
+// Function:     SyscallRingEnter
+// Description:  Dispatches the submissions published in the ring and waits
+//               for their completions. With kernel polling it only restarts
+//               the polling thread if SYSCALL_RING_FLAG_NEED_WAKEUP is set.
+// Returns:      STATUS
+// Parameter:    IN DWORD ToSubmit - maximum number of submissions dispatched.
+// Parameter:    IN DWORD MinComplete - with kernel polling, the number of
+//               completions to wait for, at most SYSCALL_RING_ENTRIES.
+// Parameter:    OUT DWORD* Submitted - number of submissions dispatched by
+//               this call.
+//******************************************************************************
+STATUS
+SyscallRingEnter(
+    IN          DWORD                   ToSubmit,
+    IN          DWORD                   MinComplete,
+    OUT         DWORD*                  Submitted
+    );
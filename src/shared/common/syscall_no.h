@@ -28,5 +28,25 @@ typedef enum _SYSCALL_ID
     SyscallIdFileRead,
     SyscallIdFileWrite,
 
-    SyscallIdReserved = SyscallIdFileWrite + 1
+    // Networking
+    SyscallIdSocketCreate,
+    SyscallIdSocketClose,
+    SyscallIdSocketBind,
+    SyscallIdSocketListen,
+    SyscallIdSocketAccept,
+    SyscallIdSocketConnect,
+    SyscallIdSocketSend,
+    SyscallIdSocketReceive,
+    SyscallIdSocketSendBatch,
+    SyscallIdSocketReceiveBatch,
+    SyscallIdSocketPoll,
+
+    // Submission rings
+    SyscallIdRingSetup,
+    SyscallIdRingEnter,
+
+    // Thread Management (appended to keep the IDs of the previous interface)
+    SyscallIdThreadSetAffinity,
+
+    SyscallIdReserved = SyscallIdThreadSetAffinity + 1
 } SYSCALL_ID;
@@ -0,0 +1,57 @@
+#pragma once
+
+// The submission and completion rings are shared between a process and the
+// kernel. Each index is written by a single side: the process produces
+// submissions and consumes completions, the kernel consumes submissions and
+// produces completions. The indices only grow, an entry is found at
+// index % SYSCALL_RING_ENTRIES.
+#define SYSCALL_RING_ENTRIES                128
+
+// SyscallRingSetup flags
+
+// A kernel thread consumes the submissions as soon as they are published,
+// SyscallRingEnter is only needed when SYSCALL_RING_FLAG_NEED_WAKEUP is set
+#define SYSCALL_RING_SETUP_KERNEL_POLLING   (1<<0)
+
+// SYSCALL_RING.Flags
+
+// The polling thread was idle and stopped, the submissions published from now
+// on are consumed only after SyscallRingEnter is called
+#define SYSCALL_RING_FLAG_NEED_WAKEUP       (1<<0)
+
+typedef struct _SYSCALL_RING_SUBMISSION
+{
+    // SYSCALL_ID of the operation, the ring system calls and those which
+    // terminate the calling thread cannot be submitted
+    DWORD                   SyscallId;
+    DWORD                   __Reserved;
+
+    // the same arguments as those passed to the system call
+    QWORD                   Arguments[SYSCALL_MAX_REGISTER_ARGUMENTS];
+
+    // copied into the completion of the operation
+    QWORD                   UserData;
+} SYSCALL_RING_SUBMISSION, *PSYSCALL_RING_SUBMISSION;
+
+typedef struct _SYSCALL_RING_COMPLETION
+{
+    QWORD                   UserData;
+    STATUS                  Status;
+    DWORD                   __Reserved;
+} SYSCALL_RING_COMPLETION, *PSYSCALL_RING_COMPLETION;
+
+typedef struct _SYSCALL_RING
+{
+    // written by the process
+    volatile DWORD          SubmissionTail;
+    volatile DWORD          CompletionHead;
+
+    // written by the kernel
+    volatile DWORD          SubmissionHead;
+    volatile DWORD          CompletionTail;
+    volatile DWORD          Flags;
+    DWORD                   __Reserved;
+
+    SYSCALL_RING_SUBMISSION Submissions[SYSCALL_RING_ENTRIES];
+    SYSCALL_RING_COMPLETION Completions[SYSCALL_RING_ENTRIES];
+} SYSCALL_RING, *PSYSCALL_RING;
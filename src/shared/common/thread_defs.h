@@ -2,6 +2,11 @@
 
 typedef QWORD       TID, *PTID;
 
+// Bit i set => the thread may run on the CPU with APIC ID i (modulo 64)
+typedef QWORD       THREAD_AFFINITY;
+
+#define THREAD_AFFINITY_ALL_CPUS            MAX_QWORD
+
 typedef enum _THREAD_PRIORITY
 {
     ThreadPriorityLowest            = 0,
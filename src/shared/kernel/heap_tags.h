@@ -14,6 +14,7 @@
 #define HEAP_DEVICE_EXT_TAG             ':TXE'
 #define HEAP_DRIVER_TAG                 ':VRD'
 #define HEAP_IRP_TAG                    ':PRI'
+#define HEAP_IO_COMPLETION_TAG          ':QCI'
 #define HEAP_VPB_TAG                    ':BPV'
 #define HEAP_TEMP_TAG                   ':PMT'
 #define HEAP_FS_TAG                     ':SF '
@@ -24,12 +25,16 @@
 #define HEAP_THREAD_TAG                 ':RHT'
 #define HEAP_MDL_TAG                    ':LMD'
 #define HEAP_ATA_TAG                    ':ATA'
+#define HEAP_AHCI_TAG                   'ICHA'
 #define HEAP_IOMU_TAG                   ':MOI'
 #define HEAP_MMU_TAG                    ':UMM'
 #define HEAP_CORE_TAG                   ':ROC'
 #define HEAP_NET_TAG                    ':TEN'
+#define HEAP_SOCKET_TAG                 ':KOS'
 #define HEAP_ETH_TAG                    ':HTE'
 #define HEAP_PORT_TAG                   ':TRP'
 #define HEAP_EXECUTIVE_TAG              ':XE '
 #define HEAP_PROCESS_TAG                ':CRP'
-#define HEAP_BOOT_TAG                   'TOOB'
\ No newline at end of file
+#define HEAP_IMAGE_TAG                  ':GMI'
+#define HEAP_BOOT_TAG                   'TOOB'
+#define HEAP_SYSCALL_TAG                ':CYS'
\ No newline at end of file
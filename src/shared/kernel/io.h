@@ -44,10 +44,25 @@ IoAttachDevice(
     IN      PDEVICE_OBJECT  TargetDevice
     );
 
+#define IoAllocateIrp(StackSize)    IoAllocateIrpEx((StackSize),NULL)
+
+//******************************************************************************
+// Function:     IoAllocateIrpEx
+// Description:  Allocates a zeroed IRP with StackSize stack locations. If
+//               StackIrp is given and large enough the IRP is built in it,
+//               else it is taken from the lookaside list of the current CPU
+//               and only if the list is empty from the heap.
+// Returns:      PIRP
+// Parameter:    IN BYTE StackSize
+// Parameter:    OUT_OPT PIO_STACK_IRP StackIrp - storage owned by the caller,
+//               it must outlive the IRP
+// NOTE:         The IRP must always be released with IoFreeIrp.
+//******************************************************************************
 PTR_SUCCESS
 PIRP
-IoAllocateIrp(
-    IN      BYTE            StackSize
+IoAllocateIrpEx(
+    IN      BYTE            StackSize,
+    OUT_OPT PIO_STACK_IRP   StackIrp
     );
 
 void
@@ -72,12 +87,36 @@ IoCopyCurrentStackLocationToNext(
     INOUT   PIRP            Irp
     );
 
+//******************************************************************************
+// Function:     IoCallDriver
+// Description:  Passes the IRP to the dispatch routine of Device. A driver
+//               which cannot complete the IRP before returning marks it as
+//               pending and returns STATUS_PENDING.
+//               If the originator of the IRP associated neither a completion
+//               queue, nor a completion routine with it, the call waits for
+//               a pending IRP to complete => the IoStatus is always valid on
+//               return. Else STATUS_PENDING is returned to the originator and
+//               the IRP must not be touched until it is completed.
+// Returns:      STATUS - on failure the IRP was not completed and is still
+//               owned by the caller.
+// Parameter:    IN PDEVICE_OBJECT Device
+// Parameter:    INOUT PIRP Irp
+//******************************************************************************
 STATUS
 IoCallDriver(
     IN      PDEVICE_OBJECT  Device,
     INOUT   PIRP            Irp
     );
 
+//******************************************************************************
+// Function:     IoCompleteIrp
+// Description:  Completes the IRP: the completion routines are called from
+//               the driver which completes it up to the originator, after
+//               which the IRP is queued to its completion queue (if any).
+//               May be called from an interrupt handler.
+// Returns:      void
+// Parameter:    INOUT PIRP Irp
+//******************************************************************************
 void
 IoCompleteIrp(
     INOUT   PIRP            Irp
@@ -85,6 +124,93 @@ IoCompleteIrp(
 
 #define IoIsIrpComplete(irp)        (TRUE==((irp)->Flags.Completed))
 
+// must be called by a driver before returning STATUS_PENDING
+#define IoMarkIrpPending(irp)       ((irp)->Flags.Pending = TRUE)
+
+//******************************************************************************
+// Function:     IoSetCompletionRoutine
+// Description:  Registers a routine to be called when the driver owning the
+//               next stack location (or a driver below it) completes the IRP.
+// Returns:      void
+// Parameter:    INOUT PIRP Irp
+// Parameter:    IN PFUNC_IoCompletionRoutine CompletionRoutine
+// Parameter:    IN_OPT PVOID Context
+//******************************************************************************
+void
+IoSetCompletionRoutine(
+    INOUT   PIRP                        Irp,
+    IN      PFUNC_IoCompletionRoutine   CompletionRoutine,
+    IN_OPT  PVOID                       Context
+    );
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+/////////                        COMPLETION QUEUES                                      /////////
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct _IO_COMPLETION_QUEUE IO_COMPLETION_QUEUE, *PIO_COMPLETION_QUEUE;
+
+//******************************************************************************
+// Function:     IoCreateCompletionQueue
+// Description:  Creates a queue on which the completed IRPs associated with
+//               it are placed. Any number of threads may wait on the queue
+//               and any number of IRPs may be in flight.
+// Returns:      STATUS
+// Parameter:    OUT_PTR PIO_COMPLETION_QUEUE* Queue
+//******************************************************************************
+STATUS
+IoCreateCompletionQueue(
+    OUT_PTR     PIO_COMPLETION_QUEUE*   Queue
+    );
+
+//******************************************************************************
+// Function:     IoDestroyCompletionQueue
+// Description:  Destroys a completion queue. The caller must make sure no IRPs
+//               associated with the queue are still in flight, the IRPs not
+//               yet removed from the queue are freed.
+// Returns:      void
+// Parameter:    IN PIO_COMPLETION_QUEUE Queue
+//******************************************************************************
+void
+IoDestroyCompletionQueue(
+    IN          PIO_COMPLETION_QUEUE    Queue
+    );
+
+//******************************************************************************
+// Function:     IoSetIrpCompletionQueue
+// Description:  Associates an IRP with a completion queue, once completed the
+//               IRP is placed on the queue together with CompletionKey. Must
+//               be called by the originator before calling IoCallDriver.
+// Returns:      void
+// Parameter:    INOUT PIRP Irp
+// Parameter:    IN PIO_COMPLETION_QUEUE Queue
+// Parameter:    IN_OPT PVOID CompletionKey
+//******************************************************************************
+void
+IoSetIrpCompletionQueue(
+    INOUT       PIRP                    Irp,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    );
+
+//******************************************************************************
+// Function:     IoRemoveCompletionQueueEntry
+// Description:  Removes the oldest completed IRP from the queue. The caller
+//               becomes the owner of the IRP and must free it with IoFreeIrp.
+// Returns:      STATUS - STATUS_NO_DATA_AVAILABLE if Wait is FALSE and no IRP
+//               completed.
+// Parameter:    IN PIO_COMPLETION_QUEUE Queue
+// Parameter:    IN BOOLEAN Wait - if TRUE blocks until an IRP completes
+// Parameter:    OUT_PTR PIRP* Irp
+// Parameter:    OUT_OPT PVOID* CompletionKey
+//******************************************************************************
+STATUS
+IoRemoveCompletionQueueEntry(
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN          BOOLEAN                 Wait,
+    OUT_PTR     PIRP*                   Irp,
+    OUT_OPT     PVOID*                  CompletionKey
+    );
+
 STATUS
 IoGetPciDevicesMatchingSpecification(
     IN          PCI_SPEC        Specification,
@@ -123,15 +249,32 @@ IoFreeTemporaryData(
     IN          PVOID               Data
     );
 
+#define IoBuildDeviceIoControlRequest(Code,Dev,In,InLen,Out,OutLen)   \
+    IoBuildDeviceIoControlRequestEx((Code),(Dev),(In),(InLen),(Out),(OutLen),NULL)
+
+//******************************************************************************
+// Function:     IoBuildDeviceIoControlRequestEx
+// Description:  Builds an IRP_MJ_DEVICE_CONTROL IRP for DeviceObject. The IRP
+//               is allocated as described for IoAllocateIrpEx.
+// Returns:      PIRP
+// Parameter:    IN DWORD IoControlCode
+// Parameter:    IN PDEVICE_OBJECT DeviceObject
+// Parameter:    IN_OPT PVOID InputBuffer
+// Parameter:    IN DWORD InputBufferLength
+// Parameter:    OUT_OPT PVOID OutputBuffer
+// Parameter:    IN DWORD OutputBufferLength
+// Parameter:    OUT_OPT PIO_STACK_IRP StackIrp
+//******************************************************************************
 PTR_SUCCESS
 PIRP
-IoBuildDeviceIoControlRequest(
+IoBuildDeviceIoControlRequestEx(
     IN          DWORD               IoControlCode,
     IN          PDEVICE_OBJECT      DeviceObject,
     IN_OPT      PVOID               InputBuffer,
     IN          DWORD               InputBufferLength,
     OUT_OPT     PVOID               OutputBuffer,
-    IN          DWORD               OutputBufferLength
+    IN          DWORD               OutputBufferLength,
+    OUT_OPT     PIO_STACK_IRP       StackIrp
     );
 
 STATUS
@@ -156,6 +299,69 @@ IoWriteDeviceEx(
 
 #define IoWriteDevice(Dev,Buf,Len,Off)                  IoWriteDeviceEx((Dev),(Buf),(Len),(Off),FALSE)
 
+//******************************************************************************
+// Function:     IoReadDeviceWithMdl
+// Description:  Reads from the device directly into the pages described by
+//               Mdl, drivers which support DMA transfer the data without
+//               building an MDL of their own.
+// Returns:      STATUS
+// Parameter:    IN PDEVICE_OBJECT DeviceObject
+// Parameter:    IN PMDL Mdl - the pages must stay pinned until the request
+//               completes (see MmuPinUserBuffer).
+// Parameter:    INOUT QWORD* Length - at most Mdl->ByteCount.
+// Parameter:    IN QWORD Offset
+//******************************************************************************
+STATUS
+IoReadDeviceWithMdl(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN                          struct _MDL*            Mdl,
+    INOUT                       QWORD*                  Length,
+    IN                          QWORD                   Offset
+    );
+
+STATUS
+IoWriteDeviceWithMdl(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN                          struct _MDL*            Mdl,
+    INOUT                       QWORD*                  Length,
+    IN                          QWORD                   Offset
+    );
+
+//******************************************************************************
+// Function:     IoReadDeviceAsync
+// Description:  Starts a read from the device and returns without waiting for
+//               it to complete. Once completed the IRP is placed on Queue, the
+//               number of bytes read is found in its IoStatus.Information.
+// Returns:      STATUS - STATUS_PENDING if the IRP was started, on failure no
+//               IRP will be queued.
+// Parameter:    IN PDEVICE_OBJECT DeviceObject
+// Parameter:    OUT_WRITES_BYTES(Length) PVOID Buffer - must remain valid
+//               until the IRP completes
+// Parameter:    IN QWORD Length
+// Parameter:    IN QWORD Offset
+// Parameter:    IN PIO_COMPLETION_QUEUE Queue
+// Parameter:    IN_OPT PVOID CompletionKey
+//******************************************************************************
+STATUS
+IoReadDeviceAsync(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    OUT_WRITES_BYTES(Length)    PVOID                   Buffer,
+    IN                          QWORD                   Length,
+    IN                          QWORD                   Offset,
+    IN                          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT                      PVOID                   CompletionKey
+    );
+
+STATUS
+IoWriteDeviceAsync(
+    IN                          PDEVICE_OBJECT          DeviceObject,
+    IN_READS_BYTES(Length)      PVOID                   Buffer,
+    IN                          QWORD                   Length,
+    IN                          QWORD                   Offset,
+    IN                          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT                      PVOID                   CompletionKey
+    );
+
 STATUS
 IoAllocateMdl(
     IN          PVOID           VirtualAddress,
@@ -169,6 +375,16 @@ IoFreeMdl(
     INOUT       struct _MDL*            Mdl
     );
 
+// Returns the MDL supplied by the issuer of the IRP if it describes the first
+// Length bytes of Buffer, NULL otherwise. The MDL must not be freed.
+PTR_SUCCESS
+struct _MDL*
+IoGetCallerMdl(
+    IN          PIRP                    Irp,
+    IN          PVOID                   Buffer,
+    IN          DWORD                   Length
+    );
+
 SIZE_SUCCESS
 DWORD
 IoMdlGetNumberOfPairs(
@@ -230,6 +446,11 @@ IoGetCurrentDateTime(
     void
     );
 
+QWORD
+IoGetSystemTimeUs(
+    void
+    );
+
 /////////////////////////////////////////////////////////////////////////////////////////////////
 /////////                        FILE OPERATIONS                                        /////////
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -268,6 +489,40 @@ IoWriteFile(
     OUT         QWORD*                  BytesWritten
     );
 
+//******************************************************************************
+// Function:     IoReadFileAsync
+// Description:  Starts a read from the file, the completed IRP is placed on
+//               Queue. The current file offset is not used nor updated.
+// Returns:      STATUS - STATUS_PENDING if the IRP was started
+// Parameter:    IN PFILE_OBJECT FileHandle
+// Parameter:    IN QWORD BytesToRead
+// Parameter:    IN QWORD FileOffset
+// Parameter:    OUT_WRITES_BYTES(BytesToRead) PVOID Buffer
+// Parameter:    IN PIO_COMPLETION_QUEUE Queue
+// Parameter:    IN_OPT PVOID CompletionKey
+//******************************************************************************
+STATUS
+IoReadFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    IN          QWORD                   BytesToRead,
+    IN          QWORD                   FileOffset,
+    OUT_WRITES_BYTES(BytesToRead)
+                PVOID                   Buffer,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    );
+
+STATUS
+IoWriteFileAsync(
+    IN          PFILE_OBJECT            FileHandle,
+    IN          QWORD                   BytesToWrite,
+    IN          QWORD                   FileOffset,
+    IN_READS_BYTES(BytesToWrite)
+                PVOID                   Buffer,
+    IN          PIO_COMPLETION_QUEUE    Queue,
+    IN_OPT      PVOID                   CompletionKey
+    );
+
 STATUS
 IoGetFileSize(
     IN          PFILE_OBJECT            FileHandle,
@@ -100,6 +100,11 @@ typedef struct _DEVICE_OBJECT
 
     MUTEX                   DeviceLock;
 
+    // if set the dispatch functions of the device are not serialized
+    // through DeviceLock, the driver is responsible for synchronizing
+    // concurrent requests itself
+    BOOLEAN                 ConcurrentDispatch;
+
     // valid only for volume and file system devices
     struct _VPB*            Vpb;
 
@@ -118,6 +123,17 @@ BOOLEAN
 
 typedef FUNC_InterruptFunction*        PFUNC_InterruptFunction;
 
+// Used by the devices which register multiple interrupts for the same device
+// object, Context identifies the interrupt which was raised
+typedef
+BOOLEAN
+(__cdecl FUNC_InterruptFunctionEx)(
+    IN      PDEVICE_OBJECT  Device,
+    IN_OPT  PVOID           Context
+    );
+
+typedef FUNC_InterruptFunctionEx*      PFUNC_InterruptFunctionEx;
+
 typedef enum _IO_INTERRUPT_TYPE
 {
     IoInterruptTypeLegacy,
@@ -131,7 +147,19 @@ typedef struct _IO_INTERRUPT
     IRQL                        Irql;
     BOOLEAN                     Exclusive;
     PFUNC_InterruptFunction     ServiceRoutine;
+
+    // if non-NULL it is called instead of ServiceRoutine
+    PFUNC_InterruptFunctionEx   ServiceRoutineEx;
+    PVOID                       ServiceContext;
+
     BOOLEAN                     BroadcastInterrupt;
+
+    // if set the interrupt is delivered only to the CPU with the index
+    // CpuIndex (modulo the number of active CPUs) in the CPU list, else it
+    // is delivered to the CPU running at the lowest priority
+    BOOLEAN                     TargetCpu;
+    DWORD                       CpuIndex;
+
     union
     {
         struct
@@ -145,10 +173,32 @@ typedef struct _IO_INTERRUPT
         struct
         {
             PPCI_DEVICE_DESCRIPTION         PciDevice;
+
+            // if non-NULL the interrupt is delivered through the entry
+            // MsiXEntry of the MSI-X table of the device mapped at this
+            // address, else through MSI or the IOAPIC
+            PVOID                           MsiXTable;
+            WORD                            MsiXEntry;
         } Pci;
     };
 } IO_INTERRUPT, *PIO_INTERRUPT;
 
+// Invoked when the IRP completes with the device object of the driver which
+// set the routine (NULL for the originator of the IRP). Completion routines
+// may run from the interrupt handler of the device which completed the IRP
+// and must not block. If STATUS_MORE_PROCESSING_REQUIRED is returned the
+// completion stops and the routine takes ownership of the IRP, it must call
+// IoCompleteIrp again once it is done with it.
+typedef
+STATUS
+(__cdecl FUNC_IoCompletionRoutine)(
+    IN_OPT      PDEVICE_OBJECT      DeviceObject,
+    INOUT       struct _IRP*        Irp,
+    IN_OPT      PVOID               Context
+    );
+
+typedef FUNC_IoCompletionRoutine*   PFUNC_IoCompletionRoutine;
+
 typedef struct _IO_STACK_LOCATION
 {
     BYTE            MajorFunction;
@@ -178,13 +228,28 @@ typedef struct _IO_STACK_LOCATION
 
     PDEVICE_OBJECT  DeviceObject;
     PFILE_OBJECT    FileObject;
+
+    // set by the driver which owns the previous stack location (see
+    // IoSetCompletionRoutine), never copied to the next stack location
+    PFUNC_IoCompletionRoutine   CompletionRoutine;
+    PVOID                       CompletionContext;
 } IO_STACK_LOCATION, *PIO_STACK_LOCATION;
 
 typedef struct _IRP_FLAGS
 {
     DWORD           Completed       :  1;
     DWORD           Asynchronous    :  1;
-    DWORD           Reserved        : 30;
+
+    // the IRP lives in memory owned by the caller (see IO_STACK_IRP)
+    DWORD           CallerAllocated :  1;
+
+    // the driver returned STATUS_PENDING, the IRP will be completed later
+    DWORD           Pending         :  1;
+
+    // the MDL describes pages pinned by the issuer of the IRP, it is not
+    // freed together with the IRP
+    DWORD           CallerMdl       :  1;
+    DWORD           Reserved        : 27;
 } IRP_FLAGS, *PIRP_FLAGS;
 
 typedef struct _IO_STATUS_BLOCK
@@ -201,12 +266,33 @@ typedef struct _IRP
     IO_STATUS_BLOCK     IoStatus;
     IRP_FLAGS           Flags;
     BYTE                CurrentStackLocation;
+    BYTE                StackSize;
 
     struct _MDL*        Mdl;
 
+    // once all the completion routines ran the IRP is queued to the
+    // completion queue (if any) and the completion event is signaled
+    struct _IO_COMPLETION_QUEUE*    CompletionQueue;
+    PVOID                           CompletionKey;
+    LIST_ENTRY                      CompletionListEntry;
+    struct _EX_EVENT*               CompletionEvent;
+
     IO_STACK_LOCATION   StackLocations[0];
 } IRP, *PIRP;
 
+#define IO_IRP_SIZE(StackSize)          (sizeof(IRP) + (StackSize) * sizeof(IO_STACK_LOCATION))
+
+// IRPs built in an IO_STACK_IRP may have at most this many stack locations
+#define IO_STACK_IRP_MAX_STACK_SIZE     8
+
+// Storage for an IRP which lives on the stack of a synchronous caller, it
+// is large enough for any of the device stacks currently built
+typedef struct _IO_STACK_IRP
+{
+    QWORD               Storage[IO_IRP_SIZE(IO_STACK_IRP_MAX_STACK_SIZE) / sizeof(QWORD)];
+} IO_STACK_IRP, *PIO_STACK_IRP;
+STATIC_ASSERT(IO_IRP_SIZE(IO_STACK_IRP_MAX_STACK_SIZE) % sizeof(QWORD) == 0);
+
 typedef struct _MDL_TRANSLATION_PAIR
 {
     PHYSICAL_ADDRESS    Address;
@@ -307,6 +393,20 @@ typedef struct _NET_RECEIVE_FRAME_OUTPUT
     ETHERNET_FRAME          Buffer;
 } NET_RECEIVE_FRAME_OUTPUT, *PNET_RECEIVE_FRAME_OUTPUT;
 
+// IOCTL_NET_RECEIVE_FRAME_REFERENCE
+typedef struct _NET_RECEIVE_FRAME_REFERENCE_OUTPUT
+{
+    // holds a reference which must be released with NetReleaseFrame
+    PNET_LOANED_FRAME       Frame;
+} NET_RECEIVE_FRAME_REFERENCE_OUTPUT, *PNET_RECEIVE_FRAME_REFERENCE_OUTPUT;
+
+// IOCTL_NET_SEND_FRAMES
+typedef struct _NET_SEND_FRAMES_INPUT
+{
+    DWORD                   NumberOfFrames;
+    PNET_FRAME_BUFFER       Frames;
+} NET_SEND_FRAMES_INPUT, *PNET_SEND_FRAMES_INPUT;
+
 typedef struct _NET_GET_SET_PHYSICAL_ADDRESS
 {
     MAC_ADDRESS             Address;
@@ -322,6 +422,21 @@ typedef struct _NET_GET_LINK_STATUS
     BOOLEAN                 LinkUp;
 } NET_GET_LINK_STATUS, *PNET_GET_LINK_STATUS;
 
+typedef struct _NET_GET_DEVICE_STATISTICS
+{
+    NETWORK_DEVICE_STATS    Statistics;
+} NET_GET_DEVICE_STATISTICS, *PNET_GET_DEVICE_STATISTICS;
+
+typedef struct _NET_GET_SET_DEVICE_TUNING
+{
+    NETWORK_DEVICE_TUNING   Tuning;
+} NET_GET_SET_DEVICE_TUNING, *PNET_GET_SET_DEVICE_TUNING;
+
+typedef struct _NET_GET_OFFLOAD_CAPABILITIES
+{
+    NETWORK_OFFLOAD_CAPABILITIES Capabilities;
+} NET_GET_OFFLOAD_CAPABILITIES, *PNET_GET_OFFLOAD_CAPABILITIES;
+
 #define IOCTL_DISK_GET_LENGTH_INFO          0x0
 #define IOCTL_DISK_LAYOUT_INFO              0x1
 #define IOCTL_VOLUME_PARTITION_INFO         0x2
@@ -332,6 +447,12 @@ typedef struct _NET_GET_LINK_STATUS
 #define IOCTL_NET_GET_DEVICE_STATUS         0x7
 #define IOCTL_NET_SET_DEVICE_STATUS         0x8
 #define IOCTL_NET_GET_LINK_STATUS           0x9
+#define IOCTL_NET_RECEIVE_FRAME_REFERENCE   0xA
+#define IOCTL_NET_GET_DEVICE_STATISTICS     0xB
+#define IOCTL_NET_GET_DEVICE_TUNING         0xC
+#define IOCTL_NET_SET_DEVICE_TUNING         0xD
+#define IOCTL_NET_SEND_FRAMES               0xE
+#define IOCTL_NET_GET_OFFLOAD_CAPABILITIES  0xF
 
 // end of common packing
 #pragma warning(pop)
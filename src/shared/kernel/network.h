@@ -14,6 +14,17 @@ NetSendFrame(
     IN                      MAC_ADDRESS     DestinationAddress
     );
 
+// Sends all the frames with a single request, the device is notified once
+// for as many of them as fit in its TX ring. The destination address must
+// already be set in each frame, the source address is filled in.
+STATUS
+NetSendFrames(
+    IN                      DEVICE_ID           DeviceId,
+    IN                      DWORD               NumberOfFrames,
+    IN_READS(NumberOfFrames)
+                            NET_FRAME_BUFFER*   Frames
+    );
+
 STATUS
 NetReceiveFrame(
     IN                      DEVICE_ID       DeviceId,
@@ -22,6 +33,26 @@ NetReceiveFrame(
     OUT                     DWORD*          BytesWritten
     );
 
+// Receives a frame without copying it, the caller owns a reference to it
+// and must release it with NetReleaseFrame when done
+STATUS
+NetReceiveFrameByReference(
+    IN                      DEVICE_ID           DeviceId,
+    OUT                     PNET_LOANED_FRAME*  Frame
+    );
+
+void
+NetReferenceFrame(
+    INOUT                   PNET_LOANED_FRAME   Frame
+    );
+
+// When the last reference is released the buffer is returned to the
+// receive pool of the device
+void
+NetReleaseFrame(
+    INOUT                   PNET_LOANED_FRAME   Frame
+    );
+
 STATUS
 NetGetNetworkDevices(
     OUT_WRITES_OPT(*NumberOfDevices)
@@ -41,4 +72,264 @@ STATUS
 NetGetNetworkDeviceStatistics(
     IN              DEVICE_ID                       DeviceId,
     OUT             PNETWORK_DEVICE_STATS           Statistics
+    );
+
+STATUS
+NetGetNetworkDeviceTuning(
+    IN              DEVICE_ID                       DeviceId,
+    OUT             PNETWORK_DEVICE_TUNING          Tuning
+    );
+
+// The ring sizes cannot be changed, only the interrupt moderation settings
+STATUS
+NetSetNetworkDeviceTuning(
+    IN              DEVICE_ID                       DeviceId,
+    IN              PNETWORK_DEVICE_TUNING          Tuning
+    );
+
+// Assigns an IPv4 address to a device, the hosts in its subnet are reachable
+// directly through it. From then on the frames received by the device are
+// consumed by the protocol layer and NetReceiveFrame must not be used on it.
+STATUS
+NetSetIp4Address(
+    IN              DEVICE_ID                       DeviceId,
+    IN              IP4_ADDRESS                     Address,
+    IN              IP4_ADDRESS                     SubnetMask
+    );
+
+// Sends an ICMP echo request with PayloadSize bytes of data and waits at most
+// TimeoutUs microseconds for the reply
+STATUS
+NetIcmpEcho(
+    IN              IP4_ADDRESS                     Destination,
+    IN              WORD                            SequenceNumber,
+    IN              WORD                            PayloadSize,
+    IN              QWORD                           TimeoutUs,
+    OUT_OPT         QWORD*                          RoundTripTimeUs
+    );
+
+// The readiness of an endpoint, listener or connection
+#define NET_POLL_READ           (1<<0)
+#define NET_POLL_WRITE          (1<<1)
+
+// The connection was reset or the listener closed
+#define NET_POLL_ERROR          (1<<2)
+
+typedef struct _NET_UDP_ENDPOINT*   PNET_UDP_ENDPOINT;
+
+// A datagram sent or received by the batched UDP functions
+typedef struct _NET_UDP_DATAGRAM
+{
+    PVOID                           Buffer;
+
+    // when receiving it is the size of the buffer on input and the
+    // number of bytes received on output
+    WORD                            Size;
+
+    // the destination when sending, the source when receiving
+    IP4_ADDRESS                     Address;
+    PORT_NUMBER                     Port;
+} NET_UDP_DATAGRAM, *PNET_UDP_DATAGRAM;
+
+// Binds an endpoint to LocalPort on all the configured devices, if LocalPort
+// is 0 a free ephemeral port is chosen. The port numbers are in host byte
+// order.
+STATUS
+NetUdpOpen(
+    IN              PORT_NUMBER                     LocalPort,
+    OUT             PNET_UDP_ENDPOINT*              Endpoint
+    );
+
+// No other thread may use the endpoint once it is closed
+void
+NetUdpClose(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    );
+
+PORT_NUMBER
+NetUdpGetLocalPort(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    );
+
+STATUS
+NetUdpSend(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    IN              IP4_ADDRESS                     Destination,
+    IN              PORT_NUMBER                     DestinationPort,
+    IN_READS_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              WORD                            Size
+    );
+
+// Sends the datagrams in order, consecutive datagrams going through the same
+// device are handed to it with a single NetSendFrames call. Stops at the
+// first datagram which cannot be sent, its error is returned only if none
+// of the datagrams was sent.
+STATUS
+NetUdpSendBatch(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    IN_READS(NumberOfDatagrams)
+                    PNET_UDP_DATAGRAM               Datagrams,
+    IN              DWORD                           NumberOfDatagrams,
+    OUT             DWORD*                          DatagramsSent
+    );
+
+// Waits for a datagram, if it does not fit in the buffer its end is lost
+STATUS
+NetUdpReceive(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    OUT_WRITES_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              WORD                            Size,
+    OUT             WORD*                           BytesReceived,
+    OUT_OPT         IP4_ADDRESS*                    Source,
+    OUT_OPT         PORT_NUMBER*                    SourcePort
+    );
+
+// Waits for a datagram, then receives as many of the queued datagrams as fit
+// in the array without waiting for more of them
+STATUS
+NetUdpReceiveBatch(
+    IN              PNET_UDP_ENDPOINT               Endpoint,
+    INOUT_UPDATES(NumberOfDatagrams)
+                    PNET_UDP_DATAGRAM               Datagrams,
+    IN              DWORD                           NumberOfDatagrams,
+    OUT             DWORD*                          DatagramsReceived
+    );
+
+// Returns the NET_POLL_* flags, it never waits
+DWORD
+NetUdpPoll(
+    IN              PNET_UDP_ENDPOINT               Endpoint
+    );
+
+typedef struct _NET_TCP_LISTENER*   PNET_TCP_LISTENER;
+typedef struct _NET_TCP_CONNECTION* PNET_TCP_CONNECTION;
+
+// Accepts connections on LocalPort (host byte order), at most Backlog of
+// them may wait to be accepted or to complete their handshake
+STATUS
+NetTcpListen(
+    IN              PORT_NUMBER                     LocalPort,
+    IN              DWORD                           Backlog,
+    OUT             PNET_TCP_LISTENER*              Listener
+    );
+
+// Waits for an established connection, it must be closed with NetTcpClose
+STATUS
+NetTcpAccept(
+    IN              PNET_TCP_LISTENER               Listener,
+    OUT             PNET_TCP_CONNECTION*            Connection
+    );
+
+// NET_POLL_READ means NetTcpAccept will not wait
+DWORD
+NetTcpPollListener(
+    IN              PNET_TCP_LISTENER               Listener
+    );
+
+// The connections not yet accepted are reset
+void
+NetTcpCloseListener(
+    IN              PNET_TCP_LISTENER               Listener
+    );
+
+// Waits for the handshake to complete, fails with STATUS_CONNECTION_REFUSED
+// if the peer resets it or with STATUS_TIMEOUT if it does not answer
+STATUS
+NetTcpConnect(
+    IN              IP4_ADDRESS                     Destination,
+    IN              PORT_NUMBER                     DestinationPort,
+    OUT             PNET_TCP_CONNECTION*            Connection
+    );
+
+// Returns once all the data is queued for sending, waiting for space in
+// the send buffer if needed
+STATUS
+NetTcpSend(
+    IN              PNET_TCP_CONNECTION             Connection,
+    IN_READS_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesSent
+    );
+
+// Waits until some data is available, 0 bytes are received once the peer
+// closed its side of the connection
+STATUS
+NetTcpReceive(
+    IN              PNET_TCP_CONNECTION             Connection,
+    OUT_WRITES_BYTES(Size)
+                    PVOID                           Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesReceived
+    );
+
+void
+NetTcpGetRemoteAddress(
+    IN              PNET_TCP_CONNECTION             Connection,
+    OUT             IP4_ADDRESS*                    Address,
+    OUT             PORT_NUMBER*                    Port
+    );
+
+// NET_POLL_READ means NetTcpReceive will not wait, NET_POLL_WRITE that the
+// send buffer has free space or that NetTcpSend fails without waiting
+DWORD
+NetTcpPoll(
+    IN              PNET_TCP_CONNECTION             Connection
+    );
+
+// Sends a FIN after the queued data, the connection can still receive
+STATUS
+NetTcpShutdown(
+    IN              PNET_TCP_CONNECTION             Connection
+    );
+
+// Shuts down the connection if not already done and releases the handle,
+// the connection lingers until the peer acknowledges everything. No other
+// thread may use the handle once it is closed.
+void
+NetTcpClose(
+    IN              PNET_TCP_CONNECTION             Connection
+    );
+// The layers of the stack crossed by a UDP datagram sent to a local address,
+// each of them is charged only for its own work
+typedef enum _NET_LAYER
+{
+    // building the UDP header and copying the data
+    NetLayerUdpSend,
+
+    // building the IPv4 header and resolving the destination
+    NetLayerIp4Send,
+
+    // handing the frames to the device, without the work of its transmit
+    // thread which is reported in NETWORK_DEVICE_STATS.TxCycles
+    NetLayerDeviceSend,
+
+    // validating the IPv4 header of a received packet
+    NetLayerIp4Receive,
+
+    // validating the datagram and queuing it to its endpoint
+    NetLayerUdpReceive,
+
+    NetLayerReserved
+} NET_LAYER;
+
+typedef struct _NET_LAYER_STATS
+{
+    QWORD                           Packets;
+    QWORD                           Cycles;
+} NET_LAYER_STATS, *PNET_LAYER_STATS;
+
+// While enabled each layer counts the packets it handles and the TSC cycles
+// spent on them, enabling it resets the statistics
+void
+NetSetLayerProfiling(
+    IN              BOOLEAN                         Enable
+    );
+
+void
+NetGetLayerStatistics(
+    OUT_WRITES(NetLayerReserved)
+                    NET_LAYER_STATS*                Statistics
     );
\ No newline at end of file
@@ -8,6 +8,41 @@ typedef struct _NETWORK_DEVICE_STATUS
     BOOLEAN                         TxEnabled;
 } NETWORK_DEVICE_STATUS, *PNETWORK_DEVICE_STATUS;
 
+// The work a device may take over from the network stack. The capabilities
+// of a device are reported in NETWORK_OFFLOAD_CAPABILITIES, the TX offloads
+// are requested for each frame in NET_FRAME_BUFFER.
+#define NETWORK_OFFLOAD_TX_IP4_CHECKSUM         (1UL<<0)
+#define NETWORK_OFFLOAD_TX_TCP_CHECKSUM         (1UL<<1)
+#define NETWORK_OFFLOAD_TX_UDP_CHECKSUM         (1UL<<2)
+
+// the device splits a large TCP frame in frames of at most MaximumSegmentSize
+// bytes of payload, the IP and TCP checksums of all of them are computed too
+#define NETWORK_OFFLOAD_TX_TCP_SEGMENTATION     (1UL<<3)
+
+#define NETWORK_OFFLOAD_RX_IP4_CHECKSUM         (1UL<<4)
+#define NETWORK_OFFLOAD_RX_TCP_UDP_CHECKSUM     (1UL<<5)
+
+#define NETWORK_OFFLOAD_TX_MASK                 (NETWORK_OFFLOAD_TX_IP4_CHECKSUM | NETWORK_OFFLOAD_TX_TCP_CHECKSUM | \
+                                                 NETWORK_OFFLOAD_TX_UDP_CHECKSUM | NETWORK_OFFLOAD_TX_TCP_SEGMENTATION)
+
+typedef struct _NETWORK_OFFLOAD_CAPABILITIES
+{
+    DWORD                   Offloads;
+
+    // the largest frame which may be sent with
+    // NETWORK_OFFLOAD_TX_TCP_SEGMENTATION, the other frames cannot be larger
+    // than the MTU of the device
+    DWORD                   MaximumSegmentationSize;
+} NETWORK_OFFLOAD_CAPABILITIES, *PNETWORK_OFFLOAD_CAPABILITIES;
+
+// The checksums verified by the device for a received frame, reported in
+// NET_LOANED_FRAME. If neither the GOOD nor the BAD flag of a header is set
+// the device did not verify it and the stack must do it.
+#define NETWORK_RX_CHECKSUM_IP4_GOOD            (1UL<<0)
+#define NETWORK_RX_CHECKSUM_IP4_BAD             (1UL<<1)
+#define NETWORK_RX_CHECKSUM_TCP_UDP_GOOD        (1UL<<2)
+#define NETWORK_RX_CHECKSUM_TCP_UDP_BAD         (1UL<<3)
+
 typedef struct _NETWORK_DEVICE_INFO
 {
     DEVICE_ID               DeviceId;
@@ -16,6 +51,13 @@ typedef struct _NETWORK_DEVICE_INFO
 
     NETWORK_DEVICE_STATUS   DeviceStatus;
     BOOLEAN                 LinkStatus;
+
+    NETWORK_OFFLOAD_CAPABILITIES OffloadCapabilities;
+
+    // valid only if Ip4Configured is set
+    BOOLEAN                 Ip4Configured;
+    IP4_ADDRESS             Ip4Address;
+    IP4_ADDRESS             SubnetMask;
 } NETWORK_DEVICE_INFO, *PNETWORK_DEVICE_INFO;
 
 typedef struct _NETWORK_FRAME_STATS
@@ -26,8 +68,118 @@ typedef struct _NETWORK_FRAME_STATS
     QWORD                   LargestPacket;
 } NETWORK_FRAME_STATS, *PNETWORK_FRAME_STATS;
 
+typedef struct _NETWORK_DEVICE_TUNING
+{
+    // number of descriptors in the device rings, chosen when the device is
+    // initialized => they are only reported
+    DWORD                   RxRingSize;
+    DWORD                   TxRingSize;
+
+    // if set the device chooses the interrupt timers from the observed
+    // traffic and the timers below are only reported
+    BOOLEAN                 AdaptiveModeration;
+
+    // all the timers are in microseconds
+    DWORD                   InterruptThrottleUs;
+    DWORD                   RxDelayUs;
+    DWORD                   RxAbsoluteDelayUs;
+    DWORD                   TxDelayUs;
+    DWORD                   TxAbsoluteDelayUs;
+} NETWORK_DEVICE_TUNING, *PNETWORK_DEVICE_TUNING;
+
+// filled in only by the devices which switch from interrupts to polling
+// when receiving frames
+typedef struct _NETWORK_RX_POLL_STATS
+{
+    // RX interrupts taken, each of them scheduled a poll
+    QWORD                   Interrupts;
+
+    // frames received by the polls
+    QWORD                   FramesPolled;
+    QWORD                   PollPasses;
+
+    // passes which consumed their whole budget and did not re-enable the
+    // interrupts
+    QWORD                   BudgetExhausted;
+} NETWORK_RX_POLL_STATS, *PNETWORK_RX_POLL_STATS;
+
+// maximum number of RX/TX queue pairs a device may use
+#define NETWORK_MAX_QUEUES          2
+
+typedef struct _NETWORK_QUEUE_STATS
+{
+    NETWORK_FRAME_STATS     RxStats;
+    NETWORK_FRAME_STATS     TxStats;
+
+    // filled in only by the devices which have a vector for each queue
+    QWORD                   RxInterrupts;
+    QWORD                   TxInterrupts;
+} NETWORK_QUEUE_STATS, *PNETWORK_QUEUE_STATS;
+
 typedef struct _NETWORK_DEVICE_STATS
 {
+    // the totals of all the queues
     NETWORK_FRAME_STATS     RxStats;
     NETWORK_FRAME_STATS     TxStats;
-} NETWORK_DEVICE_STATS, *PNETWORK_DEVICE_STATS;
\ No newline at end of file
+
+    // frames dropped because no receive buffer was available
+    QWORD                   RxFramesDropped;
+
+    NETWORK_RX_POLL_STATS   RxPollStats;
+
+    // number of times the TX frames were handed to the device, all the
+    // frames of a batch are announced to it with a single register write
+    QWORD                   TxBatches;
+
+    // TSC cycles the transmit threads spent copying the frames to the TX
+    // ring and handing them to the device. For the virtual devices this
+    // includes delivering the frames, as they complete them synchronously.
+    QWORD                   TxCycles;
+
+    DWORD                   NumberOfQueues;
+    NETWORK_QUEUE_STATS     QueueStats[NETWORK_MAX_QUEUES];
+} NETWORK_DEVICE_STATS, *PNETWORK_DEVICE_STATS;
+
+struct _NET_LOANED_FRAME;
+
+typedef
+void
+(__cdecl FUNC_NetFrameFree)(
+    INOUT   struct _NET_LOANED_FRAME*   Frame
+    );
+
+typedef FUNC_NetFrameFree*      PFUNC_NetFrameFree;
+
+// A frame to send, used to hand multiple frames to a device at once.
+// The offloads requested must be supported by the device and only IPv4
+// frames may request them. The device computes the IP header checksum, for
+// the TCP/UDP checksums the checksum field must already hold the checksum of
+// the pseudo header, computed with a 0 length for segmentation.
+typedef struct _NET_FRAME_BUFFER
+{
+    PETHERNET_FRAME         Frame;
+    DWORD                   Length;
+
+    // NETWORK_OFFLOAD_TX_*
+    DWORD                   Offloads;
+
+    // valid only for NETWORK_OFFLOAD_TX_TCP_SEGMENTATION
+    WORD                    MaximumSegmentSize;
+} NET_FRAME_BUFFER, *PNET_FRAME_BUFFER;
+
+// A received frame lent to the consumers directly from the DMA buffer in
+// which the device placed it. The frame is returned to the receive pool of
+// its device when the last reference is released.
+typedef struct _NET_LOANED_FRAME
+{
+    PETHERNET_FRAME         Frame;
+    DWORD                   Length;
+
+    // NETWORK_RX_CHECKSUM_*
+    DWORD                   ChecksumStatus;
+
+    volatile DWORD          ReferenceCount;
+
+    // called by the last NetReleaseFrame
+    PFUNC_NetFrameFree      FreeRoutine;
+} NET_LOANED_FRAME, *PNET_LOANED_FRAME;
@@ -51,6 +51,9 @@ typedef struct _IP6_ADDRESS
 #define ARP_PACKET_SIZE                     28
 #define IEEE_802_3_MINIMUM_FRAME_SIZE       64
 
+// the largest payload of an ethernet frame
+#define ETHERNET_MTU                        1500
+
 typedef WORD        ETHERNET_FRAME_TYPE;
 
 #define ETHERNET_FRAME_TYPE_IP4         __pragma(warning(suppress: 4310)) ((WORD)0x0800ui16)
@@ -112,6 +115,15 @@ typedef BYTE        IP_PROTOCOL;
 #define IP_PROTOCOL_TCP                 6
 #define IP_PROTOCOL_UDP                 17
 
+#define IP4_VERSION                     4
+
+// the values of FragmentInformation, in host byte order
+#define IP4_FLAG_DONT_FRAGMENT          (1<<14)
+#define IP4_FLAG_MORE_FRAGMENTS         (1<<13)
+#define IP4_FRAGMENT_OFFSET_MASK        0x1FFF
+
+#define IP4_DEFAULT_TIME_TO_LIVE        64
+
 typedef struct _IP4_PACKET
 {
     // size in DWORDs
@@ -125,7 +137,8 @@ typedef struct _IP4_PACKET
 
     WORD            Id;
 
-    WORD            __Reserved0;
+    // IP4_FLAG_* and the fragment offset in units of 8 bytes
+    WORD            FragmentInformation;
 
     BYTE            TimeToLive;
 
@@ -159,6 +172,21 @@ STATIC_ASSERT(sizeof(IP6_PACKET) == IP6_PACKET_SIZE);
 
 #define UDP_DATAGRAM_SIZE               8
 #define TCP_SEGMENT_SIZE                20
+#define ICMP_ECHO_SIZE                  8
+
+#define ICMP_TYPE_ECHO_REPLY            0
+#define ICMP_TYPE_ECHO_REQUEST          8
+
+typedef struct _ICMP_ECHO
+{
+    BYTE                Type;
+    BYTE                Code;
+    WORD                Checksum;
+    WORD                Identifier;
+    WORD                SequenceNumber;
+    BYTE                Data[0];
+} ICMP_ECHO, *PICMP_ECHO;
+STATIC_ASSERT(sizeof(ICMP_ECHO) == ICMP_ECHO_SIZE);
 
 typedef WORD    PORT_NUMBER;
 
@@ -171,6 +199,17 @@ typedef struct _UDP_DATAGRAM
 } UDP_DATAGRAM, *PUDP_DATAGRAM;
 STATIC_ASSERT(sizeof(UDP_DATAGRAM) == UDP_DATAGRAM_SIZE);
 
+#define TCP_OPTION_END                  0
+#define TCP_OPTION_NOP                  1
+#define TCP_OPTION_MSS                  2
+#define TCP_OPTION_WINDOW_SCALE         3
+
+#define TCP_OPTION_MSS_SIZE             4
+#define TCP_OPTION_WINDOW_SCALE_SIZE    3
+
+// RFC 7323: the window can be scaled by at most 2^14
+#define TCP_MAX_WINDOW_SCALE            14
+
 typedef struct _TCP_SEGMENT
 {
     PORT_NUMBER         Source;
@@ -179,20 +218,23 @@ typedef struct _TCP_SEGMENT
     DWORD               AckNumber;
     struct
     {
-        // 1st byte
-        BYTE            CWR             : 1;
-        BYTE            ECE             : 1;
-        BYTE            URG             : 1;
-        BYTE            ACK             : 1;
-        BYTE            PSH             : 1;
-        BYTE            RST             : 1;
-        BYTE            SYN             : 1;
-        BYTE            FIN             : 1;
+        // 1st byte, the bit fields are allocated starting with the least
+        // significant bit
+        BYTE            NS              : 1;
+        BYTE            __Reserved0     : 3;
 
-        // 2nd byte
+        // size of the header in DWORDs
         BYTE            DataOffset      : 4;
-        BYTE            __Reserved0     : 3;
-        BYTE            NS              : 1;
+
+        // 2nd byte
+        BYTE            FIN             : 1;
+        BYTE            SYN             : 1;
+        BYTE            RST             : 1;
+        BYTE            PSH             : 1;
+        BYTE            ACK             : 1;
+        BYTE            URG             : 1;
+        BYTE            ECE             : 1;
+        BYTE            CWR             : 1;
     };
     WORD                WindowSize;
     WORD                Checksum;
@@ -6,6 +6,11 @@
 #define TEXT_IP4_ADDRESS_CHARS_REQUIRED             16
 #define TEXT_IP6_ADDRESS_CHARS_REQUIRED             40
 
+// the protocol headers are in network byte order (big endian)
+#define NETWORK_ORDER_WORD(x)                       ((WORD)((((WORD)(x)) << 8) | (((WORD)(x)) >> 8)))
+#define NETWORK_ORDER_DWORD(x)                      ((DWORD)(((DWORD)NETWORK_ORDER_WORD((DWORD)(x) & MAX_WORD) << 16) | \
+                                                             NETWORK_ORDER_WORD((DWORD)(x) >> 16)))
+
 char*
 NetUtilMacAddressToText(
     IN                                                          MAC_ADDRESS         Address,
@@ -16,4 +21,27 @@ char*
 NetUtilIp4AddressToText(
     IN                                                          IP4_ADDRESS         Address,
     OUT_WRITES_BYTES_ALL(TEXT_IP4_ADDRESS_CHARS_REQUIRED)       char*               Buffer
+    );
+
+STATUS
+NetUtilTextToIp4Address(
+    IN_Z                                                        char*               Text,
+    OUT                                                         IP4_ADDRESS*        Address
+    );
+
+// Adds the 16 bit words of a buffer to the one's complement sum used by the
+// IPv4, ICMP, UDP and TCP checksums. The words are summed in the order they
+// are in memory, the result can be used as it is in the headers. Only the
+// last buffer of a sum may have an odd length.
+DWORD
+NetUtilChecksumAdd(
+    IN_READS_BYTES(Length)                                      PVOID               Buffer,
+    IN                                                          DWORD               Length,
+    IN                                                          DWORD               PartialSum
+    );
+
+// Folds the sum to 16 bits and returns its one's complement
+WORD
+NetUtilChecksumFinish(
+    IN                                                          DWORD               PartialSum
     );
\ No newline at end of file